@@ -17,6 +17,7 @@ EXTRA_SRCS :=
 ifeq ($(HOST_OS),linux)
   USB_SRCS := usb_linux.c
   EXTRA_SRCS := get_my_path_linux.c
+  EXTRA_STATIC_LIBS := libusbhost
   LOCAL_LDLIBS += -lrt -lncurses -lpthread
 endif
 
@@ -49,11 +50,13 @@ LOCAL_SRC_FILES := \
 	adb_client.c \
 	sockets.c \
 	services.c \
+	device_pool.c \
 	file_sync_client.c \
 	$(EXTRA_SRCS) \
 	$(USB_SRCS) \
-	shlist.c \
+	adb_list.c \
 	utils.c \
+	trace.c \
 
 
 ifneq ($(USE_SYSDEPS_WIN32),)
@@ -62,9 +65,11 @@ endif
 
 LOCAL_CFLAGS += -O2 -g -DADB_HOST=1  -Wall -Wno-unused-parameter
 LOCAL_CFLAGS += -D_XOPEN_SOURCE -D_GNU_SOURCE -DSH_HISTORY
+LOCAL_C_INCLUDES += external/zlib
 LOCAL_MODULE := adb
 
-LOCAL_STATIC_LIBRARIES := libzipfile libunz $(EXTRA_STATIC_LIBS)
+# libz (not libunz) because the sync client also deflates
+LOCAL_STATIC_LIBRARIES := libzipfile libz $(EXTRA_STATIC_LIBS)
 ifeq ($(USE_SYSDEPS_WIN32),)
 	LOCAL_STATIC_LIBRARIES += libcutils
 endif
@@ -112,6 +117,7 @@ LOCAL_SRC_FILES := \
 	usb_linux_client.c \
 	log_service.c \
 	utils.c \
+	trace.c \
 
 LOCAL_CFLAGS := -O2 -g -DADB_HOST=0 -Wall -Wno-unused-parameter
 LOCAL_CFLAGS += -D_XOPEN_SOURCE -D_GNU_SOURCE
@@ -122,6 +128,7 @@ ifeq ($(TARGET_ARCH),arm)
 LOCAL_CFLAGS += -DANDROID_GADGET=1
 endif
 
+LOCAL_C_INCLUDES += external/zlib
 LOCAL_MODULE := adbd
 
 LOCAL_FORCE_STATIC_EXECUTABLE := true
@@ -129,11 +136,11 @@ LOCAL_MODULE_PATH := $(TARGET_ROOT_OUT_SBIN)
 LOCAL_UNSTRIPPED_PATH := $(TARGET_ROOT_OUT_SBIN_UNSTRIPPED)
 
 ifeq ($(TARGET_SIMULATOR),true)
-  LOCAL_STATIC_LIBRARIES := libcutils
+  LOCAL_STATIC_LIBRARIES := libcutils libz
   LOCAL_LDLIBS += -lpthread
   include $(BUILD_HOST_EXECUTABLE)
 else
-  LOCAL_STATIC_LIBRARIES := libcutils libc
+  LOCAL_STATIC_LIBRARIES := libcutils libz libc
   include $(BUILD_EXECUTABLE)
 endif
 
@@ -23,12 +23,16 @@
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "sysdeps.h"
 #include "adb.h"
 
+#include <cutils/threads.h>
+
 #if !ADB_HOST
 #include <private/android_filesystem_config.h>
+#include <cutils/properties.h>
 #endif
 
 
@@ -59,81 +63,178 @@ void fatal_errno(const char *fmt, ...)
 }
 
 int   adb_trace_mask;
+int   adb_trace_ring_mask;
 
 /* read a comma/space/colum/semi-column separated list of tags
  * from the ADB_TRACE environment variable and build the trace
  * mask from it. note that '1' and 'all' are special cases to
- * enable all tracing
+ * enable all tracing.  both masks can be changed later at runtime
+ * through the host:trace service.
  */
 void  adb_trace_init(void)
 {
     const char*  p = getenv("ADB_TRACE");
-    const char*  q;
-
-    static const struct {
-        const char*  tag;
-        int           flag;
-    } tags[] = {
-        { "1", 0 },
-        { "all", 0 },
-        { "adb", TRACE_ADB },
-        { "sockets", TRACE_SOCKETS },
-        { "packets", TRACE_PACKETS },
-        { "rwx", TRACE_RWX },
-        { "usb", TRACE_USB },
-        { "sync", TRACE_SYNC },
-        { "sysdeps", TRACE_SYSDEPS },
-        { "transport", TRACE_TRANSPORT },
-        { "jdwp", TRACE_JDWP },
-        { NULL, 0 }
-    };
 
     if (p == NULL)
             return;
 
-    /* use a comma/column/semi-colum/space separated list */
-    while (*p) {
-        int  len, tagn;
+    adb_trace_mask = adb_trace_parse_tags(p);
+}
 
-        q = strpbrk(p, " ,:;");
-        if (q == NULL) {
-            q = p + strlen(p);
-        }
-        len = q - p;
-
-        for (tagn = 0; tags[tagn].tag != NULL; tagn++)
-        {
-            int  taglen = strlen(tags[tagn].tag);
-
-            if (len == taglen && !memcmp(tags[tagn].tag, p, len) )
-            {
-                int  flag = tags[tagn].flag;
-                if (flag == 0) {
-                    adb_trace_mask = ~0;
-                    return;
-                }
-                adb_trace_mask |= (1 << flag);
-                break;
-            }
+
+/* apacket and asocket blocks that miss their recycling pools come from
+** a dedicated mspace where the platform has one, so days of connection
+** churn fragment that space instead of the main heap, and "adb heap"
+** can show what the traffic machinery is holding.  blocks are told
+** apart from plain malloc ones (allocated before the space existed, or
+** when it is full) by address: the space is one contiguous mapping.
+*/
+#if !defined(_WIN32)
+#include <stdint.h>
+#include <cutils/mspace.h>
+#define ADB_HEAP_STARTING (256 * 1024)
+#define ADB_HEAP_MAX (64 * 1024 * 1024)
+
+static mspace adb_heap;
+static char *adb_heap_base;
+static char *adb_heap_end;
+static int adb_heap_failed;
+
+ADB_MUTEX_DEFINE( adb_heap_lock );
+
+void *adb_heap_malloc(size_t size)
+{
+    void *p = 0;
+
+    adb_mutex_lock(&adb_heap_lock);
+    if(adb_heap == 0 && !adb_heap_failed) {
+        adb_heap = mspace_for_subsystem("adb", ADB_HEAP_STARTING,
+                                        ADB_HEAP_MAX);
+        if(adb_heap) {
+            unsigned pagemask = getpagesize() - 1;
+            adb_heap_base = (char*) ((uintptr_t) adb_heap & ~(uintptr_t) pagemask);
+            adb_heap_end = adb_heap_base +
+                    ((ADB_HEAP_MAX + pagemask) & ~(uintptr_t) pagemask);
+        } else {
+            adb_heap_failed = 1;
         }
-        p = q;
-        if (*p)
-            p++;
     }
+    adb_mutex_unlock(&adb_heap_lock);
+
+    if(adb_heap) p = mspace_malloc(adb_heap, size);
+    if(p == 0) p = malloc(size);
+    return p;
 }
 
+void adb_heap_free(void *ptr)
+{
+    if((char*) ptr >= adb_heap_base && (char*) ptr < adb_heap_end) {
+        mspace_free(adb_heap, ptr);
+        return;
+    }
+    free(ptr);
+}
 
-apacket *get_apacket(void)
+int adb_heap_report(char *buf, size_t bufsize)
+{
+    return mspace_stats_report(buf, bufsize);
+}
+#else
+void *adb_heap_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void adb_heap_free(void *ptr)
 {
-    apacket *p = malloc(sizeof(apacket));
-    if(p == 0) fatal("failed to allocate an apacket");
-    memset(p, 0, sizeof(apacket) - MAX_PAYLOAD);
+    free(ptr);
+}
+
+int adb_heap_report(char *buf, size_t bufsize)
+{
+    return snprintf(buf, bufsize, "heap isolation not available\n");
+}
+#endif
+
+/* recycled apackets, bucketed by payload capacity.  a sustained
+** transfer turns over one packet per MAX_PAYLOAD of data, so reusing
+** them keeps the malloc/free pair out of the hottest path.  the
+** fixed-size packets sit in a per-thread cache, so a transport's
+** input and output threads each recycle their own without a lock.
+** large packets all share a transport's negotiated size, which makes
+** a first-fit check against the list head sufficient.
+*/
+#define PACKET_POOL_SMALL_THREAD 16
+#define PACKET_POOL_SMALL_MAX 64
+#define PACKET_POOL_LARGE_MAX 16
+
+static thread_cache_t packet_pool_small =
+    THREAD_CACHE_INITIALIZER(sizeof(apacket) + MAX_PAYLOAD,
+                             PACKET_POOL_SMALL_THREAD,
+                             PACKET_POOL_SMALL_MAX);
+
+ADB_MUTEX_DEFINE( packet_pool_lock );
+
+static apacket *packet_pool_large;
+static int packet_pool_large_count;
+
+apacket *get_apacket_size(unsigned size)
+{
+    apacket *p;
+    unsigned alloc;
+
+    if(size < MAX_PAYLOAD) size = MAX_PAYLOAD;
+
+    if(size == MAX_PAYLOAD) {
+        p = thread_cache_alloc(&packet_pool_small);
+        if(p == 0) fatal("failed to allocate an apacket");
+        p->alloc = MAX_PAYLOAD;
+    } else {
+        adb_mutex_lock(&packet_pool_lock);
+        p = packet_pool_large;
+        if(p && p->alloc >= size) {
+            packet_pool_large = p->next;
+            packet_pool_large_count--;
+        } else {
+            p = 0;
+        }
+        adb_mutex_unlock(&packet_pool_lock);
+
+        if(p == 0) {
+            p = adb_heap_malloc(sizeof(apacket) + size);
+            if(p == 0) fatal("failed to allocate an apacket");
+            p->alloc = size;
+        }
+    }
+
+    alloc = p->alloc;
+    memset(p, 0, sizeof(apacket));
+    p->alloc = alloc;
     return p;
 }
 
+apacket *get_apacket(void)
+{
+    return get_apacket_size(MAX_PAYLOAD);
+}
+
 void put_apacket(apacket *p)
 {
-    free(p);
+    if(p->alloc == MAX_PAYLOAD) {
+        thread_cache_release(&packet_pool_small, p);
+        return;
+    }
+
+    adb_mutex_lock(&packet_pool_lock);
+    if(packet_pool_large_count < PACKET_POOL_LARGE_MAX) {
+        p->next = packet_pool_large;
+        packet_pool_large = p;
+        packet_pool_large_count++;
+        p = 0;
+    }
+    adb_mutex_unlock(&packet_pool_lock);
+
+    if(p) adb_heap_free(p);
 }
 
 void handle_online(void)
@@ -169,6 +270,8 @@ void print_packet(const char *label, apacket *p)
     case A_OKAY: tag = "OKAY"; break;
     case A_CLSE: tag = "CLSE"; break;
     case A_WRTE: tag = "WRTE"; break;
+    case A_PING: tag = "PING"; break;
+    case A_PONG: tag = "PONG"; break;
     default: tag = "????"; break;
     }
 
@@ -214,21 +317,104 @@ static void send_close(unsigned local, unsigned remote, atransport *t)
     send_packet(p, t);
 }
 
+static void send_connect(atransport *t);
+
+#if ADB_HOST
+/* protocol keepalive.  The default kernel timeouts leave a zombie
+** transport for minutes after a networked device powers off, with
+** writes blocking until the send buffer fills.  Instead the host
+** pings each network transport off the event loop; a pong resets
+** the miss counter and yields a round-trip sample (reported by
+** host:stats), and too many missed pongs kicks the transport at
+** once.  host:keepalive:<interval_ms>[:<misses>] reconfigures this;
+** an interval of 0 disables it for transports connected afterwards.
+*/
+#define KEEPALIVE_INTERVAL_MS  5000
+#define KEEPALIVE_MISSES       3
+
+static int keepalive_interval_ms = KEEPALIVE_INTERVAL_MS;
+static int keepalive_misses = KEEPALIVE_MISSES;
+
+static long long now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return ((long long) tv.tv_sec) * 1000LL + tv.tv_usec / 1000;
+}
+
+static void keepalive_func(void *arg)
+{
+    atransport *t = arg;
+    apacket *p;
+
+    if(t->connection_state == CS_OFFLINE) return;
+    if(keepalive_interval_ms <= 0) return;
+
+    if(t->pings_missed >= (unsigned) keepalive_misses) {
+        D("transport %p: %u pongs missed, declaring link dead\n",
+          t, t->pings_missed);
+        t->connection_state = CS_OFFLINE;
+        handle_offline(t);
+        update_transports();
+        kick_transport(t);
+        return;
+    }
+
+    p = get_apacket();
+    p->msg.command = A_PING;
+    p->msg.arg0 = ++t->ping_token;
+    t->ping_sent_ms = now_ms();
+    t->pings_missed++;
+    send_packet(p, t);
+
+    fdevent_timer_set(&t->ping_timer, keepalive_func, t,
+                      keepalive_interval_ms);
+}
+#endif
+
+#if ADB_HOST
+/* devices sometimes miss the first CNXN while they are still coming
+** up, so retry a few times off the event loop.  this used to be a
+** fixed 1s sleep after every CNXN, which stalled the whole server --
+** every forward, every other device -- each time a device connected.
+*/
+#define CONNECT_RETRY_MS   1000
+#define CONNECT_RETRY_MAX  3
+
+static void connect_retry_func(void *arg)
+{
+    atransport *t = arg;
+
+    if(t->connection_state != CS_OFFLINE) return;
+    if(t->connect_retries >= CONNECT_RETRY_MAX) {
+        D("transport %p: no answer to connect, giving up\n", t);
+        return;
+    }
+    t->connect_retries++;
+    send_connect(t);
+}
+#endif
+
 static void send_connect(atransport *t)
 {
     D("Calling send_connect \n");
     apacket *cp = get_apacket();
     cp->msg.command = A_CNXN;
     cp->msg.arg0 = A_VERSION;
-    cp->msg.arg1 = MAX_PAYLOAD;
-    snprintf((char*) cp->data, sizeof cp->data, "%s::",
+    cp->msg.arg1 = MAX_PAYLOAD_LARGE;
+        /* the banner is "<type>:<product>:<prop>=<value>;...".  we
+        ** advertise no properties: in particular not "wcoal", since
+        ** our own usb reads take the 24-byte header as its own
+        ** transfer and cannot accept a coalesced packet.
+        */
+    snprintf((char*) cp->data, cp->alloc, "%s::",
             HOST ? "host" : adb_device_banner);
     cp->msg.data_length = strlen((char*) cp->data) + 1;
     send_packet(cp, t);
 #if ADB_HOST
-        /* XXX why sleep here? */
-    // allow the device some time to respond to the connect message
-    adb_sleep_ms(1000);
+    fdevent_timer_set(&t->connect_timer, connect_retry_func, t,
+                      CONNECT_RETRY_MS);
 #endif
 }
 
@@ -252,7 +438,7 @@ static char *connection_state_name(atransport *t)
 
 void parse_banner(char *banner, atransport *t)
 {
-    char *type, *product, *end;
+    char *type, *product, *props;
 
     D("parse_banner: %s\n", banner);
     type = banner;
@@ -263,9 +449,31 @@ void parse_banner(char *banner, atransport *t)
         product = "";
     }
 
-        /* remove trailing ':' */
-    end = strchr(product, ':');
-    if(end) *end = 0;
+        /* anything after the second ':' is a list of "name=value"
+        ** properties separated by ';'.  old peers send nothing there.
+        */
+    props = strchr(product, ':');
+    if(props) *props++ = 0;
+
+    t->coalesce_writes = 0;
+    while(props && *props) {
+        char *key = props;
+        char *value, *next;
+
+        next = strchr(key, ';');
+        if(next) *next++ = 0;
+        props = next;
+
+        value = strchr(key, '=');
+        if(value) *value++ = 0;
+
+        if(!strcmp(key, "wcoal")) {
+                /* the peer's usb stack accepts the packet header and
+                ** payload as a single coalesced bulk transfer
+                */
+            t->coalesce_writes = value ? atoi(value) : 1;
+        }
+    }
 
         /* save product name in device structure */
     if (t->product == NULL) {
@@ -311,9 +519,11 @@ void handle_packet(apacket *p, atransport *t)
     case A_SYNC:
         if(p->msg.arg0){
             send_packet(p, t);
+            t->connect_retries = 0;
             if(HOST) send_connect(t);
         } else {
             t->connection_state = CS_OFFLINE;
+            fdevent_timer_cancel(&t->connect_timer);
             handle_offline(t);
             send_packet(p, t);
         }
@@ -326,8 +536,18 @@ void handle_packet(apacket *p, atransport *t)
             handle_offline(t);
         }
         parse_banner((char*) p->data, t);
+        fdevent_timer_cancel(&t->connect_timer);
         handle_online();
         if(!HOST) send_connect(t);
+#if ADB_HOST
+            /* USB links fail fast on their own; only network
+            ** transports need the keepalive */
+        if(t->type == kTransportLocal && keepalive_interval_ms > 0) {
+            t->pings_missed = 0;
+            fdevent_timer_set(&t->ping_timer, keepalive_func, t,
+                              keepalive_interval_ms);
+        }
+#endif
         break;
 
     case A_OPEN: /* OPEN(local-id, 0, "destination") */
@@ -381,6 +601,20 @@ void handle_packet(apacket *p, atransport *t)
         }
         break;
 
+    case A_PING: /* PING(token, 0, "") - echo back as a PONG */
+        p->msg.command = A_PONG;
+        send_packet(p, t);
+        return;
+
+    case A_PONG:
+#if ADB_HOST
+        if(p->msg.arg0 == t->ping_token) {
+            t->rtt_ms = (unsigned)(now_ms() - t->ping_sent_ms);
+            t->pings_missed = 0;
+        }
+#endif
+        break;
+
     default:
         printf("handle_packet: what is %08x?!\n", p->msg.command);
     }
@@ -393,6 +627,56 @@ alistener listener_list = {
     .prev = &listener_list,
 };
 
+/* listeners are also indexed by local_name, so installs, removals and
+** rebinds stay O(1) with thousands of forwards in place.  the doubly
+** linked list above is kept for plain enumeration.
+*/
+#define LISTENER_HASH_SIZE 256      /* power of two */
+
+static alistener *listener_hash[LISTENER_HASH_SIZE];
+
+static unsigned hash_listener_name(const char *name)
+{
+    unsigned h = 0x811c9dc5;
+
+    while(*name) {
+        h ^= (unsigned char) *name++;
+        h *= 16777619;
+    }
+    return h & (LISTENER_HASH_SIZE - 1);
+}
+
+static alistener *find_listener(const char *local_name)
+{
+    alistener *l;
+
+    for(l = listener_hash[hash_listener_name(local_name)]; l; l = l->hnext) {
+        if(!strcmp(local_name, l->local_name)) return l;
+    }
+    return 0;
+}
+
+static void hash_insert_listener(alistener *l)
+{
+    alistener **bucket = &listener_hash[hash_listener_name(l->local_name)];
+
+    l->hnext = *bucket;
+    *bucket = l;
+}
+
+static void hash_remove_listener(alistener *l)
+{
+    alistener **lp = &listener_hash[hash_listener_name(l->local_name)];
+
+    for(; *lp; lp = &(*lp)->hnext) {
+        if(*lp == l) {
+            *lp = l->hnext;
+            l->hnext = 0;
+            return;
+        }
+    }
+}
+
 static void ss_listener_event_func(int _fd, unsigned ev, void *_l)
 {
     asocket *s;
@@ -449,6 +733,7 @@ static void  free_listener(alistener*  l)
         l->next->prev = l->prev;
         l->prev->next = l->next;
         l->next = l->prev = l;
+        hash_remove_listener(l);
     }
 
     // closes the corresponding fd
@@ -503,16 +788,13 @@ int local_name_to_fd(const char *name)
 
 static int remove_listener(const char *local_name, const char *connect_to, atransport* transport)
 {
-    alistener *l;
+    alistener *l = find_listener(local_name);
 
-    for (l = listener_list.next; l != &listener_list; l = l->next) {
-        if (!strcmp(local_name, l->local_name) &&
-            !strcmp(connect_to, l->connect_to) &&
-            l->transport && l->transport == transport) {
+    if (l && !strcmp(connect_to, l->connect_to) &&
+        l->transport && l->transport == transport) {
 
-            listener_disconnect(l, transport);
-            return 0;
-        }
+        listener_disconnect(l, transport);
+        return 0;
     }
 
     return -1;
@@ -524,30 +806,28 @@ static int install_listener(const char *local_name, const char *connect_to, atra
 
     //printf("install_listener('%s','%s')\n", local_name, connect_to);
 
-    for(l = listener_list.next; l != &listener_list; l = l->next){
-        if(strcmp(local_name, l->local_name) == 0) {
-            char *cto;
+    if((l = find_listener(local_name)) != 0) {
+        char *cto;
 
-                /* can't repurpose a smartsocket */
-            if(l->connect_to[0] == '*') {
-                return -1;
-            }
+            /* can't repurpose a smartsocket */
+        if(l->connect_to[0] == '*') {
+            return -1;
+        }
 
-            cto = strdup(connect_to);
-            if(cto == 0) {
-                return -1;
-            }
+        cto = strdup(connect_to);
+        if(cto == 0) {
+            return -1;
+        }
 
-            //printf("rebinding '%s' to '%s'\n", local_name, connect_to);
-            free((void*) l->connect_to);
-            l->connect_to = cto;
-            if (l->transport != transport) {
-                remove_transport_disconnect(l->transport, &l->disconnect);
-                l->transport = transport;
-                add_transport_disconnect(l->transport, &l->disconnect);
-            }
-            return 0;
+        //printf("rebinding '%s' to '%s'\n", local_name, connect_to);
+        free((void*) l->connect_to);
+        l->connect_to = cto;
+        if (l->transport != transport) {
+            remove_transport_disconnect(l->transport, &l->disconnect);
+            l->transport = transport;
+            add_transport_disconnect(l->transport, &l->disconnect);
         }
+        return 0;
     }
 
     if((l = calloc(1, sizeof(alistener))) == 0) goto nomem;
@@ -576,6 +856,7 @@ static int install_listener(const char *local_name, const char *connect_to, atra
     l->prev = listener_list.prev;
     l->next->prev = l;
     l->prev->next = l;
+    hash_insert_listener(l);
     l->transport = transport;
 
     if (transport) {
@@ -675,6 +956,45 @@ void start_device_log(void)
     // except TRACE_RWX is a bit too verbose
     adb_trace_mask &= ~TRACE_RWX;
 }
+
+// apply configuration changes from properties without restarting:
+// a restart costs a USB re-enumeration per device, which is what a
+// farm flipping thirty devices between USB and TCP wants to avoid.
+// sleeps on the property area and reacts when something changes.
+//
+//   service.adb.tcp.port   (re)opens the TCP listener on that port,
+//                          empty or 0 closes it; connected transports
+//                          stay up either way
+//   adb.trace              same tag list ADB_TRACE takes; replaces
+//                          the trace mask, empty clears it
+static void *config_watch_thread(void *x)
+{
+    char tcp[PROPERTY_VALUE_MAX];
+    char trace[PROPERTY_VALUE_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    unsigned serial = 0;
+
+    tcp[0] = 0;
+    trace[0] = 0;
+    for(;;) {
+        serial = property_wait(0, serial);
+
+        property_get("service.adb.tcp.port", value, "");
+        if(strcmp(value, tcp) != 0) {
+            strcpy(tcp, value);
+            D("config: tcp port '%s'\n", value);
+            local_set_tcp_port(atoi(value));
+        }
+
+        property_get("adb.trace", value, "");
+        if(strcmp(value, trace) != 0) {
+            strcpy(trace, value);
+            adb_trace_mask = adb_trace_parse_tags(value);
+            D("config: trace mask %08x\n", (unsigned)adb_trace_mask);
+        }
+    }
+    return 0;
+}
 #endif
 
 #if ADB_HOST
@@ -898,6 +1218,15 @@ int adb_main(int is_daemon)
         local_init();
     }
     init_jdwp();
+
+    {
+        /* watch for runtime configuration changes; not fatal if this
+        ** fails, we just keep the configuration we started with */
+        adb_thread_t thr;
+        if(adb_thread_create(&thr, config_watch_thread, 0)) {
+            D("cannot create config watcher thread\n");
+        }
+    }
 #endif
 
     if (is_daemon)
@@ -963,15 +1292,149 @@ int handle_host_request(char *service, transport_type ttype, char* serial, int r
         return 1;
     }
 
-    // return a list of all connected devices
-    if (!strcmp(service, "devices")) {
+    // return a list of all connected devices, sorted by serial.
+    // "devices-l" adds product and transport columns for parsers
+    if (!strcmp(service, "devices") || !strcmp(service, "devices-l")) {
+        char extra[4096];
+        char head[9];
+        char *list;
+        unsigned len;
+        D("Getting device list \n");
+        list = list_transports_alloc(service[7] == '-');
+        if (list == NULL) {
+            sendfailmsg(reply_fd, "out of memory");
+            return 0;
+        }
+        // pool endpoints still dialing or retrying show up here too,
+        // so scripts watching 'adb devices' see the whole lab
+        memset(extra, 0, sizeof(extra));
+        pool_list_disconnected(extra, sizeof(extra));
+        len = strlen(list) + strlen(extra);
+        // the reply framing carries at most 4 hex digits of length
+        if (len > 0xffff) {
+            list[0xffff - strlen(extra)] = 0;
+            len = 0xffff;
+        }
+        snprintf(head, sizeof(head), "OKAY%04x", len);
+        D("Wrote device list \n");
+        if (writex(reply_fd, head, 8) == 0 &&
+            writex(reply_fd, list, strlen(list)) == 0)
+            writex(reply_fd, extra, strlen(extra));
+        free(list);
+        return 0;
+    }
+
+    // event loop latency and per-transport throughput counters, for
+    // chasing farm regressions without an ADB_TRACE rebuild
+    if (!strcmp(service, "stats")) {
         char buffer[4096];
+        unsigned loops, callbacks, lat[FDEVENT_LAT_BUCKETS];
+        int len, i;
         memset(buf, 0, sizeof(buf));
         memset(buffer, 0, sizeof(buffer));
-        D("Getting device list \n");
-        list_transports(buffer, sizeof(buffer));
+        fdevent_get_stats(&loops, &callbacks, lat);
+        len = snprintf(buffer, sizeof(buffer),
+                       "loop iterations %u callbacks %u\ndispatch ms histogram",
+                       loops, callbacks);
+        for (i = 0; i < FDEVENT_LAT_BUCKETS; i++) {
+            len += snprintf(buffer + len, sizeof(buffer) - len,
+                            " %u", lat[i]);
+        }
+        len += snprintf(buffer + len, sizeof(buffer) - len, "\n");
+        dump_transport_stats(buffer + len, sizeof(buffer) - len);
+        snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
+        writex(reply_fd, buf, strlen(buf));
+        return 0;
+    }
+
+    // per-transport queue depth and throughput counters
+    if (!strcmp(service, "features")) {
+        char buffer[4096];
+        memset(buf, 0, sizeof(buf));
+        memset(buffer, 0, sizeof(buffer));
+        dump_transport_stats(buffer, sizeof(buffer));
+        snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
+        writex(reply_fd, buf, strlen(buf));
+        return 0;
+    }
+
+    // keepalive tuning: keepalive:<interval_ms>[:<misses>] changes
+    // how often network transports are pinged and how many missed
+    // pongs mark a link dead.  0 disables pinging.  Applies to
+    // transports connected from now on; replies with the settings
+    if (!strncmp(service, "keepalive:", strlen("keepalive:"))) {
+        char buffer[64];
+        char *arg = service + strlen("keepalive:");
+        char *misses = strchr(arg, ':');
+        memset(buf, 0, sizeof(buf));
+
+        if (misses) {
+            *misses++ = 0;
+            if (atoi(misses) > 0)
+                keepalive_misses = atoi(misses);
+        }
+        keepalive_interval_ms = atoi(arg);
+        if (keepalive_interval_ms < 0)
+            keepalive_interval_ms = 0;
+
+        snprintf(buffer, sizeof(buffer), "interval %d ms misses %d\n",
+                 keepalive_interval_ms, keepalive_misses);
+        snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
+        writex(reply_fd, buf, strlen(buf));
+        return 0;
+    }
+
+    // runtime trace control: adjust which categories are printed or
+    // recorded into the per-thread rings, and dump the rings, so a
+    // transport stall on a live server can be diagnosed after the
+    // fact.  subcommands:
+    //   trace:print:<tags>   set the stderr print mask
+    //   trace:record:<tags>  set the ring recording mask
+    //   trace:dump           dump the recorded events
+    //   trace:status         show both masks
+    // <tags> is the same list ADB_TRACE takes; an empty list clears.
+    if (!strncmp(service, "trace:", strlen("trace:"))) {
+        const char *cmd = service + strlen("trace:");
+        char buffer[64];
+        memset(buf, 0, sizeof(buf));
+
+        if (!strncmp(cmd, "print:", strlen("print:"))) {
+            adb_trace_mask = adb_trace_parse_tags(cmd + strlen("print:"));
+        } else if (!strncmp(cmd, "record:", strlen("record:"))) {
+            adb_trace_ring_mask = adb_trace_parse_tags(cmd + strlen("record:"));
+        } else if (!strcmp(cmd, "dump")) {
+            char *dump = malloc(65536);
+            int len;
+            if (!dump) {
+                sendfailmsg(reply_fd, "out of memory");
+                return 0;
+            }
+            len = adb_trace_dump(dump, 65536);
+            snprintf(buf, sizeof(buf), "OKAY%04x", (unsigned)len);
+            writex(reply_fd, buf, strlen(buf));
+            writex(reply_fd, dump, len);
+            free(dump);
+            return 0;
+        } else if (strcmp(cmd, "status")) {
+            sendfailmsg(reply_fd, "unknown trace command");
+            return 0;
+        }
+
+        snprintf(buffer, sizeof(buffer), "print %08x record %08x\n",
+                 (unsigned)adb_trace_mask, (unsigned)adb_trace_ring_mask);
+        snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
+        writex(reply_fd, buf, strlen(buf));
+        return 0;
+    }
+
+    // per-subsystem heap statistics (see cutils/mspace.h); lets a test
+    // harness watch fragmentation build up between runs
+    if (!strcmp(service, "heap")) {
+        char buffer[4096];
+        memset(buf, 0, sizeof(buf));
+        memset(buffer, 0, sizeof(buffer));
+        adb_heap_report(buffer, sizeof(buffer));
         snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
-        D("Wrote device list \n");
         writex(reply_fd, buf, strlen(buf));
         return 0;
     }
@@ -1002,50 +1465,107 @@ int handle_host_request(char *service, transport_type ttype, char* serial, int r
         /* we don't even need to send a reply */
         return 0;
     }
+
+    // device pool management; the server dials registered endpoints
+    // itself and redials them when they drop.  subcommands:
+    //   pool:add:<host>[:<port>][,...]   register endpoints
+    //   pool:remove:<host>[:<port>]     unregister and disconnect
+    //   pool:list                       one line of state per entry
+    // several endpoints may be batched into one add, separated by
+    // commas, so enrolling a lab is one round trip
+    if (!strncmp(service, "pool:", strlen("pool:"))) {
+        char *spec = service + strlen("pool:");
+        char buffer[4096];
+        char *next;
+        int count = 0;
+        memset(buf, 0, sizeof(buf));
+        memset(buffer, 0, sizeof(buffer));
+
+        if (!strcmp(spec, "list")) {
+            pool_list(buffer, sizeof(buffer));
+        } else if (!strncmp(spec, "add:", strlen("add:"))) {
+            spec += strlen("add:");
+            while (spec) {
+                next = strchr(spec, ',');
+                if (next) *next++ = 0;
+                if (pool_add(spec)) {
+                    sendfailmsg(reply_fd, "malformed endpoint spec");
+                    return 0;
+                }
+                count++;
+                spec = next;
+            }
+            snprintf(buffer, sizeof(buffer), "added %d endpoint%s\n",
+                     count, count == 1 ? "" : "s");
+        } else if (!strncmp(spec, "remove:", strlen("remove:"))) {
+            if (pool_remove(spec + strlen("remove:"))) {
+                sendfailmsg(reply_fd, "no such pool entry");
+                return 0;
+            }
+            snprintf(buffer, sizeof(buffer), "removed\n");
+        } else {
+            sendfailmsg(reply_fd, "unknown pool command");
+            return 0;
+        }
+
+        snprintf(buf, sizeof(buf), "OKAY%04x%s",(unsigned)strlen(buffer),buffer);
+        writex(reply_fd, buf, strlen(buf));
+        return 0;
+    }
 #endif // ADB_HOST
 
+        /* several forward specs may be batched into one request,
+        ** separated by commas, so a farm setup is one round trip:
+        **    forward:tcp:1;tcp:1,tcp:2;tcp:2,...
+        */
     if(!strncmp(service,"forward:",8) || !strncmp(service,"killforward:",12)) {
-        char *local, *remote, *err;
+        char *local, *remote, *next, *err;
         int r;
         atransport *transport;
 
         int createForward = strncmp(service,"kill",4);
 
-        local = service + (createForward ? 8 : 12);
-        remote = strchr(local,';');
-        if(remote == 0) {
-            sendfailmsg(reply_fd, "malformed forward spec");
-            return 0;
-        }
-
-        *remote++ = 0;
-        if((local[0] == 0) || (remote[0] == 0) || (remote[0] == '*')){
-            sendfailmsg(reply_fd, "malformed forward spec");
-            return 0;
-        }
-
         transport = acquire_one_transport(CS_ANY, ttype, serial, &err);
         if (!transport) {
             sendfailmsg(reply_fd, err);
             return 0;
         }
 
-        if (createForward) {
-            r = install_listener(local, remote, transport);
-        } else {
-            r = remove_listener(local, remote, transport);
-        }
-        if(r == 0) {
-                /* 1st OKAY is connect, 2nd OKAY is status */
-            writex(reply_fd, "OKAYOKAY", 8);
-            return 0;
-        }
+        local = service + (createForward ? 8 : 12);
+        while(local) {
+            next = strchr(local, ',');
+            if(next) *next++ = 0;
+
+            remote = strchr(local,';');
+            if(remote == 0) {
+                sendfailmsg(reply_fd, "malformed forward spec");
+                return 0;
+            }
 
-        if (createForward) {
-            sendfailmsg(reply_fd, (r == -1) ? "cannot rebind smartsocket" : "cannot bind socket");
-        } else {
-            sendfailmsg(reply_fd, "cannot remove listener");
+            *remote++ = 0;
+            if((local[0] == 0) || (remote[0] == 0) || (remote[0] == '*')){
+                sendfailmsg(reply_fd, "malformed forward spec");
+                return 0;
+            }
+
+            if (createForward) {
+                r = install_listener(local, remote, transport);
+            } else {
+                r = remove_listener(local, remote, transport);
+            }
+            if(r != 0) {
+                if (createForward) {
+                    sendfailmsg(reply_fd, (r == -1) ? "cannot rebind smartsocket" : "cannot bind socket");
+                } else {
+                    sendfailmsg(reply_fd, "cannot remove listener");
+                }
+                return 0;
+            }
+            local = next;
         }
+
+            /* 1st OKAY is connect, 2nd OKAY is status */
+        writex(reply_fd, "OKAYOKAY", 8);
         return 0;
     }
 
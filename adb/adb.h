@@ -19,14 +19,26 @@
 
 #include <limits.h>
 
+/* default payload size, used until a peer advertises a larger one in
+** its A_CNXN message.  old-protocol peers never advertise, so all
+** traffic with them is capped at MAX_PAYLOAD per packet.
+*/
 #define MAX_PAYLOAD 4096
 
+/* upper bound on the payload size we are willing to negotiate.
+** we advertise this in our A_CNXN message (arg1) and clamp whatever
+** the peer advertises to it.
+*/
+#define MAX_PAYLOAD_LARGE (256*1024)
+
 #define A_SYNC 0x434e5953
 #define A_CNXN 0x4e584e43
 #define A_OPEN 0x4e45504f
 #define A_OKAY 0x59414b4f
 #define A_CLSE 0x45534c43
 #define A_WRTE 0x45545257
+#define A_PING 0x474e4950
+#define A_PONG 0x474e4f50
 
 #define A_VERSION 0x01000000        // ADB protocol version
 
@@ -60,8 +72,14 @@ struct apacket
     unsigned len;
     unsigned char *ptr;
 
+        /* capacity of data[], always at least MAX_PAYLOAD.
+        ** check_header() rejects packets larger than this, so
+        ** data[] can never overflow.
+        */
+    unsigned alloc;
+
     amessage msg;
-    unsigned char data[MAX_PAYLOAD];
+    unsigned char data[0];
 };
 
 /* An asocket represents one half of a connection between a local and
@@ -120,6 +138,16 @@ struct asocket {
         */
     void (*close)(asocket *s);
 
+        /* local-to-local direct bridge (linux only).  when our peer is
+        ** another local socket, its bytes are splice()d through
+        ** bridge_pipe straight to our fd, bypassing apacket framing.
+        ** bridge is 0 until first use, 1 once the pipe exists and -1
+        ** when splice is not usable for this socket.
+        */
+    int bridge;
+    int bridge_pipe[2];
+    int bridge_pending;
+
         /* socket-type-specific extradata */
     void *extra;
 
@@ -151,6 +179,19 @@ struct  adisconnect
 ** object, it's a special value used to indicate that a client wants to
 ** connect to a service implemented within the ADB server itself.
 */
+#define TRANSPORT_QUEUE_SIZE 256    /* must be a power of two */
+
+/* single-producer/single-consumer packet queue between the fdevent
+** loop and a transport thread.  the producer writes one doorbell byte
+** on the transport socketpair after each push, so the syscall doubles
+** as wakeup and memory barrier; no lock is ever taken.
+*/
+typedef struct {
+    apacket *slot[TRANSPORT_QUEUE_SIZE];
+    volatile unsigned head;     /* consumer position */
+    volatile unsigned tail;     /* producer position */
+} apacket_queue;
+
 typedef enum transport_type {
         kTransportUsb,
         kTransportLocal,
@@ -184,9 +225,59 @@ struct atransport
     char *serial;
     char *product;
 
+        /* chains this transport in its serial_map hash bucket; only
+        ** touched under transport_lock (see transport.c)
+        */
+    atransport *smap_next;
+
         /* a list of adisconnect callbacks called when the transport is kicked */
     int          kicked;
     adisconnect  disconnects;
+
+        /* re-sends our A_CNXN while the peer stays silent; armed by
+        ** send_connect() and runs on the fdevent thread
+        */
+    fdevent_timer connect_timer;
+    int connect_retries;
+
+        /* protocol keepalive for network transports: ping_timer sends
+        ** A_PING off the event loop, a matching A_PONG resets the miss
+        ** counter and updates the measured round trip.  Too many
+        ** missed pongs and the link is declared dead (see
+        ** keepalive_func in adb.c)
+        */
+    fdevent_timer ping_timer;
+    unsigned ping_token;
+    long long ping_sent_ms;
+    unsigned rtt_ms;
+    unsigned pings_missed;
+
+        /* largest payload the peer accepts per packet.  starts at
+        ** MAX_PAYLOAD and is raised when the peer advertises a larger
+        ** value in its A_CNXN message.
+        */
+    unsigned max_payload;
+
+        /* nonzero if the peer advertised (via the "wcoal" banner
+        ** property) that its usb stack accepts the packet header and
+        ** payload as one coalesced bulk transfer.  cleared on every
+        ** A_CNXN, so a peer that stops advertising falls back to the
+        ** split header/payload writes.
+        */
+    unsigned coalesce_writes;
+
+        /* q_to_remote carries packets from the fdevent loop to the
+        ** write thread, q_from_remote the reverse.  the socketpair
+        ** only carries doorbell bytes now.
+        */
+    apacket_queue q_to_remote;
+    apacket_queue q_from_remote;
+
+        /* per-transport I/O counters, reported by host:features */
+    unsigned long long bytes_to_remote;
+    unsigned long long bytes_from_remote;
+    unsigned long long pkts_to_remote;
+    unsigned long long pkts_from_remote;
 };
 
 
@@ -203,6 +294,7 @@ struct alistener
 {
     alistener *next;
     alistener *prev;
+    alistener *hnext;       /* chain in the local_name hash table */
 
     fdevent fde;
     int fd;
@@ -245,7 +337,8 @@ int adb_main(int is_daemon);
 ** get_device_transport does an acquire on your behalf before returning
 */
 void init_transport_registration(void);
-int  list_transports(char *buf, size_t  bufsize);
+char *list_transports_alloc(int long_fmt);
+int  dump_transport_stats(char *buf, size_t  bufsize);
 void update_transports(void);
 
 asocket*  create_device_tracker(void);
@@ -256,45 +349,98 @@ asocket*  create_device_tracker(void);
 ** If no suitable transport is found, error is set.
 */
 atransport *acquire_one_transport(int state, transport_type ttype, const char* serial, char **error_out);
+#if ADB_HOST
+atransport *find_transport(const char *serial);
+#endif
 void   add_transport_disconnect( atransport*  t, adisconnect*  dis );
 void   remove_transport_disconnect( atransport*  t, adisconnect*  dis );
 void   run_transport_disconnects( atransport*  t );
 void   kick_transport( atransport*  t );
 
-/* initialize a transport object's func pointers and state */
-int  init_socket_transport(atransport *t, int s, int port);
+/* initialize a transport object's func pointers and state.  'local'
+** marks an emulator connection, which takes part in the local
+** transport slot tracking; pool endpoints pass 0
+*/
+int  init_socket_transport(atransport *t, int s, int port, int local);
 void init_usb_transport(atransport *t, usb_handle *usb);
 
 /* for MacOS X cleanup */
 void close_usb_devices();
 
 /* cause new transports to be init'd and added to the list */
-void register_socket_transport(int s, const char *serial, int  port);
+void register_socket_transport(int s, const char *serial, int  port, int local);
 void register_usb_transport(usb_handle *h, const char *serial);
 
+#if ADB_HOST
+/* device pool: a registry of remote endpoints the server keeps
+** connected on its own, with bounded-concurrency dialing and
+** backoff (device_pool.c)
+*/
+int pool_add(const char *spec);
+int pool_remove(const char *spec);
+int pool_list(char *buf, size_t bufsize);
+int pool_list_disconnected(char *buf, size_t bufsize);
+#endif
+
 int service_to_fd(const char *name);
 #if ADB_HOST
 asocket *host_service_to_socket(const char*  name, const char *serial);
 #endif
 
+#if !ADB_HOST
+/* direct streaming services: instead of pairing the service thread
+** with a socketpair (whose bytes the fdevent loop then re-reads into
+** apackets), the thread fills apackets itself and pushes them on an
+** SPSC queue drained by the loop -- one copy instead of two, and the
+** payload arrives pre-framed.  a doorbell socketpair carries one byte
+** per packet for wakeup and ordering, exactly like the transport
+** queues; a second, low-volume pipe carries the client's bytes to the
+** service.
+*/
+typedef struct asvc asvc;
+
+asocket *create_service_socket(void (*func)(asvc *svc, void *cookie),
+                               const char *stat_name, void *cookie);
+
+/* writex/readx-like: 0 on success, -1 once the peer has gone away */
+int svc_write(asvc *svc, const void *data, int len);
+int svc_read(asvc *svc, void *data, int len);
+
+/* the daemon-side counterpart of host_service_to_socket() */
+asocket *daemon_service_to_socket(const char *name);
+#endif
+
 #if !ADB_HOST
 int       init_jdwp(void);
 asocket*  create_jdwp_service_socket();
-asocket*  create_jdwp_tracker_service_socket();
+asocket*  create_jdwp_tracker_service_socket(int binary);
 int       create_jdwp_connection_fd(int  jdwp_pid);
 #endif
 
 #if !ADB_HOST
-void framebuffer_service(int fd, void *cookie);
-void log_service(int fd, void *cookie);
+#if !ADB_HOST
+void framebuffer_service(asvc *svc, void *cookie);
+void log_service(asvc *svc, void *cookie);
+#endif
 void remount_service(int fd, void *cookie);
 char * get_log_file_path(const char * log_name);
 #endif
 
 /* packet allocator */
 apacket *get_apacket(void);
+apacket *get_apacket_size(unsigned size);
 void put_apacket(apacket *p);
 
+/* backing store for apackets and asockets: a dedicated mspace when the
+** platform has one, so connection churn cannot fragment the main heap.
+** adb_heap_free() accepts pointers from either source.
+*/
+void *adb_heap_malloc(size_t size);
+void adb_heap_free(void *ptr);
+int adb_heap_report(char *buf, size_t bufsize);
+
+void transport_set_max_payload(atransport *t, unsigned maxdata);
+
 int check_header(apacket *p);
 int check_data(apacket *p);
 
@@ -304,6 +450,7 @@ int check_data(apacket *p);
 */
 int readx(int fd, void *ptr, size_t len);
 int writex(int fd, const void *ptr, size_t len);
+int writexv(int fd, adb_iovec *iov, int count);
 
 /* define ADB_TRACE to 1 to enable tracing support, or 0 to disable it */
 
@@ -327,17 +474,29 @@ typedef enum {
 
 #if ADB_TRACE
 
-  int     adb_trace_mask;
+  int     adb_trace_mask;       /* categories printed to stderr */
+  int     adb_trace_ring_mask;  /* categories recorded in the rings */
 
   void    adb_trace_init(void);
 
-#  define ADB_TRACING  ((adb_trace_mask & (1 << TRACE_TAG)) != 0)
+  /* implemented in trace.c: per-thread ring buffer recording, so a
+   * stall's history can be captured after the fact (host:trace:dump)
+   * without always-on printing */
+  int         adb_trace_parse_tags(const char* list);
+  const char* adb_trace_tag_name(int tag);
+  void        adb_trace_record(int tag, const char* fmt, ...);
+  int         adb_trace_dump(char* buf, size_t size);
+
+#  define ADB_TRACING    ((adb_trace_mask & (1 << TRACE_TAG)) != 0)
+#  define ADB_RECORDING  ((adb_trace_ring_mask & (1 << TRACE_TAG)) != 0)
 
   /* you must define TRACE_TAG before using this macro */
   #define  D(...)                                      \
         do {                                           \
             if (ADB_TRACING)                           \
                 fprintf(stderr, __VA_ARGS__ );         \
+            if (ADB_RECORDING)                         \
+                adb_trace_record(TRACE_TAG, __VA_ARGS__ ); \
         } while (0)
 #else
 #  define  D(...)          ((void)0)
@@ -371,6 +530,11 @@ typedef enum {
 #define PRODUCT_ID_DREAM_COMP   0x0c02  // Dream composite device
 
 void local_init();
+#if !ADB_HOST
+/* (re)open the device-side TCP listener on the given port, or close
+** it for port <= 0; existing transports stay up either way */
+void local_set_tcp_port(int port);
+#endif
 int  local_connect(int  port);
 
 /* usb host/client interface */
@@ -7,6 +7,7 @@
 #include <zipfile/zipfile.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "sysdeps.h"
 
@@ -76,10 +77,27 @@ const char *adb_error(void)
     return __adb_error;
 }
 
+/* every request to the server is a 4-digit hex length followed by the
+** service name; send both with one writev() so they share a packet.
+*/
+static int send_service_request(int fd, const char *service, int len)
+{
+    adb_iovec iov[2];
+    char tmp[5];
+
+    snprintf(tmp, sizeof tmp, "%04x", len);
+
+    iov[0].iov_base = tmp;
+    iov[0].iov_len  = 4;
+    iov[1].iov_base = (char*) service;
+    iov[1].iov_len  = len;
+
+    return writexv(fd, iov, 2);
+}
+
 static int switch_socket_transport(int fd)
 {
     char service[64];
-    char tmp[5];
     int len;
 
     if (__adb_serial)
@@ -106,9 +124,8 @@ static int switch_socket_transport(int fd)
         snprintf(service, sizeof service, "host:%s", transport_type);
     }
     len = strlen(service);
-    snprintf(tmp, sizeof tmp, "%04x", len);
 
-    if(writex(fd, tmp, 4) || writex(fd, service, len)) {
+    if(send_service_request(fd, service, len)) {
         strcpy(__adb_error, "write failure during connection");
         adb_close(fd);
         return -1;
@@ -162,7 +179,6 @@ int adb_status(int fd)
 
 int _adb_connect(const char *service)
 {
-    char tmp[5];
     int len;
     int fd;
 
@@ -172,7 +188,6 @@ int _adb_connect(const char *service)
         strcpy(__adb_error, "service name too long");
         return -1;
     }
-    snprintf(tmp, sizeof tmp, "%04x", len);
 
     fd = socket_loopback_client(ADB_PORT, SOCK_STREAM);
     if(fd < 0) {
@@ -184,7 +199,7 @@ int _adb_connect(const char *service)
         return -1;
     }
 
-    if(writex(fd, tmp, 4) || writex(fd, service, len)) {
+    if(send_service_request(fd, service, len)) {
         strcpy(__adb_error, "write failure during connection");
         adb_close(fd);
         return -1;
@@ -198,10 +213,26 @@ int _adb_connect(const char *service)
     return fd;
 }
 
+/* the server version only needs to be validated once per process;
+** after that every adb_connect() is a single connection instead of
+** a version probe plus the real one.
+*/
+static int __adb_server_checked;
+
 int adb_connect(const char *service)
 {
+    int fd;
+
+    if(__adb_server_checked) {
+        fd = _adb_connect(service);
+        if(fd == -2) {
+            fprintf(stderr,"** daemon still not running");
+        }
+        return fd;
+    }
+
     // first query the adb server's version
-    int fd = _adb_connect("host:version");
+    fd = _adb_connect("host:version");
 
     if(fd == -2) {
         fprintf(stdout,"* daemon not running. starting it now *\n");
@@ -250,6 +281,8 @@ int adb_connect(const char *service)
         }
     }
 
+    __adb_server_checked = 1;
+
     // if the command is start-server, we are done.
     if (!strcmp(service, "host:start-server"))
         return 0;
@@ -281,13 +314,78 @@ int adb_command(const char *service)
     return 0;
 }
 
+/* short-lived memo of idempotent host state queries: one command can
+** ask for the device list or transport state several times in a row,
+** and each miss costs a fresh connection to the server.
+*/
+#define QUERY_CACHE_MAX     8
+#define QUERY_CACHE_TTL_MS  500
+
+static struct {
+    char *service;
+    char *result;
+    long long when;
+} __query_cache[QUERY_CACHE_MAX];
+
+static long long query_now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return ((long long) tv.tv_sec) * 1000LL + tv.tv_usec / 1000;
+}
+
+static int query_cacheable(const char *service)
+{
+    return !strcmp(service, "host:devices") ||
+           !strncmp(service, "host:get-", 9) ||
+           (!strncmp(service, "host-serial:", 12) &&
+            strstr(service, ":get-") != 0);
+}
+
+static char *query_cache_lookup(const char *service)
+{
+    long long now = query_now_ms();
+    int n;
+
+    for(n = 0; n < QUERY_CACHE_MAX; n++) {
+        if(__query_cache[n].service &&
+           !strcmp(__query_cache[n].service, service) &&
+           now - __query_cache[n].when < QUERY_CACHE_TTL_MS) {
+            return strdup(__query_cache[n].result);
+        }
+    }
+    return 0;
+}
+
+static void query_cache_store(const char *service, const char *result)
+{
+    static int next;
+    int n = next;
+
+    free(__query_cache[n].service);
+    free(__query_cache[n].result);
+    __query_cache[n].service = strdup(service);
+    __query_cache[n].result = strdup(result);
+    __query_cache[n].when = query_now_ms();
+    next = (next + 1) % QUERY_CACHE_MAX;
+}
+
 char *adb_query(const char *service)
 {
     char buf[5];
     unsigned n;
     char *tmp;
+    int cacheable;
 
     D("adb_query: %s\n", service);
+
+    cacheable = query_cacheable(service);
+    if(cacheable) {
+        tmp = query_cache_lookup(service);
+        if(tmp) return tmp;
+    }
+
     int fd = adb_connect(service);
     if(fd < 0) {
         fprintf(stderr,"error: %s\n", __adb_error);
@@ -306,6 +404,8 @@ char *adb_query(const char *service)
     if(readx(fd, tmp, n) == 0) {
         tmp[n] = 0;
         adb_close(fd);
+        if(cacheable)
+            query_cache_store(service, tmp);
         return tmp;
     }
     free(tmp);
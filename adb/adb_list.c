@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "adb_list.h"
+
+#define APSET_MIN_CAPACITY  16
+
+void apset_init(apset *set)
+{
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+void apset_destroy(apset *set)
+{
+    free(set->slots);
+    apset_init(set);
+}
+
+static unsigned apset_hash(const void *key)
+{
+    /* pointers and inode numbers share low-bit alignment patterns,
+     * so mix before masking */
+    unsigned long k = (unsigned long) key;
+    return (unsigned)((k >> 4) * 2654435761UL);
+}
+
+static const void **apset_slot(const void **slots, unsigned capacity,
+                               const void *key)
+{
+    unsigned i = apset_hash(key) & (capacity - 1);
+
+    while (slots[i] != NULL && slots[i] != key)
+        i = (i + 1) & (capacity - 1);
+    return &slots[i];
+}
+
+static int apset_grow(apset *set)
+{
+    unsigned capacity = set->capacity ? set->capacity * 2
+                                      : APSET_MIN_CAPACITY;
+    const void **slots = calloc(capacity, sizeof(*slots));
+    unsigned i;
+
+    if (slots == NULL)
+        return -1;
+
+    for (i = 0; i < set->capacity; i++) {
+        if (set->slots[i] != NULL)
+            *apset_slot(slots, capacity, set->slots[i]) = set->slots[i];
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 0;
+}
+
+int apset_add(apset *set, const void *key)
+{
+    const void **slot;
+
+    if (key == NULL)
+        return -1;
+
+    /* keep load below 3/4 so probe chains stay short */
+    if (set->count * 4 >= set->capacity * 3) {
+        if (apset_grow(set))
+            return -1;
+    }
+
+    slot = apset_slot(set->slots, set->capacity, key);
+    if (*slot != NULL)
+        return 1;
+    *slot = key;
+    set->count++;
+    return 0;
+}
+
+int apset_contains(const apset *set, const void *key)
+{
+    if (set->capacity == 0 || key == NULL)
+        return 0;
+    return *apset_slot(set->slots, set->capacity, key) != NULL;
+}
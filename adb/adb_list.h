@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ADB_LIST_H
+#define _ADB_LIST_H
+
+#include <stddef.h>
+
+/* intrusive doubly-linked list.  the node lives inside the element
+ * (no per-item allocation like the old shlist), and the head is a
+ * sentinel that links to itself when the list is empty.
+ */
+typedef struct alist_node {
+    struct alist_node *next;
+    struct alist_node *prev;
+} alist_node;
+
+/* recover the containing element from its embedded node */
+#define alist_entry(node, type, member) \
+    ((type*)((char*)(node) - offsetof(type, member)))
+
+#define alist_for_each(node, head) \
+    for (node = (head)->next; node != (head); node = node->next)
+
+static __inline__ void alist_init(alist_node *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static __inline__ int alist_empty(const alist_node *head)
+{
+    return head->next == head;
+}
+
+static __inline__ void alist_insert_after(alist_node *pos, alist_node *item)
+{
+    item->prev = pos;
+    item->next = pos->next;
+    pos->next->prev = item;
+    pos->next = item;
+}
+
+static __inline__ void alist_insert_before(alist_node *pos, alist_node *item)
+{
+    alist_insert_after(pos->prev, item);
+}
+
+static __inline__ void alist_add_head(alist_node *head, alist_node *item)
+{
+    alist_insert_after(head, item);
+}
+
+static __inline__ void alist_add_tail(alist_node *head, alist_node *item)
+{
+    alist_insert_before(head, item);
+}
+
+static __inline__ void alist_remove(alist_node *item)
+{
+    item->prev->next = item->next;
+    item->next->prev = item->prev;
+    item->next = item;
+    item->prev = item;
+}
+
+/* small open-addressed set of pointer-sized keys, for O(1)
+ * membership tests where a list scan per lookup would be O(n*m).
+ * keys must be non-NULL (NULL marks an empty slot); removal is not
+ * supported.  grows automatically, starts empty at no cost.
+ */
+typedef struct {
+    const void **slots;
+    unsigned capacity;      /* power of two, 0 until the first add */
+    unsigned count;
+} apset;
+
+void apset_init(apset *set);
+void apset_destroy(apset *set);
+
+/* returns 0 if added, 1 if the key was already present,
+ * -1 on allocation failure */
+int apset_add(apset *set, const void *key);
+
+/* returns nonzero if the key is in the set */
+int apset_contains(const apset *set, const void *key);
+
+#endif
@@ -38,7 +38,7 @@
 #include "file_sync_service.h"
 
 #ifdef SH_HISTORY
-#include "shlist.h"
+#include "adb_list.h"
 #include "history.h"
 #endif
 
@@ -103,18 +103,35 @@ void help()
         "                                 If -p is not specified, the ANDROID_PRODUCT_OUT\n"
         "                                 environment variable is used, which must\n"
         "                                 be an absolute path.\n"
-        " devices                       - list all connected devices\n"
+        " devices [-l]                  - list all connected devices, sorted\n"
+        "                                 by serial; -l adds product and\n"
+        "                                 transport columns\n"
+        "\n"
+        "pool commands:\n"
+        "  adb pool add <host>[:<port>][,...]\n"
+        "                               - register networked devices; the server\n"
+        "                                 connects to them itself and reconnects\n"
+        "                                 with backoff when they drop\n"
+        "  adb pool remove <host>[:<port>]\n"
+        "                               - unregister and disconnect an endpoint\n"
+        "  adb pool list                - show pool entries and their state\n"
         "\n"
         "device commands:\n"
         "  adb push <local> <remote>    - copy file/dir to device\n"
         "  adb pull <remote> <local>    - copy file/dir from device\n"
+        "  adb rm [-r] <remote>         - remove file (or tree with -r) on device\n"
         "  adb sync [ <directory> ]     - copy host->device only if changed\n"
         "                                 (see 'adb help all')\n"
+        "    push/pull/sync take '-n' (plan the transfer without copying,\n"
+        "    printing file and byte counts per directory) and '--stats'\n"
+        "    (print a transfer summary with effective throughput)\n"
         "  adb shell                    - run remote shell interactively\n"
         "  adb shell <command>          - run remote shell command\n"
+        "  adb emu                      - talk to the emulator console interactively\n"
         "  adb emu <command>            - run emulator console command\n"
         "  adb logcat [ <filter-spec> ] - View device log\n"
-        "  adb forward <local> <remote> - forward socket connections\n"
+        "  adb forward <local> <remote> [<local> <remote>...]\n"
+        "                               - forward socket connections\n"
         "                                 forward specs are one of: \n"
         "                                   tcp:<port>\n"
         "                                   localabstract:<unix domain socket name>\n"
@@ -218,9 +235,23 @@ static void read_and_dump(int fd)
 }
 
 #ifdef SH_HISTORY
-int shItemCmp( void *val, void *idata )
+/* a history entry embeds its list node, so the list costs no
+ * separate node allocations */
+typedef struct histent {
+    alist_node node;
+    char cmd[1];
+} histent;
+
+static histent *history_find( alist_node *head, const char *cmd )
 {
-    return( (strcmp( val, idata ) == 0) );
+    alist_node *nd;
+
+    alist_for_each(nd, head) {
+        histent *he = alist_entry(nd, histent, node);
+        if( strcmp(he->cmd, cmd) == 0 )
+            return he;
+    }
+    return NULL;
 }
 #endif
 
@@ -229,9 +260,9 @@ static void *stdin_read_thread(void *x)
     int fd, fdi;
     unsigned char buf[1024];
 #ifdef SH_HISTORY
-    unsigned char realbuf[1024], *buf_ptr;
-    SHLIST history;
-    SHLIST *item = &history;
+    unsigned char realbuf[1024];
+    alist_node history;
+    alist_node *item = &history;
     int cmdlen = 0, ins_flag = 0;
 #endif
     int r, n;
@@ -243,7 +274,7 @@ static void *stdin_read_thread(void *x)
     free(fds);
 
 #ifdef SH_HISTORY
-    shListInitList( &history );
+    alist_init( &history );
 #endif
     for(;;) {
         /* fdi is really the client's stdin, so use read, not adb_read here */
@@ -258,10 +289,10 @@ static void *stdin_read_thread(void *x)
             (memcmp( (void *)buf, SH_ARROW_ANY, 2 ) == 0) ) {
             switch( buf[2] ) {
                 case SH_ARROW_UP:
-                    item = shListGetNextItem( &history, item );
+                    item = (item && item->next != &history) ? item->next : NULL;
                     break;
                 case SH_ARROW_DOWN:
-                    item = shListGetPrevItem( &history, item );
+                    item = (item && item->prev != &history) ? item->prev : NULL;
                     break;
                 default:
                     item = NULL;
@@ -269,8 +300,9 @@ static void *stdin_read_thread(void *x)
             }
             memset( buf, SH_DEL_CHAR, cmdlen );
             if( item != NULL ) {
-                n = snprintf( (char *)(&buf[cmdlen]), sizeof buf - cmdlen, "%s", (char *)(item->data) );
-                memcpy( realbuf, item->data, n );
+                histent *he = alist_entry( item, histent, node );
+                n = snprintf( (char *)(&buf[cmdlen]), sizeof buf - cmdlen, "%s", he->cmd );
+                memcpy( realbuf, he->cmd, n );
             }
             else { /* Clean buffer */
                 item = &history;
@@ -289,12 +321,17 @@ static void *stdin_read_thread(void *x)
                 case '\n':
 #ifdef SH_HISTORY
                     if( ins_flag && (SH_BLANK_CHAR <= realbuf[0]) ) {
-                        buf_ptr = malloc(cmdlen + 1);
-                        if( buf_ptr != NULL ) {
-                            memcpy( buf_ptr, realbuf, cmdlen );
-                            buf_ptr[cmdlen] = '\0';
-                            if( (item = shListFindItem( &history, (void *)buf_ptr, shItemCmp )) == NULL ) {
-                                shListInsFirstItem( &history, (void *)buf_ptr );
+                        histent *he = malloc(sizeof(histent) + cmdlen);
+                        if( he != NULL ) {
+                            histent *found;
+                            memcpy( he->cmd, realbuf, cmdlen );
+                            he->cmd[cmdlen] = '\0';
+                            found = history_find( &history, he->cmd );
+                            if( found != NULL ) {
+                                free( he );
+                                item = &found->node;
+                            } else {
+                                alist_add_head( &history, &he->node );
                                 item = &history;
                             }
                         }
@@ -342,7 +379,11 @@ static void *stdin_read_thread(void *x)
         }
     }
 #ifdef SH_HISTORY
-    shListDelAllItems( &history, (shListFree)free );
+    while( !alist_empty( &history ) ) {
+        alist_node *first = history.next;
+        alist_remove( first );
+        free( alist_entry( first, histent, node ) );
+    }
 #endif
     return 0;
 }
@@ -834,7 +875,10 @@ top:
 
     if(!strcmp(argv[0], "devices")) {
         char *tmp;
-        snprintf(buf, sizeof buf, "host:%s", argv[0]);
+        if(argc > 1 && !strcmp(argv[1], "-l"))
+            snprintf(buf, sizeof buf, "host:devices-l");
+        else
+            snprintf(buf, sizeof buf, "host:%s", argv[0]);
         tmp = adb_query(buf);
         if(tmp) {
             printf("List of devices attached \n");
@@ -845,6 +889,39 @@ top:
         }
     }
 
+    if(!strcmp(argv[0], "pool")) {
+        char *tmp;
+        if (argc < 2) return usage();
+        if (!strcmp(argv[1], "list") && argc == 2) {
+            snprintf(buf, sizeof buf, "host:pool:list");
+        } else if (argc == 3 && (!strcmp(argv[1], "add") ||
+                                 !strcmp(argv[1], "remove"))) {
+            snprintf(buf, sizeof buf, "host:pool:%s:%s", argv[1], argv[2]);
+        } else {
+            return usage();
+        }
+        tmp = adb_query(buf);
+        if(tmp) {
+            printf("%s", tmp);
+            return 0;
+        } else {
+            fprintf(stderr,"error: %s\n", adb_error());
+            return 1;
+        }
+    }
+
+    if(!strcmp(argv[0], "host-features")) {
+        char *tmp;
+        snprintf(buf, sizeof buf, "host:features");
+        tmp = adb_query(buf);
+        if(tmp) {
+            printf("%s", tmp);
+            return 0;
+        } else {
+            return 1;
+        }
+    }
+
     if (!strcmp(argv[0], "emu")) {
         return adb_send_emulator_command(argc, argv);
     }
@@ -956,12 +1033,27 @@ top:
     }
 
     if(!strcmp(argv[0], "forward")) {
-        if(argc != 3) return usage();
+        char *p;
+        int n;
+
+        if(argc < 3 || (argc & 1) == 0) return usage();
+
         if (serial) {
-            snprintf(buf, sizeof buf, "host-serial:%s:forward:%s;%s",serial,argv[1],argv[2]);
+            snprintf(buf, sizeof buf, "host-serial:%s:forward:", serial);
         } else {
-            snprintf(buf, sizeof buf, "host:forward:%s;%s",argv[1],argv[2]);
+            snprintf(buf, sizeof buf, "host:forward:");
         }
+        p = buf + strlen(buf);
+
+            /* any number of <local> <remote> pairs, installed by the
+            ** server as one batch
+            */
+        for(n = 1; n + 1 < argc; n += 2) {
+            p += snprintf(p, buf + sizeof buf - p, "%s%s;%s",
+                          (n > 1) ? "," : "", argv[n], argv[n + 1]);
+            if(p >= buf + sizeof buf) return usage();
+        }
+
         if(adb_command(buf)) {
             fprintf(stderr,"error: %s\n", adb_error());
             return 1;
@@ -976,6 +1068,34 @@ top:
         return do_sync_ls(argv[1]);
     }
 
+    if(!strcmp(argv[0], "rm")) {
+        int recursive = 0;
+        if(argc > 1 && !strcmp(argv[1], "-r")) {
+            recursive = 1;
+            argc--;
+            argv++;
+        }
+        if(argc != 2) return usage();
+        return do_sync_rm(argv[1], recursive);
+    }
+
+    if(!strcmp(argv[0], "push") || !strcmp(argv[0], "pull") ||
+       !strcmp(argv[0], "sync")) {
+            /* common sync-client switches, before the paths */
+        while(argc > 1 && argv[1][0] == '-') {
+            if(!strcmp(argv[1], "-n") || !strcmp(argv[1], "--dry-run")) {
+                sync_set_dry_run(1);
+            } else if(!strcmp(argv[1], "--stats")) {
+                sync_set_stats(1);
+            } else {
+                return usage();
+            }
+            argc--;
+            argv[1] = argv[0];
+            argv++;
+        }
+    }
+
     if(!strcmp(argv[0], "push")) {
         if(argc != 3) return usage();
         return do_sync_push(argv[1], argv[2], 0 /* no verify APK */);
@@ -2,6 +2,14 @@
 #include "adb.h"
 #include "adb_client.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_TERMIO_H
+#include <termios.h>
+#include <sys/select.h>
+#endif
 
 static int  connect_to_console(void)
 {
@@ -24,6 +32,99 @@ static int  connect_to_console(void)
 }
 
 
+#ifdef HAVE_TERMIO_H
+
+/* interactive console session.  stdin is left in canonical mode, so
+ * the local tty line discipline provides editing and echo, and each
+ * command crosses the link as a single write instead of a packet per
+ * keystroke -- which matters over a high-RTT connection.  console
+ * output is aggregated and flushed when the buffer fills or after a
+ * short quiet period, so a burst of output arrives as a few large
+ * writes rather than many small ones.  set ADB_CONSOLE_NOECHO to
+ * turn the local echo off if the far end echoes too.
+ */
+
+#define  CONSOLE_OUT_MAX    4096
+#define  CONSOLE_FLUSH_MS   50
+
+static int  console_interactive(int  fd)
+{
+    char   outbuf[CONSOLE_OUT_MAX];
+    char   line[1024];
+    int    outcnt = 0;
+    struct termios  tio_save;
+    int    noecho = 0;
+
+    if (getenv("ADB_CONSOLE_NOECHO") && tcgetattr(0, &tio_save) == 0) {
+        struct termios  tio = tio_save;
+        tio.c_lflag &= ~ECHO;
+        tcsetattr(0, TCSANOW, &tio);
+        noecho = 1;
+    }
+
+    for (;;) {
+        fd_set           rfds;
+        struct timeval   tv;
+        struct timeval*  timeout = NULL;
+        int              n;
+
+        FD_ZERO(&rfds);
+        FD_SET(0, &rfds);
+        FD_SET(fd, &rfds);
+
+        if (outcnt > 0) {
+            /* output is pending: wake up to flush it if the console
+             * goes quiet */
+            tv.tv_sec  = 0;
+            tv.tv_usec = CONSOLE_FLUSH_MS * 1000;
+            timeout = &tv;
+        }
+
+        n = select(fd + 1, &rfds, NULL, NULL, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (n == 0 || outcnt == CONSOLE_OUT_MAX ||
+            (outcnt > 0 && FD_ISSET(0, &rfds))) {
+            unix_write(1, outbuf, outcnt);
+            outcnt = 0;
+        }
+        if (n == 0)
+            continue;
+
+        if (FD_ISSET(fd, &rfds)) {
+            int  r = adb_read(fd, outbuf + outcnt, CONSOLE_OUT_MAX - outcnt);
+            if (r <= 0)
+                break;
+            outcnt += r;
+            if (outcnt == CONSOLE_OUT_MAX) {
+                unix_write(1, outbuf, outcnt);
+                outcnt = 0;
+            }
+        }
+
+        if (FD_ISSET(0, &rfds)) {
+            /* canonical mode: one read per edited line */
+            int  r = unix_read(0, line, sizeof(line));
+            if (r <= 0)
+                break;
+            if (adb_write(fd, line, r) != r)
+                break;
+        }
+    }
+
+    if (outcnt > 0)
+        unix_write(1, outbuf, outcnt);
+    if (noecho)
+        tcsetattr(0, TCSANOW, &tio_save);
+    adb_close(fd);
+    return 0;
+}
+
+#endif /* HAVE_TERMIO_H */
+
 int  adb_send_emulator_command(int  argc, char**  argv)
 {
     int   fd, nn;
@@ -32,6 +133,12 @@ int  adb_send_emulator_command(int  argc, char**  argv)
     if (fd < 0)
         return 1;
 
+#ifdef HAVE_TERMIO_H
+    /* no command: talk to the console interactively */
+    if (argc < 2)
+        return console_interactive(fd);
+#endif
+
 #define  QUIT  "quit\n"
 
     for (nn = 1; nn < argc; nn++) {
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysdeps.h"
+
+#define  TRACE_TAG  TRACE_TRANSPORT
+#include "adb.h"
+
+#if ADB_HOST
+
+/* The device pool is a registry of networked endpoints the server
+** keeps connected on its own, so a lab full of TCP devices doesn't
+** need an external script dialing each one.  A single manager thread
+** wakes up once a second, notices entries whose transport has gone
+** away, and hands due entries to short-lived connect threads - never
+** more than POOL_MAX_PARALLEL at once, so a rack going dark doesn't
+** turn into a hundred threads stuck in connect().  Failed attempts
+** are retried with doubling backoff.
+*/
+
+#define POOL_MAX_PARALLEL   4       /* concurrent connect attempts */
+#define POOL_BACKOFF_MIN    1       /* ticks between retries */
+#define POOL_BACKOFF_MAX    60
+#define POOL_TICK_MS        1000
+#define POOL_GRACE_TICKS    3       /* registration is asynchronous; don't
+                                    ** declare a fresh connect dead before
+                                    ** the fdevent thread has seen it */
+
+/* entry states */
+#define PS_PENDING      0           /* waiting for a slot or for backoff */
+#define PS_CONNECTING   1           /* a connect thread is dialing */
+#define PS_ONLINE       2           /* transport registered */
+#define PS_REMOVED      3           /* unlisted while a thread still held it */
+
+typedef struct pool_entry pool_entry;
+struct pool_entry {
+    char         host[64];
+    int          port;
+    char         serial[80];        /* "host:port", doubles as the
+                                    ** transport serial */
+    int          state;
+    int          due;               /* ticks until the next attempt */
+    int          backoff;           /* ticks between retries, doubling */
+    int          grace;             /* see POOL_GRACE_TICKS */
+    unsigned     attempts;
+    unsigned     failures;
+    pool_entry*  next;
+};
+
+ADB_MUTEX_DEFINE( device_pool_lock );
+
+static pool_entry*  pool_list_head;
+static int          pool_connecting;
+static int          pool_thread_started;
+
+static const char *pool_statename(pool_entry *e)
+{
+    switch(e->state) {
+    case PS_CONNECTING: return "connecting";
+    case PS_ONLINE:     return "online";
+    case PS_PENDING:    return e->attempts ? "retrying" : "connecting";
+    default:            return "unknown";
+    }
+}
+
+static void *pool_connect_thread(void *x)
+{
+    pool_entry *e = x;
+    int fd;
+
+    D("pool: dialing '%s'\n", e->serial);
+    fd = socket_network_client(e->host, e->port, SOCK_STREAM);
+
+    adb_mutex_lock(&device_pool_lock);
+    pool_connecting--;
+
+    if(e->state == PS_REMOVED) {
+            /* unlisted while we were dialing; the entry is ours to free */
+        adb_mutex_unlock(&device_pool_lock);
+        if(fd >= 0) adb_close(fd);
+        free(e);
+        return 0;
+    }
+
+    if(fd < 0) {
+        e->failures++;
+        e->due = e->backoff;
+        e->backoff *= 2;
+        if(e->backoff > POOL_BACKOFF_MAX)
+            e->backoff = POOL_BACKOFF_MAX;
+        e->state = PS_PENDING;
+        D("pool: '%s' unreachable, retry in %d s\n", e->serial, e->due);
+    } else {
+        close_on_exec(fd);
+        disable_tcp_nagle(fd);
+        register_socket_transport(fd, e->serial, e->port, 0);
+        e->state = PS_ONLINE;
+        e->grace = POOL_GRACE_TICKS;
+        e->backoff = POOL_BACKOFF_MIN;
+        D("pool: '%s' connected on fd %d\n", e->serial, fd);
+    }
+    adb_mutex_unlock(&device_pool_lock);
+    return 0;
+}
+
+static void *pool_manager_thread(void *x)
+{
+    pool_entry *e;
+    adb_thread_t thr;
+
+    D("pool: manager thread starting\n");
+
+    for(;;) {
+        adb_mutex_lock(&device_pool_lock);
+        for(e = pool_list_head; e; e = e->next) {
+            switch(e->state) {
+            case PS_ONLINE:
+                    /* registration runs on the fdevent thread; give a
+                    ** fresh connect a moment to show up in the
+                    ** transport list before treating its absence as a
+                    ** disconnect */
+                if(e->grace > 0) {
+                    e->grace--;
+                    break;
+                }
+                if(find_transport(e->serial) == NULL) {
+                    D("pool: lost '%s', reconnecting\n", e->serial);
+                    e->failures++;
+                    e->state = PS_PENDING;
+                    e->due = POOL_BACKOFF_MIN;
+                    e->backoff = POOL_BACKOFF_MIN;
+                }
+                break;
+
+            case PS_PENDING:
+                if(e->due > 0) {
+                    e->due--;
+                    break;
+                }
+                if(pool_connecting >= POOL_MAX_PARALLEL)
+                    break;
+                e->state = PS_CONNECTING;
+                e->attempts++;
+                pool_connecting++;
+                if(adb_thread_create(&thr, pool_connect_thread, e)) {
+                    pool_connecting--;
+                    e->state = PS_PENDING;
+                    e->due = POOL_BACKOFF_MIN;
+                }
+                break;
+            }
+        }
+        adb_mutex_unlock(&device_pool_lock);
+        adb_sleep_ms(POOL_TICK_MS);
+    }
+    return 0;
+}
+
+/* parses "host[:port]" into an entry; port defaults to the usual
+** device listener port
+*/
+static int pool_parse_spec(const char *spec, char *host, int hostlen,
+                           int *port)
+{
+    const char *colon = strrchr(spec, ':');
+    int len;
+
+    *port = ADB_LOCAL_TRANSPORT_PORT;
+    len = colon ? colon - spec : (int) strlen(spec);
+
+    if(len < 1 || len >= hostlen)
+        return -1;
+    if(colon) {
+        *port = atoi(colon + 1);
+        if(*port < 1 || *port > 65535)
+            return -1;
+    }
+    memcpy(host, spec, len);
+    host[len] = 0;
+    return 0;
+}
+
+int pool_add(const char *spec)
+{
+    pool_entry *e;
+    char host[64];
+    int port;
+    adb_thread_t thr;
+
+    if(pool_parse_spec(spec, host, sizeof(host), &port))
+        return -1;
+
+    adb_mutex_lock(&device_pool_lock);
+
+    for(e = pool_list_head; e; e = e->next) {
+        if(!strcmp(e->host, host) && e->port == port) {
+            adb_mutex_unlock(&device_pool_lock);
+            return 0;       /* already tracked */
+        }
+    }
+
+    e = calloc(1, sizeof(pool_entry));
+    if(e == 0) {
+        adb_mutex_unlock(&device_pool_lock);
+        return -1;
+    }
+    snprintf(e->host, sizeof(e->host), "%s", host);
+    e->port = port;
+    snprintf(e->serial, sizeof(e->serial), "%s:%d", host, port);
+    e->backoff = POOL_BACKOFF_MIN;
+
+    if(find_transport(e->serial) != NULL) {
+            /* already connected by other means; just start tracking */
+        e->state = PS_ONLINE;
+        e->grace = POOL_GRACE_TICKS;
+    } else {
+        e->state = PS_PENDING;
+    }
+
+    e->next = pool_list_head;
+    pool_list_head = e;
+
+    if(!pool_thread_started) {
+        if(adb_thread_create(&thr, pool_manager_thread, 0)) {
+            pool_list_head = e->next;
+            adb_mutex_unlock(&device_pool_lock);
+            free(e);
+            return -1;
+        }
+        pool_thread_started = 1;
+    }
+
+    adb_mutex_unlock(&device_pool_lock);
+    D("pool: added '%s'\n", spec);
+    return 0;
+}
+
+int pool_remove(const char *spec)
+{
+    pool_entry **pe, *e;
+    char host[64];
+    char serial[80];
+    int port;
+    atransport *t;
+
+    if(pool_parse_spec(spec, host, sizeof(host), &port))
+        return -1;
+    snprintf(serial, sizeof(serial), "%s:%d", host, port);
+
+    adb_mutex_lock(&device_pool_lock);
+    for(pe = &pool_list_head; (e = *pe); pe = &e->next) {
+        if(!strcmp(e->host, host) && e->port == port)
+            break;
+    }
+    if(e == 0) {
+        adb_mutex_unlock(&device_pool_lock);
+        return -1;
+    }
+
+    *pe = e->next;
+    if(e->state == PS_CONNECTING) {
+            /* a connect thread still holds the entry; it frees it */
+        e->state = PS_REMOVED;
+        e = 0;
+    }
+    adb_mutex_unlock(&device_pool_lock);
+
+        /* drop the live connection too - removal means the lab no
+        ** longer wants the device attached */
+    if((t = find_transport(serial)) != NULL)
+        kick_transport(t);
+
+    if(e)
+        free(e);
+    D("pool: removed '%s'\n", spec);
+    return 0;
+}
+
+/* full pool state, one line per entry, for host:pool:list */
+int pool_list(char *buf, size_t bufsize)
+{
+    char*        p   = buf;
+    char*        end = buf + bufsize;
+    int          len;
+    pool_entry*  e;
+
+    adb_mutex_lock(&device_pool_lock);
+    for(e = pool_list_head; e; e = e->next) {
+        len = snprintf(p, end - p, "%s\t%s\tattempts %u failures %u\n",
+                e->serial, pool_statename(e), e->attempts, e->failures);
+        if (p + len >= end) {
+            /* discard last line if buffer is too short */
+            break;
+        }
+        p += len;
+    }
+    p[0] = 0;
+    adb_mutex_unlock(&device_pool_lock);
+    return p - buf;
+}
+
+/* entries without a live transport, appended to the host:devices
+** listing so pool state shows up where scripts already look
+*/
+int pool_list_disconnected(char *buf, size_t bufsize)
+{
+    char*        p   = buf;
+    char*        end = buf + bufsize;
+    int          len;
+    pool_entry*  e;
+
+    adb_mutex_lock(&device_pool_lock);
+    for(e = pool_list_head; e; e = e->next) {
+        if(e->state == PS_ONLINE)
+            continue;
+        len = snprintf(p, end - p, "%s\t%s\n",
+                e->serial, pool_statename(e));
+        if (p + len >= end) {
+            break;
+        }
+        p += len;
+    }
+    p[0] = 0;
+    adb_mutex_unlock(&device_pool_lock);
+    return p - buf;
+}
+
+#endif /* ADB_HOST */
@@ -21,20 +21,40 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <time.h>
+#include <utime.h>
 #include <dirent.h>
 #include <limits.h>
 #include <sys/types.h>
 #include <zipfile/zipfile.h>
+#include <zlib.h>
 
 #include "sysdeps.h"
 #include "adb.h"
 #include "adb_client.h"
+#include "adb_list.h"
 #include "file_sync_service.h"
 
 
 static unsigned total_bytes;
+static unsigned total_files;
 static long long start_time;
 
+/* set from the command line: plan transfers without performing them,
+** and print a summary with effective throughput after real ones
+*/
+static int sync_dry_run;
+static int sync_show_stats;
+
+void sync_set_dry_run(int enabled)
+{
+    sync_dry_run = enabled;
+}
+
+void sync_set_stats(int enabled)
+{
+    sync_show_stats = enabled;
+}
+
 static long long NOW()
 {
     struct timeval tv;
@@ -46,20 +66,29 @@ static long long NOW()
 static void BEGIN()
 {
     total_bytes = 0;
+    total_files = 0;
     start_time = NOW();
 }
 
 static void END()
 {
     long long t = NOW() - start_time;
-    if(total_bytes == 0) return;
 
     if (t == 0)  /* prevent division by 0 :-) */
         t = 1000000;
 
-    fprintf(stderr,"%lld KB/s (%d bytes in %lld.%03llds)\n",
-            ((((long long) total_bytes) * 1000000LL) / t) / 1024LL,
-            total_bytes, (t / 1000000LL), (t % 1000000LL) / 1000LL);
+    if(total_bytes != 0) {
+        fprintf(stderr,"%lld KB/s (%d bytes in %lld.%03llds)\n",
+                ((((long long) total_bytes) * 1000000LL) / t) / 1024LL,
+                total_bytes, (t / 1000000LL), (t % 1000000LL) / 1000LL);
+    }
+    if(sync_show_stats) {
+        fprintf(stderr,"stats: %u file%s, %u bytes in %lld.%03llds, "
+                "%lld KB/s effective\n",
+                total_files, (total_files == 1) ? "" : "s", total_bytes,
+                (t / 1000000LL), (t % 1000000LL) / 1000LL,
+                ((((long long) total_bytes) * 1000000LL) / t) / 1024LL);
+    }
 }
 
 void sync_quit(int fd)
@@ -72,6 +101,23 @@ void sync_quit(int fd)
     writex(fd, &msg.req, sizeof(msg.req));
 }
 
+/* ship a request header and its name in one segment instead of two */
+static int sync_write_req(int fd, unsigned id, const char *name, int len)
+{
+    syncmsg msg;
+    adb_iovec iov[2];
+
+    msg.req.id = id;
+    msg.req.namelen = htoll(len);
+
+    iov[0].iov_base = &msg.req;
+    iov[0].iov_len  = sizeof(msg.req);
+    iov[1].iov_base = (char*) name;
+    iov[1].iov_len  = len;
+
+    return writexv(fd, iov, 2);
+}
+
 typedef void (*sync_ls_cb)(unsigned mode, unsigned size, unsigned time, const char *name, void *cookie);
 
 int sync_ls(int fd, const char *path, sync_ls_cb func, void *cookie)
@@ -83,11 +129,7 @@ int sync_ls(int fd, const char *path, sync_ls_cb func, void *cookie)
     len = strlen(path);
     if(len > 1024) goto fail;
 
-    msg.req.id = ID_LIST;
-    msg.req.namelen = htoll(len);
-
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, path, len)) {
+    if(sync_write_req(fd, ID_LIST, path, len)) {
         goto fail;
     }
 
@@ -123,16 +165,24 @@ struct syncsendbuf {
 
 static syncsendbuf send_buffer;
 
+/* serializes the parallel push engine's shared state, including the
+** transfer statistics updated by the write_data_* helpers
+*/
+ADB_MUTEX_DEFINE( sync_engine_lock );
+
+static void count_bytes(unsigned n)
+{
+    adb_mutex_lock(&sync_engine_lock);
+    total_bytes += n;
+    adb_mutex_unlock(&sync_engine_lock);
+}
+
 int sync_readtime(int fd, const char *path, unsigned *timestamp)
 {
     syncmsg msg;
     int len = strlen(path);
 
-    msg.req.id = ID_STAT;
-    msg.req.namelen = htoll(len);
-
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, path, len)) {
+    if(sync_write_req(fd, ID_STAT, path, len)) {
         return -1;
     }
 
@@ -150,18 +200,7 @@ int sync_readtime(int fd, const char *path, unsigned *timestamp)
 
 static int sync_start_readtime(int fd, const char *path)
 {
-    syncmsg msg;
-    int len = strlen(path);
-
-    msg.req.id = ID_STAT;
-    msg.req.namelen = htoll(len);
-
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, path, len)) {
-        return -1;
-    }
-
-    return 0;
+    return sync_write_req(fd, ID_STAT, path, strlen(path));
 }
 
 static int sync_finish_readtime(int fd, unsigned int *timestamp,
@@ -182,16 +221,187 @@ static int sync_finish_readtime(int fd, unsigned int *timestamp,
     return 0;
 }
 
+static int sync_start_readhash(int fd, const char *path)
+{
+    return sync_write_req(fd, ID_HASH, path, strlen(path));
+}
+
+static int sync_finish_readhash(int fd, unsigned long long *hash)
+{
+    syncmsg msg;
+
+    if(readx(fd, &msg.hash, sizeof(msg.hash)))
+        return -1;
+
+    if(msg.hash.id != ID_HASH)
+        return -1;
+
+    *hash = ((unsigned long long) ltohl(msg.hash.hash_hi) << 32)
+          | ltohl(msg.hash.hash_lo);
+    return 0;
+}
+
+/* old sync services abort the whole channel on an unknown request, so
+** probe the service's capability bits once, on a throwaway channel.
+** a service too old for ID_CAPS reports no capabilities at all.
+*/
+static unsigned sync_get_caps(void)
+{
+    static int probed = 0;
+    static unsigned caps = 0;
+    syncmsg msg;
+    int fd;
+
+    if(probed) return caps;
+    probed = 1;
+
+    fd = adb_connect("sync:");
+    if(fd < 0) return 0;
+
+    msg.req.id = ID_CAPS;
+    msg.req.namelen = 0;
+    if(writex(fd, &msg.req, sizeof(msg.req)) == 0 &&
+       readx(fd, &msg.data, sizeof(msg.data)) == 0 &&
+       msg.data.id == ID_CAPS) {
+        caps = ltohl(msg.data.size);
+        sync_quit(fd);
+    }
+    adb_close(fd);
+    return caps;
+}
+
+static int sync_hash_supported(void)
+{
+    return (sync_get_caps() & SYNC_CAP_HASH) != 0;
+}
+
+static int sync_compress_supported(void)
+{
+    char *env = getenv("ADB_SYNC_COMPRESS");
+
+    if(env && env[0] == '0') return 0;
+    return (sync_get_caps() & SYNC_CAP_COMPRESS) != 0;
+}
+
+/* resuming costs one extra round trip per file, so it is only worth
+** engaging for files large enough that a restarted transfer hurts
+*/
+#define SYNC_RESUME_MIN (1024*1024)
+
+static int sync_resume_supported(void)
+{
+    char *env = getenv("ADB_SYNC_RESUME");
+
+    if(env && env[0] == '0') return 0;
+    return (sync_get_caps() & SYNC_CAP_RESUME) != 0;
+}
+
+/* the block negotiation costs a remote stat, a full local hashing
+** pass and an extra round trip, so like resuming it only engages
+** once a file spans enough blocks for the reuse to pay for that
+*/
+#define SYNC_DELTA_MIN (256*1024)
+
+static int sync_delta_supported(void)
+{
+    char *env = getenv("ADB_SYNC_DELTA");
+
+    if(env && env[0] == '0') return 0;
+    return (sync_get_caps() & SYNC_CAP_DELTA) != 0;
+}
+
+static int sync_lsv2_supported(void)
+{
+    return (sync_get_caps() & SYNC_CAP_LSTV2) != 0;
+}
+
+/* recursive variant of sync_ls(): one ID_LST2 request streams the
+** whole subtree's metadata, with names relative to path
+*/
+static int sync_ls_v2(int fd, const char *path, sync_ls_cb func, void *cookie)
+{
+    syncmsg msg;
+    char buf[1024 + 1];
+    int len;
+
+    len = strlen(path);
+    if(len > 1024) goto fail;
+
+    if(sync_write_req(fd, ID_LST2, path, len)) {
+        goto fail;
+    }
+
+    for(;;) {
+        if(readx(fd, &msg.dent, sizeof(msg.dent))) break;
+        if(msg.dent.id == ID_DONE) return 0;
+        if(msg.dent.id != ID_DENT) break;
+
+        len = ltohl(msg.dent.namelen);
+        if(len > 1024) break;
+
+        if(readx(fd, buf, len)) break;
+        buf[len] = 0;
+
+        func(ltohl(msg.dent.mode),
+             ltohl(msg.dent.size),
+             ltohl(msg.dent.time),
+             buf, cookie);
+    }
+
+fail:
+    adb_close(fd);
+    return -1;
+}
+
+/* pushing already-compressed formats through deflate again just
+** burns cpu on both ends for nothing
+*/
+static int file_is_compressible(const char *path)
+{
+    static const char * const skip[] = {
+        ".zip", ".jar", ".gz", ".tgz", ".bz2",
+        ".png", ".jpg", ".jpeg", ".gif",
+        ".mp3", ".mp4", ".m4a", ".3gp", ".ogg", ".avi",
+        0
+    };
+    const char *ext = strrchr(path, '.');
+    int n;
+
+    if(ext == 0) return 1;
+    for(n = 0; skip[n]; n++) {
+        if(strcasecmp(ext, skip[n]) == 0) return 0;
+    }
+    return 1;
+}
+
+static unsigned long long local_file_hash(const char *path)
+{
+    unsigned long long h = 0;
+    int fd, r;
+
+    fd = adb_open(path, O_RDONLY);
+    if(fd < 0) return 0;
+
+    h = SYNC_HASH_INIT;
+    for(;;) {
+        r = adb_read(fd, send_buffer.data, SYNC_DATA_MAX);
+        if(r <= 0) {
+            if(r < 0 && errno == EINTR) continue;
+            if(r < 0) h = 0;
+            break;
+        }
+        h = sync_hash_update(h, (unsigned char*) send_buffer.data, r);
+    }
+    adb_close(fd);
+    return h;
+}
+
 int sync_readmode(int fd, const char *path, unsigned *mode)
 {
     syncmsg msg;
     int len = strlen(path);
 
-    msg.req.id = ID_STAT;
-    msg.req.namelen = htoll(len);
-
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, path, len)) {
+    if(sync_write_req(fd, ID_STAT, path, len)) {
         return -1;
     }
 
@@ -207,7 +417,36 @@ int sync_readmode(int fd, const char *path, unsigned *mode)
     return 0;
 }
 
-static int write_data_file(int fd, const char *path, syncsendbuf *sbuf)
+/* hash of the first 'len' bytes only, for checking whether a partial
+** remote temp file is a prefix of the local source before resuming
+*/
+static unsigned long long local_prefix_hash(const char *path, unsigned len)
+{
+    unsigned long long h = 0;
+    unsigned left = len;
+    int fd, r;
+
+    fd = adb_open(path, O_RDONLY);
+    if(fd < 0) return 0;
+
+    h = SYNC_HASH_INIT;
+    while(left > 0) {
+        r = adb_read(fd, send_buffer.data,
+                     (left < SYNC_DATA_MAX) ? left : SYNC_DATA_MAX);
+        if(r <= 0) {
+            if(r < 0 && errno == EINTR) continue;
+            h = 0;
+            break;
+        }
+        h = sync_hash_update(h, (unsigned char*) send_buffer.data, r);
+        left -= r;
+    }
+    adb_close(fd);
+    return h;
+}
+
+static int write_data_file(int fd, const char *path, unsigned offset,
+                           syncsendbuf *sbuf)
 {
     int lfd, err = 0;
 
@@ -217,6 +456,12 @@ static int write_data_file(int fd, const char *path, syncsendbuf *sbuf)
         return -1;
     }
 
+    if(offset && adb_lseek(lfd, offset, SEEK_SET) != (int) offset) {
+        fprintf(stderr,"cannot seek '%s': %s\n", path, strerror(errno));
+        adb_close(lfd);
+        return -1;
+    }
+
     sbuf->id = ID_DATA;
     for(;;) {
         int ret;
@@ -237,7 +482,71 @@ static int write_data_file(int fd, const char *path, syncsendbuf *sbuf)
             err = -1;
             break;
         }
-        total_bytes += ret;
+        count_bytes(ret);
+    }
+
+    adb_close(lfd);
+    return err;
+}
+
+/* like write_data_file(), but deflates each chunk into the wire buffer.
+** a chunk that does not shrink is shipped raw as plain ID_DATA, which
+** also keeps every compressed frame within SYNC_DATA_MAX.
+*/
+static int write_data_file_z(int fd, const char *path, syncsendbuf *sbuf)
+{
+    syncmsg msg;
+    char raw[SYNC_DATA_MAX];
+    int lfd, err = 0;
+
+    lfd = adb_open(path, O_RDONLY);
+    if(lfd < 0) {
+        fprintf(stderr,"cannot open '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    for(;;) {
+        uLongf clen;
+        int ret;
+
+        ret = adb_read(lfd, raw, SYNC_DATA_MAX);
+        if(!ret)
+            break;
+
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr,"cannot read '%s': %s\n", path, strerror(errno));
+            break;
+        }
+
+        clen = SYNC_DATA_MAX;
+        if(compress2((Bytef*) sbuf->data, &clen, (Bytef*) raw, ret,
+                     Z_DEFAULT_COMPRESSION) == Z_OK && clen < (uLongf) ret) {
+            adb_iovec iov[2];
+
+            msg.zdata.id = ID_ZATA;
+            msg.zdata.size = htoll(clen);
+            msg.zdata.rawsize = htoll(ret);
+
+            iov[0].iov_base = &msg.zdata;
+            iov[0].iov_len  = sizeof(msg.zdata);
+            iov[1].iov_base = sbuf->data;
+            iov[1].iov_len  = clen;
+            if(writexv(fd, iov, 2)) {
+                err = -1;
+                break;
+            }
+        } else {
+            sbuf->id = ID_DATA;
+            sbuf->size = htoll(ret);
+            memcpy(sbuf->data, raw, ret);
+            if(writex(fd, sbuf, sizeof(unsigned) * 2 + ret)) {
+                err = -1;
+                break;
+            }
+        }
+        count_bytes(ret);
     }
 
     adb_close(lfd);
@@ -263,12 +572,135 @@ static int write_data_buffer(int fd, char* file_buffer, int size, syncsendbuf *s
             break;
         }
         total += count;
-        total_bytes += count;
+        count_bytes(count);
     }
 
     return err;
 }
 
+/* ship a file over an ID_DSND request: hash it locally one block at
+** a time, learn which blocks the previous remote version already
+** holds, and send only the rest as exact-length ID_DATA chunks in
+** file order.  runs between the request and the trailing ID_DONE;
+** corks once the negotiation is over.
+*/
+static int sync_send_delta(int fd, const char *lpath, const char *rpath,
+                           unsigned size, syncsendbuf *sbuf)
+{
+    syncmsg msg;
+    adb_iovec iov[2];
+    unsigned char *hashes = NULL;
+    unsigned char *map = NULL;
+    unsigned blksize = SYNC_DATA_MAX;
+    unsigned count = (size + blksize - 1) / blksize;
+    unsigned i, reused = 0;
+    int lfd = -1;
+
+    hashes = malloc(count * 8);
+    map = malloc(count);
+    if(hashes == NULL || map == NULL) {
+        fprintf(stderr,"could not allocate block table for '%s'\n", lpath);
+        goto fail;
+    }
+
+    lfd = adb_open(lpath, O_RDONLY);
+    if(lfd < 0) {
+        fprintf(stderr,"cannot open '%s': %s\n", lpath, strerror(errno));
+        goto fail;
+    }
+
+    for(i = 0; i < count; i++) {
+        unsigned len = blksize, got = 0, lo, hi;
+        unsigned long long h;
+        int r;
+
+        if(i == count - 1)
+            len = size - i * blksize;
+        while(got < len) {
+            r = adb_read(lfd, sbuf->data + got, len - got);
+            if(r < 0 && errno == EINTR) continue;
+            if(r <= 0) {
+                fprintf(stderr,"cannot read '%s': %s\n", lpath,
+                        strerror(errno));
+                goto fail;
+            }
+            got += r;
+        }
+        h = sync_hash_update(SYNC_HASH_INIT,
+                             (unsigned char*) sbuf->data, len);
+        lo = htoll((unsigned) h);
+        hi = htoll((unsigned) (h >> 32));
+        memcpy(hashes + i * 8, &lo, 4);
+        memcpy(hashes + i * 8 + 4, &hi, 4);
+    }
+
+    msg.delta.id = ID_BLKS;
+    msg.delta.count = htoll(count);
+    msg.delta.blksize = htoll(blksize);
+    msg.delta.size = htoll(size);
+    iov[0].iov_base = &msg.delta;
+    iov[0].iov_len  = sizeof(msg.delta);
+    iov[1].iov_base = hashes;
+    iov[1].iov_len  = count * 8;
+    if(writexv(fd, iov, 2))
+        goto fail;
+
+    if(readx(fd, &msg.delta, sizeof(msg.delta)) ||
+       msg.delta.id != ID_BLKS || ltohl(msg.delta.count) != count)
+        goto fail;
+    if(readx(fd, map, count))
+        goto fail;
+
+        /* data flows one way from here, same as a plain send */
+    adb_tcp_cork(fd);
+
+    if(adb_lseek(lfd, 0, SEEK_SET) != 0)
+        goto fail;
+    for(i = 0; i < count; i++) {
+        unsigned len = blksize, got = 0;
+        int r;
+
+        if(i == count - 1)
+            len = size - i * blksize;
+        if(map[i]) {
+            if(adb_lseek(lfd, len, SEEK_CUR) < 0)
+                goto fail;
+            reused++;
+            continue;
+        }
+        while(got < len) {
+            r = adb_read(lfd, sbuf->data + got, len - got);
+            if(r < 0 && errno == EINTR) continue;
+            if(r <= 0) {
+                fprintf(stderr,"cannot read '%s': %s\n", lpath,
+                        strerror(errno));
+                goto fail;
+            }
+            got += r;
+        }
+        sbuf->id = ID_DATA;
+        sbuf->size = htoll(len);
+        if(writex(fd, sbuf, sizeof(unsigned) * 2 + len))
+            goto fail;
+        count_bytes(len);
+    }
+
+    if(reused)
+        fprintf(stderr,"delta %s: reusing %u of %u blocks\n",
+                rpath, reused, count);
+
+    adb_close(lfd);
+    free(hashes);
+    free(map);
+    return 0;
+
+fail:
+    if(lfd >= 0) adb_close(lfd);
+    if(hashes) free(hashes);
+    if(map) free(map);
+    return -1;
+}
+
 #ifdef HAVE_SYMLINKS
 static int write_data_link(int fd, const char *path, syncsendbuf *sbuf)
 {
@@ -288,20 +720,54 @@ static int write_data_link(int fd, const char *path, syncsendbuf *sbuf)
     if(ret)
         return -1;
 
-    total_bytes += len + 1;
+    count_bytes(len + 1);
 
     return 0;
 }
 #endif
 
-static int sync_send(int fd, const char *lpath, const char *rpath,
-                     unsigned mtime, mode_t mode, int verifyApk)
+/* read one deferred ID_SEND status reply off the channel */
+static int sync_read_status(int fd, const char *lpath, const char *rpath,
+                            syncsendbuf *sbuf)
 {
     syncmsg msg;
+    int len;
+
+    if(readx(fd, &msg.status, sizeof(msg.status)))
+        return -1;
+
+    if(msg.status.id != ID_OKAY) {
+        if(msg.status.id == ID_FAIL) {
+            len = ltohl(msg.status.msglen);
+            if(len > 256) len = 256;
+            if(readx(fd, sbuf->data, len)) {
+                return -1;
+            }
+            sbuf->data[len] = 0;
+        } else
+            strcpy(sbuf->data, "unknown reason");
+
+        fprintf(stderr,"failed to copy '%s' to '%s': %s\n", lpath, rpath, sbuf->data);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sync_send_buf(int fd, const char *lpath, const char *rpath,
+                         unsigned mtime, mode_t mode, int verifyApk,
+                         syncsendbuf *sbuf, int nowait)
+{
+    syncmsg msg;
+    adb_iovec iov[3];
     int len, r;
-    syncsendbuf *sbuf = &send_buffer;
     char* file_buffer = NULL;
     int size = 0;
+    int compress = 0;
+    int resume = 0;
+    int delta = 0;
+    unsigned resume_offset = 0;
+    unsigned delta_size = 0;
     char tmp[64];
 
     len = strlen(rpath);
@@ -367,20 +833,108 @@ static int sync_send(int fd, const char *lpath, const char *rpath,
         }
     }
 
-    msg.req.id = ID_SEND;
+        /* apks are zip archives, so there is nothing left to squeeze
+        ** out of the verified-apk path
+        */
+    if(!verifyApk && !file_buffer && S_ISREG(mode) &&
+       file_is_compressible(lpath) && sync_compress_supported())
+        compress = 1;
+
+        /* pipelined senders cannot stop for the offset negotiation
+        ** without stalling the pipe, so only single-file pushes are
+        ** resumable; those are exactly the large-media case
+        */
+    if(!nowait && !verifyApk && S_ISREG(mode) && sync_resume_supported()) {
+        struct stat rst;
+
+        if(stat(lpath, &rst) == 0 && rst.st_size >= SYNC_RESUME_MIN) {
+            resume = 1;
+            compress = 0;   /* resumed streams are sent raw */
+        }
+    }
+
+        /* with a previous version of the file already on the device,
+        ** negotiating per-block beats resending the whole thing - and
+        ** beats resuming, which only salvages an interrupted copy of
+        ** the same bytes
+        */
+    if(!nowait && !verifyApk && S_ISREG(mode) && sync_delta_supported()) {
+        struct stat dst;
+        unsigned rmode;
+
+        if(stat(lpath, &dst) == 0 && dst.st_size >= SYNC_DELTA_MIN &&
+           sync_readmode(fd, rpath, &rmode) == 0 && S_ISREG(rmode)) {
+            delta = 1;
+            delta_size = dst.st_size;
+            resume = 0;
+            compress = 0;
+        }
+    }
+
+    msg.req.id = delta ? ID_DSND :
+                 (resume ? ID_RSND : (compress ? ID_ZSND : ID_SEND));
     msg.req.namelen = htoll(len + r);
 
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, rpath, len) || writex(fd, tmp, r)) {
+    iov[0].iov_base = &msg.req;
+    iov[0].iov_len  = sizeof(msg.req);
+    iov[1].iov_base = (char*) rpath;
+    iov[1].iov_len  = len;
+    iov[2].iov_base = tmp;
+    iov[2].iov_len  = r;
+
+        /* cork for the duration of the transfer so the request, the
+        ** data chunks and the trailing ID_DONE pack into full segments;
+        ** uncorking below flushes the tail before we wait for status.
+        ** a resumable or delta send waits for its negotiation first,
+        ** so its request must not sit in a corked partial segment
+        */
+    if(!resume && !delta)
+        adb_tcp_cork(fd);
+
+    if(writexv(fd, iov, 3)) {
         free(file_buffer);
         goto fail;
     }
 
+    if(resume) {
+        unsigned have;
+        unsigned long long rhash;
+
+        if(readx(fd, &msg.resume, sizeof(msg.resume)) ||
+           msg.resume.id != ID_OFFS)
+            goto fail;
+
+        have = ltohl(msg.resume.size);
+        rhash = ((unsigned long long) ltohl(msg.resume.hash_hi) << 32)
+              | ltohl(msg.resume.hash_lo);
+        if(have != 0 && rhash != 0 &&
+           rhash == local_prefix_hash(lpath, have))
+            resume_offset = have;
+        if(resume_offset)
+            fprintf(stderr,"resuming %s at byte %u\n", rpath, resume_offset);
+
+        msg.resume.id = ID_OFFS;
+        msg.resume.size = htoll(resume_offset);
+        msg.resume.hash_lo = 0;
+        msg.resume.hash_hi = 0;
+        if(writex(fd, &msg.resume, sizeof(msg.resume)))
+            goto fail;
+
+        adb_tcp_cork(fd);
+    }
+
     if (file_buffer) {
         write_data_buffer(fd, file_buffer, size, sbuf);
         free(file_buffer);
-    } else if (S_ISREG(mode))
-        write_data_file(fd, lpath, sbuf);
+    } else if (S_ISREG(mode)) {
+        if(delta) {
+            if(sync_send_delta(fd, lpath, rpath, delta_size, sbuf))
+                goto fail;
+        } else if(compress)
+            write_data_file_z(fd, lpath, sbuf);
+        else
+            write_data_file(fd, lpath, resume_offset, sbuf);
+    }
 #ifdef HAVE_SYMLINKS
     else if (S_ISLNK(mode))
         write_data_link(fd, lpath, sbuf);
@@ -393,25 +947,19 @@ static int sync_send(int fd, const char *lpath, const char *rpath,
     if(writex(fd, &msg.data, sizeof(msg.data)))
         goto fail;
 
-    if(readx(fd, &msg.status, sizeof(msg.status)))
-        return -1;
+    adb_tcp_uncork(fd);
 
-    if(msg.status.id != ID_OKAY) {
-        if(msg.status.id == ID_FAIL) {
-            len = ltohl(msg.status.msglen);
-            if(len > 256) len = 256;
-            if(readx(fd, sbuf->data, len)) {
-                return -1;
-            }
-            sbuf->data[len] = 0;
-        } else
-            strcpy(sbuf->data, "unknown reason");
+    adb_mutex_lock(&sync_engine_lock);
+    total_files++;
+    adb_mutex_unlock(&sync_engine_lock);
 
-        fprintf(stderr,"failed to copy '%s' to '%s': %s\n", lpath, rpath, sbuf->data);
-        return -1;
-    }
+        /* pipelined callers reap the status reply later with
+        ** sync_read_status()
+        */
+    if(nowait)
+        return 0;
 
-    return 0;
+    return sync_read_status(fd, lpath, rpath, sbuf);
 
 fail:
     fprintf(stderr,"protocol failure\n");
@@ -419,6 +967,13 @@ fail:
     return -1;
 }
 
+static int sync_send(int fd, const char *lpath, const char *rpath,
+                     unsigned mtime, mode_t mode, int verifyApk)
+{
+    return sync_send_buf(fd, lpath, rpath, mtime, mode, verifyApk,
+                         &send_buffer, 0);
+}
+
 static int mkdirs(char *name)
 {
     int ret;
@@ -438,6 +993,130 @@ static int mkdirs(char *name)
     return 0;
 }
 
+/* pull pipeline: sync_recv used to write every received chunk to disk
+** inline on the protocol loop, so each local write stalled the stream
+** (pulls to an NFS workspace ran at a fraction of local-disk speed
+** from that coupling alone).  a small ring of buffers drained by a
+** lazily started writer thread keeps the network reads running ahead
+** of the disk: the reader fills free slots straight off the socket
+** while the writer flushes full ones.  the writer also folds each
+** chunk into an FNV-1a as it passes, so the optional end-to-end
+** verify below costs no second read of the file.
+*/
+#define RECV_RING_SLOTS 16
+
+typedef struct {
+    unsigned len;
+    char data[SYNC_DATA_MAX];
+} recv_slot;
+
+static recv_slot recv_ring[RECV_RING_SLOTS];
+static unsigned recv_head;          /* next slot the writer drains */
+static unsigned recv_tail;          /* next slot the reader fills */
+static unsigned recv_count;         /* slots queued for the writer */
+static int recv_lfd = -1;           /* file under assembly */
+static int recv_werrno;             /* first write error, 0 = none */
+static unsigned long long recv_hash;
+static int recv_started;
+ADB_MUTEX_DEFINE( recv_ring_lock );
+static adb_cond_t recv_ring_cond = ADB_COND_INITIALIZER;
+
+static void *recv_writer(void *unused)
+{
+    for(;;) {
+        recv_slot *slot;
+
+        adb_mutex_lock(&recv_ring_lock);
+        while(recv_count == 0)
+            adb_cond_wait(&recv_ring_cond, &recv_ring_lock);
+        slot = &recv_ring[recv_head];
+        adb_mutex_unlock(&recv_ring_lock);
+
+            /* after the first failure just drain: the reader notices
+            ** the errno once the file is done
+            */
+        if(recv_werrno == 0) {
+            recv_hash = sync_hash_update(recv_hash,
+                                         (unsigned char*) slot->data,
+                                         slot->len);
+            if(writex(recv_lfd, slot->data, slot->len))
+                recv_werrno = errno ? errno : EIO;
+        }
+
+        adb_mutex_lock(&recv_ring_lock);
+        recv_head = (recv_head + 1) % RECV_RING_SLOTS;
+        recv_count--;
+        adb_cond_broadcast(&recv_ring_cond);
+        adb_mutex_unlock(&recv_ring_lock);
+    }
+    return 0;
+}
+
+/* arm the ring for one file.  returns 0 (caller writes inline) if the
+** writer thread cannot be spun up.
+*/
+static int recv_writer_start(int lfd)
+{
+    if(!recv_started) {
+        adb_thread_t t;
+
+        if(adb_thread_create(&t, recv_writer, 0))
+            return 0;
+        recv_started = 1;
+    }
+    recv_lfd = lfd;
+    recv_werrno = 0;
+    recv_hash = SYNC_HASH_INIT;
+    return 1;
+}
+
+/* wait for a free slot and hand out its buffer; the chunk is read
+** straight into it and queued with recv_commit_slot()
+*/
+static char *recv_fill_slot(void)
+{
+    adb_mutex_lock(&recv_ring_lock);
+    while(recv_count == RECV_RING_SLOTS)
+        adb_cond_wait(&recv_ring_cond, &recv_ring_lock);
+    adb_mutex_unlock(&recv_ring_lock);
+    return recv_ring[recv_tail].data;
+}
+
+static void recv_commit_slot(unsigned len)
+{
+    recv_ring[recv_tail].len = len;
+    adb_mutex_lock(&recv_ring_lock);
+    recv_tail = (recv_tail + 1) % RECV_RING_SLOTS;
+    recv_count++;
+    adb_cond_broadcast(&recv_ring_cond);
+    adb_mutex_unlock(&recv_ring_lock);
+}
+
+/* drain the ring and disarm; returns the errno of the first failed
+** write, if any.  once this returns the writer is parked and
+** recv_hash covers the whole file.
+*/
+static int recv_finish(void)
+{
+    adb_mutex_lock(&recv_ring_lock);
+    while(recv_count != 0)
+        adb_cond_wait(&recv_ring_cond, &recv_ring_lock);
+    adb_mutex_unlock(&recv_ring_lock);
+    recv_lfd = -1;
+    return recv_werrno;
+}
+
+/* end-to-end pull verification: compare the device's ID_HASH of the
+** source against the hash folded in by the writer stage.  off by
+** default, it costs a round trip per file.
+*/
+static int sync_verify_requested(void)
+{
+    char *env = getenv("ADB_SYNC_VERIFY");
+
+    return env && env[0] == '1';
+}
+
 int sync_recv(int fd, const char *rpath, const char *lpath)
 {
     syncmsg msg;
@@ -445,14 +1124,13 @@ int sync_recv(int fd, const char *rpath, const char *lpath)
     int lfd = -1;
     char *buffer = send_buffer.data;
     unsigned id;
+    unsigned long long filehash = SYNC_HASH_INIT;
+    int pipelined = 0;
 
     len = strlen(rpath);
     if(len > 1024) return -1;
 
-    msg.req.id = ID_RECV;
-    msg.req.namelen = htoll(len);
-    if(writex(fd, &msg.req, sizeof(msg.req)) ||
-       writex(fd, rpath, len)) {
+    if(sync_write_req(fd, ID_RECV, rpath, len)) {
         return -1;
     }
 
@@ -469,44 +1147,86 @@ int sync_recv(int fd, const char *rpath, const char *lpath)
             fprintf(stderr,"cannot create '%s': %s\n", lpath, strerror(errno));
             return -1;
         }
+        pipelined = recv_writer_start(lfd);
         goto handle_data;
     } else {
         goto remote_error;
     }
 
     for(;;) {
+        char *dst;
+
         if(readx(fd, &msg.data, sizeof(msg.data))) {
-            return -1;
+            goto local_error;
         }
         id = msg.data.id;
 
     handle_data:
         len = ltohl(msg.data.size);
         if(id == ID_DONE) break;
-        if(id != ID_DATA) goto remote_error;
+        if(id != ID_DATA) {
+            if(pipelined) recv_finish();
+            goto remote_error;
+        }
         if(len > SYNC_DATA_MAX) {
             fprintf(stderr,"data overrun\n");
-            adb_close(lfd);
-            return -1;
+            goto local_error;
         }
 
-        if(readx(fd, buffer, len)) {
-            adb_close(lfd);
-            return -1;
+        dst = pipelined ? recv_fill_slot() : buffer;
+        if(readx(fd, dst, len)) {
+            goto local_error;
         }
 
-        if(writex(lfd, buffer, len)) {
-            fprintf(stderr,"cannot write '%s': %s\n", rpath, strerror(errno));
-            adb_close(lfd);
-            return -1;
+        if(pipelined) {
+            recv_commit_slot(len);
+        } else {
+            filehash = sync_hash_update(filehash,
+                                        (unsigned char*) buffer, len);
+            if(writex(lfd, buffer, len)) {
+                fprintf(stderr,"cannot write '%s': %s\n", rpath,
+                        strerror(errno));
+                goto local_error;
+            }
         }
 
         total_bytes += len;
     }
 
+    if(pipelined) {
+        int werr = recv_finish();
+
+        if(werr) {
+            fprintf(stderr,"cannot write '%s': %s\n", lpath, strerror(werr));
+            adb_close(lfd);
+            return -1;
+        }
+        filehash = recv_hash;
+    }
+
+    total_files++;
     adb_close(lfd);
+
+    if(sync_verify_requested() && sync_hash_supported()) {
+        unsigned long long rhash = 0;
+
+        if(sync_start_readhash(fd, rpath) ||
+           sync_finish_readhash(fd, &rhash))
+            return -1;
+            /* 0 means the service could not hash it; nothing to check */
+        if(rhash != 0 && rhash != filehash) {
+            fprintf(stderr,"verify of '%s' failed: content mismatch\n",
+                    lpath);
+            return -1;
+        }
+    }
     return 0;
 
+local_error:
+    if(pipelined) recv_finish();
+    adb_close(lfd);
+    return -1;
+
 remote_error:
     adb_close(lfd);
     adb_unlink(lpath);
@@ -554,6 +1274,59 @@ int do_sync_ls(const char *path)
     }
 }
 
+/* remove a file or tree on the device through the sync service: one
+** request, walked natively by adbd, instead of spawning toolbox rm
+** through the shell
+*/
+int do_sync_rm(const char *path, int recursive)
+{
+    syncmsg msg;
+    char buffer[257];
+    int len, fd;
+
+    if(!(sync_get_caps() & SYNC_CAP_REMOVE)) {
+        fprintf(stderr,"error: device does not support remove; "
+                "use 'adb shell rm' instead\n");
+        return 1;
+    }
+
+    len = strlen(path);
+    if(len > 1024) {
+        fprintf(stderr,"error: path too long\n");
+        return 1;
+    }
+
+    fd = adb_connect("sync:");
+    if(fd < 0) {
+        fprintf(stderr,"error: %s\n", adb_error());
+        return 1;
+    }
+
+    if(sync_write_req(fd, recursive ? ID_RMDR : ID_ULNK, path, len) ||
+       readx(fd, &msg.status, sizeof(msg.status))) {
+        fprintf(stderr,"error: connection terminated\n");
+        adb_close(fd);
+        return 1;
+    }
+
+    if(msg.status.id != ID_OKAY) {
+        strcpy(buffer, "unknown reason");
+        if(msg.status.id == ID_FAIL) {
+            len = ltohl(msg.status.msglen);
+            if(len > 256) len = 256;
+            if(readx(fd, buffer, len) == 0)
+                buffer[len] = 0;
+        }
+        fprintf(stderr,"failed to remove '%s': %s\n", path, buffer);
+        adb_close(fd);
+        return 1;
+    }
+
+    sync_quit(fd);
+    adb_close(fd);
+    return 0;
+}
+
 typedef struct copyinfo copyinfo;
 
 struct copyinfo
@@ -565,6 +1338,7 @@ struct copyinfo
     unsigned int mode;
     unsigned int size;
     int flag;
+    int hashable;
     //char data[0];
 };
 
@@ -588,6 +1362,7 @@ copyinfo *mkcopyinfo(const char *spath, const char *dpath,
     ci->mode = 0;
     ci->size = 0;
     ci->flag = 0;
+    ci->hashable = 0;
     ci->src = (const char*)(ci + 1);
     ci->dst = ci->src + ssize;
     snprintf((char*) ci->src, ssize, isdir ? "%s%s/" : "%s%s", spath, name);
@@ -598,7 +1373,111 @@ copyinfo *mkcopyinfo(const char *spath, const char *dpath,
 }
 
 
-static int local_build_list(copyinfo **filelist,
+/* transfer-plan accounting for dry runs: file and byte totals keyed by
+** the source directory, so schedulers can see where the volume is
+*/
+typedef struct plandir plandir;
+
+struct plandir
+{
+    plandir *next;
+    unsigned files;
+    unsigned long long bytes;
+    char path[1];
+};
+
+static void plan_account(plandir **list, const char *path, unsigned size)
+{
+    const char *end = adb_dirstop(path);
+    int len = end ? (int)(end - path) + 1 : 0;
+    plandir *p;
+
+    for(p = *list; p; p = p->next) {
+        if(!strncmp(p->path, path, len) && p->path[len] == 0) break;
+    }
+    if(p == 0) {
+        p = malloc(sizeof(plandir) + len);
+        if(p == 0) {
+            fprintf(stderr,"out of memory\n");
+            abort();
+        }
+        memcpy(p->path, path, len);
+        p->path[len] = 0;
+        p->files = 0;
+        p->bytes = 0;
+        p->next = *list;
+        *list = p;
+    }
+    p->files++;
+    p->bytes += size;
+}
+
+static void plan_report(plandir *list, int skipped, const char *verb)
+{
+    plandir *p, *next;
+    unsigned files = 0;
+    unsigned long long bytes = 0;
+
+    for(p = list; p; p = next) {
+        next = p->next;
+        fprintf(stderr,"plan: %4u file%s %12llu bytes  %s\n",
+                p->files, (p->files == 1) ? " " : "s", p->bytes, p->path);
+        files += p->files;
+        bytes += p->bytes;
+        free(p);
+    }
+    fprintf(stderr,"plan: would %s %u file%s (%llu bytes), "
+            "%d file%s up to date.\n",
+            verb, files, (files == 1) ? "" : "s", bytes,
+            skipped, (skipped == 1) ? "" : "s");
+}
+
+/* one inode set per device: inode numbers only identify a file within
+** a single filesystem (every ext root is inode 2, every lost+found
+** inode 11), so a tree spanning mounts must key the visited test on
+** the (st_dev, st_ino) pair or a never-seen directory can be pruned
+** for sharing an inode number with one on another filesystem.  the
+** handful of distinct devices in a push keeps the per-device scan
+** trivial; the per-inode test stays O(1) in the apset.
+*/
+typedef struct devset devset;
+struct devset {
+    dev_t dev;
+    apset inodes;
+    devset *next;
+};
+
+static apset *devset_get(devset **sets, dev_t dev)
+{
+    devset *ds;
+
+    for(ds = *sets; ds; ds = ds->next) {
+        if(ds->dev == dev)
+            return &ds->inodes;
+    }
+    ds = malloc(sizeof(devset));
+    if(ds == NULL)
+        return NULL;
+    ds->dev = dev;
+    apset_init(&ds->inodes);
+    ds->next = *sets;
+    *sets = ds;
+    return &ds->inodes;
+}
+
+static void devset_destroy(devset **sets)
+{
+    devset *ds, *next;
+
+    for(ds = *sets; ds; ds = next) {
+        next = ds->next;
+        apset_destroy(&ds->inodes);
+        free(ds);
+    }
+    *sets = NULL;
+}
+
+static int local_build_list(copyinfo **filelist, devset **visited,
                             const char *lpath, const char *rpath)
 {
     DIR *d;
@@ -635,6 +1514,18 @@ static int local_build_list(copyinfo **filelist,
         stat(stat_path, &st);
 
         if (S_ISDIR(st.st_mode)) {
+                /* O(1) membership test on the directory's identity:
+                ** a symlinked cycle (or the same tree reachable
+                ** twice) is descended only once
+                */
+            apset *inodes = devset_get(visited, st.st_dev);
+
+            if (inodes &&
+                apset_add(inodes, (void*)(unsigned long)st.st_ino) > 0) {
+                fprintf(stderr, "skipping already-visited directory '%s%s/'\n",
+                        lpath, name);
+                continue;
+            }
             ci = mkcopyinfo(lpath, rpath, name, 1);
             ci->next = dirlist;
             dirlist = ci;
@@ -662,7 +1553,7 @@ static int local_build_list(copyinfo **filelist,
 
     for(ci = dirlist; ci != 0; ci = next) {
         next = ci->next;
-        local_build_list(filelist, ci->src, ci->dst);
+        local_build_list(filelist, visited, ci->src, ci->dst);
         free(ci);
     }
 
@@ -670,6 +1561,193 @@ static int local_build_list(copyinfo **filelist,
 }
 
 
+/* parallel push engine: a work list of copyinfo records is drained by
+** several workers, each owning its own sync channel.  a worker keeps
+** up to SYNC_PIPE_DEPTH files in flight on its channel before reaping
+** the deferred status replies, so small files are no longer paced by
+** one round trip each.
+*/
+#define SYNC_PUSH_CHANNELS  4
+#define SYNC_PIPE_DEPTH     8
+
+typedef struct {
+    copyinfo *work;         /* files not yet handed to a worker */
+    int failed;
+    int active;             /* live worker count */
+    unsigned pushed;
+} syncengine;
+
+typedef struct {
+    syncengine *engine;
+    int fd;
+    int own_fd;             /* close fd when the worker is done */
+    int inflight_count;
+    copyinfo *inflight[SYNC_PIPE_DEPTH];
+    syncsendbuf sbuf;
+} syncworker;
+
+static void sync_engine_fail(syncengine *e)
+{
+    adb_mutex_lock(&sync_engine_lock);
+    e->failed = 1;
+    adb_mutex_unlock(&sync_engine_lock);
+}
+
+static copyinfo *sync_engine_next(syncengine *e)
+{
+    copyinfo *ci = 0;
+
+    adb_mutex_lock(&sync_engine_lock);
+    if(!e->failed && e->work) {
+        ci = e->work;
+        e->work = ci->next;
+    }
+    adb_mutex_unlock(&sync_engine_lock);
+    return ci;
+}
+
+static int sync_worker_reap_one(syncworker *w)
+{
+    copyinfo *ci;
+    int r;
+
+    if(w->inflight_count == 0) return 0;
+    ci = w->inflight[0];
+    w->inflight_count--;
+    memmove(&w->inflight[0], &w->inflight[1],
+            w->inflight_count * sizeof(copyinfo*));
+
+    r = sync_read_status(w->fd, ci->src, ci->dst, &w->sbuf);
+    if(r == 0) {
+        adb_mutex_lock(&sync_engine_lock);
+        w->engine->pushed++;
+        adb_mutex_unlock(&sync_engine_lock);
+    }
+    free(ci);
+    return r;
+}
+
+static void *sync_push_worker(void *_w)
+{
+    syncworker *w = _w;
+    syncengine *e = w->engine;
+    copyinfo *ci;
+
+    while((ci = sync_engine_next(e)) != 0) {
+        fprintf(stderr,"push: %s -> %s\n", ci->src, ci->dst);
+        if(sync_send_buf(w->fd, ci->src, ci->dst, ci->time, ci->mode,
+                         0 /* no verify APK */, &w->sbuf, 1)) {
+            sync_engine_fail(e);
+            free(ci);
+            break;
+        }
+        w->inflight[w->inflight_count++] = ci;
+        if(w->inflight_count == SYNC_PIPE_DEPTH && sync_worker_reap_one(w)) {
+            sync_engine_fail(e);
+            break;
+        }
+    }
+
+        /* reap whatever is still in flight on this channel */
+    while(w->inflight_count > 0) {
+        if(sync_worker_reap_one(w)) {
+            sync_engine_fail(e);
+            break;
+        }
+    }
+    while(w->inflight_count > 0)
+        free(w->inflight[--w->inflight_count]);
+
+    if(w->own_fd) {
+        sync_quit(w->fd);
+        adb_close(w->fd);
+    }
+
+    adb_mutex_lock(&sync_engine_lock);
+    e->active--;
+    adb_mutex_unlock(&sync_engine_lock);
+    return 0;
+}
+
+static int sync_push_channels(void)
+{
+    char *env = getenv("ADB_PUSH_CHANNELS");
+    int n = env ? atoi(env) : SYNC_PUSH_CHANNELS;
+
+    if(n < 1) n = 1;
+    if(n > 16) n = 16;
+    return n;
+}
+
+/* push 'work' through up to 'channels' sync channels.  the caller's fd
+** is used by the first worker and is left open; extra channels are
+** opened and closed here.  returns 0 on success.
+*/
+static int sync_push_list(int fd, copyinfo *work, int *pushed)
+{
+    syncworker *workers;
+    adb_thread_t thread;
+    syncengine engine;
+    int channels = sync_push_channels();
+    int n, failed;
+
+    memset(&engine, 0, sizeof(engine));
+    engine.work = work;
+
+        /* resolve the capability probe now, before the workers can
+        ** race to issue it
+        */
+    sync_compress_supported();
+
+        /* each worker carries a SYNC_DATA_MAX buffer, so keep them
+        ** off the stack
+        */
+    workers = calloc(channels, sizeof(syncworker));
+    if(workers == 0) {
+        fprintf(stderr,"out of memory\n");
+        abort();
+    }
+
+    for(n = 0; n < channels; n++) {
+        workers[n].engine = &engine;
+        if(n == 0) {
+            workers[n].fd = fd;
+        } else {
+            workers[n].fd = adb_connect("sync:");
+            if(workers[n].fd < 0) break;
+            workers[n].own_fd = 1;
+        }
+    }
+    channels = n ? n : 1;
+
+    engine.active = channels;
+    for(n = 1; n < channels; n++) {
+        if(adb_thread_create(&thread, sync_push_worker, &workers[n])) {
+                /* fall back to fewer channels */
+            adb_mutex_lock(&sync_engine_lock);
+            engine.active--;
+            adb_mutex_unlock(&sync_engine_lock);
+            sync_quit(workers[n].fd);
+            adb_close(workers[n].fd);
+        }
+    }
+
+    sync_push_worker(&workers[0]);
+
+    for(;;) {
+        adb_mutex_lock(&sync_engine_lock);
+        n = engine.active;
+        adb_mutex_unlock(&sync_engine_lock);
+        if(n == 0) break;
+        adb_sleep_ms(1);
+    }
+
+    *pushed += engine.pushed;
+    failed = engine.failed;
+    free(workers);
+    return failed ? 1 : 0;
+}
+
 static int copy_local_dir_remote(int fd, const char *lpath, const char *rpath, int checktimestamps)
 {
     copyinfo *filelist = 0;
@@ -693,11 +1771,21 @@ static int copy_local_dir_remote(int fd, const char *lpath, const char *rpath, i
         rpath = tmp;
     }
 
-    if(local_build_list(&filelist, lpath, rpath)) {
-        return -1;
+    {
+        devset *visited = NULL;
+        int err;
+
+        err = local_build_list(&filelist, &visited, lpath, rpath);
+        devset_destroy(&visited);
+        if(err) {
+            return -1;
+        }
     }
 
-    if(checktimestamps){
+        /* a dry run always wants the stat phase, so the plan reflects
+        ** what a real transfer would actually send
+        */
+    if(checktimestamps || sync_dry_run){
         for(ci = filelist; ci != 0; ci = ci->next) {
             if(sync_start_readtime(fd, ci->dst)) {
                 return 1;
@@ -712,21 +1800,71 @@ static int copy_local_dir_remote(int fd, const char *lpath, const char *rpath, i
                 if((S_ISREG(ci->mode & mode) && timestamp == ci->time) ||
                     (S_ISLNK(ci->mode & mode) && timestamp >= ci->time))
                     ci->flag = 1;
+                else if(S_ISREG(ci->mode & mode))
+                    ci->hashable = 1;
+            }
+        }
+
+            /* same size but different mtime: compare content hashes
+            ** before re-pushing, since build systems love touching
+            ** files without changing them
+            */
+        if(sync_hash_supported()) {
+            int candidates = 0;
+
+            for(ci = filelist; ci != 0; ci = ci->next) {
+                if(ci->hashable) {
+                    if(sync_start_readhash(fd, ci->dst)) {
+                        return 1;
+                    }
+                    candidates++;
+                }
+            }
+            if(candidates) {
+                for(ci = filelist; ci != 0; ci = ci->next) {
+                    unsigned long long remote;
+
+                    if(!ci->hashable) continue;
+                    if(sync_finish_readhash(fd, &remote))
+                        return 1;
+                    if(remote != 0 && remote == local_file_hash(ci->src))
+                        ci->flag = 1;
+                }
             }
         }
     }
-    for(ci = filelist; ci != 0; ci = next) {
-        next = ci->next;
-        if(ci->flag == 0) {
-            fprintf(stderr,"push: %s -> %s\n", ci->src, ci->dst);
-            if(sync_send(fd, ci->src, ci->dst, ci->time, ci->mode, 0 /* no verify APK */)){
-                return 1;
+    {
+        copyinfo *work = 0;
+        copyinfo **tail = &work;
+
+            /* split off the up-to-date entries, keep the rest in order */
+        for(ci = filelist; ci != 0; ci = next) {
+            next = ci->next;
+            if(ci->flag == 0) {
+                *tail = ci;
+                tail = &ci->next;
+            } else {
+                skipped++;
+                free(ci);
             }
-            pushed++;
-        } else {
-            skipped++;
         }
-        free(ci);
+        *tail = 0;
+
+        if(sync_dry_run) {
+            plandir *plan = 0;
+
+            for(ci = work; ci != 0; ci = next) {
+                next = ci->next;
+                plan_account(&plan, ci->src, ci->size);
+                free(ci);
+            }
+            plan_report(plan, skipped, "push");
+            return 0;
+        }
+
+        if(work && sync_push_list(fd, work, &pushed)) {
+            return 1;
+        }
     }
 
     fprintf(stderr,"%d file%s pushed. %d file%s skipped.\n",
@@ -783,6 +1921,12 @@ int do_sync_push(const char *lpath, const char *rpath, int verifyApk)
             snprintf(tmp, tmplen, "%s/%s", rpath, name);
             rpath = tmp;
         }
+        if(sync_dry_run) {
+            fprintf(stderr,"plan: would push %s -> %s (%llu bytes)\n",
+                    lpath, rpath, (unsigned long long) st.st_size);
+            sync_quit(fd);
+            return 0;
+        }
         BEGIN();
         if(sync_send(fd, lpath, rpath, st.st_mtime, st.st_mode, verifyApk)) {
             return 1;
@@ -837,6 +1981,29 @@ sync_ls_build_list_cb(unsigned mode, unsigned size, unsigned time,
     }
 }
 
+/* ID_LST2 hands us the whole subtree with relative names, so every
+** file or link goes straight onto the file list; directory entries
+** only exist so the service could recurse and need no work here.
+*/
+static void
+sync_lsv2_build_list_cb(unsigned mode, unsigned size, unsigned time,
+                        const char *name, void *cookie)
+{
+    sync_ls_build_list_cb_args *args = (sync_ls_build_list_cb_args *)cookie;
+    copyinfo *ci;
+
+    if (S_ISREG(mode) || S_ISLNK(mode)) {
+        ci = mkcopyinfo(args->rpath, args->lpath, name, 0);
+        ci->time = time;
+        ci->mode = mode;
+        ci->size = size;
+        ci->next = *args->filelist;
+        *args->filelist = ci;
+    } else if (!S_ISDIR(mode)) {
+        fprintf(stderr, "skipping special file '%s'\n", name);
+    }
+}
+
 static int remote_build_list(int syncfd, copyinfo **filelist,
                              const char *rpath, const char *lpath)
 {
@@ -848,6 +2015,13 @@ static int remote_build_list(int syncfd, copyinfo **filelist,
     args.rpath = rpath;
     args.lpath = lpath;
 
+    /* A capable service streams the entire subtree in one request
+    ** instead of one ID_LIST round trip per directory. */
+    if (sync_lsv2_supported()) {
+        return sync_ls_v2(syncfd, rpath, sync_lsv2_build_list_cb,
+                          (void *)&args) ? 1 : 0;
+    }
+
     /* Put the files/dirs in rpath on the lists. */
     if (sync_ls(syncfd, rpath, sync_ls_build_list_cb, (void *)&args)) {
         return 1;
@@ -897,26 +2071,39 @@ static int copy_remote_dir_local(int fd, const char *rpath, const char *lpath,
         return -1;
     }
 
-#if 0
     if (checktimestamps) {
+            /* the local tree doubles as the manifest: every file we
+            ** pull gets its mtime set to the remote mtime below, so a
+            ** file whose size and mtime both still match needs no
+            ** transfer and no round trip
+            */
         for (ci = filelist; ci != 0; ci = ci->next) {
-            if (sync_start_readtime(fd, ci->dst)) {
-                return 1;
+            struct stat st;
+
+            if (!S_ISREG(ci->mode)) continue;
+            if (lstat(ci->dst, &st)) continue;
+            if (S_ISREG(st.st_mode) &&
+                (unsigned) st.st_size == ci->size &&
+                (unsigned) st.st_mtime == ci->time) {
+                ci->flag = 1;
             }
         }
-        for (ci = filelist; ci != 0; ci = ci->next) {
-            unsigned int timestamp, mode, size;
-            if (sync_finish_readtime(fd, &timestamp, &mode, &size))
-                return 1;
-	    if (size == ci->size) {
-                /* for links, we cannot update the atime/mtime */
-                if ((S_ISREG(ci->mode & mode) && timestamp == ci->time) ||
-		   (S_ISLNK(ci->mode & mode) && timestamp >= ci->time))
-                    ci->flag = 1;
-	    }
+    }
+    if (sync_dry_run) {
+        plandir *plan = 0;
+
+        for (ci = filelist; ci != 0; ci = next) {
+            next = ci->next;
+            if (ci->flag == 0)
+                plan_account(&plan, ci->src, ci->size);
+            else
+                skipped++;
+            free(ci);
         }
+        plan_report(plan, skipped, "pull");
+        return 0;
     }
-#endif
+
     for (ci = filelist; ci != 0; ci = next) {
         next = ci->next;
         if (ci->flag == 0) {
@@ -924,6 +2111,12 @@ static int copy_remote_dir_local(int fd, const char *rpath, const char *lpath,
             if (sync_recv(fd, ci->src, ci->dst)) {
                 return 1;
             }
+            if (S_ISREG(ci->mode) && ci->time) {
+                struct utimbuf ut;
+                ut.actime = ci->time;
+                ut.modtime = ci->time;
+                utime(ci->dst, &ut);
+            }
             pulled++;
         } else {
             skipped++;
@@ -978,6 +2171,18 @@ int do_sync_pull(const char *rpath, const char *lpath)
                 lpath = tmp;
             }
         }
+        if(sync_dry_run) {
+            unsigned timestamp, size;
+
+            if(sync_start_readtime(fd, rpath) ||
+               sync_finish_readtime(fd, &timestamp, &mode, &size)) {
+                return 1;
+            }
+            fprintf(stderr,"plan: would pull %s -> %s (%u bytes)\n",
+                    rpath, lpath, size);
+            sync_quit(fd);
+            return 0;
+        }
         BEGIN();
         if(sync_recv(fd, rpath, lpath)) {
             return 1;
@@ -988,7 +2193,7 @@ int do_sync_pull(const char *rpath, const char *lpath)
         }
     } else if(S_ISDIR(mode)) {
         BEGIN();
-        if (copy_remote_dir_local(fd, rpath, lpath, 0)) {
+        if (copy_remote_dir_local(fd, rpath, lpath, 1)) {
             return 1;
         } else {
             END();
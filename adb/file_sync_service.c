@@ -25,6 +25,8 @@
 
 #include <errno.h>
 
+#include <zlib.h>
+
 #include "sysdeps.h"
 
 #define TRACE_TAG  TRACE_SYNC
@@ -73,6 +75,47 @@ static int do_stat(int s, const char *path)
     return writex(s, &msg.stat, sizeof(msg.stat));
 }
 
+static int do_hash(int s, const char *path, char *buffer)
+{
+    syncmsg msg;
+    struct stat st;
+    unsigned long long h = 0;
+    int fd, r;
+
+    if(lstat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        fd = adb_open(path, O_RDONLY);
+        if(fd >= 0) {
+            h = SYNC_HASH_INIT;
+            for(;;) {
+                r = adb_read(fd, buffer, SYNC_DATA_MAX);
+                if(r <= 0) {
+                    if(r < 0 && errno == EINTR) continue;
+                    if(r < 0) h = 0;
+                    break;
+                }
+                h = sync_hash_update(h, (unsigned char*) buffer, r);
+            }
+            adb_close(fd);
+        }
+    }
+
+    msg.hash.id = ID_HASH;
+    msg.hash.hash_lo = htoll((unsigned) h);
+    msg.hash.hash_hi = htoll((unsigned) (h >> 32));
+    return writex(s, &msg.hash, sizeof(msg.hash));
+}
+
+static int do_caps(int s)
+{
+    syncmsg msg;
+
+    msg.data.id = ID_CAPS;
+    msg.data.size = htoll(SYNC_CAP_HASH | SYNC_CAP_COMPRESS |
+                          SYNC_CAP_LSTV2 | SYNC_CAP_RESUME |
+                          SYNC_CAP_REMOVE | SYNC_CAP_DELTA);
+    return writex(s, &msg.data, sizeof(msg.data));
+}
+
 static int do_list(int s, const char *path)
 {
     DIR *d;
@@ -108,8 +151,12 @@ static int do_list(int s, const char *path)
             msg.dent.time = htoll(st.st_mtime);
             msg.dent.namelen = htoll(len);
 
-            if(writex(s, &msg.dent, sizeof(msg.dent)) ||
-               writex(s, de->d_name, len)) {
+            adb_iovec iov[2];
+            iov[0].iov_base = &msg.dent;
+            iov[0].iov_len  = sizeof(msg.dent);
+            iov[1].iov_base = de->d_name;
+            iov[1].iov_len  = len;
+            if(writexv(s, iov, 2)) {
                 return -1;
             }
         }
@@ -126,21 +173,225 @@ done:
     return writex(s, &msg.dent, sizeof(msg.dent));
 }
 
+/* stream one level of a recursive ID_LST2 listing.  tmp holds the
+** absolute path with fname pointing just past its trailing '/', and
+** the names in the replies are relative to the root of the walk so
+** the client can rebuild the tree without a request per directory.
+*/
+static int do_list_v2_dir(int s, char *tmp, char *fname, const char *rel)
+{
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+    syncmsg msg;
+    char child[1024 + 256 + 1];
+    int rellen = strlen(rel);
+
+    d = opendir(tmp);
+    if(d == 0) return 0;
+
+    msg.dent.id = ID_DENT;
+
+    while((de = readdir(d))) {
+        int len = strlen(de->d_name);
+
+        if(de->d_name[0] == '.') {
+            if(de->d_name[1] == 0) continue;
+            if((de->d_name[1] == '.') && (de->d_name[2] == 0)) continue;
+        }
+
+            /* not supposed to be possible, but
+               if it does happen, let's not buffer overrun */
+        if(len > 256) continue;
+        if(rellen + len + 1 > 1024) continue;
+        if((fname - tmp) + len + 1 >= 1024 + 256) continue;
+
+        strcpy(fname, de->d_name);
+        if(lstat(tmp, &st) == 0) {
+            adb_iovec iov[2];
+
+            if(rellen)
+                snprintf(child, sizeof(child), "%s/%s", rel, de->d_name);
+            else
+                strcpy(child, de->d_name);
+
+            msg.dent.mode = htoll(st.st_mode);
+            msg.dent.size = htoll(st.st_size);
+            msg.dent.time = htoll(st.st_mtime);
+            msg.dent.namelen = htoll(strlen(child));
+
+            iov[0].iov_base = &msg.dent;
+            iov[0].iov_len  = sizeof(msg.dent);
+            iov[1].iov_base = child;
+            iov[1].iov_len  = strlen(child);
+            if(writexv(s, iov, 2)) {
+                closedir(d);
+                return -1;
+            }
+
+            if(S_ISDIR(st.st_mode)) {
+                char *end = fname + len;
+                *end++ = '/';
+                *end = 0;
+                if(do_list_v2_dir(s, tmp, end, child)) {
+                    closedir(d);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    closedir(d);
+    return 0;
+}
+
+static int do_list_v2(int s, const char *path)
+{
+    syncmsg msg;
+    char tmp[1024 + 256 + 2];
+    int len = strlen(path);
+    int err = 0;
+
+    if(len + 1 < (int)sizeof(tmp)) {
+        memcpy(tmp, path, len);
+        if(len == 0 || tmp[len - 1] != '/')
+            tmp[len++] = '/';
+        tmp[len] = 0;
+        err = do_list_v2_dir(s, tmp, tmp + len, "");
+    }
+    if(err) return err;
+
+    msg.dent.id = ID_DONE;
+    msg.dent.mode = 0;
+    msg.dent.size = 0;
+    msg.dent.time = 0;
+    msg.dent.namelen = 0;
+    return writex(s, &msg.dent, sizeof(msg.dent));
+}
+
+static int fail_message(int s, const char *reason);
+static int fail_errno(int s);
+
+static int do_remove(int s, const char *path)
+{
+    syncmsg msg;
+
+    if(adb_unlink(path)) {
+        return fail_errno(s);
+    }
+
+    msg.status.id = ID_OKAY;
+    msg.status.msglen = 0;
+    return writex(s, &msg.status, sizeof(msg.status));
+}
+
+/* delete one level of a tree, depth first.  tmp holds the absolute
+** path with fname pointing just past its trailing '/', same walking
+** scheme as do_list_v2_dir.  stops at the first entry that will not
+** go away so the client gets the real errno.
+*/
+static int remove_tree_dir(char *tmp, char *fname)
+{
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+
+    d = opendir(tmp);
+    if(d == 0) return -1;
+
+    while((de = readdir(d))) {
+        int len = strlen(de->d_name);
+
+        if(de->d_name[0] == '.') {
+            if(de->d_name[1] == 0) continue;
+            if((de->d_name[1] == '.') && (de->d_name[2] == 0)) continue;
+        }
+
+            /* not supposed to be possible, but
+               if it does happen, let's not buffer overrun */
+        if(len > 256) continue;
+        if((fname - tmp) + len + 1 >= 1024 + 256) continue;
+
+        strcpy(fname, de->d_name);
+        if(lstat(tmp, &st)) {
+            closedir(d);
+            return -1;
+        }
+
+        if(S_ISDIR(st.st_mode)) {
+            char *end = fname + len;
+            *end++ = '/';
+            *end = 0;
+            if(remove_tree_dir(tmp, end)) {
+                closedir(d);
+                return -1;
+            }
+            *--end = 0;
+            if(rmdir(tmp)) {
+                closedir(d);
+                return -1;
+            }
+        } else {
+            if(adb_unlink(tmp)) {
+                closedir(d);
+                return -1;
+            }
+        }
+    }
+
+    closedir(d);
+    return 0;
+}
+
+/* recursive remove: one request takes down the whole tree in-process
+** instead of a request (or a spawned toolbox) per entry
+*/
+static int do_remove_tree(int s, const char *path)
+{
+    syncmsg msg;
+    char tmp[1024 + 256 + 2];
+    int len = strlen(path);
+
+    if(len + 1 >= (int)sizeof(tmp)) {
+        return fail_message(s, "path too long");
+    }
+    memcpy(tmp, path, len);
+    if(len == 0 || tmp[len - 1] != '/')
+        tmp[len++] = '/';
+    tmp[len] = 0;
+
+    if(remove_tree_dir(tmp, tmp + len)) {
+        return fail_errno(s);
+    }
+
+        /* the walk strips the trailing slash it added */
+    tmp[len - 1] = 0;
+    if(rmdir(tmp)) {
+        return fail_errno(s);
+    }
+
+    msg.status.id = ID_OKAY;
+    msg.status.msglen = 0;
+    return writex(s, &msg.status, sizeof(msg.status));
+}
+
 static int fail_message(int s, const char *reason)
 {
     syncmsg msg;
+    adb_iovec iov[2];
     int len = strlen(reason);
 
     D("sync: failure: %s\n", reason);
 
     msg.data.id = ID_FAIL;
     msg.data.size = htoll(len);
-    if(writex(s, &msg.data, sizeof(msg.data)) ||
-       writex(s, reason, len)) {
-        return -1;
-    } else {
-        return 0;
-    }
+
+    iov[0].iov_base = &msg.data;
+    iov[0].iov_len  = sizeof(msg.data);
+    iov[1].iov_base = (char*) reason;
+    iov[1].iov_len  = len;
+
+    return writexv(s, iov, 2);
 }
 
 static int fail_errno(int s)
@@ -148,19 +399,83 @@ static int fail_errno(int s)
     return fail_message(s, strerror(errno));
 }
 
-static int handle_send_file(int s, char *path, mode_t mode, char *buffer)
+static int handle_send_file(int s, char *path, mode_t mode,
+                            char *buffer, char *zbuffer, int compressed,
+                            int resumable)
 {
     syncmsg msg;
+    char tmppath[1024 + sizeof(SYNC_TMP_SUFFIX)];
+    char *dest = path;
     unsigned int timestamp = 0;
+    unsigned int offset = 0;
     int fd;
 
-    fd = adb_open_mode(path, O_WRONLY | O_CREAT | O_EXCL, mode);
+    if(resumable) {
+        struct stat st;
+        unsigned long long h = SYNC_HASH_INIT;
+        unsigned have = 0;
+
+        snprintf(tmppath, sizeof(tmppath), "%s%s", path, SYNC_TMP_SUFFIX);
+        dest = tmppath;
+
+            /* report how much of an earlier attempt survived, with a
+            ** hash so a changed source file starts over from zero
+            */
+        if(lstat(tmppath, &st) == 0 && S_ISREG(st.st_mode)) {
+            fd = adb_open(tmppath, O_RDONLY);
+            if(fd >= 0) {
+                int r;
+                while((r = adb_read(fd, buffer, SYNC_DATA_MAX)) != 0) {
+                    if(r < 0) {
+                        if(errno == EINTR) continue;
+                        h = SYNC_HASH_INIT;
+                        have = 0;
+                        break;
+                    }
+                    h = sync_hash_update(h, (unsigned char*) buffer, r);
+                    have += r;
+                }
+                adb_close(fd);
+            }
+        }
+
+        msg.resume.id = ID_OFFS;
+        msg.resume.size = htoll(have);
+        msg.resume.hash_lo = htoll((unsigned) h);
+        msg.resume.hash_hi = htoll((unsigned) (h >> 32));
+        if(writex(s, &msg.resume, sizeof(msg.resume)))
+            return -1;
+
+        if(readx(s, &msg.resume, sizeof(msg.resume)))
+            return -1;
+        if(msg.resume.id != ID_OFFS) {
+            fail_message(s, "invalid resume message");
+            return -1;
+        }
+        offset = ltohl(msg.resume.size);
+        if(offset != 0 && offset != have) {
+            fail_message(s, "invalid resume offset");
+            return -1;
+        }
+    }
+
+    fd = adb_open_mode(dest, O_WRONLY | O_CREAT | O_EXCL, mode);
     if(fd < 0 && errno == ENOENT) {
-        mkdirs(path);
-        fd = adb_open_mode(path, O_WRONLY | O_CREAT | O_EXCL, mode);
+        mkdirs(dest);
+        fd = adb_open_mode(dest, O_WRONLY | O_CREAT | O_EXCL, mode);
     }
     if(fd < 0 && errno == EEXIST) {
-        fd = adb_open_mode(path, O_WRONLY, mode);
+        fd = adb_open_mode(dest, O_WRONLY, mode);
+    }
+    if(fd >= 0 && resumable) {
+            /* drop anything past the accepted offset and continue
+            ** from there
+            */
+        if(ftruncate(fd, offset) ||
+           adb_lseek(fd, offset, SEEK_SET) != (int) offset) {
+            adb_close(fd);
+            fd = -1;
+        }
     }
     if(fd < 0) {
         if(fail_errno(s))
@@ -174,7 +489,46 @@ static int handle_send_file(int s, char *path, mode_t mode, char *buffer)
         if(readx(s, &msg.data, sizeof(msg.data)))
             goto fail;
 
-        if(msg.data.id != ID_DATA) {
+        if(msg.data.id == ID_ZATA) {
+            unsigned int clen;
+            uLongf rawlen;
+
+            if(!compressed) {
+                fail_message(s, "unexpected compressed data message");
+                goto fail;
+            }
+                /* zdata carries one extra word: the inflated size */
+            if(readx(s, &msg.zdata.rawsize, sizeof(unsigned)))
+                goto fail;
+            clen = ltohl(msg.zdata.size);
+            len = ltohl(msg.zdata.rawsize);
+            if(clen > SYNC_ZDATA_MAX || len > SYNC_DATA_MAX) {
+                fail_message(s, "oversize data message");
+                goto fail;
+            }
+            if(readx(s, zbuffer, clen))
+                goto fail;
+
+            if(fd < 0)
+                continue;
+            rawlen = len;
+            if(uncompress((Bytef*) buffer, &rawlen,
+                          (Bytef*) zbuffer, clen) != Z_OK || rawlen != len) {
+                fail_message(s, "payload inflate failure");
+                goto fail;
+            }
+        } else if(msg.data.id == ID_DATA) {
+            len = ltohl(msg.data.size);
+            if(len > SYNC_DATA_MAX) {
+                fail_message(s, "oversize data message");
+                goto fail;
+            }
+            if(readx(s, buffer, len))
+                goto fail;
+
+            if(fd < 0)
+                continue;
+        } else {
             if(msg.data.id == ID_DONE) {
                 timestamp = ltohl(msg.data.size);
                 break;
@@ -182,19 +536,13 @@ static int handle_send_file(int s, char *path, mode_t mode, char *buffer)
             fail_message(s, "invalid data message");
             goto fail;
         }
-        len = ltohl(msg.data.size);
-        if(len > SYNC_DATA_MAX) {
-            fail_message(s, "oversize data message");
-            goto fail;
-        }
-        if(readx(s, buffer, len))
-            goto fail;
-
-        if(fd < 0)
-            continue;
         if(writex(fd, buffer, len)) {
             adb_close(fd);
-            adb_unlink(path);
+                /* a short local write still leaves a valid prefix, so
+                ** a resumable temp is worth keeping
+                */
+            if(!resumable)
+                adb_unlink(path);
             fd = -1;
             if(fail_errno(s)) return -1;
         }
@@ -203,6 +551,12 @@ static int handle_send_file(int s, char *path, mode_t mode, char *buffer)
     if(fd >= 0) {
         struct utimbuf u;
         adb_close(fd);
+        if(resumable && rename(tmppath, path)) {
+            adb_unlink(tmppath);
+            if(fail_errno(s))
+                return -1;
+            return 0;
+        }
         u.actime = timestamp;
         u.modtime = timestamp;
         utime(path, &u);
@@ -217,7 +571,216 @@ static int handle_send_file(int s, char *path, mode_t mode, char *buffer)
 fail:
     if(fd >= 0)
         adb_close(fd);
-    adb_unlink(path);
+        /* keep a resumable temp: it is exactly what the next attempt
+        ** will pick up from
+        */
+    if(!resumable)
+        adb_unlink(path);
+    return -1;
+}
+
+/* cap on the ID_BLKS table: a million SYNC_DATA_MAX blocks is well
+** past anything a single file push will ever describe
+*/
+#define SYNC_DELTA_MAX_BLOCKS (1024*1024)
+
+/* block-negotiated send: the client describes its new file as one
+** hash per block, we answer with a map of the blocks the previous
+** version of <path> already holds at the same offsets, and only the
+** blocks that changed travel as ID_DATA.  the new file is assembled
+** in a temp next to the old one - the old file is the source for the
+** reused blocks - and renamed over it on ID_DONE.
+*/
+static int handle_delta_file(int s, char *path, mode_t mode, char *buffer)
+{
+    syncmsg msg;
+    char tmppath[1024 + sizeof(SYNC_TMP_SUFFIX)];
+    unsigned long long *hashes = NULL;
+    unsigned char *map = NULL;
+    unsigned count, blksize, size;
+    unsigned i, done;
+    unsigned int timestamp;
+    int ofd = -1, fd = -1;
+    adb_iovec iov[2];
+
+    if(readx(s, &msg.delta, sizeof(msg.delta)))
+        return -1;
+    if(msg.delta.id != ID_BLKS) {
+        fail_message(s, "invalid delta message: expected ID_BLKS");
+        return -1;
+    }
+    count = ltohl(msg.delta.count);
+    blksize = ltohl(msg.delta.blksize);
+    size = ltohl(msg.delta.size);
+    if(blksize == 0 || blksize > SYNC_DATA_MAX ||
+       count == 0 || count > SYNC_DELTA_MAX_BLOCKS ||
+       count != (size + blksize - 1) / blksize) {
+        fail_message(s, "invalid delta geometry");
+        return -1;
+    }
+
+    hashes = malloc(count * sizeof(unsigned long long));
+    map = malloc(count);
+    if(hashes == NULL || map == NULL) {
+        fail_message(s, "out of memory");
+        goto fail;
+    }
+
+    done = 0;
+    while(done < count) {
+        unsigned n = count - done;
+        if(n > SYNC_DATA_MAX / 8) n = SYNC_DATA_MAX / 8;
+        if(readx(s, buffer, n * 8))
+            goto fail;
+        for(i = 0; i < n; i++) {
+            unsigned lo, hi;
+            memcpy(&lo, buffer + i * 8, 4);
+            memcpy(&hi, buffer + i * 8 + 4, 4);
+            hashes[done + i] =
+                ((unsigned long long) ltohl(hi) << 32) | ltohl(lo);
+        }
+        done += n;
+    }
+
+        /* walk the old file in step with the hash table.  a short read
+        ** means the old file ends here: nothing past it can match.
+        */
+    memset(map, 0, count);
+    ofd = adb_open(path, O_RDONLY);
+    if(ofd >= 0) {
+        for(i = 0; i < count; i++) {
+            unsigned len = blksize;
+            unsigned got = 0;
+            int r;
+
+            if(i == count - 1)
+                len = size - i * blksize;
+            while(got < len) {
+                r = adb_read(ofd, buffer + got, len - got);
+                if(r < 0 && errno == EINTR) continue;
+                if(r <= 0) break;
+                got += r;
+            }
+            if(got != len)
+                break;
+            if(sync_hash_update(SYNC_HASH_INIT,
+                                (unsigned char*) buffer, len) == hashes[i])
+                map[i] = 1;
+        }
+    }
+
+    free(hashes);
+    hashes = NULL;
+
+    msg.delta.id = ID_BLKS;
+    msg.delta.count = htoll(count);
+    msg.delta.blksize = htoll(blksize);
+    msg.delta.size = htoll(size);
+    iov[0].iov_base = &msg.delta;
+    iov[0].iov_len  = sizeof(msg.delta);
+    iov[1].iov_base = map;
+    iov[1].iov_len  = count;
+    if(writexv(s, iov, 2))
+        goto fail;
+
+    snprintf(tmppath, sizeof(tmppath), "%s%s", path, SYNC_TMP_SUFFIX);
+    fd = adb_open_mode(tmppath, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if(fd < 0 && errno == ENOENT) {
+        mkdirs(tmppath);
+        fd = adb_open_mode(tmppath, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    }
+    if(fd < 0) {
+        if(fail_errno(s))
+            goto fail;
+        fd = -1;
+    }
+
+        /* assemble in file order; the missing blocks arrive on the
+        ** wire in the same order, one exact-length ID_DATA each
+        */
+    for(i = 0; i < count; i++) {
+        unsigned len = blksize;
+        unsigned got = 0;
+        int r;
+
+        if(i == count - 1)
+            len = size - i * blksize;
+
+        if(map[i]) {
+            if(fd < 0)
+                continue;
+            if(adb_lseek(ofd, i * blksize, SEEK_SET) != (int)(i * blksize))
+                goto local_fail;
+            while(got < len) {
+                r = adb_read(ofd, buffer + got, len - got);
+                if(r < 0 && errno == EINTR) continue;
+                if(r <= 0) goto local_fail;
+                got += r;
+            }
+        } else {
+            if(readx(s, &msg.data, sizeof(msg.data)))
+                goto fail;
+            if(msg.data.id != ID_DATA || ltohl(msg.data.size) != len) {
+                fail_message(s, "invalid delta data message");
+                goto fail;
+            }
+            if(readx(s, buffer, len))
+                goto fail;
+            if(fd < 0)
+                continue;
+        }
+
+        if(writex(fd, buffer, len)) {
+        local_fail:
+            adb_close(fd);
+            adb_unlink(tmppath);
+            fd = -1;
+            if(fail_errno(s)) goto fail;
+        }
+    }
+
+    if(readx(s, &msg.data, sizeof(msg.data)))
+        goto fail;
+    if(msg.data.id != ID_DONE) {
+        fail_message(s, "invalid data message: expected ID_DONE");
+        goto fail;
+    }
+    timestamp = ltohl(msg.data.size);
+
+    if(ofd >= 0) {
+        adb_close(ofd);
+        ofd = -1;
+    }
+    if(fd >= 0) {
+        struct utimbuf u;
+        adb_close(fd);
+        fd = -1;
+        if(rename(tmppath, path)) {
+            adb_unlink(tmppath);
+            if(fail_errno(s))
+                goto fail;
+        } else {
+            u.actime = timestamp;
+            u.modtime = timestamp;
+            utime(path, &u);
+
+            msg.status.id = ID_OKAY;
+            msg.status.msglen = 0;
+            if(writex(s, &msg.status, sizeof(msg.status)))
+                goto fail;
+        }
+    }
+    free(map);
+    return 0;
+
+fail:
+    if(hashes) free(hashes);
+    if(map) free(map);
+    if(ofd >= 0) adb_close(ofd);
+    if(fd >= 0) {
+        adb_close(fd);
+        adb_unlink(tmppath);
+    }
     return -1;
 }
 
@@ -271,7 +834,8 @@ static int handle_send_link(int s, char *path, char *buffer)
 }
 #endif /* HAVE_SYMLINKS */
 
-static int do_send(int s, char *path, char *buffer)
+static int do_send(int s, char *path, char *buffer, char *zbuffer,
+                   int compressed, int resumable, int delta)
 {
     char *tmp;
     mode_t mode;
@@ -294,7 +858,17 @@ static int do_send(int s, char *path, char *buffer)
         is_link = 0;
     }
 
-    adb_unlink(path);
+    if(is_link && (resumable || delta)) {
+        fail_message(s, "cannot resume a symlink");
+        return -1;
+    }
+
+        /* a resumable or delta send replaces the destination atomically
+        ** at the end, so it stays in place until then (the delta case
+        ** also reads its reused blocks from it)
+        */
+    if(!resumable && !delta)
+        adb_unlink(path);
 
 
 #ifdef HAVE_SYMLINKS
@@ -308,7 +882,11 @@ static int do_send(int s, char *path, char *buffer)
         mode |= ((mode >> 3) & 0070);
         mode |= ((mode >> 3) & 0007);
 
-        ret = handle_send_file(s, path, mode, buffer);
+        if(delta)
+            ret = handle_delta_file(s, path, mode, buffer);
+        else
+            ret = handle_send_file(s, path, mode, buffer, zbuffer,
+                                   compressed, resumable);
     }
 
     return ret;
@@ -317,6 +895,7 @@ static int do_send(int s, char *path, char *buffer)
 static int do_recv(int s, const char *path, char *buffer)
 {
     syncmsg msg;
+    adb_iovec iov[2];
     int fd, r;
 
     fd = adb_open(path, O_RDONLY);
@@ -336,8 +915,12 @@ static int do_recv(int s, const char *path, char *buffer)
             return r;
         }
         msg.data.size = htoll(r);
-        if(writex(s, &msg.data, sizeof(msg.data)) ||
-           writex(s, buffer, r)) {
+
+        iov[0].iov_base = &msg.data;
+        iov[0].iov_len  = sizeof(msg.data);
+        iov[1].iov_base = buffer;
+        iov[1].iov_len  = r;
+        if(writexv(s, iov, 2)) {
             adb_close(fd);
             return -1;
         }
@@ -361,7 +944,8 @@ void file_sync_service(int fd, void *cookie)
     unsigned namelen;
 
     char *buffer = malloc(SYNC_DATA_MAX);
-    if(buffer == 0) goto fail;
+    char *zbuffer = malloc(SYNC_ZDATA_MAX);
+    if(buffer == 0 || zbuffer == 0) goto fail;
 
     for(;;) {
         D("sync: waiting for command\n");
@@ -388,15 +972,40 @@ void file_sync_service(int fd, void *cookie)
         case ID_STAT:
             if(do_stat(fd, name)) goto fail;
             break;
+        case ID_HASH:
+            if(do_hash(fd, name, buffer)) goto fail;
+            break;
+        case ID_CAPS:
+            if(do_caps(fd)) goto fail;
+            break;
         case ID_LIST:
             if(do_list(fd, name)) goto fail;
             break;
+        case ID_LST2:
+            if(do_list_v2(fd, name)) goto fail;
+            break;
         case ID_SEND:
-            if(do_send(fd, name, buffer)) goto fail;
+            if(do_send(fd, name, buffer, zbuffer, 0, 0, 0)) goto fail;
+            break;
+        case ID_ZSND:
+            if(do_send(fd, name, buffer, zbuffer, 1, 0, 0)) goto fail;
+            break;
+        case ID_RSND:
+                /* either chunk kind is fine on a resumed stream */
+            if(do_send(fd, name, buffer, zbuffer, 1, 1, 0)) goto fail;
+            break;
+        case ID_DSND:
+            if(do_send(fd, name, buffer, zbuffer, 0, 0, 1)) goto fail;
             break;
         case ID_RECV:
             if(do_recv(fd, name, buffer)) goto fail;
             break;
+        case ID_ULNK:
+            if(do_remove(fd, name)) goto fail;
+            break;
+        case ID_RMDR:
+            if(do_remove_tree(fd, name)) goto fail;
+            break;
         case ID_QUIT:
             goto fail;
         default:
@@ -407,6 +1016,7 @@ void file_sync_service(int fd, void *cookie)
 
 fail:
     if(buffer != 0) free(buffer);
+    if(zbuffer != 0) free(zbuffer);
     D("sync: done\n");
     adb_close(fd);
 }
@@ -35,9 +35,19 @@ static inline unsigned __swap_uint32(unsigned x)
 #endif
 
 #define ID_STAT MKID('S','T','A','T')
+#define ID_HASH MKID('H','A','S','H')
+#define ID_CAPS MKID('C','A','P','S')
+#define ID_ZSND MKID('Z','S','N','D')
+#define ID_ZATA MKID('Z','A','T','A')
 #define ID_LIST MKID('L','I','S','T')
+#define ID_LST2 MKID('L','S','T','2')
 #define ID_ULNK MKID('U','L','N','K')
+#define ID_RMDR MKID('R','M','D','R')
 #define ID_SEND MKID('S','E','N','D')
+#define ID_RSND MKID('R','S','N','D')
+#define ID_DSND MKID('D','S','N','D')
+#define ID_BLKS MKID('B','L','K','S')
+#define ID_OFFS MKID('O','F','F','S')
 #define ID_RECV MKID('R','E','C','V')
 #define ID_DENT MKID('D','E','N','T')
 #define ID_DONE MKID('D','O','N','E')
@@ -72,16 +82,83 @@ typedef union {
     struct {
         unsigned id;
         unsigned msglen;
-    } status;    
+    } status;
+    struct {
+        unsigned id;
+        unsigned hash_lo;
+        unsigned hash_hi;
+    } hash;
+    struct {
+        unsigned id;
+        unsigned size;      /* deflated payload bytes that follow */
+        unsigned rawsize;   /* size after inflation */
+    } zdata;
+    struct {
+        unsigned id;        /* ID_OFFS, both directions */
+        unsigned size;      /* service: partial bytes present;
+                               client: offset to resume from */
+        unsigned hash_lo;   /* FNV-1a of those bytes (service only) */
+        unsigned hash_hi;
+    } resume;
+    struct {
+        unsigned id;        /* ID_BLKS, both directions */
+        unsigned count;     /* blocks described */
+        unsigned blksize;   /* bytes per block */
+        unsigned size;      /* total file bytes */
+    } delta;
 } syncmsg;
 
+/* capability bits reported in the size field of an ID_CAPS reply.
+** old services tear down the channel on an unknown request, so the
+** client probes this once on a throwaway channel.
+*/
+#define SYNC_CAP_HASH      0x00000001  /* ID_HASH */
+#define SYNC_CAP_COMPRESS  0x00000002  /* ID_ZSND/ID_ZATA */
+#define SYNC_CAP_LSTV2     0x00000004  /* recursive ID_LST2 listing */
+#define SYNC_CAP_RESUME    0x00000008  /* resumable ID_RSND sends */
+#define SYNC_CAP_REMOVE    0x00000010  /* ID_ULNK / recursive ID_RMDR */
+#define SYNC_CAP_DELTA     0x00000020  /* ID_DSND block negotiation */
+
+/* an interrupted ID_RSND leaves its partial data in <path> plus this
+** suffix; the next ID_RSND for the same path picks it up, and ID_DONE
+** renames it onto the destination in one step
+*/
+#define SYNC_TMP_SUFFIX ".adbsync"
+
+/* incremental 64-bit FNV-1a, used by both sides of ID_HASH.
+** a reply of 0 means "no hash available" (not a regular file,
+** unreadable, ...) and never matches.
+*/
+#define SYNC_HASH_INIT 0xcbf29ce484222325ULL
+
+static __inline__ unsigned long long
+sync_hash_update(unsigned long long h, const unsigned char *p, int len)
+{
+    while(len-- > 0) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
 
 void file_sync_service(int fd, void *cookie);
+
+/* plan/summary switches for the sync client, set from the command
+** line before do_sync_push/pull/sync run
+*/
+void sync_set_dry_run(int enabled);
+void sync_set_stats(int enabled);
+
 int do_sync_ls(const char *path);
+int do_sync_rm(const char *path, int recursive);
 int do_sync_push(const char *lpath, const char *rpath, int verifyApk);
 int do_sync_sync(const char *lpath, const char *rpath);
 int do_sync_pull(const char *rpath, const char *lpath);
 
 #define SYNC_DATA_MAX (64*1024)
 
+/* worst-case deflate expansion of one SYNC_DATA_MAX chunk */
+#define SYNC_ZDATA_MAX (SYNC_DATA_MAX + SYNC_DATA_MAX/1000 + 64)
+
 #endif
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 
 #include <cutils/fdevent.h>
+#include "sysdeps.h"
 #include "adb.h"
 
 #include <linux/fb.h>
@@ -32,16 +33,64 @@
 ** - sync with vsync to avoid tearing
 */
 
-void framebuffer_service(int fd, void *cookie)
+/* a delta frame is a list of changed scanline runs, each
+**     { unsigned offset; unsigned length; } followed by length bytes
+** terminated by { 0xffffffff, 0 }.  the first delta on a session (or
+** any request after the shadow buffer could not be allocated) comes
+** back as one run covering the whole frame.
+*/
+static int send_frame_delta(asvc *svc, char *front, char *shadow, int valid,
+                            unsigned linesize, unsigned lines)
+{
+    unsigned hdr[2];
+    unsigned n, start;
+
+    if(!valid) {
+        memcpy(shadow, front, linesize * lines);
+        hdr[0] = 0;
+        hdr[1] = linesize * lines;
+        if(svc_write(svc, hdr, sizeof(hdr)) ||
+           svc_write(svc, shadow, hdr[1])) return -1;
+    } else {
+        n = 0;
+        while(n < lines) {
+            if(memcmp(front + n * linesize, shadow + n * linesize,
+                      linesize) == 0) {
+                n++;
+                continue;
+            }
+                /* coalesce consecutive dirty lines into one run */
+            start = n;
+            while(n < lines && memcmp(front + n * linesize,
+                                      shadow + n * linesize, linesize))
+                n++;
+
+            memcpy(shadow + start * linesize, front + start * linesize,
+                   (n - start) * linesize);
+            hdr[0] = start * linesize;
+            hdr[1] = (n - start) * linesize;
+            if(svc_write(svc, hdr, sizeof(hdr)) ||
+               svc_write(svc, shadow + hdr[0], hdr[1])) return -1;
+        }
+    }
+
+    hdr[0] = 0xffffffff;
+    hdr[1] = 0;
+    return svc_write(svc, hdr, sizeof(hdr));
+}
+
+void framebuffer_service(asvc *svc, void *cookie)
 {
     struct fb_var_screeninfo vinfo;
     int fb;
     void *ptr = MAP_FAILED;
+    char *shadow = 0;
+    int shadow_valid = 0;
     char x;
 
     unsigned fbinfo[4];
 
-    fb = open("/dev/graphics/fb0", O_RDONLY);
+    fb = adb_open("/dev/graphics/fb0", O_RDONLY);
     if(fb < 0) goto done;
 
     if(ioctl(fb, FBIOGET_VSCREENINFO, &vinfo) < 0) goto done;
@@ -55,16 +104,37 @@ void framebuffer_service(int fd, void *cookie)
     ptr = mmap(0, fbinfo[1], PROT_READ, MAP_SHARED, fb, 0);
     if(ptr == MAP_FAILED) goto done;
 
-    if(writex(fd, fbinfo, sizeof(unsigned) * 4)) goto done;
+    if(svc_write(svc, fbinfo, sizeof(unsigned) * 4)) goto done;
 
     for(;;) {
-        if(readx(fd, &x, 1)) goto done;
-        if(writex(fd, ptr, fbinfo[1])) goto done;
+        if(svc_read(svc, &x, 1)) goto done;
+
+            /* 'd' requests a delta against the previous frame; any
+            ** other byte keeps the old full-frame behavior
+            */
+        if(x == 'd') {
+            if(shadow == 0)
+                shadow = malloc(fbinfo[1]);
+            if(shadow) {
+                if(send_frame_delta(svc, (char*) ptr, shadow, shadow_valid,
+                                    vinfo.xres * 2, vinfo.yres)) goto done;
+                shadow_valid = 1;
+                continue;
+            }
+                /* no memory for the shadow frame: send it all */
+        }
+
+        if(svc_write(svc, ptr, fbinfo[1])) goto done;
+        if(shadow) {
+                /* keep the shadow coherent across mixed requests */
+            memcpy(shadow, ptr, fbinfo[1]);
+            shadow_valid = 1;
+        }
     }
 
 done:
     if(ptr != MAP_FAILED) munmap(ptr, fbinfo[1]);
-    if(fb >= 0) close(fb);
-    close(fd);
+    if(shadow) free(shadow);
+    if(fb >= 0) adb_close(fb);
 }
 
@@ -152,13 +152,14 @@ jdwp_process_list_msg( char*  buffer, int  bufferlen )
 }
 
 
-static void  jdwp_process_list_updated(void);
+static void  jdwp_tracker_event(int pid, int added);
 
 static void
 jdwp_process_free( JdwpProcess*  proc )
 {
     if (proc) {
         int  n;
+        int  pid = proc->pid;
 
         proc->prev->next = proc->next;
         proc->next->prev = proc->prev;
@@ -182,7 +183,9 @@ jdwp_process_free( JdwpProcess*  proc )
 
         free(proc);
 
-        jdwp_process_list_updated();
+            /* transient connections never made it into the list */
+        if (pid >= 0)
+            jdwp_tracker_event(pid, 0);
     }
 }
 
@@ -273,7 +276,7 @@ jdwp_process_event( int  socket, unsigned  events, void*  _proc )
 
             /* all is well, keep reading to detect connection closure */
             D("Adding pid %d to jdwp process list\n", proc->pid);
-            jdwp_process_list_updated();
+            jdwp_tracker_event(proc->pid, 1);
         }
         else
         {
@@ -601,25 +604,73 @@ struct JdwpTracker {
     JdwpTracker*  next;
     JdwpTracker*  prev;
     int           need_update;
+    int           binary;      /* delta mode, see below */
 };
 
 static JdwpTracker   _jdwp_trackers_list;
 
+/* "track-jdwp-bin" consumers get incremental binary updates instead of
+ * the full re-stringified pid list on every process event.  messages
+ * are little-endian 32-bit words:
+ *
+ *    snapshot (on attach):  'S', seq, count, pid...
+ *    process started:       'A', seq, pid
+ *    process exited:        'R', seq, pid
+ *
+ * seq increments once per event, so a consumer can detect a missed
+ * update and re-attach.
+ */
+static unsigned  _jdwp_seq;
 
+static int
+jdwp_process_list_bin( unsigned*  words, int  maxwords )
+{
+    JdwpProcess*  proc = _jdwp_list.next;
+    int           n    = 3;
+
+    words[0] = 'S';
+    words[1] = _jdwp_seq;
+
+    for ( ; proc != &_jdwp_list; proc = proc->next ) {
+        if (proc->pid < 0)
+            continue;
+        if (n >= maxwords)
+            break;
+        words[n++] = proc->pid;
+    }
+    words[2] = n - 3;
+    return n * sizeof(unsigned);
+}
+
+/* a process came (added=1) or went (added=0): encode each flavor of
+ * update at most once, then fan it out to every tracker.
+ */
 static void
-jdwp_process_list_updated(void)
+jdwp_tracker_event( int  pid, int  added )
 {
-    char             buffer[1024];
-    int              len;
-    JdwpTracker*  t = _jdwp_trackers_list.next;
+    char          buffer[1024];
+    unsigned      delta[3];
+    int           len = -1;
+    JdwpTracker*  t   = _jdwp_trackers_list.next;
 
-    len = jdwp_process_list_msg(buffer, sizeof(buffer));
+    _jdwp_seq += 1;
+    delta[0] = added ? 'A' : 'R';
+    delta[1] = _jdwp_seq;
+    delta[2] = pid;
 
     for ( ; t != &_jdwp_trackers_list; t = t->next ) {
         apacket*  p    = get_apacket();
         asocket*  peer = t->socket.peer;
-        memcpy(p->data, buffer, len);
-        p->len = len;
+
+        if (t->binary) {
+            memcpy(p->data, delta, sizeof(delta));
+            p->len = sizeof(delta);
+        } else {
+            if (len < 0)
+                len = jdwp_process_list_msg(buffer, sizeof(buffer));
+            memcpy(p->data, buffer, len);
+            p->len = len;
+        }
         peer->enqueue( peer, p );
     }
 }
@@ -651,7 +702,11 @@ jdwp_tracker_ready( asocket*  s )
     if (t->need_update) {
         apacket*  p = get_apacket();
         t->need_update = 0;
-        p->len = jdwp_process_list_msg((char*)p->data, sizeof(p->data));
+        if (t->binary)
+            p->len = jdwp_process_list_bin((unsigned*)p->data,
+                                           MAX_PAYLOAD/sizeof(unsigned));
+        else
+            p->len = jdwp_process_list_msg((char*)p->data, MAX_PAYLOAD);
         s->peer->enqueue(s->peer, p);
     }
 }
@@ -667,13 +722,15 @@ jdwp_tracker_enqueue( asocket*  s, apacket*  p )
 
 
 asocket*
-create_jdwp_tracker_service_socket( void )
+create_jdwp_tracker_service_socket( int  binary )
 {
     JdwpTracker*  t = calloc(sizeof(*t),1);
 
     if (t == NULL)
         return NULL;
 
+    t->binary = binary;
+
     t->next = &_jdwp_trackers_list;
     t->prev = t->next->prev;
 
@@ -19,8 +19,10 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <utils/logger.h>
 #include "sysdeps.h"
@@ -28,18 +30,111 @@
 
 #define LOG_FILE_DIR    "/dev/log/"
 
-void write_log_entry(int fd, struct logger_entry *buf);
+/* entries are batched into one outbound write of up to this size, so
+** a chatty log no longer costs one transport packet per entry
+*/
+#define LOG_BATCH_SIZE  8192
 
-void log_service(int fd, void *cookie)
+
+
+/* a "log:<name> <spec>" request carries an optional logcat-style
+** filter spec ("Tag:W *:S ...") after the first space, evaluated
+** here so that silenced entries never cross the transport.
+*/
+typedef struct logfilter logfilter;
+struct logfilter {
+    logfilter *next;
+    unsigned char minpri;   /* ANDROID_LOG_* value, 0xff silences */
+    char tag[1];            /* empty for the '*' rule */
+};
+
+static unsigned char parse_log_priority(int c)
+{
+    static const char prichars[] = "??VDIWEF";
+    const char *p;
+
+    if (c == 'S' || c == 's') return 0xff;
+    p = strchr(prichars, toupper(c));
+    return (p && *p != '?') ? p - prichars : 2 /* verbose */;
+}
+
+static logfilter *parse_log_filters(char *spec)
+{
+    logfilter *list = 0;
+    logfilter *f;
+    char *tok, *pri;
+
+    for (tok = strtok(spec, " "); tok; tok = strtok(0, " ")) {
+        unsigned char minpri = 2;
+
+        pri = strrchr(tok, ':');
+        if (pri) {
+            *pri++ = 0;
+            minpri = parse_log_priority(pri[0]);
+        }
+        if (!strcmp(tok, "*"))
+            tok = "";
+
+        f = malloc(sizeof(logfilter) + strlen(tok));
+        if (f == 0) break;
+        strcpy(f->tag, tok);
+        f->minpri = minpri;
+        f->next = list;
+        list = f;
+    }
+    return list;
+}
+
+/* returns nonzero when the entry should be dropped.  exact tag rules
+** win over the '*' rule; entries without any matching rule pass.
+*/
+static int entry_filtered(logfilter *filters, struct logger_entry *entry)
 {
-    /* get the name of the log filepath to read */
-    char * log_filepath = cookie;
+    logfilter *f;
+    logfilter *match = 0;
+    const char *tag;
+
+    if (filters == 0) return 0;
+    if (entry->len < 3) return 0;
+    tag = entry->msg + 1;
+
+    for (f = filters; f; f = f->next) {
+        if (f->tag[0] == 0) {
+            if (match == 0) match = f;
+        } else if (!strcmp(f->tag, tag)) {
+            match = f;
+            break;
+        }
+    }
+    if (match == 0) return 0;
+    return (unsigned char) entry->msg[0] < match->minpri;
+}
+
+void log_service(asvc *svc, void *cookie)
+{
+    /* the log name, optionally followed by " <filterspec>" */
+    char * log_name = cookie;
+    char * log_filepath;
+    char * spec;
+    logfilter *filters = 0;
+    logfilter *f;
+    unsigned char outbuf[LOG_BATCH_SIZE];
+    int outlen = 0;
+    int logfd;
+
+    spec = strchr(log_name, ' ');
+    if (spec) {
+        *spec++ = 0;
+        filters = parse_log_filters(spec);
+    }
+    log_filepath = get_log_file_path(log_name);
 
     /* open the log file. */
-    int logfd = unix_open(log_filepath, O_RDONLY);
+    logfd = unix_open(log_filepath, O_RDONLY);
     if (logfd < 0) {
         goto done;
     }
+    fcntl(logfd, F_SETFL, O_NONBLOCK);
 
     // temp buffer to read the entries
     unsigned char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
@@ -47,11 +142,26 @@ void log_service(int fd, void *cookie)
 
     while (1) {
         int ret;
+        size_t size;
 
         ret = unix_read(logfd, entry, LOGGER_ENTRY_MAX_LEN);
         if (ret < 0) {
-            if (errno == EINTR || errno == EAGAIN)
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN) {
+                fd_set rfds;
+
+                /* drained the driver: flush the batch, then wait */
+                if (outlen) {
+                    if (svc_write(svc, outbuf, outlen)) goto done;
+                    outlen = 0;
+                }
+                FD_ZERO(&rfds);
+                FD_SET(logfd, &rfds);
+                if (select(logfd + 1, &rfds, 0, 0, 0) < 0 &&
+                    errno != EINTR) goto done;
                 continue;
+            }
             // perror("logcat read");
             goto done;
         }
@@ -64,12 +174,27 @@ void log_service(int fd, void *cookie)
 
         entry->msg[entry->len] = '\0';
 
-        write_log_entry(fd, entry);
+        if (entry_filtered(filters, entry))
+            continue;
+
+        size = sizeof(struct logger_entry) + entry->len;
+        if (outlen + size > sizeof(outbuf)) {
+            if (svc_write(svc, outbuf, outlen)) goto done;
+            outlen = 0;
+        }
+        memcpy(outbuf + outlen, entry, size);
+        outlen += size;
     }
 
 done:
-    unix_close(fd);
-    free(log_filepath);
+    if (logfd >= 0) unix_close(logfd);
+    while (filters) {
+        f = filters->next;
+        free(filters);
+        filters = f;
+    }
+    if (log_filepath) free(log_filepath);
+    free(log_name);
 }
 
 /* returns the full path to the log file in a newly allocated string */
@@ -82,11 +207,3 @@ char * get_log_file_path(const char * log_name) {
     return log_device;
 }
 
-
-/* prints one log entry into the file descriptor fd */
-void write_log_entry(int fd, struct logger_entry *buf)
-{
-    size_t size = sizeof(struct logger_entry) + buf->len;
-
-    writex(fd, buf, size);
-}
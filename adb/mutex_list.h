@@ -8,7 +8,13 @@ ADB_MUTEX(socket_list_lock)
 ADB_MUTEX(transport_lock)
 #if ADB_HOST
 ADB_MUTEX(local_transports_lock)
+ADB_MUTEX(device_pool_lock)
 #endif
 ADB_MUTEX(usb_lock)
+ADB_MUTEX(sync_engine_lock)
+ADB_MUTEX(recv_ring_lock)
+ADB_MUTEX(packet_pool_lock)
+ADB_MUTEX(shell_pool_lock)
+ADB_MUTEX(service_stats_lock)
 
 #undef ADB_MUTEX
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include "sysdeps.h"
 
@@ -34,22 +35,16 @@
 #endif
 
 typedef struct stinfo stinfo;
+typedef struct service_entry service_entry;
 
 struct stinfo {
     void (*func)(int fd, void *cookie);
     int fd;
     void *cookie;
+    service_entry *entry;
+    stinfo *next;           /* worker pool queue linkage */
 };
 
-
-void *service_bootstrap_func(void *x)
-{
-    stinfo *sti = x;
-    sti->func(sti->fd, sti->cookie);
-    free(sti);
-    return 0;
-}
-
 #if ADB_HOST
 ADB_MUTEX_DEFINE( dns_lock );
 
@@ -139,6 +134,214 @@ done:
 }
 #endif
 
+/* every threaded service is described by a registry entry, so usage
+** can be reported over the protocol ("service-stats:") and the
+** short-lived ones can run on a small shared worker pool instead of
+** costing a fresh thread per request.  handlers which may block for
+** a long time (log streaming, sync, wait-for-*) must not be marked
+** lightweight or they would starve the pool.
+*/
+struct service_entry {
+    const char *name;
+    void (*func)(int fd, void *cookie);
+    int lightweight;        /* run on the worker pool */
+    unsigned invocations;
+    unsigned active_ms;     /* total time spent in the handler */
+    int live;               /* instances running right now */
+};
+
+static void service_stats_service(int fd, void *cookie);
+#if ADB_HOST
+static void wait_for_state(int fd, void *cookie);
+#endif
+
+static service_entry service_table[] = {
+#if ADB_HOST
+    { "dns", dns_service, 1, 0, 0, 0 },
+    { "wait-for", wait_for_state, 0, 0, 0, 0 },
+#else
+        /* direct (queue-backed) services have no fd handler; their
+        ** entries are matched by name from create_service_socket()
+        */
+    { "framebuffer", NULL, 0, 0, 0, 0 },
+    { "recover", recover_service, 0, 0, 0, 0 },
+    { "log", NULL, 0, 0, 0, 0 },
+    { "sync", file_sync_service, 0, 0, 0, 0 },
+    { "remount", remount_service, 1, 0, 0, 0 },
+#endif
+    { "service-stats", service_stats_service, 1, 0, 0, 0 },
+};
+#define SERVICE_TABLE_SIZE (sizeof(service_table)/sizeof(service_table[0]))
+
+ADB_MUTEX_DEFINE( service_stats_lock );
+
+static service_entry *service_entry_for(void (*func)(int, void *))
+{
+    unsigned n;
+
+    for (n = 0; n < SERVICE_TABLE_SIZE; n++) {
+        if (service_table[n].func && service_table[n].func == func)
+            return &service_table[n];
+    }
+    return NULL;
+}
+
+#if !ADB_HOST
+static service_entry *service_entry_for_name(const char *name)
+{
+    unsigned n;
+
+    if (name == NULL) return NULL;
+    for (n = 0; n < SERVICE_TABLE_SIZE; n++) {
+        if (!strcmp(service_table[n].name, name))
+            return &service_table[n];
+    }
+    return NULL;
+}
+#endif
+
+static unsigned service_now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (unsigned)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+/* run one service request, bracketing the handler with the entry's
+** usage counters */
+static void service_run(stinfo *sti)
+{
+    service_entry *e = sti->entry;
+    unsigned start = 0;
+
+    if (e) {
+        adb_mutex_lock(&service_stats_lock);
+        e->invocations++;
+        e->live++;
+        adb_mutex_unlock(&service_stats_lock);
+        start = service_now_ms();
+    }
+
+    sti->func(sti->fd, sti->cookie);
+
+    if (e) {
+        adb_mutex_lock(&service_stats_lock);
+        e->live--;
+        e->active_ms += service_now_ms() - start;
+        adb_mutex_unlock(&service_stats_lock);
+    }
+    free(sti);
+}
+
+void *service_bootstrap_func(void *x)
+{
+    service_run(x);
+    return 0;
+}
+
+#ifndef HAVE_WINSOCK
+/* worker pool for lightweight services.  workers are spun up lazily
+** (never more than SERVICE_POOL_WORKERS) and then stick around
+** parked on the condition variable, so a burst of getprop-style
+** requests reuses warm threads instead of paying a pthread create
+** and teardown each time.
+*/
+#define SERVICE_POOL_WORKERS 2
+
+static stinfo *service_queue_head;
+static stinfo *service_queue_tail;
+static int service_pool_workers;
+static int service_pool_idle;
+ADB_MUTEX_DEFINE( service_pool_lock );
+static adb_cond_t service_pool_cond = ADB_COND_INITIALIZER;
+
+static void *service_pool_worker(void *unused)
+{
+    for (;;) {
+        stinfo *sti;
+
+        adb_mutex_lock(&service_pool_lock);
+        while (service_queue_head == NULL) {
+            service_pool_idle++;
+            adb_cond_wait(&service_pool_cond, &service_pool_lock);
+            service_pool_idle--;
+        }
+        sti = service_queue_head;
+        service_queue_head = sti->next;
+        if (service_queue_head == NULL)
+            service_queue_tail = NULL;
+        adb_mutex_unlock(&service_pool_lock);
+
+        service_run(sti);
+    }
+    return 0;
+}
+
+/* returns 0 if the request was queued for a pool worker */
+static int service_pool_dispatch(stinfo *sti)
+{
+    adb_thread_t t;
+
+    adb_mutex_lock(&service_pool_lock);
+    if (service_pool_idle == 0 &&
+        service_pool_workers >= SERVICE_POOL_WORKERS) {
+            /* all workers busy: fall back to a dedicated thread
+            ** rather than queueing behind a long request */
+        adb_mutex_unlock(&service_pool_lock);
+        return -1;
+    }
+    if (service_pool_idle == 0) {
+        if (adb_thread_create(&t, service_pool_worker, 0)) {
+            adb_mutex_unlock(&service_pool_lock);
+            return -1;
+        }
+        service_pool_workers++;
+    }
+    sti->next = NULL;
+    if (service_queue_tail)
+        service_queue_tail->next = sti;
+    else
+        service_queue_head = sti;
+    service_queue_tail = sti;
+    adb_cond_signal(&service_pool_cond);
+    adb_mutex_unlock(&service_pool_lock);
+    return 0;
+}
+#endif /* !HAVE_WINSOCK */
+
+/* dump the registry counters as text; itself a lightweight pooled
+** service, so "adb service-stats:" shows the pool working */
+static void service_stats_service(int fd, void *cookie)
+{
+    char buffer[1024];
+    int len = 0;
+    unsigned n;
+
+    adb_mutex_lock(&service_stats_lock);
+    for (n = 0; n < SERVICE_TABLE_SIZE && len < (int)sizeof(buffer); n++) {
+        service_entry *e = &service_table[n];
+        len += snprintf(buffer + len, sizeof(buffer) - len,
+                        "%s: %u calls %d live %u ms%s\n",
+                        e->name, e->invocations, e->live, e->active_ms,
+                        e->lightweight ? " (pooled)" : "");
+    }
+    adb_mutex_unlock(&service_stats_lock);
+#ifndef HAVE_WINSOCK
+    adb_mutex_lock(&service_pool_lock);
+    if (len < (int)sizeof(buffer)) {
+        len += snprintf(buffer + len, sizeof(buffer) - len,
+                        "pool: %d workers %d idle\n",
+                        service_pool_workers, service_pool_idle);
+    }
+    adb_mutex_unlock(&service_pool_lock);
+#endif
+    if (len > (int)sizeof(buffer))
+        len = sizeof(buffer);
+    writex(fd, buffer, len);
+    adb_close(fd);
+}
+
 static int create_service_thread(void (*func)(int, void *), void *cookie)
 {
     stinfo *sti;
@@ -155,6 +358,16 @@ static int create_service_thread(void (*func)(int, void *), void *cookie)
     sti->func = func;
     sti->cookie = cookie;
     sti->fd = s[1];
+    sti->entry = service_entry_for(func);
+    sti->next = NULL;
+
+#ifndef HAVE_WINSOCK
+    if (sti->entry && sti->entry->lightweight &&
+        service_pool_dispatch(sti) == 0) {
+        D("service queued for pool, %d:%d\n", s[0], s[1]);
+        return s[0];
+    }
+#endif
 
     if(adb_thread_create( &t, service_bootstrap_func, sti)){
         free(sti);
@@ -168,6 +381,292 @@ static int create_service_thread(void (*func)(int, void *), void *cookie)
     return s[0];
 }
 
+#if !ADB_HOST
+/* ---- direct (queue-backed) streaming services ----
+**
+** create_service_thread() moves every byte twice: the service writes
+** it into a socketpair and the fdevent loop reads it back out into an
+** apacket.  for in-process streaming services the thread can fill
+** apackets itself: packets travel over an SPSC queue with a doorbell
+** byte per packet (the transport queue scheme), and the loop hands
+** them straight to the peer socket.  the client's own bytes -- a
+** trickle for these services -- go through a plain socketpair the
+** service reads with svc_read().
+*/
+
+ADB_MUTEX_DEFINE( svc_lock );
+
+struct asvc {
+    asocket socket;         /* must be first */
+
+    apacket_queue queue;    /* service thread -> fdevent loop */
+    int doorbell[2];        /* [0] loop side, [1] service side */
+    int input[2];           /* client bytes: [0] service side, [1] loop side */
+    fdevent fde;            /* watches doorbell[0] */
+
+    int peer_gone;          /* loop side torn down; writes must stop */
+    int refs;               /* service thread + loop side */
+
+    void (*func)(asvc *svc, void *cookie);
+    void *cookie;
+    service_entry *entry;
+};
+
+static void svc_unref(asvc *svc)
+{
+    int refs;
+
+    adb_mutex_lock(&svc_lock);
+    refs = --svc->refs;
+    adb_mutex_unlock(&svc_lock);
+
+    if (refs == 0) {
+            /* nobody left on either end: drop whatever the loop never
+            ** drained */
+        while (svc->queue.head != svc->queue.tail) {
+            put_apacket(svc->queue.slot[svc->queue.head &
+                                        (TRANSPORT_QUEUE_SIZE - 1)]);
+            svc->queue.head++;
+        }
+        free(svc);
+    }
+}
+
+int svc_write(asvc *svc, const void *data, int len)
+{
+    const unsigned char *p = data;
+    apacket_queue *q = &svc->queue;
+    char b = 0;
+    int r;
+
+    while (len > 0) {
+        apacket *pkt;
+        int chunk;
+
+        if (svc->peer_gone) return -1;
+
+        pkt = get_apacket();
+        chunk = (len > (int) pkt->alloc) ? (int) pkt->alloc : len;
+        memcpy(pkt->data, p, chunk);
+        pkt->len = chunk;
+        p += chunk;
+        len -= chunk;
+
+        while ((q->tail - q->head) >= TRANSPORT_QUEUE_SIZE) {
+                /* consumer is behind; yield until a slot opens up */
+            if (svc->peer_gone) {
+                put_apacket(pkt);
+                return -1;
+            }
+            adb_sleep_ms(1);
+        }
+        q->slot[q->tail & (TRANSPORT_QUEUE_SIZE - 1)] = pkt;
+        q->tail++;
+
+        for (;;) {
+            r = adb_write(svc->doorbell[1], &b, 1);
+            if (r == 1) break;
+            if ((r < 0) && (errno == EINTR)) continue;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int svc_read(asvc *svc, void *data, int len)
+{
+    return readx(svc->input[0], data, len);
+}
+
+/* one doorbell byte announces one queued packet; eof on the doorbell
+** means the service is done and everything has been delivered
+*/
+static void svc_socket_event(int fd, unsigned ev, void *_svc)
+{
+    asvc *svc = _svc;
+    asocket *s = &svc->socket;
+
+    if (ev & FDE_READ) {
+        apacket *p;
+        char b;
+        int r;
+
+        for (;;) {
+            r = adb_read(fd, &b, 1);
+            if (r == 1) break;
+            if ((r < 0) && (errno == EINTR)) continue;
+            if ((r < 0) && (errno == EAGAIN)) return;
+                /* r == 0: service finished and the queue is drained */
+            s->close(s);
+            return;
+        }
+
+        if (svc->queue.head == svc->queue.tail) {
+            D("SS(%d): doorbell with empty queue\n", s->id);
+            return;
+        }
+        p = svc->queue.slot[svc->queue.head & (TRANSPORT_QUEUE_SIZE - 1)];
+        svc->queue.head++;
+
+        if (s->peer == 0) {
+            put_apacket(p);
+            return;
+        }
+        r = s->peer->enqueue(s->peer, p);
+        if (r < 0) {
+                /* peer closed us as a side effect */
+            return;
+        }
+        if (r > 0) {
+                /* stop draining until the peer calls ready() */
+            fdevent_del(&svc->fde, FDE_READ);
+        }
+    }
+}
+
+static int svc_socket_enqueue(asocket *s, apacket *p)
+{
+    asvc *svc = (asvc *) s;
+    int r;
+
+    r = writex(svc->input[1], p->data, p->len);
+    put_apacket(p);
+    if (r) {
+        s->close(s);
+        return -1;
+    }
+    return 0;
+}
+
+static void svc_socket_ready(asocket *s)
+{
+    asvc *svc = (asvc *) s;
+
+    fdevent_add(&svc->fde, FDE_READ);
+}
+
+static void svc_socket_close(asocket *s)
+{
+    asvc *svc = (asvc *) s;
+    asocket *peer = s->peer;
+
+    D("SS(%d): closing\n", s->id);
+
+    if (peer) {
+        peer->peer = NULL;
+        peer->close(peer);
+        s->peer = NULL;
+    }
+
+        /* the service notices through failing writes and input eof */
+    adb_mutex_lock(&svc_lock);
+    svc->peer_gone = 1;
+    adb_mutex_unlock(&svc_lock);
+
+    fdevent_remove(&svc->fde);          /* closes doorbell[0] */
+    adb_close(svc->input[1]);
+    remove_socket(s);
+    svc_unref(svc);
+}
+
+static void *svc_bootstrap_func(void *x)
+{
+    asvc *svc = x;
+    service_entry *e = svc->entry;
+    unsigned start = 0;
+
+    if (e) {
+        adb_mutex_lock(&service_stats_lock);
+        e->invocations++;
+        e->live++;
+        adb_mutex_unlock(&service_stats_lock);
+        start = service_now_ms();
+    }
+
+    svc->func(svc, svc->cookie);
+
+    if (e) {
+        adb_mutex_lock(&service_stats_lock);
+        e->live--;
+        e->active_ms += service_now_ms() - start;
+        adb_mutex_unlock(&service_stats_lock);
+    }
+
+        /* eof on the doorbell tells the loop we are done */
+    adb_close(svc->doorbell[1]);
+    adb_close(svc->input[0]);
+    svc_unref(svc);
+    return 0;
+}
+
+asocket *create_service_socket(void (*func)(asvc *svc, void *cookie),
+                               const char *stat_name, void *cookie)
+{
+    asvc *svc;
+    adb_thread_t t;
+
+    svc = calloc(1, sizeof(asvc));
+    if (svc == 0) fatal("cannot allocate service socket");
+
+    if (adb_socketpair(svc->doorbell)) {
+        free(svc);
+        return NULL;
+    }
+    if (adb_socketpair(svc->input)) {
+        adb_close(svc->doorbell[0]);
+        adb_close(svc->doorbell[1]);
+        free(svc);
+        return NULL;
+    }
+    close_on_exec(svc->doorbell[0]);
+    close_on_exec(svc->doorbell[1]);
+    close_on_exec(svc->input[0]);
+    close_on_exec(svc->input[1]);
+
+    svc->func = func;
+    svc->cookie = cookie;
+    svc->entry = service_entry_for_name(stat_name);
+    svc->refs = 2;
+
+    install_local_socket(&svc->socket);
+    svc->socket.enqueue = svc_socket_enqueue;
+    svc->socket.ready   = svc_socket_ready;
+    svc->socket.close   = svc_socket_close;
+
+    fdevent_install(&svc->fde, svc->doorbell[0], svc_socket_event, svc);
+    fdevent_set(&svc->fde, FDE_READ);
+
+    if (adb_thread_create(&t, svc_bootstrap_func, svc)) {
+        printf("cannot create service socket thread\n");
+        fdevent_remove(&svc->fde);
+        adb_close(svc->doorbell[1]);
+        adb_close(svc->input[0]);
+        adb_close(svc->input[1]);
+        remove_socket(&svc->socket);
+        free(svc);
+        return NULL;
+    }
+
+    D("SS(%d): started\n", svc->socket.id);
+    return &svc->socket;
+}
+
+asocket *daemon_service_to_socket(const char *name)
+{
+    if (!strncmp(name, "framebuffer:", 12)) {
+        return create_service_socket(framebuffer_service, "framebuffer", 0);
+    } else if (!strncmp(name, "log:", 4)) {
+            /* "log:<name> <filterspec>": the service splits off the
+            ** optional filter spec itself
+            */
+        char *n = strdup(name + 4);
+        if (n == 0) return NULL;
+        return create_service_socket(log_service, "log", n);
+    }
+    return NULL;
+}
+#endif /* !ADB_HOST */
+
 static int create_subprocess(const char *cmd, const char *arg0, const char *arg1)
 {
 #ifdef HAVE_WIN32_PROC
@@ -227,6 +726,173 @@ static int create_subprocess(const char *cmd, const char *arg0, const char *arg1
 #define SHELL_COMMAND "/system/bin/sh"
 #endif
 
+#ifndef HAVE_WIN32_PROC
+/* pre-forked shell sessions: the pty setup and fork of
+** create_subprocess() are paid ahead of time by a small warm pool, so
+** a one-shot "shell:cmd" only costs the exec.  each pooled child sits
+** on a control pipe waiting for a length-prefixed command line; eof
+** there means the server went away and the child quietly exits.
+** ADB_SHELL_POOL sets the pool size (0 disables, default 4).
+*/
+#define SHELL_POOL_DEFAULT 4
+#define SHELL_POOL_MAX     8
+#define SHELL_POOL_CMD_MAX 1024
+
+ADB_MUTEX_DEFINE( shell_pool_lock );
+
+typedef struct {
+    int ptm;        /* master pty, handed to the requester */
+    int ctl;        /* write side of the child's control pipe */
+} shellsession;
+
+static shellsession shell_pool[SHELL_POOL_MAX];
+static int shell_pool_count;
+
+static int shell_pool_size(void)
+{
+    char *env = getenv("ADB_SHELL_POOL");
+    int n = env ? atoi(env) : SHELL_POOL_DEFAULT;
+
+    if(n < 0) n = 0;
+    if(n > SHELL_POOL_MAX) n = SHELL_POOL_MAX;
+    return n;
+}
+
+static int spawn_shell_session(shellsession *ss)
+{
+    char *devname;
+    int ptm, ctl[2];
+    pid_t pid;
+
+    if(adb_socketpair(ctl)) return -1;
+
+    ptm = unix_open("/dev/ptmx", O_RDWR); // | O_NOCTTY);
+    if(ptm < 0){
+        printf("[ cannot open /dev/ptmx - %s ]\n",strerror(errno));
+        goto fail;
+    }
+    fcntl(ptm, F_SETFD, FD_CLOEXEC);
+    fcntl(ctl[1], F_SETFD, FD_CLOEXEC);
+
+    if(grantpt(ptm) || unlockpt(ptm) ||
+       ((devname = (char*) ptsname(ptm)) == 0)){
+        printf("[ trouble with /dev/ptmx - %s ]\n", strerror(errno));
+        goto fail;
+    }
+
+    pid = fork();
+    if(pid < 0) {
+        printf("- fork failed: %s -\n", strerror(errno));
+        goto fail;
+    }
+
+    if(pid == 0){
+        char cmd[SHELL_POOL_CMD_MAX];
+        unsigned len;
+        int pts;
+
+        adb_close(ctl[1]);
+        setsid();
+
+        pts = unix_open(devname, O_RDWR);
+        if(pts < 0) exit(-1);
+
+        dup2(pts, 0);
+        dup2(pts, 1);
+        dup2(pts, 2);
+
+        adb_close(ptm);
+
+        if(readx(ctl[0], &len, sizeof(len)) || len >= sizeof(cmd))
+            exit(-1);
+        if(len && readx(ctl[0], cmd, len))
+            exit(-1);
+        cmd[len] = 0;
+        adb_close(ctl[0]);
+
+        if(len)
+            execl(SHELL_COMMAND, SHELL_COMMAND, "-c", cmd, NULL);
+        else
+            execl(SHELL_COMMAND, SHELL_COMMAND, "-", NULL);
+        fprintf(stderr, "- exec '%s' failed: %s (%d) -\n",
+                SHELL_COMMAND, strerror(errno), errno);
+        exit(-1);
+    }
+
+    adb_close(ctl[0]);
+    ss->ptm = ptm;
+    ss->ctl = ctl[1];
+    return 0;
+
+fail:
+    if(ptm >= 0) adb_close(ptm);
+    adb_close(ctl[0]);
+    adb_close(ctl[1]);
+    return -1;
+}
+
+static void *shell_pool_fill(void *unused)
+{
+    shellsession ss;
+
+    for(;;) {
+        adb_mutex_lock(&shell_pool_lock);
+        if(shell_pool_count >= shell_pool_size()) {
+            adb_mutex_unlock(&shell_pool_lock);
+            return 0;
+        }
+        adb_mutex_unlock(&shell_pool_lock);
+
+        if(spawn_shell_session(&ss)) return 0;
+
+        adb_mutex_lock(&shell_pool_lock);
+        if(shell_pool_count < SHELL_POOL_MAX) {
+            shell_pool[shell_pool_count++] = ss;
+            adb_mutex_unlock(&shell_pool_lock);
+        } else {
+            adb_mutex_unlock(&shell_pool_lock);
+            adb_close(ss.ptm);
+            adb_close(ss.ctl);
+            return 0;
+        }
+    }
+}
+
+static int shell_from_pool(const char *args)
+{
+    shellsession ss;
+    adb_thread_t t;
+    unsigned len = strlen(args);
+
+    if(len >= SHELL_POOL_CMD_MAX) return -1;
+
+    adb_mutex_lock(&shell_pool_lock);
+    if(shell_pool_count == 0) {
+        adb_mutex_unlock(&shell_pool_lock);
+            /* miss: warm the pool for the next caller */
+        if(shell_pool_size() > 0)
+            adb_thread_create(&t, shell_pool_fill, 0);
+        return -1;
+    }
+    ss = shell_pool[--shell_pool_count];
+    adb_mutex_unlock(&shell_pool_lock);
+
+    if(writex(ss.ctl, &len, sizeof(len)) ||
+       (len && writex(ss.ctl, args, len))) {
+        adb_close(ss.ctl);
+        adb_close(ss.ptm);
+        return -1;
+    }
+    adb_close(ss.ctl);
+
+        /* replace the session we just consumed, off the request path */
+    adb_thread_create(&t, shell_pool_fill, 0);
+
+    D("shell pool: dispatched '%s'\n", args);
+    return ss.ptm;
+}
+#endif /* !HAVE_WIN32_PROC */
+
 int service_to_fd(const char *name)
 {
     int ret = -1;
@@ -269,20 +935,24 @@ int service_to_fd(const char *name)
 #else /* !ADB_HOST */
     } else if(!strncmp("dev:", name, 4)) {
         ret = unix_open(name + 4, O_RDWR);
-    } else if(!strncmp(name, "framebuffer:", 12)) {
-        ret = create_service_thread(framebuffer_service, 0);
     } else if(recovery_mode && !strncmp(name, "recover:", 8)) {
         ret = create_service_thread(recover_service, (void*) atoi(name + 8));
     } else if (!strncmp(name, "jdwp:", 5)) {
         ret = create_jdwp_connection_fd(atoi(name+5));
-    } else if (!strncmp(name, "log:", 4)) {
-        ret = create_service_thread(log_service, get_log_file_path(name + 4));
 #endif
+    } else if(!strncmp(name, "service-stats:", 14)) {
+        ret = create_service_thread(service_stats_service, NULL);
     } else if(!HOST && !strncmp(name, "shell:", 6)) {
-        if(name[6]) {
-            ret = create_subprocess(SHELL_COMMAND, "-c", name + 6);
-        } else {
-            ret = create_subprocess(SHELL_COMMAND, "-", 0);
+#ifndef HAVE_WIN32_PROC
+        ret = shell_from_pool(name + 6);
+        if(ret < 0)
+#endif
+        {
+            if(name[6]) {
+                ret = create_subprocess(SHELL_COMMAND, "-c", name + 6);
+            } else {
+                ret = create_subprocess(SHELL_COMMAND, "-", 0);
+            }
         }
 #if !ADB_HOST
     } else if(!strncmp(name, "sync:", 5)) {
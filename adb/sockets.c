@@ -20,16 +20,75 @@
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
 
 #include "sysdeps.h"
 
 #define  TRACE_TAG  TRACE_SOCKETS
 #include "adb.h"
 
+/* direct-bridge mode: when both halves of a connection are plain local
+** sockets (e.g. both ends of a tcp:-to-tcp: forward living in this
+** process) we can move data between their fds with splice() instead of
+** copying every byte through apacket buffers.
+*/
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+#define ADB_LOCAL_SPLICE 1
+#else
+#define ADB_LOCAL_SPLICE 0
+#endif
+
 ADB_MUTEX_DEFINE( socket_list_lock );
 
 static void local_socket_close_locked(asocket *s);
 
+typedef struct aremotesocket {
+    asocket      socket;
+    adisconnect  disconnect;
+} aremotesocket;
+
+/* asockets come and go with every connection, so recycle them the way
+** adb.c recycles apackets.  pool blocks are aremotesocket sized (the
+** larger of the two layouts) so a single freelist serves both kinds;
+** the first pointer of a free block links the list.
+*/
+#define SOCKET_POOL_MAX 64
+
+static asocket *socket_pool;
+static int socket_pool_count;
+
+static asocket *alloc_asocket(void)
+{
+    asocket *s;
+
+    adb_mutex_lock(&socket_list_lock);
+    s = socket_pool;
+    if(s) {
+        socket_pool = *(asocket**) s;
+        socket_pool_count--;
+    }
+    adb_mutex_unlock(&socket_list_lock);
+
+    if(s == 0) s = adb_heap_malloc(sizeof(aremotesocket));
+    if(s == 0) fatal("cannot allocate socket");
+    memset(s, 0, sizeof(aremotesocket));
+    return s;
+}
+
+static void free_asocket(asocket *s)
+{
+    adb_mutex_lock(&socket_list_lock);
+    if(socket_pool_count < SOCKET_POOL_MAX) {
+        *(asocket**) s = socket_pool;
+        socket_pool = s;
+        socket_pool_count++;
+        s = 0;
+    }
+    adb_mutex_unlock(&socket_list_lock);
+
+    if(s) adb_heap_free(s);
+}
+
 int sendfailmsg(int fd, const char *reason)
 {
     char buf[9];
@@ -208,8 +267,14 @@ static void local_socket_destroy(asocket  *s)
         n = p->next;
         put_apacket(p);
     }
+#if ADB_LOCAL_SPLICE
+    if(s->bridge > 0) {
+        adb_close(s->bridge_pipe[0]);
+        adb_close(s->bridge_pipe[1]);
+    }
+#endif
     remove_socket(s);
-    free(s);
+    free_asocket(s);
 }
 
 
@@ -243,6 +308,96 @@ static void local_socket_close_locked(asocket *s)
     insert_local_socket(s, &local_socket_closing_list);
 }
 
+#if ADB_LOCAL_SPLICE
+#define BRIDGE_SPLICE_MAX (64*1024)
+
+static int local_socket_bridge_init(asocket *dst)
+{
+    if(dst->bridge == 0) {
+        if(pipe(dst->bridge_pipe) < 0) {
+            dst->bridge = -1;
+        } else {
+            close_on_exec(dst->bridge_pipe[0]);
+            close_on_exec(dst->bridge_pipe[1]);
+            dst->bridge = 1;
+            D("LS(%d): direct bridge enabled\n", dst->id);
+        }
+    }
+    return dst->bridge > 0;
+}
+
+/* push whatever is sitting in dst's bridge pipe out to dst->fd.
+** returns 0 when the pipe has been fully drained, 1 when dst would
+** block (FDE_WRITE has been requested) and -1 when dst got closed.
+*/
+static int local_socket_bridge_flush(asocket *dst)
+{
+    int n;
+
+    while(dst->bridge_pending > 0) {
+        n = splice(dst->bridge_pipe[0], 0, dst->fd, 0,
+                   dst->bridge_pending, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+        if(n > 0) {
+            dst->bridge_pending -= n;
+            continue;
+        }
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0 && errno == EAGAIN) {
+            fdevent_add(&dst->fde, FDE_WRITE);
+            return 1;
+        }
+        dst->close(dst);
+        return -1;
+    }
+    return 0;
+}
+
+/* try to move readable bytes on s->fd straight to its local peer.
+** returns -1 when the bridge is not usable (caller must fall back to
+** the apacket path), 0 when the event has been fully handled and 1 on
+** end-of-file (caller closes the socket).
+*/
+static int local_socket_splice_read(asocket *s, int fd)
+{
+    asocket *dst = s->peer;
+    int n;
+
+    if(dst == 0 || dst->enqueue != local_socket_enqueue) return -1;
+    if(dst->pkt_first || dst->closing || s->closing) return -1;
+    if(!local_socket_bridge_init(dst)) return -1;
+
+    for(;;) {
+        n = splice(fd, 0, dst->bridge_pipe[1], 0,
+                   BRIDGE_SPLICE_MAX, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+        if(n > 0) {
+            dst->bridge_pending += n;
+            switch(local_socket_bridge_flush(dst)) {
+            case 0:
+                continue;
+            case 1:
+                    /* peer is backlogged: stop reading until its
+                    ** FDE_WRITE handler calls our ready()
+                    */
+                fdevent_del(&s->fde, FDE_READ);
+                return 0;
+            default:
+                    /* dst->close() also closed us; s and dst are gone */
+                return 0;
+            }
+        }
+        if(n == 0) return 1;
+        if(errno == EINTR) continue;
+        if(errno == EAGAIN) return 0;
+        if(errno == EINVAL || errno == ENOSYS) {
+                /* splice doesn't like these fds: fall back for good */
+            dst->bridge = -1;
+            return -1;
+        }
+        return 1;
+    }
+}
+#endif /* ADB_LOCAL_SPLICE */
+
 static void local_socket_event_func(int fd, unsigned ev, void *_s)
 {
     asocket *s = _s;
@@ -253,6 +408,14 @@ static void local_socket_event_func(int fd, unsigned ev, void *_s)
     if(ev & FDE_WRITE){
         apacket *p;
 
+#if ADB_LOCAL_SPLICE
+            /* drain spliced bytes ahead of any framed packets */
+        if(s->bridge_pending > 0) {
+            if(local_socket_bridge_flush(s) != 0) {
+                return;
+            }
+        }
+#endif
         while((p = s->pkt_first) != 0) {
             while(p->len > 0) {
                 int r = adb_write(fd, p->ptr, p->len);
@@ -296,10 +459,21 @@ static void local_socket_event_func(int fd, unsigned ev, void *_s)
     }
 
 
+#if ADB_LOCAL_SPLICE
+    if(ev & FDE_READ){
+        int  spliced = local_socket_splice_read(s, fd);
+        if(spliced >= 0) {
+            if(spliced > 0) s->close(s);
+            ev &= ~FDE_READ;    /* handled, skip the apacket path */
+        }
+    }
+#endif
+
     if(ev & FDE_READ){
-        apacket *p = get_apacket();
+        apacket *p = get_apacket_size(
+                s->transport ? s->transport->max_payload : MAX_PAYLOAD);
         unsigned char *x = p->data;
-        size_t avail = MAX_PAYLOAD;
+        size_t avail = p->alloc;
         int r;
         int is_eof = 0;
 
@@ -320,10 +494,10 @@ static void local_socket_event_func(int fd, unsigned ev, void *_s)
             break;
         }
 
-        if((avail == MAX_PAYLOAD) || (s->peer == 0)) {
+        if((avail == p->alloc) || (s->peer == 0)) {
             put_apacket(p);
         } else {
-            p->len = MAX_PAYLOAD - avail;
+            p->len = p->alloc - avail;
 
             r = s->peer->enqueue(s->peer, p);
 
@@ -365,7 +539,7 @@ static void local_socket_event_func(int fd, unsigned ev, void *_s)
 
 asocket *create_local_socket(int fd)
 {
-    asocket *s = calloc(1, sizeof(asocket));
+    asocket *s = alloc_asocket();
     if(s == 0) fatal("cannot allocate socket");
     install_local_socket(s);
     s->fd = fd;
@@ -390,7 +564,15 @@ asocket *create_local_service_socket(const char *name)
         return create_jdwp_service_socket();
     }
     if (!strcmp(name,"track-jdwp")) {
-        return create_jdwp_tracker_service_socket();
+        return create_jdwp_tracker_service_socket(0);
+    }
+    if (!strcmp(name,"track-jdwp-bin")) {
+        return create_jdwp_tracker_service_socket(1);
+    }
+    s = daemon_service_to_socket(name);
+    if (s != NULL) {
+        D("LS(%d): bound to '%s'\n", s->id, name);
+        return s;
     }
 #endif
     fd = service_to_fd(name);
@@ -418,13 +600,10 @@ static asocket *create_host_service_socket(const char *name, const char* serial)
 #endif /* ADB_HOST */
 
 /* a Remote socket is used to send/receive data to/from a given transport object
-** it needs to be closed when the transport is forcibly destroyed by the user
+** it needs to be closed when the transport is forcibly destroyed by the user.
+** the aremotesocket layout itself lives near the top of this file, next
+** to the socket pool that hands the blocks out.
 */
-typedef struct aremotesocket {
-    asocket      socket;
-    adisconnect  disconnect;
-} aremotesocket;
-
 static int remote_socket_enqueue(asocket *s, apacket *p)
 {
     D("Calling remote_socket_enqueue\n");
@@ -460,7 +639,7 @@ static void remote_socket_close(asocket *s)
     send_packet(p, s->transport);
     D("RS(%d): closed\n", s->id);
     remove_transport_disconnect( s->transport, &((aremotesocket*)s)->disconnect );
-    free(s);
+    free_asocket(s);
 }
 
 static void remote_socket_disconnect(void*  _s, atransport*  t)
@@ -474,12 +653,12 @@ static void remote_socket_disconnect(void*  _s, atransport*  t)
         peer->close(peer);
     }
     remove_transport_disconnect( s->transport, &((aremotesocket*)s)->disconnect );
-    free(s);
+    free_asocket(s);
 }
 
 asocket *create_remote_socket(unsigned id, atransport *t)
 {
-    asocket *s = calloc(1, sizeof(aremotesocket));
+    asocket *s = alloc_asocket();
     adisconnect*  dis = &((aremotesocket*)s)->disconnect;
 
     if(s == 0) fatal("cannot allocate socket");
@@ -754,13 +933,13 @@ static void smart_socket_close(asocket *s)
         s->peer->peer = 0;
         s->peer->close(s->peer);
     }
-    free(s);
+    free_asocket(s);
 }
 
 asocket *create_smart_socket(void (*action_cb)(asocket *s, const char *act))
 {
     D("Creating smart socket \n");
-    asocket *s = calloc(1, sizeof(asocket));
+    asocket *s = alloc_asocket();
     if(s == 0) fatal("cannot allocate socket");
     s->id = 0;
     s->enqueue = smart_socket_enqueue;
@@ -81,6 +81,15 @@ static __inline__ void  close_on_exec(int  fd)
 
 extern void  disable_tcp_nagle(int  fd);
 
+/* winsock has no TCP_CORK - writexv() alone does the coalescing here */
+static __inline__ void  adb_tcp_cork(int fd)
+{
+}
+
+static __inline__ void  adb_tcp_uncork(int fd)
+{
+}
+
 #define  lstat    stat   /* no symlinks on Win32 */
 
 #define  S_ISLNK(m)   0   /* no symlinks on Win32 */
@@ -112,6 +121,14 @@ extern int  adb_open(const char*  path, int  options);
 extern int  adb_creat(const char*  path, int  mode);
 extern int  adb_read(int  fd, void* buf, int len);
 extern int  adb_write(int  fd, const void*  buf, int  len);
+
+/* winsock has no writev(); writexv() in transport.c falls back to
+** one adb_write() per vector element on this platform.
+*/
+typedef struct {
+    void*   iov_base;
+    size_t  iov_len;
+} adb_iovec;
 extern int  adb_lseek(int  fd, int  pos, int  where);
 extern int  adb_close(int  fd);
 
@@ -189,6 +206,31 @@ void     fdevent_add(fdevent *fde, unsigned events);
 void     fdevent_del(fdevent *fde, unsigned events);
 void     fdevent_loop();
 
+#define FDEVENT_LAT_BUCKETS 8
+void     fdevent_get_stats(unsigned *loops, unsigned *callbacks,
+                           unsigned latency[FDEVENT_LAT_BUCKETS]);
+
+typedef struct fdevent_timer fdevent_timer;
+
+typedef void (*timer_func)(void *arg);
+
+struct fdevent_timer
+{
+    fdevent_timer *next;
+    fdevent_timer *prev;
+
+    long long deadline;     /* absolute, in ms */
+    long long tick;         /* deadline in granularity units */
+
+    timer_func func;
+    void *arg;
+};
+
+void     fdevent_timer_set(fdevent_timer *t, timer_func func, void *arg,
+                           unsigned ms);
+void     fdevent_timer_cancel(fdevent_timer *t);
+void     fdevent_timer_slack(unsigned ms);
+
 struct fdevent {
     fdevent *next;
     fdevent *prev;
@@ -259,6 +301,7 @@ static __inline__  int  adb_is_absolute_host_path( const char*  path )
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #include <pthread.h>
@@ -274,6 +317,7 @@ static __inline__  int  adb_is_absolute_host_path( const char*  path )
 
 typedef  pthread_mutex_t          adb_mutex_t;
 #define  ADB_MUTEX_INITIALIZER    PTHREAD_MUTEX_INITIALIZER
+#define  ADB_COND_INITIALIZER     PTHREAD_COND_INITIALIZER
 #define  adb_mutex_init           pthread_mutex_init
 #define  adb_mutex_lock           pthread_mutex_lock
 #define  adb_mutex_unlock         pthread_mutex_unlock
@@ -350,6 +394,13 @@ static __inline__  int  adb_write(int  fd, const void*  buf, size_t  len)
 #undef   write
 #define  write  ___xxx_write
 
+typedef struct iovec  adb_iovec;
+
+static __inline__  int  adb_writev(int  fd, const adb_iovec*  iov, int  count)
+{
+    return writev(fd, iov, count);
+}
+
 static __inline__ int   adb_lseek(int  fd, int  pos, int  where)
 {
     return lseek(fd, pos, where);
@@ -415,6 +466,28 @@ static __inline__ void  disable_tcp_nagle(int fd)
     setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, (void*)&on, sizeof(on) );
 }
 
+/* TCP_CORK holds back partial segments so a burst of small writes
+** leaves the host as full packets; uncorking flushes whatever is
+** still pending. only linux has it - elsewhere (and on non-TCP fds,
+** where setsockopt simply fails) these degrade to no-ops and we rely
+** on writexv() alone to coalesce header and payload.
+*/
+static __inline__ void  adb_tcp_cork(int fd)
+{
+#ifdef TCP_CORK
+    int  on = 1;
+    setsockopt( fd, IPPROTO_TCP, TCP_CORK, (void*)&on, sizeof(on) );
+#endif
+}
+
+static __inline__ void  adb_tcp_uncork(int fd)
+{
+#ifdef TCP_CORK
+    int  on = 0;
+    setsockopt( fd, IPPROTO_TCP, TCP_CORK, (void*)&on, sizeof(on) );
+#endif
+}
+
 
 static __inline__ int  unix_socketpair( int  d, int  type, int  protocol, int sv[2] )
 {
@@ -1414,6 +1414,81 @@ event_looper_unhook( EventLooper  looper, int  fd, int  events )
 
 static EventLooperRec  win32_looper;
 
+/* one-shot timers.  this looper keeps them in a deadline-sorted list
+ * rather than the timing wheel the epoll backend uses: a host server
+ * arms a handful at most, and the sorted head doubles as the wait
+ * timeout below.  semantics match <cutils/fdevent.h>.
+ */
+static fdevent_timer  timer_list = { &timer_list, &timer_list, 0, 0, NULL, NULL };
+static unsigned       timer_quantum = 10;
+
+static long long timer_now_ms( void )
+{
+    return (long long) GetTickCount();
+}
+
+void fdevent_timer_set(fdevent_timer *t, timer_func func, void *arg,
+                       unsigned ms)
+{
+    fdevent_timer*  after;
+    long long       q = timer_quantum;
+
+    fdevent_timer_cancel(t);
+
+    /* round the deadline up to the coalescing quantum */
+    t->deadline = ((timer_now_ms() + ms + q - 1) / q) * q;
+    t->tick     = t->deadline / q;
+    t->func     = func;
+    t->arg      = arg;
+
+    for (after = timer_list.next; after != &timer_list; after = after->next) {
+        if (after->deadline > t->deadline)
+            break;
+    }
+    t->next       = after;
+    t->prev       = after->prev;
+    t->prev->next = t;
+    after->prev   = t;
+}
+
+void fdevent_timer_cancel(fdevent_timer *t)
+{
+    if (t->next) {
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        t->next = NULL;
+        t->prev = NULL;
+    }
+}
+
+void fdevent_timer_slack(unsigned ms)
+{
+    if (ms == 0) ms = 1;
+    timer_quantum = ms;
+}
+
+/* how long the wait below may sleep; -1 when nothing is armed */
+static int fdevent_timer_timeout( void )
+{
+    long long  ms;
+
+    if (timer_list.next == &timer_list)
+        return -1;
+    ms = timer_list.next->deadline - timer_now_ms();
+    return (ms > 0) ? (int) ms : 0;
+}
+
+static void fdevent_process_timers( void )
+{
+    fdevent_timer*  t;
+
+    while ((t = timer_list.next) != &timer_list &&
+           t->deadline <= timer_now_ms()) {
+        fdevent_timer_cancel(t);
+        t->func(t->arg);
+    }
+}
+
 static void fdevent_init(void)
 {
     win32_looper.htab_count = 0;
@@ -1510,11 +1585,41 @@ static void fdevent_process()
             int   wait_ret;
 
             D( "adb_win32: waiting for %d events\n", looper->htab_count );
-            if (looper->htab_count > MAXIMUM_WAIT_OBJECTS) {
-                D("handle count %d exceeds MAXIMUM_WAIT_OBJECTS, aborting!\n", looper->htab_count);
-                abort();
+            if (looper->htab_count <= MAXIMUM_WAIT_OBJECTS) {
+                int  timo = fdevent_timer_timeout();
+                wait_ret = WaitForMultipleObjects( looper->htab_count, looper->htab, FALSE,
+                                                   (timo < 0) ? INFINITE : (DWORD) timo );
+                if (wait_ret == (int)WAIT_TIMEOUT)
+                    break;      /* a timer is due; let the loop fire it */
+            } else {
+                /* WaitForMultipleObjects is capped at 64 handles, and a
+                 * farm host with dozens of devices needs more than that.
+                 * rotate a bounded wait across slices of the handle
+                 * table: the rotation keeps every slice serviced, and
+                 * the short timeout bounds how long a ready handle in
+                 * another slice goes unnoticed.  hosts below the cap
+                 * keep the plain infinite wait above.
+                 */
+                static int  slice_start;
+                int         base, count;
+
+                if (slice_start >= looper->htab_count)
+                    slice_start = 0;
+                base  = slice_start;
+                count = looper->htab_count - base;
+                if (count > MAXIMUM_WAIT_OBJECTS)
+                    count = MAXIMUM_WAIT_OBJECTS;
+                slice_start += count;
+
+                wait_ret = WaitForMultipleObjects( count, looper->htab + base, FALSE, 50 );
+                if (wait_ret == (int)WAIT_TIMEOUT) {
+                    if (fdevent_timer_timeout() == 0)
+                        break;      /* a timer is due; let the loop fire it */
+                    continue;       /* move on to the next slice */
+                }
+                if ((unsigned)wait_ret < (unsigned)count)
+                    wait_ret += base;   /* index into the full table */
             }
-            wait_ret = WaitForMultipleObjects( looper->htab_count, looper->htab, FALSE, INFINITE );
             if (wait_ret == (int)WAIT_FAILED) {
                 D( "adb_win32: wait failed, error %ld\n", GetLastError() );
             } else {
@@ -1724,9 +1829,24 @@ void fdevent_del(fdevent *fde, unsigned events)
         fde, (fde->state & FDE_EVENTMASK) & (~(events & FDE_EVENTMASK)));
 }
 
+/* always-on loop statistics, mirroring the libcutils implementation */
+static unsigned stat_loops;
+static unsigned stat_callbacks;
+static unsigned stat_latency[FDEVENT_LAT_BUCKETS];
+
+void fdevent_get_stats(unsigned *loops, unsigned *callbacks,
+                       unsigned latency[FDEVENT_LAT_BUCKETS])
+{
+    *loops = stat_loops;
+    *callbacks = stat_callbacks;
+    memcpy(latency, stat_latency, sizeof(stat_latency));
+}
+
 void fdevent_loop()
 {
     fdevent *fde;
+    DWORD t0, ms;
+    int bucket;
 
     for(;;) {
 #if DEBUG
@@ -1734,13 +1854,25 @@ void fdevent_loop()
 #endif
         fdevent_process();
 
+        t0 = GetTickCount();
+        stat_loops++;
+
+        fdevent_process_timers();
+
         while((fde = fdevent_plist_dequeue())) {
             unsigned events = fde->events;
             fde->events = 0;
             fde->state &= (~FDE_PENDING);
             dump_fde(fde, "callback");
+            stat_callbacks++;
             fde->func(fde->fd, events, fde->arg);
         }
+
+        ms = GetTickCount() - t0;
+        for(bucket = 0; bucket < FDEVENT_LAT_BUCKETS - 1; bucket++) {
+            if(ms < (1U << bucket)) break;
+        }
+        stat_latency[bucket]++;
     }
 }
 
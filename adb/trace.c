@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "sysdeps.h"
+#include "adb.h"
+
+/* trace category name <-> bit mapping.  '1' and 'all' are special
+ * cases which enable every category.
+ */
+static const struct {
+    const char*  tag;
+    int          flag;
+} tags[] = {
+    { "1", 0 },
+    { "all", 0 },
+    { "adb", TRACE_ADB },
+    { "sockets", TRACE_SOCKETS },
+    { "packets", TRACE_PACKETS },
+    { "rwx", TRACE_RWX },
+    { "usb", TRACE_USB },
+    { "sync", TRACE_SYNC },
+    { "sysdeps", TRACE_SYSDEPS },
+    { "transport", TRACE_TRANSPORT },
+    { "jdwp", TRACE_JDWP },
+    { NULL, 0 }
+};
+
+const char* adb_trace_tag_name(int tag)
+{
+    int  tagn;
+
+    for (tagn = 0; tags[tagn].tag != NULL; tagn++) {
+        if (tags[tagn].flag == tag && tags[tagn].tag[0] != '1')
+            return tags[tagn].tag;
+    }
+    return "?";
+}
+
+/* turn a comma/space/colon/semi-colon separated list of category
+ * names into a trace mask.  unknown names are ignored, so an empty
+ * or bogus list yields 0.
+ */
+int adb_trace_parse_tags(const char*  p)
+{
+    const char*  q;
+    int          mask = 0;
+
+    while (*p) {
+        int  len, tagn;
+
+        q = strpbrk(p, " ,:;");
+        if (q == NULL) {
+            q = p + strlen(p);
+        }
+        len = q - p;
+
+        for (tagn = 0; tags[tagn].tag != NULL; tagn++)
+        {
+            int  taglen = strlen(tags[tagn].tag);
+
+            if (len == taglen && !memcmp(tags[tagn].tag, p, len) )
+            {
+                int  flag = tags[tagn].flag;
+                if (flag == 0) {
+                    return ~0;
+                }
+                mask |= (1 << flag);
+                break;
+            }
+        }
+        p = q;
+        if (*p)
+            p++;
+    }
+    return mask;
+}
+
+#ifndef _WIN32
+
+#include <sys/time.h>
+#include <cutils/threads.h>
+#include <cutils/atomic.h>
+
+/* each thread records trace events into its own ring, so the hot
+ * path never takes a lock and never blocks another thread.  a global
+ * serial number (one atomic increment per event) lets the dump be
+ * interleaved across threads afterwards.  rings are registered on
+ * first use and never freed -- a thread that exits leaves its last
+ * events visible, which is exactly what you want post-mortem.
+ */
+
+#define  TRACE_RING_RECORDS  256     /* per thread, power of two */
+#define  TRACE_RECORD_TEXT   108
+
+typedef struct {
+    unsigned       serial;
+    unsigned       when_ms;
+    unsigned char  tag;
+    char           text[TRACE_RECORD_TEXT];
+} trace_record;
+
+typedef struct trace_ring {
+    struct trace_ring*  next;
+    int                 id;
+    unsigned            head;       /* total records ever written */
+    trace_record        records[TRACE_RING_RECORDS];
+} trace_ring;
+
+static thread_store_t  trace_ring_store = THREAD_STORE_INITIALIZER;
+static trace_ring*     trace_rings;
+static int             trace_ring_count;
+ADB_MUTEX_DEFINE( trace_ring_lock );
+
+static volatile int32_t  trace_serial;
+
+static trace_ring*  trace_ring_get(void)
+{
+    trace_ring*  ring = thread_store_get(&trace_ring_store);
+
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL)
+            return NULL;
+        thread_store_set(&trace_ring_store, ring, NULL);
+
+        adb_mutex_lock(&trace_ring_lock);
+        ring->id = ++trace_ring_count;
+        ring->next = trace_rings;
+        trace_rings = ring;
+        adb_mutex_unlock(&trace_ring_lock);
+    }
+    return ring;
+}
+
+void adb_trace_record(int tag, const char*  fmt, ...)
+{
+    trace_ring*    ring = trace_ring_get();
+    trace_record*  r;
+    struct timeval tv;
+    va_list        ap;
+    int            len;
+
+    if (ring == NULL)
+        return;
+
+    r = &ring->records[ring->head & (TRACE_RING_RECORDS - 1)];
+
+    gettimeofday(&tv, NULL);
+    r->when_ms = (unsigned)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    r->serial = (unsigned) android_atomic_inc(&trace_serial);
+    r->tag = (unsigned char) tag;
+
+    va_start(ap, fmt);
+    len = vsnprintf(r->text, sizeof(r->text), fmt, ap);
+    va_end(ap);
+
+    /* trace formats end with a newline for the fprintf path;
+     * the ring stores bare text */
+    if (len > 0 && len < (int) sizeof(r->text) && r->text[len - 1] == '\n')
+        r->text[len - 1] = 0;
+
+    /* publish only after the record is complete.  a concurrent dump
+     * may still catch the slot mid-write; a rare torn line beats a
+     * lock on every traced event. */
+    ring->head++;
+}
+
+int adb_trace_dump(char*  buf, size_t  size)
+{
+    trace_ring*  ring;
+    int          len = 0;
+
+    adb_mutex_lock(&trace_ring_lock);
+    for (ring = trace_rings; ring; ring = ring->next) {
+        unsigned  head = ring->head;
+        unsigned  n = (head > TRACE_RING_RECORDS) ? TRACE_RING_RECORDS : head;
+        unsigned  i;
+
+        len += snprintf(buf + len, size - len,
+                        "thread %d: %u events\n", ring->id, head);
+        if ((size_t) len >= size)
+            break;
+
+        for (i = head - n; i != head; i++) {
+            trace_record*  r = &ring->records[i & (TRACE_RING_RECORDS - 1)];
+
+            len += snprintf(buf + len, size - len,
+                            "%8u %6u.%03u %-9s %s\n",
+                            r->serial, r->when_ms / 1000, r->when_ms % 1000,
+                            adb_trace_tag_name(r->tag), r->text);
+            if ((size_t) len >= size)
+                break;
+        }
+        if ((size_t) len >= size)
+            break;
+    }
+    adb_mutex_unlock(&trace_ring_lock);
+
+    if ((size_t) len >= size)
+        len = size - 1;
+    return len;
+}
+
+#else  /* _WIN32 */
+
+/* no per-thread rings on win32 (no libcutils there); the runtime
+ * print mask still works */
+
+void adb_trace_record(int tag, const char*  fmt, ...)
+{
+}
+
+int adb_trace_dump(char*  buf, size_t  size)
+{
+    return snprintf(buf, size, "trace recording not available\n");
+}
+
+#endif
@@ -34,6 +34,60 @@ static atransport transport_list = {
 
 ADB_MUTEX_DEFINE( transport_lock );
 
+/* serial -> transport hash map, maintained alongside transport_list
+** under transport_lock, so by-serial lookups (the device pool polls
+** one per entry every second) stay constant time as the lab grows
+** instead of rescanning the whole list.
+*/
+#define SERIAL_MAP_BUCKETS 64
+
+static atransport *serial_map[SERIAL_MAP_BUCKETS];
+
+static unsigned serial_map_bucket(const char *serial)
+{
+    unsigned h = 5381;
+
+    while(*serial)
+        h = h * 33 + (unsigned char) *serial++;
+    return h % SERIAL_MAP_BUCKETS;
+}
+
+/* insert/remove/find are all called with transport_lock held */
+static void serial_map_insert(atransport *t)
+{
+    unsigned b;
+
+    if(t->serial == NULL) return;
+    b = serial_map_bucket(t->serial);
+    t->smap_next = serial_map[b];
+    serial_map[b] = t;
+}
+
+static void serial_map_remove(atransport *t)
+{
+    atransport **pt;
+
+    if(t->serial == NULL) return;
+    for(pt = &serial_map[serial_map_bucket(t->serial)];
+        *pt != NULL; pt = &(*pt)->smap_next) {
+        if(*pt == t) {
+            *pt = t->smap_next;
+            break;
+        }
+    }
+}
+
+static atransport *serial_map_find(const char *serial)
+{
+    atransport *t;
+
+    for(t = serial_map[serial_map_bucket(serial)]; t; t = t->smap_next) {
+        if(!strcmp(serial, t->serial))
+            return t;
+    }
+    return NULL;
+}
+
 #if ADB_TRACE
 static void  dump_hex( const unsigned char*  ptr, size_t  len )
 {
@@ -87,29 +141,14 @@ run_transport_disconnects(atransport*  t)
     }
 }
 
-static int
-read_packet(int  fd, apacket** ppacket)
+static void
+trace_packet(const char *func, int fd, apacket *p)
 {
-    char *p = (char*)ppacket;  /* really read a packet address */
-    int   r;
-    int   len = sizeof(*ppacket);
-    while(len > 0) {
-        r = adb_read(fd, p, len);
-        if(r > 0) {
-            len -= r;
-            p   += r;
-        } else {
-            D("read_packet: %d error %d %d\n", fd, r, errno);
-            if((r < 0) && (errno == EINTR)) continue;
-            return -1;
-        }
-    }
-
 #if ADB_TRACE
     if (ADB_TRACING)
     {
-        unsigned  command = (*ppacket)->msg.command;
-        int       len     = (*ppacket)->msg.data_length;
+        unsigned  command = p->msg.command;
+        int       len     = p->msg.data_length;
         char      cmd[5];
         int       n;
 
@@ -122,54 +161,65 @@ read_packet(int  fd, apacket** ppacket)
         }
         cmd[4] = 0;
 
-        D("read_packet: %d ok: [%08x %s] %08x %08x (%d) ",
-          fd, command, cmd, (*ppacket)->msg.arg0, (*ppacket)->msg.arg1, len);
-        dump_hex((*ppacket)->data, len);
+        D("%s: %d [%08x %s] %08x %08x (%d) ",
+          func, fd, command, cmd, p->msg.arg0, p->msg.arg1, len);
+        dump_hex(p->data, len);
     }
 #endif
-    return 0;
 }
 
+/* push a packet on a transport SPSC queue and ring the doorbell.
+** the queue has a single producer and a single consumer, so only the
+** head/tail counters are shared; the doorbell byte on the socketpair
+** provides both the wakeup and the ordering.
+*/
 static int
-write_packet(int  fd, apacket** ppacket)
+queue_packet(int fd, apacket_queue *q, apacket *p)
 {
-    char *p = (char*) ppacket;  /* we really write the packet address */
-    int r, len = sizeof(ppacket);
+    char b = 0;
+    int r;
 
-#if ADB_TRACE
-    if (ADB_TRACING)
-    {
-        unsigned  command = (*ppacket)->msg.command;
-        int       len     = (*ppacket)->msg.data_length;
-        char      cmd[5];
-        int       n;
+    trace_packet("queue_packet", fd, p);
 
-        for (n = 0; n < 4; n++) {
-            int  b = (command >> (n*8)) & 255;
-            if (b >= 32 && b < 127)
-                cmd[n] = (char)b;
-            else
-                cmd[n] = '.';
-        }
-        cmd[4] = 0;
+    while((q->tail - q->head) >= TRANSPORT_QUEUE_SIZE) {
+            /* consumer is behind; yield until a slot opens up */
+        adb_sleep_ms(1);
+    }
+    q->slot[q->tail & (TRANSPORT_QUEUE_SIZE - 1)] = p;
+    q->tail++;
 
-        D("write_packet: %d [%08x %s] %08x %08x (%d) ",
-          fd, command, cmd, (*ppacket)->msg.arg0, (*ppacket)->msg.arg1, len);
-        dump_hex((*ppacket)->data, len);
+    for(;;) {
+        r = adb_write(fd, &b, 1);
+        if(r == 1) return 0;
+        if((r < 0) && (errno == EINTR)) continue;
+        D("queue_packet: %d error %d %d\n", fd, r, errno);
+        return -1;
     }
-#endif
-    len = sizeof(ppacket);
-    while(len > 0) {
-        r = adb_write(fd, p, len);
-        if(r > 0) {
-            len -= r;
-            p += r;
-        } else {
-            D("write_packet: %d error %d %d\n", fd, r, errno);
-            if((r < 0) && (errno == EINTR)) continue;
-            return -1;
-        }
+}
+
+/* wait for a doorbell byte, then pop the packet it announced */
+static int
+dequeue_packet(int fd, apacket_queue *q, apacket **ppacket)
+{
+    char b;
+    int r;
+
+    for(;;) {
+        r = adb_read(fd, &b, 1);
+        if(r == 1) break;
+        if((r < 0) && (errno == EINTR)) continue;
+        D("dequeue_packet: %d error %d %d\n", fd, r, errno);
+        return -1;
+    }
+
+    if(q->tail == q->head) {
+        D("dequeue_packet: %d doorbell with empty queue\n", fd);
+        return -1;
     }
+    *ppacket = q->slot[q->head & (TRANSPORT_QUEUE_SIZE - 1)];
+    q->head++;
+
+    trace_packet("dequeue_packet", fd, *ppacket);
     return 0;
 }
 
@@ -177,7 +227,7 @@ static void transport_socket_events(int fd, unsigned events, void *_t)
 {
     if(events & FDE_READ){
         apacket *p = 0;
-        if(read_packet(fd, &p)){
+        if(dequeue_packet(fd, &((atransport *) _t)->q_from_remote, &p)){
             D("failed to read packet from transport socket on fd %d\n", fd);
         } else {
             handle_packet(p, (atransport *) _t);
@@ -208,7 +258,10 @@ void send_packet(apacket *p, atransport *t)
         D("Transport is null \n");
     }
 
-    if(write_packet(t->transport_socket, &p)){
+    t->pkts_to_remote++;
+    t->bytes_to_remote += sizeof(amessage) + p->msg.data_length;
+
+    if(queue_packet(t->transport_socket, &t->q_to_remote, p)){
         fatal_errno("cannot enqueue packet on transport socket");
     }
 }
@@ -239,7 +292,7 @@ static void *output_thread(void *_t)
     p->msg.arg0 = 1;
     p->msg.arg1 = ++(t->sync_token);
     p->msg.magic = A_SYNC ^ 0xffffffff;
-    if(write_packet(t->fd, &p)) {
+    if(queue_packet(t->fd, &t->q_from_remote, p)) {
         put_apacket(p);
         D("from_remote: failed to write SYNC apacket to transport %p", t);
         goto oops;
@@ -247,12 +300,22 @@ static void *output_thread(void *_t)
 
     D("from_remote: data pump  for transport %p\n", t);
     for(;;) {
-        p = get_apacket();
+        p = get_apacket_size(t->max_payload);
 
         if(t->read_from_remote(p, t) == 0){
             D("from_remote: received remote packet, sending to transport %p\n",
               t);
-            if(write_packet(t->fd, &p)){
+            if(p->msg.command == A_CNXN) {
+                    /* new-protocol peers advertise the payload size they
+                    ** accept in arg1.  raise our limit here, in the read
+                    ** thread, so the packet after the A_CNXN is already
+                    ** allocated at the negotiated size.
+                    */
+                transport_set_max_payload(t, p->msg.arg1);
+            }
+            t->pkts_from_remote++;
+            t->bytes_from_remote += sizeof(amessage) + p->msg.data_length;
+            if(queue_packet(t->fd, &t->q_from_remote, p)){
                 put_apacket(p);
                 D("from_remote: failed to write apacket to transport %p", t);
                 goto oops;
@@ -270,7 +333,7 @@ static void *output_thread(void *_t)
     p->msg.arg0 = 0;
     p->msg.arg1 = 0;
     p->msg.magic = A_SYNC ^ 0xffffffff;
-    if(write_packet(t->fd, &p)) {
+    if(queue_packet(t->fd, &t->q_from_remote, p)) {
         put_apacket(p);
         D("from_remote: failed to write SYNC apacket to transport %p", t);
     }
@@ -292,7 +355,7 @@ static void *input_thread(void *_t)
        t, t->fd);
 
     for(;;){
-        if(read_packet(t->fd, &p)) {
+        if(dequeue_packet(t->fd, &t->q_to_remote, &p)) {
             D("to_remote: failed to read apacket from transport %p on fd %d\n", 
                t, t->fd );
             break;
@@ -340,16 +403,30 @@ static fdevent transport_registration_fde;
 
 
 #if ADB_HOST
-static int list_transports_msg(char*  buffer, size_t  bufferlen)
+/* frame the short-format device list for a tracker: 4 hex digits of
+** length then the body, clamped so the message still fits the single
+** apacket device_tracker_send() copies it into
+*/
+static char *list_transports_msg_alloc(int *outlen)
 {
-    char  head[5];
+    char *body = list_transports_alloc(0);
+    char *msg;
     int   len;
 
-    len = list_transports(buffer+4, bufferlen-4);
-    snprintf(head, sizeof(head), "%04x", len);
-    memcpy(buffer, head, 4);
-    len += 4;
-    return len;
+    if(body == NULL)
+        return NULL;
+    len = strlen(body);
+    if(len > MAX_PAYLOAD - 4)
+        len = MAX_PAYLOAD - 4;
+    msg = malloc(len + 5);
+    if(msg) {
+        snprintf(msg, 5, "%04x", len);
+        memcpy(msg + 4, body, len);
+        msg[len + 4] = 0;
+        *outlen = len + 4;
+    }
+    free(body);
+    return msg;
 }
 
 /* this adds support required by the 'track-devices' service.
@@ -431,13 +508,16 @@ device_tracker_ready( asocket*  socket )
     /* we want to send the device list when the tracker connects
     * for the first time, even if no update occured */
     if (tracker->update_needed > 0) {
-        char  buffer[1024];
+        char *msg;
         int   len;
 
         tracker->update_needed = 0;
 
-        len = list_transports_msg(buffer, sizeof(buffer));
-        device_tracker_send(tracker, buffer, len);
+        msg = list_transports_msg_alloc(&len);
+        if (msg) {
+            device_tracker_send(tracker, msg, len);
+            free(msg);
+        }
     }
 }
 
@@ -466,19 +546,22 @@ create_device_tracker(void)
 /* call this function each time the transport list has changed */
 void  update_transports(void)
 {
-    char             buffer[1024];
+    char*            msg;
     int              len;
     device_tracker*  tracker;
 
-    len = list_transports_msg(buffer, sizeof(buffer));
+    msg = list_transports_msg_alloc(&len);
+    if (msg == NULL)
+        return;
 
     tracker = device_tracker_list;
     while (tracker != NULL) {
         device_tracker*  next = tracker->next;
         /* note: this may destroy the tracker if the connection is closed */
-        device_tracker_send(tracker, buffer, len);
+        device_tracker_send(tracker, msg, len);
         tracker = next;
     }
+    free(msg);
 }
 #else
 void  update_transports(void)
@@ -563,11 +646,14 @@ static void transport_registration_func(int _fd, unsigned ev, void *data)
             ** socket pair.  The close closes the other half.
             */
         fdevent_remove(&(t->transport_fde));
+        fdevent_timer_cancel(&t->connect_timer);
+        fdevent_timer_cancel(&t->ping_timer);
         adb_close(t->fd);
 
         adb_mutex_lock(&transport_lock);
         t->next->prev = t->prev;
         t->prev->next = t->next;
+        serial_map_remove(t);
         adb_mutex_unlock(&transport_lock);
 
         run_transport_disconnects(t);
@@ -602,6 +688,7 @@ static void transport_registration_func(int _fd, unsigned ev, void *data)
     t->prev = transport_list.prev;
     t->next->prev = t;
     t->prev->next = t;
+    serial_map_insert(t);
     adb_mutex_unlock(&transport_lock);
 
     D("transport: %p install %d\n", t, t->transport_socket );
@@ -716,14 +803,11 @@ retry:
         *error_out = "device not found";
 
     adb_mutex_lock(&transport_lock);
-    for (t = transport_list.next; t != &transport_list; t = t->next) {
-        /* check for matching serial number */
-        if (serial) {
-            if (t->serial && !strcmp(serial, t->serial)) {
-                result = t;
-                break;
-            }
-        } else {
+    if (serial) {
+        /* by-serial lookups go through the hash map */
+        result = serial_map_find(serial);
+    } else {
+        for (t = transport_list.next; t != &transport_list; t = t->next) {
             if (ttype == kTransportUsb && t->type == kTransportUsb) {
                 if (result) {
                     if (error_out)
@@ -785,6 +869,21 @@ retry:
 }
 
 #if ADB_HOST
+/* lookup by serial, for callers (like the device pool) that only
+** need to know whether a transport is still on the list.  No
+** reference is taken; the pointer is only safe to use briefly.
+*/
+atransport *find_transport(const char *serial)
+{
+    atransport *result;
+
+    adb_mutex_lock(&transport_lock);
+    result = serial_map_find(serial);
+    adb_mutex_unlock(&transport_lock);
+
+    return result;
+}
+
 static const char *statename(atransport *t)
 {
     switch(t->connection_state){
@@ -797,19 +896,107 @@ static const char *statename(atransport *t)
     }
 }
 
-int list_transports(char *buf, size_t  bufsize)
+/* one row of the device list, snapshotted under transport_lock so it
+** can be sorted and emitted after the lock is dropped
+*/
+typedef struct {
+    char serial[128];
+    char line[256];
+    unsigned order;
+} tline;
+
+static int tline_cmp(const void *a, const void *b)
+{
+    const tline *ta = a;
+    const tline *tb = b;
+    int c = strcmp(ta->serial, tb->serial);
+
+    if (c) return c;
+        /* qsort is not stable: registration order breaks ties */
+    return (ta->order < tb->order) ? -1 : 1;
+}
+
+/* build the device list into a malloc'd, NUL-terminated string the
+** caller frees: no fixed cap, so a wall of devices no longer
+** truncates at 4KB, and rows are sorted by serial so parsers see the
+** same order from run to run.  long_fmt appends the product name and
+** the transport kind as extra tab-separated columns.  returns NULL
+** only on allocation failure.
+*/
+char *list_transports_alloc(int long_fmt)
+{
+    tline      *rows;
+    char       *buf;
+    char       *p;
+    atransport *t;
+    unsigned    count = 0, n = 0;
+    size_t      total = 1;
+
+    adb_mutex_lock(&transport_lock);
+    for(t = transport_list.next; t != &transport_list; t = t->next)
+        count++;
+
+    rows = malloc((count ? count : 1) * sizeof(tline));
+    if(rows == NULL) {
+        adb_mutex_unlock(&transport_lock);
+        return NULL;
+    }
+
+    for(t = transport_list.next; t != &transport_list; t = t->next) {
+        tline *row = &rows[n];
+
+        snprintf(row->serial, sizeof(row->serial), "%s",
+                 t->serial ? t->serial : "");
+        if(long_fmt)
+            snprintf(row->line, sizeof(row->line), "%s\t%s\t%s\t%s\n",
+                     row->serial, statename(t),
+                     t->product ? t->product : "unknown",
+                     t->type == kTransportUsb ? "usb" : "local");
+        else
+            snprintf(row->line, sizeof(row->line), "%s\t%s\n",
+                     row->serial, statename(t));
+        row->order = n++;
+    }
+    adb_mutex_unlock(&transport_lock);
+
+    qsort(rows, n, sizeof(tline), tline_cmp);
+
+    for(count = 0; count < n; count++)
+        total += strlen(rows[count].line);
+    buf = malloc(total);
+    if(buf) {
+        p = buf;
+        for(count = 0; count < n; count++) {
+            size_t len = strlen(rows[count].line);
+
+            memcpy(p, rows[count].line, len);
+            p += len;
+        }
+        *p = 0;
+    }
+    free(rows);
+    return buf;
+}
+
+int dump_transport_stats(char *buf, size_t  bufsize)
 {
     char*       p   = buf;
     char*       end = buf + bufsize;
     int         len;
     atransport *t;
 
-        /* XXX OVERRUN PROBLEMS XXX */
     adb_mutex_lock(&transport_lock);
     for(t = transport_list.next; t != &transport_list; t = t->next) {
-        len = snprintf(p, end - p, "%s\t%s\n",
+        len = snprintf(p, end - p,
+                "%s\tout depth %u pkts %llu bytes %llu\t"
+                "in depth %u pkts %llu bytes %llu\t"
+                "rtt %u ms missed %u\n",
                 t->serial ? t->serial : "",
-                statename(t));
+                t->q_to_remote.tail - t->q_to_remote.head,
+                t->pkts_to_remote, t->bytes_to_remote,
+                t->q_from_remote.tail - t->q_from_remote.head,
+                t->pkts_from_remote, t->bytes_from_remote,
+                t->rtt_ms, t->pings_missed);
 
         if (p + len >= end) {
             /* discard last line if buffer is too short */
@@ -839,11 +1026,21 @@ void close_usb_devices()
 }
 #endif // ADB_HOST
 
-void register_socket_transport(int s, const char *serial, int  port)
+void transport_set_max_payload(atransport *t, unsigned maxdata)
+{
+    unsigned max = maxdata;
+
+    if(max < MAX_PAYLOAD) max = MAX_PAYLOAD;
+    if(max > MAX_PAYLOAD_LARGE) max = MAX_PAYLOAD_LARGE;
+    t->max_payload = max;
+    D("transport: %p max_payload now %d\n", t, t->max_payload);
+}
+
+void register_socket_transport(int s, const char *serial, int  port, int local)
 {
     atransport *t = calloc(1, sizeof(atransport));
     D("transport: %p init'ing for socket %d, on port %d\n", t, s, port);
-    if ( init_socket_transport(t, s, port) < 0 ) {
+    if ( init_socket_transport(t, s, port, local) < 0 ) {
         adb_close(s);
         free(t);
         return;
@@ -922,6 +1119,45 @@ int writex(int fd, const void *ptr, size_t len)
     return 0;
 }
 
+/* vectored writex(): sends every iovec entry as one logical write so
+** that a protocol header and its payload share a segment instead of
+** going out as two packets. the iovec array is consumed in place.
+*/
+int writexv(int fd, adb_iovec *iov, int count)
+{
+    int r;
+
+    while(count > 0) {
+        if(iov->iov_len == 0) {
+            iov++;
+            count--;
+            continue;
+        }
+#ifdef _WIN32
+        r = adb_write(fd, iov->iov_base, iov->iov_len);
+#else
+        r = adb_writev(fd, iov, count);
+#endif
+        if(r <= 0) {
+            D("writexv: %d %d %s\n", fd, r, strerror(errno));
+            if((r < 0) && (errno == EINTR)) continue;
+            return -1;
+        }
+        while(r > 0 && count > 0) {
+            if((size_t) r >= iov->iov_len) {
+                r -= iov->iov_len;
+                iov++;
+                count--;
+            } else {
+                iov->iov_base = (char*) iov->iov_base + r;
+                iov->iov_len -= r;
+                r = 0;
+            }
+        }
+    }
+    return 0;
+}
+
 int check_header(apacket *p)
 {
     if(p->msg.magic != (p->msg.command ^ 0xffffffff)) {
@@ -929,8 +1165,8 @@ int check_header(apacket *p)
         return -1;
     }
 
-    if(p->msg.data_length > MAX_PAYLOAD) {
-        D("check_header(): %d > MAX_PAYLOAD\n", p->msg.data_length);
+    if(p->msg.data_length > p->alloc) {
+        D("check_header(): %d > alloc %d\n", p->msg.data_length, p->alloc);
         return -1;
     }
 
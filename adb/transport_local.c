@@ -122,16 +122,16 @@ int  local_connect(int  port)
         close_on_exec(fd);
         disable_tcp_nagle(fd);
         snprintf(buf, sizeof buf, "%s%d", LOCAL_CLIENT_PREFIX, port - 1);
-        register_socket_transport(fd, buf, port);
+        register_socket_transport(fd, buf, port, 1);
         return 0;
     }
     return -1;
 }
 
 
+#if ADB_HOST
 static void *client_socket_thread(void *x)
 {
-#if ADB_HOST
     int  port  = ADB_LOCAL_TRANSPORT_PORT;
     int  count = ADB_LOCAL_TRANSPORT_MAX;
 
@@ -143,60 +143,135 @@ static void *client_socket_thread(void *x)
     for ( ; count > 0; count--, port += 2 ) {
         (void) local_connect(port);
     }
-#endif
     return 0;
 }
+#endif /* ADB_HOST */
+
+#if !ADB_HOST
+/* the TCP listener can be reconfigured at runtime (see the config
+** watcher in adb.c): flipping it on or off only opens or closes the
+** listening socket, established transports are never touched.  the
+** config lives behind a lock; the listener fd is shut down (not
+** closed) by the controller to kick the server thread out of accept,
+** and the thread itself closes it.
+*/
+ADB_MUTEX_DEFINE( server_config_lock );
+static adb_cond_t server_config_cond = PTHREAD_COND_INITIALIZER;
+static int server_fd = -1;
+static int server_port = ADB_LOCAL_TRANSPORT_PORT;
+static int server_enabled = 0;
+static int server_thread_started = 0;
 
 static void *server_socket_thread(void *x)
 {
-    int serverfd, fd;
+    int serverfd, fd, port;
     struct sockaddr addr;
     socklen_t alen;
 
     D("transport: server_socket_thread() starting\n");
     serverfd = -1;
     for(;;) {
+        adb_mutex_lock(&server_config_lock);
+        while(!server_enabled) {
+            if(serverfd >= 0) {
+                server_fd = -1;
+                adb_close(serverfd);
+                serverfd = -1;
+            }
+            adb_cond_wait(&server_config_cond, &server_config_lock);
+        }
+        port = server_port;
+        adb_mutex_unlock(&server_config_lock);
+
         if(serverfd == -1) {
-            serverfd = socket_inaddr_any_server(ADB_LOCAL_TRANSPORT_PORT, SOCK_STREAM);
+            serverfd = socket_inaddr_any_server(port, SOCK_STREAM);
             if(serverfd < 0) {
                 D("server: cannot bind socket yet\n");
                 adb_sleep_ms(1000);
                 continue;
             }
             close_on_exec(serverfd);
+            adb_mutex_lock(&server_config_lock);
+            if(!server_enabled || server_port != port) {
+                /* config changed while we were binding */
+                adb_close(serverfd);
+                serverfd = -1;
+                adb_mutex_unlock(&server_config_lock);
+                continue;
+            }
+            server_fd = serverfd;
+            adb_mutex_unlock(&server_config_lock);
         }
 
         alen = sizeof(addr);
-        D("server: trying to get new connection from %d\n", ADB_LOCAL_TRANSPORT_PORT);
+        D("server: trying to get new connection from %d\n", port);
         fd = adb_socket_accept(serverfd, &addr, &alen);
         if(fd >= 0) {
             D("server: new connection on fd %d\n", fd);
             close_on_exec(fd);
             disable_tcp_nagle(fd);
-            register_socket_transport(fd,"host",ADB_LOCAL_TRANSPORT_PORT);
+            register_socket_transport(fd,"host",port,1);
+        } else {
+            /* the controller shut the listener down to kick us out of
+            ** accept; drop it and loop around for the new config */
+            adb_mutex_lock(&server_config_lock);
+            if(server_fd == -1 || !server_enabled || server_port != port) {
+                server_fd = -1;
+                adb_close(serverfd);
+                serverfd = -1;
+            }
+            adb_mutex_unlock(&server_config_lock);
         }
     }
     D("transport: server_socket_thread() exiting\n");
     return 0;
 }
 
-void local_init(void)
+/* (re)open the TCP listener on the given port, or close it for
+** port <= 0.  safe to call from any thread, any number of times.
+*/
+void local_set_tcp_port(int port)
 {
     adb_thread_t thr;
-    void* (*func)(void *);
+    int kick;
 
-    if(HOST) {
-        func = client_socket_thread;
+    adb_mutex_lock(&server_config_lock);
+    if(port > 0) {
+        server_port = port;
+        server_enabled = 1;
     } else {
-        func = server_socket_thread;
+        server_enabled = 0;
+    }
+    kick = server_fd;
+    if(server_enabled && !server_thread_started) {
+        if(adb_thread_create(&thr, server_socket_thread, 0)) {
+            server_enabled = 0;
+            adb_mutex_unlock(&server_config_lock);
+            fatal_errno("cannot create local socket server thread");
+            return;
+        }
+        server_thread_started = 1;
     }
+    if(kick >= 0)
+        shutdown(kick, SHUT_RDWR);
+    adb_cond_broadcast(&server_config_cond);
+    adb_mutex_unlock(&server_config_lock);
+}
+#endif /* !ADB_HOST */
 
-    D("transport: local %s init\n", HOST ? "client" : "server");
+void local_init(void)
+{
+#if ADB_HOST
+    adb_thread_t thr;
 
-    if(adb_thread_create(&thr, func, 0)) {
-        fatal_errno("cannot create local socket %s thread",
-                    HOST ? "client" : "server");
+    D("transport: local client init\n");
+    if(adb_thread_create(&thr, client_socket_thread, 0)) {
+        fatal_errno("cannot create local socket client thread");
     }
+#else
+    D("transport: local server init\n");
+    local_set_tcp_port(ADB_LOCAL_TRANSPORT_PORT);
+#endif
 }
 
 static void remote_kick(atransport *t)
@@ -225,7 +300,7 @@ static void remote_close(atransport *t)
     adb_close(t->fd);
 }
 
-int init_socket_transport(atransport *t, int s, int  port)
+int init_socket_transport(atransport *t, int s, int  port, int local)
 {
     int  fail = 0;
 
@@ -237,9 +312,12 @@ int init_socket_transport(atransport *t, int s, int  port)
     t->sync_token = 1;
     t->connection_state = CS_OFFLINE;
     t->type = kTransportLocal;
+    t->max_payload = MAX_PAYLOAD;
 
 #if ADB_HOST
-    if (HOST) {
+    /* remote (pool) endpoints use arbitrary ports; only emulator
+    ** connections take part in the local transport slot tracking */
+    if (HOST && local) {
         adb_mutex_lock( &local_transports_lock );
         {
             int  index = (port - ADB_LOCAL_TRANSPORT_PORT)/2;
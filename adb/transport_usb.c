@@ -82,12 +82,29 @@ static int remote_write(apacket *p, atransport *t)
 
     fix_endians(p);
 
+        /* the message and its payload are contiguous in the apacket,
+        ** so a single coalesced bulk write carries both and the
+        ** transport submits half as many transfers.  but the peer's
+        ** usb stack must have queued a read large enough for both:
+        ** peers that did not advertise the "wcoal" banner property
+        ** (every shipping device) read the 24-byte header as its own
+        ** transfer, and a larger packet would overflow that request,
+        ** so they get the split writes.
+        */
+    if(t->coalesce_writes) {
+        if(usb_write(t->usb, &p->msg, sizeof(amessage) + size)) {
+            D("remote usb: write terminated\n");
+            return -1;
+        }
+        return 0;
+    }
+
     if(usb_write(t->usb, &p->msg, sizeof(amessage))) {
         D("remote usb: 1 - write terminated\n");
         return -1;
     }
-    if(p->msg.data_length == 0) return 0;
-    if(usb_write(t->usb, &p->data, size)) {
+    if(size == 0) return 0;
+    if(usb_write(t->usb, p->data, size)) {
         D("remote usb: 2 - write terminated\n");
         return -1;
     }
@@ -117,6 +134,7 @@ void init_usb_transport(atransport *t, usb_handle *h)
     t->connection_state = CS_OFFLINE;
     t->type = kTransportUsb;
     t->usb = h;
+    t->max_payload = MAX_PAYLOAD;
 
 #if ADB_HOST
     HOST = 1;
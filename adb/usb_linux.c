@@ -21,19 +21,15 @@
 
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/inotify.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
 
 #include <linux/usbdevice_fs.h>
-#include <linux/version.h>
-#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
-#include <linux/usb/ch9.h>
-#else
-#include <linux/usb_ch9.h>
-#endif
-#include <asm/byteorder.h>
+
+#include <usbhost/usbhost.h>
 
 #include "sysdeps.h"
 
@@ -44,6 +40,15 @@
 /* usb scan debugging is waaaay too verbose */
 #define DBGX(x...)
 
+/* usbdevfs accepts bulk buffers up to 16KB per URB */
+#define MAX_USBFS_BULK_SIZE (16*1024)
+
+/* bulk transfers are cut into MAX_USBFS_BULK_SIZE chunks and up to
+** this many URBs are kept in flight per direction, so the bus never
+** sits idle between submit and reap.  ADB_USB_URB_DEPTH overrides.
+*/
+#define USB_URB_DEPTH_MAX 8
+
 static adb_mutex_t usb_lock = ADB_MUTEX_INITIALIZER;
 
 struct usb_handle
@@ -58,11 +63,13 @@ struct usb_handle
 
     unsigned zero_mask;
 
-    struct usbdevfs_urb urb_in;
-    struct usbdevfs_urb urb_out;
+    struct usburb {
+        struct usbdevfs_urb urb;
+        int busy;       /* owned by the kernel */
+        int xfer;       /* submitted length, to verify completions */
+    } in_urbs[USB_URB_DEPTH_MAX], out_urbs[USB_URB_DEPTH_MAX];
 
-    int urb_in_busy;
-    int urb_out_busy;
+    int reaping;        /* a thread is blocked in REAPURB */
     int dead;
 
     adb_cond_t notify;
@@ -75,6 +82,8 @@ struct usb_handle
     pthread_t reaper_thread;
 };
 
+typedef struct usburb usburb;
+
 static usb_handle handle_list = {
     .prev = &handle_list,
     .next = &handle_list,
@@ -125,319 +134,182 @@ static inline int badname(const char *name)
     return 0;
 }
 
-static int find_usb_device(const char *base,
-                           void (*register_device_callback) (const char *, unsigned char, unsigned char, int, const char *, unsigned))
+/* descriptor walk, serial fetch and reject caching live in
+** libusbhost; adb supplies a skip callback so devices it already has
+** open are never reopened (and get their liveness mark refreshed),
+** and notes each adb interface it is handed.
+*/
+static int skip_known_device(const char *dev_name, void *cookie)
 {
-    char busname[32], devname[32];
-    unsigned char local_ep_in, local_ep_out;
-    DIR *busdir , *devdir ;
-    struct dirent *de;
-    int fd ;
-    int found_device = 0;
-    char serial[256];
-
-    busdir = opendir(base);
-    if(busdir == 0) return 0;
-
-    while((de = readdir(busdir)) != 0) {
-        if(badname(de->d_name)) continue;
-
-        snprintf(busname, sizeof busname, "%s/%s", base, de->d_name);
-        devdir = opendir(busname);
-        if(devdir == 0) continue;
-
-//        DBGX("[ scanning %s ]\n", busname);
-        while((de = readdir(devdir))) {
-            unsigned char devdesc[256];
-            unsigned char* bufptr = devdesc;
-            struct usb_device_descriptor* device;
-            struct usb_config_descriptor* config;
-            struct usb_interface_descriptor* interface;
-            struct usb_endpoint_descriptor *ep1, *ep2;
-            unsigned zero_mask = 0;
-            unsigned vid, pid;
-            int i, interfaces;
-            size_t desclength;
-
-            if(badname(de->d_name)) continue;
-            snprintf(devname, sizeof devname, "%s/%s", busname, de->d_name);
-
-            if(known_device(devname)) {
-                DBGX("skipping %s\n", devname);
-                continue;
-            }
-
-//            DBGX("[ scanning %s ]\n", devname);
-            if((fd = unix_open(devname, O_RDWR)) < 0) {
-                continue;
-            }
-
-            desclength = adb_read(fd, devdesc, sizeof(devdesc));
-
-                // should have device and configuration descriptors, and atleast two endpoints
-            if (desclength < USB_DT_DEVICE_SIZE + USB_DT_CONFIG_SIZE) {
-                D("desclength %d is too small\n", desclength);
-                adb_close(fd);
-                continue;
-            }
-
-            device = (struct usb_device_descriptor*)bufptr;
-            bufptr += USB_DT_DEVICE_SIZE;
-
-            if((device->bLength != USB_DT_DEVICE_SIZE) || (device->bDescriptorType != USB_DT_DEVICE)) {
-                adb_close(fd);
-                continue;
-            }
-
-            vid = __le16_to_cpu(device->idVendor);
-            pid = __le16_to_cpu(device->idProduct);
-            pid = devdesc[10] | (devdesc[11] << 8);
-            DBGX("[ %s is V:%04x P:%04x ]\n", devname, vid, pid);
-
-                // should have config descriptor next
-            config = (struct usb_config_descriptor *)bufptr;
-            bufptr += USB_DT_CONFIG_SIZE;
-            if (config->bLength != USB_DT_CONFIG_SIZE || config->bDescriptorType != USB_DT_CONFIG) {
-                D("usb_config_descriptor not found\n");
-                adb_close(fd);
-                continue;
-            }
+    if(known_device(dev_name)) {
+        DBGX("skipping %s\n", dev_name);
+        return 1;
+    }
+    return 0;
+}
 
-                // loop through all the interfaces and look for the ADB interface
-            interfaces = config->bNumInterfaces;
-            for (i = 0; i < interfaces; i++) {
-                if (bufptr + USB_DT_ENDPOINT_SIZE > devdesc + desclength)
-                    break;
+static int adb_ifc_scan(usb_ifc_match *m, void *cookie)
+{
+    unsigned zero_mask = 0;
 
-                interface = (struct usb_interface_descriptor *)bufptr;
-                bufptr += USB_DT_INTERFACE_SIZE;
-                if (interface->bLength != USB_DT_INTERFACE_SIZE ||
-                    interface->bDescriptorType != USB_DT_INTERFACE) {
-                    D("usb_interface_descriptor not found\n");
-                    break;
-                }
+    if(!m->has_bulk_in || !m->has_bulk_out)
+        return USB_SCAN_CONTINUE;
 
-                DBGX("bInterfaceClass: %d,  bInterfaceSubClass: %d,"
-                     "bInterfaceProtocol: %d, bNumEndpoints: %d\n",
-                     interface->bInterfaceClass, interface->bInterfaceSubClass,
-                     interface->bInterfaceProtocol, interface->bNumEndpoints);
-
-                if (interface->bNumEndpoints == 2 &&
-                        is_adb_interface(vid, pid, interface->bInterfaceClass,
-                        interface->bInterfaceSubClass, interface->bInterfaceProtocol))  {
-
-                    DBGX("looking for bulk endpoints\n");
-                        // looks like ADB...
-                    ep1 = (struct usb_endpoint_descriptor *)bufptr;
-                    bufptr += USB_DT_ENDPOINT_SIZE;
-                    ep2 = (struct usb_endpoint_descriptor *)bufptr;
-                    bufptr += USB_DT_ENDPOINT_SIZE;
-
-                    if (bufptr > devdesc + desclength ||
-                        ep1->bLength != USB_DT_ENDPOINT_SIZE ||
-                        ep1->bDescriptorType != USB_DT_ENDPOINT ||
-                        ep2->bLength != USB_DT_ENDPOINT_SIZE ||
-                        ep2->bDescriptorType != USB_DT_ENDPOINT) {
-                        D("endpoints not found\n");
-                        break;
-                    }
-
-                        // both endpoints should be bulk
-                    if (ep1->bmAttributes != USB_ENDPOINT_XFER_BULK ||
-                        ep2->bmAttributes != USB_ENDPOINT_XFER_BULK) {
-                        D("bulk endpoints not found\n");
-                        continue;
-                    }
-
-                        /* aproto 01 needs 0 termination */
-                    if(interface->bInterfaceProtocol == 0x01) {
-                        zero_mask = ep1->wMaxPacketSize - 1;
-                    }
-
-                        // we have a match.  now we just need to figure out which is in and which is out.
-                    if (ep1->bEndpointAddress & USB_ENDPOINT_DIR_MASK) {
-                        local_ep_in = ep1->bEndpointAddress;
-                        local_ep_out = ep2->bEndpointAddress;
-                    } else {
-                        local_ep_in = ep2->bEndpointAddress;
-                        local_ep_out = ep1->bEndpointAddress;
-                    }
-
-                        // read the device's serial number
-                    serial[0] = 0;
-                    memset(serial, 0, sizeof(serial));
-                    if (device->iSerialNumber) {
-                        struct usbdevfs_ctrltransfer  ctrl;
-                        __u16 buffer[128];
-                        int result;
-
-                        memset(buffer, 0, sizeof(buffer));
-                        memset(&ctrl, 0, sizeof(ctrl));
-
-                        ctrl.bRequestType = USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE;
-                        ctrl.bRequest = USB_REQ_GET_DESCRIPTOR;
-                        ctrl.wValue = (USB_DT_STRING << 8) | device->iSerialNumber;
-                        ctrl.wIndex = 0;
-                        ctrl.wLength = sizeof(buffer);
-                        ctrl.data = buffer;
-
-                        result = ioctl(fd, USBDEVFS_CONTROL, &ctrl);
-                        if (result > 0) {
-                            int i;
-                                // skip first word, and copy the rest to the serial string, changing shorts to bytes.
-                            result /= 2;
-                            for (i = 1; i < result; i++)
-                                serial[i - 1] = buffer[i];
-                            serial[i - 1] = 0;
-                        }
-                    }
-
-                    register_device_callback(devname, local_ep_in, local_ep_out, i, serial, zero_mask);
-
-                    found_device = 1;
-                    break;
-                } else {
-                        // skip to next interface
-                    bufptr += (interface->bNumEndpoints * USB_DT_ENDPOINT_SIZE);
-                }
-            } // end of for
+    if(!is_adb_interface(m->dev_vendor, m->dev_product, m->ifc_class,
+                         m->ifc_subclass, m->ifc_protocol))
+        return USB_SCAN_CONTINUE;
 
-            adb_close(fd);
-        } // end of devdir while
-        closedir(devdir);
-    } //end of busdir while
-    closedir(busdir);
+        /* aproto 01 needs 0 termination */
+    if(m->ifc_protocol == 0x01)
+        zero_mask = m->ep_max_packet - 1;
 
-    return found_device;
+    register_device(m->dev_name, m->ep_in, m->ep_out, m->ifc_number,
+                    m->serial_number, zero_mask);
+    return USB_SCAN_MATCH;
 }
 
 void usb_cleanup()
 {
 }
 
-static int usb_bulk_write(usb_handle *h, const void *data, int len)
+static int usb_urb_depth(void)
 {
-    struct usbdevfs_urb *urb = &h->urb_out;
-    int res;
-
-    memset(urb, 0, sizeof(*urb));
-    urb->type = USBDEVFS_URB_TYPE_BULK;
-    urb->endpoint = h->ep_out;
-    urb->status = -1;
-    urb->buffer = (void*) data;
-    urb->buffer_length = len;
-
-    D("++ write ++\n");
+    static int depth = 0;
 
-    adb_mutex_lock(&h->lock);
-    if(h->dead) {
-        res = -1;
-        goto fail;
-    }
-    do {
-        res = ioctl(h->desc, USBDEVFS_SUBMITURB, urb);
-    } while((res < 0) && (errno == EINTR));
-
-    if(res < 0) {
-        goto fail;
+    if(depth == 0) {
+        char *env = getenv("ADB_USB_URB_DEPTH");
+        depth = env ? atoi(env) : USB_URB_DEPTH_MAX;
+        if(depth < 1) depth = 1;
+        if(depth > USB_URB_DEPTH_MAX) depth = USB_URB_DEPTH_MAX;
     }
-
-    res = -1;
-    h->urb_out_busy = 1;
-    for(;;) {
-        adb_cond_wait(&h->notify, &h->lock);
-        if(h->dead) {
-            break;
-        }
-        if(h->urb_out_busy == 0) {
-            if(urb->status == 0) {
-                res = urb->actual_length;
-            }
-            break;
-        }
-    }
-fail:
-    adb_mutex_unlock(&h->lock);
-    D("-- write --\n");
-    return res;
+    return depth;
 }
 
-static int usb_bulk_read(usb_handle *h, void *data, int len)
+/* wait until some URB completes and mark its slot.  h->lock must be
+** held.  only one thread sits in REAPURB at a time; others wait on
+** h->notify and recheck their own slot.  returns -1 once the handle
+** is dead.
+*/
+static int usb_wait_completion(usb_handle *h)
 {
-    struct usbdevfs_urb *urb = &h->urb_in;
     struct usbdevfs_urb *out = NULL;
-    int res;
-
-    memset(urb, 0, sizeof(*urb));
-    urb->type = USBDEVFS_URB_TYPE_BULK;
-    urb->endpoint = h->ep_in;
-    urb->status = -1;
-    urb->buffer = data;
-    urb->buffer_length = len;
+    int res, n;
 
+    if(h->reaping) {
+        adb_cond_wait(&h->notify, &h->lock);
+        return h->dead ? -1 : 0;
+    }
 
+    h->reaping = 1;
+    h->reaper_thread = pthread_self();
+    adb_mutex_unlock(&h->lock);
+    res = ioctl(h->desc, USBDEVFS_REAPURB, &out);
     adb_mutex_lock(&h->lock);
-    if(h->dead) {
-        res = -1;
-        goto fail;
+    h->reaper_thread = 0;
+    h->reaping = 0;
+
+    if(!h->dead && res >= 0) {
+        for(n = 0; n < USB_URB_DEPTH_MAX; n++) {
+            if(out == &h->in_urbs[n].urb || out == &h->out_urbs[n].urb) {
+                D("[ urb @%p status = %d, actual = %d ]\n",
+                  out, out->status, out->actual_length);
+                ((usburb*) out)->busy = 0;
+                break;
+            }
+        }
     }
-    do {
-        res = ioctl(h->desc, USBDEVFS_SUBMITURB, urb);
-    } while((res < 0) && (errno == EINTR));
+    adb_cond_broadcast(&h->notify);
 
-    if(res < 0) {
-        goto fail;
+    if(h->dead) return -1;
+    if((res < 0) && (errno != EINTR)) {
+        D("[ reap urb - error %d ]\n", errno);
+        return -1;
     }
+    return 0;
+}
 
-    h->urb_in_busy = 1;
-    for(;;) {
-        D("[ reap urb - wait ]\n");
-        h->reaper_thread = pthread_self();
-        adb_mutex_unlock(&h->lock);
-        res = ioctl(h->desc, USBDEVFS_REAPURB, &out);
-        adb_mutex_lock(&h->lock);
-        h->reaper_thread = 0;
-        if(h->dead) {
-            res = -1;
-            break;
-        }
-        if(res < 0) {
-            if(errno == EINTR) {
-                continue;
-            }
-            D("[ reap urb - error ]\n");
-            break;
+/* move 'len' bytes to or from 'data' on the given endpoint, pipelining
+** the MAX_USBFS_BULK_SIZE chunks across several in-flight URBs.
+** len == 0 submits a single zero-length transfer.  h->lock must be
+** held; it is released while waiting for completions.
+*/
+static int usb_bulk_io(usb_handle *h, unsigned char ep, void *_data, int len)
+{
+    usburb *slots = (ep == h->ep_in) ? h->in_urbs : h->out_urbs;
+    unsigned char *data = (unsigned char*) _data;
+    int depth = usb_urb_depth();
+    int remain = len;
+    int sub = 0, reap = 0, chunks;
+    int res;
+    usburb *u;
+
+    if(h->dead) return -1;
+
+    chunks = (len == 0) ? 1
+           : (len + MAX_USBFS_BULK_SIZE - 1) / MAX_USBFS_BULK_SIZE;
+
+    while(reap < chunks) {
+            /* keep the submission queue full */
+        while((sub < chunks) && ((sub - reap) < depth)) {
+            int xfer = (remain > MAX_USBFS_BULK_SIZE)
+                     ? MAX_USBFS_BULK_SIZE : remain;
+
+            u = &slots[sub % depth];
+            memset(&u->urb, 0, sizeof(u->urb));
+            u->urb.type = USBDEVFS_URB_TYPE_BULK;
+            u->urb.endpoint = ep;
+            u->urb.status = -1;
+            u->urb.buffer = data;
+            u->urb.buffer_length = xfer;
+            u->xfer = xfer;
+
+            do {
+                res = ioctl(h->desc, USBDEVFS_SUBMITURB, &u->urb);
+            } while((res < 0) && (errno == EINTR));
+            if(res < 0) goto fail;
+
+            u->busy = 1;
+            data += xfer;
+            remain -= xfer;
+            sub++;
         }
-        D("[ urb @%p status = %d, actual = %d ]\n",
-            out, out->status, out->actual_length);
-
-        if(out == &h->urb_in) {
-            D("[ reap urb - IN complete ]\n");
-            h->urb_in_busy = 0;
-            if(urb->status == 0) {
-                res = urb->actual_length;
-            } else {
-                res = -1;
-            }
-            break;
+
+            /* completions arrive in submission order: reap the oldest */
+        u = &slots[reap % depth];
+        while(u->busy) {
+            if(usb_wait_completion(h)) goto fail;
         }
-        if(out == &h->urb_out) {
-            D("[ reap urb - OUT compelete ]\n");
-            h->urb_out_busy = 0;
-            adb_cond_broadcast(&h->notify);
+        if((u->urb.status != 0) || (u->urb.actual_length != u->xfer)) {
+            D("[ bulk io - urb failed, status %d, actual %d/%d ]\n",
+              u->urb.status, u->urb.actual_length, u->xfer);
+            goto fail;
         }
+        reap++;
     }
+    return 0;
+
 fail:
-    adb_mutex_unlock(&h->lock);
-    return res;
+        /* the kernel may still own parts of the caller's buffer:
+        ** discard and reap everything before handing it back
+        */
+    while(reap < sub) {
+        u = &slots[reap % depth];
+        if(u->busy && !h->dead) {
+            ioctl(h->desc, USBDEVFS_DISCARDURB, &u->urb);
+            while(u->busy && !h->dead) {
+                if(usb_wait_completion(h)) break;
+            }
+        }
+        u->busy = 0;
+        reap++;
+    }
+    return -1;
 }
 
-
 int usb_write(usb_handle *h, const void *_data, int len)
 {
-    unsigned char *data = (unsigned char*) _data;
-    int n;
     int need_zero = 0;
+    int res;
 
     if(h->zero_mask) {
             /* if we need 0-markers and our transfer
@@ -449,62 +321,40 @@ int usb_write(usb_handle *h, const void *_data, int len)
         }
     }
 
-    while(len > 0) {
-        int xfer = (len > 4096) ? 4096 : len;
-
-        n = usb_bulk_write(h, data, xfer);
-        if(n != xfer) {
-            D("ERROR: n = %d, errno = %d (%s)\n",
-                n, errno, strerror(errno));
-            return -1;
-        }
-
-        len -= xfer;
-        data += xfer;
-    }
+    D("++ write ++\n");
+    adb_mutex_lock(&h->lock);
+    res = usb_bulk_io(h, h->ep_out, (void*) _data, len);
+    if((res == 0) && need_zero)
+        res = usb_bulk_io(h, h->ep_out, (void*) _data, 0);
+    adb_mutex_unlock(&h->lock);
+    D("-- write --\n");
 
-    if(need_zero){
-        n = usb_bulk_write(h, _data, 0);
-        return n;
+    if(res < 0) {
+        D("ERROR: usb_write, errno = %d (%s)\n", errno, strerror(errno));
+        return -1;
     }
-
     return 0;
 }
 
 int usb_read(usb_handle *h, void *_data, int len)
 {
-    unsigned char *data = (unsigned char*) _data;
-    int n;
+    int res;
 
     D("++ usb_read ++\n");
-    while(len > 0) {
-        int xfer = (len > 4096) ? 4096 : len;
-
-        D("[ usb read %d fd = %d], fname=%s\n", xfer, h->desc, h->fname);
-        n = usb_bulk_read(h, data, xfer);
-        D("[ usb read %d ] = %d, fname=%s\n", xfer, n, h->fname);
-        if(n != xfer) {
-            if((errno == ETIMEDOUT) && (h->desc != -1)) {
-                D("[ timeout ]\n");
-                if(n > 0){
-                    data += n;
-                    len -= n;
-                }
-                continue;
-            }
-            D("ERROR: n = %d, errno = %d (%s)\n",
-                n, errno, strerror(errno));
-            return -1;
-        }
+    adb_mutex_lock(&h->lock);
+    res = usb_bulk_io(h, h->ep_in, _data, len);
+    adb_mutex_unlock(&h->lock);
+    D("-- usb_read --\n");
 
-        len -= xfer;
-        data += xfer;
+    if(res < 0) {
+        D("ERROR: usb_read, errno = %d (%s)\n", errno, strerror(errno));
+        return -1;
     }
-
-    D("-- usb_read --\n");
     return 0;
 }
 
+
+
 void usb_kick(usb_handle *h)
 {
     D("[ kicking %p (fd = %d) ]\n", h, h->desc);
@@ -525,12 +375,18 @@ void usb_kick(usb_handle *h)
         ** but this ensures that a reader blocked on REAPURB
         ** will get unblocked
         */
-        ioctl(h->desc, USBDEVFS_DISCARDURB, &h->urb_in);
-        ioctl(h->desc, USBDEVFS_DISCARDURB, &h->urb_out);
-        h->urb_in.status = -ENODEV;
-        h->urb_out.status = -ENODEV;
-        h->urb_in_busy = 0;
-        h->urb_out_busy = 0;
+        {
+            int n;
+
+            for(n = 0; n < USB_URB_DEPTH_MAX; n++) {
+                ioctl(h->desc, USBDEVFS_DISCARDURB, &h->in_urbs[n].urb);
+                ioctl(h->desc, USBDEVFS_DISCARDURB, &h->out_urbs[n].urb);
+                h->in_urbs[n].urb.status = -ENODEV;
+                h->out_urbs[n].urb.status = -ENODEV;
+                h->in_urbs[n].busy = 0;
+                h->out_urbs[n].busy = 0;
+            }
+        }
         adb_cond_broadcast(&h->notify);
     }
     adb_mutex_unlock(&h->lock);
@@ -618,14 +474,133 @@ fail:
     free(usb);
 }
 
+static void kick_removed_device(const char *dev_name)
+{
+    usb_handle *usb;
+
+    adb_mutex_lock(&usb_lock);
+    for(usb = handle_list.next; usb != &handle_list; usb = usb->next){
+        if(!strcmp(usb->fname, dev_name)) {
+            usb_kick(usb);
+            break;
+        }
+    }
+    adb_mutex_unlock(&usb_lock);
+}
+
+/* one inotify watch per bus directory, so device node add/remove
+** (and the chmod udev applies after creation, hence IN_ATTRIB)
+** wakes the device thread
+*/
+#define USB_MAX_BUS_WATCHES 64
+
+static struct {
+    int wd;
+    char name[32];
+} bus_watches[USB_MAX_BUS_WATCHES];
+
+static void watch_usb_buses(int ifd, const char *base)
+{
+    DIR *busdir;
+    struct dirent *de;
+    char busname[32];
+    int n, wd;
+
+    busdir = opendir(base);
+    if(busdir == 0) return;
+
+    while((de = readdir(busdir)) != 0) {
+        if(badname(de->d_name)) continue;
+        snprintf(busname, sizeof busname, "%s/%s", base, de->d_name);
+
+        wd = inotify_add_watch(ifd, busname,
+                               IN_CREATE | IN_DELETE | IN_ATTRIB);
+        if(wd < 0) continue;
+
+            /* re-adding an already watched directory returns the
+            ** same wd, so duplicates never reach an empty slot
+            */
+        for(n = 0; n < USB_MAX_BUS_WATCHES; n++) {
+            if(bus_watches[n].wd == wd) break;
+            if(bus_watches[n].wd == 0) {
+                bus_watches[n].wd = wd;
+                snprintf(bus_watches[n].name, sizeof(bus_watches[n].name),
+                         "%s", busname);
+                break;
+            }
+        }
+    }
+    closedir(busdir);
+}
+
 void* device_poll_thread(void* unused)
 {
+    char evbuf[4096], devname[64];
+    struct inotify_event *event;
+    char *p;
+    int ifd, n, i;
+
     D("Created device thread\n");
+
+    ifd = inotify_init();
+    if(ifd >= 0 &&
+       inotify_add_watch(ifd, "/dev/bus/usb", IN_CREATE | IN_DELETE) < 0) {
+        adb_close(ifd);
+        ifd = -1;
+    }
+
     for(;;) {
-            /* XXX use inotify */
-        find_usb_device("/dev/bus/usb", register_device);
+        if(ifd >= 0)
+            watch_usb_buses(ifd, "/dev/bus/usb");
+            /* known devices are skipped before their nodes are even
+            ** opened, so a rescan only reads the new descriptors
+            */
+        usb_host_scan("/dev/bus/usb", skip_known_device, adb_ifc_scan, 0);
         kick_disconnected_devices();
-        sleep(1);
+
+        if(ifd < 0) {
+                /* no inotify: fall back to the 1 second rescan */
+            sleep(1);
+            continue;
+        }
+
+        n = adb_read(ifd, evbuf, sizeof(evbuf));
+        if(n < (int) sizeof(*event)) {
+            if(n < 0 && errno == EINTR) continue;
+            D("inotify read failed: %s, falling back to polling\n",
+              strerror(errno));
+            adb_close(ifd);
+            ifd = -1;
+            continue;
+        }
+
+        for(p = evbuf; p < evbuf + n; p += sizeof(*event) + event->len) {
+            event = (struct inotify_event*) p;
+
+            if(event->mask & IN_IGNORED) {
+                    /* the bus directory itself went away */
+                for(i = 0; i < USB_MAX_BUS_WATCHES; i++) {
+                    if(bus_watches[i].wd == event->wd)
+                        bus_watches[i].wd = 0;
+                }
+                continue;
+            }
+            if(event->len == 0 || badname(event->name)) continue;
+            if(!(event->mask & IN_DELETE) || (event->mask & IN_ISDIR))
+                continue;
+
+                /* a device node disappeared: kick its transport now
+                ** instead of waiting for the next I/O to fail
+                */
+            for(i = 0; i < USB_MAX_BUS_WATCHES; i++) {
+                if(bus_watches[i].wd == event->wd) {
+                    snprintf(devname, sizeof devname, "%s/%s",
+                             bus_watches[i].name, event->name);
+                    kick_removed_device(devname);
+                    break;
+                }
+            }
+        }
     }
     return NULL;
 }
@@ -6,6 +6,8 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
 	mkbootfs.c
 
+LOCAL_LDLIBS := -lz -lpthread
+
 LOCAL_MODULE := mkbootfs
 
 include $(BUILD_HOST_EXECUTABLE)
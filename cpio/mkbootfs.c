@@ -10,6 +10,9 @@
 
 #include <stdarg.h>
 #include <fcntl.h>
+#include <pthread.h>
+
+#include <zlib.h>
 
 #include <private/android_filesystem_config.h>
 
@@ -20,6 +23,14 @@
 ** - dotfiles are ignored
 ** - directories named 'root' are ignored
 ** - device notes, pipes, etc are not supported (error)
+**
+** With -z the archive is gzipped on the way out.  Every entry is
+** deflated as an independent block ending in a full flush, so blocks
+** can be compressed in parallel and glued together into one ordinary
+** gzip stream (the trailer crc is stitched with crc32_combine).
+** With -c <dir> the compressed blocks of large files are cached,
+** keyed by the entry header and mtime, so an incremental rebuild only
+** compresses what actually changed.
 */
 
 void die(const char *why, ...)
@@ -35,30 +46,92 @@ void die(const char *why, ...)
 }
 
 static int verbose = 0;
-static int total_size = 0;
+static int do_gzip = 0;
+static const char *cache_dir = 0;
+static unsigned total_size = 0;
+
+// entries below this size aren't worth a cache file
+#define CACHE_MIN 4096
+
+#define CACHE_MAGIC 0x4d424643  /* 'MBFC' */
+
+struct cache_entry {
+    unsigned magic;
+    unsigned rawlen;
+    unsigned crc;
+    unsigned zlen;
+    /* zlen bytes of deflated block follow */
+};
+
+// one archive member: encoded raw bytes, and after the compression
+// pass (or a cache hit) the deflated block that stands in for them
+typedef struct segment {
+    unsigned char *data;
+    unsigned len;
+    unsigned cap;
+
+    unsigned rawlen;        // length the block expands back to
+    unsigned crc;           // crc32 of the raw block
+    unsigned char *zdata;
+    unsigned zlen;
+    char *ckey;             // cache file, when cacheable
+    int from_cache;
+} segment_t;
+
+static segment_t **segments = 0;
+static int nr_segments = 0;
+static int segments_cap = 0;
+static segment_t *cur = 0;
+
+static void seg_begin(void)
+{
+    segment_t *s = calloc(1, sizeof(segment_t));
+
+    if(s == 0) die("out of memory");
+    if(nr_segments == segments_cap) {
+        segments_cap = segments_cap ? segments_cap * 2 : 256;
+        segments = realloc(segments, segments_cap * sizeof(segment_t*));
+        if(segments == 0) die("out of memory");
+    }
+    segments[nr_segments++] = s;
+    cur = s;
+}
+
+static void seg_put(const void *data, unsigned len)
+{
+    if(cur->len + len > cur->cap) {
+        cur->cap = cur->cap ? cur->cap * 2 : 512;
+        while(cur->len + len > cur->cap) cur->cap *= 2;
+        cur->data = realloc(cur->data, cur->cap);
+        if(cur->data == 0) die("out of memory");
+    }
+    memcpy(cur->data + cur->len, data, len);
+    cur->len += len;
+}
+
+static void seg_pad4(void)
+{
+    static const char zero[4] = { 0, 0, 0, 0 };
+
+    if(cur->len & 3) seg_put(zero, 4 - (cur->len & 3));
+}
 
 static void fix_stat(const char *path, struct stat *s)
 {
     fs_config(path, S_ISDIR(s->st_mode), &s->st_uid, &s->st_gid, &s->st_mode);
 }
 
-static void _eject(struct stat *s, char *out, int olen, char *data, unsigned datasize)
+static void emit_header(struct stat *s, const char *out, int olen, unsigned datasize)
 {
     // Nothing is special about this value, just picked something in the
     // approximate range that was being used already, and avoiding small
     // values which may be special.
     static unsigned next_inode = 300000;
+    char hdr[120];
 
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
-    }
-
-    fix_stat(out, s);
-//    fprintf(stderr, "_eject %s: mode=0%o\n", out, s->st_mode);
-
-    printf("%06x%08x%08x%08x%08x%08x%08x"
-           "%08x%08x%08x%08x%08x%08x%08x%s%c",
+    sprintf(hdr,
+           "%06x%08x%08x%08x%08x%08x%08x"
+           "%08x%08x%08x%08x%08x%08x%08x",
            0x070701,
            next_inode++,  //  s.st_ino,
            s->st_mode,
@@ -72,36 +145,137 @@ static void _eject(struct stat *s, char *out, int olen, char *data, unsigned dat
            0, // devmajor
            0, // devminor,
            olen + 1,
-           0,
-           out,
            0
            );
 
-    total_size += 6 + 8*13 + olen + 1;
+    seg_put(hdr, 6 + 8*13);
+    seg_put(out, olen + 1);
+    seg_pad4();
 
-    if(strlen(out) != olen) die("ACK!");
+    if(((int) strlen(out)) != olen) die("ACK!");
+}
 
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
+// cache file for this entry: the name keeps things greppable, the key
+// crc covers the entry header (mode, size, inode, path) and the mtime
+static char *cache_key(const char *out, struct stat *s)
+{
+    char name[64];
+    unsigned long key;
+    char *ckey;
+    unsigned n;
+
+    key = crc32(0, cur->data, cur->len);
+    key = crc32(key, (void*) &s->st_mtime, sizeof(s->st_mtime));
+
+    strncpy(name, out, sizeof(name) - 1);
+    name[sizeof(name) - 1] = 0;
+    for(n = 0; name[n]; n++) {
+        if(name[n] == '/') name[n] = '_';
+    }
+
+    ckey = malloc(strlen(cache_dir) + sizeof(name) + 16);
+    if(ckey == 0) die("out of memory");
+    sprintf(ckey, "%s/%s-%08lx", cache_dir, name, key);
+    return ckey;
+}
+
+// pull a previously compressed block in; the raw data never gets
+// read or deflated on a hit
+static int cache_load(segment_t *s)
+{
+    struct cache_entry e;
+    int fd;
+
+    fd = open(s->ckey, O_RDONLY);
+    if(fd < 0) return 0;
+
+    if(read(fd, &e, sizeof(e)) != sizeof(e) || e.magic != CACHE_MAGIC) {
+        close(fd);
+        return 0;
+    }
+
+    s->zdata = malloc(e.zlen);
+    if(s->zdata == 0) die("out of memory");
+    if(read(fd, s->zdata, e.zlen) != ((int) e.zlen)) {
+        free(s->zdata);
+        s->zdata = 0;
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    s->zlen = e.zlen;
+    s->rawlen = e.rawlen;
+    s->crc = e.crc;
+    s->from_cache = 1;
+    return 1;
+}
+
+static void cache_store(segment_t *s)
+{
+    struct cache_entry e;
+    char *tmp;
+    int fd;
+
+    tmp = malloc(strlen(s->ckey) + 16);
+    if(tmp == 0) die("out of memory");
+    sprintf(tmp, "%s.%d", s->ckey, getpid());
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        free(tmp);
+        return;
     }
 
+    e.magic = CACHE_MAGIC;
+    e.rawlen = s->rawlen;
+    e.crc = s->crc;
+    e.zlen = s->zlen;
+
+    if(write(fd, &e, sizeof(e)) != sizeof(e) ||
+       write(fd, s->zdata, s->zlen) != ((int) s->zlen)) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return;
+    }
+    close(fd);
+
+    rename(tmp, s->ckey);
+    free(tmp);
+}
+
+static void _eject(struct stat *s, char *out, int olen, char *data, unsigned datasize)
+{
+    seg_begin();
+
+    fix_stat(out, s);
+//    fprintf(stderr, "_eject %s: mode=0%o\n", out, s->st_mode);
+
+    emit_header(s, out, olen, datasize);
+
     if(datasize) {
-        fwrite(data, datasize, 1, stdout);
-        total_size += datasize;
+        seg_put(data, datasize);
+        seg_pad4();
     }
+
+    cur->rawlen = cur->len;
+    total_size += cur->len;
 }
 
 static void _eject_trailer()
 {
+    static const char zero[4] = { 0, 0, 0, 0 };
     struct stat s;
+
     memset(&s, 0, sizeof(s));
     _eject(&s, "TRAILER!!!", 10, 0, 0);
 
     while(total_size & 0xff) {
+        seg_put(zero, 1);
         total_size++;
-        putchar(0);
     }
+    cur->rawlen = cur->len;
 }
 
 static void _archive(char *in, char *out, int ilen, int olen);
@@ -196,6 +370,40 @@ static void _archive(char *in, char *out, int ilen, int olen)
         char *tmp;
         int fd;
 
+        if(do_gzip && cache_dir && s.st_size >= CACHE_MIN) {
+            seg_begin();
+            fix_stat(out, &s);
+            emit_header(&s, out, olen, s.st_size);
+            cur->ckey = cache_key(out, &s);
+
+            if(cache_load(cur)) {
+                // raw bytes of a hit are never needed again
+                free(cur->data);
+                cur->data = 0;
+                total_size += cur->rawlen;
+                return;
+            }
+
+            fd = open(in, O_RDONLY);
+            if(fd < 0) die("cannot open '%s' for read", in);
+
+            tmp = (char*) malloc(s.st_size);
+            if(tmp == 0) die("cannot allocate %d bytes", s.st_size);
+
+            if(read(fd, tmp, s.st_size) != s.st_size) {
+                die("cannot read %d bytes", s.st_size);
+            }
+
+            seg_put(tmp, s.st_size);
+            seg_pad4();
+            cur->rawlen = cur->len;
+            total_size += cur->len;
+
+            free(tmp);
+            close(fd);
+            return;
+        }
+
         fd = open(in, O_RDONLY);
         if(fd < 0) die("cannot open '%s' for read", in);
 
@@ -235,11 +443,155 @@ void archive(const char *start, const char *prefix)
     _archive_dir(in, out, strlen(in), strlen(out));
 }
 
+// deflate one block, independent of its neighbours: a fresh raw
+// stream ended with a full flush has no final bit and no dangling
+// references, so the blocks concatenate into one valid stream
+static void compress_segment(segment_t *s)
+{
+    z_stream z;
+    unsigned cap;
+
+    memset(&z, 0, sizeof(z));
+    if(deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK) {
+        die("deflateInit2 failed");
+    }
+
+    cap = deflateBound(&z, s->len) + 16;
+    s->zdata = malloc(cap);
+    if(s->zdata == 0) die("out of memory");
+
+    z.next_in = s->data;
+    z.avail_in = s->len;
+    z.next_out = s->zdata;
+    z.avail_out = cap;
+
+    if(deflate(&z, Z_FULL_FLUSH) != Z_OK || z.avail_in != 0) {
+        die("deflate failed");
+    }
+    s->zlen = cap - z.avail_out;
+    deflateEnd(&z);
+
+    s->crc = crc32(crc32(0, 0, 0), s->data, s->len);
+}
+
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_work = 0;
+
+static void *compress_worker(void *arg)
+{
+    for(;;) {
+        segment_t *s;
+        int n;
+
+        pthread_mutex_lock(&work_lock);
+        n = next_work++;
+        pthread_mutex_unlock(&work_lock);
+        if(n >= nr_segments) return 0;
+
+        s = segments[n];
+        if(s->zdata == 0) compress_segment(s);
+    }
+}
+
+static void output_gzip(void)
+{
+    static const unsigned char gzhdr[10] =
+        { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+    unsigned char tail[10];
+    unsigned long crc;
+    unsigned long isize = 0;
+    unsigned ztail;
+    z_stream z;
+    int nthreads;
+    int n;
+
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads < 1) nthreads = 1;
+    if(nthreads > 8) nthreads = 8;
+
+    {
+        pthread_t threads[8];
+        for(n = 0; n < nthreads; n++) {
+            if(pthread_create(&threads[n], NULL, compress_worker, NULL)) {
+                threads[n] = 0;
+            }
+        }
+        for(n = 0; n < nthreads; n++) {
+            if(threads[n]) pthread_join(threads[n], NULL);
+        }
+        // anything the workers didn't reach (they may have failed to
+        // spawn entirely) gets compressed here
+        for(n = 0; n < nr_segments; n++) {
+            if(segments[n]->zdata == 0) compress_segment(segments[n]);
+        }
+    }
+
+    fwrite(gzhdr, sizeof(gzhdr), 1, stdout);
+
+    crc = crc32(0, 0, 0);
+    for(n = 0; n < nr_segments; n++) {
+        segment_t *s = segments[n];
+
+        fwrite(s->zdata, s->zlen, 1, stdout);
+        crc = crc32_combine(crc, s->crc, s->rawlen);
+        isize += s->rawlen;
+
+        if(s->ckey && !s->from_cache) cache_store(s);
+    }
+
+    // an empty block with the final bit set closes the stream
+    memset(&z, 0, sizeof(z));
+    if(deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK) {
+        die("deflateInit2 failed");
+    }
+    z.next_out = tail;
+    z.avail_out = sizeof(tail);
+    if(deflate(&z, Z_FINISH) != Z_STREAM_END) die("deflate failed");
+    ztail = sizeof(tail) - z.avail_out;
+    deflateEnd(&z);
+    fwrite(tail, ztail, 1, stdout);
+
+    tail[0] = crc;
+    tail[1] = crc >> 8;
+    tail[2] = crc >> 16;
+    tail[3] = crc >> 24;
+    tail[4] = isize;
+    tail[5] = isize >> 8;
+    tail[6] = isize >> 16;
+    tail[7] = isize >> 24;
+    fwrite(tail, 8, 1, stdout);
+}
+
+static void output_raw(void)
+{
+    int n;
+
+    for(n = 0; n < nr_segments; n++) {
+        fwrite(segments[n]->data, segments[n]->len, 1, stdout);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     argc--;
     argv++;
 
+    while(argc > 0 && argv[0][0] == '-') {
+        if(!strcmp(*argv, "-z")) {
+            do_gzip = 1;
+            argc--;
+            argv++;
+        } else if(!strcmp(*argv, "-c") && argc > 1) {
+            cache_dir = argv[1];
+            argc -= 2;
+            argv += 2;
+        } else {
+            die("usage: mkbootfs [-z] [-c cachedir] <dir>[=<prefix>] ...");
+        }
+    }
+
     if(argc == 0) die("no directories to process?!");
 
     while(argc-- > 0){
@@ -257,5 +609,11 @@ int main(int argc, char *argv[])
 
     _eject_trailer();
 
+    if(do_gzip) {
+        output_gzip();
+    } else {
+        output_raw();
+    }
+
     return 0;
 }
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <pthread.h>
 #include <stdarg.h>
@@ -30,6 +31,8 @@
 #include <sys/wait.h>
 #include <sys/exec_elf.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
 
 #include <cutils/sockets.h>
 #include <cutils/logd.h>
@@ -54,11 +57,22 @@ static int logsocket = -1;
 
 #define ANDROID_LOG_INFO 4
 
+/* While the crashed process is held under ptrace the report is composed
+ * into this preallocated buffer instead of being written out; the flash
+ * writes happen in commit_tombstone() once the process is detached, so
+ * a crash storm no longer serializes every victim on storage.
+ * Pass TOMBSTONE_BUFFER_FD as tfd while capturing.
+ */
+#define TOMBSTONE_BUFFER_FD INT_MAX
+#define TOMBSTONE_MAX (64*1024)
+static char tombstone_buf[TOMBSTONE_MAX];
+static int tombstone_len = -1;      /* -1: not capturing */
+
 /* Log information onto the tombstone */
 void _LOG(int tfd, bool in_tombstone_only, const char *fmt, ...)
 {
     char buf[128];
-    
+
     va_list ap;
     va_start(ap, fmt);
 
@@ -66,7 +80,14 @@ void _LOG(int tfd, bool in_tombstone_only, const char *fmt, ...)
         int len;
         vsnprintf(buf, sizeof(buf), fmt, ap);
         len = strlen(buf);
-        if(tfd >= 0) write(tfd, buf, len);
+        if (tfd == TOMBSTONE_BUFFER_FD && tombstone_len >= 0) {
+            if (len > TOMBSTONE_MAX - tombstone_len)
+                len = TOMBSTONE_MAX - tombstone_len;
+            memcpy(tombstone_buf + tombstone_len, buf, len);
+            tombstone_len += len;
+        } else {
+            write(tfd, buf, len);
+        }
     }
 
     if (!in_tombstone_only)
@@ -100,7 +121,7 @@ mapinfo *parse_maps_line(char *line)
     
     mi->start = strtoul(line, 0, 16);
     mi->end = strtoul(line + 9, 0, 16);
-    /* To be filled in parse_exidx_info if the mapped section starts with 
+    /* To be filled in parse_exidx_info if the mapped section starts with
      * elf_header
      */
     mi->exidx_start = mi->exidx_end = 0;
@@ -110,6 +131,38 @@ mapinfo *parse_maps_line(char *line)
     return mi;
 }
 
+/* Parse /proc/<pid>/maps once; the result is shared by every thread we
+ * dump, so there is no point doing it again per sibling.
+ */
+static mapinfo *parse_process_maps(unsigned pid)
+{
+    char data[1024];
+    FILE *fp;
+    mapinfo *milist = 0;
+
+    sprintf(data, "/proc/%d/maps", pid);
+    fp = fopen(data, "r");
+    if(fp) {
+        while(fgets(data, 1024, fp)) {
+            mapinfo *mi = parse_maps_line(data);
+            if(mi) {
+                mi->next = milist;
+                milist = mi;
+            }
+        }
+        fclose(fp);
+    }
+    return milist;
+}
+
+static unsigned long long msec_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
 void dump_build_info(int tfd)
 {
     char fingerprint[PROPERTY_VALUE_MAX];
@@ -155,7 +208,7 @@ void dump_stack_and_code(int tfd, int pid, mapinfo *map,
 
         _LOG(tfd, true, " %08x  ", p);
         for (i = 0; i < 4; i++) {
-            data = ptrace(PTRACE_PEEKTEXT, pid, (void*)p, NULL);
+            data = get_remote_word(pid, (void*)p);
             _LOG(tfd, true, " %08x", data);
             p += 4;
         }
@@ -190,9 +243,9 @@ void dump_stack_and_code(int tfd, int pid, mapinfo *map,
     }
 
     while (p <= end) {
-         char *prompt; 
+         char *prompt;
          char level[16];
-         data = ptrace(PTRACE_PEEKTEXT, pid, (void*)p, NULL);
+         data = get_remote_word(pid, (void*)p);
          if (p == sp_list[sp_depth]) {
              sprintf(level, "#%02d", sp_depth++);
              prompt = level;
@@ -213,7 +266,7 @@ void dump_stack_and_code(int tfd, int pid, mapinfo *map,
 
     end = p+64;
     while (p <= end) {
-         data = ptrace(PTRACE_PEEKTEXT, pid, (void*)p, NULL);
+         data = get_remote_word(pid, (void*)p);
          _LOG(tfd, (sp_depth > 2) || only_in_tombstone, 
               "    %08x  %08x  %s\n", p, data, 
               map_to_name(map, data, ""));
@@ -330,7 +383,7 @@ static void parse_exidx_info(mapinfo *milist, pid_t pid)
             ptr = (Elf32_Phdr *) (mi->start + ehdr.e_phoff);
             for (i = 0; i < ehdr.e_phnum; i++) {
                 /* Parse the program header */
-                get_remote_struct(pid, (void *) ptr+i, &phdr, 
+                get_remote_struct(pid, (void *) (ptr+i), &phdr,
                                   sizeof(Elf32_Phdr));
                 /* Found a EXIDX segment? */
                 if (phdr.p_type == PT_ARM_EXIDX) {
@@ -343,41 +396,27 @@ static void parse_exidx_info(mapinfo *milist, pid_t pid)
     }
 }
 
-void dump_crash_report(int tfd, unsigned pid, unsigned tid, bool at_fault)
+void dump_crash_report(int tfd, unsigned pid, unsigned tid, mapinfo *milist,
+                       bool at_fault)
 {
-    char data[1024];
-    FILE *fp;
-    mapinfo *milist = 0;
     unsigned int sp_list[STACK_CONTENT_DEPTH];
     int stack_depth;
     int frame0_pc_sane = 1;
-    
+
     if (!at_fault) {
         _LOG(tfd, true,
          "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
         _LOG(tfd, true, "pid: %d, tid: %d\n", pid, tid);
     }
 
-    dump_registers(tfd, tid, at_fault);
-    
+    /* For the thread at fault the registers already went into the log
+     * from the fast pass in engrave_tombstone; don't log them twice.
+     */
+    dump_registers(tfd, tid, false);
+
     /* Clear stack pointer records */
     memset(sp_list, 0, sizeof(sp_list));
 
-    sprintf(data, "/proc/%d/maps", pid);
-    fp = fopen(data, "r");
-    if(fp) {
-        while(fgets(data, 1024, fp)) {
-            mapinfo *mi = parse_maps_line(data);
-            if(mi) {
-                mi->next = milist;
-                milist = mi;
-            }
-        }
-        fclose(fp);
-    }
-
-    parse_exidx_info(milist, tid);
-
     /* If stack unwinder fails, use the default solution to dump the stack
      * content.
      */
@@ -393,12 +432,6 @@ void dump_crash_report(int tfd, unsigned pid, unsigned tid, bool at_fault)
 
     dump_stack_and_code(tfd, tid, milist, stack_depth, sp_list, frame0_pc_sane,
                         at_fault);
-
-    while(milist) {
-        mapinfo *next = milist->next;
-        free(milist);
-        milist = next;
-    }
 }
 
 /* FIXME: unused: use it or lose it*/
@@ -495,8 +528,114 @@ static int find_and_open_tombstone(void)
     return fd;
 }
 
+/* Persistent ring of the last few raw dumps, memory mapped under the
+ * tombstone directory. Recording a crash is a couple of memcpys into
+ * the mapping -- the kernel writes the pages back on its own time --
+ * so back-to-back crashes don't serialize on flash, and the raw state
+ * of the most recent ones survives a reboot even if the formatted
+ * tombstone never got written.
+ */
+#define CRASH_RING_PATH  TOMBSTONE_DIR "/crash-ring"
+#define CRASH_RING_MAGIC 0x68737263
+#define CRASH_RING_SLOTS 16
+#define CRASH_RING_STACK 2048
+
+struct crash_record {
+    unsigned magic;
+    unsigned seq;
+    unsigned pid, tid;
+    unsigned signal;
+    unsigned long long when;
+    struct pt_regs regs;
+    unsigned stack_base;
+    unsigned char stack[CRASH_RING_STACK];
+};
+
+static struct crash_record *crash_ring;
+static unsigned crash_ring_seq;
+
+static void map_crash_ring(void)
+{
+    int fd, i;
+
+    mkdir(TOMBSTONE_DIR, 0755);
+    fd = open(CRASH_RING_PATH, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return;
+    fchown(fd, AID_SYSTEM, AID_SYSTEM);
+    if (ftruncate(fd, CRASH_RING_SLOTS * sizeof(struct crash_record))) {
+        close(fd);
+        return;
+    }
+    crash_ring = mmap(0, CRASH_RING_SLOTS * sizeof(struct crash_record),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (crash_ring == MAP_FAILED) {
+        crash_ring = NULL;
+        return;
+    }
+    /* pick up the sequence where the previous incarnation left off */
+    for (i = 0; i < CRASH_RING_SLOTS; i++) {
+        if (crash_ring[i].magic == CRASH_RING_MAGIC &&
+            crash_ring[i].seq >= crash_ring_seq) {
+            crash_ring_seq = crash_ring[i].seq + 1;
+        }
+    }
+}
+
+static void record_crash_raw(unsigned pid, unsigned tid, int signal)
+{
+    struct crash_record *cr;
+
+    if (crash_ring == NULL) return;
+    cr = &crash_ring[crash_ring_seq % CRASH_RING_SLOTS];
+    cr->magic = 0;
+    cr->seq = crash_ring_seq++;
+    cr->pid = pid;
+    cr->tid = tid;
+    cr->signal = signal;
+    cr->when = msec_now();
+    memset(&cr->regs, 0, sizeof(cr->regs));
+    cr->stack_base = 0;
+    if (ptrace(PTRACE_GETREGS, tid, 0, &cr->regs) == 0) {
+        cr->stack_base = cr->regs.ARM_sp & ~3;
+        get_remote_struct(tid, (void *) cr->stack_base, cr->stack,
+                          sizeof(cr->stack));
+    }
+    cr->magic = CRASH_RING_MAGIC;
+    msync(cr, sizeof(*cr), MS_ASYNC);
+}
+
+/* Phase two: write the report captured in tombstone_buf out to a
+ * tombstone file, after the crashed process has been detached.
+ */
+static void commit_tombstone(void)
+{
+    int fd;
+
+    if (tombstone_len < 0) return;
+
+    mkdir(TOMBSTONE_DIR, 0755);
+    chown(TOMBSTONE_DIR, AID_SYSTEM, AID_SYSTEM);
+
+    fd = find_and_open_tombstone();
+    if (fd >= 0) {
+        write(fd, tombstone_buf, tombstone_len);
+        close(fd);
+    }
+    tombstone_len = -1;
+}
+
+/* Total time the crashed process is allowed to stay frozen for the dump.
+ * Once it is used up we stop dumping sibling threads: the thread at
+ * fault is on file by then, and holding everything stopped for seconds
+ * sets off watchdogs in services blocked on the dying process.
+ */
+#define DUMP_BUDGET_MS 2000
+
 /* Return true if some thread is not detached cleanly */
-static bool dump_sibling_thread_report(int tfd, unsigned pid, unsigned tid)
+static bool dump_sibling_thread_report(int tfd, unsigned pid, unsigned tid,
+                                       mapinfo *milist,
+                                       unsigned long long started)
 {
     char task_path[1024];
 
@@ -514,18 +653,23 @@ static bool dump_sibling_thread_report(int tfd, unsigned pid, unsigned tid)
     while ((de = readdir(d)) != NULL) {
         unsigned new_tid;
         /* Ignore "." and ".." */
-        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) 
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
             continue;
         new_tid = atoi(de->d_name);
         /* The main thread at fault has been handled individually */
         if (new_tid == tid)
             continue;
 
+        if (msec_now() - started > DUMP_BUDGET_MS) {
+            _LOG(tfd, false, "dump budget exhausted, skipping remaining threads\n");
+            break;
+        }
+
         /* Skip this thread if cannot ptrace it */
         if (ptrace(PTRACE_ATTACH, new_tid, 0, 0) < 0)
             continue;
 
-        dump_crash_report(tfd, pid, new_tid, false);
+        dump_crash_report(tfd, pid, new_tid, milist, false);
         need_cleanup |= ptrace(PTRACE_DETACH, new_tid, 0, 0);
     }
     closedir(d);
@@ -533,30 +677,49 @@ static bool dump_sibling_thread_report(int tfd, unsigned pid, unsigned tid)
 }
 
 /* Return true if some thread is not detached cleanly */
-static bool engrave_tombstone(unsigned pid, unsigned tid, int debug_uid, 
+static bool engrave_tombstone(unsigned pid, unsigned tid, int debug_uid,
                               int signal)
 {
-    int fd;
     bool need_cleanup = false;
+    mapinfo *milist;
+    unsigned long long started = msec_now();
 
-    mkdir(TOMBSTONE_DIR, 0755);
-    chown(TOMBSTONE_DIR, AID_SYSTEM, AID_SYSTEM);
+    init_remote_reader(tid);
+    milist = parse_process_maps(pid);
 
-    fd = find_and_open_tombstone();
-    if (fd < 0)
-        return need_cleanup;
+    /* Get the vital information into the log right away, before the
+     * full dump (exidx parsing, stack contents, sibling threads) takes
+     * its time; triage usually only needs these first few lines.
+     */
+    dump_registers(-1, tid, true);
+    dump_pc_and_lr(-1, tid, milist, 0, true);
 
-    dump_crash_banner(fd, pid, tid, signal);
-    dump_crash_report(fd, pid, tid, true);
-    /* 
-     * If the user has requested to attach gdb, don't collect the per-thread
-     * information as it increases the chance to lose track of the process.
+    record_crash_raw(pid, tid, signal);
+
+    parse_exidx_info(milist, tid);
+
+    /* Phase one: compose the report in memory; commit_tombstone() puts
+     * it on flash once the process has been detached.
+     */
+    tombstone_len = 0;
+    dump_crash_banner(TOMBSTONE_BUFFER_FD, pid, tid, signal);
+    dump_crash_report(TOMBSTONE_BUFFER_FD, pid, tid, milist, true);
+    /*
+     * If the user has requested to attach gdb, don't collect the
+     * per-thread information as it increases the chance to lose track
+     * of the process.
      */
     if ((signed)pid > debug_uid) {
-        need_cleanup = dump_sibling_thread_report(fd, pid, tid);
+        need_cleanup = dump_sibling_thread_report(TOMBSTONE_BUFFER_FD, pid,
+                                                  tid, milist, started);
     }
 
-    close(fd);
+    while(milist) {
+        mapinfo *next = milist->next;
+        free(milist);
+        milist = next;
+    }
+    uninit_remote_reader();
     return need_cleanup;
 }
 
@@ -785,6 +948,10 @@ done:
         need_cleanup |= (detach_status != 0);
     }
 
+    /* now that nothing is held under ptrace any more, put the captured
+     * report on flash */
+    commit_tombstone();
+
     /*
      * if debug.db.uid is set, its value indicates if we should wait
      * for user action for the crashing process.
@@ -822,6 +989,8 @@ int main(int argc, char **argv)
         fcntl(logsocket, F_SETFD, FD_CLOEXEC);
     }
 
+    map_crash_ring();
+
     act.sa_handler = SIG_DFL;
     sigemptyset(&act.sa_mask);
     sigaddset(&act.sa_mask,SIGCHLD);
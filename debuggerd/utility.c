@@ -18,22 +18,63 @@
 #include <sys/ptrace.h>
 #include <sys/exec_elf.h>
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "utility.h"
 
-/* Get a word from pid using ptrace. The result is the return value. */
-int get_remote_word(int pid, void *src)
+/* Reading the crashed process one word per PTRACE_PEEKTEXT gets very
+** expensive on deep stacks, and the process (and everything waiting on
+** its locks) stays frozen the whole time.  When possible we read through
+** /proc/<pid>/mem instead, a page at a time, and serve repeated requests
+** out of the cached page.  ptrace remains as the fallback.
+*/
+static int remote_fd = -1;
+static unsigned remote_base;
+static int remote_valid;
+static unsigned char remote_page[4096];
+
+void init_remote_reader(int pid)
 {
-    return ptrace(PTRACE_PEEKTEXT, pid, src, NULL);
+    char path[32];
+
+    uninit_remote_reader();
+    sprintf(path, "/proc/%d/mem", pid);
+    remote_fd = open(path, O_RDONLY);
 }
 
+void uninit_remote_reader(void)
+{
+    if (remote_fd >= 0) close(remote_fd);
+    remote_fd = -1;
+    remote_valid = 0;
+}
 
-/* Handy routine to read aggregated data from pid using ptrace. The read 
- * values are written to the dest locations directly. 
+/* Make sure the page containing addr is cached. Returns 0 on success.
+ * Mappings are page granular, so an aligned page read never straddles
+ * the end of one.
  */
-void get_remote_struct(int pid, void *src, void *dst, size_t size)
+static int read_remote_page(unsigned addr)
+{
+    unsigned base = addr & ~(sizeof(remote_page) - 1);
+
+    if (remote_valid && base == remote_base) return 0;
+    remote_valid = 0;
+    if (remote_fd < 0) return -1;
+    if (pread(remote_fd, remote_page, sizeof(remote_page), base)
+            != (ssize_t) sizeof(remote_page)) {
+        return -1;
+    }
+    remote_base = base;
+    remote_valid = 1;
+    return 0;
+}
+
+static void get_remote_struct_ptrace(int pid, void *src, void *dst,
+                                     size_t size)
 {
     unsigned int i;
 
@@ -54,6 +95,42 @@ void get_remote_struct(int pid, void *src, void *dst, size_t size)
     }
 }
 
+/* Get a word from pid using ptrace. The result is the return value. */
+int get_remote_word(int pid, void *src)
+{
+    int val;
+
+    get_remote_struct(pid, src, &val, sizeof(val));
+    return val;
+}
+
+
+/* Handy routine to read aggregated data from pid using ptrace. The read
+ * values are written to the dest locations directly.
+ */
+void get_remote_struct(int pid, void *src, void *dst, size_t size)
+{
+    unsigned int i = 0;
+
+    /* All the threads we dump share one address space, so the reader set
+     * up for the crashing thread serves its siblings too.
+     */
+    while (i < size) {
+        unsigned addr = (unsigned) src + i;
+        unsigned off = addr & (sizeof(remote_page) - 1);
+        unsigned chunk = sizeof(remote_page) - off;
+
+        if (read_remote_page(addr)) break;
+        if (chunk > size - i) chunk = size - i;
+        memcpy((char *) dst + i, remote_page + off, chunk);
+        i += chunk;
+    }
+    if (i >= size) return;
+
+    get_remote_struct_ptrace(pid, (char *) src + i, (char *) dst + i,
+                             size - i);
+}
+
 /* Map a pc address to the name of the containing ELF file */
 const char *map_to_name(mapinfo *mi, unsigned pc, const char* def)
 {
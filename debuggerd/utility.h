@@ -36,6 +36,13 @@ typedef struct mapinfo {
     char name[];
 } mapinfo;
 
+/* Route remote reads through /proc/<pid>/mem, which is much faster than
+ * one word per ptrace call. Reads fall back to ptrace if this was not
+ * called or the open failed.
+ */
+extern void init_remote_reader(int pid);
+extern void uninit_remote_reader(void);
+
 /* Get a word from pid using ptrace. The result is the return value. */
 extern int get_remote_word(int pid, void *src);
 
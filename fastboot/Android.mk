@@ -17,11 +17,13 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../mkbootimg
-LOCAL_SRC_FILES := protocol.c engine.c bootimg.c fastboot.c 
+LOCAL_SRC_FILES := protocol.c engine.c bootimg.c sparse.c fastboot.c
 LOCAL_MODULE := fastboot
 
 ifeq ($(HOST_OS),linux)
   LOCAL_SRC_FILES += usb_linux.c util_linux.c
+  EXTRA_STATIC_LIBS := libusbhost
+  LOCAL_LDLIBS += -lpthread
 endif
 
 ifeq ($(HOST_OS),darwin)
@@ -40,7 +42,7 @@ ifeq ($(HOST_OS),windows)
   endif
 endif
 
-LOCAL_STATIC_LIBRARIES := $(EXTRA_STATIC_LIBS) libzipfile libunz
+LOCAL_STATIC_LIBRARIES := $(EXTRA_STATIC_LIBS) libzipfile libunz libcutils
 
 include $(BUILD_HOST_EXECUTABLE)
 $(call dist-for-goals,droid,$(LOCAL_BUILT_MODULE))
@@ -48,6 +50,7 @@ $(call dist-for-goals,droid,$(LOCAL_BUILT_MODULE))
 ifeq ($(HOST_OS),linux)
 include $(CLEAR_VARS)
 LOCAL_SRC_FILES := usbtest.c usb_linux.c
+LOCAL_STATIC_LIBRARIES := libusbhost
 LOCAL_MODULE := usbtest
 include $(BUILD_HOST_EXECUTABLE)
 endif
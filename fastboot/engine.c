@@ -33,6 +33,19 @@
 
 #include "fastboot.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+
+// in multi-device mode an action's header and its verdict go out
+// together under this lock so device lines do not interleave
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+static void print_lock_acquire(void) { pthread_mutex_lock(&print_lock); }
+static void print_lock_release(void) { pthread_mutex_unlock(&print_lock); }
+#else
+static void print_lock_acquire(void) {}
+static void print_lock_release(void) {}
+#endif
+
 char *mkmsg(const char *fmt, ...)
 {
     char buf[256];
@@ -111,14 +124,65 @@ void fb_queue_erase(const char *ptn)
     a->msg = mkmsg("erasing '%s'", ptn);
 }
 
+// sparse candidate for a queued flash: if the device answers "yes" to
+// getvar:sparse-format, the download action is switched over to the
+// encoded image before it runs
+struct sparse_image
+{
+    Action *download;
+    const char *ptn;
+    void *sparse_data;
+    unsigned sparse_size;
+    unsigned raw_size;
+};
+
+static int cb_sparse(Action *a, int status, char *resp)
+{
+    struct sparse_image *s = a->data;
+
+    if((status == 0) && !strcmp(resp, "yes")) {
+        s->download->data = s->sparse_data;
+        s->download->size = s->sparse_size;
+        s->download->msg = mkmsg("sending sparse '%s' (%d KB of %d KB)",
+                                 s->ptn, s->sparse_size / 1024,
+                                 s->raw_size / 1024);
+        fprintf(stderr,"yes\n");
+    } else {
+        fprintf(stderr,"no\n");
+    }
+
+    // a bootloader without sparse support is not an error -
+    // the raw image goes out as always
+    return 0;
+}
+
 void fb_queue_flash(const char *ptn, void *data, unsigned sz)
 {
+    struct sparse_image *s = 0;
+    void *sdata;
+    unsigned ssz;
     Action *a;
 
+    sdata = fb_sparse_encode(data, sz, &ssz);
+    if (sdata) {
+        s = calloc(1, sizeof(struct sparse_image));
+        if (s == 0) die("out of memory");
+        s->ptn = ptn;
+        s->sparse_data = sdata;
+        s->sparse_size = ssz;
+        s->raw_size = sz;
+
+        a = queue_action(OP_QUERY, "getvar:sparse-format");
+        a->data = s;
+        a->func = cb_sparse;
+        a->msg = mkmsg("checking sparse support for '%s'", ptn);
+    }
+
     a = queue_action(OP_DOWNLOAD, "");
     a->data = data;
     a->size = sz;
     a->msg = mkmsg("sending '%s' (%d KB)", ptn, sz / 1024);
+    if (s) s->download = a;
 
     a = queue_action(OP_COMMAND, "flash:%s", ptn);
     a->msg = mkmsg("writing '%s'", ptn);
@@ -254,36 +318,164 @@ void fb_queue_notice(const char *notice)
     a->data = (void*) notice;
 }
 
-void fb_execute_queue(usb_handle *usb)
+// run one action list against one device.  With a name set (multi
+// device mode) each line is prefixed "[name] " and printed only once
+// the outcome is known, so concurrent devices get whole lines
+static int fb_execute_actions(Action *list, usb_handle *usb, const char *name)
 {
     Action *a;
     char resp[FB_RESPONSE_SZ+1];
-    int status;
+    int status = 0;
 
-    a = action_list;
     resp[FB_RESPONSE_SZ] = 0;
 
-    for (a = action_list; a; a = a->next) {
-        if (a->msg) {
+    for (a = list; a; a = a->next) {
+        if (a->msg && name == 0) {
             fprintf(stderr,"%s... ",a->msg);
         }
         if (a->op == OP_DOWNLOAD) {
             status = fb_download_data(usb, a->data, a->size);
-            status = a->func(a, status, status ? fb_get_error() : "");
-            if (status) break;
         } else if (a->op == OP_COMMAND) {
             status = fb_command(usb, a->cmd);
-            status = a->func(a, status, status ? fb_get_error() : "");
-            if (status) break;
         } else if (a->op == OP_QUERY) {
             status = fb_command_response(usb, a->cmd, resp);
-            status = a->func(a, status, status ? fb_get_error() : resp);
-            if (status) break;
         } else if (a->op == OP_NOTICE) {
             fprintf(stderr,"%s\n",(char*)a->data);
+            continue;
         } else {
             die("bogus action");
         }
+
+        print_lock_acquire();
+        if (a->msg && name) {
+            fprintf(stderr,"[%s] %s... ", name, a->msg);
+        }
+        if (a->op == OP_QUERY) {
+            status = a->func(a, status, status ? fb_get_error() : resp);
+        } else {
+            status = a->func(a, status, status ? fb_get_error() : "");
+        }
+        print_lock_release();
+        if (status) return status;
+    }
+
+    return 0;
+}
+
+void fb_execute_queue(usb_handle *usb)
+{
+    fb_execute_actions(action_list, usb, 0);
+}
+
+// deep-copy the action list so every device runs (and cb_sparse
+// patches) its own copy.  Image payloads stay shared: one mmap()ed
+// copy feeds all devices
+static Action *clone_action_list(void)
+{
+    Action *first = 0;
+    Action *last = 0;
+    Action *a, *n;
+    Action *o, *c;
+
+    for (a = action_list; a; a = a->next) {
+        n = malloc(sizeof(Action));
+        if (n == 0) die("out of memory");
+        memcpy(n, a, sizeof(Action));
+        n->next = 0;
+        if (last) {
+            last->next = n;
+        } else {
+            first = n;
+        }
+        last = n;
+    }
+
+    // the sparse bookkeeping points back into the list - give each
+    // clone its own copy aimed at its own download action
+    for (o = action_list, c = first; o; o = o->next, c = c->next) {
+        if (o->func == cb_sparse) {
+            struct sparse_image *s;
+            Action *o2, *c2;
+
+            s = malloc(sizeof(struct sparse_image));
+            if (s == 0) die("out of memory");
+            memcpy(s, o->data, sizeof(struct sparse_image));
+            c->data = s;
+
+            for (o2 = action_list, c2 = first; o2; o2 = o2->next, c2 = c2->next) {
+                if (o2 == s->download) {
+                    s->download = c2;
+                    break;
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+struct queue_job
+{
+    Action *list;
+    usb_handle *usb;
+    const char *name;
+    int status;
+};
+
+static void *queue_job_run(void *arg)
+{
+    struct queue_job *job = arg;
+    job->status = fb_execute_actions(job->list, job->usb, job->name);
+    return 0;
+}
+
+// run the queued actions against every device at once, sharing the
+// in-memory images.  Returns the number of devices that failed
+int fb_execute_queue_parallel(usb_handle **usbs, const char **names, int count)
+{
+    struct queue_job *jobs;
+    int failed = 0;
+    int n;
+
+    jobs = calloc(count, sizeof(struct queue_job));
+    if (jobs == 0) die("out of memory");
+
+    for (n = 0; n < count; n++) {
+        jobs[n].list = n ? clone_action_list() : action_list;
+        jobs[n].usb = usbs[n];
+        jobs[n].name = names[n];
+    }
+
+#ifndef _WIN32
+    {
+        pthread_t *threads = calloc(count, sizeof(pthread_t));
+        if (threads == 0) die("out of memory");
+        for (n = 0; n < count; n++) {
+            if (pthread_create(&threads[n], NULL, queue_job_run, &jobs[n])) {
+                // couldn't spawn - run this one inline
+                queue_job_run(&jobs[n]);
+                threads[n] = 0;
+            }
+        }
+        for (n = 0; n < count; n++) {
+            if (threads[n]) pthread_join(threads[n], NULL);
+        }
+        free(threads);
+    }
+#else
+    // no threads here - take the devices one after another
+    for (n = 0; n < count; n++) {
+        queue_job_run(&jobs[n]);
     }
+#endif
+
+    for (n = 0; n < count; n++) {
+        fprintf(stderr,"[%s] %s\n", jobs[n].name,
+                jobs[n].status ? "FAILED" : "finished");
+        if (jobs[n].status) failed++;
+    }
+
+    free(jobs);
+    return failed;
 }
 
@@ -48,6 +48,7 @@ static const char *product = 0;
 static const char *cmdline = 0;
 static int wipe_data = 0;
 static unsigned short vendor_id = 0;
+static int multidev = 0;
 
 void die(const char *fmt, ...)
 {
@@ -101,37 +102,10 @@ char *find_item(const char *item, const char *product)
 }
 
 #ifdef _WIN32
-void *load_file(const char *fn, unsigned *_sz);
+/* no mmap on win32: util_windows.c reads the file into the heap */
+void *map_file(const char *fn, unsigned *_sz);
 #else
-void *load_file(const char *fn, unsigned *_sz)
-{
-    char *data;
-    int sz;
-    int fd;
-
-    data = 0;
-    fd = open(fn, O_RDONLY);
-    if(fd < 0) return 0;
-
-    sz = lseek(fd, 0, SEEK_END);
-    if(sz < 0) goto oops;
-
-    if(lseek(fd, 0, SEEK_SET) != 0) goto oops;
-
-    data = (char*) malloc(sz);
-    if(data == 0) goto oops;
-
-    if(read(fd, data, sz) != sz) goto oops;
-    close(fd);
-
-    if(_sz) *_sz = sz;
-    return data;
-
-oops:
-    close(fd);
-    if(data != 0) free(data);
-    return 0;
-}
+#include <cutils/misc.h>
 #endif
 
 int match_fastboot(usb_ifc_info *info)
@@ -162,6 +136,27 @@ int list_devices_callback(usb_ifc_info *info)
     return -1;
 }
 
+// multi-device mode: each usb_open() pass claims one device, so
+// devices already claimed (and devices with no serial number, which
+// could not be told apart on the next pass) are skipped
+#define MAX_DEVICES 16
+
+static char claimed_serial[MAX_DEVICES][256];
+static int nr_claimed = 0;
+
+int match_fastboot_multi(usb_ifc_info *info)
+{
+    int n;
+
+    if (match_fastboot(info)) return -1;
+    if (info->serial_number[0] == 0) return -1;
+    for (n = 0; n < nr_claimed; n++) {
+        if (!strcmp(claimed_serial[n], info->serial_number)) return -1;
+    }
+    strcpy(claimed_serial[nr_claimed], info->serial_number);
+    return 0;
+}
+
 usb_handle *open_device(void)
 {
     static usb_handle *usb = 0;
@@ -206,6 +201,7 @@ void usage(void)
             "  reboot-bootloader                        reboot device into bootloader\n"
             "\n"
             "options:\n"
+            "  -m                                       run against every matching device\n"
             "  -w                                       erase userdata and cache\n"
             "  -s <serial number>                       specify device serial number\n"
             "  -p <product>                             specify product name\n"
@@ -228,7 +224,7 @@ void *load_bootable_image(const char *kernel, const char *ramdisk,
         return 0;
     }
 
-    kdata = load_file(kernel, &ksize);
+    kdata = map_file(kernel, &ksize);
     if(kdata == 0) {
         fprintf(stderr, "cannot load '%s'\n", kernel);
         return 0;
@@ -248,7 +244,7 @@ void *load_bootable_image(const char *kernel, const char *ramdisk,
     }
 
     if(ramdisk) {
-        rdata = load_file(ramdisk, &rsize);
+        rdata = map_file(ramdisk, &rsize);
         if(rdata == 0) {
             fprintf(stderr,"cannot load '%s'\n", ramdisk);
             return  0;
@@ -408,7 +404,7 @@ void do_update(char *fn)
 
     queue_info_dump();
 
-    zdata = load_file(fn, &zsize);
+    zdata = map_file(fn, &zsize);
     if (zdata == 0) die("failed to load '%s'", fn);
 
     zip = init_zipfile(zdata, zsize);
@@ -459,7 +455,7 @@ void do_send_signature(char *fn)
     if (strcmp(xtn, ".img")) return;
 	
     strcpy(xtn,".sig");
-    data = load_file(fn, &sz);
+    data = map_file(fn, &sz);
     strcpy(xtn,".img");
     if (data == 0) return;
     fb_queue_download("signature", data, sz);
@@ -476,25 +472,25 @@ void do_flashall(void)
 
     fname = find_item("info", product);
     if (fname == 0) die("cannot find android-info.txt");
-    data = load_file(fname, &sz);
+    data = map_file(fname, &sz);
     if (data == 0) die("could not load android-info.txt");
     setup_requirements(data, sz);
 
     fname = find_item("boot", product);
-    data = load_file(fname, &sz);
+    data = map_file(fname, &sz);
     if (data == 0) die("could not load boot.img");
     do_send_signature(fname);
     fb_queue_flash("boot", data, sz);
 
     fname = find_item("recovery", product);
-    data = load_file(fname, &sz);
+    data = map_file(fname, &sz);
     if (data != 0) {
         do_send_signature(fname);
         fb_queue_flash("recovery", data, sz);
     }
 
     fname = find_item("system", product);
-    data = load_file(fname, &sz);
+    data = map_file(fname, &sz);
     if (data == 0) die("could not load system.img");
     do_send_signature(fname);
     fb_queue_flash("system", data, sz);   
@@ -544,6 +540,9 @@ int main(int argc, char **argv)
         if(!strcmp(*argv, "-w")) {
             wants_wipe = 1;
             skip(1);
+        } else if(!strcmp(*argv, "-m")) {
+            multidev = 1;
+            skip(1);
         } else if(!strcmp(*argv, "-s")) {
             require(2);
             serial = argv[1];
@@ -576,7 +575,7 @@ int main(int argc, char **argv)
             skip(2);
         } else if(!strcmp(*argv, "signature")) {
             require(2);
-            data = load_file(argv[1], &sz);
+            data = map_file(argv[1], &sz);
             if (data == 0) die("could not load '%s'", argv[1]);
             if (sz != 256) die("signature must be 256 bytes");
             fb_queue_download("signature", data, sz);
@@ -616,7 +615,7 @@ int main(int argc, char **argv)
                 skip(2);
             }
             if (fname == 0) die("cannot determine image filename for '%s'", pname);
-            data = load_file(fname, &sz);
+            data = map_file(fname, &sz);
             if (data == 0) die("cannot load '%s'\n", fname);
             fb_queue_flash(pname, data, sz);
         } else if(!strcmp(*argv, "flash:raw")) {
@@ -663,6 +662,25 @@ int main(int argc, char **argv)
         fb_queue_command("reboot-bootloader", "rebooting into bootloader");
     }
 
+    if (multidev) {
+        usb_handle *usbs[MAX_DEVICES];
+        const char *serials[MAX_DEVICES];
+        int count = 0;
+
+        while (count < MAX_DEVICES) {
+            usb = usb_open(match_fastboot_multi);
+            if (usb == 0) break;
+            usbs[count] = usb;
+            serials[count] = claimed_serial[nr_claimed];
+            nr_claimed++;
+            count++;
+        }
+        if (count == 0) die("no devices found");
+        fprintf(stderr,"running against %d device%s\n",
+                count, (count == 1) ? "" : "s");
+        return fb_execute_queue_parallel(usbs, serials, count);
+    }
+
     usb = open_device();
 
     fb_execute_queue(usb);
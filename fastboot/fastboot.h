@@ -40,6 +40,9 @@ char *fb_get_error(void);
 #define FB_COMMAND_SZ 64
 #define FB_RESPONSE_SZ 64
 
+/* sparse.c - block-map image encoder */
+void *fb_sparse_encode(const void *data, unsigned sz, unsigned *out_sz);
+
 /* engine.c - high level command queue engine */
 void fb_queue_flash(const char *ptn, void *data, unsigned sz);;
 void fb_queue_erase(const char *ptn);
@@ -49,6 +52,7 @@ void fb_queue_reboot(void);
 void fb_queue_command(const char *cmd, const char *msg);
 void fb_queue_download(const char *name, void *data, unsigned size);
 void fb_queue_notice(const char *notice);
+int fb_execute_queue_parallel(usb_handle **usbs, const char **names, int count);
 void fb_execute_queue(usb_handle *usb);
 
 /* util stuff */
@@ -31,9 +31,20 @@
 #include <string.h>
 #include <errno.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 #include "fastboot.h"
 
+#ifndef _WIN32
+/* per-thread so concurrent multi-device sessions don't garble each
+** other's failure messages
+*/
+static __thread char ERROR[128];
+#else
 static char ERROR[128];
+#endif
 
 char *fb_get_error(void)
 {
@@ -100,13 +111,14 @@ static int check_response(usb_handle *usb, unsigned size,
     return -1;
 }
 
-static int _command_send(usb_handle *usb, const char *cmd,
-                         const void *data, unsigned size,
-                         char *response)
+/* sends the command and, when data is to follow (size != 0), waits
+** for the DATA response and returns how much the device will accept
+*/
+static int _command_start(usb_handle *usb, const char *cmd,
+                          unsigned size, char *response)
 {
     int cmdsize = strlen(cmd);
-    int r;
-    
+
     if(response) {
         response[0] = 0;
     }
@@ -122,36 +134,65 @@ static int _command_send(usb_handle *usb, const char *cmd,
         return -1;
     }
 
-    if(data == 0) {
+    if(size == 0) {
         return check_response(usb, size, 0, response);
     }
 
-    r = check_response(usb, size, 1, 0);
+    return check_response(usb, size, 1, 0);
+}
+
+static int _command_write_data(usb_handle *usb, const void *data, unsigned size)
+{
+    int r;
+
+    r = usb_write(usb, data, size);
+    if(r < 0) {
+        sprintf(ERROR, "data transfer failure (%s)", strerror(errno));
+        usb_close(usb);
+        return -1;
+    }
+    if(r != ((int) size)) {
+        sprintf(ERROR, "data transfer failure (short transfer)");
+        usb_close(usb);
+        return -1;
+    }
+    return r;
+}
+
+static int _command_end(usb_handle *usb)
+{
+    if(check_response(usb, 0, 0, 0) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int _command_send(usb_handle *usb, const char *cmd,
+                         const void *data, unsigned size,
+                         char *response)
+{
+    int r;
+
+    if(data == 0) {
+        return _command_start(usb, cmd, 0, response);
+    }
+
+    r = _command_start(usb, cmd, size, 0);
     if(r < 0) {
         return -1;
     }
     size = r;
 
     if(size) {
-        r = usb_write(usb, data, size);
-        if(r < 0) {
-            sprintf(ERROR, "data transfer failure (%s)", strerror(errno));
-            usb_close(usb);
-            return -1;
-        }
-        if(r != ((int) size)) {
-            sprintf(ERROR, "data transfer failure (short transfer)");
-            usb_close(usb);
+        if(_command_write_data(usb, data, size) < 0) {
             return -1;
         }
     }
-    
-    r = check_response(usb, 0, 0, 0);
-    if(r < 0) {
+
+    if(_command_end(usb) < 0) {
         return -1;
-    } else {
-        return size;
     }
+    return size;
 }
 
 int fb_command(usb_handle *usb, const char *cmd)
@@ -164,18 +205,179 @@ int fb_command_response(usb_handle *usb, const char *cmd, char *response)
     return _command_send(usb, cmd, 0, 0, response);
 }
 
+/* images go out a window at a time so the next window can be paged in
+** while the current one is on the wire
+*/
+#define DOWNLOAD_CHUNK (1024 * 1024)
+
+static void prefetch(const void *data, unsigned size)
+{
+#ifndef _WIN32
+    /* best effort - the buffer may be heap rather than an mmap()ed
+    ** image, in which case the kernel just declines
+    */
+    madvise((void*) data, size, MADV_WILLNEED);
+#endif
+}
+
+/* crc handshake, for devices that answer "yes" to
+** getvar:download-crc: after every window of a download the device
+** sends "ACKD" followed by eight hex digits of the offset it has
+** safely received and eight hex digits of the crc32 of the last
+** window.  The host answers each ack with a fixed 12 byte control
+** frame - "CONT" padded with the next offset to keep going, or
+** "RSUM" plus eight hex digits of the last good offset, upon which
+** the device rewinds its write pointer there and expects that window
+** again.  A mangled window thus costs one window, not the whole
+** image.  The device sends the usual final OKAY once the last window
+** has been acked and continued
+*/
+#define DOWNLOAD_RETRIES 3
+
+/* standard reflected crc32, table built on first use */
+static unsigned crc_table[256];
+
+static void make_crc_table(void)
+{
+    unsigned n, k, c;
+
+    for(n = 0; n < 256; n++) {
+        c = n;
+        for(k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        crc_table[n] = c;
+    }
+}
+
+static unsigned crc32_block(const void *_data, unsigned len)
+{
+    const unsigned char *data = _data;
+    unsigned crc = 0xffffffff;
+    unsigned n;
+
+    if(crc_table[1] == 0) make_crc_table();
+    for(n = 0; n < len; n++) {
+        crc = crc_table[(crc ^ data[n]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+}
+
+static int read_window_ack(usb_handle *usb, unsigned *offset, unsigned *crc)
+{
+    unsigned char status[65];
+    char tmp[9];
+    int r;
+
+    r = usb_read(usb, status, 64);
+    if(r < 0) {
+        sprintf(ERROR, "window ack read failed (%s)", strerror(errno));
+        return -1;
+    }
+    status[r] = 0;
+
+    if(r >= 4 && !memcmp(status, "FAIL", 4)) {
+        sprintf(ERROR, "remote: %s", status + 4);
+        return -1;
+    }
+    if(r < 20 || memcmp(status, "ACKD", 4)) {
+        sprintf(ERROR, "malformed window ack");
+        return -1;
+    }
+
+    memcpy(tmp, status + 4, 8);
+    tmp[8] = 0;
+    *offset = strtoul(tmp, 0, 16);
+    memcpy(tmp, status + 12, 8);
+    tmp[8] = 0;
+    *crc = strtoul(tmp, 0, 16);
+    return 0;
+}
+
 int fb_download_data(usb_handle *usb, const void *data, unsigned size)
 {
+    const char *ptr = data;
     char cmd[64];
+    char resp[FB_RESPONSE_SZ+1];
+    unsigned total;
+    unsigned offset = 0;
+    unsigned ack_offset, ack_crc;
+    int crc_mode = 0;
+    int retries = DOWNLOAD_RETRIES;
     int r;
-    
+
+    /* one-window downloads aren't worth the probe round trip */
+    if(size > DOWNLOAD_CHUNK) {
+        if(fb_command_response(usb, "getvar:download-crc", resp) == 0 &&
+           !strcmp(resp, "yes")) {
+            crc_mode = 1;
+        }
+    }
+
     sprintf(cmd, "download:%08x", size);
-    r = _command_send(usb, cmd, data, size, 0);
-    
+    r = _command_start(usb, cmd, size, 0);
     if(r < 0) {
         return -1;
-    } else {
-        return 0;
     }
+    total = r;
+
+    /* the image is typically an mmap()ed file (see map_file()).  Ask
+    ** the kernel to start faulting in the window after the one being
+    ** sent, so the usb pipe never stalls waiting on the disk
+    */
+    prefetch(ptr, (total > DOWNLOAD_CHUNK) ? DOWNLOAD_CHUNK : total);
+
+    while(offset < total) {
+        unsigned remaining = total - offset;
+        unsigned xfer = (remaining > DOWNLOAD_CHUNK) ? DOWNLOAD_CHUNK : remaining;
+
+        if(remaining > xfer) {
+            unsigned next = remaining - xfer;
+            prefetch(ptr + offset + xfer,
+                     (next > DOWNLOAD_CHUNK) ? DOWNLOAD_CHUNK : next);
+        }
+
+        if(!crc_mode) {
+            if(_command_write_data(usb, ptr + offset, xfer) < 0) {
+                return -1;
+            }
+            offset += xfer;
+            continue;
+        }
+
+        if(usb_write(usb, ptr + offset, xfer) == ((int) xfer) &&
+           read_window_ack(usb, &ack_offset, &ack_crc) == 0 &&
+           ack_offset == offset + xfer &&
+           ack_crc == crc32_block(ptr + offset, xfer)) {
+            sprintf(cmd, "CONT%08x", offset + xfer);
+            if(usb_write(usb, cmd, 12) != 12) {
+                sprintf(ERROR, "control write failed (%s)", strerror(errno));
+                usb_close(usb);
+                return -1;
+            }
+            offset += xfer;
+            retries = DOWNLOAD_RETRIES;
+            continue;
+        }
+
+        /* glitch - rewind the device to the last good offset and
+        ** send the window again
+        */
+        if(retries-- <= 0) {
+            sprintf(ERROR, "download failed at offset 0x%x", offset);
+            usb_close(usb);
+            return -1;
+        }
+        fprintf(stderr,"(retrying from 0x%08x) ", offset);
+
+        sprintf(cmd, "RSUM%08x", offset);
+        if(usb_write(usb, cmd, 12) != 12) {
+            sprintf(ERROR, "control write failed (%s)", strerror(errno));
+            usb_close(usb);
+            return -1;
+        }
+    }
+
+    return _command_end(usb);
 }
 
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fastboot.h"
+#include "sparse.h"
+
+#define SPARSE_BLOCK_SIZE 4096
+
+#define CLASS_RAW       0
+#define CLASS_FILL      1
+#define CLASS_DONT_CARE 2
+
+/* all-0xff blocks are erased nand and need not be sent at all.  Other
+** uniform blocks (typically zeros) still have to be written, but a
+** four byte pattern replaces them on the wire
+*/
+static int classify(const unsigned char *block, unsigned len)
+{
+    unsigned char first = block[0];
+    unsigned i;
+
+    for(i = 1; i < len; i++) {
+        if(block[i] != first) return CLASS_RAW;
+    }
+
+    return (first == 0xff) ? CLASS_DONT_CARE : CLASS_FILL;
+}
+
+/* length in bytes of the run of equally classified blocks starting at
+** block n.  FILL runs only merge blocks sharing the same pattern
+*/
+static unsigned run_length(const unsigned char *data, unsigned sz,
+                           unsigned n, unsigned nblocks, int cls)
+{
+    unsigned char first = data[n * SPARSE_BLOCK_SIZE];
+    unsigned j;
+
+    for(j = n + 1; j < nblocks; j++) {
+        const unsigned char *block = data + j * SPARSE_BLOCK_SIZE;
+        unsigned len = sz - j * SPARSE_BLOCK_SIZE;
+        if(len > SPARSE_BLOCK_SIZE) len = SPARSE_BLOCK_SIZE;
+
+        if(classify(block, len) != cls) break;
+        if(cls == CLASS_FILL && block[0] != first) break;
+    }
+
+    j = j * SPARSE_BLOCK_SIZE;
+    if(j > sz) j = sz;
+    return j - n * SPARSE_BLOCK_SIZE;
+}
+
+/* encode a raw image into the block-map format from sparse.h.
+** Returns a malloc()ed buffer and its size in *out_sz, or 0 if the
+** image does not shrink enough to be worth the extra bookkeeping
+*/
+void *fb_sparse_encode(const void *_data, unsigned sz, unsigned *out_sz)
+{
+    const unsigned char *data = _data;
+    unsigned nblocks = (sz + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE;
+    unsigned chunks = 0;
+    unsigned data_bytes = 0;
+    unsigned enc_sz;
+    unsigned n;
+    unsigned char *out;
+    unsigned char *p;
+    sparse_header_t *hdr;
+
+    if(sz == 0) return 0;
+
+    /* first pass: count the chunks and the bytes they carry */
+    n = 0;
+    while(n < nblocks) {
+        const unsigned char *block = data + n * SPARSE_BLOCK_SIZE;
+        unsigned len = sz - n * SPARSE_BLOCK_SIZE;
+        int cls;
+        unsigned run;
+
+        if(len > SPARSE_BLOCK_SIZE) len = SPARSE_BLOCK_SIZE;
+        cls = classify(block, len);
+        run = run_length(data, sz, n, nblocks, cls);
+
+        chunks++;
+        if(cls == CLASS_RAW) data_bytes += run;
+        else if(cls == CLASS_FILL) data_bytes += 4;
+
+        n += (run + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE;
+    }
+
+    enc_sz = sizeof(sparse_header_t)
+        + chunks * sizeof(chunk_header_t) + data_bytes;
+
+    /* sending sparse costs an extra getvar round trip - demand a
+    ** real saving before switching formats
+    */
+    if(enc_sz >= sz - sz / 16) return 0;
+
+    out = malloc(enc_sz);
+    if(out == 0) return 0;
+
+    hdr = (sparse_header_t*) out;
+    hdr->magic = SPARSE_HEADER_MAGIC;
+    hdr->version = SPARSE_VERSION;
+    hdr->blocksize = SPARSE_BLOCK_SIZE;
+    hdr->total_size = sz;
+    hdr->total_chunks = chunks;
+    p = out + sizeof(sparse_header_t);
+
+    /* second pass: emit */
+    n = 0;
+    while(n < nblocks) {
+        const unsigned char *block = data + n * SPARSE_BLOCK_SIZE;
+        unsigned len = sz - n * SPARSE_BLOCK_SIZE;
+        int cls;
+        unsigned run;
+        chunk_header_t *chunk;
+
+        if(len > SPARSE_BLOCK_SIZE) len = SPARSE_BLOCK_SIZE;
+        cls = classify(block, len);
+        run = run_length(data, sz, n, nblocks, cls);
+
+        chunk = (chunk_header_t*) p;
+        chunk->reserved = 0;
+        chunk->chunk_size = run;
+        p += sizeof(chunk_header_t);
+
+        if(cls == CLASS_RAW) {
+            chunk->type = CHUNK_TYPE_RAW;
+            chunk->data_size = run;
+            memcpy(p, block, run);
+            p += run;
+        } else if(cls == CLASS_FILL) {
+            chunk->type = CHUNK_TYPE_FILL;
+            chunk->data_size = 4;
+            memset(p, block[0], 4);
+            p += 4;
+        } else {
+            chunk->type = CHUNK_TYPE_DONT_CARE;
+            chunk->data_size = 0;
+        }
+
+        n += (run + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE;
+    }
+
+    *out_sz = enc_sz;
+    return out;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FASTBOOT_SPARSE_H_
+#define _FASTBOOT_SPARSE_H_
+
+/* Block-map image format for "fastboot flash".  The raw image is cut
+** into runs of blocks that are sent verbatim (RAW), expanded on the
+** device from a four byte pattern (FILL), or not sent at all
+** (DONT_CARE).  DONT_CARE runs are left in the erased state, so a
+** bootloader must erase the partition before applying a sparse image.
+** Bootloaders advertise support by answering "yes" to
+** getvar:sparse-format; everyone else keeps getting raw images.
+**
+** All fields are little endian.
+*/
+
+#define SPARSE_HEADER_MAGIC 0x46425331  /* 'FBS1' */
+#define SPARSE_VERSION      1
+
+typedef struct sparse_header {
+    unsigned magic;          /* SPARSE_HEADER_MAGIC */
+    unsigned version;        /* SPARSE_VERSION */
+    unsigned blocksize;      /* run granularity, bytes */
+    unsigned total_size;     /* size of the expanded image, bytes */
+    unsigned total_chunks;   /* number of chunk headers that follow */
+} sparse_header_t;
+
+#define CHUNK_TYPE_RAW       1   /* data_size == chunk_size */
+#define CHUNK_TYPE_FILL      2   /* data_size == 4, pattern to repeat */
+#define CHUNK_TYPE_DONT_CARE 3   /* data_size == 0, leave erased */
+
+typedef struct chunk_header {
+    unsigned short type;     /* CHUNK_TYPE_* */
+    unsigned short reserved;
+    unsigned chunk_size;     /* expanded size, bytes */
+    unsigned data_size;      /* bytes following this header */
+} chunk_header_t;
+
+#endif
@@ -33,21 +33,13 @@
 
 #include <sys/ioctl.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
-#include <ctype.h>
 
 #include <linux/usbdevice_fs.h>
-#include <linux/usbdevice_fs.h>
-#include <linux/version.h>
-#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
-#include <linux/usb/ch9.h>
-#else
-#include <linux/usb_ch9.h>
-#endif
-#include <asm/byteorder.h>
+
+#include <usbhost/usbhost.h>
 
 #include "usb.h"
 
@@ -67,185 +59,120 @@ struct usb_handle
     unsigned char ep_out;
 };
 
-static inline int badname(const char *name)
+/* the scan itself (descriptor parse, serial fetch, reject cache)
+** lives in libusbhost; this wrapper maps its per-interface callback
+** onto the ifc_match_func fastboot's callers pass in, and captures
+** the endpoints of the interface being claimed.
+*/
+struct scan_state
 {
-    while(*name) {
-        if(!isdigit(*name++)) return 1;
-    }
-    return 0;
-}
+    ifc_match_func callback;
+    char fname[64];
+    unsigned char ep_in;
+    unsigned char ep_out;
+};
 
-static int check(void *_desc, int len, unsigned type, int size)
+static int fastboot_scan_cb(usb_ifc_match *m, void *cookie)
 {
-    unsigned char *desc = _desc;
-    
-    if(len < size) return -1;
-    if(desc[0] < size) return -1;
-    if(desc[0] > len) return -1;
-    if(desc[1] != type) return -1;
-    
-    return 0;
+    struct scan_state *state = cookie;
+    usb_ifc_info info;
+
+    info.dev_vendor = m->dev_vendor;
+    info.dev_product = m->dev_product;
+    info.dev_class = m->dev_class;
+    info.dev_subclass = m->dev_subclass;
+    info.dev_protocol = m->dev_protocol;
+    info.ifc_class = m->ifc_class;
+    info.ifc_subclass = m->ifc_subclass;
+    info.ifc_protocol = m->ifc_protocol;
+    info.has_bulk_in = m->has_bulk_in;
+    info.has_bulk_out = m->has_bulk_out;
+    strcpy(info.serial_number, m->serial_number);
+
+    if(state->callback(&info) != 0)
+        return USB_SCAN_CONTINUE;
+
+    strcpy(state->fname, m->dev_name);
+    state->ep_in = m->ep_in;
+    state->ep_out = m->ep_out;
+    return USB_SCAN_CLAIM;
 }
 
-static int filter_usb_device(int fd, char *ptr, int len, ifc_match_func callback,
-                             int *ept_in_id, int *ept_out_id, int *ifc_id)
+/* largest transfer usbdevfs will take in a single urb */
+#define MAX_USBFS_BULK_SIZE (16 * 1024)
+
+/* number of writes kept in flight on the bulk pipe.  Submitting the
+** next buffers while the device is still draining the current one
+** keeps the pipe full instead of idling it between every transfer,
+** which matters when the other end is slow (a bootloader writing
+** flash, say).
+*/
+#define URB_QUEUE_DEPTH 8
+
+/* returns bytes written, -1 on a transfer error, or -2 if the kernel
+** refused the very first submission (nothing went out - the caller
+** can safely retry synchronously)
+*/
+static int usb_write_queued(usb_handle *h, unsigned char *data, int len)
 {
-    struct usb_device_descriptor *dev;
-    struct usb_config_descriptor *cfg;
-    struct usb_interface_descriptor *ifc;
-    struct usb_endpoint_descriptor *ept;
-    struct usb_ifc_info info;
-    
-    int in, out;
-    unsigned i;
-    unsigned e;
-    
-    if(check(ptr, len, USB_DT_DEVICE, USB_DT_DEVICE_SIZE))
-        return -1;
-    dev = (void*) ptr;
-    len -= dev->bLength;
-    ptr += dev->bLength;
-    
-    if(check(ptr, len, USB_DT_CONFIG, USB_DT_CONFIG_SIZE))
-        return -1;
-    cfg = (void*) ptr;
-    len -= cfg->bLength;
-    ptr += cfg->bLength;
-    
-    info.dev_vendor = dev->idVendor;
-    info.dev_product = dev->idProduct;
-    info.dev_class = dev->bDeviceClass;
-    info.dev_subclass = dev->bDeviceSubClass;
-    info.dev_protocol = dev->bDeviceProtocol;
-
-    // read device serial number (if there is one)
-    info.serial_number[0] = 0;
-    if (dev->iSerialNumber) {
-        struct usbdevfs_ctrltransfer  ctrl;
-        __u16 buffer[128];
-        int result;
-
-        memset(buffer, 0, sizeof(buffer));
-
-        ctrl.bRequestType = USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE;
-        ctrl.bRequest = USB_REQ_GET_DESCRIPTOR;
-        ctrl.wValue = (USB_DT_STRING << 8) | dev->iSerialNumber;
-        ctrl.wIndex = 0;
-        ctrl.wLength = sizeof(buffer);
-        ctrl.data = buffer;
-
-        result = ioctl(fd, USBDEVFS_CONTROL, &ctrl);
-        if (result > 0) {
-            int i;
-            // skip first word, and copy the rest to the serial string, changing shorts to bytes.
-            result /= 2;
-            for (i = 1; i < result; i++)
-                info.serial_number[i - 1] = buffer[i];
-            info.serial_number[i - 1] = 0;
+    struct usbdevfs_urb urbs[URB_QUEUE_DEPTH];
+    struct usbdevfs_urb *urb;
+    int submitted = 0;
+    int reaped = 0;
+    int count = 0;
+
+    memset(urbs, 0, sizeof(urbs));
+
+    while(len > 0 || submitted > reaped) {
+        while(len > 0 && (submitted - reaped) < URB_QUEUE_DEPTH) {
+            int xfer = (len > MAX_USBFS_BULK_SIZE) ? MAX_USBFS_BULK_SIZE : len;
+
+            urb = urbs + (submitted % URB_QUEUE_DEPTH);
+            urb->type = USBDEVFS_URB_TYPE_BULK;
+            urb->endpoint = h->ep_out;
+            urb->buffer = data;
+            urb->buffer_length = xfer;
+
+            if(ioctl(h->desc, USBDEVFS_SUBMITURB, urb) < 0) {
+                DBG("ERROR: submiturb failed, errno = %d (%s)\n",
+                    errno, strerror(errno));
+                if(submitted == 0) return -2;
+                goto fail;
+            }
+
+            submitted++;
+            data += xfer;
+            len -= xfer;
         }
-    }
 
-    for(i = 0; i < cfg->bNumInterfaces; i++) {
-        if(check(ptr, len, USB_DT_INTERFACE, USB_DT_INTERFACE_SIZE))
-            return -1;
-        ifc = (void*) ptr;
-        len -= ifc->bLength;
-        ptr += ifc->bLength;
-        
-        in = -1;
-        out = -1;
-        info.ifc_class = ifc->bInterfaceClass;
-        info.ifc_subclass = ifc->bInterfaceSubClass;
-        info.ifc_protocol = ifc->bInterfaceProtocol;
-        
-        for(e = 0; e < ifc->bNumEndpoints; e++) {
-            if(check(ptr, len, USB_DT_ENDPOINT, USB_DT_ENDPOINT_SIZE))
-                return -1;
-            ept = (void*) ptr;
-            len -= ept->bLength;
-            ptr += ept->bLength;
-    
-            if((ept->bmAttributes & 0x03) != 0x02)
-                continue;
-            
-            if(ept->bEndpointAddress & 0x80) {
-                in = ept->bEndpointAddress;
-            } else {
-                out = ept->bEndpointAddress;
-            }
+        urb = NULL;
+        if(ioctl(h->desc, USBDEVFS_REAPURB, &urb) < 0) {
+            DBG("ERROR: reapurb failed, errno = %d (%s)\n",
+                errno, strerror(errno));
+            goto fail;
         }
+        reaped++;
 
-        info.has_bulk_in = (in != -1);
-        info.has_bulk_out = (out != -1);
-        
-        if(callback(&info) == 0) {
-            *ept_in_id = in;
-            *ept_out_id = out;
-            *ifc_id = ifc->bInterfaceNumber;
-            return 0;
+        if(urb->status != 0 || urb->actual_length != urb->buffer_length) {
+            DBG("ERROR: urb status %d, %d of %d bytes\n",
+                urb->status, urb->actual_length, urb->buffer_length);
+            goto fail;
         }
+        count += urb->actual_length;
     }
 
-    return -1;
-}
-
-static usb_handle *find_usb_device(const char *base, ifc_match_func callback)
-{
-    usb_handle *usb = 0;
-    char busname[64], devname[64];
-    char desc[1024];
-    int n, in, out, ifc;
-    
-    DIR *busdir, *devdir;
-    struct dirent *de;
-    int fd;
-    
-    busdir = opendir(base);
-    if(busdir == 0) return 0;
-
-    while((de = readdir(busdir)) && (usb == 0)) {
-        if(badname(de->d_name)) continue;
-        
-        sprintf(busname, "%s/%s", base, de->d_name);
-        devdir = opendir(busname);
-        if(devdir == 0) continue;
-        
-//        DBG("[ scanning %s ]\n", busname);
-        while((de = readdir(devdir)) && (usb == 0)) {
-            
-            if(badname(de->d_name)) continue;
-            sprintf(devname, "%s/%s", busname, de->d_name);
-
-//            DBG("[ scanning %s ]\n", devname);
-            if((fd = open(devname, O_RDWR)) < 0) {
-                continue;
-            }
+    return count;
 
-            n = read(fd, desc, sizeof(desc));
-            
-            if(filter_usb_device(fd, desc, n, callback, &in, &out, &ifc) == 0){
-                usb = calloc(1, sizeof(usb_handle));
-                strcpy(usb->fname, devname);
-                usb->ep_in = in;
-                usb->ep_out = out;
-                usb->desc = fd;
-
-                n = ioctl(fd, USBDEVFS_CLAIMINTERFACE, &ifc);
-                if(n != 0) {
-                    close(fd);
-                    free(usb);
-                    usb = 0;
-                    continue;
-                }
-            } else {
-                close(fd);
-            }
-        }
-        closedir(devdir);
+fail:
+    /* drain whatever is still on the wire before reporting the error
+    ** so no completion lands after we return
+    */
+    while(submitted > reaped) {
+        urb = NULL;
+        if(ioctl(h->desc, USBDEVFS_REAPURB, &urb) < 0) break;
+        reaped++;
     }
-    closedir(busdir);
-
-    return usb;
+    return -1;
 }
 
 int usb_write(usb_handle *h, const void *_data, int len)
@@ -258,7 +185,15 @@ int usb_write(usb_handle *h, const void *_data, int len)
     if(h->ep_out == 0) {
         return -1;
     }
-    
+
+    if(len > MAX_USBFS_BULK_SIZE) {
+        n = usb_write_queued(h, data, len);
+        if(n != -2) return n;
+        /* kernel would not take async urbs - fall back to the
+        ** synchronous loop below
+        */
+    }
+
     if(len == 0) {
         bulk.ep = h->ep_out;
         bulk.len = 0;
@@ -367,7 +302,20 @@ int usb_close(usb_handle *h)
 
 usb_handle *usb_open(ifc_match_func callback)
 {
-    return find_usb_device("/dev/bus/usb", callback);
+    struct scan_state state;
+    usb_handle *usb;
+    int fd;
+
+    state.callback = callback;
+    fd = usb_host_scan("/dev/bus/usb", 0, fastboot_scan_cb, &state);
+    if(fd < 0) return 0;
+
+    usb = calloc(1, sizeof(usb_handle));
+    strcpy(usb->fname, state.fname);
+    usb->ep_in = state.ep_in;
+    usb->ep_out = state.ep_out;
+    usb->desc = fd;
+    return usb;
 }
 
 
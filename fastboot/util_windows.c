@@ -91,3 +91,15 @@ void *load_file(const char *fn, unsigned *_sz)
     *_sz = (unsigned) file_size;
     return  data;
 }
+
+/* the rest of the tools get a copy-on-write mmap from libcutils here;
+ * on win32 we just hand out the heap copy made by load_file() */
+void *map_file(const char *fn, unsigned *_sz)
+{
+    return load_file( fn, _sz );
+}
+
+void unmap_file(void *data, unsigned sz)
+{
+    free( data );
+}
@@ -54,13 +54,38 @@ extern "C" {
 #define assertNotSame(a, b) assertTrueWithSource(a != b, __FILE__, __LINE__,\
         "Expected different values");
     
+/**
+ * Adds a benchmark to the benchmark suite. The benchmark function
+ * should run the operation being measured 'iterations' times.
+ */
+#define addBenchmark(benchmark) addNamedBenchmark(#benchmark, &benchmark)
+
 /**
  * Runs a test suite.
  */
 void runTests(void);
 
+/**
+ * Runs the benchmark suite. Each benchmark is warmed up and calibrated
+ * to an iteration count that runs long enough to time reliably, then
+ * sampled several times. Results go to stdout as one machine-readable
+ * line per benchmark:
+ *
+ *   BENCH <name> iters=<n> min=<ns> median=<ns> stddev=<ns>
+ *
+ * where the times are nanoseconds per iteration. If the environment
+ * variable CTEST_BENCHMARK_BASELINE names a file containing BENCH lines
+ * from an earlier run, medians are compared against it, and benchmarks
+ * that regress by more than CTEST_BENCHMARK_THRESHOLD percent (default
+ * 10) are reported on stderr.
+ *
+ * Returns the number of regressions, so callers can gate on it.
+ */
+int runBenchmarks(void);
+
 // Do not call these functions directly. Use macros above instead.
 void addNamedTest(const char* name, void (*test)(void));
+void addNamedBenchmark(const char* name, void (*benchmark)(int iterations));
 void assertTrueWithSource(int value, const char* file, int line, char* message);
     
 #ifdef __cplusplus
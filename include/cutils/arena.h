@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Region-based allocator for parse-and-discard workloads: allocation
+ * is a pointer bump inside cacheline-aligned chunks, individual frees
+ * do not exist, and the whole region is reset in O(1) or freed at
+ * once. Resetting retains the chunks, so a reused arena stops calling
+ * malloc altogether.
+ */
+
+#ifndef __CUTILS_ARENA_H
+#define __CUTILS_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Arena Arena;
+
+/* create an arena; chunk_size 0 picks a sensible default */
+Arena *arena_new(size_t chunk_size);
+
+/* free the arena and all memory ever allocated from it */
+void arena_free(Arena *arena);
+
+/* allocate 'size' bytes, aligned for any type; returns NULL on
+** out-of-memory. There is no way to free a single allocation. */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* allocate and zero */
+void *arena_zalloc(Arena *arena, size_t size);
+
+/* copy a string into the arena */
+char *arena_strdup(Arena *arena, const char *str);
+
+/* discard every allocation at once, keeping the chunks for reuse */
+void arena_reset(Arena *arena);
+
+/* returns an arena private to the calling thread, created on first
+** use and freed automatically when the thread exits */
+Arena *arena_for_thread(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_ARENA_H */
@@ -54,12 +54,52 @@ int arraySetSize(Array* array, int size);
 /** Returns the size of the given array. */
 int arraySize(Array* array);
 
-/** 
- * Returns a pointer to a C-style array which will be valid until this array 
+/**
+ * Returns a pointer to a C-style array which will be valid until this array
  * changes.
  */
 const void** arrayUnwrap(Array* array);
 
+/**
+ * Compares two elements. Returns < 0 if a is less than b, 0 if they are
+ * equal, > 0 otherwise.
+ */
+typedef int ArrayComparator(const void* a, const void* b);
+
+/** Decides whether an element matches. Returns true to remove it. */
+typedef int ArrayPredicate(void* element, void* context);
+
+/** Sorts the array with the given comparator. */
+void arraySort(Array* array, ArrayComparator* compare);
+
+/**
+ * Binary searches a sorted array. Returns the index of the element or -1
+ * if it's not present.
+ */
+int arraySortedFind(Array* array, const void* needle,
+        ArrayComparator* compare);
+
+/**
+ * Inserts a pointer into a sorted array, keeping it sorted. Returns 0 if
+ * successful, < 0 otherwise.
+ */
+int arraySortedAdd(Array* array, void* pointer, ArrayComparator* compare);
+
+/**
+ * Removes the pointer at the given index by moving the last element into
+ * its place, avoiding the memmove of arrayRemove. The array order is not
+ * preserved. Returns the removed pointer.
+ */
+void* arrayRemoveUnordered(Array* array, int index);
+
+/**
+ * Removes every element the predicate matches in one compaction pass,
+ * preserving the order of the survivors. Returns the number of elements
+ * removed.
+ */
+int arrayRemoveMatching(Array* array, ArrayPredicate* predicate,
+        void* context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,33 @@ int ashmem_set_prot_region(int fd, int prot);
 int ashmem_pin_region(int fd, size_t offset, size_t len);
 int ashmem_unpin_region(int fd, size_t offset, size_t len);
 
+/*
+ * Pool of recycled ashmem regions, bucketed by power-of-two size class.
+ * Pooled regions are kept unpinned, so the kernel may reclaim their pages
+ * under memory pressure; they are pinned again on reuse, at which point
+ * their previous contents may be gone (normal ashmem purging semantics).
+ */
+
+struct ashmem_pool_stats {
+	int hits;	/* acquires served from the pool */
+	int misses;	/* acquires that had to create a region */
+	int purged;	/* reused regions whose pages had been reclaimed */
+	int cached;	/* regions currently sitting in the pool */
+};
+
+/* returns an fd for a region of at least `size' bytes, or <0 on error.
+ * `name' is only applied if a fresh region has to be created */
+int ashmem_pool_acquire(const char *name, size_t size);
+
+/* hands fd's region back to the pool (or closes it if it does not fit).
+ * `size' must be the size passed to ashmem_pool_acquire */
+void ashmem_pool_release(int fd, size_t size);
+
+/* closes all regions currently cached in the pool */
+void ashmem_pool_trim(void);
+
+void ashmem_pool_get_stats(struct ashmem_pool_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -58,7 +58,12 @@ int32_t android_atomic_swap(int32_t value, volatile int32_t* addr);
 
 int64_t android_quasiatomic_swap_64(int64_t value, volatile int64_t* addr);
 int64_t android_quasiatomic_read_64(volatile int64_t* addr);
-    
+
+/* like the 32-bit ops, returns the previous value */
+int64_t android_quasiatomic_add_64(int64_t value, volatile int64_t* addr);
+
+void android_quasiatomic_write_64(int64_t value, volatile int64_t* addr);
+
 /*
  * cmpxchg return a non zero value if the exchange was NOT performed,
  * in other words if oldvalue != *addr
@@ -31,6 +31,13 @@ struct cnode
     cnode *last_child;
     const char *name;
     const char *value;
+    /* child lookup index, built internally once a node has enough
+    ** children for linear scans to hurt */
+    cnode *hnext;
+    cnode **buckets;
+    unsigned nbuckets;
+    unsigned nchildren;
+    unsigned hash;
 };
 
 /* parse a text string into a config node tree */
@@ -54,6 +61,15 @@ const char* config_str(cnode *root, const char *name, const char *_default);
 /* add a named child to a config node (or modify it if it already exists) */
 void config_set(cnode *root, const char *name, const char *value);
 
+/* write a parsed tree out as a flat image with an interned string pool;
+** returns 0 on success */
+int config_freeze(cnode *root, const char *fn);
+
+/* mmap a file written by config_freeze and attach its nodes under root,
+** skipping the parser entirely; returns 0 on success or -1 if the file
+** is missing or not a valid frozen config */
+int config_load_frozen(cnode *root, const char *fn);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,11 +21,37 @@
 extern "C" {
 #endif
 
-/* returns a string contiaining an ASCII representation of the CPU serial number, 
+/* returns a string contiaining an ASCII representation of the CPU serial number,
 ** or NULL if cpu info not available.
 ** The string is a static variable, so don't call free() on it.
 */
 extern const char* get_cpu_serial_number(void);
+
+/* ISA feature bits reported by get_cpu_info() */
+#define CPU_FEATURE_THUMB   (1 << 0)
+#define CPU_FEATURE_VFP     (1 << 1)
+#define CPU_FEATURE_EDSP    (1 << 2)
+#define CPU_FEATURE_NEON    (1 << 3)
+
+/* per-core frequencies are only recorded for this many cores */
+#define CPU_MAX_CORES 8
+
+typedef struct {
+    int         core_count;
+    int         arch_version;       /* ARM architecture version, 0 if unknown */
+    unsigned    features;           /* CPU_FEATURE_* bits */
+    int         cache_line_size;    /* bytes; a conservative default if unknown */
+    /* per-core cpuinfo_max_freq in kHz for the first CPU_MAX_CORES
+    ** cores, 0 if unknown */
+    int         max_freq_khz[CPU_MAX_CORES];
+} cpu_info_t;
+
+/* returns the CPU topology and feature bits, probed from /proc/cpuinfo
+** and sysfs exactly once and cached, so runtime-dispatch decisions can
+** read a struct instead of re-parsing. The pointer is to a static
+** structure and is always non-NULL.
+*/
+extern const cpu_info_t* get_cpu_info(void);
     
 #ifdef __cplusplus
 }
@@ -24,3 +24,14 @@ int get_file_hash(HashAlgorithm algorithm, const char *path,
 int get_recursive_hash_manifest(HashAlgorithm algorithm,
                                 const char *directory_path,
                                 char **output_string);
+
+/*
+ * Same manifest, but backed by a persistent cache of
+ * (path, size, mtime, hash) at cache_path: files whose size and mtime
+ * are unchanged since the previous run are not re-read.  The cache is
+ * refreshed in place; losing or corrupting it only costs a full hash.
+ */
+int get_recursive_hash_manifest_incremental(HashAlgorithm algorithm,
+                                            const char *directory_path,
+                                            const char *cache_path,
+                                            char **output_string);
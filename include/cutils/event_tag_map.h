@@ -43,6 +43,18 @@ void android_closeEventTagMap(EventTagMap* map);
  */
 const char* android_lookupEventTag(const EventTagMap* map, int tag);
 
+/*
+ * Write a loaded map back out as a precompiled binary map (a hash
+ * table over fixed-width records plus a string pool).  A compiled map
+ * is mmap'd read-only and shared between processes, and lookups in it
+ * are a single hash probe with no parsing at load time.
+ * android_openEventTagMap() uses "<fileName>.bin" automatically when
+ * it exists and is no older than the text file.
+ *
+ * Returns 0 on success.
+ */
+int android_writeEventTagMap(const EventTagMap* map, const char* fileName);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,7 +57,53 @@ void fdevent_del(fdevent *fde, unsigned events);
 */
 void fdevent_loop();
 
-struct fdevent 
+/* one-shot timers, multiplexed onto the loop's own wait: a loop with
+** no armed timers never wakes up for them, and deadlines are rounded
+** up to a coalescing granularity so timers due close together fire on
+** a single wakeup.  callbacks run on the loop thread, between fd
+** dispatch rounds.
+*/
+typedef struct fdevent_timer fdevent_timer;
+
+typedef void (*timer_func)(void *arg);
+
+struct fdevent_timer
+{
+    fdevent_timer *next;
+    fdevent_timer *prev;
+
+    long long deadline;     /* absolute, in ms */
+    long long tick;         /* deadline in granularity units */
+
+    timer_func func;
+    void *arg;
+};
+
+/* Arm (or re-arm) a timer to fire once, ms milliseconds from now.
+** The struct must be zero-initialized before it is first armed.
+*/
+void fdevent_timer_set(fdevent_timer *t, timer_func func, void *arg,
+                       unsigned ms);
+
+/* Disarm a timer; harmless if it is not armed
+*/
+void fdevent_timer_cancel(fdevent_timer *t);
+
+/* Set the coalescing granularity (default 10ms).  Larger values trade
+** timer precision for fewer wakeups.
+*/
+void fdevent_timer_slack(unsigned ms);
+
+/* always-on loop statistics: iterations, callbacks dispatched, and a
+** power-of-two histogram of per-iteration dispatch latency (bucket n
+** counts iterations that took less than 2^n milliseconds; the last
+** bucket collects everything slower).
+*/
+#define FDEVENT_LAT_BUCKETS 8
+void fdevent_get_stats(unsigned *loops, unsigned *callbacks,
+                       unsigned latency[FDEVENT_LAT_BUCKETS]);
+
+struct fdevent
 {
     fdevent *next;
     fdevent *prev;
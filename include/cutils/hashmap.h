@@ -41,6 +41,42 @@ typedef struct Hashmap Hashmap;
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
 
+/**
+ * Creates a hash map which is safe to use from several threads at once
+ * without external locking. Writes are serialized on a small set of
+ * striped locks, reads take no lock at all, and the table is rehashed
+ * incrementally so a resize never stops all readers. Returns NULL if
+ * memory allocation fails.
+ *
+ * The regular hash map functions work on maps of both kinds. A read
+ * which races with a write may observe the map either before or after
+ * that write, but never a mix of the two. Keys put in a concurrent map
+ * must stay valid until the map is freed; hashmapForEach() must run
+ * between hashmapLock() and hashmapUnlock(), which quiesce the map by
+ * taking every striped lock.
+ *
+ * @param initialCapacity number of expected entries
+ * @param hash function which hashes keys
+ * @param equals function which compares keys for equality
+ */
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
+
+/**
+ * Creates a hash map which stores its entries in one flat open-addressed
+ * array instead of a malloc'd chain node per entry. Lookups probe
+ * consecutive slots, which is far friendlier to the cache than chasing
+ * pointers across the heap, and adding an entry allocates nothing.
+ * The regular hash map functions work on maps of both kinds. Returns
+ * NULL if memory allocation fails.
+ *
+ * @param initialCapacity number of expected entries
+ * @param hash function which hashes keys
+ * @param equals function which compares keys for equality
+ */
+Hashmap* hashmapCreateFlat(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
+
 /**
  * Frees the hash map. Does not free the keys or values themselves.
  */
@@ -303,8 +303,10 @@ typedef enum {
             sizeof(longBuf));                                               \
     }
 #define LOG_EVENT_STRING(_tag, _value)                                      \
-    ((void) 0)  /* not implemented -- must combine len with string */
-/* TODO: something for LIST */
+    ((void) android_bswriteLog(_tag, _value))
+/* a typed list, e.g. LOG_EVENT_LIST(tag, "isl", count, name, micros) */
+#define LOG_EVENT_LIST(_tag, _fmt...)                                       \
+    ((void) __android_log_event_list(_tag, _fmt))
 
 /*
  * ===========================================================================
@@ -328,6 +330,8 @@ typedef enum {
     __android_log_bwrite(tag, payload, len)
 #define android_btWriteLog(tag, type, payload, len) \
     __android_log_btwrite(tag, type, payload, len)
+#define android_bswriteLog(tag, payload) \
+    __android_log_bswrite(tag, payload)
 	
 // TODO: remove these prototypes and their users
 #define android_testLog(prio, tag) (1)
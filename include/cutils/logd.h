@@ -55,6 +55,14 @@ int __android_log_vprint(int prio, const char *tag,
 int __android_log_bwrite(int32_t tag, const void *payload, size_t len);
 int __android_log_btwrite(int32_t tag, char type, const void *payload,
     size_t len);
+int __android_log_bswrite(int32_t tag, const char *payload);
+
+/*
+ * Binary list event from typed arguments, no printf formatting: each
+ * character of "fmt" is the type of the matching vararg, 'i' for
+ * int32_t, 'l' for int64_t, 's' for a NUL-terminated string.
+ */
+int __android_log_event_list(int32_t tag, const char *fmt, ...);
 
 int __android_log_print(int prio, const char *tag,  const char *fmt, ...)
 #if defined(__GNUC__)
@@ -64,13 +72,27 @@ int __android_log_print(int prio, const char *tag,  const char *fmt, ...)
 
 
 void __android_log_assert(const char *cond, const char *tag,
-			  const char *fmt, ...)    
+			  const char *fmt, ...)
 #if defined(__GNUC__)
     __attribute__ ((noreturn))
     __attribute__ ((format(printf, 3, 4)))
 #endif
     ;
 
+/*
+ * Switch this process to asynchronous logging: log calls copy the
+ * record into a bounded in-process buffer and return, and a background
+ * thread hands the records to the log device in order.  When the
+ * buffer is full new records are dropped (and the drops noted in the
+ * log) rather than blocking the caller; records still buffered at
+ * process exit are lost.  Returns 0 on success, -1 if the log device
+ * is unavailable or the flusher could not be started.
+ */
+int __android_log_async_start(void);
+
+/* total records dropped so far because the async buffer was full */
+int __android_log_async_dropped(void);
+
 #ifdef __cplusplus
 }
 #endif
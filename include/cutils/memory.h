@@ -30,6 +30,26 @@ void android_memset16(uint16_t* dst, uint16_t value, size_t size);
 /* size is given in bytes and must be multiple of 4 */
 void android_memset32(uint32_t* dst, uint32_t value, size_t size);
 
+/* copies 'height' rows of 'width' bytes between two non-overlapping
+ * buffers, stepping by the given strides (in bytes) after each row;
+ * adjacent rows are coalesced into larger copies when the strides allow */
+void android_memcpy_rect(void* dst, size_t dstStride,
+        const void* src, size_t srcStride, size_t width, size_t height);
+
+/* rotates a width x height rect of pixels by the given number of
+ * clockwise quarter turns (0-3, the FB_ROTATE encoding) into a
+ * non-overlapping destination; for odd turns the destination is
+ * height pixels wide and width tall.  strides are in pixels.  the
+ * copy runs in cache-sized tiles so the column-order stream a
+ * rotation creates doesn't miss on every access */
+void android_rotate_rect16(uint16_t* dst, size_t dstStride,
+        const uint16_t* src, size_t srcStride,
+        size_t width, size_t height, int turns);
+
+void android_rotate_rect32(uint32_t* dst, size_t dstStride,
+        const uint32_t* src, size_t srcStride,
+        size_t width, size_t height, int turns);
+
 #if !HAVE_STRLCPY
 /* Declaration of strlcpy() for platforms that don't already have it. */
 size_t strlcpy(char *dst, const char *src, size_t size);
@@ -28,6 +28,19 @@ extern "C" {
          */
 extern void *load_file(const char *fn, unsigned *sz);
 
+        /* Map an entire file into memory instead of copying it
+         * into the heap. The mapping is private: writes are
+         * copy-on-write and never reach the file. Unlike
+         * load_file(), the contents are NOT null terminated.
+         * If sz is non-zero, return the size of the file via sz.
+         * Returns 0 on failure or if the file is empty. Release
+         * the view with unmap_file().
+         */
+extern void *map_file(const char *fn, unsigned *sz);
+
+        /* Releases a view returned by map_file(). */
+extern void unmap_file(void *data, unsigned sz);
+
         /* Connects your process to the system debugger daemon
          * so that on a crash it may be logged or interactively
          * debugged (depending on system settings).
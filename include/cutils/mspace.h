@@ -83,6 +83,41 @@ mspace create_contiguous_mspace_with_name(size_t starting_capacity,
 size_t destroy_contiguous_mspace(mspace msp);
 #endif
 
+/*
+  Heap statistics for one mspace, gathered by walking its chunks.
+  free_bytes and largest_free together give a fragmentation measure:
+  the closer largest_free is to free_bytes, the less fragmented the
+  space is.
+*/
+struct mspace_stats {
+  size_t live_bytes;      /* user bytes in allocated chunks */
+  size_t free_bytes;      /* bytes in free chunks */
+  size_t largest_free;    /* biggest single free chunk */
+  size_t footprint;       /* bytes currently obtained from the system */
+  size_t max_footprint;   /* high watermark of footprint */
+  int live_chunks;
+  int free_chunks;
+};
+
+void mspace_get_stats(mspace msp, struct mspace_stats *stats);
+
+/*
+  Returns the mspace registered under `name', creating it (as a locked
+  contiguous mspace) on first use.  Long-running daemons can give each
+  allocation-heavy subsystem its own space this way, so churn in one
+  subsystem cannot fragment the others, and mspace_stats_report() can
+  show where the memory went.  Returns 0 if the space cannot be created
+  or the registry is full.
+*/
+mspace mspace_for_subsystem(const char *name, size_t starting_capacity,
+    size_t max_capacity);
+
+/*
+  Formats one line of statistics per registered subsystem space into
+  buf, and returns the number of bytes written (snprintf-style).
+*/
+int mspace_stats_report(char *buf, size_t bufsize);
+
 /*
   Call the handler for each block in the specified mspace.
   chunkptr and chunklen refer to the heap-level chunk including
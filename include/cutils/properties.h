@@ -43,8 +43,75 @@ int property_get(const char *key, char *value, const char *default_value);
 /* property_set: returns 0 on success, < 0 on failure
 */
 int property_set(const char *key, const char *value);
+
+/* property_set_bulk: set count properties over a single connection to
+** the property service, instead of one connection per property_set.
+** keys[i] is paired with values[i]; a null value is taken as "".
+** Stops at the first failure; returns 0 if all were sent, < 0 otherwise.
+*/
+int property_set_bulk(const char **keys, const char **values, int count);
     
-int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);    
+int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
+
+/* property_serial: returns a token which changes whenever any system
+** property changes, at the cost of a single shared-memory read. Use it
+** to skip re-reading properties which cannot have changed. On builds
+** without a shared property area the token only tracks local
+** property_set calls.
+*/
+unsigned property_serial(void);
+
+/* property_wait: blocks until the named property's serial differs from
+** old_serial, then returns the new serial; pass the returned value back
+** in to wait for the next change. Pass 0 the first time around: for a
+** property that is already set the first call returns at once with the
+** current serial, for one not yet defined it blocks until the property
+** appears. A NULL key waits on the whole property area instead, using
+** the same token as property_serial().
+**
+** On devices this sleeps on the property area's futex and costs nothing
+** while nothing changes; builds without a shared area fall back to
+** polling the local serial.
+*/
+unsigned property_wait(const char *key, unsigned old_serial);
+
+/* A caller-owned cache for one property, for code which reads the same
+** property in a hot loop. Zero-initialize before first use. Not
+** thread-safe; give each thread its own cache.
+*/
+typedef struct {
+    unsigned serial;
+    int len;
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+} property_cache_t;
+
+/* property_cache_get: like property_get, but only does a full lookup
+** when the property serial has changed since the cached value was
+** read. When the property is undefined and no default is given, value
+** is set to the empty string.
+*/
+int property_cache_get(property_cache_t *cache, const char *key,
+                       char *value, const char *default_value);
+
+/* Called with the property's key, its new value (the empty string if
+** it became undefined) and the cookie it was registered with.
+*/
+typedef void property_watch_fn(const char *key, const char *value,
+                               void *cookie);
+
+/* property_watch: registers a callback to run from within
+** property_watch_poll() whenever the property's value has changed.
+** Returns 0 on success, < 0 on failure.
+*/
+int property_watch(const char *key, property_watch_fn *fn, void *cookie);
+
+/* property_watch_poll: fires the callbacks for all watched properties
+** which changed since the last poll. Costs a single shared-memory read
+** when nothing changed, so it is cheap enough to call once per frame.
+** Callbacks must not call property_watch or property_watch_poll.
+*/
+void property_watch_poll(void);
 
 
 #ifdef HAVE_SYSTEM_PROPERTY_SERVER
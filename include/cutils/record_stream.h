@@ -21,6 +21,8 @@
 #ifndef _CUTILS_RECORD_STREAM_H
 #define _CUTILS_RECORD_STREAM_H
 
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,7 +33,16 @@ typedef struct RecordStream RecordStream;
 extern RecordStream *record_stream_new(int fd, size_t maxRecordLen);
 extern void record_stream_free(RecordStream *p_rs);
 
-extern int record_stream_get_next (RecordStream *p_rs, void ** p_outRecord, 
+extern int record_stream_get_next (RecordStream *p_rs, void ** p_outRecord,
+                                    size_t *p_outRecordLen);
+
+/* Batched reading: record_stream_fill() refills the buffer with one
+ * vectored read, then record_stream_next() iterates over the complete
+ * records already buffered without further syscalls or copying.
+ * record_stream_get_next() is equivalent to one next/fill/next cycle.
+ */
+extern ssize_t record_stream_fill (RecordStream *p_rs);
+extern int record_stream_next (RecordStream *p_rs, void ** p_outRecord,
                                     size_t *p_outRecordLen);
 
 #ifdef __cplusplus
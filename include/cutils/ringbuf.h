@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Bounded ring buffer carrying pointer-sized entries from any number
+ * of producer threads to one consumer thread. Producers never block
+ * and never allocate: a put costs a compare-and-swap to claim a slot
+ * and an atomic store to publish it. The consumer can poll for free,
+ * or sleep on a file descriptor which becomes readable when entries
+ * arrive, so a buffer drops into a select/poll loop.
+ */
+
+#ifndef __RINGBUF_H
+#define __RINGBUF_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A ring buffer. */
+typedef struct RingBuffer RingBuffer;
+
+/**
+ * Creates a new ring buffer holding at least 'capacity' entries,
+ * rounded up to a power of 2. Returns NULL if memory or file
+ * descriptor allocation fails.
+ */
+RingBuffer* ringbufCreate(size_t capacity);
+
+/**
+ * Frees the ring buffer. Does not free the entries themselves. No
+ * thread may touch the buffer once this starts.
+ */
+void ringbufFree(RingBuffer* buffer);
+
+/** Gets the buffer's capacity in entries. */
+size_t ringbufCapacity(RingBuffer* buffer);
+
+/**
+ * Enqueues one entry. Safe to call from several threads at once.
+ * Returns false if the buffer is full.
+ */
+bool ringbufPut(RingBuffer* buffer, void* value);
+
+/**
+ * Enqueues up to 'count' entries from 'values' as one contiguous
+ * claim. Safe to call from several threads at once. Returns the
+ * number actually enqueued, which is less than 'count' if the buffer
+ * filled up.
+ */
+size_t ringbufPutMany(RingBuffer* buffer, void** values, size_t count);
+
+/**
+ * Dequeues one entry into '*value'. Only the single consumer thread
+ * may call this. Returns false if the buffer is empty.
+ */
+bool ringbufGet(RingBuffer* buffer, void** value);
+
+/**
+ * Dequeues up to 'count' entries into 'values'. Only the single
+ * consumer thread may call this. Returns the number dequeued.
+ */
+size_t ringbufGetMany(RingBuffer* buffer, void** values, size_t count);
+
+/**
+ * Returns a file descriptor for the consumer to poll or select on; it
+ * becomes readable when entries arrive after ringbufBeginWait().
+ */
+int ringbufWakeFd(RingBuffer* buffer);
+
+/**
+ * Arms the wakeup descriptor. Returns true if entries are already
+ * available, in which case there is no need to sleep. Otherwise the
+ * consumer may sleep on ringbufWakeFd() and must call ringbufEndWait()
+ * when it wakes. Only the consumer thread may call this.
+ */
+bool ringbufBeginWait(RingBuffer* buffer);
+
+/**
+ * Clears the wakeup descriptor after sleeping on it.
+ */
+void ringbufEndWait(RingBuffer* buffer);
+
+/**
+ * Blocks the consumer until at least one entry is available.
+ */
+void ringbufWait(RingBuffer* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RINGBUF_H */
@@ -95,6 +95,12 @@ struct SelectableFd {
      * The selector which selected this fd. Set by the selector itself.
      */
     Selector* selector;
+
+    /**
+     * Event mask currently registered with the kernel. Managed by the
+     * selector itself; do not modify.
+     */
+    int installedEvents;
 };
 
 /** 
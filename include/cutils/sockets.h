@@ -85,6 +85,14 @@ static inline int android_get_control_socket(const char *name)
 
 extern int socket_loopback_client(int port, int type);
 extern int socket_network_client(const char *host, int port, int type);
+/* like socket_network_client, but gives up after timeout_ms and races
+ * the resolved addresses in parallel instead of trying them one at a
+ * time; name resolution itself is still synchronous */
+extern int socket_network_client_timeout(const char *host, int port,
+        int type, int timeout_ms);
+/* standard transport tuning (TCP_NODELAY, bigger buffers), shared by
+ * adb and the debugging tools */
+extern int socket_set_transport_options(int s, int type);
 extern int socket_loopback_server(int port, int type);
 extern int socket_local_server(const char *name, int namespaceId, int type);
 extern int socket_local_server_bind(int s, const char *name, int namespaceId);
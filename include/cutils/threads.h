@@ -139,6 +139,45 @@ static __inline__ void  mutex_destroy(mutex_t*  lock)
 }
 #endif
 
+/***********************************************************************/
+/***********************************************************************/
+/*****                                                             *****/
+/*****         thread object cache                                 *****/
+/*****                                                             *****/
+/***********************************************************************/
+/***********************************************************************/
+
+/*
+ * A cache for fixed-size objects: each thread keeps a short freelist
+ * of released objects it can recycle without taking a lock, and the
+ * overflow spills into a central pool shared by all threads.  Objects
+ * must be at least sizeof(void*) bytes; their contents are undefined
+ * when allocated.  Define one statically:
+ *
+ *     static thread_cache_t  cache =
+ *         THREAD_CACHE_INITIALIZER(sizeof(myobj), 16, 64);
+ *
+ * where 16 is the per-thread freelist depth and 64 caps the central
+ * pool; objects released beyond both limits are simply freed.
+ */
+typedef struct {
+    thread_store_t    store;         /* per-thread freelists */
+    mutex_t           lock;          /* guards the fields below */
+    void*             central;       /* overflow freelist */
+    int               central_count;
+    int               central_max;   /* beyond this, release frees */
+    int               thread_max;    /* objects kept per thread */
+    size_t            obj_size;
+} thread_cache_t;
+
+#define  THREAD_CACHE_INITIALIZER(objsize, threadmax, centralmax) \
+    { THREAD_STORE_INITIALIZER, MUTEX_INITIALIZER, NULL, 0, \
+      (centralmax), (threadmax), (objsize) }
+
+extern void*  thread_cache_alloc(thread_cache_t*  cache);
+
+extern void   thread_cache_release(thread_cache_t*  cache, void*  object);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_TIMER_H
+#define __CUTILS_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* time in nanoseconds; signed so intervals can be subtracted freely */
+typedef int64_t nsecs_t;
+
+#define NSECS_PER_USEC 1000LL
+#define NSECS_PER_MSEC 1000000LL
+#define NSECS_PER_SEC  1000000000LL
+
+/* system_time: monotonic time in nanoseconds. Uses CLOCK_MONOTONIC
+** where available, so it never jumps when the wall clock is set; on
+** other platforms resolution degrades but the value still only moves
+** forward within a process.
+*/
+extern nsecs_t system_time(void);
+
+/* cycle_counter: raw CPU cycle counter where one can be read from user
+** space (TSC on x86); elsewhere it falls back to system_time(), so it
+** is always usable, just not always cheaper than a clock read. Compare
+** readings only on the same core.
+*/
+extern uint64_t cycle_counter(void);
+
+/* cycles_per_usec: cycle_counter() rate, calibrated against
+** system_time() on the first call (which therefore takes a couple of
+** milliseconds). Never returns 0.
+*/
+extern unsigned cycles_per_usec(void);
+
+/* cycles_to_ns: convert a cycle_counter() interval to nanoseconds
+** using the calibrated rate.
+*/
+extern nsecs_t cycles_to_ns(uint64_t cycles);
+
+/* Interval statistics with power-of-two bucketing: bucket n counts
+** intervals in [2^n, 2^(n+1)) nanoseconds, with the first and last
+** buckets absorbing underflow and overflow. Small enough to embed one
+** per instrumented path; zero-initialize or call interval_stats_init()
+** before use. Not thread-safe; guard with the caller's own lock.
+*/
+#define INTERVAL_STATS_BUCKETS 32
+
+typedef struct {
+    unsigned count;
+    nsecs_t min;
+    nsecs_t max;
+    nsecs_t total;
+    unsigned buckets[INTERVAL_STATS_BUCKETS];
+} interval_stats_t;
+
+extern void interval_stats_init(interval_stats_t *s);
+extern void interval_stats_add(interval_stats_t *s, nsecs_t interval);
+
+/* interval_stats_format: writes "count/min/avg/max" and the non-empty
+** buckets into buf, always 0-terminated. Returns the length written,
+** like snprintf.
+*/
+extern int interval_stats_format(const interval_stats_t *s,
+                                 char *buf, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_TIMER_H */
@@ -39,6 +39,19 @@ struct strftime_locale {
 
 size_t strftime_tz(char *s, size_t max, const char *format, const struct tm *tm, const struct strftime_locale *locale);
 
+/*
+ * Compiled variant for callers that format many times through one
+ * format string (log printers, mostly): compile parses the format
+ * once into an op list, and strftime_fmt() plays it back without
+ * re-scanning.  The object also caches the last result, so formatting
+ * an identical broken-down time again is just a copy.  An object is
+ * not thread safe; give each thread its own.
+ */
+struct strftime_fmt;
+struct strftime_fmt *strftime_fmt_compile(const char *format);
+size_t strftime_fmt(char *s, size_t max, struct strftime_fmt *fmt, const struct tm *tm, const struct strftime_locale *locale);
+void strftime_fmt_free(struct strftime_fmt *fmt);
+
 #ifdef __cplusplus
 }
 #endif
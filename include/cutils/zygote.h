@@ -25,6 +25,27 @@ int zygote_run_oneshot(int sendStdio, int argc, const char **argv);
 int zygote_run(int argc, const char **argv);
 int zygote_run_wait(int argc, const char **argv, void (*post_run_func)(int));
 
+/*
+ * Like zygote_run_oneshot with sendStdio == 0, but reuses one cached
+ * connection to the zygote for all spawns from this process instead of
+ * connecting every time. Thread safe. Returns the pid or -1.
+ */
+int zygote_run_pooled(int argc, const char **argv);
+
+/* Closes the cached connection, if any. */
+void zygote_close_pool(void);
+
+/*
+ * Asynchronous form of zygote_run_wait, so several spawns can be
+ * started and then waited on together. zygote_run_start() sends the
+ * spawn request, stores the child pid in *spawnedPid, and returns a
+ * handle fd that becomes readable (EOF) when the child exits; poll it
+ * or pass it to zygote_run_finish() to block until then. Returns -1 on
+ * error.
+ */
+int zygote_run_start(int argc, const char **argv, int *spawnedPid);
+int zygote_run_finish(int fd);
+
 #ifdef __cplusplus
 }
 #endif
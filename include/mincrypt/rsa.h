@@ -30,6 +30,8 @@
 
 #include <inttypes.h>
 
+#include "mincrypt/sha.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -49,6 +51,23 @@ int RSA_verify(const RSAPublicKey *key,
                const int len,
                const uint8_t* sha);
 
+/* Incremental flavor of RSA_verify, for callers that want to hash
+** while they read instead of holding the whole image in memory and
+** making a second pass.  Feed the signed data to RSA_verify_update in
+** whatever chunks arrive, then check the signature with
+** RSA_verify_final.  Returns 0 on failure, 1 on success.
+*/
+typedef struct RSAVerifyCtx {
+    SHA_CTX sha;
+    const RSAPublicKey* key;
+} RSAVerifyCtx;
+
+void RSA_verify_init(RSAVerifyCtx* ctx, const RSAPublicKey* key);
+void RSA_verify_update(RSAVerifyCtx* ctx, const void* data, int len);
+int RSA_verify_final(RSAVerifyCtx* ctx,
+                     const uint8_t* signature,
+                     const int len);
+
 #ifdef __cplusplus
 }
 #endif
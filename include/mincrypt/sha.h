@@ -49,6 +49,17 @@ const uint8_t* SHA(const void *data, int len, uint8_t *digest);
 
 #define SHA_DIGEST_SIZE 20
 
+/* Checkpointing. SHA_save() serializes the running state of a context
+** into a fixed-size, byte-order independent record; SHA_restore()
+** rebuilds a context from one. A caller that hashes a large image while
+** writing it can store the record and later resume or finalize the hash
+** without re-reading the data. Valid at any point, not just on block
+** boundaries. */
+#define SHA_SAVED_STATE_SIZE (8 + SHA_DIGEST_SIZE + 64)
+
+void SHA_save(const SHA_CTX *ctx, uint8_t *state);
+void SHA_restore(SHA_CTX *ctx, const uint8_t *state);
+
 #ifdef __cplusplus
 }
 #endif
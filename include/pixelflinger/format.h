@@ -114,6 +114,12 @@ typedef struct {
         } __attribute__((__packed__)) c[4];        
     } __attribute__((__packed__));
 	uint16_t    components;	// GGLFormatComponents
+
+    // batch converters to/from 32-bit RGBA (R in the lowest memory
+    // byte), or NULL when the format has no specialized kernel.
+    // count is in pixels; src and dst may not overlap.
+    void    (*fromRGBA8888)(void* dst, const void* src, size_t count);
+    void    (*toRGBA8888)(void* dst, const void* src, size_t count);
 } GGLFormat;
 
 
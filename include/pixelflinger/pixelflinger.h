@@ -73,6 +73,7 @@ enum GGLNames {
     GGL_AA                          = 0x80000001,
     GGL_W_LERP                      = 0x80000004,
     GGL_POINT_SMOOTH_NICE           = 0x80000005,
+    GGL_OCCLUSION_CULLING           = 0x80000006,
 
     // buffers, pixel drawing/reading
     GGL_COLOR                       = 0x1800,
@@ -172,6 +173,13 @@ enum GGLNames {
     GGL_STENCIL_BUFFER_BIT          = 0x00000400,
     GGL_COLOR_BUFFER_BIT            = 0x00004000,
 
+    // surface layout flags (GGLSurface::flags)
+    // tiled surfaces store texels in 4x4 blocks, which keeps minified
+    // and rotated sampling within a cache line; the stride is rounded
+    // up to a multiple of 4 and gives the block-row pitch
+    GGL_SURFACE_LINEAR              = 0x00000000,
+    GGL_SURFACE_TILED_4X4           = 0x00000001,
+
     // errors
     GGL_NO_ERROR                    = 0,
     GGL_INVALID_ENUM                = 0x0500,
@@ -191,7 +199,8 @@ typedef struct {
     GGLint      stride;     // stride in pixels
     GGLubyte*   data;       // pointer to the bits
     GGLubyte    format;     // pixel format
-    GGLubyte    rfu[3];     // must be zero
+    GGLubyte    flags;      // surface layout flags, 0 = linear
+    GGLubyte    rfu[2];     // must be zero
     // these values are dependent on the used format
     union {
         GGLint  compressedFormat;
@@ -200,6 +209,10 @@ typedef struct {
     void*       reserved;
 } GGLSurface;
 
+// opaque handle to a captured, validated rasterizer state
+// (see captureState below)
+typedef struct GGLStateBlockRec* GGLStateBlock;
+
 
 typedef struct {
     // immediate rendering
@@ -220,6 +233,12 @@ typedef struct {
     void (*readBuffer)(void* c, const GGLSurface* surface);
     void (*depthBuffer)(void* c, const GGLSurface* surface);
     void (*bindTextureLod)(void* c, GGLuint tmu, const GGLSurface* surface);
+    // bind one level of the mipmap chain (level 1 and up; level 0 is
+    // the surface set by bindTexture/bindTextureLod).  all levels must
+    // have the same format as level 0.  minified spans automatically
+    // sample the level whose texel step is closest to one pixel.
+    void (*bindTextureLevel)(void* c, GGLuint tmu, GGLint level,
+            const GGLSurface* surface);
 
     // enable/disable features
     void (*enable)(void* c, GGLenum name);
@@ -297,12 +316,72 @@ typedef struct {
             GGLclampx r, GGLclampx g, GGLclampx b, GGLclampx a);
     void (*clearDepthx)(void* c, GGLclampx depth);
     void (*clearStencil)(void* c, GGLint s);
+    // like clear(), but satisfied lazily: pending regions are cleared
+    // as rendering first reads them, and rows entirely covered by
+    // opaque spans are never cleared at all.  clearDeferred(c, 0)
+    // resolves whatever is still pending; call it (or clear again)
+    // before the buffer is read or scanned out.
+    void (*clearDeferred)(void* c, GGLbitfield mask);
 
     // framebuffer operations
     void (*copyPixels)(void* c, GGLint x, GGLint y,
             GGLsizei width, GGLsizei height, GGLenum type);
     void (*rasterPos2x)(void* c, GGLfixed x, GGLfixed y);
     void (*rasterPos2i)(void* c, GGLint x, GGLint y);
+
+    // pipeline warmup.  the first draw with a new configuration stalls
+    // while its pipeline is assembled; warmup() pre-assembles a list of
+    // configurations on a background thread so known-hot pipelines are
+    // ready before the first frame.  keys are groups of four words
+    // (p, n, t0, t1); the context must stay valid until warmup is done.
+    void (*warmup)(void* c, const GGLuint* keys, GGLsizei count);
+    // copies up to maxCount of the distinct keys observed so far into
+    // keys (four words each) and returns how many have been observed;
+    // pass a null buffer to just query the count.  feed the result
+    // back to warmup() at the next startup.
+    GGLsizei (*dumpNeeds)(void* c, GGLuint* keys, GGLsizei maxCount);
+
+    // restricts all rasterization to a list of dirty rectangles, so a
+    // partial update only touches the memory it changed.  rects are
+    // groups of four ints (l, t, r, b) in window coordinates; the
+    // region stays in effect across draws and state changes until it
+    // is replaced, or removed with a null list.
+    void (*dirtyRegion)(void* c, const GGLint* rects, GGLsizei count);
+
+    // like clear(), but the color plane is cleared through per-16x16-
+    // tile metadata: tiles wholly inside the scissor are only flagged
+    // "cleared to the constant" and are materialized the first time
+    // rendering touches them; the flags are honored by the span
+    // readers.  other planes clear eagerly.  clearTiled(c, 0)
+    // materializes whatever is still flagged; call it (or clear again)
+    // before the buffer is read directly or scanned out.
+    void (*clearTiled)(void* c, GGLbitfield mask);
+
+    // draws count/2 independent segments from an array of (x, y)
+    // vertex pairs, like linex() for each one but with the pipeline
+    // validated only once for the whole batch.
+    void (*linesx)(void* c,
+            const GGLcoord* verts, GGLsizei count, GGLcoord width);
+
+    // fills count rects from an array of (l, t, r, b) int groups,
+    // like recti() for each one but with the pipeline validated only
+    // once for the whole batch.  rects are filled in array order.
+    void (*rectsi)(void* c, const GGLint* rects, GGLsizei count);
+
+    // captures the whole rasterizer state - bound buffers, textures
+    // and per-fragment settings - together with the pipeline resolved
+    // for it, into an opaque block.  validates first if needed.
+    // returns 0 on out-of-memory.
+    GGLStateBlock (*captureState)(void* c);
+    // makes a captured block the current state.  no validation runs:
+    // the pipeline saved at capture time is installed directly, so
+    // switching between a handful of blocks costs a copy rather than
+    // a re-pick.  the current color, coordinate iterators and raster
+    // position are not part of a block and keep their values.
+    void (*bindState)(void* c, GGLStateBlock block);
+    // frees a block.  the current state is unaffected, even if the
+    // block is the one last bound.
+    void (*releaseState)(void* c, GGLStateBlock block);
 } GGLContext;
 
 // ----------------------------------------------------------------------------
@@ -109,6 +109,7 @@ template<> struct CTA<true> { };
 #define ggl_unlikely(x)	__builtin_expect(!!(x), 0)
 
 const int GGL_TEXTURE_UNIT_COUNT    = 2;
+const int GGL_TEXTURE_MIP_LEVELS    = 8;    // extra levels below level 0
 const int GGL_TMU_STATE             = 0x00000001;
 const int GGL_CB_STATE              = 0x00000002;
 const int GGL_PIXEL_PIPELINE_STATE  = 0x00000004;
@@ -330,13 +331,21 @@ struct surface_t {
         uint8_t*			data;	
         uint8_t				format;
         uint8_t				dirty;
-        uint8_t				pad[2];
+        uint8_t             flags;
+        uint8_t				pad;
         };
     };
     void                (*read) (const surface_t* s, context_t* c,
                                 uint32_t x, uint32_t y, pixel_t* pixel);
     void                (*write)(const surface_t* s, context_t* c,
                                 uint32_t x, uint32_t y, const pixel_t* pixel);
+    // span variants: operate on count horizontal pixels starting at x,y
+    void                (*read_span) (const surface_t* s, context_t* c,
+                                uint32_t x, uint32_t y, pixel_t* pixels,
+                                uint32_t count);
+    void                (*write_span)(const surface_t* s, context_t* c,
+                                uint32_t x, uint32_t y, const pixel_t* pixels,
+                                uint32_t count);
 };
 
 // ----------------------------------------------------------------------------
@@ -399,6 +408,9 @@ struct texture_t {
     uint8_t             env_color[4];
 	uint8_t				enable;
 	uint8_t				dirty;
+    surface_t*          sampled;    // level the current primitive samples
+    surface_t           lod[GGL_TEXTURE_MIP_LEVELS];    // levels 1..N
+    uint8_t             lod_count;  // number of extra levels bound
 };
 
 struct raster_t {
@@ -504,6 +516,14 @@ struct state_t {
 
 // ----------------------------------------------------------------------------
 
+// per-row bookkeeping for the deferred-clear / occlusion span guard
+// (see clear.cpp and scanline.cpp)
+struct occlusion_row_t {
+    int16_t             l, r;       // opaquely drawn interval [l, r)
+    uint16_t            settled;    // pending clear already applied here
+    uint16_t            reserved;
+};
+
 struct context_t {
 	GGLContext          procs;
 	state_t             state;
@@ -527,6 +547,33 @@ struct context_t {
     void*               base;
     Assembly*           scanline_as;
     GGLenum             error;
+
+    // deferred clear and opaque-span occlusion culling.  these fields
+    // must stay at the end of the context: generated code bakes in the
+    // offsets of everything above them.
+    uint32_t            deferredClear;  // buffer bits with a pending clear
+    uint32_t            clearLeft;      // pending clear rectangle
+    uint32_t            clearTop;
+    uint32_t            clearRight;
+    uint32_t            clearBottom;
+    occlusion_row_t*    occlusion;      // one entry per color-buffer row
+    uint32_t            occlusionRows;
+    uint32_t            occlusionEnabled;
+    void                (*scanline_core)(context_t* c);
+    void                (*rect_core)(context_t* c, size_t yc);
+
+    // dirty-region clipping (see trap.cpp)
+    int32_t*            region;         // rects, groups of four: l,t,r,b
+    uint32_t            regionCount;    // number of rects
+    int32_t             regionBounds[4];// union of the region
+
+    // tile-status fast clear (see clear.cpp).  a flagged tile holds
+    // tileClearColor instead of real pixels until it is materialized
+    uint8_t*            tileStatus;     // one byte per 16x16 color tile
+    uint32_t            tileCols;
+    uint32_t            tileRows;
+    uint32_t            tileActive;     // number of tiles still flagged
+    uint32_t            tileClearColor; // packed clear value, memory order
 };
 
 // ----------------------------------------------------------------------------
@@ -172,6 +172,37 @@ inline GGLfixed gglMulSubx(GGLfixed x, GGLfixed y, GGLfixed a, int shift) {
     return result;
 }
 
+// fused dual multiply-accumulate: (x*y + u*v)>>shift, with the sum
+// accumulated in 64 bits before the final shift (and rounding)
+inline GGLfixed gglMulMulAddx(GGLfixed x, GGLfixed y,
+        GGLfixed u, GGLfixed v, int shift) CONST;
+inline GGLfixed gglMulMulAddx(GGLfixed x, GGLfixed y,
+        GGLfixed u, GGLfixed v, int shift) {
+    GGLfixed result, t;
+    if (__builtin_constant_p(shift)) {
+    asm("smull  %[lo], %[hi], %[x], %[y]            \n"
+        "smlal  %[lo], %[hi], %[u], %[v]            \n"
+        "movs   %[lo], %[lo], lsr %[rshift]         \n"
+        "adc    %[lo], %[lo], %[hi], lsl %[lshift]  \n"
+        : [lo]"=&r"(result), [hi]"=&r"(t), [x]"=&r"(x)
+        : "%[x]"(x), [y]"r"(y), [u]"r"(u), [v]"r"(v),
+          [lshift] "I"(32-shift), [rshift] "I"(shift)
+        : "cc"
+        );
+    } else {
+    asm("smull  %[lo], %[hi], %[x], %[y]            \n"
+        "smlal  %[lo], %[hi], %[u], %[v]            \n"
+        "movs   %[lo], %[lo], lsr %[rshift]         \n"
+        "adc    %[lo], %[lo], %[hi], lsl %[lshift]  \n"
+        : [lo]"=&r"(result), [hi]"=&r"(t), [x]"=&r"(x)
+        : "%[x]"(x), [y]"r"(y), [u]"r"(u), [v]"r"(v),
+          [lshift] "r"(32-shift), [rshift] "r"(shift)
+        : "cc"
+        );
+    }
+    return result;
+}
+
 inline int64_t gglMulii(int32_t x, int32_t y) CONST;
 inline int64_t gglMulii(int32_t x, int32_t y)
 {
@@ -205,6 +236,12 @@ inline GGLfixed gglMulSubx(GGLfixed a, GGLfixed b, GGLfixed c, int shift) CONST;
 inline GGLfixed gglMulSubx(GGLfixed a, GGLfixed b, GGLfixed c, int shift) {
     return GGLfixed((int64_t(a)*b)>>shift) - c;
 }
+inline GGLfixed gglMulMulAddx(GGLfixed a, GGLfixed b,
+        GGLfixed c, GGLfixed d, int shift) CONST;
+inline GGLfixed gglMulMulAddx(GGLfixed a, GGLfixed b,
+        GGLfixed c, GGLfixed d, int shift) {
+    return GGLfixed((int64_t(a)*b + int64_t(c)*d + (1<<(shift-1)))>>shift);
+}
 inline int64_t gglMulii(int32_t a, int32_t b) CONST;
 inline int64_t gglMulii(int32_t a, int32_t b) {
     return int64_t(a)*b;
@@ -226,6 +263,12 @@ inline GGLfixed gglMulSubx(GGLfixed a, GGLfixed b, GGLfixed c) CONST;
 inline GGLfixed gglMulSubx(GGLfixed a, GGLfixed b, GGLfixed c) {
     return gglMulSubx(a, b, c, 16);
 }
+inline GGLfixed gglMulMulAddx(GGLfixed a, GGLfixed b,
+        GGLfixed c, GGLfixed d) CONST;
+inline GGLfixed gglMulMulAddx(GGLfixed a, GGLfixed b,
+        GGLfixed c, GGLfixed d) {
+    return gglMulMulAddx(a, b, c, d, 16);
+}
 
 // ------------------------------------------------------------------------
 
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _USBHOST_USBHOST_H
+#define _USBHOST_USBHOST_H
+
+/* Shared host-side USB device scanning for the linux usbdevfs
+** backends of adb and fastboot.  One walk of /dev/bus/usb parses the
+** descriptor set of every device and hands each interface to a
+** callback; the caller decides to ignore it, note it, or claim it.
+**
+** Rejected device nodes are remembered with their mtime and inode
+** and skipped while unchanged, so a once-a-second polling loop does
+** not re-read descriptors and serial strings from devices it has
+** already turned down.
+*/
+
+/* one interface of a scanned device, plus the device identity */
+typedef struct usb_ifc_match usb_ifc_match;
+
+struct usb_ifc_match
+{
+    const char *dev_name;         /* usbdevfs node for this device */
+
+    unsigned short dev_vendor;
+    unsigned short dev_product;
+
+    unsigned char dev_class;
+    unsigned char dev_subclass;
+    unsigned char dev_protocol;
+
+    unsigned char ifc_class;
+    unsigned char ifc_subclass;
+    unsigned char ifc_protocol;
+    unsigned char ifc_number;     /* bInterfaceNumber */
+
+    unsigned char has_bulk_in;    /* ep_in/ep_out below are valid */
+    unsigned char has_bulk_out;
+    unsigned char ep_in;
+    unsigned char ep_out;
+    unsigned short ep_max_packet; /* wMaxPacketSize of the bulk in
+                                     endpoint (out if there is no in) */
+
+    char serial_number[256];
+};
+
+/* callback verdicts */
+#define USB_SCAN_CONTINUE 0   /* not interesting; the device may be
+                                 remembered as rejected */
+#define USB_SCAN_MATCH    1   /* caller noted the device; move on to
+                                 the next one, never cache it */
+#define USB_SCAN_CLAIM    2   /* claim this interface now; the scan
+                                 returns the open fd */
+
+typedef int (*usb_scan_cb)(usb_ifc_match *m, void *cookie);
+
+/* returns nonzero if dev_name should be skipped without opening it;
+** used by callers which track their open devices themselves
+*/
+typedef int (*usb_skip_cb)(const char *dev_name, void *cookie);
+
+/* Walk every device under base (normally "/dev/bus/usb") and run cb
+** over each interface.  Returns the claimed interface's open fd once
+** a callback answers USB_SCAN_CLAIM and the claim succeeds, -1
+** otherwise.
+**
+** When skip is null, bus directories whose mtime has not changed
+** since they last came up empty are skipped wholesale; callers which
+** mark-and-sweep their open devices each pass (adb) supply a skip
+** callback and get a full walk instead.
+*/
+int usb_host_scan(const char *base, usb_skip_cb skip,
+                  usb_scan_cb cb, void *cookie);
+
+#endif
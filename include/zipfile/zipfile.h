@@ -47,6 +47,45 @@ char* get_zipentry_name(zipentry_t entry);
 // by get_zipentry_size.  Returns nonzero on failure.
 int decompress_zipentry(zipentry_t entry, void* buf, int bufsize);
 
+// compression methods, per the zip spec
+enum {
+    ZIPENTRY_STORED = 0,
+    ZIPENTRY_DEFLATED = 8
+};
+
+// Get a window onto the entry's data as it sits in the buffer that
+// was passed to init_zipfile: *data points into that buffer, *size is
+// the number of bytes stored there, and *method is the compression
+// method.  For ZIPENTRY_STORED entries the window is the uncompressed
+// data itself, so callers keeping the archive mapped can use it in
+// place with no copy and no allocation.  Returns nonzero on failure.
+// Any of data/size/method may be NULL.
+int zipentry_get_window(zipentry_t entry, const void** data, size_t* size,
+        int* method);
+
+typedef void* zipstream_t;
+
+// Streaming extraction: open a pull-based reader on an entry and
+// decompress into a caller-provided window, so the working set stays
+// at the window size however large the entry is.  Returns NULL on
+// failure.  The stream is independent of the entry and must be
+// closed with zipentry_close_stream.
+zipstream_t zipentry_open_stream(zipentry_t entry);
+
+// Fill buf with up to bufsize decompressed bytes.  Returns the number
+// of bytes produced, 0 at the end of the entry, or -1 on error.
+int zipentry_read_stream(zipstream_t stream, void* buf, int bufsize);
+
+void zipentry_close_stream(zipstream_t stream);
+
+// Extract every entry in the zip file into dir, sharding the entries
+// across nthreads worker threads (pass 0 to use one per online cpu).
+// Each entry's crc is checked incrementally as it inflates, and output
+// files are preallocated to their final size.  Returns the number of
+// entries that could not be extracted, or -1 if nothing could be done
+// at all.
+int extract_all_zipentries(zipfile_t file, const char* dir, int nthreads);
+
 // iterate through the entries in the zip file.  pass a pointer to
 // a void* initialized to NULL to start.  Returns NULL when done
 zipentry_t iterate_zipfile(zipfile_t file, void** cookie);
@@ -8,8 +8,11 @@ LOCAL_SRC_FILES:= \
 	init.c \
 	devices.c \
 	property_service.c \
+	control_service.c \
 	util.c \
 	parser.c \
+	compiled.c \
+	bootchart_lite.c \
 	logo.c
 
 ifeq ($(strip $(INIT_BOOTCHART)),true)
@@ -31,3 +34,19 @@ LOCAL_STATIC_LIBRARIES := libcutils libc
 
 include $(BUILD_EXECUTABLE)
 
+# the offline rc compiler, run on the host at build time to produce
+# the compiled init.rc that init loads in place of the text file
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	rcc.c \
+	parser.c \
+	compiled.c \
+	util.c
+
+LOCAL_CFLAGS := -DINIT_HOST_RCC
+
+LOCAL_MODULE:= rcc
+
+include $(BUILD_HOST_EXECUTABLE)
+
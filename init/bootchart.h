@@ -33,4 +33,15 @@ extern void  bootchart_finish(void);
 
 #endif /* BOOTCHART */
 
+/* the lightweight sampler is always built in; it records binary
+ * snapshots into a shared-memory ring and only touches the filesystem
+ * when a dump is requested.  see bootchart_lite.c
+ */
+
+extern int   bootchart_lite_init(void);
+extern int   bootchart_lite_timeout(int timeout);
+extern void  bootchart_lite_dump(void);
+
+#define BOOTCHART_LITE_PERIOD_MS  1000   /* sampling period in ms */
+
 #endif /* _BOOTCHART_H */
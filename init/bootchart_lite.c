@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* always-on lightweight variant of the bootchart sampler.  unlike
+ * bootchart.c this performs no file I/O while sampling: fixed-interval
+ * snapshots of /proc/stat and the per-process stat lines are written as
+ * binary records into a preallocated shared-memory ring, so it is cheap
+ * enough to leave enabled on production devices.  the ring keeps the
+ * most recent window and is dumped to /data on request by setting the
+ * "bootchart.dump" property to "1", so a slow boot can be diagnosed in
+ * the field after the fact.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <cutils/ashmem.h>
+#include "bootchart.h"
+#include "property_service.h"
+
+#define LITE_MAGIC      0x314c4342  /* "BCL1" */
+#define LITE_VERSION    1
+#define LITE_SAMPLES    120         /* ring window: 120 * 1s = 2 minutes */
+#define LITE_PROCS      48          /* max processes recorded per sample */
+
+#define LITE_LOG_ROOT   "/data/bootchart"
+#define LITE_LOG_FILE   LITE_LOG_ROOT"/lite.bin"
+
+/* one process: pid, parent, total cpu ticks, run state, comm */
+typedef struct {
+    int       pid;
+    int       ppid;
+    unsigned  ticks;      /* utime + stime */
+    char      state;
+    char      name[15];
+} LiteProc;
+
+/* one snapshot: uptime in jiffies, the /proc/stat cpu line, processes */
+typedef struct {
+    unsigned  uptime;
+    unsigned  cpu[7];     /* user nice system idle iowait irq softirq */
+    unsigned  nprocs;
+    LiteProc  procs[LITE_PROCS];
+} LiteSample;
+
+/* the shared region: samples[head] is written next, count is capped at
+ * LITE_SAMPLES, so the oldest sample is at (head + LITE_SAMPLES - count)
+ * modulo LITE_SAMPLES.  the dump is the raw region; the reader recovers
+ * the order from head/count.
+ */
+typedef struct {
+    unsigned    magic;
+    unsigned    version;
+    unsigned    head;
+    unsigned    count;
+    LiteSample  samples[LITE_SAMPLES];
+} LiteRing;
+
+static LiteRing*  lite_ring;
+static long long  lite_next_ms;
+
+static int
+lite_read(const char*  filename, char*  buff, size_t  buffsize)
+{
+    int  len = 0;
+    int  fd  = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        do { len = read(fd, buff, buffsize-1); }
+        while (len < 0 && errno == EINTR);
+        close(fd);
+    }
+    buff[len > 0 ? len : 0] = 0;
+    return len;
+}
+
+static long long
+lite_now_ms(void)
+{
+    struct timespec  ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000LL + ts.tv_nsec/1000000;
+}
+
+/* parse "pid (comm) state ppid ... utime stime" into proc; the comm may
+ * itself contain parentheses, so scan back from the last ')' */
+static int
+lite_read_proc(int  pid, LiteProc*  proc)
+{
+    char   filename[32];
+    char   buff[512];
+    char*  p1;
+    char*  p2;
+    char*  s;
+    int    len, field;
+    unsigned  utime = 0, stime = 0;
+
+    snprintf(filename, sizeof(filename), "/proc/%d/stat", pid);
+    if (lite_read(filename, buff, sizeof(buff)) <= 0)
+        return -1;
+
+    p1 = strchr(buff, '(');
+    p2 = strrchr(buff, ')');
+    if (p1 == NULL || p2 == NULL || p2 < p1)
+        return -1;
+
+    proc->pid = pid;
+    len = p2 - (p1+1);
+    if (len > (int)sizeof(proc->name)-1)
+        len = sizeof(proc->name)-1;
+    memcpy(proc->name, p1+1, len);
+    proc->name[len] = 0;
+
+    /* after ") " comes: state ppid pgrp session tty tpgid flags
+     * minflt cminflt majflt cmajflt utime stime ... */
+    s = p2 + 2;
+    proc->state = *s;
+    proc->ppid  = 0;
+    for (field = 0; *s && field < 13; field++) {
+        while (*s && *s != ' ')
+            s++;
+        while (*s == ' ')
+            s++;
+        if (field == 0)
+            proc->ppid = atoi(s);
+        else if (field == 11)
+            utime = strtoul(s, NULL, 10);
+        else if (field == 12)
+            stime = strtoul(s, NULL, 10);
+    }
+    proc->ticks = utime + stime;
+    return 0;
+}
+
+static void
+lite_sample(void)
+{
+    LiteSample*     sample;
+    DIR*            dir;
+    struct dirent*  entry;
+    char            buff[256];
+    char*           s;
+    int             i;
+
+    sample = lite_ring->samples + lite_ring->head;
+    memset(sample, 0, sizeof(*sample));
+
+    if (lite_read("/proc/uptime", buff, sizeof(buff)) > 0)
+        sample->uptime = (unsigned)(100LL*strtod(buff, NULL));
+
+    if (lite_read("/proc/stat", buff, sizeof(buff)) > 0) {
+        /* first line: "cpu  user nice system idle iowait irq softirq" */
+        s = buff + 3;
+        for (i = 0; i < 7; i++) {
+            while (*s == ' ')
+                s++;
+            sample->cpu[i] = strtoul(s, &s, 10);
+        }
+    }
+
+    dir = opendir("/proc");
+    if (dir) {
+        while ((entry = readdir(dir)) != NULL) {
+            char*  end;
+            int    pid = strtol(entry->d_name, &end, 10);
+            if (end == NULL || end == entry->d_name || *end != 0)
+                continue;
+            if (sample->nprocs == LITE_PROCS)
+                break;
+            if (lite_read_proc(pid, sample->procs + sample->nprocs) == 0)
+                sample->nprocs++;
+        }
+        closedir(dir);
+    }
+
+    lite_ring->head = (lite_ring->head + 1) % LITE_SAMPLES;
+    if (lite_ring->count < LITE_SAMPLES)
+        lite_ring->count++;
+}
+
+/* called once at startup; returns nonzero when sampling is active */
+int  bootchart_lite_init(void)
+{
+    const char*  disabled = property_get("ro.bootchart.lite");
+    int  fd;
+
+    if (disabled && !strcmp(disabled, "0"))
+        return 0;
+
+    fd = ashmem_create_region("bootchart", sizeof(LiteRing));
+    if (fd < 0)
+        return 0;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    lite_ring = mmap(NULL, sizeof(LiteRing), PROT_READ|PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (lite_ring == MAP_FAILED) {
+        lite_ring = NULL;
+        close(fd);
+        return 0;
+    }
+
+    lite_ring->magic   = LITE_MAGIC;
+    lite_ring->version = LITE_VERSION;
+    lite_next_ms = lite_now_ms();
+    return 1;
+}
+
+/* called once per main loop iteration: takes a sample when one is due
+ * and folds the time until the next sample into the poll timeout */
+int  bootchart_lite_timeout(int timeout)
+{
+    long long  now;
+
+    if (lite_ring == NULL)
+        return timeout;
+
+    now = lite_now_ms();
+    if (now >= lite_next_ms) {
+        lite_sample();
+        lite_next_ms = now + BOOTCHART_LITE_PERIOD_MS;
+    }
+    if (timeout < 0 || timeout > (int)(lite_next_ms - now))
+        timeout = (int)(lite_next_ms - now);
+    return timeout;
+}
+
+/* triggered by setting the "bootchart.dump" property to "1" */
+void  bootchart_lite_dump(void)
+{
+    int  fd, ret;
+
+    if (lite_ring == NULL)
+        return;
+
+    do { ret = mkdir(LITE_LOG_ROOT, 0755); }
+    while (ret < 0 && errno == EINTR);
+
+    fd = open(LITE_LOG_FILE, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    do { ret = write(fd, lite_ring, sizeof(LiteRing)); }
+    while (ret < 0 && errno == EINTR);
+    close(fd);
+}
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <sys/mount.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <linux/loop.h>
 
 #include "init.h"
@@ -342,6 +343,62 @@ int do_mount(int nargs, char **args)
     }
 }
 
+#define MOUNT_ASYNC_MAX 8
+
+static struct {
+    pid_t pid;
+    char target[64];
+} mount_async_jobs[MOUNT_ASYNC_MAX];
+static int mount_async_count = 0;
+
+/* mount_async <type> <device> <path> <flags ...> <options>
+ *
+ * same as mount, but the mount itself runs in a forked child so that
+ * several independent mounts can proceed concurrently.  mount_wait
+ * collects the results in the order the mounts were issued; nothing
+ * that depends on one of the filesystems may run before it.
+ */
+int do_mount_async(int nargs, char **args)
+{
+    pid_t pid;
+
+    /* table full or fork failed: just mount synchronously */
+    if (mount_async_count == MOUNT_ASYNC_MAX)
+        return do_mount(nargs, args);
+
+    pid = fork();
+    if (pid < 0)
+        return do_mount(nargs, args);
+    if (pid == 0)
+        _exit(do_mount(nargs, args) ? 1 : 0);
+
+    mount_async_jobs[mount_async_count].pid = pid;
+    strlcpy(mount_async_jobs[mount_async_count].target, args[3],
+            sizeof(mount_async_jobs[mount_async_count].target));
+    mount_async_count++;
+    return 0;
+}
+
+/* mount_wait */
+int do_mount_wait(int nargs, char **args)
+{
+    int n, status, ret = 0;
+
+    for (n = 0; n < mount_async_count; n++) {
+        pid_t pid = mount_async_jobs[n].pid;
+
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+            ;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ERROR("async mount of '%s' failed\n",
+                  mount_async_jobs[n].target);
+            ret = -1;
+        }
+    }
+    mount_async_count = 0;
+    return ret;
+}
+
 int do_setkey(int nargs, char **args)
 {
     struct kbentry kbe;
@@ -0,0 +1,638 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "init.h"
+#include "keywords.h"
+#include "compiled.h"
+
+/*
+ * Loader.
+ *
+ * The compiled file is fully validated up front (counts, table
+ * bounds, string references, keywords), then materialized into the
+ * same service/action structures the text parser builds.  Strings are
+ * used in place from the mapping, which stays mapped for the life of
+ * init just as the text parser's file buffer does.  All commands,
+ * sockets, envvars and dependency records are carved out of one
+ * allocation each instead of one malloc apiece.
+ */
+
+struct rc_file {
+    const struct rc_header *hdr;
+    const struct rc_service *services;
+    const struct rc_action *actions;
+    const struct rc_command *commands;
+    const struct rc_socket *sockets;
+    const struct rc_envvar *envvars;
+    const uint32_t *deps;
+    const int32_t *keycodes;
+    const uint32_t *args;
+    const char *strings;
+};
+
+/* no table may be larger than this many entries; an rc file is small
+ * and this keeps the size arithmetic below well away from overflow
+ */
+#define RC_MAX_COUNT    0x100000
+
+static const char *rc_string(const struct rc_file *f, uint32_t off)
+{
+    if (off >= f->hdr->strings_len)
+        return 0;
+    return f->strings + off;
+}
+
+static int rc_layout(struct rc_file *f, const void *map, size_t len)
+{
+    const struct rc_header *hdr = map;
+    const char *p;
+    size_t need;
+
+    if (len < sizeof(*hdr))
+        return -1;
+    if (hdr->magic != RC_MAGIC || hdr->version != RC_VERSION)
+        return -1;
+    if (hdr->num_services > RC_MAX_COUNT || hdr->num_actions > RC_MAX_COUNT ||
+        hdr->num_commands > RC_MAX_COUNT || hdr->num_sockets > RC_MAX_COUNT ||
+        hdr->num_envvars > RC_MAX_COUNT || hdr->num_deps > RC_MAX_COUNT ||
+        hdr->num_keycodes > RC_MAX_COUNT || hdr->num_args > RC_MAX_COUNT)
+        return -1;
+
+    f->hdr = hdr;
+    p = (const char*) map + sizeof(*hdr);
+    f->services = (const struct rc_service*) p;
+    p += hdr->num_services * sizeof(struct rc_service);
+    f->actions = (const struct rc_action*) p;
+    p += hdr->num_actions * sizeof(struct rc_action);
+    f->commands = (const struct rc_command*) p;
+    p += hdr->num_commands * sizeof(struct rc_command);
+    f->sockets = (const struct rc_socket*) p;
+    p += hdr->num_sockets * sizeof(struct rc_socket);
+    f->envvars = (const struct rc_envvar*) p;
+    p += hdr->num_envvars * sizeof(struct rc_envvar);
+    f->deps = (const uint32_t*) p;
+    p += hdr->num_deps * sizeof(uint32_t);
+    f->keycodes = (const int32_t*) p;
+    p += hdr->num_keycodes * sizeof(int32_t);
+    f->args = (const uint32_t*) p;
+    p += hdr->num_args * sizeof(uint32_t);
+    f->strings = p;
+
+    need = (p - (const char*) map) + hdr->strings_len;
+    if (need != len)
+        return -1;
+    if (hdr->strings_len != 0 && f->strings[hdr->strings_len - 1] != '\0')
+        return -1;
+    return 0;
+}
+
+/* validate one (count, first) run of commands */
+static int rc_check_commands(const struct rc_file *f,
+                             uint32_t first, uint32_t n)
+{
+    const struct rc_command *c;
+    uint32_t i;
+
+    if (first > f->hdr->num_commands || n > f->hdr->num_commands - first)
+        return -1;
+    for (i = 0; i < n; i++) {
+        c = &f->commands[first + i];
+        if (c->keyword >= KEYWORD_COUNT || !keyword_is_command(c->keyword))
+            return -1;
+        if (c->nargs == 0 ||
+            c->first_arg > f->hdr->num_args ||
+            c->nargs > f->hdr->num_args - c->first_arg)
+            return -1;
+    }
+    return 0;
+}
+
+static int rc_check_args(const struct rc_file *f, uint32_t first, uint32_t n)
+{
+    uint32_t i;
+
+    if (first > f->hdr->num_args || n > f->hdr->num_args - first)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (!rc_string(f, f->args[first + i]))
+            return -1;
+    }
+    return 0;
+}
+
+static int rc_validate(const struct rc_file *f)
+{
+    const struct rc_header *hdr = f->hdr;
+    const struct rc_service *s;
+    const struct rc_action *a;
+    const struct rc_command *c;
+    uint32_t i, k;
+
+    for (i = 0; i < hdr->num_commands; i++) {
+        c = &f->commands[i];
+        if (rc_check_args(f, c->first_arg, c->nargs))
+            return -1;
+    }
+    for (i = 0; i < hdr->num_sockets; i++) {
+        if (!rc_string(f, f->sockets[i].name) ||
+            !rc_string(f, f->sockets[i].type))
+            return -1;
+    }
+    for (i = 0; i < hdr->num_envvars; i++) {
+        if (!rc_string(f, f->envvars[i].name) ||
+            !rc_string(f, f->envvars[i].value))
+            return -1;
+    }
+    for (i = 0; i < hdr->num_deps; i++) {
+        if (!rc_string(f, f->deps[i]))
+            return -1;
+    }
+
+    for (i = 0; i < hdr->num_actions; i++) {
+        a = &f->actions[i];
+        if (!rc_string(f, a->name))
+            return -1;
+        if (rc_check_commands(f, a->first_command, a->ncommands))
+            return -1;
+    }
+
+    for (i = 0; i < hdr->num_services; i++) {
+        s = &f->services[i];
+        if (!rc_string(f, s->name) || !rc_string(f, s->classname))
+            return -1;
+        if (s->nargs == 0 || rc_check_args(f, s->first_arg, s->nargs))
+            return -1;
+        if (s->nr_supp_gids > NR_SVC_SUPP_GIDS)
+            return -1;
+        if (s->first_socket > hdr->num_sockets ||
+            s->nsockets > hdr->num_sockets - s->first_socket)
+            return -1;
+        if (s->first_envvar > hdr->num_envvars ||
+            s->nenvvars > hdr->num_envvars - s->first_envvar)
+            return -1;
+        for (k = 0; k < 2; k++) {
+            uint32_t first = k ? s->first_before : s->first_after;
+            uint32_t n = k ? s->nbefore : s->nafter;
+            if (first > hdr->num_deps || n > hdr->num_deps - first)
+                return -1;
+        }
+        if (s->first_keycode > hdr->num_keycodes ||
+            s->nkeycodes > hdr->num_keycodes - s->first_keycode)
+            return -1;
+        if (rc_check_commands(f, s->first_command, s->ncommands))
+            return -1;
+    }
+    return 0;
+}
+
+/* append one run of commands to a command list, carving each command
+ * out of the shared block at *blockp
+ */
+static void rc_build_commands(const struct rc_file *f,
+                              uint32_t first, uint32_t n,
+                              struct listnode *list, char **blockp)
+{
+    const struct rc_command *c;
+    struct command *cmd;
+    uint32_t i, k;
+
+    for (i = 0; i < n; i++) {
+        c = &f->commands[first + i];
+        cmd = (struct command*) *blockp;
+        *blockp += sizeof(*cmd) + sizeof(char*) * c->nargs;
+        cmd->func = keyword_func(c->keyword);
+        cmd->nargs = c->nargs;
+        for (k = 0; k < c->nargs; k++)
+            cmd->args[k] = (char*) rc_string(f, f->args[c->first_arg + k]);
+        list_add_tail(list, &cmd->clist);
+    }
+}
+
+static struct svcdepinfo *rc_build_deps(const struct rc_file *f,
+                                        uint32_t first, uint32_t n,
+                                        struct svcdepinfo **blockp)
+{
+    struct svcdepinfo *head = 0;
+    struct svcdepinfo *di;
+    uint32_t i;
+
+    /* walk backwards so head insertion reproduces the list order the
+     * compiler saw
+     */
+    for (i = n; i-- > 0; ) {
+        di = (*blockp)++;
+        di->name = rc_string(f, f->deps[first + i]);
+        di->next = head;
+        head = di;
+    }
+    return head;
+}
+
+int load_compiled_config(const char *fn)
+{
+    char bin_fn[PATH_MAX];
+    struct rc_file f;
+    struct stat bin_st, txt_st;
+    void *map = MAP_FAILED;
+    size_t maplen = 0;
+    char *cmd_block = 0;
+    struct socketinfo *si_block = 0;
+    struct svcenvinfo *ei_block = 0;
+    struct svcdepinfo *di_block = 0;
+    size_t cmd_bytes;
+    uint32_t i, k;
+    int fd;
+
+    if (snprintf(bin_fn, sizeof(bin_fn), "%s.bin", fn)
+            >= (int) sizeof(bin_fn))
+        return -1;
+
+    if (stat(bin_fn, &bin_st) != 0)
+        return -1;
+    if (stat(fn, &txt_st) == 0 && bin_st.st_mtime < txt_st.st_mtime) {
+        ERROR("ignoring stale compiled config '%s'\n", bin_fn);
+        return -1;
+    }
+
+    fd = open(bin_fn, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    map = mmap(NULL, bin_st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    maplen = bin_st.st_size;
+
+    if (rc_layout(&f, map, maplen) || rc_validate(&f)) {
+        ERROR("'%s' is not a valid compiled config, ignoring\n", bin_fn);
+        munmap(map, maplen);
+        return -1;
+    }
+
+    /* size and allocate the shared blocks */
+    cmd_bytes = 0;
+    for (i = 0; i < f.hdr->num_commands; i++)
+        cmd_bytes += sizeof(struct command) +
+                     sizeof(char*) * f.commands[i].nargs;
+    if (cmd_bytes)
+        cmd_block = calloc(1, cmd_bytes);
+    if (f.hdr->num_sockets)
+        si_block = calloc(f.hdr->num_sockets, sizeof(struct socketinfo));
+    if (f.hdr->num_envvars)
+        ei_block = calloc(f.hdr->num_envvars, sizeof(struct svcenvinfo));
+    if (f.hdr->num_deps)
+        di_block = calloc(f.hdr->num_deps, sizeof(struct svcdepinfo));
+    if ((cmd_bytes && !cmd_block) ||
+        (f.hdr->num_sockets && !si_block) ||
+        (f.hdr->num_envvars && !ei_block) ||
+        (f.hdr->num_deps && !di_block)) {
+        ERROR("out of memory loading '%s'\n", bin_fn);
+        free(cmd_block);
+        free(si_block);
+        free(ei_block);
+        free(di_block);
+        munmap(map, maplen);
+        return -1;
+    }
+
+    for (i = 0; i < f.hdr->num_actions; i++) {
+        const struct rc_action *ra = &f.actions[i];
+        struct action *act = calloc(1, sizeof(*act));
+
+        if (!act)
+            break;
+        act->name = rc_string(&f, ra->name);
+        list_init(&act->commands);
+        rc_build_commands(&f, ra->first_command, ra->ncommands,
+                          &act->commands, &cmd_block);
+        list_add_tail(&action_list, &act->alist);
+    }
+
+    for (i = 0; i < f.hdr->num_services; i++) {
+        const struct rc_service *rs = &f.services[i];
+        struct service *svc;
+
+        if (service_find_by_name(rc_string(&f, rs->name))) {
+            ERROR("ignored duplicate definition of service '%s'\n",
+                  rc_string(&f, rs->name));
+            continue;
+        }
+
+        svc = calloc(1, sizeof(*svc) + sizeof(char*) * rs->nargs);
+        if (!svc)
+            break;
+        svc->name = rc_string(&f, rs->name);
+        svc->classname = rc_string(&f, rs->classname);
+        svc->flags = rs->flags;
+        svc->uid = rs->uid;
+        svc->gid = rs->gid;
+        svc->nr_supp_gids = rs->nr_supp_gids;
+        for (k = 0; k < rs->nr_supp_gids; k++)
+            svc->supp_gids[k] = rs->supp_gids[k];
+        for (k = 0; k < rs->nargs; k++)
+            svc->args[k] = (char*) rc_string(&f, f.args[rs->first_arg + k]);
+        svc->args[rs->nargs] = 0;
+        svc->nargs = rs->nargs;
+
+        /* walk backwards so head insertion keeps the compiler's order */
+        for (k = rs->nsockets; k-- > 0; ) {
+            struct socketinfo *si = &si_block[rs->first_socket + k];
+            const struct rc_socket *s = &f.sockets[rs->first_socket + k];
+            si->name = rc_string(&f, s->name);
+            si->type = rc_string(&f, s->type);
+            si->perm = s->perm;
+            si->uid = s->uid;
+            si->gid = s->gid;
+            si->next = svc->sockets;
+            svc->sockets = si;
+        }
+        for (k = rs->nenvvars; k-- > 0; ) {
+            struct svcenvinfo *ei = &ei_block[rs->first_envvar + k];
+            ei->name = rc_string(&f, f.envvars[rs->first_envvar + k].name);
+            ei->value = rc_string(&f, f.envvars[rs->first_envvar + k].value);
+            ei->next = svc->envvars;
+            svc->envvars = ei;
+        }
+        svc->after = rc_build_deps(&f, rs->first_after, rs->nafter,
+                                   &di_block);
+        svc->before = rc_build_deps(&f, rs->first_before, rs->nbefore,
+                                    &di_block);
+        if (rs->nkeycodes) {
+            svc->nkeycodes = rs->nkeycodes;
+            svc->keycodes = (int*) &f.keycodes[rs->first_keycode];
+        }
+
+        svc->onrestart.name = "onrestart";
+        list_init(&svc->onrestart.commands);
+        rc_build_commands(&f, rs->first_command, rs->ncommands,
+                          &svc->onrestart.commands, &cmd_block);
+
+        list_add_tail(&service_list, &svc->slist);
+    }
+
+    INFO("loaded compiled config '%s'\n", bin_fn);
+    return 0;
+}
+
+/*
+ * Compiler.
+ *
+ * Walks the parsed lists and flattens them into the tables described
+ * in compiled.h.  Strings are interned with a linear scan; rc files
+ * are small and this only runs on the host at build time.
+ */
+
+struct strpool {
+    char *buf;
+    uint32_t len;
+    uint32_t cap;
+};
+
+static uint32_t intern(struct strpool *sp, const char *s)
+{
+    uint32_t off = 0;
+    uint32_t n = strlen(s) + 1;
+
+    while (off < sp->len) {
+        if (!strcmp(sp->buf + off, s))
+            return off;
+        off += strlen(sp->buf + off) + 1;
+    }
+
+    if (sp->len + n > sp->cap) {
+        sp->cap = (sp->cap ? sp->cap * 2 : 4096);
+        if (sp->cap < sp->len + n)
+            sp->cap = sp->len + n;
+        sp->buf = realloc(sp->buf, sp->cap);
+        if (!sp->buf) {
+            ERROR("out of memory interning strings\n");
+            exit(1);
+        }
+    }
+    memcpy(sp->buf + sp->len, s, n);
+    off = sp->len;
+    sp->len += n;
+    return off;
+}
+
+struct rc_out {
+    struct rc_header hdr;
+    struct rc_service *services;
+    struct rc_action *actions;
+    struct rc_command *commands;
+    struct rc_socket *sockets;
+    struct rc_envvar *envvars;
+    uint32_t *deps;
+    int32_t *keycodes;
+    uint32_t *args;
+    struct strpool strings;
+};
+
+static uint32_t out_commands(struct rc_out *o, struct listnode *list)
+{
+    struct listnode *node;
+    struct command *cmd;
+    struct rc_command *c;
+    uint32_t n = 0;
+    int i;
+
+    list_for_each(node, list) {
+        cmd = node_to_item(node, struct command, clist);
+        c = &o->commands[o->hdr.num_commands++];
+        c->keyword = lookup_keyword(cmd->args[0]);
+        c->nargs = cmd->nargs;
+        c->first_arg = o->hdr.num_args;
+        for (i = 0; i < cmd->nargs; i++)
+            o->args[o->hdr.num_args++] = intern(&o->strings, cmd->args[i]);
+        n++;
+    }
+    return n;
+}
+
+static uint32_t out_deps(struct rc_out *o, struct svcdepinfo *di)
+{
+    uint32_t n = 0;
+
+    for (; di; di = di->next) {
+        o->deps[o->hdr.num_deps++] = intern(&o->strings, di->name);
+        n++;
+    }
+    return n;
+}
+
+int write_compiled_config(const char *fn)
+{
+    struct rc_out o;
+    struct listnode *node;
+    struct listnode *node2;
+    struct service *svc;
+    struct action *act;
+    struct command *cmd;
+    struct socketinfo *si;
+    struct svcenvinfo *ei;
+    struct svcdepinfo *di;
+    uint32_t ns = 0, na = 0, nc = 0, nsock = 0, nenv = 0;
+    uint32_t ndep = 0, nkey = 0, nargs = 0;
+    FILE *fp;
+    int i, ok;
+
+    /* counting pass so every table can be allocated exactly */
+    list_for_each(node, &service_list) {
+        svc = node_to_item(node, struct service, slist);
+        ns++;
+        nargs += svc->nargs;
+        for (si = svc->sockets; si; si = si->next) nsock++;
+        for (ei = svc->envvars; ei; ei = ei->next) nenv++;
+        for (di = svc->after; di; di = di->next) ndep++;
+        for (di = svc->before; di; di = di->next) ndep++;
+        nkey += svc->nkeycodes;
+        list_for_each(node2, &svc->onrestart.commands) {
+            cmd = node_to_item(node2, struct command, clist);
+            nc++;
+            nargs += cmd->nargs;
+        }
+    }
+    list_for_each(node, &action_list) {
+        act = node_to_item(node, struct action, alist);
+        na++;
+        list_for_each(node2, &act->commands) {
+            cmd = node_to_item(node2, struct command, clist);
+            nc++;
+            nargs += cmd->nargs;
+        }
+    }
+
+    memset(&o, 0, sizeof(o));
+    o.hdr.magic = RC_MAGIC;
+    o.hdr.version = RC_VERSION;
+    o.services = calloc(ns ? ns : 1, sizeof(struct rc_service));
+    o.actions = calloc(na ? na : 1, sizeof(struct rc_action));
+    o.commands = calloc(nc ? nc : 1, sizeof(struct rc_command));
+    o.sockets = calloc(nsock ? nsock : 1, sizeof(struct rc_socket));
+    o.envvars = calloc(nenv ? nenv : 1, sizeof(struct rc_envvar));
+    o.deps = calloc(ndep ? ndep : 1, sizeof(uint32_t));
+    o.keycodes = calloc(nkey ? nkey : 1, sizeof(int32_t));
+    o.args = calloc(nargs ? nargs : 1, sizeof(uint32_t));
+    if (!o.services || !o.actions || !o.commands || !o.sockets ||
+        !o.envvars || !o.deps || !o.keycodes || !o.args) {
+        ERROR("out of memory compiling config\n");
+        return -1;
+    }
+
+    /* the pool must not be empty so offset 0 is always "" and every
+     * real string reference is representable
+     */
+    intern(&o.strings, "");
+
+    list_for_each(node, &action_list) {
+        act = node_to_item(node, struct action, alist);
+        struct rc_action *ra = &o.actions[o.hdr.num_actions++];
+        ra->name = intern(&o.strings, act->name);
+        ra->first_command = o.hdr.num_commands;
+        ra->ncommands = out_commands(&o, &act->commands);
+    }
+
+    list_for_each(node, &service_list) {
+        svc = node_to_item(node, struct service, slist);
+        struct rc_service *rs = &o.services[o.hdr.num_services++];
+        rs->name = intern(&o.strings, svc->name);
+        rs->classname = intern(&o.strings, svc->classname);
+        rs->flags = svc->flags;
+        rs->uid = svc->uid;
+        rs->gid = svc->gid;
+        rs->nr_supp_gids = svc->nr_supp_gids;
+        for (i = 0; i < (int) svc->nr_supp_gids; i++)
+            rs->supp_gids[i] = svc->supp_gids[i];
+        rs->nargs = svc->nargs;
+        rs->first_arg = o.hdr.num_args;
+        for (i = 0; i < svc->nargs; i++)
+            o.args[o.hdr.num_args++] = intern(&o.strings, svc->args[i]);
+        rs->first_socket = o.hdr.num_sockets;
+        for (si = svc->sockets; si; si = si->next) {
+            struct rc_socket *s = &o.sockets[o.hdr.num_sockets++];
+            s->name = intern(&o.strings, si->name);
+            s->type = intern(&o.strings, si->type);
+            s->perm = si->perm;
+            s->uid = si->uid;
+            s->gid = si->gid;
+            rs->nsockets++;
+        }
+        rs->first_envvar = o.hdr.num_envvars;
+        for (ei = svc->envvars; ei; ei = ei->next) {
+            struct rc_envvar *e = &o.envvars[o.hdr.num_envvars++];
+            e->name = intern(&o.strings, ei->name);
+            e->value = intern(&o.strings, ei->value);
+            rs->nenvvars++;
+        }
+        rs->first_after = o.hdr.num_deps;
+        rs->nafter = out_deps(&o, svc->after);
+        rs->first_before = o.hdr.num_deps;
+        rs->nbefore = out_deps(&o, svc->before);
+        rs->first_keycode = o.hdr.num_keycodes;
+        rs->nkeycodes = svc->nkeycodes;
+        for (i = 0; i < svc->nkeycodes; i++)
+            o.keycodes[o.hdr.num_keycodes++] = svc->keycodes[i];
+        rs->first_command = o.hdr.num_commands;
+        rs->ncommands = out_commands(&o, &svc->onrestart.commands);
+    }
+
+    o.hdr.strings_len = o.strings.len;
+
+    fp = fopen(fn, "wb");
+    if (!fp) {
+        ERROR("cannot write '%s': %s\n", fn, strerror(errno));
+        return -1;
+    }
+    ok = fwrite(&o.hdr, sizeof(o.hdr), 1, fp) == 1 &&
+         (!ns || fwrite(o.services, sizeof(struct rc_service), ns, fp) == ns) &&
+         (!na || fwrite(o.actions, sizeof(struct rc_action), na, fp) == na) &&
+         (!nc || fwrite(o.commands, sizeof(struct rc_command), nc, fp) == nc) &&
+         (!nsock || fwrite(o.sockets, sizeof(struct rc_socket), nsock, fp) == nsock) &&
+         (!nenv || fwrite(o.envvars, sizeof(struct rc_envvar), nenv, fp) == nenv) &&
+         (!ndep || fwrite(o.deps, sizeof(uint32_t), ndep, fp) == ndep) &&
+         (!nkey || fwrite(o.keycodes, sizeof(int32_t), nkey, fp) == nkey) &&
+         (!nargs || fwrite(o.args, sizeof(uint32_t), nargs, fp) == nargs) &&
+         fwrite(o.strings.buf, 1, o.strings.len, fp) == o.strings.len;
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (!ok) {
+        ERROR("error writing '%s'\n", fn);
+        unlink(fn);
+        return -1;
+    }
+
+    free(o.services);
+    free(o.actions);
+    free(o.commands);
+    free(o.sockets);
+    free(o.envvars);
+    free(o.deps);
+    free(o.keycodes);
+    free(o.args);
+    free(o.strings.buf);
+    return 0;
+}
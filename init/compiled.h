@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_COMPILED_H
+#define _INIT_COMPILED_H
+
+#include <stdint.h>
+
+#include "init.h"
+
+/*
+ * Compiled form of an init rc file, produced offline by the host rc
+ * compiler (rcc).  The layout is a header followed by flat tables --
+ * services, actions, commands, sockets, environment variables,
+ * dependency names, keycodes, argument string references -- and
+ * finally a pool of NUL-terminated interned strings.  All cross
+ * references are table indices or string-pool offsets, so the file
+ * can be mapped and walked directly: loading it does no tokenizing,
+ * no keyword lookups, and only a handful of allocations instead of
+ * one malloc per command.
+ *
+ * Commands store the keyword enum from keywords.h, so the version
+ * number must change whenever that enum or these structs change.
+ */
+
+#define RC_MAGIC        0x31435249      /* "IRC1", little-endian */
+#define RC_VERSION      2
+
+struct rc_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_services;
+    uint32_t num_actions;
+    uint32_t num_commands;
+    uint32_t num_sockets;
+    uint32_t num_envvars;
+    uint32_t num_deps;
+    uint32_t num_keycodes;
+    uint32_t num_args;
+    uint32_t strings_len;
+};
+
+/* each (count, first) pair indexes a contiguous run in one table */
+struct rc_service {
+    uint32_t name;                  /* string offset */
+    uint32_t classname;             /* string offset */
+    uint32_t flags;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t nr_supp_gids;
+    uint32_t supp_gids[NR_SVC_SUPP_GIDS];
+    uint32_t nargs, first_arg;
+    uint32_t nsockets, first_socket;
+    uint32_t nenvvars, first_envvar;
+    uint32_t nafter, first_after;
+    uint32_t nbefore, first_before;
+    uint32_t nkeycodes, first_keycode;
+    uint32_t ncommands, first_command;  /* onrestart commands */
+};
+
+struct rc_action {
+    uint32_t name;                  /* string offset */
+    uint32_t ncommands, first_command;
+};
+
+struct rc_command {
+    uint32_t keyword;               /* K_* enum value */
+    uint32_t nargs, first_arg;
+};
+
+struct rc_socket {
+    uint32_t name;                  /* string offset */
+    uint32_t type;                  /* string offset */
+    uint32_t perm;
+    uint32_t uid;
+    uint32_t gid;
+};
+
+struct rc_envvar {
+    uint32_t name;                  /* string offset */
+    uint32_t value;                 /* string offset */
+};
+
+/* the deps table is string offsets; the args table is string offsets;
+ * the keycodes table is int32_t values
+ */
+
+/*
+ * Load "<fn>.bin" if it exists, passes validation, and is no older
+ * than the text file "fn".  Returns 0 on success, nonzero to make the
+ * caller fall back to the text parser.
+ */
+int load_compiled_config(const char *fn);
+
+/*
+ * Write everything parsed so far as a compiled rc file.  Used by the
+ * host compiler.  Returns 0 on success.
+ */
+int write_compiled_config(const char *fn);
+
+#endif /* _INIT_COMPILED_H */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cutils/sockets.h>
+
+#include "init.h"
+#include "property_service.h"
+#include "control_service.h"
+
+/* read exactly len bytes, riding out EINTR and short reads */
+static int recv_all(int s, void *data, int len)
+{
+    char *p = data;
+    int r;
+
+    while (len > 0) {
+        r = recv(s, p, len, 0);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+static int run_control_command(const ctl_msg *msg)
+{
+    struct service *svc;
+
+    svc = service_find_by_name(msg->name);
+    if (svc == 0) {
+        ERROR("svc_ctl: no such service '%s'\n", msg->name);
+        return CTL_STATUS_NOSVC;
+    }
+
+    switch (msg->cmd) {
+    case CTL_MSG_START:
+        service_start(svc);
+        break;
+    case CTL_MSG_STOP:
+        service_stop(svc);
+        break;
+    case CTL_MSG_RESTART:
+        service_stop(svc);
+        service_start(svc);
+        break;
+    default:
+        ERROR("svc_ctl: unknown command %d for '%s'\n", msg->cmd, msg->name);
+        return CTL_STATUS_BADCMD;
+    }
+    return CTL_STATUS_OK;
+}
+
+void handle_control_fd(int fd)
+{
+    ctl_msg msg;
+    unsigned char count;
+    unsigned char status[CTL_MAX_CMDS];
+    int s;
+    int n;
+    struct ucred cr;
+    struct sockaddr_un addr;
+    socklen_t addr_size = sizeof(addr);
+    socklen_t cr_size = sizeof(cr);
+
+    if ((s = accept(fd, (struct sockaddr *) &addr, &addr_size)) < 0) {
+        return;
+    }
+
+    if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cr, &cr_size) < 0) {
+        close(s);
+        ERROR("svc_ctl: unable to receive socket options\n");
+        return;
+    }
+
+    if (recv_all(s, &count, 1) || count == 0 || count > CTL_MAX_CMDS) {
+        ERROR("svc_ctl: bad command count\n");
+        close(s);
+        return;
+    }
+
+    for (n = 0; n < count; n++) {
+        if (recv_all(s, &msg, sizeof(msg))) {
+            ERROR("svc_ctl: short batch: %d of %d commands\n", n, count);
+            close(s);
+            return;
+        }
+        msg.name[sizeof(msg.name) - 1] = 0;
+
+        if (check_control_perms(msg.name, cr.uid)) {
+            status[n] = run_control_command(&msg);
+        } else {
+            ERROR("svc_ctl: uid %d pid %d may not control service [%s]\n",
+                  cr.uid, cr.pid, msg.name);
+            status[n] = CTL_STATUS_PERM;
+        }
+    }
+
+    /* one status byte per command, in request order */
+    while (send(s, status, count, 0) < 0 && errno == EINTR)
+        ;
+    close(s);
+}
+
+int start_control_service(void)
+{
+    int fd;
+
+    fd = create_socket(CTL_SOCKET_NAME, SOCK_STREAM, 0666, 0, 0);
+    if (fd < 0)
+        return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    listen(fd, 8);
+    return fd;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_CONTROL_SERVICE_H
+#define _INIT_CONTROL_SERVICE_H
+
+/* Batched service control channel.
+ *
+ * Setting the ctl.start/ctl.stop properties costs one socket round
+ * trip and one string parse per service, which adds up when a client
+ * sequences many services at once.  This socket takes a whole batch
+ * in one connection: the client sends a single count byte followed
+ * by that many fixed-size ctl_msg records, and init replies with one
+ * status byte per command, in request order, after running them all.
+ *
+ * Permissions are checked per command against the same uid ACL as
+ * the ctl. properties, so a partially-allowed batch still runs the
+ * allowed commands and reports CTL_STATUS_PERM for the rest.
+ */
+
+#define CTL_SOCKET_NAME "svc_ctl"
+
+#define CTL_MAX_CMDS  64
+
+/* command opcodes */
+#define CTL_MSG_START    1
+#define CTL_MSG_STOP     2
+#define CTL_MSG_RESTART  3
+
+/* per-command status codes */
+#define CTL_STATUS_OK      0
+#define CTL_STATUS_BADCMD  1   /* unknown opcode */
+#define CTL_STATUS_NOSVC   2   /* no such service */
+#define CTL_STATUS_PERM    3   /* uid may not control this service */
+
+typedef struct ctl_msg ctl_msg;
+
+struct ctl_msg {
+    unsigned char cmd;
+    char name[63];  /* service name, 0-terminated */
+};
+
+int start_control_service(void);
+void handle_control_fd(int fd);
+
+#endif /* _INIT_CONTROL_SERVICE_H */
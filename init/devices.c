@@ -52,7 +52,11 @@ struct uevent {
 static int open_uevent_socket(void)
 {
     struct sockaddr_nl addr;
-    int sz = 64*1024; // XXX larger? udev uses 16MB!
+        /* coldplug floods thousands of events before we get a chance
+         * to drain; a small buffer overflows and loses devices.
+         * (udev goes as far as 16MB.)
+         */
+    int sz = 1024*1024;
     int s;
 
     memset(&addr, 0, sizeof(addr));
@@ -80,6 +84,8 @@ struct perms_ {
     unsigned int uid;
     unsigned int gid;
     unsigned short prefix;
+        /* hash bucket / prefix chain link; see build_perm_table() */
+    struct perms_ *next;
 };
 static struct perms_ devperms[] = {
     { "/dev/null",          0666,   AID_ROOT,       AID_ROOT,       0 },
@@ -210,6 +216,66 @@ void qemu_cmdline(const char* name, const char *value)
     }
 }
 
+/* devperms gets probed for every node during coldplug, so the exact
+ * entries are kept in a small hash table and the (few) prefix entries
+ * on their own chain, instead of strcmp'ing the whole array per node.
+ * Chains are built in reverse so that, as with the old linear scan,
+ * the first matching table entry wins.
+ */
+#define PERM_HASH_BUCKETS 32    /* power of two */
+
+static struct perms_ *perm_hash[PERM_HASH_BUCKETS];
+static struct perms_ *perm_prefixes;
+
+static unsigned int perm_hash_path(const char *path)
+{
+    unsigned int h = 0;
+    while (*path)
+        h = h * 31 + *path++;
+    return h & (PERM_HASH_BUCKETS - 1);
+}
+
+static void build_perm_table(void)
+{
+    int n, i;
+
+    for (n = 0; devperms[n].name; n++)
+        ;
+    for (i = n - 1; i >= 0; i--) {
+        struct perms_ *p = &devperms[i];
+        if (p->prefix) {
+            p->next = perm_prefixes;
+            perm_prefixes = p;
+        } else {
+            unsigned int h = perm_hash_path(p->name);
+            p->next = perm_hash[h];
+            perm_hash[h] = p;
+        }
+    }
+}
+
+static int get_device_perm_hashed(const char *path,
+                                    unsigned *uid, unsigned *gid, mode_t *perm)
+{
+    struct perms_ *p;
+
+    for (p = perm_hash[perm_hash_path(path)]; p; p = p->next) {
+        if (!strcmp(path, p->name))
+            goto found;
+    }
+    for (p = perm_prefixes; p; p = p->next) {
+        if (!strncmp(path, p->name, strlen(p->name)))
+            goto found;
+    }
+    return -1;
+
+found:
+    *uid = p->uid;
+    *gid = p->gid;
+    *perm = p->perm;
+    return 0;
+}
+
 static int get_device_perm_inner(struct perms_ *perms, const char *path,
                                     unsigned *uid, unsigned *gid, mode_t *perm)
 {
@@ -236,9 +302,10 @@ static mode_t get_device_perm(const char *path, unsigned *uid, unsigned *gid)
 {
     mode_t perm;
 
-    if (get_device_perm_inner(qemu_perms, path, uid, gid, &perm) == 0) {
+    if (qemu_perm_count &&
+        get_device_perm_inner(qemu_perms, path, uid, gid, &perm) == 0) {
         return perm;
-    } else if (get_device_perm_inner(devperms, path, uid, gid, &perm) == 0) {
+    } else if (get_device_perm_hashed(path, uid, gid, &perm) == 0) {
         return perm;
     } else {
         struct listnode *node;
@@ -285,6 +352,69 @@ static void make_device(const char *path, int block, int major, int minor)
     chown(path, uid, gid);
 }
 
+/* During coldplug, node creation for subsystems nothing needs this
+** early is pushed onto a queue and done in one batch after the sysfs
+** walk, so the devices init and early services depend on show up as
+** fast as possible.  Everything is still created before device_init()
+** returns; nothing after that can see a missing node.
+*/
+
+struct deferred_device {
+    struct deferred_device *next;
+    int block;
+    int major;
+    int minor;
+    char path[96];
+};
+
+static int coldboot_deferring;
+static struct deferred_device *deferred_list;
+static struct deferred_device *deferred_tail;
+
+static int subsystem_is_critical(const char *subsystem)
+{
+    return !strncmp(subsystem, "graphics", 8) ||
+           !strncmp(subsystem, "block", 5) ||
+           !strncmp(subsystem, "input", 5) ||
+           !strncmp(subsystem, "misc", 4) ||
+           !strncmp(subsystem, "tty", 3) ||
+           !strncmp(subsystem, "mem", 3);
+}
+
+static int defer_device(const char *path, int block, int major, int minor)
+{
+    struct deferred_device *dd;
+
+    dd = malloc(sizeof(*dd));
+    if(!dd)
+        return -1;
+
+    dd->next = 0;
+    dd->block = block;
+    dd->major = major;
+    dd->minor = minor;
+    strlcpy(dd->path, path, sizeof(dd->path));
+
+    if(deferred_tail)
+        deferred_tail->next = dd;
+    else
+        deferred_list = dd;
+    deferred_tail = dd;
+    return 0;
+}
+
+static void flush_deferred_devices(void)
+{
+    struct deferred_device *dd;
+
+    while((dd = deferred_list)) {
+        deferred_list = dd->next;
+        make_device(dd->path, dd->block, dd->major, dd->minor);
+        free(dd);
+    }
+    deferred_tail = 0;
+}
+
 #ifdef LOG_UEVENTS
 
 static inline suseconds_t get_usecs(void)
@@ -402,6 +532,14 @@ static void handle_device_event(struct uevent *uevent)
     snprintf(devpath, sizeof(devpath), "%s%s", base, name);
 
     if(!strcmp(uevent->action, "add")) {
+            /* coldplug generates adds only, so a deferred node cannot
+             * be overtaken by a remove for the same device
+             */
+        if(coldboot_deferring && !subsystem_is_critical(uevent->subsystem)) {
+            if(!defer_device(devpath, block, uevent->major, uevent->minor))
+                return;
+            /* fall through and create it now if we can't queue it */
+        }
         make_device(devpath, block, uevent->major, uevent->minor);
         return;
     }
@@ -412,6 +550,124 @@ static void handle_device_event(struct uevent *uevent)
     }
 }
 
+/* devices that crash and reload their firmware pay the file read from
+ * flash every time, so keep the last few blobs in memory.  the cache
+ * lives in init proper and is looked up before the load is forked off;
+ * the child inherits the blob through fork and copies it straight to
+ * the driver without touching the filesystem.  entries are capped so
+ * the allocations stay small and bounded.
+ */
+
+#define FW_CACHE_ENTRIES    2
+#define FW_CACHE_ENTRY_MAX  (512*1024)
+
+struct fw_cache_entry {
+    char *name;
+    char *data;
+    int size;
+    unsigned last_used;
+};
+
+static struct fw_cache_entry fw_cache[FW_CACHE_ENTRIES];
+static unsigned fw_cache_tick;
+
+static struct fw_cache_entry *fw_cache_find(const char *name)
+{
+    int n;
+
+    for(n = 0; n < FW_CACHE_ENTRIES; n++) {
+        if(fw_cache[n].name && !strcmp(fw_cache[n].name, name)) {
+            fw_cache[n].last_used = ++fw_cache_tick;
+            return fw_cache + n;
+        }
+    }
+    return 0;
+}
+
+static struct fw_cache_entry *fw_cache_load(const char *name)
+{
+    struct fw_cache_entry *entry;
+    struct stat st;
+    char *file;
+    char *data;
+    int fd, n, len, done;
+
+    if(asprintf(&file, FIRMWARE_DIR"/%s", name) == -1)
+        return 0;
+    fd = open(file, O_RDONLY);
+    free(file);
+    if(fd < 0)
+        return 0;
+
+    if(fstat(fd, &st) < 0 || st.st_size == 0 ||
+       st.st_size > FW_CACHE_ENTRY_MAX) {
+        close(fd);
+        return 0;
+    }
+
+    data = malloc(st.st_size);
+    if(!data) {
+        close(fd);
+        return 0;
+    }
+    for(done = 0; done < st.st_size; done += len) {
+        len = read(fd, data + done, st.st_size - done);
+        if(len <= 0) {
+            free(data);
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+
+        /* evict the least recently used slot */
+    entry = fw_cache;
+    for(n = 1; n < FW_CACHE_ENTRIES; n++) {
+        if(fw_cache[n].last_used < entry->last_used)
+            entry = fw_cache + n;
+    }
+    free(entry->name);
+    free(entry->data);
+    entry->name = strdup(name);
+    if(!entry->name) {
+        free(data);
+        entry->data = 0;
+        entry->size = 0;
+        entry->last_used = 0;
+        return 0;
+    }
+    entry->data = data;
+    entry->size = st.st_size;
+    entry->last_used = ++fw_cache_tick;
+    return entry;
+}
+
+/* copy a cached blob to the driver: no file I/O at all */
+static int load_firmware_data(const char *data, int size,
+                              int loading_fd, int data_fd)
+{
+    int ret = 0;
+
+    write(loading_fd, "1", 1);  /* start transfer */
+
+    while (size > 0) {
+        ssize_t nw = write(data_fd, data, size);
+        if(nw <= 0) {
+            ret = -1;
+            break;
+        }
+        data += nw;
+        size -= nw;
+    }
+
+    if(!ret)
+        write(loading_fd, "0", 1);  /* successful end of transfer */
+    else
+        write(loading_fd, "-1", 2); /* abort transfer */
+
+    return ret;
+}
+
 static int load_firmware(int fw_fd, int loading_fd, int data_fd)
 {
     struct stat st;
@@ -458,7 +714,8 @@ out:
     return ret;
 }
 
-static void process_firmware_event(struct uevent *uevent)
+static void process_firmware_event(struct uevent *uevent,
+                                   struct fw_cache_entry *fw)
 {
     char *root, *loading, *data, *file;
     int l, loading_fd, data_fd, fw_fd;
@@ -490,10 +747,22 @@ static void process_firmware_event(struct uevent *uevent)
     if(data_fd < 0)
         goto loading_close_out;
 
+    if(fw) {
+        /* the blob was cached by init before the fork */
+        if(!load_firmware_data(fw->data, fw->size, loading_fd, data_fd))
+            log_event_print("firmware copy success { '%s', '%s' }\n", root, file);
+        else
+            log_event_print("firmware copy failure { '%s', '%s' }\n", root, file);
+        goto data_close_out;
+    }
+
     fw_fd = open(file, O_RDONLY);
     if(fw_fd < 0)
         goto data_close_out;
 
+        /* start reading the blob in while the driver sets up */
+    posix_fadvise(fw_fd, 0, 0, POSIX_FADV_WILLNEED);
+
     if(!load_firmware(fw_fd, loading_fd, data_fd))
         log_event_print("firmware copy success { '%s', '%s' }\n", root, file);
     else
@@ -516,6 +785,7 @@ root_free_out:
 
 static void handle_firmware_event(struct uevent *uevent)
 {
+    struct fw_cache_entry *fw;
     pid_t pid;
 
     if(strcmp(uevent->subsystem, "firmware"))
@@ -524,10 +794,17 @@ static void handle_firmware_event(struct uevent *uevent)
     if(strcmp(uevent->action, "add"))
         return;
 
-    /* we fork, to avoid making large memory allocations in init proper */
+        /* look the blob up (or pull it in) before forking, so the
+         * child inherits it and repeat loads never reread flash
+         */
+    fw = fw_cache_find(uevent->firmware);
+    if(!fw)
+        fw = fw_cache_load(uevent->firmware);
+
+    /* we fork, so the copy to the driver never blocks uevent handling */
     pid = fork();
     if (!pid) {
-        process_firmware_event(uevent);
+        process_firmware_event(uevent, fw);
         exit(EXIT_SUCCESS);
     }
 }
@@ -618,10 +895,15 @@ int device_init(void)
     fcntl(fd, F_SETFD, FD_CLOEXEC);
     fcntl(fd, F_SETFL, O_NONBLOCK);
 
+    build_perm_table();
+
     t0 = get_usecs();
+    coldboot_deferring = 1;
     coldboot(fd, "/sys/class");
     coldboot(fd, "/sys/block");
     coldboot(fd, "/sys/devices");
+    coldboot_deferring = 0;
+    flush_deferred_devices();
     t1 = get_usecs();
 
     log_event_print("coldboot %ld uS\n", ((long) (t1 - t0)));
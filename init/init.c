@@ -24,7 +24,7 @@
 #include <sys/wait.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <errno.h>
 #include <stdarg.h>
@@ -44,6 +44,7 @@
 #include "devices.h"
 #include "init.h"
 #include "property_service.h"
+#include "control_service.h"
 #include "bootchart.h"
 
 static int property_triggers_enabled = 0;
@@ -66,6 +67,7 @@ static int keychords_count = 0;
 static int keychords_length = 0;
 
 static void drain_action_queue(void);
+static void service_release_dependents(void);
 
 static void notify_service_state(const char *name, const char *state)
 {
@@ -156,6 +158,30 @@ static void publish_socket(const char *name, int fd)
     fcntl(fd, F_SETFD, 0);
 }
 
+/* returns nonzero once everything svc is ordered after has started.
+ * a dependency which is disabled (and so not starting at all) does
+ * not hold us up -- the ordering only matters while both services
+ * are coming up together.  a heartbeat dependency only counts as
+ * started once it has reported ready, not merely forked.
+ */
+static int service_deps_met(struct service *svc)
+{
+    struct svcdepinfo *di;
+
+    for (di = svc->after; di; di = di->next) {
+        if (!di->svc)
+            continue;
+        if (di->svc->flags & SVC_DISABLED)
+            continue;
+        if (!(di->svc->flags & SVC_RUNNING))
+            return 0;
+        if ((di->svc->flags & SVC_HEARTBEAT) &&
+            !(di->svc->flags & SVC_READY))
+            return 0;
+    }
+    return 1;
+}
+
 void service_start(struct service *svc)
 {
     struct stat s;
@@ -167,9 +193,9 @@ void service_start(struct service *svc)
          * state and immediately takes it out of the restarting
          * state if it was in there
          */
-    svc->flags &= (~(SVC_DISABLED|SVC_RESTARTING));
+    svc->flags &= (~(SVC_DISABLED|SVC_RESTARTING|SVC_READY));
     svc->time_started = 0;
-    
+
         /* running processes require no additional work -- if
          * they're in the process of exiting, we've ensured
          * that they will immediately restart on exit, unless
@@ -179,6 +205,20 @@ void service_start(struct service *svc)
         return;
     }
 
+        /* defer the start until everything we are ordered after has
+         * forked; service_release_dependents() comes back for us.
+         * services with no dependencies are unaffected and fork
+         * immediately, so independent services still launch together.
+         */
+    if (!service_deps_met(svc)) {
+        if (!(svc->flags & SVC_WAITING)) {
+            svc->flags |= SVC_WAITING;
+            notify_service_state(svc->name, "waiting");
+        }
+        return;
+    }
+    svc->flags &= (~SVC_WAITING);
+
     needs_console = (svc->flags & SVC_CONSOLE) ? 1 : 0;
     if (needs_console && (!have_console)) {
         ERROR("service '%s' requires console\n", svc->name);
@@ -264,15 +304,36 @@ void service_start(struct service *svc)
     svc->pid = pid;
     svc->flags |= SVC_RUNNING;
 
+        /* heartbeat services are not "running" until they report
+         * ready, so that property triggers fire only on a service
+         * which has actually finished initializing
+         */
+    if (svc->flags & SVC_HEARTBEAT) {
+        notify_service_state(svc->name, "spawning");
+        return;
+    }
+
     notify_service_state(svc->name, "running");
+
+        /* now that we're up, anything ordered after us may be ready */
+    service_release_dependents();
+}
+
+/* retry every service whose start was deferred on a dependency.
+ * service_start() rechecks the dependencies itself, so services that
+ * are still blocked simply stay in the waiting state.
+ */
+static void service_release_dependents(void)
+{
+    service_for_each_flags(SVC_WAITING, service_start);
 }
 
 void service_stop(struct service *svc)
 {
         /* we are no longer running, nor should we
-         * attempt to restart
+         * attempt to restart, nor waiting to start
          */
-    svc->flags &= (~(SVC_RUNNING|SVC_RESTARTING));
+    svc->flags &= (~(SVC_RUNNING|SVC_RESTARTING|SVC_WAITING));
 
         /* if the service has not yet started, prevent
          * it from auto-starting with its class
@@ -288,8 +349,45 @@ void service_stop(struct service *svc)
     }
 }
 
+/* heartbeat services report readiness by setting svc.<name>.ready
+ * to "1".  that completes their transition to the running state and
+ * unblocks anything ordered after them.
+ */
+static void check_ready_property(const char *name, const char *value)
+{
+    char svcname[PROP_NAME_MAX];
+    size_t len = strlen(name);
+    struct service *svc;
+
+    if (strncmp(name, "svc.", 4) || len < sizeof("svc..ready") - 1)
+        return;
+    if (strcmp(name + len - 6, ".ready"))
+        return;
+
+    len -= 4 + 6;
+    if (len >= sizeof(svcname))
+        return;
+    memcpy(svcname, name + 4, len);
+    svcname[len] = 0;
+
+    svc = service_find_by_name(svcname);
+    if (!svc || !(svc->flags & SVC_HEARTBEAT) || strcmp(value, "1"))
+        return;
+    if ((svc->flags & (SVC_RUNNING|SVC_READY)) != SVC_RUNNING)
+        return;
+
+    svc->flags |= SVC_READY;
+    notify_service_state(svc->name, "running");
+    service_release_dependents();
+}
+
 void property_changed(const char *name, const char *value)
 {
+    if (!strcmp(name, "bootchart.dump") && !strcmp(value, "1"))
+        bootchart_lite_dump();
+
+    check_ready_property(name, value);
+
     if (property_triggers_enabled) {
         queue_property_triggers(name, value);
         drain_action_queue();
@@ -299,6 +397,12 @@ void property_changed(const char *name, const char *value)
 #define CRITICAL_CRASH_THRESHOLD    4       /* if we crash >4 times ... */
 #define CRITICAL_CRASH_WINDOW       (4*60)  /* ... in 4 minutes, goto recovery*/
 
+#define SVC_RESTART_PERIOD_MIN      5       /* first restart delay, seconds */
+#define SVC_RESTART_PERIOD_MAX      300     /* delay stops doubling here */
+#define SVC_HEALTHY_UPTIME          60      /* ran this long: forgive crashes */
+
+static unsigned restart_seed;
+
 static int wait_for_one_process(int block)
 {
     pid_t pid;
@@ -334,7 +438,7 @@ static int wait_for_one_process(int block)
     }
 
     svc->pid = 0;
-    svc->flags &= (~SVC_RUNNING);
+    svc->flags &= (~(SVC_RUNNING|SVC_READY));
 
         /* oneshot processes go into the disabled state on exit */
     if (svc->flags & SVC_ONESHOT) {
@@ -348,9 +452,32 @@ static int wait_for_one_process(int block)
     }
 
     now = gettime();
-    if (svc->flags & SVC_CRITICAL) {
-        if (svc->time_crashed + CRITICAL_CRASH_WINDOW >= now) {
-            if (++svc->nr_crashed > CRITICAL_CRASH_THRESHOLD) {
+    if (now - svc->time_started >= SVC_HEALTHY_UPTIME) {
+            /* it ran long enough to be considered healthy; forgive
+             * earlier crashes and restart promptly again
+             */
+        svc->nr_crashed = 0;
+        svc->restart_period = SVC_RESTART_PERIOD_MIN;
+    } else {
+        if (svc->time_crashed + CRITICAL_CRASH_WINDOW < now) {
+            svc->time_crashed = now;
+            svc->nr_crashed = 0;
+        }
+        svc->nr_crashed++;
+
+            /* each rapid crash doubles the delay before the next
+             * attempt, so a broken service settles down instead of
+             * rediscovering its failure at full speed
+             */
+        if (svc->restart_period < SVC_RESTART_PERIOD_MIN)
+            svc->restart_period = SVC_RESTART_PERIOD_MIN;
+        else if (svc->restart_period < SVC_RESTART_PERIOD_MAX / 2)
+            svc->restart_period *= 2;
+        else
+            svc->restart_period = SVC_RESTART_PERIOD_MAX;
+
+        if (svc->nr_crashed > CRITICAL_CRASH_THRESHOLD) {
+            if (svc->flags & SVC_CRITICAL) {
                 ERROR("critical process '%s' exited %d times in %d minutes; "
                       "rebooting into recovery mode\n", svc->name,
                       CRITICAL_CRASH_THRESHOLD, CRITICAL_CRASH_WINDOW / 60);
@@ -359,12 +486,30 @@ static int wait_for_one_process(int block)
                          LINUX_REBOOT_CMD_RESTART2, "recovery");
                 return 0;
             }
-        } else {
-            svc->time_crashed = now;
-            svc->nr_crashed = 1;
+                /* crash-looping: park it rather than keep burning
+                 * cpu.  setting ctl.start for the service puts it
+                 * back into rotation with the counters cleared.
+                 */
+            ERROR("process '%s' exited %d times in %d minutes; "
+                  "not restarting it (set ctl.start to resume)\n",
+                  svc->name, svc->nr_crashed, CRITICAL_CRASH_WINDOW / 60);
+            svc->flags |= SVC_DISABLED;
+            svc->nr_crashed = 0;
+            svc->restart_period = SVC_RESTART_PERIOD_MIN;
+            notify_service_state(svc->name, "parked");
+            return 0;
         }
     }
 
+        /* spread restarts out a little so services which died
+         * together do not keep forking in lockstep
+         */
+    if (!restart_seed)
+        restart_seed = (unsigned) now | 1;
+    restart_seed = restart_seed * 1103515245 + 12345;
+    svc->time_next_start = now + svc->restart_period +
+            (restart_seed >> 16) % ((unsigned) svc->restart_period / 4 + 1);
+
     /* Execute all onrestart commands for this service. */
     list_for_each(node, &svc->onrestart.commands) {
         cmd = node_to_item(node, struct command, clist);
@@ -377,7 +522,7 @@ static int wait_for_one_process(int block)
 
 static void restart_service_if_needed(struct service *svc)
 {
-    time_t next_start_time = svc->time_started + 5;
+    time_t next_start_time = svc->time_next_start;
 
     if (next_start_time <= gettime()) {
         svc->flags &= (~SVC_RESTARTING);
@@ -745,18 +890,58 @@ void handle_keychord(int fd)
     }
 }
 
+static void handle_signal(int fd)
+{
+    char tmp[32];
+
+    /* we got a SIGCHLD - reap and restart as needed */
+    read(fd, tmp, sizeof(tmp));
+    while (!wait_for_one_process(0))
+        ;
+}
+
+/* the main loop waits on all of these with one epoll set and runs the
+ * handlers for whatever is ready in registration order, so the order
+ * of register_event() calls is the dispatch priority */
+
+#define EVENT_COUNT_MAX 5
+
+static struct {
+    int fd;
+    void (*handler)(int fd);
+} events[EVENT_COUNT_MAX];
+
+static int event_count = 0;
+static int epoll_fd = -1;
+
+static int register_event(int fd, void (*handler)(int fd))
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = event_count;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ERROR("failed to add fd %d to epoll set (%s)\n", fd, strerror(errno));
+        return -1;
+    }
+    events[event_count].fd = fd;
+    events[event_count].handler = handler;
+    event_count++;
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int device_fd = -1;
     int property_set_fd = -1;
+    int control_fd = -1;
     int signal_recv_fd = -1;
     int keychord_fd = -1;
-    int fd_count;
     int s[2];
     int fd;
     struct sigaction act;
     char tmp[PROP_VALUE_MAX];
-    struct pollfd ufds[4];
     char *tmpdev;
     char* debuggable;
 
@@ -804,6 +989,9 @@ int main(int argc, char **argv)
     snprintf(tmp, sizeof(tmp), "/init.%s.rc", hardware);
     parse_config_file(tmp);
 
+        /* all services are known now; wire up start ordering */
+    service_resolve_dependencies();
+
     action_for_each_trigger("early-init", action_add_queue_tail);
     drain_action_queue();
 
@@ -818,6 +1006,10 @@ int main(int argc, char **argv)
         keychord_fd = open_keychord();
     }
 
+    /* lightweight sampling into the shared ring; on unless
+     * ro.bootchart.lite is set to "0" */
+    bootchart_lite_init();
+
     if (console[0]) {
         snprintf(tmp, sizeof(tmp), "/dev/%s", console);
         console_name = strdup(tmp);
@@ -883,6 +1075,13 @@ int main(int argc, char **argv)
          */
     property_set_fd = start_property_service();
 
+        /* batched service control channel; not fatal if it fails
+         * since the ctl. properties still work without it
+         */
+    control_fd = start_control_service();
+    if (control_fd < 0)
+        ERROR("failed to start control service\n");
+
     /* create a signalling mechanism for the sigchld handler */
     if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) == 0) {
         signal_fd = s[0];
@@ -913,23 +1112,23 @@ int main(int argc, char **argv)
         /* enable property triggers */   
     property_triggers_enabled = 1;     
 
-    ufds[0].fd = device_fd;
-    ufds[0].events = POLLIN;
-    ufds[1].fd = property_set_fd;
-    ufds[1].events = POLLIN;
-    ufds[2].fd = signal_recv_fd;
-    ufds[2].events = POLLIN;
-    fd_count = 3;
-
-    if (keychord_fd > 0) {
-        ufds[3].fd = keychord_fd;
-        ufds[3].events = POLLIN;
-        fd_count++;
-    } else {
-        ufds[3].events = 0;
-        ufds[3].revents = 0;
+    epoll_fd = epoll_create(EVENT_COUNT_MAX);
+    if (epoll_fd < 0) {
+        ERROR("epoll_create failed (%s)\n", strerror(errno));
+        return 1;
     }
 
+        /* registration order is dispatch priority: reap children ahead
+         * of everything else so a storm of property sets cannot starve
+         * service restarts, and leave the property socket last */
+    register_event(signal_recv_fd, handle_signal);
+    register_event(device_fd, handle_device_fd);
+    if (keychord_fd > 0)
+        register_event(keychord_fd, handle_keychord);
+    if (control_fd >= 0)
+        register_event(control_fd, handle_control_fd);
+    register_event(property_set_fd, handle_property_set_fd);
+
 #if BOOTCHART
     bootchart_count = bootchart_init();
     if (bootchart_count < 0) {
@@ -942,11 +1141,10 @@ int main(int argc, char **argv)
 #endif
 
     for(;;) {
+        struct epoll_event evts[EVENT_COUNT_MAX];
+        int ready[EVENT_COUNT_MAX];
         int nr, i, timeout = -1;
 
-        for (i = 0; i < fd_count; i++)
-            ufds[i].revents = 0;
-
         drain_action_queue();
         restart_processes();
 
@@ -966,25 +1164,20 @@ int main(int argc, char **argv)
             }
         }
 #endif
-        nr = poll(ufds, fd_count, timeout);
-        if (nr <= 0)
-            continue;
+        timeout = bootchart_lite_timeout(timeout);
 
-        if (ufds[2].revents == POLLIN) {
-            /* we got a SIGCHLD - reap and restart as needed */
-            read(signal_recv_fd, tmp, sizeof(tmp));
-            while (!wait_for_one_process(0))
-                ;
+        nr = epoll_wait(epoll_fd, evts, EVENT_COUNT_MAX, timeout);
+        if (nr <= 0)
             continue;
-        }
 
-        if (ufds[0].revents == POLLIN)
-            handle_device_fd(device_fd);
+        memset(ready, 0, sizeof(ready));
+        for (i = 0; i < nr; i++)
+            ready[evts[i].data.u32] = 1;
 
-        if (ufds[1].revents == POLLIN)
-            handle_property_set_fd(property_set_fd);
-        if (ufds[3].revents == POLLIN)
-            handle_keychord(keychord_fd);
+            /* run whatever is ready, highest priority first */
+        for (i = 0; i < event_count; i++)
+            if (ready[i])
+                events[i].handler(events[i].fd);
     }
 
     return 0;
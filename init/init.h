@@ -106,12 +106,24 @@ struct svcenvinfo {
     const char *value;
 };
 
+struct svcdepinfo {
+    struct svcdepinfo *next;
+    const char *name;
+        /* filled in by service_resolve_dependencies(); left null
+         * if the named service does not exist or closes a cycle
+         */
+    struct service *svc;
+};
+
 #define SVC_DISABLED    0x01  /* do not autostart with class */
 #define SVC_ONESHOT     0x02  /* do not restart on exit */
 #define SVC_RUNNING     0x04  /* currently active */
 #define SVC_RESTARTING  0x08  /* waiting to restart */
 #define SVC_CONSOLE     0x10  /* requires console */
 #define SVC_CRITICAL    0x20  /* will reboot into recovery if keeps crashing */
+#define SVC_WAITING     0x40  /* start deferred until dependencies are up */
+#define SVC_HEARTBEAT   0x80  /* not "running" until svc.<name>.ready is 1 */
+#define SVC_READY       0x100 /* heartbeat service has reported ready */
 
 #define NR_SVC_SUPP_GIDS 6    /* six supplementary groups */
 
@@ -127,6 +139,8 @@ struct service {
     time_t time_started;    /* time of last start */
     time_t time_crashed;    /* first crash within inspection window */
     int nr_crashed;         /* number of times crashed within window */
+    time_t restart_period;  /* current restart delay; grows on rapid crashes */
+    time_t time_next_start; /* earliest time to attempt the next restart */
     
     uid_t uid;
     gid_t gid;
@@ -136,6 +150,14 @@ struct service {
     struct socketinfo *sockets;
     struct svcenvinfo *envvars;
 
+        /* services we must not start before ("after" option), and
+         * services which must not start before us ("before" option,
+         * folded into the target's after list at resolve time)
+         */
+    struct svcdepinfo *after;
+    struct svcdepinfo *before;
+    int dep_mark;           /* scratch for cycle detection */
+
     int nargs;
     char *args[1];
     struct action onrestart;  /* Actions to execute on restart. */
@@ -147,6 +169,16 @@ struct service {
 };
 
 int parse_config_file(const char *fn);
+int parse_text_config_file(const char *fn);
+int lookup_keyword(const char *s);
+int (*keyword_func(int kw))(int nargs, char **args);
+int keyword_is_command(int kw);
+
+/* owned by parser.c; compiled.c appends to them when loading a
+ * compiled config
+ */
+extern struct listnode service_list;
+extern struct listnode action_list;
 
 struct service *service_find_by_name(const char *name);
 struct service *service_find_by_pid(pid_t pid);
@@ -158,6 +190,7 @@ void service_for_each_flags(unsigned matchflags,
                             void (*func)(struct service *svc));
 void service_stop(struct service *svc);
 void service_start(struct service *svc);
+void service_resolve_dependencies(void);
 void property_changed(const char *name, const char *value);
 
 struct action *action_remove_queue_head(void);
@@ -11,6 +11,8 @@ int do_insmod(int nargs, char **args);
 int do_import(int nargs, char **args);
 int do_mkdir(int nargs, char **args);
 int do_mount(int nargs, char **args);
+int do_mount_async(int nargs, char **args);
+int do_mount_wait(int nargs, char **args);
 int do_restart(int nargs, char **args);
 int do_setkey(int nargs, char **args);
 int do_setprop(int nargs, char **args);
@@ -30,6 +32,8 @@ int do_device(int nargs, char **args);
 enum {
     K_UNKNOWN,
 #endif
+    KEYWORD(after,       OPTION,  0, 0)
+    KEYWORD(before,      OPTION,  0, 0)
     KEYWORD(capability,  OPTION,  0, 0)
     KEYWORD(class,       OPTION,  0, 0)
     KEYWORD(class_start, COMMAND, 1, do_class_start)
@@ -41,6 +45,7 @@ enum {
     KEYWORD(exec,        COMMAND, 1, do_exec)
     KEYWORD(export,      COMMAND, 2, do_export)
     KEYWORD(group,       OPTION,  0, 0)
+    KEYWORD(heartbeat,   OPTION,  0, 0)
     KEYWORD(hostname,    COMMAND, 1, do_hostname)
     KEYWORD(ifup,        COMMAND, 1, do_ifup)
     KEYWORD(insmod,      COMMAND, 1, do_insmod)
@@ -48,6 +53,8 @@ enum {
     KEYWORD(keycodes,    OPTION,  0, 0)
     KEYWORD(mkdir,       COMMAND, 1, do_mkdir)
     KEYWORD(mount,       COMMAND, 3, do_mount)
+    KEYWORD(mount_async, COMMAND, 3, do_mount_async)
+    KEYWORD(mount_wait,  COMMAND, 0, do_mount_wait)
     KEYWORD(on,          SECTION, 0, 0)
     KEYWORD(oneshot,     OPTION,  0, 0)
     KEYWORD(onrestart,   OPTION,  0, 0)
@@ -9,12 +9,20 @@
 
 #include "init.h"
 #include "property_service.h"
-
+#include "compiled.h"
+
+#ifdef INIT_HOST_RCC
+/* building the offline rc compiler on the host; no bionic there,
+ * and only the property name length limit is needed here
+ */
+#define PROP_NAME_MAX 32
+#else
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
+#endif
 
-static list_declare(service_list);
-static list_declare(action_list);
+list_declare(service_list);
+list_declare(action_list);
 static list_declare(action_queue);
 
 #define RAW(x...) log_write(6, x)
@@ -125,78 +133,60 @@ struct {
 #define kw_func(kw) (keyword_info[kw].func)
 #define kw_nargs(kw) (keyword_info[kw].nargs)
 
+/* accessors for the compiled config loader (compiled.c) */
+int (*keyword_func(int kw))(int nargs, char **args)
+{
+    return kw_func(kw);
+}
+
+int keyword_is_command(int kw)
+{
+    return kw_is(kw, COMMAND);
+}
+
+/* open-addressed keyword hash, built once from keyword_info[] so the
+ * list in keywords.h stays the single source of truth; K_UNKNOWN (0)
+ * doubles as the empty-slot marker
+ */
+#define KEYWORD_HASH_SIZE 128
+
+static unsigned char keyword_hash[KEYWORD_HASH_SIZE];
+static int keyword_hash_ready;
+
+static unsigned hash_keyword(const char *s)
+{
+    unsigned h = 5381;
+    while (*s)
+        h = h * 33 + *s++;
+    return h;
+}
+
+static void build_keyword_hash(void)
+{
+    unsigned i;
+    int kw;
+
+    for (kw = K_UNKNOWN + 1; kw < KEYWORD_COUNT; kw++) {
+        i = hash_keyword(kw_name(kw)) & (KEYWORD_HASH_SIZE - 1);
+        while (keyword_hash[i])
+            i = (i + 1) & (KEYWORD_HASH_SIZE - 1);
+        keyword_hash[i] = kw;
+    }
+    keyword_hash_ready = 1;
+}
+
 int lookup_keyword(const char *s)
 {
-    switch (*s++) {
-    case 'c':
-        if (!strcmp(s, "apability")) return K_capability;
-        if (!strcmp(s, "lass")) return K_class;
-        if (!strcmp(s, "lass_start")) return K_class_start;
-        if (!strcmp(s, "lass_stop")) return K_class_stop;
-        if (!strcmp(s, "onsole")) return K_console;
-        if (!strcmp(s, "hown")) return K_chown;
-        if (!strcmp(s, "hmod")) return K_chmod;
-        if (!strcmp(s, "ritical")) return K_critical;
-        break;
-    case 'd':
-        if (!strcmp(s, "isabled")) return K_disabled;
-        if (!strcmp(s, "omainname")) return K_domainname;
-        if (!strcmp(s, "evice")) return K_device;
-        break;
-    case 'e':
-        if (!strcmp(s, "xec")) return K_exec;
-        if (!strcmp(s, "xport")) return K_export;
-        break;
-    case 'g':
-        if (!strcmp(s, "roup")) return K_group;
-        break;
-    case 'h':
-        if (!strcmp(s, "ostname")) return K_hostname;
-        break;
-    case 'i':
-        if (!strcmp(s, "fup")) return K_ifup;
-        if (!strcmp(s, "nsmod")) return K_insmod;
-        if (!strcmp(s, "mport")) return K_import;
-        break;
-    case 'k':
-        if (!strcmp(s, "eycodes")) return K_keycodes;
-        break;
-    case 'l':
-        if (!strcmp(s, "oglevel")) return K_loglevel;
-        break;
-    case 'm':
-        if (!strcmp(s, "kdir")) return K_mkdir;
-        if (!strcmp(s, "ount")) return K_mount;
-        break;
-    case 'o':
-        if (!strcmp(s, "n")) return K_on;
-        if (!strcmp(s, "neshot")) return K_oneshot;
-        if (!strcmp(s, "nrestart")) return K_onrestart;
-        break;
-    case 'r':
-        if (!strcmp(s, "estart")) return K_restart;
-        break;
-    case 's':
-        if (!strcmp(s, "ervice")) return K_service;
-        if (!strcmp(s, "etenv")) return K_setenv;
-        if (!strcmp(s, "etkey")) return K_setkey;
-        if (!strcmp(s, "etprop")) return K_setprop;
-        if (!strcmp(s, "etrlimit")) return K_setrlimit;
-        if (!strcmp(s, "ocket")) return K_socket;
-        if (!strcmp(s, "tart")) return K_start;
-        if (!strcmp(s, "top")) return K_stop;
-        if (!strcmp(s, "ymlink")) return K_symlink;
-        if (!strcmp(s, "ysclktz")) return K_sysclktz;
-        break;
-    case 't':
-        if (!strcmp(s, "rigger")) return K_trigger;
-        break;
-    case 'u':
-        if (!strcmp(s, "ser")) return K_user;
-        break;
-    case 'w':
-        if (!strcmp(s, "rite")) return K_write;
-        break;
+    unsigned i;
+
+    if (!keyword_hash_ready)
+        build_keyword_hash();
+
+    i = hash_keyword(s) & (KEYWORD_HASH_SIZE - 1);
+    while (keyword_hash[i]) {
+        if (!strcmp(s, kw_name(keyword_hash[i])))
+            return keyword_hash[i];
+        i = (i + 1) & (KEYWORD_HASH_SIZE - 1);
     }
     return K_UNKNOWN;
 }
@@ -232,7 +222,8 @@ int next_token(struct parse_state *state)
             x++;
             continue;
         case '#':
-            while (*x && (*x != '\n')) x++;
+            s = strchr(x, '\n');
+            x = s ? s : x + strlen(x);
             state->line++;
             state->ptr = x;
             return T_NEWLINE;
@@ -249,6 +240,16 @@ text:
     state->text = s = x;
 textresume:
     for (;;) {
+            /* scan plain bytes in bulk; the loop only needs to look at
+             * delimiters, escapes and quotes one at a time
+             */
+        size_t n = strcspn(x, " \t\r\n\"\\");
+        if (n) {
+            if (s != x)
+                memmove(s, x, n);
+            s += n;
+            x += n;
+        }
         switch (*x) {
         case 0:
             goto textdone;
@@ -263,20 +264,18 @@ textresume:
             goto textdone;
         case '"':
             x++;
-            for (;;) {
-                switch (*x) {
-                case 0:
-                        /* unterminated quoted thing */
-                    state->ptr = x;
-                    return T_EOF;
-                case '"':
-                    x++;
-                    goto textresume;
-                default:
-                    *s++ = *x++;
-                }
+            n = strcspn(x, "\"");
+            if (s != x)
+                memmove(s, x, n);
+            s += n;
+            x += n;
+            if (*x == 0) {
+                    /* unterminated quoted thing */
+                state->ptr = x;
+                return T_EOF;
             }
-            break;
+            x++;
+            continue;
         case '\\':
             x++;
             switch (*x) {
@@ -392,7 +391,7 @@ static void parse_config(const char *fn, char *s)
     }
 }
 
-int parse_config_file(const char *fn)
+int parse_text_config_file(const char *fn)
 {
     char *data;
     data = read_file(fn, 0);
@@ -403,6 +402,17 @@ int parse_config_file(const char *fn)
     return 0;
 }
 
+int parse_config_file(const char *fn)
+{
+        /* prefer the compiled form when the build has provided one;
+         * fall back to the text parser when absent, stale or invalid
+         */
+    if (load_compiled_config(fn) == 0)
+        return 0;
+
+    return parse_text_config_file(fn);
+}
+
 static int valid_name(const char *name)
 {
     if (strlen(name) > 16) {
@@ -492,6 +502,78 @@ void service_for_each_flags(unsigned matchflags,
     }
 }
 
+/*
+ * Walk one service's after list depth-first, looking for a cycle.
+ * dep_mark is 1 while a service is on the current path, 2 once its
+ * subtree is known to be clean.  An edge closing a cycle is dropped
+ * (svc pointer nulled) so the services involved can still start.
+ */
+static void check_dependency_cycle(struct service *svc)
+{
+    struct svcdepinfo *di;
+
+    svc->dep_mark = 1;
+    for (di = svc->after; di; di = di->next) {
+        if (!di->svc)
+            continue;
+        if (di->svc->dep_mark == 1) {
+            ERROR("dependency cycle: ignoring '%s' after '%s'\n",
+                  svc->name, di->name);
+            di->svc = 0;
+        } else if (di->svc->dep_mark == 0) {
+            check_dependency_cycle(di->svc);
+        }
+    }
+    svc->dep_mark = 2;
+}
+
+/*
+ * Resolve service dependency names to services.  Called once, after
+ * all config files have been parsed and before any service starts.
+ * "before" entries are folded into the target's after list so the
+ * scheduler only ever has to look at one list.
+ */
+void service_resolve_dependencies(void)
+{
+    struct listnode *node;
+    struct service *svc;
+    struct svcdepinfo *di;
+    struct svcdepinfo *rev;
+
+    list_for_each(node, &service_list) {
+        svc = node_to_item(node, struct service, slist);
+
+        for (di = svc->after; di; di = di->next) {
+            di->svc = service_find_by_name(di->name);
+            if (!di->svc)
+                ERROR("service '%s' is after unknown service '%s'\n",
+                      svc->name, di->name);
+        }
+
+        for (di = svc->before; di; di = di->next) {
+            di->svc = service_find_by_name(di->name);
+            if (!di->svc) {
+                ERROR("service '%s' is before unknown service '%s'\n",
+                      svc->name, di->name);
+                continue;
+            }
+            rev = calloc(1, sizeof(*rev));
+            if (!rev)
+                continue;
+            rev->name = svc->name;
+            rev->svc = svc;
+            rev->next = di->svc->after;
+            di->svc->after = rev;
+        }
+    }
+
+    list_for_each(node, &service_list) {
+        svc = node_to_item(node, struct service, slist);
+        if (svc->dep_mark == 0)
+            check_dependency_cycle(svc);
+    }
+}
+
 void action_for_each_trigger(const char *trigger,
                              void (*func)(struct action *act))
 {
@@ -620,6 +702,31 @@ static void parse_line_service(struct parse_state *state, int nargs, char **args
     
     kw = lookup_keyword(args[0]);
     switch (kw) {
+    case K_after:
+    case K_before: { /* name [ name ]* */
+        struct svcdepinfo *di;
+        int n;
+        if (nargs < 2) {
+            parse_error(state, "%s option requires a service name\n", args[0]);
+            break;
+        }
+        for (n = 1; n < nargs; n++) {
+            di = calloc(1, sizeof(*di));
+            if (!di) {
+                parse_error(state, "out of memory\n");
+                break;
+            }
+            di->name = args[n];
+            if (kw == K_after) {
+                di->next = svc->after;
+                svc->after = di;
+            } else {
+                di->next = svc->before;
+                svc->before = di;
+            }
+        }
+        break;
+    }
     case K_capability:
         break;
     case K_class:
@@ -650,6 +757,9 @@ static void parse_line_service(struct parse_state *state, int nargs, char **args
             svc->nr_supp_gids = n - 2;
         }
         break;
+    case K_heartbeat:
+        svc->flags |= SVC_HEARTBEAT;
+        break;
     case K_keycodes:
         if (nargs < 2) {
             parse_error(state, "keycodes option requires atleast one keycode\n");
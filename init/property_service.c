@@ -118,18 +118,74 @@ out:
     return -1;
 }
 
-/* (8 header words + 247 toc words) = 1020 bytes */
-/* 1024 bytes header and toc + 247 prop_infos @ 128 bytes = 32640 bytes */
+/* (8 header words + 1016 toc words) = 4096 bytes header and toc */
+/* 4096 bytes header and toc + 992 prop_infos @ 128 bytes = 131072 bytes */
+/*
+ * The client side follows the toc offsets and takes the count from the
+ * header, so the area can grow without breaking already-built readers;
+ * they map whatever size init advertises in the workspace environment.
+ */
 
-#define PA_COUNT_MAX  247
-#define PA_INFO_START 1024
-#define PA_SIZE       32768
+#define PA_COUNT_MAX  992
+#define PA_INFO_START 4096
+#define PA_SIZE       131072
 
 static workspace pa_workspace;
 static prop_info *pa_info_array;
 
 extern prop_area *__system_property_area__;
 
+/*
+ * init does a find for every get and set, and with the bigger area the
+ * linear toc scan in libc gets expensive, so init keeps its own hash
+ * index over the prop_infos.  This lives in init's heap; readers in
+ * other processes are unaffected and still rely on the per-entry
+ * serial versioning in update_prop_info() for lock-free consistency.
+ */
+
+#define PROP_HASH_BUCKETS 256   /* power of two */
+
+struct prop_node {
+    struct prop_node *next;
+    prop_info *pi;
+};
+
+static struct prop_node *prop_hash[PROP_HASH_BUCKETS];
+
+static unsigned int prop_hash_name(const char *name)
+{
+    unsigned int h = 0;
+    while (*name)
+        h = h * 31 + *name++;
+    return h & (PROP_HASH_BUCKETS - 1);
+}
+
+static prop_info *prop_index_find(const char *name)
+{
+    struct prop_node *n;
+
+    for (n = prop_hash[prop_hash_name(name)]; n; n = n->next) {
+        if (!strcmp(n->pi->name, name))
+            return n->pi;
+    }
+    return 0;
+}
+
+static int prop_index_insert(prop_info *pi)
+{
+    struct prop_node *n;
+    unsigned int h;
+
+    n = malloc(sizeof(*n));
+    if (!n)
+        return -1;
+    h = prop_hash_name(pi->name);
+    n->pi = pi;
+    n->next = prop_hash[h];
+    prop_hash[h] = n;
+    return 0;
+}
+
 static int init_property_area(void)
 {
     prop_area *pa;
@@ -178,7 +234,7 @@ static int property_write(prop_info *pi, const char *value)
  *
  * Returns 1 if uid allowed, 0 otherwise.
  */
-static int check_control_perms(const char *name, int uid) {
+int check_control_perms(const char *name, int uid) {
     int i;
     if (uid == AID_SYSTEM || uid == AID_ROOT)
         return 1;
@@ -225,7 +281,7 @@ const char* property_get(const char *name)
 
     if(strlen(name) >= PROP_NAME_MAX) return 0;
 
-    pi = (prop_info*) __system_property_find(name);
+    pi = prop_index_find(name);
 
     if(pi != 0) {
         return pi->value;
@@ -268,7 +324,7 @@ int property_set(const char *name, const char *value)
     if(valuelen >= PROP_VALUE_MAX) return -1;
     if(namelen < 1) return -1;
 
-    pi = (prop_info*) __system_property_find(name);
+    pi = prop_index_find(name);
 
     if(pi != 0) {
         /* ro.* properties may NEVER be modified once set */
@@ -287,6 +343,10 @@ int property_set(const char *name, const char *value)
         memcpy(pi->name, name, namelen + 1);
         memcpy(pi->value, value, valuelen + 1);
 
+        /* index it before publishing so a failed insert can't leave
+         * an entry the index will never see again */
+        if(prop_index_insert(pi)) return -1;
+
         pa->toc[pa->count] =
             (namelen << 24) | (((unsigned) pi) - ((unsigned) pa));
 
@@ -354,39 +414,44 @@ void handle_property_set_fd(int fd)
         return;
     }
 
-    r = recv(s, &msg, sizeof(msg), 0);
-    close(s);
-    if(r != sizeof(prop_msg)) {
-        ERROR("sys_prop: mis-match msg size recieved: %d expected: %d\n",
-              r, sizeof(prop_msg));
-        return;
-    }
+    /* drain every message queued on this connection, so clients
+     * may batch several sets behind a single connect */
+    for(;;) {
+        r = recv(s, &msg, sizeof(msg), 0);
+        if(r == 0) break;
+        if(r != sizeof(prop_msg)) {
+            ERROR("sys_prop: mis-match msg size recieved: %d expected: %d\n",
+                  r, sizeof(prop_msg));
+            break;
+        }
 
-    switch(msg.cmd) {
-    case PROP_MSG_SETPROP:
-        msg.name[PROP_NAME_MAX-1] = 0;
-        msg.value[PROP_VALUE_MAX-1] = 0;
+        switch(msg.cmd) {
+        case PROP_MSG_SETPROP:
+            msg.name[PROP_NAME_MAX-1] = 0;
+            msg.value[PROP_VALUE_MAX-1] = 0;
 
-        if(memcmp(msg.name,"ctl.",4) == 0) {
-            if (check_control_perms(msg.value, cr.uid)) {
-                handle_control_message((char*) msg.name + 4, (char*) msg.value);
-            } else {
-                ERROR("sys_prop: Unable to %s service ctl [%s] uid: %d pid:%d\n",
-                        msg.name + 4, msg.value, cr.uid, cr.pid);
-            }
-        } else {
-            if (check_perms(msg.name, cr.uid)) {
-                property_set((char*) msg.name, (char*) msg.value);
+            if(memcmp(msg.name,"ctl.",4) == 0) {
+                if (check_control_perms(msg.value, cr.uid)) {
+                    handle_control_message((char*) msg.name + 4, (char*) msg.value);
+                } else {
+                    ERROR("sys_prop: Unable to %s service ctl [%s] uid: %d pid:%d\n",
+                            msg.name + 4, msg.value, cr.uid, cr.pid);
+                }
             } else {
-                ERROR("sys_prop: permission denied uid:%d  name:%s\n",
-                      cr.uid, msg.name);
+                if (check_perms(msg.name, cr.uid)) {
+                    property_set((char*) msg.name, (char*) msg.value);
+                } else {
+                    ERROR("sys_prop: permission denied uid:%d  name:%s\n",
+                          cr.uid, msg.name);
+                }
             }
-        }
-        break;
+            break;
 
-    default:
-        break;
+        default:
+            break;
+        }
     }
+    close(s);
 }
 
 void get_property_workspace(int *fd, int *sz)
@@ -23,6 +23,7 @@ extern void property_init(void);
 extern int start_property_service(void);
 void get_property_workspace(int *fd, int *sz);
 extern const char* property_get(const char *name);
+extern int check_control_perms(const char *name, int uid);
 extern int property_set(const char *name, const char *value);
 
 #endif	/* _INIT_PROPERTY_H */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Offline init.rc compiler.  Parses an rc file with the same parser
+ * init uses and writes the compiled form described in compiled.h.
+ * Runs on the host at build time:
+ *
+ *     rcc init.rc init.rc.bin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "init.h"
+#include "compiled.h"
+
+/* the parser's keyword table references every builtin command; none
+ * of them can run on the host, and the compiler never executes
+ * commands, so stub them all out
+ */
+#define STUB_FUNCTION(fn) \
+    int fn(int nargs, char **args) { return 0; }
+STUB_FUNCTION(do_class_start)
+STUB_FUNCTION(do_class_stop)
+STUB_FUNCTION(do_domainname)
+STUB_FUNCTION(do_exec)
+STUB_FUNCTION(do_export)
+STUB_FUNCTION(do_hostname)
+STUB_FUNCTION(do_ifup)
+STUB_FUNCTION(do_insmod)
+STUB_FUNCTION(do_import)
+STUB_FUNCTION(do_mkdir)
+STUB_FUNCTION(do_mount)
+STUB_FUNCTION(do_mount_async)
+STUB_FUNCTION(do_mount_wait)
+STUB_FUNCTION(do_restart)
+STUB_FUNCTION(do_setkey)
+STUB_FUNCTION(do_setprop)
+STUB_FUNCTION(do_setrlimit)
+STUB_FUNCTION(do_start)
+STUB_FUNCTION(do_stop)
+STUB_FUNCTION(do_trigger)
+STUB_FUNCTION(do_symlink)
+STUB_FUNCTION(do_sysclktz)
+STUB_FUNCTION(do_write)
+STUB_FUNCTION(do_chown)
+STUB_FUNCTION(do_chmod)
+STUB_FUNCTION(do_loglevel)
+STUB_FUNCTION(do_device)
+
+/* likewise for the property service the parser links against */
+const char* property_get(const char *name)
+{
+    return 0;
+}
+
+int property_set(const char *name, const char *value)
+{
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: rcc <input.rc> <output.bin>\n");
+        return 1;
+    }
+
+    if (parse_text_config_file(argv[1])) {
+        fprintf(stderr, "rcc: cannot read '%s'\n", argv[1]);
+        return 1;
+    }
+
+    if (write_compiled_config(argv[2])) {
+        fprintf(stderr, "rcc: cannot write '%s'\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -4,4 +4,13 @@ include $(CLEAR_VARS)
 LOCAL_MODULE:= libctest
 LOCAL_SRC_FILES := ctest.c
 
+LOCAL_SHARED_LIBRARIES := libm
+
+# need "-lrt" on Linux simulator to pick up clock_gettime
+ifeq ($(TARGET_SIMULATOR),true)
+	ifeq ($(HOST_OS),linux)
+		LOCAL_LDLIBS += -lrt -lm
+	endif
+endif
+
 include $(BUILD_SHARED_LIBRARY)
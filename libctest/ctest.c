@@ -15,10 +15,13 @@
  */
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include <ctest/ctest.h>
 
@@ -151,11 +154,175 @@ void assertTrueWithSource(int value, const char* file, int line, char* message)
     if (!value) {
         TestSuite* suite = getTestSuite();
 
-        fprintf(suite->out, "Assertion failed: [%s:%d] %s: %s\n", file, line, 
+        fprintf(suite->out, "Assertion failed: [%s:%d] %s: %s\n", file, line,
                 suite->testNames[suite->currentTest], message);
         fflush(suite->out);
-        
+
         // Exit the process for this test case.
         exit(ASSERTION_ERROR);
     }
 }
+
+#define MAX_BENCHMARKS 255
+
+/** Number of timed samples taken per benchmark. */
+#define BENCHMARK_SAMPLES 5
+
+/** Aim for timed samples at least this long (ns). */
+#define BENCHMARK_TARGET_NS 100000000LL
+
+typedef void BenchmarkCase(int iterations);
+
+/** A suite of benchmarks. */
+typedef struct {
+    int size;
+    const char* benchmarkNames[MAX_BENCHMARKS];
+    BenchmarkCase* benchmarks[MAX_BENCHMARKS];
+} BenchmarkSuite;
+
+/** Gets the benchmark suite. Creates it if necessary. */
+static BenchmarkSuite* getBenchmarkSuite() {
+    static BenchmarkSuite* suite = NULL;
+
+    if (suite != NULL) {
+        return suite;
+    }
+
+    suite = calloc(1, sizeof(BenchmarkSuite));
+    assert(suite != NULL);
+
+    return suite;
+}
+
+void addNamedBenchmark(const char* name, BenchmarkCase* benchmark) {
+    BenchmarkSuite* suite = getBenchmarkSuite();
+    assert(suite->size <= MAX_BENCHMARKS);
+
+    int index = suite->size;
+    suite->benchmarkNames[index] = name;
+    suite->benchmarks[index] = benchmark;
+
+    suite->size++;
+}
+
+static long long nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** Times one run of 'iterations' iterations of a benchmark. */
+static long long timeBenchmark(BenchmarkCase* benchmark, int iterations) {
+    long long start = nowNanos();
+    benchmark(iterations);
+    return nowNanos() - start;
+}
+
+/**
+ * Looks up the baseline median for a benchmark in a file of BENCH
+ * lines. Returns a negative value if the benchmark isn't in the file.
+ */
+static double baselineMedian(const char* fileName, const char* name) {
+    FILE* in = fopen(fileName, "r");
+    char line[256];
+    char benchName[128];
+    int iterations;
+    double min, median, stddev;
+    double result = -1.0;
+
+    if (in == NULL) {
+        return -1.0;
+    }
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "BENCH %127s iters=%d min=%lf median=%lf stddev=%lf",
+                benchName, &iterations, &min, &median, &stddev) == 5
+                && strcmp(benchName, name) == 0) {
+            result = median;
+            break;
+        }
+    }
+
+    fclose(in);
+    return result;
+}
+
+int runBenchmarks() {
+    BenchmarkSuite* suite = getBenchmarkSuite();
+    const char* baselineFile = getenv("CTEST_BENCHMARK_BASELINE");
+    const char* thresholdString = getenv("CTEST_BENCHMARK_THRESHOLD");
+    double threshold = thresholdString != NULL ? atof(thresholdString) : 10.0;
+    int regressions = 0;
+    int i;
+
+    for (i = 0; i < suite->size; i++) {
+        BenchmarkCase* benchmark = suite->benchmarks[i];
+        const char* name = suite->benchmarkNames[i];
+        double samples[BENCHMARK_SAMPLES];
+        double min, median, mean, variance;
+        long long elapsed;
+        int iterations = 1;
+        int s, t;
+
+        // Warm up and calibrate: double the iteration count until one
+        // run takes long enough to time reliably.
+        elapsed = timeBenchmark(benchmark, iterations);
+        while (elapsed * 2 < BENCHMARK_TARGET_NS && iterations < (1 << 30)) {
+            iterations <<= 1;
+            elapsed = timeBenchmark(benchmark, iterations);
+        }
+
+        for (s = 0; s < BENCHMARK_SAMPLES; s++) {
+            elapsed = timeBenchmark(benchmark, iterations);
+            samples[s] = (double) elapsed / iterations;
+
+            // Keep the samples sorted.
+            for (t = s; t > 0 && samples[t] < samples[t - 1]; t--) {
+                double swap = samples[t];
+                samples[t] = samples[t - 1];
+                samples[t - 1] = swap;
+            }
+        }
+
+        min = samples[0];
+        median = samples[BENCHMARK_SAMPLES / 2];
+
+        mean = 0.0;
+        for (s = 0; s < BENCHMARK_SAMPLES; s++) {
+            mean += samples[s];
+        }
+        mean /= BENCHMARK_SAMPLES;
+
+        variance = 0.0;
+        for (s = 0; s < BENCHMARK_SAMPLES; s++) {
+            variance += (samples[s] - mean) * (samples[s] - mean);
+        }
+        variance /= BENCHMARK_SAMPLES;
+
+        printf("BENCH %s iters=%d min=%.1f median=%.1f stddev=%.1f\n",
+                name, iterations, min, median, sqrt(variance));
+        fflush(stdout);
+
+        if (baselineFile != NULL) {
+            double baseline = baselineMedian(baselineFile, name);
+            if (baseline > 0.0
+                    && median > baseline * (1.0 + threshold / 100.0)) {
+                fprintf(stderr,
+                        "REGRESSION: %s: median %.1f ns vs baseline %.1f ns "
+                        "(+%.1f%%, threshold %.1f%%)\n",
+                        name, median, baseline,
+                        (median / baseline - 1.0) * 100.0, threshold);
+                regressions++;
+            }
+        }
+    }
+
+    if (regressions > 0) {
+        fprintf(stderr, "BENCHMARK FAILURE! %d of %d benchmarks regressed.\n",
+                regressions, suite->size);
+    } else {
+        printf("SUCCESS! %d benchmarks ran.\n", suite->size);
+    }
+
+    return regressions;
+}
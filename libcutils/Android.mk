@@ -17,6 +17,7 @@ LOCAL_PATH := $(my-dir)
 include $(CLEAR_VARS)
 
 commonSources := \
+	arena.c \
 	array.c \
 	hashmap.c \
 	atomic.c \
@@ -30,12 +31,15 @@ commonSources := \
 	config_utils.c \
 	cpu_info.c \
 	load_file.c \
+	memcpy_rect.c \
+	rotate_rect.c \
 	strdup16to8.c \
 	strdup8to16.c \
 	record_stream.c \
 	process_name.c \
 	properties.c \
-	threads.c
+	threads.c \
+	timer.c
 
 # some files must not be compiled when building against Mingw
 # they correspond to features not used by our host development tools
@@ -56,7 +60,10 @@ ifeq ($(WITH_MINGW),1)
         uio.c
 else
     commonSources += \
+        map_file.c \
         mspace.c \
+        mspace_stats.c \
+        ringbuf.c \
         selector.c \
         fdevent.c \
         tztime.c \
@@ -69,7 +76,7 @@ endif
 # Static library for host
 # ========================================================
 LOCAL_MODULE := libcutils
-LOCAL_SRC_FILES := $(commonSources) ashmem-host.c
+LOCAL_SRC_FILES := $(commonSources) ashmem-host.c ashmem-pool.c
 LOCAL_LDLIBS := -lpthread
 LOCAL_STATIC_LIBRARIES := liblog
 include $(BUILD_HOST_STATIC_LIBRARY)
@@ -81,7 +88,7 @@ ifeq ($(TARGET_SIMULATOR),true)
 # ========================================================
 include $(CLEAR_VARS)
 LOCAL_MODULE := libcutils
-LOCAL_SRC_FILES := $(commonSources) memory.c dlmalloc_stubs.c ashmem-host.c
+LOCAL_SRC_FILES := $(commonSources) memory.c dlmalloc_stubs.c ashmem-host.c ashmem-pool.c
 LOCAL_LDLIBS := -lpthread
 LOCAL_SHARED_LIBRARIES := liblog
 include $(BUILD_SHARED_LIBRARY)
@@ -92,7 +99,7 @@ else #!sim
 # ========================================================
 include $(CLEAR_VARS)
 LOCAL_MODULE := libcutils
-LOCAL_SRC_FILES := $(commonSources) ashmem-dev.c mq.c
+LOCAL_SRC_FILES := $(commonSources) ashmem-dev.c ashmem-pool.c mq.c
 
 ifeq ($(TARGET_ARCH),arm)
 LOCAL_SRC_FILES += memset32.S atomic-android-arm.S
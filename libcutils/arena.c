@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/arena.h>
+#include <cutils/threads.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* every allocation is aligned to this */
+#define ARENA_ALIGN 8
+
+/* chunk payloads start on a cache line */
+#define ARENA_CHUNK_ALIGN 32
+
+#define ARENA_DEFAULT_CHUNK_SIZE 4096
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    char *data;             /* aligned payload start */
+    size_t capacity;        /* payload bytes */
+    size_t used;
+} ArenaChunk;
+
+struct Arena {
+    ArenaChunk *chunks;     /* all chunks, in allocation order */
+    ArenaChunk *current;    /* chunk being filled; NULL right after reset */
+    size_t chunk_size;
+};
+
+Arena *arena_new(size_t chunk_size)
+{
+    Arena *arena;
+
+    arena = calloc(1, sizeof(Arena));
+    if(arena == NULL)
+        return NULL;
+
+    arena->chunk_size =
+            chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+    return arena;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaChunk *chunk, *next;
+
+    if(arena == NULL)
+        return;
+
+    for(chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(arena);
+}
+
+void arena_reset(Arena *arena)
+{
+    /* retained chunks are rewound lazily as allocation reaches them */
+    arena->current = NULL;
+}
+
+/*
+ * Steps to a chunk with at least 'size' free bytes, reusing a retained
+ * chunk when possible and allocating a fresh one otherwise.
+ */
+static ArenaChunk *arena_grow(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk;
+    size_t capacity;
+    uintptr_t payload;
+
+    chunk = arena->current ? arena->current->next : arena->chunks;
+    if(chunk && size <= chunk->capacity) {
+        chunk->used = 0;
+        arena->current = chunk;
+        return chunk;
+    }
+
+    capacity = arena->chunk_size;
+    if(capacity < size)
+        capacity = size;
+
+    chunk = malloc(sizeof(ArenaChunk) + ARENA_CHUNK_ALIGN + capacity);
+    if(chunk == NULL)
+        return NULL;
+
+    payload = (uintptr_t)(chunk + 1);
+    payload = (payload + ARENA_CHUNK_ALIGN - 1) & ~(uintptr_t)(ARENA_CHUNK_ALIGN - 1);
+    chunk->data = (char*) payload;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+
+    /* keep allocation order so a reset arena reuses chunks in order */
+    if(arena->current) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    arena->current = chunk;
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk;
+    void *ptr;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    chunk = arena->current;
+    if(chunk == NULL || chunk->capacity - chunk->used < size) {
+        chunk = arena_grow(arena, size);
+        if(chunk == NULL)
+            return NULL;
+    }
+
+    ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+void *arena_zalloc(Arena *arena, size_t size)
+{
+    void *ptr = arena_alloc(arena, size);
+    if(ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+char *arena_strdup(Arena *arena, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = arena_alloc(arena, len);
+    if(copy)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+static thread_store_t gThreadArena = THREAD_STORE_INITIALIZER;
+
+static void thread_arena_destroy(void *arena)
+{
+    arena_free(arena);
+}
+
+Arena *arena_for_thread(void)
+{
+    Arena *arena = thread_store_get(&gThreadArena);
+    if(arena == NULL) {
+        arena = arena_new(0);
+        if(arena)
+            thread_store_set(&gThreadArena, arena, thread_arena_destroy);
+    }
+    return arena;
+}
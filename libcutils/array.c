@@ -153,3 +153,150 @@ int arraySize(Array* array) {
 const void** arrayUnwrap(Array* array) {
     return array->contents;
 }
+
+static void mergeSort(void** contents, void** temp, int size,
+        ArrayComparator* compare) {
+    int half = size / 2;
+    int left = 0;
+    int right = half;
+    int out = 0;
+
+    if (size < 2) {
+        return;
+    }
+
+    mergeSort(contents, temp, half, compare);
+    mergeSort(contents + half, temp, size - half, compare);
+
+    while (left < half && right < size) {
+        if (compare(contents[left], contents[right]) <= 0) {
+            temp[out++] = contents[left++];
+        } else {
+            temp[out++] = contents[right++];
+        }
+    }
+    while (left < half) {
+        temp[out++] = contents[left++];
+    }
+
+    // Elements remaining on the right are already in place.
+    memcpy(contents, temp, sizeof(void*) * out);
+}
+
+void arraySort(Array* array, ArrayComparator* compare) {
+    assert(array != NULL);
+
+    if (array->size > 1) {
+        void** temp = malloc(sizeof(void*) * array->size);
+        if (temp == NULL) {
+            // Out of memory; fall back to an in-place insertion sort.
+            int i;
+            for (i = 1; i < array->size; i++) {
+                void* pointer = array->contents[i];
+                int j = i;
+                while (j > 0 && compare(array->contents[j - 1], pointer) > 0) {
+                    array->contents[j] = array->contents[j - 1];
+                    j--;
+                }
+                array->contents[j] = pointer;
+            }
+            return;
+        }
+        mergeSort(array->contents, temp, array->size, compare);
+        free(temp);
+    }
+}
+
+/**
+ * Finds the index of the element, or the index where it would be
+ * inserted if it's not present (with *found telling which).
+ */
+static int sortedIndex(Array* array, const void* needle,
+        ArrayComparator* compare, int* found) {
+    int low = 0;
+    int high = array->size;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        int result = compare(needle, array->contents[mid]);
+        if (result == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (result < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    *found = 0;
+    return low;
+}
+
+int arraySortedFind(Array* array, const void* needle,
+        ArrayComparator* compare) {
+    int found;
+    int index;
+
+    assert(array != NULL);
+
+    index = sortedIndex(array, needle, compare, &found);
+    return found ? index : -1;
+}
+
+int arraySortedAdd(Array* array, void* pointer, ArrayComparator* compare) {
+    int found;
+    int index;
+    int result;
+
+    assert(array != NULL);
+
+    result = ensureCapacity(array, array->size + 1);
+    if (result < 0) {
+        return result;
+    }
+
+    index = sortedIndex(array, pointer, compare, &found);
+
+    // Shift entries right.
+    if (index != array->size) {
+        memmove(array->contents + index + 1, array->contents + index,
+                (sizeof(void*)) * (array->size - index));
+    }
+
+    array->contents[index] = pointer;
+    array->size++;
+    return 0;
+}
+
+void* arrayRemoveUnordered(Array* array, int index) {
+    checkBounds(array, index);
+
+    void* pointer = array->contents[index];
+
+    array->size--;
+    array->contents[index] = array->contents[array->size];
+
+    return pointer;
+}
+
+int arrayRemoveMatching(Array* array, ArrayPredicate* predicate,
+        void* context) {
+    int out = 0;
+    int removed;
+    int i;
+
+    assert(array != NULL);
+
+    for (i = 0; i < array->size; i++) {
+        void* pointer = array->contents[i];
+        if (!predicate(pointer, context)) {
+            array->contents[out++] = pointer;
+        }
+    }
+
+    removed = array->size - out;
+    array->size = out;
+    return removed;
+}
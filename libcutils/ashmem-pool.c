@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A pool of recycled ashmem regions, layered over ashmem_create_region().
+ * Regions are bucketed by power-of-two size class. While a region sits in
+ * the pool it is unpinned, so the kernel is free to reclaim its pages under
+ * memory pressure; it is pinned again when handed back out. That makes
+ * caching regions here nearly free, while still avoiding the open/ioctl
+ * and mmap churn of creating a fresh region per use.
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <cutils/ashmem.h>
+
+#define POOL_MIN_SIZE		4096		/* smallest size class */
+#define POOL_BUCKETS		9		/* 4k, 8k, ... 1M */
+#define POOL_BUCKET_DEPTH	8		/* cached regions per class */
+
+static int pool[POOL_BUCKETS][POOL_BUCKET_DEPTH];
+static int pool_count[POOL_BUCKETS];
+static struct ashmem_pool_stats pool_stats;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* returns the bucket for `size', or <0 if it is too big to pool */
+static int size_class(size_t size)
+{
+	size_t class_size = POOL_MIN_SIZE;
+	int i;
+
+	for (i = 0; i < POOL_BUCKETS; i++) {
+		if (size <= class_size)
+			return i;
+		class_size <<= 1;
+	}
+	return -1;
+}
+
+static size_t class_bytes(int class)
+{
+	return (size_t)POOL_MIN_SIZE << class;
+}
+
+int ashmem_pool_acquire(const char *name, size_t size)
+{
+	int class = size_class(size);
+	int fd = -1;
+
+	pthread_mutex_lock(&pool_lock);
+
+	while (class >= 0 && pool_count[class] > 0) {
+		int ret;
+
+		fd = pool[class][--pool_count[class]];
+		pool_stats.cached--;
+
+		ret = ashmem_pin_region(fd, 0, 0);
+		if (ret < 0) {
+			/* something is wrong with this one; toss it */
+			close(fd);
+			fd = -1;
+			continue;
+		}
+		if (ret == ASHMEM_WAS_PURGED)
+			pool_stats.purged++;
+		break;
+	}
+
+	if (fd >= 0)
+		pool_stats.hits++;
+	else
+		pool_stats.misses++;
+
+	pthread_mutex_unlock(&pool_lock);
+
+	if (fd >= 0)
+		return fd;
+
+	/* create at the full class size so the region is recyclable */
+	if (class >= 0)
+		size = class_bytes(class);
+
+	return ashmem_create_region(name, size);
+}
+
+void ashmem_pool_release(int fd, size_t size)
+{
+	int class = size_class(size);
+
+	if (fd < 0)
+		return;
+
+	if (class >= 0 && ashmem_unpin_region(fd, 0, 0) >= 0) {
+		pthread_mutex_lock(&pool_lock);
+		if (pool_count[class] < POOL_BUCKET_DEPTH) {
+			pool[class][pool_count[class]++] = fd;
+			pool_stats.cached++;
+			fd = -1;
+		}
+		pthread_mutex_unlock(&pool_lock);
+	}
+
+	if (fd >= 0)
+		close(fd);
+}
+
+void ashmem_pool_trim(void)
+{
+	int class, i;
+
+	pthread_mutex_lock(&pool_lock);
+	for (class = 0; class < POOL_BUCKETS; class++) {
+		for (i = 0; i < pool_count[class]; i++)
+			close(pool[class][i]);
+		pool_stats.cached -= pool_count[class];
+		pool_count[class] = 0;
+	}
+	pthread_mutex_unlock(&pool_lock);
+}
+
+void ashmem_pool_get_stats(struct ashmem_pool_stats *stats)
+{
+	pthread_mutex_lock(&pool_lock);
+	*stats = pool_stats;
+	pthread_mutex_unlock(&pool_lock);
+}
@@ -99,7 +99,11 @@ int64_t android_quasiatomic_swap_64(int64_t value, volatile int64_t* addr) {
 
 int64_t android_quasiatomic_read_64(volatile int64_t* addr) {
     return OSAtomicAdd64Barrier(0, addr);
-}    
+}
+
+int64_t android_quasiatomic_add_64(int64_t value, volatile int64_t* addr) {
+    return OSAtomicAdd64Barrier(value, addr) - value;
+}
 
 #endif
 
@@ -243,7 +247,20 @@ int64_t android_quasiatomic_read_64(volatile int64_t* addr) {
     result = *addr;
     pthread_mutex_unlock(lock);
     return result;
-}    
+}
+
+int64_t android_quasiatomic_add_64(int64_t value, volatile int64_t* addr) {
+    int64_t oldValue;
+    pthread_mutex_t*  lock = SWAP_LOCK(addr);
+
+    pthread_mutex_lock(lock);
+
+    oldValue = *addr;
+    *addr    = oldValue + value;
+
+    pthread_mutex_unlock(lock);
+    return oldValue;
+}
 
 #else
 
@@ -332,4 +349,29 @@ int64_t android_quasiatomic_swap_64(int64_t value, volatile int64_t* addr) {
     return result;
 }
 
+int64_t android_quasiatomic_add_64(int64_t value, volatile int64_t* addr) {
+    int64_t result;
+
+    while (android_atomic_cmpxchg(0, 1, &quasiatomic_spinlock)) {
+#ifdef HAVE_WIN32_THREADS
+        Sleep(0);
+#else
+        sched_yield();
+#endif
+    }
+
+    result = *addr;
+    *addr = result + value;
+    android_atomic_swap(0, &quasiatomic_spinlock);
+
+    return result;
+}
+
 #endif
+
+/* a store is just a swap whose previous value nobody wants; every
+ * backend already pays for the swap's atomicity, so this needs no
+ * per-backend code */
+void android_quasiatomic_write_64(int64_t value, volatile int64_t* addr) {
+    (void) android_quasiatomic_swap_64(value, addr);
+}
@@ -19,7 +19,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "buffer.h"
 #include "loghack.h"
@@ -106,7 +108,7 @@ ssize_t bufferWrite(Buffer* buffer, int fd) {
 
         LOGD("Buffer bytes written: %d", (int) bytesWritten);
         LOGD("Buffer size: %d", (int) buffer->size);
-        LOGD("Buffer remaining: %d", (int) buffer->remaining);        
+        LOGD("Buffer remaining: %d", (int) buffer->remaining);
 
         return buffer->remaining;
     }
@@ -114,3 +116,205 @@ ssize_t bufferWrite(Buffer* buffer, int fd) {
     return bytesWritten;
 }
 
+/** Chunks double in size up to this; beyond it, waste outweighs the
+ * savings in chunk count. */
+#define MAX_CHUNK_CAPACITY (256 * 1024)
+
+typedef struct BufferChunk {
+    struct BufferChunk* next;
+    size_t capacity;
+    size_t size;
+    char data[0];
+} BufferChunk;
+
+struct ChunkedBuffer {
+    BufferChunk* first;
+    BufferChunk* last;
+    size_t size;
+    int chunkCount;
+};
+
+static BufferChunk* chunkCreate(size_t capacity) {
+    BufferChunk* chunk = malloc(sizeof(BufferChunk) + capacity);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->capacity = capacity;
+    chunk->size = 0;
+    return chunk;
+}
+
+ChunkedBuffer* chunkedBufferCreate(size_t initialCapacity) {
+    ChunkedBuffer* buffer;
+
+    if (initialCapacity == 0) {
+        initialCapacity = 1;
+    }
+
+    buffer = malloc(sizeof(ChunkedBuffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->first = chunkCreate(initialCapacity);
+    if (buffer->first == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->last = buffer->first;
+    buffer->size = 0;
+    buffer->chunkCount = 1;
+    return buffer;
+}
+
+void chunkedBufferFree(ChunkedBuffer* buffer) {
+    BufferChunk* chunk = buffer->first;
+    while (chunk != NULL) {
+        BufferChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(buffer);
+}
+
+size_t chunkedBufferSize(const ChunkedBuffer* buffer) {
+    return buffer->size;
+}
+
+int chunkedBufferChunkCount(const ChunkedBuffer* buffer) {
+    return buffer->chunkCount;
+}
+
+int chunkedBufferAppend(ChunkedBuffer* buffer, const void* data, size_t len) {
+    const char* in = data;
+
+    while (len > 0) {
+        BufferChunk* last = buffer->last;
+        size_t room = last->capacity - last->size;
+        size_t count;
+
+        if (room == 0) {
+            // Grow by adding a chunk; the data already buffered stays put.
+            size_t capacity = last->capacity * 2;
+            BufferChunk* chunk;
+
+            if (capacity > MAX_CHUNK_CAPACITY) {
+                capacity = MAX_CHUNK_CAPACITY;
+            }
+            chunk = chunkCreate(capacity);
+            if (chunk == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            last->next = chunk;
+            buffer->last = chunk;
+            buffer->chunkCount++;
+            continue;
+        }
+
+        count = (len < room) ? len : room;
+        memcpy(last->data + last->size, in, count);
+        last->size += count;
+        buffer->size += count;
+        in += count;
+        len -= count;
+    }
+
+    return 0;
+}
+
+int chunkedBufferIov(const ChunkedBuffer* buffer, struct iovec* iov,
+        int maxIov) {
+    BufferChunk* chunk;
+    int count = 0;
+
+    for (chunk = buffer->first; chunk != NULL && count < maxIov;
+            chunk = chunk->next) {
+        if (chunk->size == 0) {
+            continue;
+        }
+        iov[count].iov_base = chunk->data;
+        iov[count].iov_len = chunk->size;
+        count++;
+    }
+    return count;
+}
+
+ssize_t chunkedBufferWrite(ChunkedBuffer* buffer, int fd) {
+    BufferChunk* chunk = buffer->first;
+    size_t offset = 0;
+    ssize_t total = 0;
+
+    while (chunk != NULL) {
+        struct iovec iov[16];
+        BufferChunk* c = chunk;
+        size_t skip = offset;
+        int count = 0;
+        ssize_t bytesWritten;
+
+        // Describe as much as fits in the iovec array, starting at the
+        // first unwritten byte.
+        while (c != NULL && count < 16) {
+            if (c->size > skip) {
+                iov[count].iov_base = c->data + skip;
+                iov[count].iov_len = c->size - skip;
+                count++;
+            }
+            skip = 0;
+            c = c->next;
+        }
+        if (count == 0) {
+            break;
+        }
+
+        bytesWritten = writev(fd, iov, count);
+        if (bytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += bytesWritten;
+
+        // Advance past whole chunks the write covered.
+        while (chunk != NULL
+                && (size_t) bytesWritten >= chunk->size - offset) {
+            bytesWritten -= chunk->size - offset;
+            offset = 0;
+            chunk = chunk->next;
+        }
+        offset += bytesWritten;
+    }
+
+    return total;
+}
+
+char* chunkedBufferContiguous(ChunkedBuffer* buffer) {
+    BufferChunk* merged;
+    BufferChunk* chunk;
+
+    if (buffer->chunkCount == 1) {
+        return buffer->first->data;
+    }
+
+    merged = chunkCreate(buffer->size);
+    if (merged == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    chunk = buffer->first;
+    while (chunk != NULL) {
+        BufferChunk* next = chunk->next;
+        memcpy(merged->data + merged->size, chunk->data, chunk->size);
+        merged->size += chunk->size;
+        free(chunk);
+        chunk = next;
+    }
+
+    buffer->first = merged;
+    buffer->last = merged;
+    buffer->chunkCount = 1;
+    return merged->data;
+}
+
@@ -99,12 +99,74 @@ void bufferPrepareForWrite(Buffer* buffer);
 /**
  * Writes data from buffer to the given fd. Returns -1 and sets errno in case
  * of an error. Updates buffer->remaining and returns the number of remaining
- * bytes to be written after a successful write. 
+ * bytes to be written after a successful write.
  *
  * Precondition: buffer->remaining > 0
  */
 ssize_t bufferWrite(Buffer* buffer, int fd);
 
+struct iovec;
+
+/**
+ * Growable buffer kept as a list of chunks. Appending never copies data
+ * that is already in the buffer; a new chunk is added instead, twice the
+ * size of the last one (up to a cap), so accumulating a large payload
+ * costs O(n) instead of the O(n^2) of repeated realloc-and-copy. The
+ * chunks can be written out directly with writev(), and a contiguous
+ * view is only built if someone asks for one.
+ */
+typedef struct ChunkedBuffer ChunkedBuffer;
+
+/**
+ * Creates a chunked buffer whose first chunk has the given capacity.
+ * Returns NULL if memory can't be allocated.
+ */
+ChunkedBuffer* chunkedBufferCreate(size_t initialCapacity);
+
+/**
+ * Frees the buffer and all of its chunks.
+ */
+void chunkedBufferFree(ChunkedBuffer* buffer);
+
+/**
+ * Total # of bytes currently in the buffer.
+ */
+size_t chunkedBufferSize(const ChunkedBuffer* buffer);
+
+/**
+ * # of chunks the data is spread over (the # of iovecs needed to
+ * describe it).
+ */
+int chunkedBufferChunkCount(const ChunkedBuffer* buffer);
+
+/**
+ * Appends len bytes to the buffer. Existing chunks are never moved.
+ * Returns 0 if successful or -1 if memory can't be allocated.
+ */
+int chunkedBufferAppend(ChunkedBuffer* buffer, const void* data, size_t len);
+
+/**
+ * Fills in up to maxIov iovecs describing the buffered data, suitable
+ * for writev(). Returns the # of iovecs used.
+ */
+int chunkedBufferIov(const ChunkedBuffer* buffer, struct iovec* iov,
+        int maxIov);
+
+/**
+ * Writes the whole buffer to the given fd with writev(), retrying short
+ * writes. Returns the # of bytes written, or -1 and sets errno. The
+ * buffer contents are left intact.
+ */
+ssize_t chunkedBufferWrite(ChunkedBuffer* buffer, int fd);
+
+/**
+ * Returns a pointer to the buffered data as one contiguous block,
+ * collapsing the chunks if there is more than one (the only time this
+ * type copies). Returns NULL if memory can't be allocated. The pointer
+ * is valid until the next append.
+ */
+char* chunkedBufferContiguous(ChunkedBuffer* buffer);
+
 #ifdef __cplusplus
 }
 #endif
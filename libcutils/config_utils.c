@@ -19,18 +19,45 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <cutils/config_utils.h>
+#include <cutils/arena.h>
 #include <cutils/misc.h>
 
+/* config trees are built once and kept for the life of the process,
+** so the nodes come from a shared arena instead of one calloc each */
+static Arena *gConfigArena;
+
+/* lists shorter than this are cheaper to scan than to index */
+#define CONFIG_INDEX_THRESHOLD 8
+
+static unsigned config_hash(const char *s)
+{
+    unsigned hash = 0;
+
+    while(*s)
+        hash = hash * 33 + *s++;
+
+    return hash;
+}
+
 cnode* config_node(const char *name, const char *value)
 {
     cnode *node;
 
-    node = calloc(sizeof(cnode), 1);
+    if(gConfigArena == NULL) {
+        gConfigArena = arena_new(0);
+        if(gConfigArena == NULL)
+            return NULL;
+    }
+
+    node = arena_zalloc(gConfigArena, sizeof(cnode));
     if(node) {
         node->name = name ? name : "";
         node->value = value ? value : "";
+        node->hash = config_hash(node->name);
     }
 
     return node;
@@ -40,6 +67,19 @@ cnode* config_find(cnode *root, const char *name)
 {
     cnode *node, *match = NULL;
 
+    if(root->buckets) {
+        unsigned hash = config_hash(name);
+
+        /* bucket chains are newest-first, so the first match is the
+        ** last (newest) entry */
+        for(node = root->buckets[hash & (root->nbuckets - 1)];
+            node; node = node->hnext)
+            if(node->hash == hash && !strcmp(node->name, name))
+                return node;
+
+        return NULL;
+    }
+
     /* we walk the whole list, as we need to return the last (newest) entry */
     for(node = root->first_child; node; node = node->next)
         if(!strcmp(node->name, name))
@@ -48,12 +88,38 @@ cnode* config_find(cnode *root, const char *name)
     return match;
 }
 
-static cnode* _config_create(cnode *root, const char *name)
+static void index_insert(cnode *root, cnode *node)
+{
+    cnode **bucket = root->buckets + (node->hash & (root->nbuckets - 1));
+
+    node->hnext = *bucket;
+    *bucket = node;
+}
+
+/* (re)builds the child index from the list; children are prepended to
+** their chains in list order so the newest duplicate ends up first */
+static void config_build_index(cnode *root)
 {
     cnode *node;
+    unsigned n = 16;
 
-    node = config_node(name, NULL);
+    while(n < root->nchildren)
+        n *= 2;
 
+    root->buckets = arena_zalloc(gConfigArena, n * sizeof(cnode*));
+    if(root->buckets == NULL) {
+        /* no index; config_find falls back to walking the list */
+        root->nbuckets = 0;
+        return;
+    }
+    root->nbuckets = n;
+
+    for(node = root->first_child; node; node = node->next)
+        index_insert(root, node);
+}
+
+static void _config_attach(cnode *root, cnode *node)
+{
     if(root->last_child)
         root->last_child->next = node;
     else
@@ -61,6 +127,24 @@ static cnode* _config_create(cnode *root, const char *name)
 
     root->last_child = node;
 
+    root->nchildren++;
+    if(root->buckets) {
+        if(root->nchildren > 2 * root->nbuckets)
+            config_build_index(root);
+        else
+            index_insert(root, node);
+    } else if(root->nchildren > CONFIG_INDEX_THRESHOLD) {
+        config_build_index(root);
+    }
+}
+
+static cnode* _config_create(cnode *root, const char *name)
+{
+    cnode *node;
+
+    node = config_node(name, NULL);
+    _config_attach(root, node);
+
     return node;
 }
 
@@ -315,3 +399,261 @@ void config_load_file(cnode *root, const char *fn)
     data = load_file(fn, 0);
     config_load(root, data);
 }
+
+/* Frozen config images: the tree flattened into fixed-size records plus
+** an interned string pool, so processes sharing a config can mmap the
+** image and rebuild the tree in one pass instead of re-lexing the text.
+** Node references are stored as record index + 1 (0 means none), and a
+** node's children and later siblings always have higher indices than
+** the node itself, which makes cycles impossible to encode.
+*/
+
+#define FROZEN_MAGIC 0x31676663   /* "cfg1" */
+
+typedef struct {
+    unsigned magic;
+    unsigned node_count;
+    unsigned string_bytes;
+    unsigned first_child;
+} frozen_header;
+
+typedef struct {
+    unsigned name;          /* offset into the string pool */
+    unsigned value;
+    unsigned next;
+    unsigned first_child;
+} frozen_node;
+
+typedef struct istring istring;
+struct istring {
+    istring *next;
+    unsigned offset;
+};
+
+#define INTERN_BUCKETS 64
+
+typedef struct {
+    frozen_node *nodes;
+    unsigned used;
+    char *strings;
+    unsigned str_used;
+    unsigned str_cap;
+    istring *itab[INTERN_BUCKETS];
+} fstate;
+
+/* returns the pool offset of s, adding it only if it is new */
+static unsigned intern_string(fstate *fs, const char *s)
+{
+    unsigned hash = config_hash(s);
+    istring *is;
+    unsigned len;
+
+    for(is = fs->itab[hash & (INTERN_BUCKETS - 1)]; is; is = is->next)
+        if(!strcmp(fs->strings + is->offset, s))
+            return is->offset;
+
+    len = strlen(s) + 1;
+    if(fs->str_used + len > fs->str_cap) {
+        unsigned cap = fs->str_cap * 2 + len;
+        char *strings = realloc(fs->strings, cap);
+        if(strings == NULL)
+            return 0;
+        fs->strings = strings;
+        fs->str_cap = cap;
+    }
+    memcpy(fs->strings + fs->str_used, s, len);
+
+    is = malloc(sizeof(istring));
+    if(is) {
+        is->offset = fs->str_used;
+        is->next = fs->itab[hash & (INTERN_BUCKETS - 1)];
+        fs->itab[hash & (INTERN_BUCKETS - 1)] = is;
+    }
+
+    fs->str_used += len;
+    return fs->str_used - len;
+}
+
+static unsigned count_nodes(cnode *first)
+{
+    cnode *node;
+    unsigned n = 0;
+
+    for(node = first; node; node = node->next)
+        n += 1 + count_nodes(node->first_child);
+
+    return n;
+}
+
+/* returns the index + 1 of the first record of the chain */
+static unsigned freeze_chain(fstate *fs, cnode *first)
+{
+    cnode *node;
+    unsigned head = 0;
+    unsigned prev = 0;
+
+    for(node = first; node; node = node->next) {
+        unsigned index = fs->used++;
+
+        fs->nodes[index].name = intern_string(fs, node->name);
+        fs->nodes[index].value = intern_string(fs, node->value);
+        fs->nodes[index].next = 0;
+        fs->nodes[index].first_child = freeze_chain(fs, node->first_child);
+
+        if(prev)
+            fs->nodes[prev - 1].next = index + 1;
+        else
+            head = index + 1;
+        prev = index + 1;
+    }
+
+    return head;
+}
+
+int config_freeze(cnode *root, const char *fn)
+{
+    fstate fs;
+    frozen_header header;
+    istring *is, *next;
+    int fd, result = -1;
+    unsigned n;
+
+    memset(&fs, 0, sizeof(fs));
+
+    n = count_nodes(root->first_child);
+    fs.nodes = malloc(n * sizeof(frozen_node));
+    if(fs.nodes == NULL && n != 0)
+        return -1;
+
+    /* the empty string is at offset zero, which lets records use 0 for
+    ** "no value" */
+    intern_string(&fs, "");
+
+    header.magic = FROZEN_MAGIC;
+    header.first_child = freeze_chain(&fs, root->first_child);
+    header.node_count = fs.used;
+    header.string_bytes = fs.str_used;
+
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0) {
+        if(write(fd, &header, sizeof(header)) == sizeof(header) &&
+           write(fd, fs.nodes, n * sizeof(frozen_node)) ==
+                   (ssize_t) (n * sizeof(frozen_node)) &&
+           write(fd, fs.strings, fs.str_used) == (ssize_t) fs.str_used)
+            result = 0;
+        close(fd);
+        if(result != 0)
+            unlink(fn);
+    }
+
+    for(n = 0; n < INTERN_BUCKETS; n++) {
+        for(is = fs.itab[n]; is; is = next) {
+            next = is->next;
+            free(is);
+        }
+    }
+    free(fs.strings);
+    free(fs.nodes);
+    return result;
+}
+
+int config_load_frozen(cnode *root, const char *fn)
+{
+    const frozen_header *header;
+    const frozen_node *records;
+    const char *strings;
+    cnode **nodes = NULL;
+    void *map;
+    struct stat st;
+    size_t expected;
+    unsigned i, index;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if(fd < 0)
+        return -1;
+    if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(frozen_header)) {
+        close(fd);
+        return -1;
+    }
+
+    /* the tree's strings point straight into the mapping, which stays
+    ** for the life of the process and is shared page cache between
+    ** every process loading the same image */
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return -1;
+
+    header = map;
+    expected = sizeof(frozen_header) +
+            header->node_count * sizeof(frozen_node) + header->string_bytes;
+    if(header->magic != FROZEN_MAGIC ||
+       header->node_count > (size_t) st.st_size / sizeof(frozen_node) ||
+       expected != (size_t) st.st_size ||
+       header->first_child > header->node_count)
+        goto fail;
+    if(header->node_count > 0 &&
+       (header->string_bytes == 0 ||
+        ((const char *) map)[st.st_size - 1] != 0))
+        goto fail;
+
+    records = (const frozen_node *) (header + 1);
+    strings = (const char *) (records + header->node_count);
+
+    nodes = malloc(header->node_count * sizeof(cnode*));
+    if(nodes == NULL && header->node_count != 0)
+        goto fail;
+
+    for(i = 0; i < header->node_count; i++) {
+        if(records[i].name >= header->string_bytes ||
+           records[i].value >= header->string_bytes)
+            goto fail;
+        /* forward references only; see the format comment above */
+        if(records[i].next && records[i].next - 1 <= i)
+            goto fail;
+        if(records[i].first_child && records[i].first_child - 1 <= i)
+            goto fail;
+        if(records[i].next > header->node_count ||
+           records[i].first_child > header->node_count)
+            goto fail;
+
+        nodes[i] = config_node(strings + records[i].name,
+                               strings + records[i].value);
+        if(nodes[i] == NULL)
+            goto fail;
+    }
+
+    for(i = 0; i < header->node_count; i++) {
+        cnode *node = nodes[i];
+
+        if(records[i].next)
+            node->next = nodes[records[i].next - 1];
+
+        for(index = records[i].first_child; index;
+            index = records[index - 1].next) {
+            node->last_child = nodes[index - 1];
+            node->nchildren++;
+        }
+        if(records[i].first_child)
+            node->first_child = nodes[records[i].first_child - 1];
+    }
+
+    /* the indexes walk sibling lists, so they can only be built once
+    ** every node is linked */
+    for(i = 0; i < header->node_count; i++)
+        if(nodes[i]->nchildren > CONFIG_INDEX_THRESHOLD)
+            config_build_index(nodes[i]);
+
+    for(index = header->first_child; index;
+        index = records[index - 1].next)
+        _config_attach(root, nodes[index - 1]);
+
+    free(nodes);
+    return 0;
+
+fail:
+    free(nodes);
+    munmap(map, st.st_size);
+    return -1;
+}
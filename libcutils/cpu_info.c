@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 
 // we cache the serial number here.
 // this is also used as a fgets() line buffer when we are reading /proc/cpuinfo
@@ -81,3 +83,108 @@ extern const char* get_cpu_serial_number(void)
 
     return (serial_number[0] ? serial_number : NULL);
 }
+
+static cpu_info_t cpu_info;
+static int cpu_info_probed = 0;
+static pthread_mutex_t cpu_info_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// returns true if 'word' appears in 'line' as a whitespace-delimited token
+static int has_word(const char* line, const char* word)
+{
+    int length = strlen(word);
+    const char* chp = line;
+
+    while ((chp = strstr(chp, word)) != NULL)
+    {
+        if ((chp == line || isspace(chp[-1])) &&
+            (chp[length] == 0 || isspace(chp[length])))
+            return 1;
+        chp += length;
+    }
+    return 0;
+}
+
+static int value_after_colon(const char* line)
+{
+    const char* chp = strchr(line, ':');
+    return chp ? atoi(chp + 1) : 0;
+}
+
+static void probe_cpu_info(void)
+{
+    FILE* file;
+    char line[256];
+    int i;
+
+    // ARM cores don't report their cache line in /proc/cpuinfo;
+    // 32 bytes is correct for everything up through ARM11
+    cpu_info.cache_line_size = 32;
+
+    file = fopen("/proc/cpuinfo", "r");
+    if (file)
+    {
+        while (fgets(line, sizeof(line), file) != NULL)
+        {
+            if (strncmp(line, "processor", 9) == 0)
+            {
+                cpu_info.core_count++;
+            }
+            else if (strncmp(line, "CPU architecture", 16) == 0)
+            {
+                cpu_info.arch_version = value_after_colon(line);
+            }
+            else if (strncmp(line, "cache_alignment", 15) == 0)
+            {
+                cpu_info.cache_line_size = value_after_colon(line);
+            }
+            else if (strncmp(line, "Features", 8) == 0 ||
+                     strncmp(line, "flags", 5) == 0)
+            {
+                const char* chp = strchr(line, ':');
+                if (!chp)
+                    continue;
+                chp++;
+
+                if (has_word(chp, "thumb"))
+                    cpu_info.features |= CPU_FEATURE_THUMB;
+                if (has_word(chp, "vfp") || has_word(chp, "vfpv3"))
+                    cpu_info.features |= CPU_FEATURE_VFP;
+                if (has_word(chp, "edsp"))
+                    cpu_info.features |= CPU_FEATURE_EDSP;
+                if (has_word(chp, "neon"))
+                    cpu_info.features |= CPU_FEATURE_NEON;
+            }
+        }
+        fclose(file);
+    }
+
+    if (cpu_info.core_count == 0)
+        cpu_info.core_count = 1;
+
+    for (i = 0; i < cpu_info.core_count && i < CPU_MAX_CORES; i++)
+    {
+        char path[80];
+        snprintf(path, sizeof(path),
+                "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+        file = fopen(path, "r");
+        if (file)
+        {
+            if (fgets(line, sizeof(line), file) != NULL)
+                cpu_info.max_freq_khz[i] = atoi(line);
+            fclose(file);
+        }
+    }
+}
+
+extern const cpu_info_t* get_cpu_info(void)
+{
+    pthread_mutex_lock(&cpu_info_lock);
+    if (! cpu_info_probed)
+    {
+        probe_cpu_info();
+        cpu_info_probed = 1;
+    }
+    pthread_mutex_unlock(&cpu_info_lock);
+
+    return &cpu_info;
+}
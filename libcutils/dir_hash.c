@@ -29,6 +29,10 @@
 #include <resolv.h>
 
 #include <cutils/dir_hash.h>
+#include <cutils/hashmap.h>
+
+/** Streaming buffer used when hashing file contents. */
+#define HASH_READ_SIZE (64 * 1024)
 
 /**
  * Copies, if it fits within max_output_string bytes, into output_string
@@ -66,26 +70,34 @@ int get_file_hash(HashAlgorithm algorithm, const char *path,
         SHA1Update(&context, (unsigned char *) buf, len);
         SHA1Final(md, &context);
     } else if (S_ISREG(sb.st_mode)) {
-        char buf[10000];
-        FILE *f = fopen(path, "rb");
+        char *buf = malloc(HASH_READ_SIZE);
+        FILE *f;
         int len;
 
+        if (buf == NULL) {
+            return -1;
+        }
+
+        f = fopen(path, "rb");
         if (f == NULL) {
+            free(buf);
             return -1;
         }
 
         SHA1Init(&context);
 
-        while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+        while ((len = fread(buf, 1, HASH_READ_SIZE, f)) > 0) {
             SHA1Update(&context, (unsigned char *) buf, len);
         }
 
         if (ferror(f)) {
             fclose(f);
+            free(buf);
             return -1;
         }
 
         fclose(f);
+        free(buf);
         SHA1Final(md, &context);
     }
 
@@ -126,145 +138,240 @@ static int cmp(const void *a, const void *b) {
     return strcmp((*ra)->name, (*rb)->name);
 }
 
-static int recurse(HashAlgorithm algorithm, const char *directory_path,
-                    struct list **out) {
-    struct list *list = NULL;
-    struct list *f;
+/** What the cache remembers about a file from the previous run. */
+struct cache_entry {
+    long long size;
+    long long mtime;
+    char *outstr;       /* the hash line computed last time */
+};
 
-    struct dirent *de;
-    DIR *d = opendir(directory_path);
+static int str_hash(void *key) {
+    char *s = key;
+    int hash = 0;
 
-    if (d == NULL) {
-        return -1;
+    while (*s != 0) {
+        hash = hash * 31 + *s++;
+    }
+    return hash;
+}
+
+static bool str_equals(void *keyA, void *keyB) {
+    return strcmp(keyA, keyB) == 0;
+}
+
+static bool free_cache_entry(void *key, void *value, void *context) {
+    struct cache_entry *entry = value;
+
+    free(key);
+    free(entry->outstr);
+    free(entry);
+    return true;
+}
+
+static void free_cache(Hashmap *cache) {
+    if (cache != NULL) {
+        hashmapForEach(cache, free_cache_entry, NULL);
+        hashmapFree(cache);
+    }
+}
+
+/**
+ * Reads a cache file of "<mtime> <size> <path>\t<hashline>" lines into a
+ * map keyed by path.  A missing or malformed file yields an empty map,
+ * which just means every file gets hashed this run.
+ */
+static Hashmap *load_cache(const char *cache_path) {
+    Hashmap *cache = hashmapCreate(256, str_hash, str_equals);
+    char line[PATH_MAX + NAME_MAX + 200];
+    FILE *f;
+
+    if (cache == NULL) {
+        return NULL;
     }
 
-    while ((de = readdir(d)) != NULL) {
-        if (strcmp(de->d_name, ".") == 0) {
+    f = fopen(cache_path, "r");
+    if (f == NULL) {
+        return cache;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        struct cache_entry *entry;
+        long long mtime, size;
+        char *path, *tab, *newline, *key;
+        int consumed;
+
+        if (sscanf(line, "%lld %lld %n", &mtime, &size, &consumed) != 2) {
             continue;
         }
-        if (strcmp(de->d_name, "..") == 0) {
+
+        path = line + consumed;
+        tab = strchr(path, '\t');
+        if (tab == NULL) {
             continue;
         }
+        *tab = 0;
 
-        char *name = malloc(strlen(de->d_name) + 1);
-        struct list *node = malloc(sizeof(struct list));
+        newline = strchr(tab + 1, '\n');
+        if (newline != NULL) {
+            *newline = 0;
+        }
 
-        if (name == NULL || node == NULL) {
-            struct list *next;
-            for (f = list; f != NULL; f = next) {
-                next = f->next;
-                free(f->name);
-                free(f);
-            }
+        key = strdup(path);
+        entry = malloc(sizeof(struct cache_entry));
+        if (key == NULL || entry == NULL) {
+            free(key);
+            free(entry);
+            break;
+        }
 
-            free(name);
-            free(node);
-            return -1;
+        entry->mtime = mtime;
+        entry->size = size;
+        entry->outstr = strdup(tab + 1);
+        if (entry->outstr == NULL) {
+            free(key);
+            free(entry);
+            break;
         }
 
-        strcpy(name, de->d_name);
+        hashmapPut(cache, key, entry);
+    }
+
+    fclose(f);
+    return cache;
+}
 
-        node->name = name;
-        node->next = list;
-        list = node;
+/** Carries the walk state so recurse() doesn't need a parameter per mode. */
+struct hash_context {
+    HashAlgorithm algorithm;
+    struct list *out;
+    Hashmap *cache;     /* previous run, or NULL for a full hash */
+    FILE *cache_out;    /* refreshed cache being written, or NULL */
+};
+
+static int filter_dots(const struct dirent *de) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+        return 0;
+    }
+    return 1;
+}
+
+static void free_list(struct list *list) {
+    struct list *next;
+
+    while (list != NULL) {
+        next = list->next;
+        free(list->name);
+        free(list);
+        list = next;
     }
+}
+
+static int recurse(struct hash_context *context, const char *directory_path) {
+    struct dirent **namelist;
+    int count;
+    int i;
+    int result = 0;
 
-    closedir(d);
+    /* scandir gives us the entries of a directory in a single sorted
+     * pass, in place of the hand-rolled list this code used to build */
+    count = scandir(directory_path, &namelist, filter_dots, alphasort);
+    if (count < 0) {
+        return -1;
+    }
 
-    for (f = list; f != NULL; f = f->next) {
+    for (i = 0; i < count; i++) {
         struct stat sb;
-        char *name;
         char outstr[NAME_MAX + 100];
+        const char *hashline = outstr;
+        char *name;
         char *keep;
         struct list *res;
+        int cached = 0;
 
-        name = malloc(strlen(f->name) + strlen(directory_path) + 2);
+        if (result < 0) {
+            break;
+        }
+
+        name = malloc(strlen(namelist[i]->d_name)
+                + strlen(directory_path) + 2);
         if (name == NULL) {
-            struct list *next;
-            for (f = list; f != NULL; f = f->next) {
-                next = f->next;
-                free(f->name);
-                free(f);
-            }
-            for (f = *out; f != NULL; f = f->next) {
-                next = f->next;
-                free(f->name);
-                free(f);
-            }
-            *out = NULL;
-            return -1;
+            result = -1;
+            break;
         }
 
-        sprintf(name, "%s/%s", directory_path, f->name);
+        sprintf(name, "%s/%s", directory_path, namelist[i]->d_name);
 
-        int len = get_file_hash(algorithm, name,
-                                outstr, sizeof(outstr));
-        if (len < 0) {
-            // should not happen
-            return -1;
+        if (stat(name, &sb) != 0) {
+            free(name);
+            result = -1;
+            break;
         }
 
-        keep = malloc(len + strlen(name) + 3);
-        res = malloc(sizeof(struct list));
+        if (S_ISREG(sb.st_mode) && context->cache != NULL) {
+            struct cache_entry *entry = hashmapGet(context->cache, name);
 
-        if (keep == NULL || res == NULL) {
-            struct list *next;
-            for (f = list; f != NULL; f = f->next) {
-                next = f->next;
-                free(f->name);
-                free(f);
+            if (entry != NULL && entry->size == (long long) sb.st_size
+                    && entry->mtime == (long long) sb.st_mtime) {
+                hashline = entry->outstr;
+                cached = 1;
             }
-            for (f = *out; f != NULL; f = f->next) {
-                next = f->next;
-                free(f->name);
-                free(f);
+        }
+
+        if (!cached) {
+            int len = get_file_hash(context->algorithm, name,
+                                    outstr, sizeof(outstr));
+            if (len < 0) {
+                // should not happen
+                free(name);
+                result = -1;
+                break;
             }
-            *out = NULL;
+        }
+
+        if (S_ISREG(sb.st_mode) && context->cache_out != NULL) {
+            fprintf(context->cache_out, "%lld %lld %s\t%s\n",
+                    (long long) sb.st_mtime, (long long) sb.st_size,
+                    name, hashline);
+        }
 
+        keep = malloc(strlen(hashline) + strlen(name) + 3);
+        res = malloc(sizeof(struct list));
+
+        if (keep == NULL || res == NULL) {
+            free(name);
             free(keep);
             free(res);
-            return -1;
+            result = -1;
+            break;
         }
 
-        sprintf(keep, "%s %s\n", name, outstr);
+        sprintf(keep, "%s %s\n", name, hashline);
 
         res->name = keep;
-        res->next = *out;
-        *out = res;
-
-        if ((stat(name, &sb) == 0) && S_ISDIR(sb.st_mode)) {
-            if (recurse(algorithm, name, out) < 0) {
-                struct list *next;
-                for (f = list; f != NULL; f = next) {
-                    next = f->next;
-                    free(f->name);
-                    free(f);
-                }
-
-                return -1;
-            }
+        res->next = context->out;
+        context->out = res;
+
+        if (S_ISDIR(sb.st_mode)) {
+            result = recurse(context, name);
         }
-    }
 
-    struct list *next;
-    for (f = list; f != NULL; f = next) {
-        next = f->next;
+        free(name);
+    }
 
-        free(f->name);
-        free(f);
+    for (i = 0; i < count; i++) {
+        free(namelist[i]);
     }
+    free(namelist);
+
+    return result;
 }
 
 /**
- * Allocates a string containing the names and hashes of all files recursively
- * reached under the specified directory_path, using the specified algorithm.
- * The string is returned as *output_string; the return value is the length
- * of the string, or a negative number if there was a failure.
+ * Sorts the lines collected by recurse() and glues them into one
+ * malloc'd string, freeing the list.  Returns the length of the string
+ * via *output_string, or a negative number on failure.
  */
-int get_recursive_hash_manifest(HashAlgorithm algorithm,
-                                const char *directory_path,
-                                char **output_string) {
-    struct list *out = NULL;
+static int assemble_manifest(struct list *out, char **output_string) {
     struct list *r;
     struct list **list;
     int count = 0;
@@ -272,10 +379,6 @@ int get_recursive_hash_manifest(HashAlgorithm algorithm,
     int retlen = 0;
     int i;
     char *buf;
-    
-    if (recurse(algorithm, directory_path, &out) < 0) {
-        return -1;
-    }
 
     for (r = out; r != NULL; r = r->next) {
         count++;
@@ -284,12 +387,7 @@ int get_recursive_hash_manifest(HashAlgorithm algorithm,
 
     list = malloc(count * sizeof(struct list *));
     if (list == NULL) {
-        struct list *next;
-        for (r = out; r != NULL; r = next) {
-            next = r->next;
-            free(r->name);
-            free(r);
-        }
+        free_list(out);
         return -1;
     }
 
@@ -302,12 +400,7 @@ int get_recursive_hash_manifest(HashAlgorithm algorithm,
 
     buf = malloc(len + 1);
     if (buf == NULL) {
-        struct list *next;
-        for (r = out; r != NULL; r = next) {
-            next = r->next;
-            free(r->name);
-            free(r);
-        }
+        free_list(out);
         free(list);
         return -1;
     }
@@ -318,17 +411,96 @@ int get_recursive_hash_manifest(HashAlgorithm algorithm,
         strcpy(buf + retlen, list[i]->name);
         retlen += n;
     }
+    buf[retlen] = 0;
 
     free(list);
+    free_list(out);
 
-    struct list *next;
-    for (r = out; r != NULL; r = next) {
-        next = r->next;
+    *output_string = buf;
+    return retlen;
+}
+
+/**
+ * Allocates a string containing the names and hashes of all files recursively
+ * reached under the specified directory_path, using the specified algorithm.
+ * The string is returned as *output_string; the return value is the length
+ * of the string, or a negative number if there was a failure.
+ */
+int get_recursive_hash_manifest(HashAlgorithm algorithm,
+                                const char *directory_path,
+                                char **output_string) {
+    struct hash_context context;
 
-        free(r->name);
-        free(r);
+    context.algorithm = algorithm;
+    context.out = NULL;
+    context.cache = NULL;
+    context.cache_out = NULL;
+
+    if (recurse(&context, directory_path) < 0) {
+        free_list(context.out);
+        return -1;
     }
 
-    *output_string = buf;
-    return retlen;
+    return assemble_manifest(context.out, output_string);
+}
+
+/**
+ * Like get_recursive_hash_manifest(), but keeps a cache of
+ * (path, size, mtime, hash) at cache_path between runs.  Files whose
+ * size and mtime are unchanged reuse the cached hash and are not read
+ * at all; everything else is hashed and the refreshed cache is written
+ * back atomically.  A missing or stale cache degrades to a full hash,
+ * never to a wrong manifest.
+ */
+int get_recursive_hash_manifest_incremental(HashAlgorithm algorithm,
+                                            const char *directory_path,
+                                            const char *cache_path,
+                                            char **output_string) {
+    struct hash_context context;
+    char *temp_path;
+    int result;
+
+    temp_path = malloc(strlen(cache_path) + 5);
+    if (temp_path == NULL) {
+        return -1;
+    }
+    sprintf(temp_path, "%s.tmp", cache_path);
+
+    context.algorithm = algorithm;
+    context.out = NULL;
+    context.cache = load_cache(cache_path);
+    if (context.cache == NULL) {
+        free(temp_path);
+        return -1;
+    }
+
+    context.cache_out = fopen(temp_path, "w");
+    if (context.cache_out == NULL) {
+        free_cache(context.cache);
+        free(temp_path);
+        return -1;
+    }
+
+    result = recurse(&context, directory_path);
+
+    free_cache(context.cache);
+
+    if (result < 0 || ferror(context.cache_out)) {
+        fclose(context.cache_out);
+        unlink(temp_path);
+        free(temp_path);
+        free_list(context.out);
+        return -1;
+    }
+
+    fclose(context.cache_out);
+    if (rename(temp_path, cache_path) != 0) {
+        unlink(temp_path);
+        free(temp_path);
+        free_list(context.out);
+        return -1;
+    }
+    free(temp_path);
+
+    return assemble_manifest(context.out, output_string);
 }
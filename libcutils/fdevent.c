@@ -20,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include <fcntl.h>
 
@@ -76,8 +77,201 @@ static fdevent list_pending = {
 static fdevent **fd_table = 0;
 static int fd_table_max = 0;
 
-#ifdef CRAPTASTIC
-//HAVE_EPOLL
+/* ---- one-shot timers ----
+** hashed timing wheel: an armed timer lives in wheel[tick & (WHEEL-1)]
+** where a tick is one coalescing quantum, so arming and cancelling are
+** O(1) and the loop only scans the buckets its cursor actually
+** crosses.  the next deadline bounds the backend's wait, so an idle
+** loop with no timers sleeps forever instead of polling.
+*/
+#define TIMER_WHEEL 64
+
+static fdevent_timer timer_wheel[TIMER_WHEEL];
+static int timer_inited = 0;
+static int timer_count = 0;
+static long long timer_cursor = 0;      /* last tick processed */
+static unsigned timer_quantum = 10;     /* coalescing granularity, ms */
+
+static long long timer_now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+}
+
+static void timer_init(void)
+{
+    int i;
+
+    if(timer_inited) return;
+    for(i = 0; i < TIMER_WHEEL; i++) {
+        timer_wheel[i].next = &timer_wheel[i];
+        timer_wheel[i].prev = &timer_wheel[i];
+    }
+    timer_cursor = timer_now_ms() / timer_quantum;
+    timer_inited = 1;
+}
+
+static void timer_unlink(fdevent_timer *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = 0;
+    t->prev = 0;
+    timer_count--;
+}
+
+static void timer_link(fdevent_timer *t)
+{
+    fdevent_timer *list = &timer_wheel[t->tick & (TIMER_WHEEL - 1)];
+
+    t->next = list;
+    t->prev = list->prev;
+    t->prev->next = t;
+    list->prev = t;
+    timer_count++;
+}
+
+void fdevent_timer_set(fdevent_timer *t, timer_func func, void *arg,
+                       unsigned ms)
+{
+    long long q = timer_quantum;
+
+    timer_init();
+    if(t->next) timer_unlink(t);
+
+        /* after a long idle stretch the cursor is stale; with nothing
+        ** armed it is free to jump
+        */
+    if(timer_count == 0)
+        timer_cursor = timer_now_ms() / q;
+
+        /* round the deadline up to the coalescing quantum */
+    t->deadline = ((timer_now_ms() + ms + q - 1) / q) * q;
+    t->tick = t->deadline / q;
+    if(t->tick <= timer_cursor)
+        t->tick = timer_cursor + 1;
+    t->func = func;
+    t->arg = arg;
+    timer_link(t);
+}
+
+void fdevent_timer_cancel(fdevent_timer *t)
+{
+    if(t->next) timer_unlink(t);
+}
+
+void fdevent_timer_slack(unsigned ms)
+{
+    fdevent_timer stash;
+    fdevent_timer *t;
+
+    if(ms == 0) ms = 1;
+    timer_init();
+
+        /* rehash armed timers: their bucket depends on the quantum */
+    stash.next = &stash;
+    stash.prev = &stash;
+    while(timer_count > 0) {
+        int i;
+        for(i = 0; i < TIMER_WHEEL; i++) {
+            while((t = timer_wheel[i].next) != &timer_wheel[i]) {
+                timer_unlink(t);
+                t->next = &stash;
+                t->prev = stash.prev;
+                t->prev->next = t;
+                stash.prev = t;
+            }
+        }
+    }
+
+    timer_quantum = ms;
+    timer_cursor = timer_now_ms() / ms;
+    while((t = stash.next) != &stash) {
+        stash.next = t->next;
+        stash.next->prev = &stash;
+            /* round up: a deadline from the old quantum must not fire
+            ** a fraction of the new one early
+            */
+        t->tick = (t->deadline + ms - 1) / ms;
+        if(t->tick <= timer_cursor)
+            t->tick = timer_cursor + 1;
+        timer_link(t);
+    }
+}
+
+/* how long the backend may sleep: -1 when nothing is armed, otherwise
+** the distance to the nearest armed tick, capped at one wheel
+** revolution (a far-out timer just re-bounds the next wait)
+*/
+static int fdevent_timer_timeout(void)
+{
+    long long now, tick;
+    int off;
+
+    if(timer_count == 0) return -1;
+
+    now = timer_now_ms();
+    for(off = 1; off <= TIMER_WHEEL; off++) {
+        fdevent_timer *list, *t;
+
+        tick = timer_cursor + off;
+        list = &timer_wheel[tick & (TIMER_WHEEL - 1)];
+        for(t = list->next; t != list; t = t->next) {
+            if(t->tick == tick) {
+                long long ms = tick * timer_quantum - now;
+                return (ms > 0) ? (int) ms : 0;
+            }
+        }
+    }
+    return TIMER_WHEEL * timer_quantum;
+}
+
+/* fire everything the cursor has crossed.  a callback may arm or
+** cancel timers, so each bucket is rescanned from its head after
+** every callback
+*/
+static void fdevent_process_timers(void)
+{
+    long long now, now_tick, tick, from;
+
+    if(timer_count == 0) return;
+
+    now = timer_now_ms();
+    now_tick = now / timer_quantum;
+    if(now_tick <= timer_cursor) return;
+
+        /* crossing more than a revolution visits every bucket anyway */
+    from = timer_cursor + 1;
+    if(now_tick - timer_cursor > TIMER_WHEEL)
+        from = now_tick - TIMER_WHEEL + 1;
+
+    for(tick = from; tick <= now_tick; tick++) {
+        fdevent_timer *list = &timer_wheel[tick & (TIMER_WHEEL - 1)];
+        fdevent_timer *t;
+
+    rescan:
+        for(t = list->next; t != list; t = t->next) {
+            if(t->tick <= now_tick) {
+                timer_unlink(t);
+                t->func(t->arg);
+                goto rescan;
+            }
+        }
+    }
+    timer_cursor = now_tick;
+}
+
+#if defined(__linux__)
+/* linux hosts and devices get an epoll backend: wakeups cost O(ready)
+** instead of an O(highest-fd) scan, and there is no FD_SETSIZE ceiling
+** to hit once a server accumulates a few hundred forwarded sockets.
+** everything else falls back to the portable select() code below.
+*/
+#define USE_EPOLL 1
+#endif
+
+#ifdef USE_EPOLL
 
 #include <sys/epoll.h>
 
@@ -85,9 +279,9 @@ static int epoll_fd = -1;
 
 static void fdevent_init()
 {
-        /* XXX: what's a good size for the passed in hint? */
+        /* size hint is ignored by modern kernels, but must be > 0 */
     epoll_fd = epoll_create(256);
-    
+
     if(epoll_fd < 0) {
         perror("epoll_create() failed");
         exit(1);
@@ -99,24 +293,16 @@ static void fdevent_init()
 
 static void fdevent_connect(fdevent *fde)
 {
-    struct epoll_event ev;
-
-    memset(&ev, 0, sizeof(ev));
-    ev.events = 0;
-    ev.data.ptr = fde;
-
-#if 0    
-    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fde->fd, &ev)) {
-        perror("epoll_ctl() failed\n");
-        exit(1);
-    }
-#endif
+        /* nothing to do here: the fd is added to the epoll set by
+        ** fdevent_update() the first time a nonzero event mask is
+        ** installed, so an fde that never asks for events costs nothing
+        */
 }
 
 static void fdevent_disconnect(fdevent *fde)
 {
     struct epoll_event ev;
-    
+
     memset(&ev, 0, sizeof(ev));
     ev.events = 0;
     ev.data.ptr = fde;
@@ -179,9 +365,10 @@ static void fdevent_process()
 {
     struct epoll_event events[256];
     fdevent *fde;
+    unsigned ready;
     int i, n;
 
-    n = epoll_wait(epoll_fd, events, 256, -1);
+    n = epoll_wait(epoll_fd, events, 256, fdevent_timer_timeout());
 
     if(n < 0) {
         if(errno == EINTR) return;
@@ -192,21 +379,32 @@ static void fdevent_process()
     for(i = 0; i < n; i++) {
         struct epoll_event *ev = events + i;
         fde = ev->data.ptr;
+        ready = 0;
 
         if(ev->events & EPOLLIN) {
-            fde->events |= FDE_READ;
+            ready |= FDE_READ;
         }
         if(ev->events & EPOLLOUT) {
-            fde->events |= FDE_WRITE;
+            ready |= FDE_WRITE;
         }
         if(ev->events & (EPOLLERR | EPOLLHUP)) {
-            fde->events |= FDE_ERROR;
-        }
-        if(fde->events) {
-            if(fde->state & FDE_PENDING) continue;
-            fde->state |= FDE_PENDING;
-            fdevent_plist_enqueue(fde);
+                /* also wake the handler for whatever it was waiting
+                ** on, so it discovers the failure from read()/write()
+                ** like it would with the select() backend, instead of
+                ** us re-reporting a level-triggered error forever
+                */
+            ready |= FDE_ERROR | (fde->state & (FDE_READ | FDE_WRITE));
         }
+
+            /* only signal events that are actually being monitored */
+        ready &= (fde->state & FDE_EVENTMASK) | FDE_ERROR;
+        if(ready == 0) continue;
+
+        fde->events |= ready;
+
+        if(fde->state & FDE_PENDING) continue;
+        fde->state |= FDE_PENDING;
+        fdevent_plist_enqueue(fde);
     }
 }
 
@@ -279,12 +477,22 @@ static void fdevent_process()
     fdevent *fde;
     unsigned events;
     fd_set rfd, wfd, efd;
+    struct timeval tv;
+    struct timeval *ptv = 0;
+    int timeout;
 
     memcpy(&rfd, &read_fds, sizeof(fd_set));
     memcpy(&wfd, &write_fds, sizeof(fd_set));
     memcpy(&efd, &error_fds, sizeof(fd_set));
-    
-    n = select(select_n, &rfd, &wfd, &efd, 0);
+
+    timeout = fdevent_timer_timeout();
+    if(timeout >= 0) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        ptv = &tv;
+    }
+
+    n = select(select_n, &rfd, &wfd, &efd, ptv);
     
     if(n < 0) {
         if(errno == EINTR) return;
@@ -337,7 +545,7 @@ static void fdevent_register(fdevent *fde)
         if(fd_table == 0) {
             FATAL("could not expand fd_table to %d entries\n", fd_table_max);
         }
-        memset(fd_table + oldmax, 0, sizeof(int) * (fd_table_max - oldmax));
+        memset(fd_table + oldmax, 0, sizeof(fdevent*) * (fd_table_max - oldmax));
     }
 
     fd_table[fde->fd] = fde;
@@ -484,23 +692,55 @@ void fdevent_del(fdevent *fde, unsigned events)
         fde, (fde->state & FDE_EVENTMASK) & (~(events & FDE_EVENTMASK)));
 }
 
+/* always-on loop statistics; two gettimeofday() calls per iteration
+** is cheap enough to leave enabled in production builds
+*/
+static unsigned stat_loops;
+static unsigned stat_callbacks;
+static unsigned stat_latency[FDEVENT_LAT_BUCKETS];
+
+void fdevent_get_stats(unsigned *loops, unsigned *callbacks,
+                       unsigned latency[FDEVENT_LAT_BUCKETS])
+{
+    *loops = stat_loops;
+    *callbacks = stat_callbacks;
+    memcpy(latency, stat_latency, sizeof(stat_latency));
+}
+
 void fdevent_loop()
 {
     fdevent *fde;
-    
+    struct timeval tv0, tv1;
+    long long us;
+    int bucket;
+
     for(;;) {
 #if DEBUG
         fprintf(stderr,"--- ---- waiting for events\n");
 #endif
         fdevent_process();
-        
+
+        gettimeofday(&tv0, 0);
+        stat_loops++;
+
+        fdevent_process_timers();
+
         while((fde = fdevent_plist_dequeue())) {
             unsigned events = fde->events;
             fde->events = 0;
             fde->state &= (~FDE_PENDING);
             dump_fde(fde, "callback");
+            stat_callbacks++;
             fde->func(fde->fd, events, fde->arg);
         }
+
+        gettimeofday(&tv1, 0);
+        us = (tv1.tv_sec - tv0.tv_sec) * 1000000LL
+           + (tv1.tv_usec - tv0.tv_usec);
+        for(bucket = 0; bucket < FDEVENT_LAT_BUCKETS - 1; bucket++) {
+            if(us < (1000LL << bucket)) break;
+        }
+        stat_latency[bucket]++;
     }
 }
 
@@ -17,6 +17,7 @@
 #include <cutils/hashmap.h>
 #include <assert.h>
 #include <errno.h>
+#include <cutils/atomic.h>
 #include <cutils/threads.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,13 +32,101 @@ struct Entry {
     Entry* next;
 };
 
+/*
+ * Concurrent maps (hashmapCreateConcurrent) keep the same interface but
+ * a different representation. Writes take one of a small number of
+ * striped locks, chosen by key hash, so unrelated writers rarely
+ * contend. Reads take no lock at all: each stripe keeps a sequence
+ * counter which writers bump to an odd value before mutating and back
+ * to even after, and a reader retries if the counter changed under it.
+ * For that to be safe a reader must never follow a dangling pointer, so
+ * entries live in index-linked blocks which are only freed with the map
+ * itself, and a removed entry is recycled only for keys of the same
+ * stripe -- any reuse a reader could observe bumps the very counter it
+ * is watching. Resizing installs an empty table up front and migrates a
+ * few buckets after each write; readers search the new table and then
+ * the old one, and retired tables are kept around until hashmapFree()
+ * in case a stalled reader still holds one.
+ */
+
+// At most this many writers proceed in parallel. Must be a power of 2.
+#define CONCURRENT_STRIPES 8
+
+// Entries are allocated in blocks and linked by index rather than by
+// pointer so a racing reader can never chase freed memory.
+#define CONCURRENT_BLOCK_SHIFT 8
+#define CONCURRENT_BLOCK_SIZE (1 << CONCURRENT_BLOCK_SHIFT)
+#define CONCURRENT_MAX_BLOCKS 1024
+
+// A lock-free reader gives up on a chain this long and retries; only a
+// writer re-linking the chain under it can make one.
+#define CONCURRENT_MAX_HOPS 4096
+
+// Old buckets migrated to the new table after each write during a rehash.
+#define CONCURRENT_MIGRATE_STEP 4
+
+typedef struct {
+    void* key;
+    int hash;
+    void* volatile value;
+    volatile int32_t next;      // entry index, -1 terminates the chain
+} ConcurrentEntry;
+
+typedef struct {
+    size_t bucketCount;          // power of 2, >= CONCURRENT_STRIPES
+    volatile int32_t buckets[1]; // head entry index per bucket, -1 if empty
+} ConcurrentTable;
+
+typedef struct {
+    mutex_t lock;
+    volatile int32_t seq;       // odd while a writer is in this stripe
+    int32_t freeList;           // removed entries, recycled in this stripe
+} ConcurrentStripe;
+
+typedef struct ConcurrentMap ConcurrentMap;
+struct ConcurrentMap {
+    ConcurrentStripe stripes[CONCURRENT_STRIPES];
+    ConcurrentTable* volatile table;
+    ConcurrentTable* volatile oldTable; // non-NULL while rehashing
+    volatile int32_t migratePos;        // next old bucket to migrate
+    mutex_t rehashLock;                 // serializes rehash start and finish
+    ConcurrentEntry* volatile blocks[CONCURRENT_MAX_BLOCKS];
+    mutex_t arenaLock;
+    int32_t blockCount;                 // guarded by arenaLock
+    int32_t arenaUsed;                  // entries handed out, guarded by arenaLock
+    volatile int32_t size;
+    // The table doubles on each rehash, so this can never overflow.
+    ConcurrentTable* retired[32];
+    size_t retiredCount;
+};
+
+/*
+ * Flat maps (hashmapCreateFlat) store entries in one open-addressed
+ * array instead of malloc'd chain nodes, so probing walks consecutive
+ * cache lines and an entry costs no allocation. Collisions resolve
+ * robin-hood style: an inserting entry which has probed further from
+ * its home slot than the resident entry evicts it and the resident
+ * continues probing, which keeps probe lengths short and uniform.
+ * Removal shifts the rest of the cluster back one slot, so there are
+ * no tombstones to accumulate.
+ */
+typedef struct {
+    void* key;
+    int hash;
+    bool used;
+    void* value;
+} FlatEntry;
+
 struct Hashmap {
     Entry** buckets;
     size_t bucketCount;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
-    mutex_t lock; 
+    mutex_t lock;
     size_t size;
+    ConcurrentMap* concurrent;  // NULL for maps from hashmapCreate()
+    FlatEntry* slots;           // non-NULL for maps from hashmapCreateFlat()
+    size_t slotCount;           // power of 2
 };
 
 Hashmap* hashmapCreate(size_t initialCapacity,
@@ -68,9 +157,12 @@ Hashmap* hashmapCreate(size_t initialCapacity,
 
     map->hash = hash;
     map->equals = equals;
-    
+    map->concurrent = NULL;
+    map->slots = NULL;
+    map->slotCount = 0;
+
     mutex_init(&map->lock);
-    
+
     return map;
 }
 
@@ -91,6 +183,9 @@ static inline int hashKey(Hashmap* map, void* key) {
 }
 
 size_t hashmapSize(Hashmap* map) {
+    if (map->concurrent != NULL) {
+        return (size_t) map->concurrent->size;
+    }
     return map->size;
 }
 
@@ -130,14 +225,61 @@ static void expandIfNecessary(Hashmap* map) {
 }
 
 void hashmapLock(Hashmap* map) {
+    if (map->concurrent != NULL) {
+        // Same order as the rehash paths: rehashLock, then the stripes.
+        ConcurrentMap* cm = map->concurrent;
+        mutex_lock(&cm->rehashLock);
+        int i;
+        for (i = 0; i < CONCURRENT_STRIPES; i++) {
+            mutex_lock(&cm->stripes[i].lock);
+        }
+        return;
+    }
     mutex_lock(&map->lock);
 }
 
 void hashmapUnlock(Hashmap* map) {
+    if (map->concurrent != NULL) {
+        ConcurrentMap* cm = map->concurrent;
+        int i;
+        for (i = CONCURRENT_STRIPES - 1; i >= 0; i--) {
+            mutex_unlock(&cm->stripes[i].lock);
+        }
+        mutex_unlock(&cm->rehashLock);
+        return;
+    }
     mutex_unlock(&map->lock);
 }
 
 void hashmapFree(Hashmap* map) {
+    if (map->slots != NULL) {
+        free(map->slots);
+        mutex_destroy(&map->lock);
+        free(map);
+        return;
+    }
+    if (map->concurrent != NULL) {
+        ConcurrentMap* cm = map->concurrent;
+        int i;
+        for (i = 0; i < CONCURRENT_STRIPES; i++) {
+            mutex_destroy(&cm->stripes[i].lock);
+        }
+        mutex_destroy(&cm->rehashLock);
+        mutex_destroy(&cm->arenaLock);
+        for (i = 0; i < cm->blockCount; i++) {
+            free(cm->blocks[i]);
+        }
+        free((void*) cm->table);
+        free((void*) cm->oldTable);
+        size_t r;
+        for (r = 0; r < cm->retiredCount; r++) {
+            free(cm->retired[r]);
+        }
+        free(cm);
+        mutex_destroy(&map->lock);
+        free(map);
+        return;
+    }
     size_t i;
     for (i = 0; i < map->bucketCount; i++) {
         Entry* entry = map->buckets[i];
@@ -186,7 +328,698 @@ static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
     return equals(keyA, keyB);
 }
 
+static inline ConcurrentEntry* concurrentEntryOf(ConcurrentMap* cm,
+        int32_t index) {
+    return &cm->blocks[index >> CONCURRENT_BLOCK_SHIFT]
+            [index & (CONCURRENT_BLOCK_SIZE - 1)];
+}
+
+static inline ConcurrentStripe* concurrentStripeOf(ConcurrentMap* cm,
+        int hash) {
+    return &cm->stripes[((size_t) hash) & (CONCURRENT_STRIPES - 1)];
+}
+
+/**
+ * Reads a stripe's sequence counter. Every atomic in cutils/atomic.h
+ * synchronizes memory, so this also keeps the surrounding reads from
+ * drifting across it; or-ing in zero is just a load.
+ */
+static inline int32_t concurrentReadSeq(ConcurrentStripe* stripe) {
+    return android_atomic_or(0, &stripe->seq);
+}
+
+static inline void concurrentBeginWrite(ConcurrentStripe* stripe) {
+    mutex_lock(&stripe->lock);
+    // Now odd: lock-free readers of this stripe retry.
+    android_atomic_inc(&stripe->seq);
+}
+
+static inline void concurrentEndWrite(ConcurrentStripe* stripe) {
+    android_atomic_inc(&stripe->seq);
+    mutex_unlock(&stripe->lock);
+}
+
+static ConcurrentTable* concurrentNewTable(size_t bucketCount) {
+    ConcurrentTable* table = malloc(sizeof(ConcurrentTable)
+            + (bucketCount - 1) * sizeof(int32_t));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->bucketCount = bucketCount;
+    // An int32_t of all one bits is -1, the empty marker.
+    memset((void*) table->buckets, 0xff, bucketCount * sizeof(int32_t));
+    return table;
+}
+
+/**
+ * Hands out an unused entry index, preferring the stripe's free list.
+ * Returns -1 if memory allocation fails or the arena is full. The
+ * caller holds the stripe's lock.
+ */
+static int32_t concurrentAllocEntry(ConcurrentMap* cm,
+        ConcurrentStripe* stripe) {
+    int32_t index = stripe->freeList;
+    if (index != -1) {
+        stripe->freeList = concurrentEntryOf(cm, index)->next;
+        return index;
+    }
+
+    mutex_lock(&cm->arenaLock);
+    if (cm->arenaUsed == cm->blockCount << CONCURRENT_BLOCK_SHIFT) {
+        if (cm->blockCount == CONCURRENT_MAX_BLOCKS) {
+            mutex_unlock(&cm->arenaLock);
+            return -1;
+        }
+        ConcurrentEntry* block = malloc(
+                CONCURRENT_BLOCK_SIZE * sizeof(ConcurrentEntry));
+        if (block == NULL) {
+            mutex_unlock(&cm->arenaLock);
+            return -1;
+        }
+        cm->blocks[cm->blockCount] = block;
+        cm->blockCount++;
+    }
+    index = cm->arenaUsed++;
+    mutex_unlock(&cm->arenaLock);
+    return index;
+}
+
+/**
+ * Moves every entry of old table bucket 'index' to the new table. The
+ * caller holds the one stripe lock covering that bucket, with the
+ * sequence counter odd. Harmless on a bucket already migrated.
+ */
+static void concurrentMigrateBucket(ConcurrentMap* cm, size_t index) {
+    ConcurrentTable* old = cm->oldTable;
+    ConcurrentTable* table = cm->table;
+    int32_t entryIndex = old->buckets[index];
+    old->buckets[index] = -1;
+    while (entryIndex != -1) {
+        ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+        int32_t next = entry->next;
+        size_t newIndex = calculateIndex(table->bucketCount, entry->hash);
+        entry->next = table->buckets[newIndex];
+        android_atomic_write(entryIndex, &table->buckets[newIndex]);
+        entryIndex = next;
+    }
+}
+
+/**
+ * Migrates a few old buckets toward rehash completion and retires the
+ * old table once it is empty. Called with no stripe lock held; takes
+ * them one at a time, so locks never nest and writers never deadlock.
+ */
+static void concurrentMigrateStep(Hashmap* map) {
+    ConcurrentMap* cm = map->concurrent;
+    int i;
+    for (i = 0; i < CONCURRENT_MIGRATE_STEP; i++) {
+        ConcurrentTable* old = cm->oldTable;
+        if (old == NULL) {
+            return;
+        }
+        int32_t pos = cm->migratePos;
+        if ((size_t) pos >= old->bucketCount) {
+            break;
+        }
+        // Bucket counts are multiples of the stripe count, so bucket
+        // 'pos' holds only hashes covered by stripe 'pos mod stripes'.
+        ConcurrentStripe* stripe =
+                &cm->stripes[pos & (CONCURRENT_STRIPES - 1)];
+        concurrentBeginWrite(stripe);
+        if (cm->oldTable == old && cm->migratePos == pos) {
+            concurrentMigrateBucket(cm, pos);
+            android_atomic_write(pos + 1, &cm->migratePos);
+        }
+        concurrentEndWrite(stripe);
+    }
+
+    // The old table may still be in the hands of a stalled reader, so
+    // retiring keeps it around until hashmapFree().
+    ConcurrentTable* done = cm->oldTable;
+    if (done != NULL && (size_t) cm->migratePos >= done->bucketCount) {
+        mutex_lock(&cm->rehashLock);
+        done = cm->oldTable;
+        if (done != NULL && (size_t) cm->migratePos >= done->bucketCount) {
+            cm->retired[cm->retiredCount++] = done;
+            cm->oldTable = NULL;
+        }
+        mutex_unlock(&cm->rehashLock);
+    }
+}
+
+/**
+ * Doubles the table if the load factor exceeds 0.75. The empty new
+ * table goes in right away; writers then drain the old one a few
+ * buckets at a time while readers check both, so no one ever waits for
+ * a full rehash. Called with no stripe lock held: the swap itself
+ * briefly takes every stripe lock so in-flight writers always see a
+ * stable pair of tables.
+ */
+static void concurrentExpandIfNecessary(Hashmap* map) {
+    ConcurrentMap* cm = map->concurrent;
+    ConcurrentTable* table = cm->table;
+    if (cm->oldTable != NULL
+            || (size_t) cm->size <= table->bucketCount * 3 / 4) {
+        return;
+    }
+
+    mutex_lock(&cm->rehashLock);
+    table = cm->table;
+    if (cm->oldTable == NULL
+            && (size_t) cm->size > table->bucketCount * 3 / 4) {
+        ConcurrentTable* newTable =
+                concurrentNewTable(table->bucketCount << 1);
+        if (newTable != NULL) {
+            int i;
+            for (i = 0; i < CONCURRENT_STRIPES; i++) {
+                mutex_lock(&cm->stripes[i].lock);
+            }
+            // Old before new: a reader which still sees the old table
+            // in 'table' just searches it twice. The atomic write in
+            // between keeps the stores in that order.
+            cm->oldTable = table;
+            android_atomic_write(0, &cm->migratePos);
+            cm->table = newTable;
+            for (i = CONCURRENT_STRIPES - 1; i >= 0; i--) {
+                mutex_unlock(&cm->stripes[i].lock);
+            }
+        }
+    }
+    mutex_unlock(&cm->rehashLock);
+}
+
+/**
+ * Housekeeping run by every writer after releasing its stripe lock.
+ */
+static void concurrentAfterWrite(Hashmap* map) {
+    if (map->concurrent->oldTable != NULL) {
+        concurrentMigrateStep(map);
+    } else {
+        concurrentExpandIfNecessary(map);
+    }
+}
+
+/**
+ * Searches one table for a key without taking a lock. Returns false if
+ * it walked an impossibly long chain, which means a writer tore the
+ * links under us and the whole read must retry.
+ */
+static bool concurrentFindIn(ConcurrentMap* cm, ConcurrentTable* table,
+        void* key, int hash, bool (*equals)(void*, void*),
+        bool* found, void** value) {
+    int32_t entryIndex =
+            table->buckets[calculateIndex(table->bucketCount, hash)];
+    size_t hops = 0;
+    while (entryIndex != -1) {
+        if (++hops > CONCURRENT_MAX_HOPS) {
+            return false;
+        }
+        ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+        if (equalKeys(entry->key, entry->hash, key, hash, equals)) {
+            *found = true;
+            *value = entry->value;
+            return true;
+        }
+        entryIndex = entry->next;
+    }
+    return true;
+}
+
+static void* concurrentGet(Hashmap* map, void* key, bool* foundOut) {
+    ConcurrentMap* cm = map->concurrent;
+    int hash = hashKey(map, key);
+    ConcurrentStripe* stripe = concurrentStripeOf(cm, hash);
+
+    int attempts;
+    for (attempts = 0; attempts < 8; attempts++) {
+        int32_t seq = concurrentReadSeq(stripe);
+        if (seq & 1) {
+            // A writer is in this stripe right now.
+            continue;
+        }
+        bool found = false;
+        void* value = NULL;
+        ConcurrentTable* table = cm->table;
+        bool sane = concurrentFindIn(cm, table, key, hash, map->equals,
+                &found, &value);
+        if (sane && !found) {
+            // Re-reading the counter here also orders this load of
+            // oldTable after the load of table above.
+            if (concurrentReadSeq(stripe) != seq) {
+                continue;
+            }
+            ConcurrentTable* old = cm->oldTable;
+            if (old != NULL && old != table) {
+                sane = concurrentFindIn(cm, old, key, hash, map->equals,
+                        &found, &value);
+            }
+        }
+        if (sane && concurrentReadSeq(stripe) == seq) {
+            if (foundOut != NULL) {
+                *foundOut = found;
+            }
+            return value;
+        }
+    }
+
+    // The stripe is too busy to read consistently; fall back to its
+    // lock. Entries of this stripe cannot move while we hold it.
+    mutex_lock(&stripe->lock);
+    void* value = NULL;
+    bool found = false;
+    ConcurrentTable* table = cm->table;
+    ConcurrentTable* old = cm->oldTable;
+    int t;
+    for (t = 0; t < 2 && !found; t++) {
+        ConcurrentTable* which = (t == 0) ? table : old;
+        if (which == NULL || (t == 1 && which == table)) {
+            continue;
+        }
+        int32_t entryIndex = which->buckets[
+                calculateIndex(which->bucketCount, hash)];
+        while (entryIndex != -1) {
+            ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+            if (equalKeys(entry->key, entry->hash, key, hash,
+                    map->equals)) {
+                value = entry->value;
+                found = true;
+                break;
+            }
+            entryIndex = entry->next;
+        }
+    }
+    mutex_unlock(&stripe->lock);
+    if (foundOut != NULL) {
+        *foundOut = found;
+    }
+    return value;
+}
+
+static void* concurrentPut(Hashmap* map, void* key, void* value) {
+    ConcurrentMap* cm = map->concurrent;
+    int hash = hashKey(map, key);
+    ConcurrentStripe* stripe = concurrentStripeOf(cm, hash);
+
+    concurrentBeginWrite(stripe);
+
+    // Drain this key's old bucket first so the current table is the
+    // only place the key can live.
+    ConcurrentTable* old = cm->oldTable;
+    if (old != NULL) {
+        concurrentMigrateBucket(cm,
+                calculateIndex(old->bucketCount, hash));
+    }
+
+    ConcurrentTable* table = cm->table;
+    size_t index = calculateIndex(table->bucketCount, hash);
+    int32_t entryIndex = table->buckets[index];
+    while (entryIndex != -1) {
+        ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
+            void* oldValue = entry->value;
+            entry->value = value;
+            concurrentEndWrite(stripe);
+            return oldValue;
+        }
+        entryIndex = entry->next;
+    }
+
+    int32_t newIndex = concurrentAllocEntry(cm, stripe);
+    if (newIndex == -1) {
+        concurrentEndWrite(stripe);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ConcurrentEntry* entry = concurrentEntryOf(cm, newIndex);
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    entry->next = table->buckets[index];
+    // The entry is fully built before this store makes it reachable.
+    android_atomic_write(newIndex, &table->buckets[index]);
+    android_atomic_inc(&cm->size);
+    concurrentEndWrite(stripe);
+
+    concurrentAfterWrite(map);
+    return NULL;
+}
+
+static void* concurrentMemoize(Hashmap* map, void* key,
+        void* (*initialValue)(void* key, void* context), void* context) {
+    ConcurrentMap* cm = map->concurrent;
+    int hash = hashKey(map, key);
+    ConcurrentStripe* stripe = concurrentStripeOf(cm, hash);
+
+    concurrentBeginWrite(stripe);
+
+    ConcurrentTable* old = cm->oldTable;
+    if (old != NULL) {
+        concurrentMigrateBucket(cm,
+                calculateIndex(old->bucketCount, hash));
+    }
+
+    ConcurrentTable* table = cm->table;
+    size_t index = calculateIndex(table->bucketCount, hash);
+    int32_t entryIndex = table->buckets[index];
+    while (entryIndex != -1) {
+        ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
+            void* value = entry->value;
+            concurrentEndWrite(stripe);
+            return value;
+        }
+        entryIndex = entry->next;
+    }
+
+    int32_t newIndex = concurrentAllocEntry(cm, stripe);
+    if (newIndex == -1) {
+        concurrentEndWrite(stripe);
+        errno = ENOMEM;
+        return NULL;
+    }
+    // The callback runs under this key's stripe lock: it must not
+    // touch the map itself.
+    void* value = initialValue(key, context);
+    ConcurrentEntry* entry = concurrentEntryOf(cm, newIndex);
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    entry->next = table->buckets[index];
+    android_atomic_write(newIndex, &table->buckets[index]);
+    android_atomic_inc(&cm->size);
+    concurrentEndWrite(stripe);
+
+    concurrentAfterWrite(map);
+    return value;
+}
+
+static void* concurrentRemove(Hashmap* map, void* key) {
+    ConcurrentMap* cm = map->concurrent;
+    int hash = hashKey(map, key);
+    ConcurrentStripe* stripe = concurrentStripeOf(cm, hash);
+
+    concurrentBeginWrite(stripe);
+
+    ConcurrentTable* old = cm->oldTable;
+    if (old != NULL) {
+        concurrentMigrateBucket(cm,
+                calculateIndex(old->bucketCount, hash));
+    }
+
+    ConcurrentTable* table = cm->table;
+    volatile int32_t* p =
+            &table->buckets[calculateIndex(table->bucketCount, hash)];
+    int32_t entryIndex;
+    while ((entryIndex = *p) != -1) {
+        ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
+            void* value = entry->value;
+            android_atomic_write(entry->next, p);
+            // Recycled within the stripe, never freed: a reader still
+            // standing on this entry retries once it sees our bump of
+            // the sequence counter.
+            entry->next = stripe->freeList;
+            stripe->freeList = entryIndex;
+            android_atomic_dec(&cm->size);
+            concurrentEndWrite(stripe);
+            return value;
+        }
+        p = &entry->next;
+    }
+
+    concurrentEndWrite(stripe);
+    return NULL;
+}
+
+static void concurrentForEach(Hashmap* map,
+        bool (*callback)(void* key, void* value, void* context),
+        void* context) {
+    ConcurrentMap* cm = map->concurrent;
+    ConcurrentTable* tables[2];
+    tables[0] = cm->table;
+    tables[1] = cm->oldTable;
+    int t;
+    for (t = 0; t < 2; t++) {
+        ConcurrentTable* table = tables[t];
+        if (table == NULL || (t == 1 && table == tables[0])) {
+            continue;
+        }
+        size_t i;
+        for (i = 0; i < table->bucketCount; i++) {
+            int32_t entryIndex = table->buckets[i];
+            while (entryIndex != -1) {
+                ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+                if (!callback(entry->key, entry->value, context)) {
+                    return;
+                }
+                entryIndex = entry->next;
+            }
+        }
+    }
+}
+
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    assert(hash != NULL);
+    assert(equals != NULL);
+
+    Hashmap* map = malloc(sizeof(Hashmap));
+    if (map == NULL) {
+        return NULL;
+    }
+
+    ConcurrentMap* cm = calloc(1, sizeof(ConcurrentMap));
+    if (cm == NULL) {
+        free(map);
+        return NULL;
+    }
+
+    // 0.75 load factor, and at least one bucket per stripe so that a
+    // bucket maps to the same stripe as the hashes it holds.
+    size_t minimumBucketCount = initialCapacity * 4 / 3;
+    size_t bucketCount = CONCURRENT_STRIPES;
+    while (bucketCount <= minimumBucketCount) {
+        bucketCount <<= 1;
+    }
+
+    cm->table = concurrentNewTable(bucketCount);
+    if (cm->table == NULL) {
+        free(cm);
+        free(map);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < CONCURRENT_STRIPES; i++) {
+        mutex_init(&cm->stripes[i].lock);
+        cm->stripes[i].freeList = -1;
+    }
+    mutex_init(&cm->rehashLock);
+    mutex_init(&cm->arenaLock);
+
+    map->buckets = NULL;
+    map->bucketCount = 0;
+    map->size = 0;
+    map->hash = hash;
+    map->equals = equals;
+    map->concurrent = cm;
+    map->slots = NULL;
+    map->slotCount = 0;
+    mutex_init(&map->lock);
+
+    return map;
+}
+
+/**
+ * How far the entry living in 'index' has probed from its home slot.
+ */
+static inline size_t flatDistance(size_t slotCount, size_t index, int hash) {
+    return (index - calculateIndex(slotCount, hash)) & (slotCount - 1);
+}
+
+/**
+ * Places an entry known not to be in the table. The caller has made
+ * sure a free slot exists.
+ */
+static void flatPlace(FlatEntry* slots, size_t slotCount,
+        void* key, int hash, void* value) {
+    size_t index = calculateIndex(slotCount, hash);
+    size_t probes = 0;
+    while (true) {
+        FlatEntry* slot = &slots[index];
+        if (!slot->used) {
+            slot->key = key;
+            slot->hash = hash;
+            slot->value = value;
+            slot->used = true;
+            return;
+        }
+        // Robin hood: the entry closer to home yields its slot to the
+        // one which has probed further, and continues probing itself.
+        size_t distance = flatDistance(slotCount, index, slot->hash);
+        if (distance < probes) {
+            FlatEntry evicted = *slot;
+            slot->key = key;
+            slot->hash = hash;
+            slot->value = value;
+            key = evicted.key;
+            hash = evicted.hash;
+            value = evicted.value;
+            probes = distance;
+        }
+        index = (index + 1) & (slotCount - 1);
+        probes++;
+    }
+}
+
+/**
+ * Grows the table if the load factor exceeds 0.75. Returns false only
+ * if the table is completely full and cannot grow.
+ */
+static bool flatExpandIfNecessary(Hashmap* map) {
+    if (map->size <= map->slotCount * 3 / 4) {
+        return true;
+    }
+    size_t newCount = map->slotCount << 1;
+    FlatEntry* newSlots = calloc(newCount, sizeof(FlatEntry));
+    if (newSlots == NULL) {
+        // Not fatal until every slot is taken.
+        return map->size < map->slotCount;
+    }
+    size_t i;
+    for (i = 0; i < map->slotCount; i++) {
+        FlatEntry* slot = &map->slots[i];
+        if (slot->used) {
+            flatPlace(newSlots, newCount, slot->key, slot->hash, slot->value);
+        }
+    }
+    free(map->slots);
+    map->slots = newSlots;
+    map->slotCount = newCount;
+    return true;
+}
+
+/**
+ * Returns the slot holding the key, or NULL. Robin hood keeps clusters
+ * ordered by probe distance, so the search stops as soon as it has
+ * probed further than the entry it is looking at.
+ */
+static FlatEntry* flatFind(Hashmap* map, void* key, int hash) {
+    size_t index = calculateIndex(map->slotCount, hash);
+    size_t probes = 0;
+    while (true) {
+        FlatEntry* slot = &map->slots[index];
+        if (!slot->used
+                || flatDistance(map->slotCount, index, slot->hash) < probes) {
+            return NULL;
+        }
+        if (equalKeys(slot->key, slot->hash, key, hash, map->equals)) {
+            return slot;
+        }
+        index = (index + 1) & (map->slotCount - 1);
+        probes++;
+    }
+}
+
+static void* flatPut(Hashmap* map, void* key, void* value) {
+    int hash = hashKey(map, key);
+    FlatEntry* slot = flatFind(map, key, hash);
+    if (slot != NULL) {
+        void* oldValue = slot->value;
+        slot->value = value;
+        return oldValue;
+    }
+    if (!flatExpandIfNecessary(map)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    flatPlace(map->slots, map->slotCount, key, hash, value);
+    map->size++;
+    return NULL;
+}
+
+static void* flatMemoize(Hashmap* map, void* key,
+        void* (*initialValue)(void* key, void* context), void* context) {
+    int hash = hashKey(map, key);
+    FlatEntry* slot = flatFind(map, key, hash);
+    if (slot != NULL) {
+        return slot->value;
+    }
+    if (!flatExpandIfNecessary(map)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void* value = initialValue(key, context);
+    flatPlace(map->slots, map->slotCount, key, hash, value);
+    map->size++;
+    return value;
+}
+
+static void* flatRemove(Hashmap* map, void* key) {
+    int hash = hashKey(map, key);
+    FlatEntry* slot = flatFind(map, key, hash);
+    if (slot == NULL) {
+        return NULL;
+    }
+    void* value = slot->value;
+    // Shift the rest of the cluster back so no tombstone is left.
+    size_t index = slot - map->slots;
+    while (true) {
+        size_t next = (index + 1) & (map->slotCount - 1);
+        FlatEntry* nextSlot = &map->slots[next];
+        if (!nextSlot->used
+                || flatDistance(map->slotCount, next, nextSlot->hash) == 0) {
+            break;
+        }
+        map->slots[index] = *nextSlot;
+        index = next;
+    }
+    map->slots[index].used = false;
+    map->size--;
+    return value;
+}
+
+Hashmap* hashmapCreateFlat(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    assert(hash != NULL);
+    assert(equals != NULL);
+
+    Hashmap* map = malloc(sizeof(Hashmap));
+    if (map == NULL) {
+        return NULL;
+    }
+
+    // 0.75 load factor, like the chained map.
+    size_t minimumSlotCount = initialCapacity * 4 / 3;
+    map->slotCount = 1;
+    while (map->slotCount <= minimumSlotCount) {
+        map->slotCount <<= 1;
+    }
+
+    map->slots = calloc(map->slotCount, sizeof(FlatEntry));
+    if (map->slots == NULL) {
+        free(map);
+        return NULL;
+    }
+
+    map->buckets = NULL;
+    map->bucketCount = 0;
+    map->size = 0;
+    map->hash = hash;
+    map->equals = equals;
+    map->concurrent = NULL;
+    mutex_init(&map->lock);
+
+    return map;
+}
+
 void* hashmapPut(Hashmap* map, void* key, void* value) {
+    if (map->concurrent != NULL) {
+        return concurrentPut(map, key, value);
+    }
+    if (map->slots != NULL) {
+        return flatPut(map, key, value);
+    }
     int hash = hashKey(map, key);
     size_t index = calculateIndex(map->bucketCount, hash);
 
@@ -219,6 +1052,13 @@ void* hashmapPut(Hashmap* map, void* key, void* value) {
 }
 
 void* hashmapGet(Hashmap* map, void* key) {
+    if (map->concurrent != NULL) {
+        return concurrentGet(map, key, NULL);
+    }
+    if (map->slots != NULL) {
+        FlatEntry* slot = flatFind(map, key, hashKey(map, key));
+        return slot != NULL ? slot->value : NULL;
+    }
     int hash = hashKey(map, key);
     size_t index = calculateIndex(map->bucketCount, hash);
 
@@ -234,6 +1074,14 @@ void* hashmapGet(Hashmap* map, void* key) {
 }
 
 bool hashmapContainsKey(Hashmap* map, void* key) {
+    if (map->concurrent != NULL) {
+        bool found = false;
+        concurrentGet(map, key, &found);
+        return found;
+    }
+    if (map->slots != NULL) {
+        return flatFind(map, key, hashKey(map, key)) != NULL;
+    }
     int hash = hashKey(map, key);
     size_t index = calculateIndex(map->bucketCount, hash);
 
@@ -248,8 +1096,14 @@ bool hashmapContainsKey(Hashmap* map, void* key) {
     return false;
 }
 
-void* hashmapMemoize(Hashmap* map, void* key, 
+void* hashmapMemoize(Hashmap* map, void* key,
         void* (*initialValue)(void* key, void* context), void* context) {
+    if (map->concurrent != NULL) {
+        return concurrentMemoize(map, key, initialValue, context);
+    }
+    if (map->slots != NULL) {
+        return flatMemoize(map, key, initialValue, context);
+    }
     int hash = hashKey(map, key);
     size_t index = calculateIndex(map->bucketCount, hash);
 
@@ -282,6 +1136,12 @@ void* hashmapMemoize(Hashmap* map, void* key,
 }
 
 void* hashmapRemove(Hashmap* map, void* key) {
+    if (map->concurrent != NULL) {
+        return concurrentRemove(map, key);
+    }
+    if (map->slots != NULL) {
+        return flatRemove(map, key);
+    }
     int hash = hashKey(map, key);
     size_t index = calculateIndex(map->bucketCount, hash);
 
@@ -306,6 +1166,20 @@ void* hashmapRemove(Hashmap* map, void* key) {
 void hashmapForEach(Hashmap* map, 
         bool (*callback)(void* key, void* value, void* context),
         void* context) {
+    if (map->concurrent != NULL) {
+        concurrentForEach(map, callback, context);
+        return;
+    }
+    if (map->slots != NULL) {
+        size_t i;
+        for (i = 0; i < map->slotCount; i++) {
+            FlatEntry* slot = &map->slots[i];
+            if (slot->used && !callback(slot->key, slot->value, context)) {
+                return;
+            }
+        }
+        return;
+    }
     size_t i;
     for (i = 0; i < map->bucketCount; i++) {
         Entry* entry = map->buckets[i];
@@ -320,10 +1194,45 @@ void hashmapForEach(Hashmap* map,
 
 size_t hashmapCurrentCapacity(Hashmap* map) {
     size_t bucketCount = map->bucketCount;
+    if (map->concurrent != NULL) {
+        bucketCount = map->concurrent->table->bucketCount;
+    } else if (map->slots != NULL) {
+        bucketCount = map->slotCount;
+    }
     return bucketCount * 3 / 4;
 }
 
 size_t hashmapCountCollisions(Hashmap* map) {
+    if (map->slots != NULL) {
+        // Entries pushed out of their home slot by a collision.
+        size_t collisions = 0;
+        size_t i;
+        for (i = 0; i < map->slotCount; i++) {
+            FlatEntry* slot = &map->slots[i];
+            if (slot->used
+                    && flatDistance(map->slotCount, i, slot->hash) != 0) {
+                collisions++;
+            }
+        }
+        return collisions;
+    }
+    if (map->concurrent != NULL) {
+        ConcurrentMap* cm = map->concurrent;
+        size_t collisions = 0;
+        ConcurrentTable* table = cm->table;
+        size_t i;
+        for (i = 0; i < table->bucketCount; i++) {
+            int32_t entryIndex = table->buckets[i];
+            while (entryIndex != -1) {
+                ConcurrentEntry* entry = concurrentEntryOf(cm, entryIndex);
+                if (entry->next != -1) {
+                    collisions++;
+                }
+                entryIndex = entry->next;
+            }
+        }
+        return collisions;
+    }
     size_t collisions = 0;
     size_t i;
     for (i = 0; i < map->bucketCount; i++) {
@@ -0,0 +1,57 @@
+/* libs/cutils/map_file.c
+**
+** Copyright 2008, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void *map_file(const char *fn, unsigned *_sz)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if(fd < 0) return 0;
+
+    if(fstat(fd, &st) < 0) goto oops;
+    if(st.st_size == 0) goto oops;
+
+    /* MAP_PRIVATE makes writes copy-on-write, so callers that patch
+    ** the data in place (image headers, parsers) never touch the file
+    */
+    data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) goto oops;
+    close(fd);
+
+    /* the typical consumer walks the file front to back exactly once */
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    if(_sz) *_sz = st.st_size;
+    return data;
+
+oops:
+    close(fd);
+    return 0;
+}
+
+void unmap_file(void *data, unsigned sz)
+{
+    munmap(data, sz);
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/memory.h>
+
+#include <string.h>
+
+/*
+ * lives in its own file because memory.c is replaced by assembly
+ * on some targets, while this helper is wanted everywhere
+ */
+void android_memcpy_rect(void* dst, size_t dstStride,
+        const void* src, size_t srcStride, size_t width, size_t height)
+{
+    char* d = dst;
+    const char* s = src;
+
+    if (width == 0 || height == 0)
+        return;
+
+    /* when the rows are packed the whole rect is one contiguous copy */
+    if (dstStride == width && srcStride == width) {
+        memcpy(d, s, width * height);
+        return;
+    }
+
+    while (height--) {
+        memcpy(d, s, width);
+        d += dstStride;
+        s += srcStride;
+    }
+}
@@ -16,19 +16,81 @@
 
 #include <cutils/memory.h>
 
-void android_memset16(uint16_t* dst, uint16_t value, size_t size)
+#include <stdint.h>
+
+/* this file only builds for targets without an assembly version
+ * (see memset32.S for ARM), so SSE2 covers the interesting case */
+#if defined(__SSE2__) && !defined(__arm__)
+#define ANDROID_SSE2_MEMSET 1
+#include <emmintrin.h>
+#endif
+
+void android_memset32(uint32_t* dst, uint32_t value, size_t size)
 {
-    size >>= 1;
+    size >>= 2;
+
+#ifdef ANDROID_SSE2_MEMSET
+    if (size >= 8) {
+        __m128i value4 = _mm_set1_epi32(value);
+
+        /* get to a 16-byte boundary */
+        while ((uintptr_t)dst & 15) {
+            *dst++ = value;
+            size--;
+        }
+        /* 64 bytes per iteration */
+        while (size >= 16) {
+            _mm_store_si128((__m128i*)dst, value4);
+            _mm_store_si128((__m128i*)(dst + 4), value4);
+            _mm_store_si128((__m128i*)(dst + 8), value4);
+            _mm_store_si128((__m128i*)(dst + 12), value4);
+            dst += 16;
+            size -= 16;
+        }
+        while (size >= 4) {
+            _mm_store_si128((__m128i*)dst, value4);
+            dst += 4;
+            size -= 4;
+        }
+    }
+#else
+    while (size >= 8) {
+        dst[0] = value;
+        dst[1] = value;
+        dst[2] = value;
+        dst[3] = value;
+        dst[4] = value;
+        dst[5] = value;
+        dst[6] = value;
+        dst[7] = value;
+        dst += 8;
+        size -= 8;
+    }
+#endif
     while (size--) {
         *dst++ = value;
     }
 }
 
-void android_memset32(uint32_t* dst, uint32_t value, size_t size)
+void android_memset16(uint16_t* dst, uint16_t value, size_t size)
 {
-    size >>= 2;
-    while (size--) {
+    size >>= 1;
+
+    if (size == 0) {
+        return;
+    }
+
+    /* align to a word boundary, then widen to word stores */
+    if ((uintptr_t)dst & 2) {
         *dst++ = value;
+        size--;
+    }
+
+    android_memset32((uint32_t*) dst,
+            ((uint32_t)value << 16) | value, (size >> 1) << 2);
+
+    if (size & 1) {
+        dst[size - 1] = value;
     }
 }
 
@@ -0,0 +1,109 @@
+/* Copyright 2008 The Android Open Source Project */
+
+/* Statistics and a per-subsystem registry for dlmalloc mspaces.
+ * Long-running daemons fragment their single heap over days; giving
+ * each allocation-heavy subsystem its own named space keeps the churn
+ * contained and lets the daemon report per-space numbers over its
+ * control socket.  Everything here sits on the public mspace_*() API,
+ * so it stays out of the dlmalloc wrapper in mspace.c.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <cutils/mspace.h>
+
+static void stats_walker(const void *chunkptr, size_t chunklen,
+    const void *userptr, size_t userlen, void *arg) {
+  struct mspace_stats *stats = arg;
+
+  if (userptr == NULL) {
+    stats->free_bytes += chunklen;
+    stats->free_chunks++;
+    if (chunklen > stats->largest_free)
+      stats->largest_free = chunklen;
+  } else {
+    stats->live_bytes += userlen;
+    stats->live_chunks++;
+  }
+}
+
+void mspace_get_stats(mspace msp, struct mspace_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  mspace_walk_heap(msp, stats_walker, stats);
+  stats->footprint = mspace_footprint(msp);
+  stats->max_footprint = mspace_max_footprint(msp);
+}
+
+#define MAX_SUBSYSTEM_SPACES 8
+
+static struct {
+  char name[32];
+  mspace msp;
+} subsystem_spaces[MAX_SUBSYSTEM_SPACES];
+static int subsystem_space_count;
+static pthread_mutex_t subsystem_space_lock = PTHREAD_MUTEX_INITIALIZER;
+
+mspace mspace_for_subsystem(const char *name, size_t starting_capacity,
+    size_t max_capacity) {
+  mspace msp = (mspace)0;
+  int i;
+
+  pthread_mutex_lock(&subsystem_space_lock);
+
+  for (i = 0; i < subsystem_space_count; i++) {
+    if (strcmp(subsystem_spaces[i].name, name) == 0) {
+      msp = subsystem_spaces[i].msp;
+      goto done;
+    }
+  }
+
+  if (subsystem_space_count == MAX_SUBSYSTEM_SPACES)
+    goto done;
+
+  /* The spaces are shared across threads, so they must be locked.
+   */
+  msp = create_contiguous_mspace_with_name(starting_capacity,
+      max_capacity, 1, name);
+  if (msp != (mspace)0) {
+    i = subsystem_space_count++;
+    snprintf(subsystem_spaces[i].name, sizeof(subsystem_spaces[i].name),
+        "%s", name);
+    subsystem_spaces[i].msp = msp;
+  }
+
+done:
+  pthread_mutex_unlock(&subsystem_space_lock);
+  return msp;
+}
+
+int mspace_stats_report(char *buf, size_t bufsize) {
+  struct mspace_stats stats;
+  int len = 0;
+  int frag;
+  int i;
+
+  pthread_mutex_lock(&subsystem_space_lock);
+
+  for (i = 0; i < subsystem_space_count && (size_t)len < bufsize; i++) {
+    mspace_get_stats(subsystem_spaces[i].msp, &stats);
+
+    /* How much of the free memory is unusable for a request the size
+     * of the largest free chunk; 0% means one contiguous free region.
+     */
+    frag = 0;
+    if (stats.free_bytes > 0)
+      frag = 100 - (int)(stats.largest_free * 100 / stats.free_bytes);
+
+    len += snprintf(buf + len, bufsize - len,
+        "%s: live %lu/%d free %lu/%d frag %d%% footprint %lu max %lu\n",
+        subsystem_spaces[i].name,
+        (unsigned long)stats.live_bytes, stats.live_chunks,
+        (unsigned long)stats.free_bytes, stats.free_chunks,
+        frag,
+        (unsigned long)stats.footprint, (unsigned long)stats.max_footprint);
+  }
+
+  pthread_mutex_unlock(&subsystem_space_lock);
+  return len;
+}
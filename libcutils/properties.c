@@ -24,12 +24,19 @@
 #include <assert.h>
 
 #include <cutils/properties.h>
+#include <cutils/threads.h>
 #include "loghack.h"
 
+#ifndef HAVE_LIBC_SYSTEM_PROPERTIES
+/* counts local property_set calls for builds with no shared area */
+static unsigned gPropertyLocalSerial = 0;
+#endif
+
 #ifdef HAVE_LIBC_SYSTEM_PROPERTIES
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
+#include <sys/atomics.h>
 
 static int send_prop_msg(prop_msg *msg)
 {
@@ -119,6 +126,10 @@ int property_list(void (*propfn)(const char *key, const char *value, void *cooki
 #include <sys/un.h>
 #include <pthread.h>
 
+/* the server can be changed by other processes without bumping our
+** local serial, so the cache must not trust it */
+#define PROPERTY_CACHE_DIRECT 1
+
 static pthread_once_t gInitOnce = PTHREAD_ONCE_INIT;
 static pthread_mutex_t gPropertyFdLock = PTHREAD_MUTEX_INITIALIZER;
 static int gPropFd = -1;
@@ -273,6 +284,8 @@ int property_set(const char *key, const char *value)
 
     if (recvBuf[0] != 1)
         return -1;
+
+    gPropertyLocalSerial++;
     return 0;
 }
 
@@ -353,16 +366,233 @@ int property_set(const char *key, const char *value)
     }
 #else    
     r = setenv(ename, value, 1);
-#endif    
+#endif
+    if (r == 0) {
+        gPropertyLocalSerial++;
+    }
     mutex_unlock(&env_lock);
-    
+
     return r;
 }
 
-int property_list(void (*propfn)(const char *key, const char *value, void *cookie), 
+int property_list(void (*propfn)(const char *key, const char *value, void *cookie),
                   void *cookie)
 {
     return 0;
 }
 
 #endif
+
+int property_set_bulk(const char **keys, const char **values, int count)
+{
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    /* the property service drains every message queued on one
+    ** connection, so the whole batch costs a single connect
+    */
+    prop_msg msg;
+    const char *value;
+    int s;
+    int r;
+    int n;
+
+    s = socket_local_client(PROP_SERVICE_NAME,
+                            ANDROID_SOCKET_NAMESPACE_RESERVED,
+                            SOCK_STREAM);
+    if(s < 0) return -1;
+
+    for(n = 0; n < count; n++) {
+        if(keys[n] == 0) break;
+        value = values[n] ? values[n] : "";
+        if(strlen(keys[n]) >= PROP_NAME_MAX) break;
+        if(strlen(value) >= PROP_VALUE_MAX) break;
+
+        msg.cmd = PROP_MSG_SETPROP;
+        strcpy((char*) msg.name, keys[n]);
+        strcpy((char*) msg.value, value);
+
+        while((r = send(s, &msg, sizeof(prop_msg), 0)) < 0) {
+            if((errno == EINTR) || (errno == EAGAIN)) continue;
+            break;
+        }
+        if(r != sizeof(prop_msg)) break;
+    }
+
+    close(s);
+    return (n == count) ? 0 : -1;
+#else
+    int n;
+
+    for(n = 0; n < count; n++) {
+        if(property_set(keys[n], values[n] ? values[n] : ""))
+            return -1;
+    }
+    return 0;
+#endif
+}
+
+/*
+ * Client-side caching, common to all backends. Everything below hangs
+ * off property_serial(): a cheap monotonic token which changes whenever
+ * a property does, so hot loops only pay for a full lookup after an
+ * actual change.
+ */
+
+unsigned property_serial(void)
+{
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    /* the shared property area bumps 'serial' on every value change
+    ** and 'count' on every addition; both only ever increment, so
+    ** their sum is a monotonic change token shared by all processes */
+    prop_area *pa = __system_property_area__;
+    return pa->serial + pa->count;
+#else
+    return gPropertyLocalSerial;
+#endif
+}
+
+unsigned property_wait(const char *key, unsigned old_serial)
+{
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    prop_area *pa = __system_property_area__;
+
+    if (key == 0) {
+        /* the property service bumps pa->serial and wakes its futex on
+        ** every mutation, so the area serial is enough to sleep on */
+        for (;;) {
+            unsigned serial = pa->serial;
+            unsigned token = serial + pa->count;
+            if (token != old_serial)
+                return token;
+            __futex_wait(&pa->serial, serial, 0);
+        }
+    }
+
+    for (;;) {
+        const prop_info *pi = __system_property_find(key);
+        unsigned serial;
+
+        if (pi) {
+            serial = pi->serial;
+            /* the low bit marks a write in progress; the writer clears
+            ** it and wakes this futex when the value is complete */
+            if (serial != old_serial && !(serial & 1))
+                return serial;
+            __futex_wait((volatile void*) &pi->serial, serial, 0);
+        } else {
+            /* not defined yet: additions bump the area serial */
+            serial = pa->serial;
+            if (__system_property_find(key) == 0)
+                __futex_wait(&pa->serial, serial, 0);
+        }
+    }
+#else
+    /* no shared area to sleep on; fall back to polling the local
+    ** serial so callers still behave sensibly on these builds */
+    for (;;) {
+        unsigned serial = property_serial();
+        if (serial != old_serial)
+            return serial;
+        usleep(100000);
+    }
+#endif
+}
+
+int property_cache_get(property_cache_t *cache, const char *key,
+                       char *value, const char *default_value)
+{
+#ifdef PROPERTY_CACHE_DIRECT
+    (void) cache;
+    return property_get(key, value, default_value);
+#else
+    unsigned serial = property_serial();
+
+    if (strlen(key) >= PROPERTY_KEY_MAX) return -1;
+
+    if (cache->serial != serial || strcmp(cache->key, key) != 0) {
+        cache->value[0] = '\0';
+        cache->len = property_get(key, cache->value, default_value);
+        strcpy(cache->key, key);
+        cache->serial = serial;
+    }
+
+    if (cache->len >= 0) {
+        memcpy(value, cache->value, cache->len + 1);
+    }
+    return cache->len;
+#endif
+}
+
+typedef struct PropertyWatch {
+    struct PropertyWatch *next;
+    property_watch_fn *fn;
+    void *cookie;
+    int len;
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+} PropertyWatch;
+
+static mutex_t gWatchLock = MUTEX_INITIALIZER;
+static PropertyWatch *gWatchList = NULL;
+static unsigned gWatchSerial = 0;
+
+int property_watch(const char *key, property_watch_fn *fn, void *cookie)
+{
+    PropertyWatch *w;
+    int len;
+
+    if (strlen(key) >= PROPERTY_KEY_MAX) return -1;
+
+    w = calloc(1, sizeof(PropertyWatch));
+    if (w == NULL) return -1;
+
+    strcpy(w->key, key);
+    w->fn = fn;
+    w->cookie = cookie;
+
+    /* the callback only fires for changes after this point */
+    len = property_get(key, w->value, NULL);
+    if (len < 0) {
+        len = 0;
+        w->value[0] = '\0';
+    }
+    w->len = len;
+
+    mutex_lock(&gWatchLock);
+    w->next = gWatchList;
+    gWatchList = w;
+    mutex_unlock(&gWatchLock);
+    return 0;
+}
+
+void property_watch_poll(void)
+{
+    unsigned serial;
+    PropertyWatch *w;
+
+    if (gWatchList == NULL) return;
+
+    serial = property_serial();
+#ifndef PROPERTY_CACHE_DIRECT
+    if (serial == gWatchSerial) return;
+#endif
+
+    mutex_lock(&gWatchLock);
+    gWatchSerial = serial;
+    for (w = gWatchList; w != NULL; w = w->next) {
+        char fresh[PROPERTY_VALUE_MAX];
+        int len;
+
+        fresh[0] = '\0';
+        len = property_get(w->key, fresh, NULL);
+        if (len < 0) {
+            len = 0;
+            fresh[0] = '\0';
+        }
+        if (len != w->len || memcmp(w->value, fresh, len + 1) != 0) {
+            memcpy(w->value, fresh, len + 1);
+            w->len = len;
+            w->fn(w->key, w->value, w->cookie);
+        }
+    }
+    mutex_unlock(&gWatchLock);
+}
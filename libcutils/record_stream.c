@@ -2,16 +2,16 @@
 **
 ** Copyright 2006, The Android Open Source Project
 **
-** Licensed under the Apache License, Version 2.0 (the "License"); 
-** you may not use this file except in compliance with the License. 
-** You may obtain a copy of the License at 
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
 **
-**     http://www.apache.org/licenses/LICENSE-2.0 
+**     http://www.apache.org/licenses/LICENSE-2.0
 **
-** Unless required by applicable law or agreed to in writing, software 
-** distributed under the License is distributed on an "AS IS" BASIS, 
-** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. 
-** See the License for the specific language governing permissions and 
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
 ** limitations under the License.
 */
 
@@ -20,25 +20,29 @@
 #include <assert.h>
 #include <errno.h>
 #include <cutils/record_stream.h>
+#include <cutils/uio.h>
 #include <string.h>
 #include <stdint.h>
-#ifdef HAVE_WINSOCK
-#include <winsock2.h>   /* for ntohl */
-#else
-#include <netinet/in.h>
-#endif
 
 #define HEADER_SIZE 4
 
+/* The buffer is a ring: consuming a record just advances the head, so
+** a batch of small records costs no shifting at all, and a refill
+** gathers into the free space on both sides of the wrap with a single
+** readv. The rare record which straddles the wrap point is copied into
+** a bounce buffer so callers always see contiguous bytes. Head and
+** tail are absolute byte counts; the ring index is position & mask.
+*/
 struct RecordStream {
     int fd;
     size_t maxRecordLen;
 
     unsigned char *buffer;
+    size_t capacity;        /* power of 2, holds at least two records */
+    size_t head;            /* next unconsumed byte */
+    size_t tail;            /* end of valid data */
 
-    unsigned char *unconsumed;
-    unsigned char *read_end;
-    unsigned char *buffer_end;
+    unsigned char *bounce;  /* for records straddling the wrap */
 };
 
 
@@ -52,11 +56,17 @@ extern RecordStream *record_stream_new(int fd, size_t maxRecordLen)
 
     ret->fd = fd;
     ret->maxRecordLen = maxRecordLen;
-    ret->buffer = (unsigned char *)malloc (maxRecordLen + HEADER_SIZE);
-    
-    ret->unconsumed = ret->buffer;
-    ret->read_end = ret->buffer;
-    ret->buffer_end = ret->buffer + maxRecordLen + HEADER_SIZE;
+
+    ret->capacity = 1;
+    while (ret->capacity < 2 * (maxRecordLen + HEADER_SIZE)) {
+        ret->capacity <<= 1;
+    }
+
+    ret->buffer = (unsigned char *)malloc (ret->capacity);
+    ret->bounce = (unsigned char *)malloc (maxRecordLen);
+
+    ret->head = 0;
+    ret->tail = 0;
 
     return ret;
 }
@@ -64,53 +74,117 @@ extern RecordStream *record_stream_new(int fd, size_t maxRecordLen)
 
 extern void record_stream_free(RecordStream *rs)
 {
+    free(rs->bounce);
     free(rs->buffer);
     free(rs);
 }
 
 
-/* returns NULL; if there isn't a full record in the buffer */
-static unsigned char * getEndOfRecord (unsigned char *p_begin,
-                                            unsigned char *p_end)
+/**
+ * Refills the buffer with a single (vectored) read from the stream fd.
+ * Does no parsing; use record_stream_next to consume whatever arrived.
+ *
+ * Returns the count read on success
+ * Returns 0 on end of stream
+ * Returns -1 / errno on error; ENOBUFS means the buffer is already full
+ */
+extern ssize_t record_stream_fill (RecordStream *p_rs)
 {
-    size_t len;
-    unsigned char * p_ret;
+    struct iovec iov[2];
+    int iovCount;
+    size_t freeSpace, tailIndex, chunk;
+    ssize_t countRead;
+
+    freeSpace = p_rs->capacity - (p_rs->tail - p_rs->head);
 
-    if (p_end < p_begin + HEADER_SIZE) {
-        return NULL;
+    if (freeSpace == 0) {
+        /* the caller kept filling without consuming */
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    tailIndex = p_rs->tail & (p_rs->capacity - 1);
+    chunk = p_rs->capacity - tailIndex;
+    if (chunk > freeSpace) {
+        chunk = freeSpace;
     }
 
-    //First four bytes are length
-    len = ntohl(*((uint32_t *)p_begin));
+    iov[0].iov_base = p_rs->buffer + tailIndex;
+    iov[0].iov_len = chunk;
+    iovCount = 1;
+
+    if (chunk < freeSpace) {
+        /* the free space wraps; gather into both pieces at once */
+        iov[1].iov_base = p_rs->buffer;
+        iov[1].iov_len = freeSpace - chunk;
+        iovCount = 2;
+    }
 
-    p_ret = p_begin + HEADER_SIZE + len;
+    countRead = readv (p_rs->fd, iov, iovCount);
 
-    if (p_end < p_ret) {
-        return NULL;
+    if (countRead > 0) {
+        p_rs->tail += countRead;
     }
 
-    return p_ret;
+    return countRead;
 }
 
-static void *getNextRecord (RecordStream *p_rs, size_t *p_outRecordLen)
+
+/**
+ * Consumes the next complete record already in the buffer, without
+ * reading from the fd. The record stays valid until the next call that
+ * returns a record or refills the buffer.
+ *
+ * Returns 1 with *p_outRecord set on success
+ * Returns 0 if there is no complete record buffered
+ * Returns -1 / errno = EFBIG if the next record exceeds maxRecordLen
+ */
+extern int record_stream_next (RecordStream *p_rs, void ** p_outRecord,
+                                    size_t *p_outRecordLen)
 {
-    unsigned char *record_start, *record_end;
+    size_t mask = p_rs->capacity - 1;
+    size_t avail = p_rs->tail - p_rs->head;
+    size_t len, start, i;
+    uint32_t header;
 
-    record_end = getEndOfRecord (p_rs->unconsumed, p_rs->read_end);
+    if (avail < HEADER_SIZE) {
+        return 0;
+    }
+
+    /* first four bytes are a big-endian length; they may wrap */
+    header = 0;
+    for (i = 0; i < HEADER_SIZE; i++) {
+        header = (header << 8) | p_rs->buffer[(p_rs->head + i) & mask];
+    }
+    len = header;
 
-    if (record_end != NULL) {
-        /* one full line in the buffer */
-        record_start = p_rs->unconsumed + HEADER_SIZE;
-        p_rs->unconsumed = record_end;
+    if (len > p_rs->maxRecordLen) {
+        errno = EFBIG;
+        return -1;
+    }
 
-        *p_outRecordLen = record_end - record_start;
+    if (avail < HEADER_SIZE + len) {
+        return 0;
+    }
 
-        return record_start;
+    start = (p_rs->head + HEADER_SIZE) & mask;
+    p_rs->head += HEADER_SIZE + len;
+
+    if (start + len <= p_rs->capacity) {
+        *p_outRecord = p_rs->buffer + start;
+    } else {
+        /* the record straddles the wrap; make it contiguous */
+        size_t first = p_rs->capacity - start;
+        memcpy (p_rs->bounce, p_rs->buffer + start, first);
+        memcpy (p_rs->bounce + first, p_rs->buffer, len - first);
+        *p_outRecord = p_rs->bounce;
     }
 
-    return NULL;
+    *p_outRecordLen = len;
+    return 1;
 }
 
+
 /**
  * Reads the next record from stream fd
  * Records are prefixed by a 16-bit big endian length value
@@ -124,46 +198,29 @@ static void *getNextRecord (RecordStream *p_rs, size_t *p_outRecordLen)
  * Returns 0 with *p_outRecord set to NULL on end of stream
  * Returns -1 / errno = EAGAIN if it needs to read again
  */
-int record_stream_get_next (RecordStream *p_rs, void ** p_outRecord, 
+int record_stream_get_next (RecordStream *p_rs, void ** p_outRecord,
                                     size_t *p_outRecordLen)
 {
-    void *ret;
+    int haveRecord;
 
     ssize_t countRead;
 
     /* is there one record already in the buffer? */
-    ret = getNextRecord (p_rs, p_outRecordLen);
+    haveRecord = record_stream_next (p_rs, p_outRecord, p_outRecordLen);
 
-    if (ret != NULL) {
-        *p_outRecord = ret;
+    if (haveRecord > 0) {
         return 0;
     }
 
-    // if the buffer is full and we don't have a full record
-    if (p_rs->unconsumed == p_rs->buffer 
-        && p_rs->read_end == p_rs->buffer_end
-    ) {
-        // this should never happen
+    if (haveRecord < 0) {
+        // a record larger than maxRecordLen: this should never happen
         //LOGE("max record length exceeded\n");
         assert (0);
         errno = EFBIG;
         return -1;
     }
 
-    if (p_rs->unconsumed != p_rs->buffer) {
-        // move remainder to the beginning of the buffer
-        size_t toMove;
-
-        toMove = p_rs->read_end - p_rs->unconsumed;
-        if (toMove) {
-            memmove(p_rs->buffer, p_rs->unconsumed, toMove);
-        }
-
-        p_rs->read_end = p_rs->buffer + toMove;
-        p_rs->unconsumed = p_rs->buffer;
-    }
-
-    countRead = read (p_rs->fd, p_rs->read_end, p_rs->buffer_end - p_rs->read_end);
+    countRead = record_stream_fill (p_rs);
 
     if (countRead <= 0) {
         /* note: end-of-stream drops through here too */
@@ -171,16 +228,19 @@ int record_stream_get_next (RecordStream *p_rs, void ** p_outRecord,
         return countRead;
     }
 
-    p_rs->read_end += countRead;
+    haveRecord = record_stream_next (p_rs, p_outRecord, p_outRecordLen);
 
-    ret = getNextRecord (p_rs, p_outRecordLen);
+    if (haveRecord < 0) {
+        assert (0);
+        errno = EFBIG;
+        return -1;
+    }
 
-    if (ret == NULL) {
+    if (haveRecord == 0) {
         /* not enough of a buffer to for a whole command */
         errno = EAGAIN;
         return -1;
     }
 
-    *p_outRecord = ret;        
     return 0;
 }
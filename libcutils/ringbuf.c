@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/ringbuf.h>
+#include <cutils/atomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Each slot carries a sequence counter next to its value. A slot is
+ * writable at position p when its counter reads p, and readable when
+ * it reads p + 1; the consumer hands a slot back to the producers by
+ * advancing its counter a full lap to p + capacity. Producers claim
+ * positions by compare-and-swap on the shared tail, so claiming never
+ * takes a lock, and publish each slot independently by storing its
+ * counter. The consumer owns the head outright. Position arithmetic
+ * wraps mod 2^32, which is harmless because slots are matched by
+ * equality and capacities stay far below 2^31.
+ *
+ * Head, tail and the slot array live on separate cache lines so
+ * producers hammering the tail do not steal the consumer's line.
+ */
+
+#define RINGBUF_CACHE_LINE 32
+
+typedef struct {
+    volatile int32_t seq;
+    void* value;
+} RingSlot;
+
+struct RingBuffer {
+    size_t capacity;            // power of 2
+    RingSlot* slots;
+    int wakeFds[2];             // pipe: consumer polls [0], producers write [1]
+    char pad0[RINGBUF_CACHE_LINE];
+    volatile int32_t tail;      // next position producers claim
+    char pad1[RINGBUF_CACHE_LINE - sizeof(int32_t)];
+    volatile int32_t head;      // next position the consumer reads
+    volatile int32_t waiting;   // consumer armed its wakeup
+};
+
+RingBuffer* ringbufCreate(size_t capacity) {
+    RingBuffer* buffer = calloc(1, sizeof(RingBuffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    buffer->capacity = 2;
+    while (buffer->capacity < capacity) {
+        buffer->capacity <<= 1;
+    }
+
+    buffer->slots = malloc(buffer->capacity * sizeof(RingSlot));
+    if (buffer->slots == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    size_t i;
+    for (i = 0; i < buffer->capacity; i++) {
+        // Slot i is first writable at position i.
+        buffer->slots[i].seq = i;
+    }
+
+    if (pipe(buffer->wakeFds) == -1) {
+        free(buffer->slots);
+        free(buffer);
+        return NULL;
+    }
+    fcntl(buffer->wakeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(buffer->wakeFds[1], F_SETFL, O_NONBLOCK);
+
+    return buffer;
+}
+
+void ringbufFree(RingBuffer* buffer) {
+    close(buffer->wakeFds[0]);
+    close(buffer->wakeFds[1]);
+    free(buffer->slots);
+    free(buffer);
+}
+
+size_t ringbufCapacity(RingBuffer* buffer) {
+    return buffer->capacity;
+}
+
+/**
+ * Pokes the consumer if it armed the wakeup. The swap makes sure only
+ * one producer pays for the write.
+ */
+static void ringbufWakeConsumer(RingBuffer* buffer) {
+    if (buffer->waiting != 0 && android_atomic_swap(0, &buffer->waiting)) {
+        char one = 1;
+        write(buffer->wakeFds[1], &one, sizeof(one));
+    }
+}
+
+size_t ringbufPutMany(RingBuffer* buffer, void** values, size_t count) {
+    RingSlot* slots = buffer->slots;
+    size_t mask = buffer->capacity - 1;
+    uint32_t pos;
+    size_t n;
+    for (;;) {
+        pos = (uint32_t) buffer->tail;
+        // Find how many contiguous free slots start at pos. The
+        // consumer frees slots in order, so a free slot means every
+        // slot before it is free too.
+        n = count < buffer->capacity ? count : buffer->capacity;
+        while (n > 0) {
+            uint32_t last = pos + n - 1;
+            if (slots[last & mask].seq == (int32_t) last) {
+                break;
+            }
+            n--;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (android_atomic_cmpxchg((int32_t) pos, (int32_t)(pos + n),
+                &buffer->tail) == 0) {
+            break;
+        }
+        // Another producer moved the tail; start over.
+    }
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        RingSlot* slot = &slots[(pos + i) & mask];
+        slot->value = values[i];
+        // The value is in place before this store publishes the slot.
+        android_atomic_write((int32_t)(pos + i + 1), &slot->seq);
+    }
+    ringbufWakeConsumer(buffer);
+    return n;
+}
+
+bool ringbufPut(RingBuffer* buffer, void* value) {
+    return ringbufPutMany(buffer, &value, 1) == 1;
+}
+
+size_t ringbufGetMany(RingBuffer* buffer, void** values, size_t count) {
+    RingSlot* slots = buffer->slots;
+    size_t mask = buffer->capacity - 1;
+    uint32_t pos = (uint32_t) buffer->head;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        RingSlot* slot = &slots[pos & mask];
+        // The barrier in the atomic read keeps the value load below it.
+        if (android_atomic_or(0, &slot->seq) != (int32_t)(pos + 1)) {
+            break;
+        }
+        values[i] = slot->value;
+        // Hand the slot back to the producers, a lap ahead.
+        android_atomic_write((int32_t)(pos + buffer->capacity), &slot->seq);
+        pos++;
+    }
+    buffer->head = (int32_t) pos;
+    return i;
+}
+
+bool ringbufGet(RingBuffer* buffer, void** value) {
+    return ringbufGetMany(buffer, value, 1) == 1;
+}
+
+int ringbufWakeFd(RingBuffer* buffer) {
+    return buffer->wakeFds[0];
+}
+
+/**
+ * True if the slot at the head is readable.
+ */
+static bool ringbufReady(RingBuffer* buffer) {
+    uint32_t pos = (uint32_t) buffer->head;
+    RingSlot* slot = &buffer->slots[pos & (buffer->capacity - 1)];
+    return android_atomic_or(0, &slot->seq) == (int32_t)(pos + 1);
+}
+
+bool ringbufBeginWait(RingBuffer* buffer) {
+    android_atomic_write(1, &buffer->waiting);
+    if (ringbufReady(buffer)) {
+        // A producer may have taken the flag and written a byte
+        // already; ringbufEndWait() drains any leftovers either way.
+        android_atomic_swap(0, &buffer->waiting);
+        return true;
+    }
+    return false;
+}
+
+void ringbufEndWait(RingBuffer* buffer) {
+    char drain[16];
+    while (read(buffer->wakeFds[0], drain, sizeof(drain)) == sizeof(drain)) {
+    }
+}
+
+void ringbufWait(RingBuffer* buffer) {
+    while (!ringbufBeginWait(buffer)) {
+        struct pollfd waker;
+        waker.fd = buffer->wakeFds[0];
+        waker.events = POLLIN;
+        waker.revents = 0;
+        poll(&waker, 1, -1);
+        ringbufEndWait(buffer);
+    }
+}
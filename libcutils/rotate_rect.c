@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/memory.h>
+
+#include <stdint.h>
+
+/*
+ * a quarter turn makes one of the two streams walk columns.  done
+ * naively every access on that side misses the cache once the surface
+ * is larger than it.  working in square tiles keeps both footprints
+ * inside L1 (a 32x32 tile of 16-bit pixels is 32 lines of 64 bytes),
+ * so each cache line is loaded once and written once no matter how
+ * big the surface is.
+ *
+ * the paired 16-bit stores assume little-endian layout, like the rest
+ * of the pixel code.
+ */
+#define ROT_TILE 32
+
+static void rotate16_quarter(uint16_t* dst, size_t dstride,
+        const uint16_t* src, size_t sstride,
+        size_t w, size_t h, int cw)
+{
+    size_t xb, yb, x, y;
+
+    for (yb = 0; yb < h; yb += ROT_TILE) {
+        size_t ylim = (h - yb < ROT_TILE) ? h : yb + ROT_TILE;
+        for (xb = 0; xb < w; xb += ROT_TILE) {
+            size_t xlim = (w - xb < ROT_TILE) ? w : xb + ROT_TILE;
+            for (x = xb; x < xlim; x++) {
+                const uint16_t* s = src + yb * sstride + x;
+                uint16_t* d;
+                if (cw) {
+                    /* (x, y) -> (h-1-y, x) */
+                    d = dst + x * dstride + (h - 1 - yb);
+                    y = yb;
+                    /* vertically adjacent source pixels land next to
+                     * each other in the destination row: pack pairs
+                     * into single 32-bit stores when aligned */
+                    if (((uintptr_t)d & 2) == 0 && y + 1 < ylim) {
+                        *d-- = *s;
+                        s += sstride;
+                        y++;
+                    }
+                    for (; y + 1 < ylim; y += 2) {
+                        uint32_t lo = s[sstride];
+                        uint32_t hi = *s;
+                        *(uint32_t*)(d - 1) = lo | (hi << 16);
+                        d -= 2;
+                        s += 2 * sstride;
+                    }
+                    for (; y < ylim; y++) {
+                        *d-- = *s;
+                        s += sstride;
+                    }
+                } else {
+                    /* (x, y) -> (y, w-1-x) */
+                    d = dst + (w - 1 - x) * dstride + yb;
+                    y = yb;
+                    if (((uintptr_t)d & 2) != 0) {
+                        *d++ = *s;
+                        s += sstride;
+                        y++;
+                    }
+                    for (; y + 1 < ylim; y += 2) {
+                        uint32_t lo = *s;
+                        uint32_t hi = s[sstride];
+                        *(uint32_t*)d = lo | (hi << 16);
+                        d += 2;
+                        s += 2 * sstride;
+                    }
+                    for (; y < ylim; y++) {
+                        *d++ = *s;
+                        s += sstride;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void rotate16_half(uint16_t* dst, size_t dstride,
+        const uint16_t* src, size_t sstride, size_t w, size_t h)
+{
+    size_t x, y;
+
+    /* both streams stay row order, one of them reversed; read pairs
+     * and store them swapped */
+    for (y = 0; y < h; y++) {
+        const uint16_t* s = src + y * sstride;
+        uint16_t* d = dst + (h - 1 - y) * dstride + w;
+        x = 0;
+        if (((uintptr_t)d & 2) != 0 && x < w) {
+            *--d = *s++;
+            x++;
+        }
+        for (; x + 1 < w; x += 2) {
+            uint32_t lo = s[1];
+            uint32_t hi = s[0];
+            d -= 2;
+            *(uint32_t*)d = lo | (hi << 16);
+            s += 2;
+        }
+        for (; x < w; x++)
+            *--d = *s++;
+    }
+}
+
+void android_rotate_rect16(uint16_t* dst, size_t dstStride,
+        const uint16_t* src, size_t srcStride,
+        size_t width, size_t height, int turns)
+{
+    if (width == 0 || height == 0)
+        return;
+
+    switch (turns & 3) {
+    case 0:
+        android_memcpy_rect(dst, dstStride * 2,
+                src, srcStride * 2, width * 2, height);
+        break;
+    case 1:
+        rotate16_quarter(dst, dstStride, src, srcStride,
+                width, height, 1);
+        break;
+    case 2:
+        rotate16_half(dst, dstStride, src, srcStride, width, height);
+        break;
+    case 3:
+        rotate16_quarter(dst, dstStride, src, srcStride,
+                width, height, 0);
+        break;
+    }
+}
+
+void android_rotate_rect32(uint32_t* dst, size_t dstStride,
+        const uint32_t* src, size_t srcStride,
+        size_t width, size_t height, int turns)
+{
+    size_t xb, yb, x, y;
+
+    if (width == 0 || height == 0)
+        return;
+
+    switch (turns & 3) {
+    case 0:
+        android_memcpy_rect(dst, dstStride * 4,
+                src, srcStride * 4, width * 4, height);
+        break;
+    case 1:
+    case 3:
+        for (yb = 0; yb < height; yb += ROT_TILE) {
+            size_t ylim = (height - yb < ROT_TILE) ? height : yb + ROT_TILE;
+            for (xb = 0; xb < width; xb += ROT_TILE) {
+                size_t xlim = (width - xb < ROT_TILE) ? width : xb + ROT_TILE;
+                for (x = xb; x < xlim; x++) {
+                    const uint32_t* s = src + yb * srcStride + x;
+                    if ((turns & 3) == 1) {
+                        uint32_t* d = dst + x * dstStride + (height - 1 - yb);
+                        for (y = yb; y < ylim; y++) {
+                            *d-- = *s;
+                            s += srcStride;
+                        }
+                    } else {
+                        uint32_t* d = dst + (width - 1 - x) * dstStride + yb;
+                        for (y = yb; y < ylim; y++) {
+                            *d++ = *s;
+                            s += srcStride;
+                        }
+                    }
+                }
+            }
+        }
+        break;
+    case 2:
+        for (y = 0; y < height; y++) {
+            const uint32_t* s = src + y * srcStride;
+            uint32_t* d = dst + (height - 1 - y) * dstStride + width;
+            for (x = 0; x < width; x++)
+                *--d = *s++;
+        }
+        break;
+    }
+}
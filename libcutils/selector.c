@@ -18,7 +18,9 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -29,26 +31,46 @@
 
 #include "loghack.h"
 
+#if defined(__linux__)
+/* On linux the loop runs on epoll: interest is registered with the
+ * kernel once and re-registered only when a descriptor's callback set
+ * changes, and each wakeup hands back just the ready descriptors, so a
+ * service with many idle connections no longer pays for all of them on
+ * every event. Other platforms keep the select() implementation below.
+ */
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+
+/** Max events handed back by one epoll_wait() call. */
+#define MAX_EVENTS 64
+#endif
+
 struct Selector {
     Array* selectableFds;
     bool looping;
+#ifdef USE_EPOLL
+    int epollFd;
+    struct epoll_event readyEvents[MAX_EVENTS];
+    int readyCount;
+#else
     fd_set readFds;
     fd_set writeFds;
     fd_set exceptFds;
     int maxFd;
+#endif
     int wakeupPipe[2];
     SelectableFd* wakeupFd;
 
     bool inSelect;
-    pthread_mutex_t inSelectLock; 
+    pthread_mutex_t inSelectLock;
 };
 
-/** Reads and ignores wake up data. */ 
+/** Reads and ignores wake up data. */
 static void eatWakeupData(SelectableFd* wakeupFd) {
     static char garbage[64];
     if (read(wakeupFd->fd, garbage, sizeof(garbage)) < 0) {
         if (errno == EINTR) {
-            LOGI("read() interrupted.");    
+            LOGI("read() interrupted.");
         } else {
             LOG_ALWAYS_FATAL("This should never happen: %s", strerror(errno));
         }
@@ -73,11 +95,11 @@ void selectorWakeUp(Selector* selector) {
         // We only need to write wake-up data if we're blocked in select().
         return;
     }
-    
+
     static char garbage[1];
     if (write(selector->wakeupPipe[1], garbage, sizeof(garbage)) < 0) {
         if (errno == EINTR) {
-            LOGI("read() interrupted.");    
+            LOGI("read() interrupted.");
         } else {
             LOG_ALWAYS_FATAL("This should never happen: %s", strerror(errno));
         }
@@ -90,20 +112,29 @@ Selector* selectorCreate(void) {
         LOG_ALWAYS_FATAL("malloc() error.");
     }
     selector->selectableFds = arrayCreate();
-    
+
+#ifdef USE_EPOLL
+    // The size hint is ignored by modern kernels but must be positive.
+    selector->epollFd = epoll_create(256);
+    if (selector->epollFd < 0) {
+        LOG_ALWAYS_FATAL("epoll_create() error: %s", strerror(errno));
+    }
+    fcntl(selector->epollFd, F_SETFD, FD_CLOEXEC);
+#endif
+
     // Set up wake-up pipe.
     if (pipe(selector->wakeupPipe) < 0) {
         LOG_ALWAYS_FATAL("pipe() error: %s", strerror(errno));
     }
-    
+
     LOGD("Wakeup fd: %d", selector->wakeupPipe[0]);
-    
+
     SelectableFd* wakeupFd = selectorAdd(selector, selector->wakeupPipe[0]);
     if (wakeupFd == NULL) {
         LOG_ALWAYS_FATAL("malloc() error.");
     }
-    wakeupFd->onReadable = &eatWakeupData; 
-    
+    wakeupFd->onReadable = &eatWakeupData;
+
     pthread_mutex_init(&selector->inSelectLock, NULL);
 
     return selector;
@@ -116,13 +147,66 @@ SelectableFd* selectorAdd(Selector* selector, int fd) {
     if (selectableFd != NULL) {
         selectableFd->selector = selector;
         selectableFd->fd = fd;
-    
+
         arrayAdd(selector->selectableFds, selectableFd);
     }
 
     return selectableFd;
 }
 
+#ifdef USE_EPOLL
+
+/** Computes the event mask a descriptor's callbacks currently ask for. */
+static uint32_t interestEvents(SelectableFd* selectableFd) {
+    uint32_t events = 0;
+    if (selectableFd->onReadable != NULL) {
+        events |= EPOLLIN;
+    }
+    if (selectableFd->onWritable != NULL) {
+        events |= EPOLLOUT;
+    }
+    if (selectableFd->onExcept != NULL) {
+        events |= EPOLLPRI;
+    }
+    return events;
+}
+
+/**
+ * Syncs the kernel's interest in a descriptor with its callbacks,
+ * issuing an epoll_ctl() only when the mask actually changed.
+ */
+static void updateInterest(Selector* selector, SelectableFd* selectableFd) {
+    uint32_t events = interestEvents(selectableFd);
+    if (events == (uint32_t) selectableFd->installedEvents) {
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = selectableFd;
+
+    int op = selectableFd->installedEvents == 0 ? EPOLL_CTL_ADD
+            : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (epoll_ctl(selector->epollFd, op, selectableFd->fd, &event) < 0) {
+        LOG_ALWAYS_FATAL("epoll_ctl() error: %s", strerror(errno));
+    }
+    selectableFd->installedEvents = (int) events;
+}
+
+/** Drops a descriptor from the epoll set before it's removed and freed. */
+static void dropInterest(Selector* selector, SelectableFd* selectableFd) {
+    if (selectableFd->installedEvents != 0) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        // Best effort: the caller may have closed the fd already, which
+        // removes it from the epoll set on its own.
+        epoll_ctl(selector->epollFd, EPOLL_CTL_DEL, selectableFd->fd, &event);
+    }
+}
+
+#else
+
 /**
  * Adds an fd to the given set if the callback is non-null. Returns true
  * if the fd was added.
@@ -136,21 +220,26 @@ static inline bool maybeAdd(SelectableFd* selectableFd,
     return false;
 }
 
+#endif
+
 /**
- * Removes stale file descriptors and initializes file descriptor sets.
+ * Removes stale file descriptors and registers the remaining descriptors
+ * for the events their callbacks ask for.
  */
 static void prepareForSelect(Selector* selector) {
+#ifndef USE_EPOLL
     fd_set* exceptFds = &selector->exceptFds;
     fd_set* readFds = &selector->readFds;
     fd_set* writeFds = &selector->writeFds;
-    
+
     FD_ZERO(exceptFds);
     FD_ZERO(readFds);
     FD_ZERO(writeFds);
+    selector->maxFd = 0;
+#endif
 
     Array* selectableFds = selector->selectableFds;
     int i = 0;
-    selector->maxFd = 0;
     int size = arraySize(selectableFds);
     while (i < size) {
         SelectableFd* selectableFd = arrayGet(selectableFds, i);
@@ -158,6 +247,9 @@ static void prepareForSelect(Selector* selector) {
             // This descriptor should be removed.
             arrayRemove(selectableFds, i);
             size--;
+#ifdef USE_EPOLL
+            dropInterest(selector, selectableFd);
+#endif
             if (selectableFd->onRemove != NULL) {
                 selectableFd->onRemove(selectableFd);
             }
@@ -166,7 +258,10 @@ static void prepareForSelect(Selector* selector) {
             if (selectableFd->beforeSelect != NULL) {
                 selectableFd->beforeSelect(selectableFd);
             }
-            
+
+#ifdef USE_EPOLL
+            updateInterest(selector, selectableFd);
+#else
             bool inSet = false;
             if (maybeAdd(selectableFd, selectableFd->onExcept, exceptFds)) {
             	LOGD("Selecting fd %d for writing...", selectableFd->fd);
@@ -187,20 +282,64 @@ static void prepareForSelect(Selector* selector) {
                     selector->maxFd = fd;
                 }
             }
-            
+#endif
+
             // Move to next descriptor.
             i++;
         }
     }
 }
 
+#ifdef USE_EPOLL
+
+/**
+ * Invokes a callback if the callback is non-null and the descriptor
+ * hasn't been flagged for removal by an earlier callback.
+ */
+static inline void maybeInvoke(SelectableFd* selectableFd,
+        void (*callback)(SelectableFd*)) {
+    if (callback != NULL && !selectableFd->remove) {
+        LOGD("Selected fd %d.", selectableFd->fd);
+        callback(selectableFd);
+    }
+}
+
+/**
+ * Notifies user of the descriptors epoll reported ready. The
+ * SelectableFds are guaranteed to stay allocated until the next
+ * prepareForSelect(), so the stashed pointers are safe to chase even
+ * after a callback flags some of them for removal.
+ */
+static void fireEvents(Selector* selector) {
+    int i;
+    for (i = 0; i < selector->readyCount; i++) {
+        struct epoll_event* event = &selector->readyEvents[i];
+        SelectableFd* selectableFd = event->data.ptr;
+
+        if (event->events & EPOLLPRI) {
+            maybeInvoke(selectableFd, selectableFd->onExcept);
+        }
+        // Errors and hang-ups are reported as readable/writable, the
+        // same way select() reports them, so the callbacks observe the
+        // condition from read() or write() as they always have.
+        if (event->events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            maybeInvoke(selectableFd, selectableFd->onReadable);
+        }
+        if (event->events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            maybeInvoke(selectableFd, selectableFd->onWritable);
+        }
+    }
+}
+
+#else
+
 /**
  * Invokes a callback if the callback is non-null and the fd is in the given
  * set.
  */
 static inline void maybeInvoke(SelectableFd* selectableFd,
         void (*callback)(SelectableFd*), fd_set* fdSet) {
-	if (callback != NULL && !selectableFd->remove && 
+	if (callback != NULL && !selectableFd->remove &&
             FD_ISSET(selectableFd->fd, fdSet)) {
 		LOGD("Selected fd %d.", selectableFd->fd);
         callback(selectableFd);
@@ -226,37 +365,47 @@ static void fireEvents(Selector* selector) {
     }
 }
 
+#endif
+
 void selectorLoop(Selector* selector) {
     // Make sure we're not already looping.
     if (selector->looping) {
         LOG_ALWAYS_FATAL("Already looping.");
     }
     selector->looping = true;
-    
+
     while (true) {
         setInSelect(selector, true);
-        
+
         prepareForSelect(selector);
 
         LOGD("Entering select().");
-        
+
+#ifdef USE_EPOLL
+        int result = epoll_wait(selector->epollFd, selector->readyEvents,
+                MAX_EVENTS, -1);
+#else
         // Select file descriptors.
-        int result = select(selector->maxFd + 1, &selector->readFds, 
+        int result = select(selector->maxFd + 1, &selector->readFds,
                 &selector->writeFds, &selector->exceptFds, NULL);
-        
+#endif
+
         LOGD("Exiting select().");
-        
+
         setInSelect(selector, false);
-        
+
         if (result == -1) {
             // Abort on everything except EINTR.
             if (errno == EINTR) {
-                LOGI("select() interrupted.");    
+                LOGI("select() interrupted.");
             } else {
-                LOG_ALWAYS_FATAL("select() error: %s", 
+                LOG_ALWAYS_FATAL("select() error: %s",
                         strerror(errno));
             }
         } else if (result > 0) {
+#ifdef USE_EPOLL
+            selector->readyCount = result;
+#endif
             fireEvents(selector);
         }
     }
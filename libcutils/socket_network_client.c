@@ -27,8 +27,11 @@
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
+#include <fcntl.h>
 #endif
 
 
@@ -63,3 +66,183 @@ int socket_network_client(const char *host, int port, int type)
 
 }
 
+/* Apply the standard transport options: no nagle on stream sockets
+ * (command/response traffic suffers badly from delayed acks) and
+ * larger socket buffers so bulk transfers aren't window-limited.
+ * Best effort; returns -1 only if the socket is unusable.
+ */
+int socket_set_transport_options(int s, int type)
+{
+    int one = 1;
+    int bufsize = 256 * 1024;
+
+    if (s < 0) return -1;
+
+    if (type == SOCK_STREAM) {
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    setsockopt(s, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    return 0;
+}
+
+static int set_nonblocking(int s, int on)
+{
+    int flags = fcntl(s, F_GETFL, 0);
+    if (flags < 0) return -1;
+    if (on)
+        flags |= O_NONBLOCK;
+    else
+        flags &= ~O_NONBLOCK;
+    return fcntl(s, F_SETFL, flags);
+}
+
+static long long now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return ((long long) tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+/* Start one more non-blocking connect attempt.  Returns the fd (still
+ * connecting, or already connected), or -1.
+ */
+static int start_attempt(struct hostent *hp, int which, int port, int type)
+{
+    struct sockaddr_in addr;
+    int s;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = hp->h_addrtype;
+    addr.sin_port = htons(port);
+    memcpy(&addr.sin_addr, hp->h_addr_list[which], hp->h_length);
+
+    s = socket(hp->h_addrtype, type, 0);
+    if (s < 0) return -1;
+    if (set_nonblocking(s, 1) < 0) {
+        close(s);
+        return -1;
+    }
+    if (connect(s, (struct sockaddr *) &addr, sizeof(addr)) < 0
+            && errno != EINPROGRESS) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/* How long a connect attempt gets a head start before the next
+ * resolved address is also tried in parallel.
+ */
+#define CONNECT_STAGGER_MS 250
+
+#define MAX_ATTEMPTS 8
+
+/* Like socket_network_client, but gives up after timeout_ms instead of
+ * hanging for the kernel default on a dead host.  When the name
+ * resolves to several addresses they are raced: each attempt gets a
+ * short head start, then the next address is tried in parallel, and
+ * the first to connect wins.  Name resolution itself is still
+ * synchronous (there is no resolver with a deadline down here); the
+ * timeout governs the connect phase.
+ * Returns a blocking file descriptor or -1 on error.
+ */
+int socket_network_client_timeout(const char *host, int port, int type,
+        int timeout_ms)
+{
+    struct hostent *hp;
+    int pending[MAX_ATTEMPTS];
+    int npending = 0;
+    int naddr, next, i, n, s;
+    int last_err = 0;
+    long long deadline, stagger, wait;
+    fd_set wfds;
+    struct timeval tv;
+
+    hp = gethostbyname(host);
+    if (hp == 0) return -1;
+
+    for (naddr = 0; hp->h_addr_list[naddr]; naddr++)
+        ;
+    if (naddr == 0) return -1;
+
+    /* connect on a datagram socket just records the peer; no need for
+     * any of the machinery below */
+    if (type != SOCK_STREAM) {
+        return socket_network_client(host, port, type);
+    }
+
+    deadline = now_ms() + timeout_ms;
+    stagger = 0;   /* start the first attempt immediately */
+    next = 0;
+
+    for (;;) {
+        long long now = now_ms();
+
+        if (now >= deadline) break;
+
+        /* time to put another address in the race? */
+        if (next < naddr && npending < MAX_ATTEMPTS
+                && (npending == 0 || now >= stagger)) {
+            s = start_attempt(hp, next++, port, type);
+            if (s >= 0) {
+                pending[npending++] = s;
+            } else {
+                last_err = errno;
+            }
+            stagger = now_ms() + CONNECT_STAGGER_MS;
+            continue;
+        }
+        if (npending == 0) break;   /* nothing in flight, nothing left */
+
+        FD_ZERO(&wfds);
+        n = 0;
+        for (i = 0; i < npending; i++) {
+            FD_SET(pending[i], &wfds);
+            if (pending[i] >= n) n = pending[i] + 1;
+        }
+        wait = deadline - now;
+        if (next < naddr && stagger - now < wait) wait = stagger - now;
+        if (wait < 0) wait = 0;
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+
+        n = select(n, 0, &wfds, 0, &tv);
+        if (n < 0 && errno != EINTR) break;
+        if (n <= 0) continue;
+
+        for (i = 0; i < npending; i++) {
+            int err = 0;
+            socklen_t errlen = sizeof(err);
+
+            if (!FD_ISSET(pending[i], &wfds)) continue;
+            if (getsockopt(pending[i], SOL_SOCKET, SO_ERROR,
+                           &err, &errlen) == 0 && err == 0) {
+                /* winner: everybody else goes home */
+                s = pending[i];
+                for (n = 0; n < npending; n++) {
+                    if (pending[n] != s) close(pending[n]);
+                }
+                if (set_nonblocking(s, 0) < 0) {
+                    close(s);
+                    return -1;
+                }
+                return s;
+            }
+            /* this attempt failed; drop it and let the loop start the
+             * next address right away */
+            if (err != 0) last_err = err;
+            close(pending[i]);
+            pending[i] = pending[--npending];
+            stagger = 0;
+            i--;
+        }
+    }
+
+    for (i = 0; i < npending; i++) {
+        close(pending[i]);
+    }
+    errno = last_err ? last_err : ETIMEDOUT;
+    return -1;
+}
+
@@ -20,6 +20,25 @@
 #include <stdlib.h>
 
 
+/*
+ * Most strings crossing these converters are pure ASCII, so both the
+ * length and the copy loop test four UTF-16 code units at a time with
+ * one 64-bit word each: a unit needs multi-byte encoding iff it has a
+ * bit set in 0xff80, and a zero unit must be excluded too because it
+ * encodes as the two-byte "0xc0 0x80" pair.  Only when a word fails
+ * the test do we fall back to the per-unit path.
+ */
+#define UTF16_WORD_UNITS   (sizeof(uint64_t) / sizeof(char16_t))
+
+static inline int utf16_word_is_ascii(uint64_t word)
+{
+    if (word & 0xff80ff80ff80ff80ULL)
+        return 0;
+    /* any 16-bit lane zero? */
+    return !((word - 0x0001000100010001ULL) & ~word & 0x8000800080008000ULL);
+}
+
+
 /**
  * Given a UTF-16 string, compute the length of the corresponding UTF-8
  * string in bytes.
@@ -28,8 +47,20 @@ extern size_t strnlen16to8(const char16_t* utf16Str, size_t len)
 {
    size_t utf8Len = 0;
 
-   while (len--) {
-       unsigned int uic = *utf16Str++;
+   while (len) {
+       unsigned int uic;
+
+       while (len >= UTF16_WORD_UNITS && ((uintptr_t)utf16Str & 7) == 0
+               && utf16_word_is_ascii(*(const uint64_t*)utf16Str)) {
+           utf16Str += UTF16_WORD_UNITS;
+           utf8Len += UTF16_WORD_UNITS;
+           len -= UTF16_WORD_UNITS;
+       }
+       if (len == 0)
+           break;
+
+       len--;
+       uic = *utf16Str++;
 
        if (uic > 0x07ff)
            utf8Len += 3;
@@ -58,8 +89,24 @@ extern char* strncpy16to8(char* utf8Str, const char16_t* utf16Str, size_t len)
 {
     char* utf8cur = utf8Str;
 
-    while (len--) {
-        unsigned int uic = *utf16Str++;
+    while (len) {
+        unsigned int uic;
+
+        while (len >= UTF16_WORD_UNITS && ((uintptr_t)utf16Str & 7) == 0
+                && utf16_word_is_ascii(*(const uint64_t*)utf16Str)) {
+            utf8cur[0] = (char)utf16Str[0];
+            utf8cur[1] = (char)utf16Str[1];
+            utf8cur[2] = (char)utf16Str[2];
+            utf8cur[3] = (char)utf16Str[3];
+            utf8cur += UTF16_WORD_UNITS;
+            utf16Str += UTF16_WORD_UNITS;
+            len -= UTF16_WORD_UNITS;
+        }
+        if (len == 0)
+            break;
+
+        len--;
+        uic = *utf16Str++;
 
         if (uic > 0x07ff) {
             *utf8cur++ = (uic >> 12) | 0xe0;
@@ -15,6 +15,8 @@
 ** limitations under the License.
 */
 #include <cutils/threads.h>
+#include <cutils/atomic.h>
+#include <stdlib.h>
 
 #ifdef HAVE_PTHREADS
 void*  thread_store_get( thread_store_t*  store )
@@ -31,15 +33,21 @@ extern void   thread_store_set( thread_store_t*          store,
                                 void*                    value,
                                 thread_store_destruct_t  destroy)
 {
-    pthread_mutex_lock( &store->lock );
-    if (!store->has_tls) {
-        if (pthread_key_create( &store->tls, destroy) != 0) {
-            pthread_mutex_unlock(&store->lock);
-            return;
+    /* the key almost always exists already; the atomic read makes the
+    ** key's publication below visible before we use store->tls, so the
+    ** lock is only ever taken to create the key
+    */
+    if (android_atomic_or(0, (volatile int32_t*)&store->has_tls) == 0) {
+        pthread_mutex_lock( &store->lock );
+        if (!store->has_tls) {
+            if (pthread_key_create( &store->tls, destroy) != 0) {
+                pthread_mutex_unlock(&store->lock);
+                return;
+            }
+            android_atomic_write(1, (volatile int32_t*)&store->has_tls);
         }
-        store->has_tls = 1;
+        pthread_mutex_unlock( &store->lock );
     }
-    pthread_mutex_unlock( &store->lock );
 
     pthread_setspecific( store->tls, value );
 }
@@ -59,6 +67,11 @@ void   thread_store_set( thread_store_t*          store,
                          void*                    value,
                          thread_store_destruct_t  destroy )
 {
+    if (store->has_tls) {
+        TlsSetValue( store->tls, value );
+        return;
+    }
+
     /* XXX: can't use destructor on thread exit */
     if (!store->lock_init) {
         store->lock_init = -1;
@@ -82,3 +95,119 @@ void   thread_store_set( thread_store_t*          store,
     TlsSetValue( store->tls, value );
 }
 #endif
+
+/***********************************************************************/
+/*****         thread object cache                                 *****/
+/***********************************************************************/
+
+/* objects on a freelist are chained through their first word */
+#define  CACHE_NEXT(obj)   (*(void**)(obj))
+
+typedef struct {
+    void*            head;
+    int              count;
+    thread_cache_t*  cache;
+} thread_cache_slot_t;
+
+/* pushes a whole chain into the central pool, freeing whatever
+** doesn't fit under central_max
+*/
+static void thread_cache_spill( thread_cache_t*  cache, void*  head )
+{
+    mutex_lock( &cache->lock );
+    while (head != NULL) {
+        void*  next = CACHE_NEXT(head);
+
+        if (cache->central_count < cache->central_max) {
+            CACHE_NEXT(head)     = cache->central;
+            cache->central       = head;
+            cache->central_count += 1;
+        } else {
+            free( head );
+        }
+        head = next;
+    }
+    mutex_unlock( &cache->lock );
+}
+
+/* thread exit: hand the thread's freelist back to everyone else.
+** (on win32 thread_store_set can't register a destructor, so there a
+** thread that exits simply leaks whatever it had cached)
+*/
+static void thread_cache_slot_destroy( void*  value )
+{
+    thread_cache_slot_t*  slot = value;
+
+    thread_cache_spill( slot->cache, slot->head );
+    free( slot );
+}
+
+static thread_cache_slot_t*  thread_cache_slot( thread_cache_t*  cache )
+{
+    thread_cache_slot_t*  slot = thread_store_get( &cache->store );
+
+    if (slot == NULL) {
+        slot = malloc( sizeof(*slot) );
+        if (slot != NULL) {
+            slot->head  = NULL;
+            slot->count = 0;
+            slot->cache = cache;
+            thread_store_set( &cache->store, slot,
+                              thread_cache_slot_destroy );
+        }
+    }
+    return slot;
+}
+
+void*  thread_cache_alloc( thread_cache_t*  cache )
+{
+    thread_cache_slot_t*  slot = thread_cache_slot( cache );
+    void*                 obj;
+
+    if (slot != NULL && slot->head != NULL) {
+        obj         = slot->head;
+        slot->head  = CACHE_NEXT(obj);
+        slot->count -= 1;
+        return obj;
+    }
+
+    mutex_lock( &cache->lock );
+    obj = cache->central;
+    if (obj != NULL) {
+        cache->central       = CACHE_NEXT(obj);
+        cache->central_count -= 1;
+    }
+    mutex_unlock( &cache->lock );
+
+    if (obj == NULL)
+        obj = malloc( cache->obj_size );
+
+    return obj;
+}
+
+void  thread_cache_release( thread_cache_t*  cache, void*  object )
+{
+    thread_cache_slot_t*  slot;
+
+    if (object == NULL)
+        return;
+
+    slot = thread_cache_slot( cache );
+    if (slot == NULL) {
+        /* out of memory for the slot itself: go straight central */
+        CACHE_NEXT(object) = NULL;
+        thread_cache_spill( cache, object );
+        return;
+    }
+
+    CACHE_NEXT(object) = slot->head;
+    slot->head         = object;
+    slot->count        += 1;
+
+    if (slot->count >= cache->thread_max) {
+        /* spill the whole list so releases go back to being lock-free */
+        thread_cache_spill( cache, slot->head );
+        slot->head  = NULL;
+        slot->count = 0;
+    }
+}
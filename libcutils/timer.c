@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/timer.h>
+#include <cutils/threads.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+nsecs_t system_time(void)
+{
+#if defined(HAVE_POSIX_CLOCKS)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+#elif defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (nsecs_t)(now.QuadPart * (NSECS_PER_SEC / (double) freq.QuadPart));
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * NSECS_PER_SEC + tv.tv_usec * NSECS_PER_USEC;
+#endif
+}
+
+uint64_t cycle_counter(void)
+{
+#if defined(__i386__)
+    uint64_t v;
+    __asm__ __volatile__ ("rdtsc" : "=A" (v));
+    return v;
+#elif defined(__x86_64__)
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t) hi << 32) | lo;
+#else
+    /* no user-space cycle counter on our ARM kernels; the clock keeps
+     * callers working, just without beating a clock_gettime */
+    return (uint64_t) system_time();
+#endif
+}
+
+static mutex_t calibrate_lock = MUTEX_INITIALIZER;
+static unsigned calibrated_rate;
+
+unsigned cycles_per_usec(void)
+{
+    if (calibrated_rate == 0) {
+        mutex_lock(&calibrate_lock);
+        if (calibrated_rate == 0) {
+            nsecs_t t0, t1;
+            uint64_t c0, c1;
+            unsigned rate;
+
+            t0 = system_time();
+            c0 = cycle_counter();
+            do {
+                t1 = system_time();
+            } while (t1 - t0 < 2 * NSECS_PER_MSEC);
+            c1 = cycle_counter();
+
+            rate = (unsigned)((c1 - c0) * NSECS_PER_USEC / (t1 - t0));
+            calibrated_rate = rate ? rate : 1;
+        }
+        mutex_unlock(&calibrate_lock);
+    }
+    return calibrated_rate;
+}
+
+nsecs_t cycles_to_ns(uint64_t cycles)
+{
+    /* fine for intervals; overflows only after hours of cycles */
+    return (nsecs_t)(cycles * NSECS_PER_USEC / cycles_per_usec());
+}
+
+void interval_stats_init(interval_stats_t *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void interval_stats_add(interval_stats_t *s, nsecs_t interval)
+{
+    uint64_t v = interval > 0 ? (uint64_t) interval : 0;
+    int n = 0;
+
+    while (v > 1 && n < INTERVAL_STATS_BUCKETS - 1) {
+        v >>= 1;
+        n++;
+    }
+    s->buckets[n]++;
+
+    if (s->count == 0 || interval < s->min)
+        s->min = interval;
+    if (s->count == 0 || interval > s->max)
+        s->max = interval;
+    s->total += interval;
+    s->count++;
+}
+
+int interval_stats_format(const interval_stats_t *s, char *buf, int size)
+{
+    int len, n;
+
+    if (s->count == 0)
+        return snprintf(buf, size, "no samples");
+
+    len = snprintf(buf, size, "%u samples min %lld avg %lld max %lld ns",
+                   s->count, (long long) s->min,
+                   (long long) (s->total / s->count), (long long) s->max);
+    if (len >= size)
+        return size - 1;
+
+    for (n = 0; n < INTERVAL_STATS_BUCKETS; n++) {
+        if (s->buckets[n] == 0)
+            continue;
+        len += snprintf(buf + len, size - len, " [2^%d]=%u",
+                        n, s->buckets[n]);
+        if (len >= size)
+            return size - 1;
+    }
+    return len;
+}
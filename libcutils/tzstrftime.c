@@ -11,6 +11,8 @@ static char	elsieid[] = "@(#)strftime.c	8.1";
 #include <time.h>
 #include <tzfile.h>
 #include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 #include <cutils/tztime.h>
 
 /*
@@ -832,3 +834,153 @@ no_locale:
 	return &localebuf;
 }
 #endif /* defined LOCALE_HOME */
+
+/*
+** Compiled formats.  Consumers like log printers format a timestamp
+** for every line, and _fmt() re-scans the format string and walks the
+** dispatch switch on each call.  strftime_fmt_compile() does the scan
+** once, splitting the format into literal runs and single-conversion
+** ops that strftime_fmt() plays back.  The object also remembers the
+** last broken-down time it produced, so a run of entries inside the
+** same second costs a compare and a copy.
+*/
+
+struct sf_op {
+    const char *lit;    /* literal run (into the format copy), len bytes */
+    int len;            /* 0 for a conversion op */
+    char spec[8];       /* "%<modifiers><conversion>", handed to _fmt() */
+};
+
+struct strftime_fmt {
+    char *format;       /* private copy the literal ops point into */
+    struct sf_op *ops;
+    int nops;
+
+    int cache_valid;
+    struct tm cache_tm;
+    const struct strftime_locale *cache_locale;
+    size_t cache_len;
+    char cache[256];
+};
+
+static int
+is_modifier(int c)
+{
+    return c == 'E' || c == 'O' || c == '_' || c == '-' ||
+        c == '0' || c == '^' || c == '#';
+}
+
+struct strftime_fmt *
+strftime_fmt_compile(const char *format)
+{
+    struct strftime_fmt *f;
+    struct sf_op *op;
+    const char *p;
+    char *q;
+    int n;
+
+    if (format == NULL)
+        format = "%c";
+    f = calloc(1, sizeof(*f));
+    if (f == NULL)
+        return NULL;
+    f->format = strdup(format);
+    /* worst case: alternating literals and conversions */
+    n = 1;
+    for (p = format; *p; p++)
+        if (*p == '%')
+            n += 2;
+    f->ops = malloc(n * sizeof(struct sf_op));
+    if (f->format == NULL || f->ops == NULL) {
+        strftime_fmt_free(f);
+        return NULL;
+    }
+
+    op = f->ops;
+    q = f->format;
+    while (*q) {
+        if (*q != '%') {
+            op->lit = q;
+            op->len = 0;
+            while (*q && *q != '%') {
+                q++;
+                op->len++;
+            }
+            op++;
+            continue;
+        }
+        {
+            char *spec = op->spec;
+            char *lim = op->spec + sizeof(op->spec) - 2;
+
+            op->lit = NULL;
+            op->len = 0;
+            *spec++ = *q++;             /* '%' */
+            while (*q && is_modifier(*q)) {
+                if (spec < lim)
+                    *spec++ = *q;
+                q++;
+            }
+            if (*q)                     /* conversion char, or "%" at end */
+                *spec++ = *q++;
+            *spec = '\0';
+            op++;
+        }
+    }
+    f->nops = op - f->ops;
+    return f;
+}
+
+size_t
+strftime_fmt(char *s, size_t maxsize, struct strftime_fmt *f,
+    const struct tm *t, const struct strftime_locale *Locale)
+{
+    char *pt;
+    const char *ptlim;
+    const struct sf_op *op;
+    int i;
+    int warn;
+
+    if (f->cache_valid && Locale == f->cache_locale &&
+        memcmp(&f->cache_tm, t, sizeof(*t)) == 0) {
+        if (f->cache_len >= maxsize)
+            return 0;
+        memcpy(s, f->cache, f->cache_len + 1);
+        return f->cache_len;
+    }
+
+    pt = s;
+    ptlim = s + maxsize;
+    warn = IN_NONE;
+    for (i = 0, op = f->ops; i < f->nops; i++, op++) {
+        if (op->len) {
+            const char *cp = op->lit;
+            int left = op->len;
+            while (left-- && pt != ptlim)
+                *pt++ = *cp++;
+        } else
+            pt = _fmt(op->spec, t, pt, ptlim, &warn, Locale);
+    }
+    if (pt == ptlim)
+        return 0;
+    *pt = '\0';
+    f->cache_len = pt - s;
+    if (f->cache_len < sizeof(f->cache)) {
+        memcpy(f->cache, s, f->cache_len + 1);
+        f->cache_tm = *t;
+        f->cache_locale = Locale;
+        f->cache_valid = 1;
+    } else
+        f->cache_valid = 0;
+    return pt - s;
+}
+
+void
+strftime_fmt_free(struct strftime_fmt *f)
+{
+    if (f == NULL)
+        return;
+    free(f->format);
+    free(f->ops);
+    free(f);
+}
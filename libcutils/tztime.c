@@ -189,6 +189,7 @@ static int		tzload P((const char * name, struct state * sp,
 				int doextend));
 static int		tzload_uncached P((const char * name, struct state * sp,
 				int doextend));
+static struct state *	tzget P((const char * name, int doextend));
 static int		tzparse P((const char * name, struct state * sp,
 				int lastditch));
 
@@ -282,45 +283,60 @@ static int toint(unsigned char *s) {
     return (s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
 }
 
+/*
+** Returns a pointer to the cached state for the named zone, parsing it
+** into a cache slot on the first use.  Callers that only convert with
+** the state can share the cached copy directly instead of paying for a
+** multi-kilobyte struct copy per call; the pointer stays good until
+** the slot is recycled for a different zone.
+*/
+static struct state *
+tzget(const char *name, int doextend)
+{
+    int i, err;
+
+    if (0 == strcmp(name, "UTC")) {
+        if (!g_utcSet) {
+            tzload_uncached(name, &g_utc, 1);
+            g_utcSet = 1;
+        }
+        //printf("tzload: utc\n");
+        return &g_utc;
+    }
+    for (i=0; i<CACHE_COUNT; i++) {
+        if (g_cacheNames[i] && 0 == strcmp(name, g_cacheNames[i])) {
+            //printf("tzload: hit: %s\n", name);
+            return &(g_cacheStates[i]);
+        }
+    }
+    //printf("tzload: miss: %s\n", name);
+    g_lastCache++;
+    if (g_lastCache >= CACHE_COUNT) {
+        g_lastCache = 0;
+    }
+    i = g_lastCache;
+    if (g_cacheNames[i]) {
+        free(g_cacheNames[i]);
+    }
+    err = tzload_uncached(name, &(g_cacheStates[i]), doextend);
+    if (err == 0) {
+        g_cacheNames[i] = strdup(name);
+        return &(g_cacheStates[i]);
+    }
+    g_cacheNames[i] = NULL;
+    return NULL;
+}
+
 static int
 tzload(const char *name, struct state * const sp, const int doextend)
 {
     if (name) {
-        int i, err;
-        if (0 == strcmp(name, "UTC")) {
-            if (!g_utcSet) {
-                tzload_uncached(name, &g_utc, 1);
-                g_utcSet = 1;
-            }
-            //printf("tzload: utc\n");
-            *sp = g_utc;
-            return 0;
-        }
-        for (i=0; i<CACHE_COUNT; i++) {
-            if (g_cacheNames[i] && 0 == strcmp(name, g_cacheNames[i])) {
-                *sp = g_cacheStates[i];
-                //printf("tzload: hit: %s\n", name);
-                return 0;
-            }
-        }
-        //printf("tzload: miss: %s\n", name);
-        g_lastCache++;
-        if (g_lastCache >= CACHE_COUNT) {
-            g_lastCache = 0;
-        }
-        i = g_lastCache;
-        if (g_cacheNames[i]) {
-            free(g_cacheNames[i]);
-        }
-        err = tzload_uncached(name, &(g_cacheStates[i]), 1);
-        if (err == 0) {
-            g_cacheNames[i] = strdup(name);
-            *sp = g_cacheStates[i];
-            return 0;
-        } else {
-            g_cacheNames[i] = NULL;
-            return err;
+        struct state * cached = tzget(name, doextend);
+        if (cached == NULL) {
+            return -1;
         }
+        *sp = *cached;
+        return 0;
     }
     return tzload_uncached(name, sp, doextend);
 }
@@ -1262,17 +1278,107 @@ const time_t * const	timep;
 ** Re-entrant version of localtime.
 */
 
+/*
+** One-entry conversion cache.  Timestamps usually arrive in bursts that
+** share a zone, a UTC day and an offset segment (log lines being the
+** worst offender), in which case the broken-down times only differ in
+** hh:mm:ss, which one subtraction from the local midnight rebuilds.
+*/
+static char	fast_TZname[TZ_STRLEN_MAX + 1];
+static struct tm	fast_tm;
+static time_t	fast_day_start;	/* UTC instant of local 00:00:00 */
+static time_t	fast_lo;	/* cache serves fast_lo <= t < fast_hi */
+static time_t	fast_hi;
+static int	fast_is_set;
+
 // ============================================================================
 void
 localtime_tz(const time_t * const timep, struct tm * tmp, const char* tz)
 {
+    struct state * sp;
     struct state st;
-    if (tzload(tz, &st, TRUE) != 0) {
+    const time_t t = *timep;
+    time_t day_start;
+    time_t lo;
+    time_t hi;
+    int secs;
+
+    if (fast_is_set && tz != NULL &&
+        t >= fast_lo && t < fast_hi &&
+        0 == strcmp(tz, fast_TZname)) {
+            secs = (int) (t - fast_day_start);
+            *tmp = fast_tm;
+            tmp->tm_hour = secs / SECSPERHOUR;
+            tmp->tm_min = (secs % SECSPERHOUR) / SECSPERMIN;
+            tmp->tm_sec = secs % SECSPERMIN;
+            return;
+    }
+
+    sp = (tz != NULL) ? tzget(tz, TRUE) : NULL;
+    if (sp == NULL) {
+        if (tz == NULL && tzload(NULL, &st, TRUE) == 0) {
+            localsub(timep, 0L, tmp, &st);
+            return;
+        }
         // not sure what's best here, but for now, we fall back to gmt
         gmtload(&st);
+        localsub(timep, 0L, tmp, &st);
+        return;
+    }
+
+    if (localsub(timep, 0L, tmp, sp) == NULL) {
+        return;
+    }
+
+    /*
+    ** Prime the fast path for the next call.  Zones with leap seconds
+    ** and times in the extrapolated goback/goahead range keep taking
+    ** the full conversion.
+    */
+    if (sp->leapcnt != 0 || strlen(tz) > TZ_STRLEN_MAX) {
+        return;
+    }
+    if ((sp->goback && t < sp->ats[0]) ||
+        (sp->goahead && sp->timecnt > 0 && t > sp->ats[sp->timecnt - 1])) {
+            return;
     }
 
-	localsub(timep, 0L, tmp, &st);
+    day_start = t - (tmp->tm_hour * SECSPERHOUR +
+        tmp->tm_min * SECSPERMIN + tmp->tm_sec);
+    lo = day_start;
+    hi = day_start + SECSPERDAY;
+
+    /*
+    ** Clamp the interval to the offset segment around t, so a zone
+    ** change in the middle of the day falls back to the slow path.
+    */
+    if (sp->timecnt > 0) {
+        int loidx = 0;
+        int hiidx = sp->timecnt;
+
+        while (loidx < hiidx) {
+            int mid = (loidx + hiidx) >> 1;
+
+            if (t < sp->ats[mid])
+                hiidx = mid;
+            else	loidx = mid + 1;
+        }
+        if (loidx < sp->timecnt && sp->ats[loidx] < hi) {
+            hi = sp->ats[loidx];
+        }
+        if (loidx > 0 && sp->ats[loidx - 1] > lo) {
+            lo = sp->ats[loidx - 1];
+        }
+    }
+
+    if (lo <= t && t < hi) {
+        fast_day_start = day_start;
+        fast_lo = lo;
+        fast_hi = hi;
+        fast_tm = *tmp;
+        strcpy(fast_TZname, tz);
+        fast_is_set = 1;
+    }
 }
 
 /*
@@ -1907,9 +2013,16 @@ time_t
 mktime_tz(struct tm * const	tmp, char const * tz)
 {
     struct state st;
-    if (tzload(tz, &st, TRUE) != 0) {
-        // not sure what's best here, but for now, we fall back to gmt
-        gmtload(&st);
+
+    if (tz != NULL) {
+        struct state * sp = tzget(tz, TRUE);
+        if (sp != NULL) {
+            return time1(tmp, localsub, 0L, sp);
+        }
+    } else if (tzload(NULL, &st, TRUE) == 0) {
+        return time1(tmp, localsub, 0L, &st);
     }
+    // not sure what's best here, but for now, we fall back to gmt
+    gmtload(&st);
 	return time1(tmp, localsub, 0L, &st);
 }
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <time.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -38,6 +39,11 @@
 
 static void replace_nl(char *str);
 
+// cached connection for zygote_run_pooled(); the zygote handles a
+// sequence of requests per connection, so it can be reused
+static int sPooledFd = -1;
+static pthread_mutex_t sPooledFdMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * If sendStdio is non-zero, the current process's stdio file descriptors
  * will be sent and inherited by the spawned process.
@@ -51,29 +57,59 @@ static int send_request(int fd, int sendStdio, int argc, const char **argv)
 #else /* HAVE_ANDROID_OS */
     uint32_t pid;
     int i;
-    struct iovec ivs[2];
+    struct iovec ivs[2 * argc + 1];
+    int niv;
     struct msghdr msg;
     char argc_buffer[12];
     const char *newline_string = "\n";
     struct cmsghdr *cmsg;
     char msgbuf[CMSG_SPACE(sizeof(int) * 3)];
     int *cmsg_payload;
+    char *frees[argc > 0 ? argc : 1];
+    int nfrees = 0;
+    size_t total;
     ssize_t ret;
 
     memset(&msg, 0, sizeof(msg));
-    memset(&ivs, 0, sizeof(ivs));
 
-    // First line is arg count 
+    // Gather the whole request - the arg count line and every argument -
+    // into one vector so it goes out in a single sendmsg() instead of a
+    // write per line.
+
+    // First line is arg count
     snprintf(argc_buffer, sizeof(argc_buffer), "%d\n", argc);
 
     ivs[0].iov_base = argc_buffer;
     ivs[0].iov_len = strlen(argc_buffer);
+    total = ivs[0].iov_len;
+    niv = 1;
+
+    // replace any newlines with spaces and append the args
+    for (i = 0; i < argc; i++) {
+        const char *toprint = argv[i];
+
+        if (strchr(toprint, '\n') != NULL) {
+            char *tofree = strdup(toprint);
+            replace_nl(tofree);
+            frees[nfrees++] = tofree;
+            toprint = tofree;
+        }
+
+        ivs[niv].iov_base = (char *)toprint;
+        ivs[niv].iov_len = strlen(toprint);
+        total += ivs[niv].iov_len;
+        niv++;
+        ivs[niv].iov_base = (char *)newline_string;
+        ivs[niv].iov_len = 1;
+        total += 1;
+        niv++;
+    }
 
     msg.msg_iov = ivs;
-    msg.msg_iovlen = 1;
+    msg.msg_iovlen = niv;
 
     if (sendStdio != 0) {
-        // Pass the file descriptors with the first write
+        // Pass the file descriptors with the request
         msg.msg_control = msgbuf;
         msg.msg_controllen = sizeof msgbuf;
 
@@ -89,51 +125,50 @@ static int send_request(int fd, int sendStdio, int argc, const char **argv)
         cmsg_payload[2] = STDERR_FILENO;
     }
 
-    do {
-        ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
-    } while (ret < 0 && errno == EINTR);
-
-    if (ret < 0) {
-        return -1;
-    }
-
-    // Only send the fd's once
-    msg.msg_control = NULL;
-    msg.msg_controllen = 0;
-
-    // replace any newlines with spaces and send the args
-    for (i = 0; i < argc; i++) {
-        char *tofree = NULL;
-        const char *toprint;
-
-        toprint = argv[i];
-
-        if (strchr(toprint, '\n') != NULL) {
-            tofree = strdup(toprint);
-            toprint = tofree;
-            replace_nl(tofree);
-        }
-
-        ivs[0].iov_base = (char *)toprint;
-        ivs[0].iov_len = strlen(toprint);
-        ivs[1].iov_base = (char *)newline_string;
-        ivs[1].iov_len = 1;
-
-        msg.msg_iovlen = 2;
-
+    for (;;) {
         do {
             ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
         } while (ret < 0 && errno == EINTR);
 
-        if (tofree != NULL) {
-            free(tofree);
-        }
-
         if (ret < 0) {
+            for (i = 0; i < nfrees; i++) {
+                free(frees[i]);
+            }
             return -1;
         }
+
+        total -= ret;
+        if (total == 0) {
+            break;
+        }
+
+        // Short write: only send the fd's once, and advance the vector
+        // past what went out already
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+
+        while (ret > 0) {
+            if ((size_t)ret >= msg.msg_iov[0].iov_len) {
+                ret -= msg.msg_iov[0].iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov[0].iov_base =
+                        (char *)msg.msg_iov[0].iov_base + ret;
+                msg.msg_iov[0].iov_len -= ret;
+                ret = 0;
+            }
+        }
+    }
+
+    for (i = 0; i < nfrees; i++) {
+        free(frees[i]);
     }
 
+    msg.msg_iov = ivs;
+    msg.msg_control = NULL;
+    msg.msg_controllen = 0;
+
     // Read the pid, as a 4-byte network-order integer
 
     ivs[0].iov_base = &pid;
@@ -159,14 +194,14 @@ static int send_request(int fd, int sendStdio, int argc, const char **argv)
 #endif /* HAVE_ANDROID_OS */
 }
 
-int zygote_run_wait(int argc, const char **argv, void (*post_run_func)(int))
+int zygote_run_start(int argc, const char **argv, int *spawnedPid)
 {
     int fd;
     int pid;
     int err;
     const char *newargv[argc + 1];
 
-    fd = socket_local_client(ZYGOTE_SOCKET, 
+    fd = socket_local_client(ZYGOTE_SOCKET,
             ANDROID_SOCKET_NAMESPACE_RESERVED, AF_LOCAL);
 
     if (fd < 0) {
@@ -176,14 +211,28 @@ int zygote_run_wait(int argc, const char **argv, void (*post_run_func)(int))
     // The command socket is passed to the peer as close-on-exec
     // and will close when the peer dies
     newargv[0] = "--peer-wait";
-    memcpy(newargv + 1, argv, argc * sizeof(*argv)); 
+    memcpy(newargv + 1, argv, argc * sizeof(*argv));
 
     pid = send_request(fd, 1, argc + 1, newargv);
 
-    if (pid > 0 && post_run_func != NULL) {
-        post_run_func(pid);
+    if (pid < 0) {
+        do {
+            err = close(fd);
+        } while (err < 0 && errno == EINTR);
+        return -1;
+    }
+
+    if (spawnedPid != NULL) {
+        *spawnedPid = pid;
     }
 
+    return fd;
+}
+
+int zygote_run_finish(int fd)
+{
+    int err;
+
     // Wait for socket to close
     do {
         int dummy;
@@ -197,6 +246,70 @@ int zygote_run_wait(int argc, const char **argv, void (*post_run_func)(int))
     return 0;
 }
 
+int zygote_run_wait(int argc, const char **argv, void (*post_run_func)(int))
+{
+    int fd;
+    int pid = -1;
+
+    fd = zygote_run_start(argc, argv, &pid);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (pid > 0 && post_run_func != NULL) {
+        post_run_func(pid);
+    }
+
+    return zygote_run_finish(fd);
+}
+
+int zygote_run_pooled(int argc, const char **argv)
+{
+    int pid = -1;
+    int tries;
+
+    pthread_mutex_lock(&sPooledFdMutex);
+
+    // A cached connection may have been closed by the zygote since we
+    // last used it, so reconnect and retry once on failure
+    for (tries = 0; tries < 2; tries++) {
+        if (sPooledFd < 0) {
+            sPooledFd = socket_local_client(ZYGOTE_SOCKET,
+                    ANDROID_SOCKET_NAMESPACE_RESERVED, AF_LOCAL);
+
+            if (sPooledFd < 0) {
+                break;
+            }
+        }
+
+        pid = send_request(sPooledFd, 0, argc, argv);
+
+        if (pid >= 0) {
+            break;
+        }
+
+        close(sPooledFd);
+        sPooledFd = -1;
+    }
+
+    pthread_mutex_unlock(&sPooledFdMutex);
+
+    return pid;
+}
+
+void zygote_close_pool(void)
+{
+    pthread_mutex_lock(&sPooledFdMutex);
+
+    if (sPooledFd >= 0) {
+        close(sPooledFd);
+        sPooledFd = -1;
+    }
+
+    pthread_mutex_unlock(&sPooledFdMutex);
+}
+
 /**
  * Spawns a new dalvik instance via the Zygote process. The non-zygote
  * arguments are passed to com.android.internal.os.RuntimeInit(). The
@@ -18,8 +18,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -33,6 +37,31 @@ typedef struct EventTag {
     const char*     tagStr;
 } EventTag;
 
+/*
+ * Precompiled map format: a header, a hash table of fixed-width slots
+ * open-addressed on the tag number, then a pool of NUL-terminated tag
+ * strings.  The whole file is position-independent (string references
+ * are offsets from the start of the file), so it can be mapped
+ * read-only and shared between processes, and a lookup is one hash
+ * probe with no parsing at load time.
+ */
+#define BINMAP_MAGIC    0x314d5445      /* "ETM1", little-endian */
+
+typedef struct BinMapHeader {
+    uint32_t    magic;
+    uint32_t    numTags;
+    uint32_t    numBuckets;     /* power of two, >= 2 * numTags */
+    uint32_t    stringsOff;     /* offset of the string pool */
+} BinMapHeader;
+
+typedef struct BinMapSlot {
+    uint32_t    tagIndex;
+    uint32_t    strOff;         /* offset of the tag string; 0 = empty */
+} BinMapSlot;
+
+/* Knuth's multiplicative hash; tags are small dense-ish ints */
+#define BINMAP_HASH(tag)    ((uint32_t)(tag) * 2654435761u)
+
 /*
  * Map.
  */
@@ -44,9 +73,14 @@ struct EventTagMap {
     /* array of event tags, sorted numerically by tag index */
     EventTag*       tagArray;
     int             numTags;
+
+    /* set instead of tagArray when the file is a precompiled map */
+    const BinMapHeader* binHeader;
 };
 
 /* fwd */
+static EventTagMap* openBinaryMap(const char* fileName,
+        const char* textFileName);
 static int processFile(EventTagMap* map);
 static int countMapLines(const EventTagMap* map);
 static int parseMapLines(EventTagMap* map);
@@ -64,9 +98,22 @@ static void dumpTags(const EventTagMap* map);
 EventTagMap* android_openEventTagMap(const char* fileName)
 {
     EventTagMap* newTagMap;
+    char binFileName[PATH_MAX];
     off_t end;
     int fd = -1;
 
+    /*
+     * If a precompiled map is sitting next to the text file and is no
+     * older, use it and skip the parse entirely.
+     */
+    if (snprintf(binFileName, sizeof(binFileName), "%s.bin", fileName)
+            < (int) sizeof(binFileName))
+    {
+        newTagMap = openBinaryMap(binFileName, fileName);
+        if (newTagMap != NULL)
+            return newTagMap;
+    }
+
     newTagMap = calloc(1, sizeof(EventTagMap));
     if (newTagMap == NULL)
         return NULL;
@@ -97,6 +144,13 @@ EventTagMap* android_openEventTagMap(const char* fileName)
     if (processFile(newTagMap) != 0)
         goto fail;
 
+    /*
+     * Try to leave a compiled map behind for the next process.  This
+     * fails quietly when the directory isn't writable (e.g. /system),
+     * in which case the build-time copy is expected to be there already.
+     */
+    (void) android_writeEventTagMap(newTagMap, binFileName);
+
     return newTagMap;
 
 fail:
@@ -106,6 +160,79 @@ fail:
     return NULL;
 }
 
+/*
+ * Try to open "fileName" as a precompiled map.  We only accept it if it
+ * is no older than the text file it was compiled from and it passes a
+ * basic structural sanity check; on any doubt we return NULL and the
+ * caller falls back to parsing the text file.
+ *
+ * Unlike the text map, the compiled map is mapped read-only and shared,
+ * so all processes using it share one copy of the pages.
+ */
+static EventTagMap* openBinaryMap(const char* fileName,
+        const char* textFileName)
+{
+    EventTagMap* newTagMap = NULL;
+    const BinMapHeader* hdr;
+    struct stat binStat, textStat;
+    size_t slotEnd;
+    int fd;
+
+    if (stat(fileName, &binStat) != 0)
+        return NULL;
+    if (stat(textFileName, &textStat) == 0 &&
+        binStat.st_mtime < textStat.st_mtime)
+    {
+        /* stale; the text file has been updated since it was compiled */
+        return NULL;
+    }
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    newTagMap = calloc(1, sizeof(EventTagMap));
+    if (newTagMap == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    newTagMap->mapAddr = mmap(NULL, binStat.st_size, PROT_READ, MAP_SHARED,
+                                fd, 0);
+    close(fd);
+    if (newTagMap->mapAddr == MAP_FAILED) {
+        free(newTagMap);
+        return NULL;
+    }
+    newTagMap->mapLen = binStat.st_size;
+
+    /* sanity-check the header and make sure everything is in bounds */
+    hdr = (const BinMapHeader*) newTagMap->mapAddr;
+    if (newTagMap->mapLen < sizeof(BinMapHeader) ||
+        hdr->magic != BINMAP_MAGIC ||
+        hdr->numBuckets == 0 ||
+        (hdr->numBuckets & (hdr->numBuckets-1)) != 0)
+    {
+        goto fail;
+    }
+    slotEnd = sizeof(BinMapHeader) + hdr->numBuckets * sizeof(BinMapSlot);
+    if (slotEnd > newTagMap->mapLen || hdr->stringsOff != slotEnd ||
+        ((const char*) newTagMap->mapAddr)[newTagMap->mapLen-1] != '\0')
+    {
+        goto fail;
+    }
+
+    newTagMap->binHeader = hdr;
+    newTagMap->numTags = hdr->numTags;
+    return newTagMap;
+
+fail:
+    fprintf(stderr, "%s: '%s' is not a valid compiled map, ignoring\n",
+        OUT_TAG, fileName);
+    android_closeEventTagMap(newTagMap);
+    return NULL;
+}
+
 /*
  * Close the map.
  */
@@ -115,6 +242,7 @@ void android_closeEventTagMap(EventTagMap* map)
         return;
 
     munmap(map->mapAddr, map->mapLen);
+    free(map->tagArray);
     free(map);
 }
 
@@ -127,6 +255,22 @@ const char* android_lookupEventTag(const EventTagMap* map, int tag)
 {
     int hi, lo, mid;
 
+    if (map->binHeader != NULL) {
+        /* compiled map; open-addressed hash probe, usually just one */
+        const BinMapHeader* hdr = map->binHeader;
+        const BinMapSlot* slots =
+            (const BinMapSlot*) ((const char*) hdr + sizeof(BinMapHeader));
+        uint32_t mask = hdr->numBuckets - 1;
+        uint32_t slot = BINMAP_HASH(tag) & mask;
+
+        while (slots[slot].strOff != 0) {
+            if (slots[slot].tagIndex == (uint32_t) tag)
+                return (const char*) map->mapAddr + slots[slot].strOff;
+            slot = (slot+1) & mask;
+        }
+        return NULL;
+    }
+
     lo = 0;
     hi = map->numTags-1;
 
@@ -151,6 +295,89 @@ const char* android_lookupEventTag(const EventTagMap* map, int tag)
 }
 
 
+/*
+ * Compile the map into its binary form and write it to "fileName".
+ *
+ * The output is built in memory and written through a temp file that is
+ * renamed into place, so a reader never sees a half-written map.
+ */
+int android_writeEventTagMap(const EventTagMap* map, const char* fileName)
+{
+    char tmpFileName[PATH_MAX];
+    BinMapHeader* hdr;
+    BinMapSlot* slots;
+    char* buf;
+    char* strp;
+    size_t bufLen, poolLen;
+    uint32_t numBuckets;
+    int i, fd;
+
+    if (map == NULL || map->tagArray == NULL)
+        return -1;
+
+    /* pick a power-of-two table size with at most 50% occupancy */
+    numBuckets = 1;
+    while (numBuckets < (uint32_t) map->numTags * 2)
+        numBuckets <<= 1;
+
+    poolLen = 0;
+    for (i = 0; i < map->numTags; i++)
+        poolLen += strlen(map->tagArray[i].tagStr) + 1;
+
+    bufLen = sizeof(BinMapHeader) + numBuckets * sizeof(BinMapSlot) + poolLen;
+    buf = calloc(1, bufLen);
+    if (buf == NULL)
+        return -1;
+
+    hdr = (BinMapHeader*) buf;
+    hdr->magic = BINMAP_MAGIC;
+    hdr->numTags = map->numTags;
+    hdr->numBuckets = numBuckets;
+    hdr->stringsOff = sizeof(BinMapHeader) + numBuckets * sizeof(BinMapSlot);
+
+    slots = (BinMapSlot*) (buf + sizeof(BinMapHeader));
+    strp = buf + hdr->stringsOff;
+    for (i = 0; i < map->numTags; i++) {
+        uint32_t slot = BINMAP_HASH(map->tagArray[i].tagIndex)
+                            & (numBuckets-1);
+
+        while (slots[slot].strOff != 0)
+            slot = (slot+1) & (numBuckets-1);
+        slots[slot].tagIndex = map->tagArray[i].tagIndex;
+        slots[slot].strOff = strp - buf;
+
+        strcpy(strp, map->tagArray[i].tagStr);
+        strp += strlen(map->tagArray[i].tagStr) + 1;
+    }
+
+    if (snprintf(tmpFileName, sizeof(tmpFileName), "%s.tmp", fileName)
+            >= (int) sizeof(tmpFileName))
+    {
+        free(buf);
+        return -1;
+    }
+
+    fd = open(tmpFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(buf);
+        return -1;
+    }
+    if (write(fd, buf, bufLen) != (ssize_t) bufLen) {
+        close(fd);
+        unlink(tmpFileName);
+        free(buf);
+        return -1;
+    }
+    free(buf);
+
+    if (close(fd) != 0 || rename(tmpFileName, fileName) != 0) {
+        unlink(tmpFileName);
+        return -1;
+    }
+
+    return 0;
+}
+
 
 /*
  * Determine whether "c" is a whitespace char.
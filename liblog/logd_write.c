@@ -27,6 +27,7 @@
 
 #include <utils/logger.h>
 #include <cutils/logd.h>
+#include <cutils/log.h>
 
 #define LOG_BUF_SIZE	1024
 
@@ -53,6 +54,9 @@ static int (*write_to_log)(log_id_t, struct iovec *vec, size_t nr) =
     __write_to_log_init;
 #ifdef HAVE_PTHREADS
 static pthread_mutex_t log_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* set once async mode is on; the flusher writes through this */
+static int (*sync_write_to_log)(log_id_t, struct iovec *vec, size_t nr);
 #endif
 
 static int log_fds[(int)LOG_ID_MAX] = { -1, -1, -1 };
@@ -100,6 +104,27 @@ static int __write_to_log_kernel(log_id_t log_id, struct iovec *vec, size_t nr)
     return ret;
 }
 
+/* must hold log_init_lock (when threads are available) */
+static void __open_log_devices(void)
+{
+    log_fds[LOG_ID_MAIN] = log_open("/dev/"LOGGER_LOG_MAIN, O_WRONLY);
+    log_fds[LOG_ID_RADIO] = log_open("/dev/"LOGGER_LOG_RADIO, O_WRONLY);
+    log_fds[LOG_ID_EVENTS] = log_open("/dev/"LOGGER_LOG_EVENTS, O_WRONLY);
+
+    write_to_log = __write_to_log_kernel;
+
+    if (log_fds[LOG_ID_MAIN] < 0 || log_fds[LOG_ID_RADIO] < 0 ||
+            log_fds[LOG_ID_EVENTS] < 0) {
+        log_close(log_fds[LOG_ID_MAIN]);
+        log_close(log_fds[LOG_ID_RADIO]);
+        log_close(log_fds[LOG_ID_EVENTS]);
+        log_fds[LOG_ID_MAIN] = -1;
+        log_fds[LOG_ID_RADIO] = -1;
+        log_fds[LOG_ID_EVENTS] = -1;
+        write_to_log = __write_to_log_null;
+    }
+}
+
 static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
 {
 #ifdef HAVE_PTHREADS
@@ -107,22 +132,7 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
 #endif
 
     if (write_to_log == __write_to_log_init) {
-        log_fds[LOG_ID_MAIN] = log_open("/dev/"LOGGER_LOG_MAIN, O_WRONLY);
-        log_fds[LOG_ID_RADIO] = log_open("/dev/"LOGGER_LOG_RADIO, O_WRONLY);
-        log_fds[LOG_ID_EVENTS] = log_open("/dev/"LOGGER_LOG_EVENTS, O_WRONLY);
-
-        write_to_log = __write_to_log_kernel;
-
-        if (log_fds[LOG_ID_MAIN] < 0 || log_fds[LOG_ID_RADIO] < 0 ||
-                log_fds[LOG_ID_EVENTS] < 0) {
-            log_close(log_fds[LOG_ID_MAIN]);
-            log_close(log_fds[LOG_ID_RADIO]);
-            log_close(log_fds[LOG_ID_EVENTS]);
-            log_fds[LOG_ID_MAIN] = -1;
-            log_fds[LOG_ID_RADIO] = -1;
-            log_fds[LOG_ID_EVENTS] = -1;
-            write_to_log = __write_to_log_null;
-        }
+        __open_log_devices();
     }
 
 #ifdef HAVE_PTHREADS
@@ -132,6 +142,208 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
     return write_to_log(log_id, vec, nr);
 }
 
+#ifdef HAVE_PTHREADS
+
+/*
+ * Optional asynchronous mode: __android_log_async_start() interposes a
+ * bounded in-process ring between callers and the log device, and a
+ * flusher thread drains it, so a burst of logging no longer stalls the
+ * logging thread on the driver.  Each record is still handed to the
+ * device as a single writev, since the driver treats every writev as
+ * one log entry; the caller only pays for a memcpy into the ring.
+ *
+ * When the ring is full, new records are dropped and counted rather
+ * than blocking; the flusher notes the drops in the log once it
+ * catches up.  Records still queued when the process exits are lost.
+ */
+
+#define LOG_ASYNC_RING      128     /* entries; must be a power of two */
+#define LOG_ASYNC_PAYLOAD   (LOG_BUF_SIZE + 128)
+
+struct log_async_entry {
+    log_id_t log_id;
+    size_t len;
+    char payload[LOG_ASYNC_PAYLOAD];
+};
+
+static struct log_async_entry *async_ring;
+static unsigned async_head;             /* next slot to fill */
+static unsigned async_tail;             /* next slot to drain */
+static int async_dropped;
+static int async_dropped_reported;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_nonempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t async_empty = PTHREAD_COND_INITIALIZER;
+
+static void __report_dropped_locked(void)
+{
+    int dropped = async_dropped - async_dropped_reported;
+    char buf[64];
+    struct iovec vec[3];
+    int prio = ANDROID_LOG_WARN;
+
+    if (dropped <= 0)
+        return;
+    async_dropped_reported = async_dropped;
+    pthread_mutex_unlock(&async_lock);
+
+    snprintf(buf, sizeof(buf), "%d log messages dropped", dropped);
+    vec[0].iov_base = (unsigned char *) &prio;
+    vec[0].iov_len  = 1;
+    vec[1].iov_base = "liblog";
+    vec[1].iov_len  = sizeof("liblog");
+    vec[2].iov_base = buf;
+    vec[2].iov_len  = strlen(buf) + 1;
+    sync_write_to_log(LOG_ID_MAIN, vec, 3);
+
+    pthread_mutex_lock(&async_lock);
+}
+
+static void *__log_flusher(void *unused)
+{
+    pthread_mutex_lock(&async_lock);
+    for (;;) {
+        while (async_head == async_tail) {
+            __report_dropped_locked();
+            pthread_cond_broadcast(&async_empty);
+            pthread_cond_wait(&async_nonempty, &async_lock);
+        }
+
+        while (async_head != async_tail) {
+            struct log_async_entry *entry =
+                &async_ring[async_tail % LOG_ASYNC_RING];
+            struct iovec vec;
+
+            /* the producer cannot reuse this slot until tail moves */
+            pthread_mutex_unlock(&async_lock);
+            vec.iov_base = entry->payload;
+            vec.iov_len  = entry->len;
+            sync_write_to_log(entry->log_id, &vec, 1);
+            pthread_mutex_lock(&async_lock);
+
+            async_tail++;
+        }
+    }
+    return NULL;    /* not reached */
+}
+
+static int __write_to_log_async(log_id_t log_id, struct iovec *vec, size_t nr)
+{
+    struct log_async_entry *entry;
+    size_t total = 0;
+    size_t i;
+    char *cur;
+
+    for (i = 0; i < nr; i++)
+        total += vec[i].iov_len;
+
+    /* oversized records keep the old synchronous path */
+    if (total > LOG_ASYNC_PAYLOAD)
+        return sync_write_to_log(log_id, vec, nr);
+
+    pthread_mutex_lock(&async_lock);
+    if (async_head - async_tail == LOG_ASYNC_RING) {
+        async_dropped++;
+        pthread_mutex_unlock(&async_lock);
+        return total;
+    }
+
+    entry = &async_ring[async_head % LOG_ASYNC_RING];
+    entry->log_id = log_id;
+    entry->len = total;
+    cur = entry->payload;
+    for (i = 0; i < nr; i++) {
+        memcpy(cur, vec[i].iov_base, vec[i].iov_len);
+        cur += vec[i].iov_len;
+    }
+    async_head++;
+
+    pthread_cond_signal(&async_nonempty);
+    pthread_mutex_unlock(&async_lock);
+    return total;
+}
+
+/* wait for the flusher to catch up; used before aborting */
+static void __android_log_async_drain(void)
+{
+    if (write_to_log != __write_to_log_async)
+        return;
+
+    pthread_mutex_lock(&async_lock);
+    while (async_head != async_tail)
+        pthread_cond_wait(&async_empty, &async_lock);
+    pthread_mutex_unlock(&async_lock);
+}
+
+int __android_log_async_start(void)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    int result = 0;
+
+    pthread_mutex_lock(&log_init_lock);
+
+    if (write_to_log == __write_to_log_async)
+        goto done;
+
+    if (write_to_log == __write_to_log_init)
+        __open_log_devices();
+    if (write_to_log == __write_to_log_null) {
+        result = -1;
+        goto done;
+    }
+
+    async_ring = malloc(LOG_ASYNC_RING * sizeof(struct log_async_entry));
+    if (async_ring == NULL) {
+        result = -1;
+        goto done;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, __log_flusher, NULL) != 0) {
+        free(async_ring);
+        async_ring = NULL;
+        result = -1;
+    } else {
+        sync_write_to_log = write_to_log;
+        write_to_log = __write_to_log_async;
+    }
+    pthread_attr_destroy(&attr);
+
+done:
+    pthread_mutex_unlock(&log_init_lock);
+    return result;
+}
+
+int __android_log_async_dropped(void)
+{
+    int dropped;
+
+    pthread_mutex_lock(&async_lock);
+    dropped = async_dropped;
+    pthread_mutex_unlock(&async_lock);
+    return dropped;
+}
+
+#else  /* !HAVE_PTHREADS */
+
+static void __android_log_async_drain(void)
+{
+}
+
+int __android_log_async_start(void)
+{
+    return -1;
+}
+
+int __android_log_async_dropped(void)
+{
+    return 0;
+}
+
+#endif /* HAVE_PTHREADS */
+
 int __android_log_write(int prio, const char *tag, const char *msg)
 {
     struct iovec vec[3];
@@ -194,6 +406,9 @@ void __android_log_assert(const char *cond, const char *tag,
 
     __android_log_write(ANDROID_LOG_FATAL, tag, buf);
 
+    /* make sure the message reaches the device before we die */
+    __android_log_async_drain();
+
     __builtin_trap(); /* trap so we have a chance to debug the situation */
 }
 
@@ -228,3 +443,116 @@ int __android_log_btwrite(int32_t tag, char type, const void *payload,
 
     return write_to_log(LOG_ID_EVENTS, vec, 3);
 }
+
+/*
+ * Serialization for typed event records.  These must produce exactly
+ * what android_log_printBinaryEvent() in logprint.c consumes: values
+ * are little-endian regardless of host order.
+ */
+static inline void put4LE(unsigned char *dst, uint32_t val)
+{
+    dst[0] = val & 0xff;
+    dst[1] = (val >> 8) & 0xff;
+    dst[2] = (val >> 16) & 0xff;
+    dst[3] = (val >> 24) & 0xff;
+}
+
+static inline void put8LE(unsigned char *dst, uint64_t val)
+{
+    put4LE(dst, (uint32_t) val);
+    put4LE(dst + 4, (uint32_t) (val >> 32));
+}
+
+/*
+ * Log a string event.  The record is the type byte, the byte length,
+ * and the (unterminated) UTF-8 characters.
+ */
+int __android_log_bswrite(int32_t tag, const char *payload)
+{
+    struct iovec vec[4];
+    char type = EVENT_TYPE_STRING;
+    size_t len = strlen(payload);
+    unsigned char lenBytes[4];
+
+    put4LE(lenBytes, len);
+
+    vec[0].iov_base = &tag;
+    vec[0].iov_len = sizeof(tag);
+    vec[1].iov_base = &type;
+    vec[1].iov_len = sizeof(type);
+    vec[2].iov_base = lenBytes;
+    vec[2].iov_len = sizeof(lenBytes);
+    vec[3].iov_base = (void*)payload;
+    vec[3].iov_len = len;
+
+    return write_to_log(LOG_ID_EVENTS, vec, 4);
+}
+
+/*
+ * Log a list event built from typed arguments, avoiding any printf
+ * formatting: each character of "fmt" names the type of the matching
+ * vararg, 'i' for int32_t, 'l' for int64_t (long long), 's' for a
+ * NUL-terminated string.  So
+ *
+ *     __android_log_event_list(tag, "isl", count, name, micros);
+ *
+ * logs a three-element list record.  Returns the usual writev result,
+ * or -1 if the record doesn't fit in a single log entry or "fmt"
+ * contains an unknown type character.
+ */
+int __android_log_event_list(int32_t tag, const char *fmt, ...)
+{
+    unsigned char buf[LOG_BUF_SIZE];
+    size_t pos;
+    size_t count = strlen(fmt);
+    va_list ap;
+    int result = -1;
+
+    if (count > 255)
+        return -1;
+
+    buf[0] = EVENT_TYPE_LIST;
+    buf[1] = count;
+    pos = 2;
+
+    va_start(ap, fmt);
+    for (; *fmt != '\0'; fmt++) {
+        switch (*fmt) {
+        case 'i':
+            if (pos + 5 > sizeof(buf))
+                goto bail;
+            buf[pos++] = EVENT_TYPE_INT;
+            put4LE(buf + pos, va_arg(ap, int32_t));
+            pos += 4;
+            break;
+        case 'l':
+            if (pos + 9 > sizeof(buf))
+                goto bail;
+            buf[pos++] = EVENT_TYPE_LONG;
+            put8LE(buf + pos, va_arg(ap, int64_t));
+            pos += 8;
+            break;
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            size_t len = strlen(str);
+
+            if (pos + 5 + len > sizeof(buf))
+                goto bail;
+            buf[pos++] = EVENT_TYPE_STRING;
+            put4LE(buf + pos, len);
+            pos += 4;
+            memcpy(buf + pos, str, len);
+            pos += len;
+            break;
+        }
+        default:
+            goto bail;
+        }
+    }
+
+    result = __android_log_bwrite(tag, buf, pos);
+
+bail:
+    va_end(ap);
+    return result;
+}
@@ -33,14 +33,51 @@ typedef struct FilterInfo_t {
     char *mTag;
     android_LogPriority mPri;
     struct FilterInfo_t *p_next;
+    struct FilterInfo_t *p_bucketNext;
 } FilterInfo;
 
+/* must be a power of two */
+#define FILTER_HASH_BUCKETS 32
+
+/* longest tag the formatLogLine prefix cache bothers to remember */
+#define PREFIX_CACHE_TAG_MAX 64
+
+/*
+ * The caches at the bottom are private to android_log_formatLogLine;
+ * like the filter list, they assume a format is only used from one
+ * thread at a time.
+ */
 struct AndroidLogFormat_t {
     android_LogPriority global_pri;
     FilterInfo *filters;
+    FilterInfo *filterHash[FILTER_HASH_BUCKETS];
     AndroidLogPrintFormat format;
+
+    /* timestamp string for the last-seen second */
+    time_t timeSec;
+    int timeValid;
+    char timeBuf[32];
+
+    /* prefix/suffix built for the last (pri, tag, pid, tid) seen */
+    int prefixValid;
+    android_LogPriority prefixPri;
+    pid_t prefixPid;
+    pthread_t prefixTid;
+    char prefixTag[PREFIX_CACHE_TAG_MAX];
+    char prefixBuf[128], suffixBuf[128];
+    size_t prefixLen, suffixLen;
 };
 
+static unsigned int tagHash(const char *tag)
+{
+    unsigned int hash = 0;
+
+    while (*tag != '\0') {
+        hash = hash * 31 + (unsigned char) *tag++;
+    }
+    return hash & (FILTER_HASH_BUCKETS - 1);
+}
+
 static FilterInfo * filterinfo_new(const char * tag, android_LogPriority pri)
 {
     FilterInfo *p_ret;
@@ -123,9 +160,9 @@ static android_LogPriority filterPriForTag(
 {
     FilterInfo *p_curFilter;
 
-    for (p_curFilter = p_format->filters
+    for (p_curFilter = p_format->filterHash[tagHash(tag)]
             ; p_curFilter != NULL
-            ; p_curFilter = p_curFilter->p_next
+            ; p_curFilter = p_curFilter->p_bucketNext
     ) {
         if (0 == strcmp(tag, p_curFilter->mTag)) {
             if (p_curFilter->mPri == ANDROID_LOG_DEFAULT) {
@@ -200,6 +237,7 @@ void android_log_setPrintFormat(AndroidLogFormat *p_format,
         AndroidLogPrintFormat format)
 {
     p_format->format=format;
+    p_format->prefixValid = 0;
 }
 
 /**
@@ -285,6 +323,12 @@ int android_log_addFilterRule(AndroidLogFormat *p_format,
 
         p_fi->p_next = p_format->filters;
         p_format->filters = p_fi;
+
+        /* head insertion on both chains, so the newest rule for a
+         * tag wins the lookup either way */
+        unsigned int bucket = tagHash(p_fi->mTag);
+        p_fi->p_bucketNext = p_format->filterHash[bucket];
+        p_format->filterHash[bucket] = p_fi;
     }
 
     return 0;
@@ -663,19 +707,26 @@ char *android_log_formatLogLine (
     const AndroidLogEntry *entry,
     size_t *p_outLength)
 {
-#if defined(HAVE_LOCALTIME_R)
-    struct tm tmBuf;
-#endif
-    struct tm* ptm;
-    char timeBuf[32];
-    char headerBuf[128];
-    char prefixBuf[128], suffixBuf[128];
+    char *timeBuf = p_format->timeBuf;
+    char *prefixBuf = p_format->prefixBuf;
+    char *suffixBuf = p_format->suffixBuf;
     char priChar;
     int prefixSuffixIsHeaderFooter = 0;
+    int needTime = 0;
     char * ret = NULL;
 
     priChar = filterPriToChar(entry->priority);
 
+    switch (p_format->format) {
+        case FORMAT_TIME:
+        case FORMAT_THREADTIME:
+        case FORMAT_LONG:
+            needTime = 1;
+            break;
+        default:
+            break;
+    }
+
     /*
      * Get the current date/time in pretty form
      *
@@ -684,34 +735,59 @@ char *android_log_formatLogLine (
      * For this reason it's very annoying to have regexp meta characters
      * in the time stamp.  Don't use forward slashes, parenthesis,
      * brackets, asterisks, or other special chars here.
+     *
+     * Consecutive entries usually share a second, so the string is
+     * rebuilt only when the second changes.
      */
+    if (needTime &&
+            (!p_format->timeValid || entry->tv_sec != p_format->timeSec)) {
 #if defined(HAVE_LOCALTIME_R)
-    ptm = localtime_r(&(entry->tv_sec), &tmBuf);
+        struct tm tmBuf;
+        struct tm* ptm = localtime_r(&(entry->tv_sec), &tmBuf);
 #else
-    ptm = localtime(&(entry->tv_sec));
+        struct tm* ptm = localtime(&(entry->tv_sec));
 #endif
-    //strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", ptm);
-    strftime(timeBuf, sizeof(timeBuf), "%m-%d %H:%M:%S", ptm);
+        //strftime(timeBuf, sizeof(p_format->timeBuf), "%Y-%m-%d %H:%M:%S", ptm);
+        strftime(timeBuf, sizeof(p_format->timeBuf), "%m-%d %H:%M:%S", ptm);
+        p_format->timeSec = entry->tv_sec;
+        p_format->timeValid = 1;
+    }
 
     /*
      * Construct a buffer containing the log header and log message.
+     *
+     * The time-independent formats only depend on (priority, tag, pid,
+     * tid), and a burst of logging tends to repeat those, so the last
+     * prefix/suffix pair is kept and reused when they all match.
      */
     size_t prefixLen, suffixLen;
 
+    if (!needTime && p_format->format != FORMAT_RAW &&
+            p_format->prefixValid &&
+            p_format->prefixPri == entry->priority &&
+            p_format->prefixPid == entry->pid &&
+            p_format->prefixTid == entry->tid &&
+            strcmp(p_format->prefixTag, entry->tag) == 0) {
+        prefixLen = p_format->prefixLen;
+        suffixLen = p_format->suffixLen;
+        goto havePrefix;
+    }
+    p_format->prefixValid = 0;
+
     switch (p_format->format) {
         case FORMAT_TAG:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%c/%-8s: ", priChar, entry->tag);
             strcpy(suffixBuf, "\n"); suffixLen = 1;
             break;
         case FORMAT_PROCESS:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%c(%5d) ", priChar, entry->pid);
-            suffixLen = snprintf(suffixBuf, sizeof(suffixBuf),
+            suffixLen = snprintf(suffixBuf, sizeof(p_format->suffixBuf),
                 "  (%s)\n", entry->tag);
             break;
         case FORMAT_THREAD:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%c(%5d:%p) ", priChar, entry->pid, (void*)entry->tid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
@@ -723,21 +799,21 @@ char *android_log_formatLogLine (
             suffixLen = 1;
             break;
         case FORMAT_TIME:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%s.%03ld %c/%-8s(%5d): ", timeBuf, entry->tv_nsec / 1000000,
                 priChar, entry->tag, entry->pid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
             break;
         case FORMAT_THREADTIME:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%s.%03ld %5d %5d %c %-8s: ", timeBuf, entry->tv_nsec / 1000000,
                 (int)entry->pid, (int)entry->tid, priChar, entry->tag);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
             break;
         case FORMAT_LONG:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "[ %s.%03ld %5d:%p %c/%-8s ]\n",
                 timeBuf, entry->tv_nsec / 1000000, entry->pid,
                 (void*)entry->tid, priChar, entry->tag);
@@ -747,13 +823,26 @@ char *android_log_formatLogLine (
             break;
         case FORMAT_BRIEF:
         default:
-            prefixLen = snprintf(prefixBuf, sizeof(prefixBuf),
+            prefixLen = snprintf(prefixBuf, sizeof(p_format->prefixBuf),
                 "%c/%-8s(%5d): ", priChar, entry->tag, entry->pid);
             strcpy(suffixBuf, "\n");
             suffixLen = 1;
             break;
     }
 
+    if (!needTime && p_format->format != FORMAT_RAW &&
+            strlen(entry->tag) < PREFIX_CACHE_TAG_MAX) {
+        p_format->prefixPri = entry->priority;
+        p_format->prefixPid = entry->pid;
+        p_format->prefixTid = entry->tid;
+        strcpy(p_format->prefixTag, entry->tag);
+        p_format->prefixLen = prefixLen;
+        p_format->suffixLen = suffixLen;
+        p_format->prefixValid = 1;
+    }
+
+havePrefix:
+
     /* the following code is tragically unreadable */
 
     size_t numLines;
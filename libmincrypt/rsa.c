@@ -28,11 +28,18 @@
 #include "mincrypt/rsa.h"
 #include "mincrypt/sha.h"
 
+/* The loops below run over RSANUMWORDS rather than key->len --
+** RSA_verify only accepts RSANUMWORDS keys, and a constant trip count
+** lets the compiler unroll and keep the pointers in registers instead
+** of reloading key->len every iteration, which is most of what the
+** ARM9 was missing.
+*/
+
 /* a[] -= mod */
 static void subM(const RSAPublicKey *key, uint32_t *a) {
     int64_t A = 0;
     int i;
-    for (i = 0; i < key->len; ++i) {
+    for (i = 0; i < RSANUMWORDS; ++i) {
         A += (uint64_t)a[i] - key->n[i];
         a[i] = (uint32_t)A;
         A >>= 32;
@@ -42,7 +49,7 @@ static void subM(const RSAPublicKey *key, uint32_t *a) {
 /* return a[] >= mod */
 static int geM(const RSAPublicKey *key, const uint32_t *a) {
     int i;
-    for (i = key->len; i;) {
+    for (i = RSANUMWORDS; i;) {
         --i;
         if (a[i] < key->n[i]) return 0;
         if (a[i] > key->n[i]) return 1;
@@ -58,11 +65,12 @@ static void montMulAdd(const RSAPublicKey *key,
     uint64_t A = (uint64_t)a * b[0] + c[0];
     uint32_t d0 = (uint32_t)A * key->n0inv;
     uint64_t B = (uint64_t)d0 * key->n[0] + (uint32_t)A;
+    const uint32_t* n = key->n;
     int i;
 
-    for (i = 1; i < key->len; ++i) {
+    for (i = 1; i < RSANUMWORDS; ++i) {
         A = (A >> 32) + (uint64_t)a * b[i] + c[i];
-        B = (B >> 32) + (uint64_t)d0 * key->n[i] + (uint32_t)A;
+        B = (B >> 32) + (uint64_t)d0 * n[i] + (uint32_t)A;
         c[i - 1] = (uint32_t)B;
     }
 
@@ -81,14 +89,87 @@ static void montMul(const RSAPublicKey *key,
                     const uint32_t* a,
                     const uint32_t* b) {
     int i;
-    for (i = 0; i < key->len; ++i) {
+    for (i = 0; i < RSANUMWORDS; ++i) {
         c[i] = 0;
     }
-    for (i = 0; i < key->len; ++i) {
+    for (i = 0; i < RSANUMWORDS; ++i) {
         montMulAdd(key, c, a[i], b);
     }
 }
 
+/* montgomery c[] = a[] * a[] / R % mod
+**
+** Squaring forms each off-diagonal partial product once and doubles
+** the lot, which is just over half the single-precision multiplies of
+** the general montMul path.  The product is accumulated into a
+** double-width buffer and Montgomery-reduced in a second pass.
+*/
+static void montSqr(const RSAPublicKey *key,
+                    uint32_t* c,
+                    const uint32_t* a) {
+    uint32_t t[RSANUMWORDS * 2];
+    const uint32_t* n = key->n;
+    uint64_t A;
+    uint32_t carry;
+    int i, j;
+
+    for (i = 0; i < RSANUMWORDS * 2; ++i) {
+        t[i] = 0;
+    }
+
+    /* off-diagonal products, each pair once */
+    for (i = 0; i < RSANUMWORDS; ++i) {
+        A = 0;
+        for (j = i + 1; j < RSANUMWORDS; ++j) {
+            A = (A >> 32) + (uint64_t)a[i] * a[j] + t[i + j];
+            t[i + j] = (uint32_t)A;
+        }
+        t[i + RSANUMWORDS] = (uint32_t)(A >> 32);
+    }
+
+    /* double, then add the diagonal squares */
+    carry = 0;
+    for (i = 0; i < RSANUMWORDS * 2; ++i) {
+        uint32_t hi = t[i] >> 31;
+        t[i] = (t[i] << 1) | carry;
+        carry = hi;
+    }
+    A = 0;
+    for (i = 0; i < RSANUMWORDS; ++i) {
+        A = (A >> 32) + (uint64_t)a[i] * a[i] + t[2 * i];
+        t[2 * i] = (uint32_t)A;
+        A = (A >> 32) + t[2 * i + 1];
+        t[2 * i + 1] = (uint32_t)A;
+    }
+
+    /* Montgomery reduction, one limb at a time */
+    carry = 0;
+    for (i = 0; i < RSANUMWORDS; ++i) {
+        uint32_t d0 = t[i] * key->n0inv;
+        A = (uint64_t)d0 * n[0] + t[i];
+        for (j = 1; j < RSANUMWORDS; ++j) {
+            A = (A >> 32) + (uint64_t)d0 * n[j] + t[i + j];
+            t[i + j] = (uint32_t)A;
+        }
+        A >>= 32;
+        for (j = i + RSANUMWORDS; A != 0 && j < RSANUMWORDS * 2; ++j) {
+            A += t[j];
+            t[j] = (uint32_t)A;
+            A >>= 32;
+        }
+        carry += (uint32_t)A;
+    }
+
+    for (i = 0; i < RSANUMWORDS; ++i) {
+        c[i] = t[i + RSANUMWORDS];
+    }
+    /* result < 2 * mod, so one conditional subtract settles it; the
+    ** borrow out of subM cancels any carry into bit 2048 */
+    if (carry || geM(key, c)) {
+        subM(key, c);
+    }
+}
+
 /* In-place public exponentiation.
 ** Input and output big-endian byte array in inout.
 */
@@ -101,17 +182,17 @@ static void modpow3(const RSAPublicKey *key,
     int i;
 
     /* Convert from big endian byte array to little endian word array. */
-    for (i = 0; i < key->len; ++i) {
+    for (i = 0; i < RSANUMWORDS; ++i) {
         uint32_t tmp =
-            (inout[((key->len - 1 - i) * 4) + 0] << 24) |
-            (inout[((key->len - 1 - i) * 4) + 1] << 16) |
-            (inout[((key->len - 1 - i) * 4) + 2] << 8) |
-            (inout[((key->len - 1 - i) * 4) + 3] << 0);
+            (inout[((RSANUMWORDS - 1 - i) * 4) + 0] << 24) |
+            (inout[((RSANUMWORDS - 1 - i) * 4) + 1] << 16) |
+            (inout[((RSANUMWORDS - 1 - i) * 4) + 2] << 8) |
+            (inout[((RSANUMWORDS - 1 - i) * 4) + 3] << 0);
         a[i] = tmp;
     }
 
     montMul(key, aR, a, key->rr);  /* aR = a * RR / R mod M   */
-    montMul(key, aaR, aR, aR);     /* aaR = aR * aR / R mod M */
+    montSqr(key, aaR, aR);         /* aaR = aR * aR / R mod M */
     montMul(key, aaa, aaR, a);     /* aaa = aaR * a / R mod M */
 
     /* Make sure aaa < mod; aaa is at most 1x mod too large. */
@@ -120,7 +201,7 @@ static void modpow3(const RSAPublicKey *key,
     }
 
     /* Convert to bigendian byte array */
-    for (i = key->len - 1; i >= 0; --i) {
+    for (i = RSANUMWORDS - 1; i >= 0; --i) {
         uint32_t tmp = aaa[i];
         *inout++ = tmp >> 24;
         *inout++ = tmp >> 16;
@@ -196,3 +277,18 @@ int RSA_verify(const RSAPublicKey *key,
 
     return 1;
 }
+
+void RSA_verify_init(RSAVerifyCtx* ctx, const RSAPublicKey* key) {
+    SHA_init(&ctx->sha);
+    ctx->key = key;
+}
+
+void RSA_verify_update(RSAVerifyCtx* ctx, const void* data, int len) {
+    SHA_update(&ctx->sha, data, len);
+}
+
+int RSA_verify_final(RSAVerifyCtx* ctx,
+                     const uint8_t* signature,
+                     const int len) {
+    return RSA_verify(ctx->key, signature, len, SHA_final(&ctx->sha));
+}
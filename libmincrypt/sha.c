@@ -27,24 +27,43 @@
 
 #include "mincrypt/sha.h"
 
+#include <string.h>
+
 #define rol(bits, value) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
-static void SHA1_transform(SHA_CTX *ctx) {
-    uint32_t W[80];
-    uint32_t A, B, C, D, E;
-    uint8_t *p = ctx->buf;
+/* The compression function is fully unrolled with a 16-word rolling
+** message schedule, so W[] stays in registers (or one cache line)
+** instead of an 80-word spill, and the round logic has no branches.
+** This is where nearly all of the hashing time goes.
+*/
+
+/* message schedule: rounds 16..79 reuse the 16-word window in place */
+#define M(t) (tmp = W[((t)-3)&15] ^ W[((t)-8)&15] ^ W[((t)-14)&15] \
+                  ^ W[(t)&15], W[(t)&15] = rol(1, tmp))
+
+#define F1(B,C,D) ((D)^((B)&((C)^(D))))
+#define F2(B,C,D) ((B)^(C)^(D))
+#define F3(B,C,D) (((B)&(C))|((D)&((B)|(C))))
+
+#define R0(A,B,C,D,E,t) \
+    E += rol(5,A) + F1(B,C,D) + W[t] + 0x5A827999; B = rol(30,B)
+#define R1(A,B,C,D,E,t) \
+    E += rol(5,A) + F1(B,C,D) + M(t) + 0x5A827999; B = rol(30,B)
+#define R2(A,B,C,D,E,t) \
+    E += rol(5,A) + F2(B,C,D) + M(t) + 0x6ED9EBA1; B = rol(30,B)
+#define R3(A,B,C,D,E,t) \
+    E += rol(5,A) + F3(B,C,D) + M(t) + 0x8F1BBCDC; B = rol(30,B)
+#define R4(A,B,C,D,E,t) \
+    E += rol(5,A) + F2(B,C,D) + M(t) + 0xCA62C1D6; B = rol(30,B)
+
+static void SHA1_transform(SHA_CTX *ctx, const uint8_t *p) {
+    uint32_t W[16];
+    uint32_t A, B, C, D, E, tmp;
     int t;
 
     for(t = 0; t < 16; ++t) {
-        uint32_t tmp =  *p++ << 24;
-        tmp |= *p++ << 16;
-        tmp |= *p++ << 8;
-        tmp |= *p++;
-        W[t] = tmp;
-    }
-
-    for(; t < 80; t++) {
-        W[t] = rol(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
+        W[t] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        p += 4;
     }
 
     A = ctx->state[0];
@@ -53,24 +72,26 @@ static void SHA1_transform(SHA_CTX *ctx) {
     D = ctx->state[3];
     E = ctx->state[4];
 
-    for(t = 0; t < 80; t++) {
-        uint32_t tmp = rol(5,A) + E + W[t];
-
-        if (t < 20)
-            tmp += (D^(B&(C^D))) + 0x5A827999;
-        else if ( t < 40)
-            tmp += (B^C^D) + 0x6ED9EBA1;
-        else if ( t < 60)
-            tmp += ((B&C)|(D&(B|C))) + 0x8F1BBCDC;
-        else
-            tmp += (B^C^D) + 0xCA62C1D6;
-
-        E = D;
-        D = C;
-        C = rol(30,B);
-        B = A;
-        A = tmp;
-    }
+    R0(A,B,C,D,E, 0); R0(E,A,B,C,D, 1); R0(D,E,A,B,C, 2); R0(C,D,E,A,B, 3);
+    R0(B,C,D,E,A, 4); R0(A,B,C,D,E, 5); R0(E,A,B,C,D, 6); R0(D,E,A,B,C, 7);
+    R0(C,D,E,A,B, 8); R0(B,C,D,E,A, 9); R0(A,B,C,D,E,10); R0(E,A,B,C,D,11);
+    R0(D,E,A,B,C,12); R0(C,D,E,A,B,13); R0(B,C,D,E,A,14); R0(A,B,C,D,E,15);
+    R1(E,A,B,C,D,16); R1(D,E,A,B,C,17); R1(C,D,E,A,B,18); R1(B,C,D,E,A,19);
+    R2(A,B,C,D,E,20); R2(E,A,B,C,D,21); R2(D,E,A,B,C,22); R2(C,D,E,A,B,23);
+    R2(B,C,D,E,A,24); R2(A,B,C,D,E,25); R2(E,A,B,C,D,26); R2(D,E,A,B,C,27);
+    R2(C,D,E,A,B,28); R2(B,C,D,E,A,29); R2(A,B,C,D,E,30); R2(E,A,B,C,D,31);
+    R2(D,E,A,B,C,32); R2(C,D,E,A,B,33); R2(B,C,D,E,A,34); R2(A,B,C,D,E,35);
+    R2(E,A,B,C,D,36); R2(D,E,A,B,C,37); R2(C,D,E,A,B,38); R2(B,C,D,E,A,39);
+    R3(A,B,C,D,E,40); R3(E,A,B,C,D,41); R3(D,E,A,B,C,42); R3(C,D,E,A,B,43);
+    R3(B,C,D,E,A,44); R3(A,B,C,D,E,45); R3(E,A,B,C,D,46); R3(D,E,A,B,C,47);
+    R3(C,D,E,A,B,48); R3(B,C,D,E,A,49); R3(A,B,C,D,E,50); R3(E,A,B,C,D,51);
+    R3(D,E,A,B,C,52); R3(C,D,E,A,B,53); R3(B,C,D,E,A,54); R3(A,B,C,D,E,55);
+    R3(E,A,B,C,D,56); R3(D,E,A,B,C,57); R3(C,D,E,A,B,58); R3(B,C,D,E,A,59);
+    R4(A,B,C,D,E,60); R4(E,A,B,C,D,61); R4(D,E,A,B,C,62); R4(C,D,E,A,B,63);
+    R4(B,C,D,E,A,64); R4(A,B,C,D,E,65); R4(E,A,B,C,D,66); R4(D,E,A,B,C,67);
+    R4(C,D,E,A,B,68); R4(B,C,D,E,A,69); R4(A,B,C,D,E,70); R4(E,A,B,C,D,71);
+    R4(D,E,A,B,C,72); R4(C,D,E,A,B,73); R4(B,C,D,E,A,74); R4(A,B,C,D,E,75);
+    R4(E,A,B,C,D,76); R4(D,E,A,B,C,77); R4(C,D,E,A,B,78); R4(B,C,D,E,A,79);
 
     ctx->state[0] += A;
     ctx->state[1] += B;
@@ -94,12 +115,28 @@ void SHA_update(SHA_CTX *ctx, const void *data, int len) {
 
     ctx->count += len;
 
-    while (len--) {
-        ctx->buf[i++] = *p++;
-        if (i == sizeof(ctx->buf)) {
-            SHA1_transform(ctx);
-            i = 0;
+    /* top up a partial block first */
+    if (i != 0) {
+        int n = sizeof(ctx->buf) - i;
+        if (n > len) n = len;
+        memcpy(&ctx->buf[i], p, n);
+        p += n;
+        len -= n;
+        if (i + n < (int) sizeof(ctx->buf)) {
+            return;
         }
+        SHA1_transform(ctx, ctx->buf);
+    }
+
+    /* whole blocks straight from the caller's buffer, no copy */
+    while (len >= (int) sizeof(ctx->buf)) {
+        SHA1_transform(ctx, p);
+        p += sizeof(ctx->buf);
+        len -= sizeof(ctx->buf);
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buf, p, len);
     }
 }
 const uint8_t *SHA_final(SHA_CTX *ctx) {
@@ -127,6 +164,39 @@ const uint8_t *SHA_final(SHA_CTX *ctx) {
     return ctx->buf;
 }
 
+void SHA_save(const SHA_CTX *ctx, uint8_t *state) {
+    uint8_t *p = state;
+    int i;
+
+    for (i = 0; i < 8; ++i) {
+        *p++ = ctx->count >> ((7 - i) * 8);
+    }
+    for (i = 0; i < 5; ++i) {
+        uint32_t tmp = ctx->state[i];
+        *p++ = tmp >> 24;
+        *p++ = tmp >> 16;
+        *p++ = tmp >> 8;
+        *p++ = tmp >> 0;
+    }
+    memcpy(p, ctx->buf, sizeof(ctx->buf));
+}
+
+void SHA_restore(SHA_CTX *ctx, const uint8_t *state) {
+    const uint8_t *p = state;
+    int i;
+
+    ctx->count = 0;
+    for (i = 0; i < 8; ++i) {
+        ctx->count = (ctx->count << 8) | *p++;
+    }
+    for (i = 0; i < 5; ++i) {
+        ctx->state[i] = ((uint32_t)p[0] << 24) | (p[1] << 16) |
+                        (p[2] << 8) | p[3];
+        p += 4;
+    }
+    memcpy(ctx->buf, p, sizeof(ctx->buf));
+}
+
 /* Convenience function */
 const uint8_t* SHA(const void *data, int len, uint8_t *digest) {
     const uint8_t *p;
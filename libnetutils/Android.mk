@@ -6,6 +6,7 @@ LOCAL_SRC_FILES:= \
         dhcpmsg.c \
         dhcp_utils.c \
         ifc_utils.c \
+        netstats.c \
 	packet.c
 
 LOCAL_SHARED_LIBRARIES := \
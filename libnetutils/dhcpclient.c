@@ -19,7 +19,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <time.h>
 #include <sys/time.h>
@@ -399,10 +401,116 @@ static int is_valid_reply(dhcp_msg *msg, dhcp_msg *reply, int sz)
 
 #define STATE_SELECTING  1
 #define STATE_REQUESTING 2
+#define STATE_REBOOTING  3
 
 #define TIMEOUT_INITIAL   4000
 #define TIMEOUT_MAX      32000
 
+/* A cached-lease request gets one quick retry before we give up and
+** fall back to full discovery; a stale lease must not cost more than
+** a few seconds on top of what discovery would have taken anyway.
+*/
+#define TIMEOUT_REBOOT    2000
+
+#ifndef LEASE_DIR
+#define LEASE_DIR "/data/misc/dhcp"
+#endif
+#define LEASE_MAGIC 0x4c454153
+
+typedef struct dhcp_lease {
+    uint32_t magic;
+    uint32_t expires;       /* wall clock, seconds */
+    dhcp_info info;
+} dhcp_lease;
+
+/* Distinguishes leases for the same interface on different networks.
+** The wifi layer sets this to the BSSID before kicking off dhcp, so
+** rejoining a known network finds its old lease and a new network
+** misses.  Anything filename-hostile is mapped to '_'.
+*/
+static char lease_key[64] = "default";
+
+void dhcp_set_lease_key(const char *key)
+{
+    unsigned i;
+
+    for (i = 0; key[i] != 0 && i < sizeof(lease_key) - 1; i++) {
+        if ((key[i] >= 'a' && key[i] <= 'z')
+                || (key[i] >= 'A' && key[i] <= 'Z')
+                || (key[i] >= '0' && key[i] <= '9')
+                || key[i] == ':' || key[i] == '-' || key[i] == '.') {
+            lease_key[i] = key[i];
+        } else {
+            lease_key[i] = '_';
+        }
+    }
+    lease_key[i] = 0;
+}
+
+static void lease_path(const char *ifname, char *path, int size)
+{
+    snprintf(path, size, LEASE_DIR "/%s-%s.lease", ifname, lease_key);
+}
+
+static int load_lease(const char *ifname, dhcp_info *info)
+{
+    char path[128];
+    dhcp_lease lease;
+    int fd, r;
+
+    lease_path(ifname, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    r = read(fd, &lease, sizeof(lease));
+    close(fd);
+
+    if (r != sizeof(lease) || lease.magic != LEASE_MAGIC) {
+        unlink(path);
+        return -1;
+    }
+    /* don't bother renewing a lease that is about to run out */
+    if ((uint32_t) time(0) + 60 >= lease.expires) {
+        unlink(path);
+        return -1;
+    }
+
+    *info = lease.info;
+    return 0;
+}
+
+static void save_lease(const char *ifname, dhcp_info *info)
+{
+    char path[128];
+    dhcp_lease lease;
+    int fd;
+
+    if (info->lease == 0) return;
+
+    mkdir(LEASE_DIR, 0700);
+
+    lease.magic = LEASE_MAGIC;
+    lease.expires = (uint32_t) time(0) + info->lease;
+    lease.info = *info;
+
+    lease_path(ifname, path, sizeof(path));
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return;
+    if (write(fd, &lease, sizeof(lease)) != sizeof(lease)) {
+        close(fd);
+        unlink(path);
+        return;
+    }
+    close(fd);
+}
+
+static void remove_lease(const char *ifname)
+{
+    char path[128];
+
+    lease_path(ifname, path, sizeof(path));
+    unlink(path);
+}
+
 int dhcp_init_ifc(const char *ifname)
 {
     dhcp_msg discover_msg;
@@ -410,6 +518,7 @@ int dhcp_init_ifc(const char *ifname)
     dhcp_msg reply;
     dhcp_msg *msg;
     dhcp_info info;
+    dhcp_info lease;
     int s, r, size;
     int valid_reply;
     uint32_t xid;
@@ -430,8 +539,19 @@ int dhcp_init_ifc(const char *ifname)
 
     s = open_raw_socket(ifname, hwaddr, if_index);
 
-    timeout = TIMEOUT_INITIAL;
-    state = STATE_SELECTING;
+    /* If we hold an unexpired lease for this network, skip discovery
+    ** and try to reclaim the old address with a quick INIT-REBOOT
+    ** request first (RFC 2131 4.3.2).
+    */
+    if (load_lease(ifname, &lease) == 0) {
+        printerr("trying cached lease %s for %s\n",
+                 ipaddr(lease.ipaddr), ifname);
+        timeout = TIMEOUT_REBOOT;
+        state = STATE_REBOOTING;
+    } else {
+        timeout = TIMEOUT_INITIAL;
+        state = STATE_SELECTING;
+    }
     info.type = 0;
     goto transmit;
 
@@ -445,6 +565,13 @@ int dhcp_init_ifc(const char *ifname)
 #if VERBOSE
             printerr("TIMEOUT\n");
 #endif
+            if (state == STATE_REBOOTING && timeout > TIMEOUT_REBOOT) {
+                printerr("no answer to cached-lease request, reverting to discovery\n");
+                state = STATE_SELECTING;
+                timeout = TIMEOUT_INITIAL;
+                xid++;
+                goto transmit;
+            }
             if (timeout >= TIMEOUT_MAX) {
                 printerr("timed out\n");
                 if ( info.type == DHCPOFFER ) {
@@ -469,6 +596,10 @@ int dhcp_init_ifc(const char *ifname)
                 msg = &request_msg;
                 size = init_dhcp_request_msg(msg, hwaddr, xid, info.ipaddr, info.serveraddr);
                 break;
+            case STATE_REBOOTING:
+                msg = &request_msg;
+                size = init_dhcp_request_msg(msg, hwaddr, xid, lease.ipaddr, 0);
+                break;
             default:
                 r = 0;
             }
@@ -530,6 +661,7 @@ int dhcp_init_ifc(const char *ifname)
             if (info.type == DHCPACK) {
                 printerr("configuring %s\n", ifname);
                 close(s);
+                save_lease(ifname, &info);
                 return ifc_configure(ifname, &info);
             } else if (info.type == DHCPNAK) {
                 printerr("configuration request denied\n");
@@ -540,6 +672,24 @@ int dhcp_init_ifc(const char *ifname)
                          dhcp_type_to_name(info.type), state);
             }
             break;
+        case STATE_REBOOTING:
+            if (info.type == DHCPACK) {
+                printerr("cached lease renewed, configuring %s\n", ifname);
+                close(s);
+                save_lease(ifname, &info);
+                return ifc_configure(ifname, &info);
+            } else if (info.type == DHCPNAK) {
+                printerr("cached lease refused, reverting to discovery\n");
+                remove_lease(ifname);
+                state = STATE_SELECTING;
+                timeout = TIMEOUT_INITIAL;
+                xid++;
+                goto transmit;
+            } else {
+                printerr("ignoring %s message in state %d\n",
+                         dhcp_type_to_name(info.type), state);
+            }
+            break;
         }
     }
     close(s);
@@ -89,10 +89,15 @@ int init_dhcp_request_msg(dhcp_msg *msg, void *hwaddr, uint32_t xid,
     memcpy(x, &ipaddr, 4);
     x +=  4;
 
-    *x++ = OPT_SERVER_ID;
-    *x++ = 4;
-    memcpy(x, &serveraddr, 4);
-    x += 4;
+    /* An INIT-REBOOT request (RFC 2131 4.3.2) must not carry a server
+    ** identifier; passing serveraddr == 0 selects that flavor.
+    */
+    if (serveraddr != 0) {
+        *x++ = OPT_SERVER_ID;
+        *x++ = 4;
+        memcpy(x, &serveraddr, 4);
+        x += 4;
+    }
 
     *x++ = OPT_END;
 
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Bulk network statistics over netlink.  One dump request returns every
+ * socket (inet_diag) or every interface with its counters (rtnetlink),
+ * so callers get binary records instead of parsing /proc text a line at
+ * a time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "netstats.h"
+
+/* from <linux/inet_diag.h> */
+
+#ifndef NETLINK_INET_DIAG
+#define NETLINK_INET_DIAG 4
+#endif
+#define TCPDIAG_GETSOCK 18
+
+struct inet_diag_sockid {
+    __u16 idiag_sport;
+    __u16 idiag_dport;
+    __u32 idiag_src[4];
+    __u32 idiag_dst[4];
+    __u32 idiag_if;
+    __u32 idiag_cookie[2];
+};
+
+struct inet_diag_req {
+    __u8 idiag_family;
+    __u8 idiag_src_len;
+    __u8 idiag_dst_len;
+    __u8 idiag_ext;
+    struct inet_diag_sockid id;
+    __u32 idiag_states;
+    __u32 idiag_dbs;
+};
+
+struct inet_diag_msg {
+    __u8 idiag_family;
+    __u8 idiag_state;
+    __u8 idiag_timer;
+    __u8 idiag_retrans;
+    struct inet_diag_sockid id;
+    __u32 idiag_expires;
+    __u32 idiag_rqueue;
+    __u32 idiag_wqueue;
+    __u32 idiag_uid;
+    __u32 idiag_inode;
+};
+
+/* end <linux/inet_diag.h> */
+
+/* Send one netlink dump request and walk the reply messages, letting
+ * record() copy each one into the caller's array.  Returns the number
+ * of records stored, or -1 if the kernel rejected the request.
+ */
+static int netlink_dump(int proto, struct nlmsghdr *req,
+                        int (*record)(struct nlmsghdr *nh, void *list,
+                                      int nr, int max),
+                        void *list, int max)
+{
+    char buf[8192];
+    struct sockaddr_nl addr;
+    struct nlmsghdr *nh;
+    int s, len, nr = 0;
+
+    s = socket(AF_NETLINK, SOCK_RAW, proto);
+    if (s < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+
+    req->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req->nlmsg_seq = 1;
+    if (sendto(s, req, req->nlmsg_len, 0,
+               (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(s);
+        return -1;
+    }
+
+    for (;;) {
+        len = recv(s, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            close(s);
+            return -1;
+        }
+        for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len);
+             nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == NLMSG_DONE) {
+                close(s);
+                return nr;
+            }
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                close(s);
+                return -1;
+            }
+            nr = record(nh, list, nr, max);
+        }
+    }
+}
+
+static int record_link(struct nlmsghdr *nh, void *ptr, int nr, int max)
+{
+    struct netstats_if *ifs = (struct netstats_if *)ptr + nr;
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    struct rtattr *rta = IFLA_RTA(ifi);
+    struct rtnl_link_stats *st;
+    int len = IFLA_PAYLOAD(nh);
+
+    if (nh->nlmsg_type != RTM_NEWLINK || nr >= max)
+        return nr;
+
+    memset(ifs, 0, sizeof(*ifs));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        switch (rta->rta_type) {
+        case IFLA_IFNAME:
+            strncpy(ifs->name, RTA_DATA(rta), sizeof(ifs->name) - 1);
+            break;
+        case IFLA_MTU:
+            ifs->mtu = *(unsigned *)RTA_DATA(rta);
+            break;
+        case IFLA_STATS:
+            st = RTA_DATA(rta);
+            ifs->rx_bytes = st->rx_bytes;
+            ifs->rx_packets = st->rx_packets;
+            ifs->rx_errors = st->rx_errors;
+            ifs->rx_dropped = st->rx_dropped;
+            ifs->tx_bytes = st->tx_bytes;
+            ifs->tx_packets = st->tx_packets;
+            ifs->tx_errors = st->tx_errors;
+            ifs->tx_dropped = st->tx_dropped;
+            break;
+        }
+    }
+    return nr + 1;
+}
+
+int netstats_get_interfaces(struct netstats_if *list, int max)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct ifinfomsg ifi;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifi));
+    req.nh.nlmsg_type = RTM_GETLINK;
+    req.ifi.ifi_family = AF_UNSPEC;
+
+    return netlink_dump(NETLINK_ROUTE, &req.nh, record_link, list, max);
+}
+
+static int record_sock(struct nlmsghdr *nh, void *ptr, int nr, int max)
+{
+    struct netstats_socket *sk = (struct netstats_socket *)ptr + nr;
+    struct inet_diag_msg *msg = NLMSG_DATA(nh);
+
+    if (nh->nlmsg_type != TCPDIAG_GETSOCK || nr >= max)
+        return nr;
+    if (msg->idiag_family != AF_INET)
+        return nr;
+
+    sk->local_addr = msg->id.idiag_src[0];
+    sk->remote_addr = msg->id.idiag_dst[0];
+    sk->local_port = ntohs(msg->id.idiag_sport);
+    sk->remote_port = ntohs(msg->id.idiag_dport);
+    sk->txq = msg->idiag_wqueue;
+    sk->rxq = msg->idiag_rqueue;
+    sk->state = msg->idiag_state;
+    return nr + 1;
+}
+
+/* /proc/net/{tcp,udp} parser, used when the kernel does not support
+ * inet_diag and always for udp, which has no diag handler.
+ */
+static int sockets_from_proc(const char *path,
+                             struct netstats_socket *list, int max)
+{
+    char buf[512];
+    unsigned num, laddr, lport, raddr, rport, state, txq, rxq;
+    int nr = 0;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp == 0)
+        return -1;
+    fgets(buf, 512, fp);
+    while (nr < max && fgets(buf, 512, fp)) {
+        if (sscanf(buf, " %d: %x:%x %x:%x %x %x:%x",
+                   &num, &laddr, &lport, &raddr, &rport,
+                   &state, &txq, &rxq) == 8) {
+            list[nr].local_addr = laddr;
+            list[nr].remote_addr = raddr;
+            list[nr].local_port = lport;
+            list[nr].remote_port = rport;
+            list[nr].txq = txq;
+            list[nr].rxq = rxq;
+            list[nr].state = state;
+            nr++;
+        }
+    }
+    fclose(fp);
+    return nr;
+}
+
+int netstats_get_tcp(struct netstats_socket *list, int max)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct inet_diag_req r;
+    } req;
+    int nr;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.r));
+    req.nh.nlmsg_type = TCPDIAG_GETSOCK;
+    req.r.idiag_family = AF_INET;
+    req.r.idiag_states = ~0;
+
+    nr = netlink_dump(NETLINK_INET_DIAG, &req.nh, record_sock, list, max);
+    if (nr < 0)
+        nr = sockets_from_proc("/proc/net/tcp", list, max);
+    return nr;
+}
+
+int netstats_get_udp(struct netstats_socket *list, int max)
+{
+    return sockets_from_proc("/proc/net/udp", list, max);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2008, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NETSTATS_H_
+#define _NETSTATS_H_
+
+struct netstats_socket {
+    unsigned local_addr;        /* network byte order */
+    unsigned remote_addr;       /* network byte order */
+    unsigned txq;
+    unsigned rxq;
+    unsigned short local_port;  /* host byte order */
+    unsigned short remote_port; /* host byte order */
+    unsigned char state;        /* TCP_ESTABLISHED, ... */
+};
+
+struct netstats_if {
+    char name[16];
+    unsigned mtu;
+
+    unsigned rx_bytes;
+    unsigned rx_packets;
+    unsigned rx_errors;
+    unsigned rx_dropped;
+
+    unsigned tx_bytes;
+    unsigned tx_packets;
+    unsigned tx_errors;
+    unsigned tx_dropped;
+};
+
+int netstats_get_tcp(struct netstats_socket *list, int max);
+int netstats_get_udp(struct netstats_socket *list, int max);
+int netstats_get_interfaces(struct netstats_if *list, int max);
+
+#endif
@@ -23,6 +23,7 @@
 #include <netinet/udp.h>
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
+#include <linux/filter.h>
 #include <errno.h>
 
 #ifdef ANDROID
@@ -39,15 +40,45 @@
 
 int fatal();
 
+/* Matches IPv4 UDP datagrams for the bootp client port (and only the
+** first fragment, since the udp header is only in that one).  The
+** filter runs in the kernel, so on a busy network the client is no
+** longer woken up once per broadcast packet just to throw it away in
+** receive_packet(); the userspace checks stay as a backstop.
+**
+** Offsets are from the start of the IP header (SOCK_DGRAM gives us
+** cooked packets with the link level header stripped).
+*/
+static struct sock_filter bootp_reply_filter[] = {
+    BPF_STMT(BPF_LD  | BPF_B | BPF_ABS, 9),                  /* protocol  */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+    BPF_STMT(BPF_LD  | BPF_H | BPF_ABS, 6),                  /* frag_off  */
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                  /* X = 4*ihl */
+    BPF_STMT(BPF_LD  | BPF_H | BPF_IND, 2),                  /* udp dest  */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PORT_BOOTP_CLIENT, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
 int open_raw_socket(const char *ifname, uint8_t *hwaddr, int if_index)
 {
     int s, flag;
     struct sockaddr_ll bindaddr;
+    struct sock_fprog filter;
 
     if((s = socket(PF_PACKET, SOCK_DGRAM, htons(ETH_P_IP))) < 0) {
         return fatal("socket(PF_PACKET)");
     }
 
+    filter.len = sizeof(bootp_reply_filter) / sizeof(bootp_reply_filter[0]);
+    filter.filter = bootp_reply_filter;
+    if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &filter, sizeof(filter)) < 0) {
+        /* not fatal; we just fall back to filtering in userspace */
+        LOGW("Cannot attach socket filter: %s\n", strerror(errno));
+    }
+
     memset(&bindaddr, 0, sizeof(bindaddr));
     bindaddr.sll_family = AF_PACKET;
     bindaddr.sll_protocol = htons(ETH_P_IP);
@@ -57,6 +57,8 @@ ifneq ($(TARGET_ARCH),arm)
 # TODO: move the simulator logging functions into libcutils with
 # the rest of the basic log stuff.
 LOCAL_SHARED_LIBRARIES += libutils
+# the rect_memcpy helper thread in scanline.cpp
+LOCAL_LDLIBS += -lpthread
 endif
 
 #
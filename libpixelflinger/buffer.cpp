@@ -19,6 +19,7 @@
 #include <assert.h>
 
 #include "buffer.h"
+#include "clear.h"
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -32,6 +33,32 @@ static void readRGB565(const surface_t* s, context_t* c,
 static void readABGR8888(const surface_t* s, context_t* c,
         uint32_t x, uint32_t y, pixel_t* pixel);
 
+static void read_pixel_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel);
+static void write_pixel_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixel);
+static void readRGB565_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel);
+static void readABGR8888_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel);
+static void read_span_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count);
+static void write_span_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count);
+
+static void read_pixel_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count);
+static void write_pixel_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count);
+static void readRGB565_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count);
+static void readABGR8888_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count);
+static void writeRGB565_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count);
+static void writeABGR8888_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count);
+
 static uint32_t logic_op(int op, uint32_t s, uint32_t d);
 static uint32_t extract(uint32_t v, int h, int l, int bits);
 static uint32_t expand(uint32_t v, int sbits, int dbits);
@@ -51,6 +78,8 @@ void ggl_init_texture(context_t* c)
         t.min_filter = GGL_NEAREST;
         t.mag_filter = GGL_NEAREST;
         t.env = GGL_MODULATE;
+        t.sampled = &t.surface;
+        t.lod_count = 0;
     }
     c->activeTMU = &(c->state.texture[0]);
 }
@@ -62,6 +91,7 @@ void ggl_set_surface(context_t* c, surface_t* dst, const GGLSurface* src)
     dst->stride = src->stride;
     dst->data = src->data;
     dst->format = src->format;
+    dst->flags = src->flags;
     dst->dirty = 1;
     if (__builtin_expect(dst->stride < 0, false)) {
         const GGLFormat& pixelFormat(c->formats[dst->format]);
@@ -70,13 +100,47 @@ void ggl_set_surface(context_t* c, surface_t* dst, const GGLSurface* src)
     }
 }
 
+// texel index of (x,y) in a 4x4-tiled surface.  the stride gives the
+// pitch of a row of blocks, rounded up to a multiple of 4.
+static inline int32_t tiled_index(const surface_t* s, uint32_t x, uint32_t y)
+{
+    const int32_t bpr = (s->stride + 3) >> 2;
+    return (((y>>2)*bpr + (x>>2))<<4) + ((y&3)<<2) + (x&3);
+}
+
 static void pick_read_write(surface_t* s)
 {
+    if (s->flags & GGL_SURFACE_TILED_4X4) {
+        // the linear readers/writers below (and the shortcut or
+        // generated scanlines) assume row-major addressing
+        switch (s->format) {
+            case GGL_PIXEL_FORMAT_RGBA_8888: s->read = readABGR8888_tiled; break;
+            case GGL_PIXEL_FORMAT_RGB_565:   s->read = readRGB565_tiled;   break;
+            default:                         s->read = read_pixel_tiled;   break;
+        }
+        s->write = write_pixel_tiled;
+        s->read_span = read_span_tiled;
+        s->write_span = write_span_tiled;
+        return;
+    }
+
     // Choose best reader/writers.
     switch (s->format) {
-        case GGL_PIXEL_FORMAT_RGBA_8888:    s->read = readABGR8888;  break;
-        case GGL_PIXEL_FORMAT_RGB_565:      s->read = readRGB565;    break;
-        default:                            s->read = read_pixel;    break;
+        case GGL_PIXEL_FORMAT_RGBA_8888:
+            s->read = readABGR8888;
+            s->read_span = readABGR8888_span;
+            s->write_span = writeABGR8888_span;
+            break;
+        case GGL_PIXEL_FORMAT_RGB_565:
+            s->read = readRGB565;
+            s->read_span = readRGB565_span;
+            s->write_span = writeRGB565_span;
+            break;
+        default:
+            s->read = read_pixel;
+            s->read_span = read_pixel_span;
+            s->write_span = write_pixel_span;
+            break;
     }
     s->write = write_pixel;
 }
@@ -84,8 +148,18 @@ static void pick_read_write(surface_t* s)
 void ggl_pick_texture(context_t* c)
 {
     for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; ++i) {
-        surface_t& s = c->state.texture[i].surface;
-        if ((!c->state.texture[i].enable) || (!s.dirty))
+        texture_t& t = c->state.texture[i];
+        surface_t& s = t.surface;
+        if (!t.enable)
+            continue;
+        for (int j=0 ; j<t.lod_count ; j++) {
+            surface_t& l = t.lod[j];
+            if (l.dirty) {
+                l.dirty = 0;
+                pick_read_write(&l);
+            }
+        }
+        if (!s.dirty)
             continue;
         s.dirty = 0;
         pick_read_write(&s);
@@ -108,13 +182,10 @@ void ggl_pick_cb(context_t* c)
 
 // ----------------------------------------------------------------------------
 
-void read_pixel(const surface_t* s, context_t* c,
-        uint32_t x, uint32_t y, pixel_t* pixel)
+static void read_pixel_at(const surface_t* s, context_t* c,
+        int32_t index, pixel_t* pixel)
 {
-    assert((x < s->width) && (y < s->height));
-
     const GGLFormat* f = &(c->formats[s->format]);
-    int32_t index = x + (s->stride * y);
     uint8_t* const data = s->data + index * f->size;
     uint32_t v = 0;
     switch (f->size) {
@@ -130,6 +201,20 @@ void read_pixel(const surface_t* s, context_t* c,
     }
 }
 
+void read_pixel(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel)
+{
+    assert((x < s->width) && (y < s->height));
+    read_pixel_at(s, c, x + (s->stride * y), pixel);
+}
+
+void read_pixel_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel)
+{
+    assert((x < s->width) && (y < s->height));
+    read_pixel_at(s, c, tiled_index(s, x, y), pixel);
+}
+
 void readRGB565(const surface_t* s, context_t* c,
         uint32_t x, uint32_t y, pixel_t* pixel)
 {
@@ -159,11 +244,9 @@ void readABGR8888(const surface_t* s, context_t* c,
     pixel->s[3] = 8;
 }
 
-void write_pixel(const surface_t* s, context_t* c,
-        uint32_t x, uint32_t y, const pixel_t* pixel)
+static void write_pixel_at(const surface_t* s, context_t* c,
+        int32_t index, uint32_t x, uint32_t y, const pixel_t* pixel)
 {
-    assert((x < s->width) && (y < s->height));
-
     int dither = -1;
     if (c->state.enables & GGL_ENABLE_DITHER) {
         dither = c->ditherMatrix[ (x & GGL_DITHER_MASK) +
@@ -171,7 +254,6 @@ void write_pixel(const surface_t* s, context_t* c,
     }
 
     const GGLFormat* f = &(c->formats[s->format]);
-    int32_t index = x + (s->stride * y);
     uint8_t* const data = s->data + index * f->size;
         
     uint32_t mask = 0;
@@ -225,6 +307,325 @@ void write_pixel(const surface_t* s, context_t* c,
     }
 }
 
+void write_pixel(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixel)
+{
+    assert((x < s->width) && (y < s->height));
+    write_pixel_at(s, c, x + (s->stride * y), x, y, pixel);
+}
+
+void write_pixel_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixel)
+{
+    assert((x < s->width) && (y < s->height));
+    write_pixel_at(s, c, tiled_index(s, x, y), x, y, pixel);
+}
+
+void readRGB565_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel)
+{
+    uint16_t v = *(reinterpret_cast<uint16_t*>(s->data) + tiled_index(s, x, y));
+    pixel->c[0] = 0;
+    pixel->c[1] = v>>11;
+    pixel->c[2] = (v>>5)&0x3F;
+    pixel->c[3] = v&0x1F;
+    pixel->s[0] = 0;
+    pixel->s[1] = 5;
+    pixel->s[2] = 6;
+    pixel->s[3] = 5;
+}
+
+void readABGR8888_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixel)
+{
+    uint32_t v = *(reinterpret_cast<uint32_t*>(s->data) + tiled_index(s, x, y));
+    v = GGL_RGBA_TO_HOST(v);
+    pixel->c[0] = v>>24;        // A
+    pixel->c[1] = v&0xFF;       // R
+    pixel->c[2] = (v>>8)&0xFF;  // G
+    pixel->c[3] = (v>>16)&0xFF; // B
+    pixel->s[0] =
+    pixel->s[1] =
+    pixel->s[2] =
+    pixel->s[3] = 8;
+}
+
+void read_span_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count)
+{
+    while (count--) {
+        s->read(s, c, x, y, pixels);
+        x++;
+        pixels++;
+    }
+}
+
+void write_span_tiled(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count)
+{
+    while (count--) {
+        s->write(s, c, x, y, pixels);
+        x++;
+        pixels++;
+    }
+}
+
+/* span variants of the reader/writers above.  the generic versions
+** just hoist the format lookup and pointer math out of the per-pixel
+** loop; the RGB565/ABGR8888 versions convert whole runs with direct
+** loads/stores, so the generic scanline doesn't pay an indirect call
+** and its attendant branches for every pixel.
+*/
+
+// true when the surface is the color buffer and some of its tiles are
+// still only flagged as cleared (see the tile-status fast clear in
+// clear.cpp); readers then substitute the clear constant
+static inline int tile_status_active(const surface_t* s, const context_t* c)
+{
+    return ggl_unlikely(c->tileActive != 0) &&
+            (s->data == c->state.buffers.color.data) &&
+            !(s->flags & GGL_SURFACE_TILED_4X4);
+}
+
+static inline int tile_flagged(const context_t* c, uint32_t x, uint32_t y)
+{
+    return c->tileStatus[(y>>GGL_TILE_SHIFT)*c->tileCols +
+                         (x>>GGL_TILE_SHIFT)];
+}
+
+void read_pixel_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count)
+{
+    assert((x+count <= s->width) && (y < s->height));
+
+    const GGLFormat* f = &(c->formats[s->format]);
+    int32_t index = x + (s->stride * y);
+    const uint8_t* data = s->data + index * f->size;
+
+    if (tile_status_active(s, c)) {
+        while (count--) {
+            uint32_t v = 0;
+            if (tile_flagged(c, x, y)) {
+                v = (f->size == 4) ? GGL_RGBA_TO_HOST(c->tileClearColor)
+                                   : c->tileClearColor;
+            } else {
+                switch (f->size) {
+                    case 1: v = *data;                                  break;
+                    case 2: v = *(uint16_t*)data;                       break;
+                    case 3: v = (data[2]<<16)|(data[1]<<8)|data[0];     break;
+                    case 4: v = GGL_RGBA_TO_HOST(*(uint32_t*)data);     break;
+                }
+            }
+            for (int i=0 ; i<4 ; i++) {
+                pixels->s[i] = f->c[i].h - f->c[i].l;
+                if (pixels->s[i])
+                    pixels->c[i] = extract(v, f->c[i].h, f->c[i].l, f->size*8);
+            }
+            data += f->size;
+            x++;
+            pixels++;
+        }
+        return;
+    }
+
+    while (count--) {
+        uint32_t v = 0;
+        switch (f->size) {
+            case 1:     v = *data;                                  break;
+            case 2:     v = *(uint16_t*)data;                       break;
+            case 3:     v = (data[2]<<16)|(data[1]<<8)|data[0];     break;
+            case 4:     v = GGL_RGBA_TO_HOST(*(uint32_t*)data);     break;
+        }
+        for (int i=0 ; i<4 ; i++) {
+            pixels->s[i] = f->c[i].h - f->c[i].l;
+            if (pixels->s[i])
+                pixels->c[i] = extract(v, f->c[i].h, f->c[i].l, f->size*8);
+        }
+        data += f->size;
+        pixels++;
+    }
+}
+
+void readRGB565_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count)
+{
+    const uint16_t* p =
+            reinterpret_cast<uint16_t*>(s->data) + (x + (s->stride * y));
+    if (tile_status_active(s, c)) {
+        while (count--) {
+            const uint16_t v = tile_flagged(c, x, y) ?
+                    uint16_t(c->tileClearColor) : *p;
+            p++;
+            pixels->c[0] = 0;
+            pixels->c[1] = v>>11;
+            pixels->c[2] = (v>>5)&0x3F;
+            pixels->c[3] = v&0x1F;
+            pixels->s[0] = 0;
+            pixels->s[1] = 5;
+            pixels->s[2] = 6;
+            pixels->s[3] = 5;
+            x++;
+            pixels++;
+        }
+        return;
+    }
+    while (count--) {
+        uint16_t v = *p++;
+        pixels->c[0] = 0;
+        pixels->c[1] = v>>11;
+        pixels->c[2] = (v>>5)&0x3F;
+        pixels->c[3] = v&0x1F;
+        pixels->s[0] = 0;
+        pixels->s[1] = 5;
+        pixels->s[2] = 6;
+        pixels->s[3] = 5;
+        pixels++;
+    }
+}
+
+void readABGR8888_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, pixel_t* pixels, uint32_t count)
+{
+    const uint32_t* p =
+            reinterpret_cast<uint32_t*>(s->data) + (x + (s->stride * y));
+    if (tile_status_active(s, c)) {
+        while (count--) {
+            const uint32_t v = GGL_RGBA_TO_HOST(
+                    tile_flagged(c, x, y) ? c->tileClearColor : *p);
+            p++;
+            pixels->c[0] = v>>24;        // A
+            pixels->c[1] = v&0xFF;       // R
+            pixels->c[2] = (v>>8)&0xFF;  // G
+            pixels->c[3] = (v>>16)&0xFF; // B
+            pixels->s[0] =
+            pixels->s[1] =
+            pixels->s[2] =
+            pixels->s[3] = 8;
+            x++;
+            pixels++;
+        }
+        return;
+    }
+    while (count--) {
+        uint32_t v = GGL_RGBA_TO_HOST(*p++);
+        pixels->c[0] = v>>24;        // A
+        pixels->c[1] = v&0xFF;       // R
+        pixels->c[2] = (v>>8)&0xFF;  // G
+        pixels->c[3] = (v>>16)&0xFF; // B
+        pixels->s[0] =
+        pixels->s[1] =
+        pixels->s[2] =
+        pixels->s[3] = 8;
+        pixels++;
+    }
+}
+
+void write_pixel_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count)
+{
+    while (count--) {
+        write_pixel(s, c, x, y, pixels);
+        x++;
+        pixels++;
+    }
+}
+
+// returns true when the straight store path below matches what
+// write_pixel would do: all components enabled, no logic-op, and no
+// dithering (write_pixel truncates rather than dithers or rounds)
+static inline int write_span_is_simple(const context_t* c)
+{
+    return (c->state.mask.color == 0xF) &&
+           !(c->state.enables & (GGL_ENABLE_LOGIC_OP|GGL_ENABLE_DITHER));
+}
+
+// narrow a component to dbits, same truncation as write_pixel
+static inline uint32_t narrow_component(uint32_t u, int sbits, int dbits)
+{
+    if (sbits < dbits) {
+        u = expand(u, sbits, dbits);
+        sbits = dbits;
+    }
+    return u >> (sbits - dbits);
+}
+
+// dither and narrow a component to dbits, same rounding as
+// downshift_component.  dither must already be looked up for (x,y)
+static inline uint32_t dither_component(uint32_t u, int sbits, int dbits,
+        int dither)
+{
+    if (sbits < dbits) {
+        u = expand(u, sbits, dbits);
+        sbits = dbits;
+    }
+    if (sbits > dbits) {
+        u -= u >> dbits;   // fix up, keeps the sum below 1<<sbits
+        const int shift = GGL_DITHER_BITS - (sbits - dbits);
+        if (shift >= 0)   u += dither >> shift;
+        else              u += dither << (-shift);
+    }
+    return u >> (sbits - dbits);
+}
+
+void writeRGB565_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count)
+{
+    if (!write_span_is_simple(c)) {
+        if ((c->state.mask.color == 0xF) &&
+                !(c->state.enables & GGL_ENABLE_LOGIC_OP)) {
+            // dithering is the only thing keeping us off the straight
+            // store path.  the kernel row only depends on y, so hoist
+            // it out of the loop instead of recomputing the matrix
+            // index for each pixel like write_pixel does
+            const uint8_t* ditherRow = &c->ditherMatrix[
+                    (y & GGL_DITHER_MASK) << GGL_DITHER_ORDER_SHIFT];
+            uint16_t* p = reinterpret_cast<uint16_t*>(s->data) +
+                    (x + (s->stride * y));
+            while (count--) {
+                const int dither = ditherRow[x & GGL_DITHER_MASK];
+                const uint32_t r =
+                        dither_component(pixels->c[1], pixels->s[1], 5, dither);
+                const uint32_t g =
+                        dither_component(pixels->c[2], pixels->s[2], 6, dither);
+                const uint32_t b =
+                        dither_component(pixels->c[3], pixels->s[3], 5, dither);
+                *p++ = (r<<11) | (g<<5) | b;
+                x++;
+                pixels++;
+            }
+            return;
+        }
+        write_pixel_span(s, c, x, y, pixels, count);
+        return;
+    }
+    uint16_t* p = reinterpret_cast<uint16_t*>(s->data) + (x + (s->stride * y));
+    while (count--) {
+        const uint32_t r = narrow_component(pixels->c[1], pixels->s[1], 5);
+        const uint32_t g = narrow_component(pixels->c[2], pixels->s[2], 6);
+        const uint32_t b = narrow_component(pixels->c[3], pixels->s[3], 5);
+        *p++ = (r<<11) | (g<<5) | b;
+        pixels++;
+    }
+}
+
+void writeABGR8888_span(const surface_t* s, context_t* c,
+        uint32_t x, uint32_t y, const pixel_t* pixels, uint32_t count)
+{
+    if (!write_span_is_simple(c)) {
+        write_pixel_span(s, c, x, y, pixels, count);
+        return;
+    }
+    uint32_t* p = reinterpret_cast<uint32_t*>(s->data) + (x + (s->stride * y));
+    while (count--) {
+        const uint32_t a = narrow_component(pixels->c[0], pixels->s[0], 8);
+        const uint32_t r = narrow_component(pixels->c[1], pixels->s[1], 8);
+        const uint32_t g = narrow_component(pixels->c[2], pixels->s[2], 8);
+        const uint32_t b = narrow_component(pixels->c[3], pixels->s[3], 8);
+        *p++ = GGL_HOST_TO_RGBA((a<<24) | (b<<16) | (g<<8) | r);
+        pixels++;
+    }
+}
+
 static uint32_t logic_op(int op, uint32_t s, uint32_t d)
 {
     switch(op) {
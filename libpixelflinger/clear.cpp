@@ -15,10 +15,14 @@
 ** limitations under the License.
 */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <cutils/memory.h>
 
 #include "clear.h"
 #include "buffer.h"
+#include "scanline.h"
 
 namespace android {
 
@@ -26,9 +30,11 @@ namespace android {
 
 static void ggl_clear(void* c, GGLbitfield mask);
 static void ggl_clearColorx(void* c,
-        GGLclampx r, GGLclampx g, GGLclampx b, GGLclampx a);        
+        GGLclampx r, GGLclampx g, GGLclampx b, GGLclampx a);
 static void ggl_clearDepthx(void* c, GGLclampx depth);
 static void ggl_clearStencil(void* c, GGLint s);
+static void ggl_clearDeferred(void* c, GGLbitfield mask);
+static void ggl_clearTiled(void* c, GGLbitfield mask);
 
 // ----------------------------------------------------------------------------
 
@@ -39,6 +45,8 @@ void ggl_init_clear(context_t* c)
     GGL_INIT_PROC(procs, clearColorx);
     GGL_INIT_PROC(procs, clearDepthx);
     GGL_INIT_PROC(procs, clearStencil);
+    GGL_INIT_PROC(procs, clearDeferred);
+    GGL_INIT_PROC(procs, clearTiled);
     c->state.clear.dirty =  GGL_STENCIL_BUFFER_BIT |
                             GGL_COLOR_BUFFER_BIT |
                             GGL_DEPTH_BUFFER_BIT;
@@ -89,6 +97,311 @@ static inline GGLfixed fixedToZ(GGLfixed z) {
     return GGLfixed(((int64_t(z) << 16) - z) >> 16);
 }
 
+// current clear color, packed in the color buffer's format
+// (memory byte order, ready for memset2d)
+static uint32_t clear_color_packed(context_t* c)
+{
+    if (c->state.clear.dirty & GGL_COLOR_BUFFER_BIT) {
+        c->state.clear.dirty &= ~GGL_COLOR_BUFFER_BIT;
+
+        uint32_t colorPacked = ggl_pack_color(c,
+                c->state.buffers.color.format,
+                gglFixedToIteratedColor(c->state.clear.r),
+                gglFixedToIteratedColor(c->state.clear.g),
+                gglFixedToIteratedColor(c->state.clear.b),
+                gglFixedToIteratedColor(c->state.clear.a));
+
+        c->state.clear.colorPacked = GGL_HOST_TO_RGBA(colorPacked);
+    }
+    return c->state.clear.colorPacked;
+}
+
+void ggl_clear_region(context_t* c, uint32_t mask,
+        uint32_t l, uint32_t t, uint32_t w, uint32_t h)
+{
+    if (!w || !h)
+        return;
+
+    if (mask & GGL_COLOR_BUFFER_BIT) {
+        const uint32_t packed = clear_color_packed(c);
+        memset2d(c, c->state.buffers.color, packed, l, t, w, h);
+    }
+    if (mask & GGL_DEPTH_BUFFER_BIT) {
+        if (c->state.clear.dirty & GGL_DEPTH_BUFFER_BIT) {
+            c->state.clear.dirty &= ~GGL_DEPTH_BUFFER_BIT;
+            uint32_t depth = fixedToZ(c->state.clear.depth);
+            c->state.clear.depthPacked = (depth<<16)|depth;
+        }
+        const uint32_t packed = c->state.clear.depthPacked;
+        memset2d(c, c->state.buffers.depth, packed, l, t, w, h);
+    }
+
+    // XXX: do stencil buffer
+}
+
+// ----------------------------------------------------------------------------
+
+static int occlusion_resize(context_t* c)
+{
+    const uint32_t rows = c->state.buffers.color.height;
+    if (c->occlusionRows < rows) {
+        occlusion_row_t* o = (occlusion_row_t*)realloc(c->occlusion,
+                rows * sizeof(occlusion_row_t));
+        if (o == 0)
+            return 0;
+        c->occlusion = o;
+        c->occlusionRows = rows;
+    }
+    return c->occlusion != 0;
+}
+
+static void occlusion_reset(context_t* c)
+{
+    if (c->occlusion) {
+        // l==r means "nothing drawn", settled==0 "clear still pending"
+        memset(c->occlusion, 0,
+                c->occlusionRows * sizeof(occlusion_row_t));
+    }
+}
+
+void ggl_resolve_deferred_clear(context_t* c)
+{
+    const uint32_t mask = c->deferredClear;
+    if (!mask)
+        return;
+    c->deferredClear = 0;
+
+    const uint32_t l = c->clearLeft;
+    const uint32_t t = c->clearTop;
+    const uint32_t r = c->clearRight;
+    const uint32_t b = c->clearBottom;
+
+    if (mask & GGL_COLOR_BUFFER_BIT) {
+        // clear each row, skipping what opaque spans already wrote
+        for (uint32_t y=t ; y<b && y<c->occlusionRows ; y++) {
+            const occlusion_row_t& row = c->occlusion[y];
+            if (row.settled)
+                continue;
+            if (row.l >= row.r) {
+                ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, y, r-l, 1);
+                continue;
+            }
+            if (uint32_t(row.l) > l) {
+                const uint32_t e = uint32_t(row.l) < r ? uint32_t(row.l) : r;
+                ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, y, e-l, 1);
+            }
+            if (uint32_t(row.r) < r) {
+                const uint32_t s = uint32_t(row.r) > l ? uint32_t(row.r) : l;
+                ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, s, y, r-s, 1);
+            }
+        }
+    }
+    if (mask & GGL_DEPTH_BUFFER_BIT)
+        ggl_clear_region(c, GGL_DEPTH_BUFFER_BIT, l, t, r-l, b-t);
+}
+
+void ggl_enable_occlusion_culling(context_t* c, int enable)
+{
+    if (enable && !occlusion_resize(c))
+        enable = 0;
+    if (c->occlusionEnabled != uint32_t(enable)) {
+        c->occlusionEnabled = enable;
+        if (enable) {
+            occlusion_reset(c);
+            ggl_install_span_guard(c);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+// tile-status fast clear.  one status byte per 16x16 tile of the color
+// buffer; a set byte means the tile still holds c->tileClearColor
+// instead of real pixels.  the span guard in scanline.cpp materializes
+// tiles as rendering touches them, and the span readers in buffer.cpp
+// substitute the constant for tiles that are still only flagged.
+
+static int tile_resize(context_t* c)
+{
+    const uint32_t cols = (c->state.buffers.color.width
+            + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    const uint32_t rows = (c->state.buffers.color.height
+            + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    if (c->tileCols != cols || c->tileRows != rows) {
+        // the pitch changes, old flags would land on the wrong tiles
+        ggl_tile_resolve_all(c);
+        uint8_t* status = (uint8_t*)realloc(c->tileStatus, cols*rows);
+        if (status == 0)
+            return 0;
+        memset(status, 0, cols*rows);
+        c->tileStatus = status;
+        c->tileCols = cols;
+        c->tileRows = rows;
+    }
+    return c->tileStatus != 0;
+}
+
+void ggl_tile_resolve(context_t* c,
+        int32_t l, int32_t t, int32_t r, int32_t b)
+{
+    if (!c->tileActive)
+        return;
+
+    const surface_t& cb = c->state.buffers.color;
+    if (l < 0) l = 0;
+    if (t < 0) t = 0;
+    if (r > int32_t(cb.width))  r = cb.width;
+    if (b > int32_t(cb.height)) b = cb.height;
+    if (l >= r || t >= b)
+        return;
+
+    const uint32_t tl = uint32_t(l) >> GGL_TILE_SHIFT;
+    const uint32_t tt = uint32_t(t) >> GGL_TILE_SHIFT;
+    const uint32_t tr = (uint32_t(r) + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    const uint32_t tb = (uint32_t(b) + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+
+    for (uint32_t ty=tt ; ty<tb && ty<c->tileRows ; ty++) {
+        uint8_t* row = c->tileStatus + ty*c->tileCols;
+        const uint32_t py = ty << GGL_TILE_SHIFT;
+        const uint32_t ph = (py + GGL_TILE_SIZE <= cb.height) ?
+                GGL_TILE_SIZE : (cb.height - py);
+        for (uint32_t tx=tl ; tx<tr && tx<c->tileCols ; tx++) {
+            if (!row[tx])
+                continue;
+            row[tx] = 0;
+            c->tileActive--;
+            const uint32_t px = tx << GGL_TILE_SHIFT;
+            const uint32_t pw = (px + GGL_TILE_SIZE <= cb.width) ?
+                    GGL_TILE_SIZE : (cb.width - px);
+            memset2d(c, cb, c->tileClearColor, px, py, pw, ph);
+        }
+    }
+}
+
+void ggl_tile_resolve_all(context_t* c)
+{
+    if (c->tileActive) {
+        ggl_tile_resolve(c, 0, 0,
+                c->state.buffers.color.width,
+                c->state.buffers.color.height);
+    }
+}
+
+// an eager clear of [l,r)x[t,b) is about to overwrite the pixels:
+// drop the flags of tiles it fully covers, materialize partial ones
+static void tile_forget(context_t* c,
+        uint32_t l, uint32_t t, uint32_t r, uint32_t b)
+{
+    const surface_t& cb = c->state.buffers.color;
+    const uint32_t tl = l >> GGL_TILE_SHIFT;
+    const uint32_t tt = t >> GGL_TILE_SHIFT;
+    const uint32_t tr = (r + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    const uint32_t tb = (b + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+
+    for (uint32_t ty=tt ; ty<tb && ty<c->tileRows && c->tileActive ; ty++) {
+        uint8_t* row = c->tileStatus + ty*c->tileCols;
+        const uint32_t py = ty << GGL_TILE_SHIFT;
+        const uint32_t pb = py + GGL_TILE_SIZE < cb.height ?
+                py + GGL_TILE_SIZE : cb.height;
+        for (uint32_t tx=tl ; tx<tr && tx<c->tileCols ; tx++) {
+            if (!row[tx])
+                continue;
+            const uint32_t px = tx << GGL_TILE_SHIFT;
+            const uint32_t pr = px + GGL_TILE_SIZE < cb.width ?
+                    px + GGL_TILE_SIZE : cb.width;
+            if (px >= l && pr <= r && py >= t && pb <= b) {
+                // fully covered, the clear will write it anyway
+                row[tx] = 0;
+                c->tileActive--;
+            } else {
+                ggl_tile_resolve(c, px, py, pr, pb);
+            }
+        }
+    }
+}
+
+static void ggl_clearTiled(void* con, GGLbitfield mask)
+{
+    GGL_CONTEXT(c, con);
+
+    // settle the older mechanisms first so the tile flags end up the
+    // only thing pending on the color plane
+    ggl_resolve_deferred_clear(c);
+
+    if (c->state.buffers.color.format == 0)
+        mask &= ~GGL_COLOR_BUFFER_BIT;
+
+    if (!(mask & GGL_COLOR_BUFFER_BIT)) {
+        // resolve-only call, or planes we don't track
+        ggl_tile_resolve_all(c);
+        if (mask)
+            ggl_clear(con, mask);
+        return;
+    }
+    if (mask & ~GGL_COLOR_BUFFER_BIT)
+        ggl_clear(con, mask & ~GGL_COLOR_BUFFER_BIT);
+
+    const uint32_t l = c->state.scissor.left;
+    const uint32_t t = c->state.scissor.top;
+    const uint32_t r = c->state.scissor.right;
+    const uint32_t b = c->state.scissor.bottom;
+    if (l >= r || t >= b)
+        return;
+
+    const uint32_t packed = clear_color_packed(c);
+    if (!tile_resize(c)) {
+        // can't track status, clear eagerly
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, t, r-l, b-t);
+        return;
+    }
+    if (c->tileActive && packed != c->tileClearColor) {
+        // leftover flags promise a different constant
+        ggl_tile_resolve_all(c);
+    }
+    c->tileClearColor = packed;
+    occlusion_reset(c);
+
+    const surface_t& cb = c->state.buffers.color;
+
+    // tiles wholly inside the scissor become a flag write
+    const uint32_t tl = (l + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    const uint32_t tt = (t + GGL_TILE_SIZE-1) >> GGL_TILE_SHIFT;
+    const uint32_t tr = (r >= cb.width)  ? c->tileCols : (r >> GGL_TILE_SHIFT);
+    const uint32_t tb = (b >= cb.height) ? c->tileRows : (b >> GGL_TILE_SHIFT);
+
+    if (tl >= tr || tt >= tb) {
+        // scissor too small to cover a single tile
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, t, r-l, b-t);
+        return;
+    }
+
+    for (uint32_t ty=tt ; ty<tb ; ty++) {
+        uint8_t* row = c->tileStatus + ty*c->tileCols;
+        for (uint32_t tx=tl ; tx<tr ; tx++) {
+            c->tileActive += !row[tx];
+            row[tx] = 1;
+        }
+    }
+
+    // boundary strips not covered by whole tiles clear eagerly
+    const uint32_t il = tl << GGL_TILE_SHIFT;
+    const uint32_t it = tt << GGL_TILE_SHIFT;
+    const uint32_t ir = (tr == c->tileCols) ? r : (tr << GGL_TILE_SHIFT);
+    const uint32_t ib = (tb == c->tileRows) ? b : (tb << GGL_TILE_SHIFT);
+    if (t < it)
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, t, r-l, it-t);
+    if (ib < b)
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, ib, r-l, b-ib);
+    if (l < il)
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, it, il-l, ib-it);
+    if (ir < r)
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, ir, it, r-ir, ib-it);
+
+    ggl_install_span_guard(c);
+}
+
+// ----------------------------------------------------------------------------
+
 static void ggl_clear(void* con, GGLbitfield mask)
 {
     GGL_CONTEXT(c, con);
@@ -114,33 +427,61 @@ static void ggl_clear(void* con, GGLbitfield mask)
     if (c->state.buffers.stencil.format == 0)
         mask &= ~GGL_STENCIL_BUFFER_BIT;
 
-    if (mask & GGL_COLOR_BUFFER_BIT) {
-        if (c->state.clear.dirty & GGL_COLOR_BUFFER_BIT) {
-            c->state.clear.dirty &= ~GGL_COLOR_BUFFER_BIT;
-
-            uint32_t colorPacked = ggl_pack_color(c,
-                    c->state.buffers.color.format,
-                    gglFixedToIteratedColor(c->state.clear.r),
-                    gglFixedToIteratedColor(c->state.clear.g),
-                    gglFixedToIteratedColor(c->state.clear.b),
-                    gglFixedToIteratedColor(c->state.clear.a));
-
-            c->state.clear.colorPacked = GGL_HOST_TO_RGBA(colorPacked);
+    if (c->deferredClear) {
+        // this clear supersedes whatever is still pending on the
+        // buffers it covers at least as much of
+        if (l <= c->clearLeft && t <= c->clearTop &&
+            l+w >= c->clearRight && t+h >= c->clearBottom) {
+            c->deferredClear &= ~mask;
         }
-        const uint32_t packed = c->state.clear.colorPacked;
-        memset2d(c, c->state.buffers.color, packed, l, t, w, h);
+        ggl_resolve_deferred_clear(c);
     }
-    if (mask & GGL_DEPTH_BUFFER_BIT) {
-        if (c->state.clear.dirty & GGL_DEPTH_BUFFER_BIT) {
-            c->state.clear.dirty &= ~GGL_DEPTH_BUFFER_BIT;
-            uint32_t depth = fixedToZ(c->state.clear.depth);
-            c->state.clear.depthPacked = (depth<<16)|depth;
-        }
-        const uint32_t packed = c->state.clear.depthPacked;
-        memset2d(c, c->state.buffers.depth, packed, l, t, w, h);
+    occlusion_reset(c);
+
+    if (c->tileActive && (mask & GGL_COLOR_BUFFER_BIT)) {
+        // this clear overwrites whatever the tile flags promised
+        tile_forget(c, l, t, l+w, t+h);
     }
 
-    // XXX: do stencil buffer
+    ggl_clear_region(c, mask, l, t, w, h);
+}
+
+static void ggl_clearDeferred(void* con, GGLbitfield mask)
+{
+    GGL_CONTEXT(c, con);
+
+    // settle whatever the previous frame left behind first
+    ggl_resolve_deferred_clear(c);
+    ggl_tile_resolve_all(c);
+
+    if (c->state.buffers.color.format == 0)
+        mask &= ~GGL_COLOR_BUFFER_BIT;
+    if (c->state.buffers.depth.format == 0)
+        mask &= ~GGL_DEPTH_BUFFER_BIT;
+    mask &= GGL_COLOR_BUFFER_BIT | GGL_DEPTH_BUFFER_BIT;
+    if (!mask)
+        return;
+
+    const uint32_t l = c->state.scissor.left;
+    const uint32_t t = c->state.scissor.top;
+    const uint32_t r = c->state.scissor.right;
+    const uint32_t b = c->state.scissor.bottom;
+    if (l >= r || t >= b)
+        return;
+
+    if (!occlusion_resize(c)) {
+        // can't track coverage, fall back to an eager clear
+        ggl_clear_region(c, mask, l, t, r-l, b-t);
+        return;
+    }
+
+    c->deferredClear = mask;
+    c->clearLeft = l;
+    c->clearTop = t;
+    c->clearRight = r;
+    c->clearBottom = b;
+    occlusion_reset(c);
+    ggl_install_span_guard(c);
 }
 
 static void ggl_clearColorx(void* con,
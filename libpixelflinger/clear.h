@@ -25,6 +25,24 @@ namespace android {
 
 void ggl_init_clear(context_t* c);
 
+// immediate clear of a sub-rectangle, using the current clear values.
+// shared with the lazy-clear span guard in scanline.cpp.
+void ggl_clear_region(context_t* c, uint32_t mask,
+        uint32_t l, uint32_t t, uint32_t w, uint32_t h);
+
+// settle whatever a clearDeferred() left pending
+void ggl_resolve_deferred_clear(context_t* c);
+
+void ggl_enable_occlusion_culling(context_t* c, int enable);
+
+// tile-status fast clear.  ggl_tile_resolve() materializes every
+// flagged tile intersecting the pixel rectangle [l,r)x[t,b)
+const int GGL_TILE_SHIFT = 4;
+const int GGL_TILE_SIZE  = 1 << GGL_TILE_SHIFT;
+void ggl_tile_resolve(context_t* c,
+        int32_t l, int32_t t, int32_t r, int32_t b);
+void ggl_tile_resolve_all(context_t* c);
+
 }; // namespace android
 
 #endif // ANDROID_GGL_CLEAR_H
@@ -159,8 +159,155 @@ void ARMAssembler::epilog(uint32_t touched)
     }
 }
 
+// ----------------------------------------------------------------------------
+// conservative peephole scheduling
+// ----------------------------------------------------------------------------
+
+// Classify one instruction word.  Returns 0 when the word isn't one we
+// know how to reason about (branches, LDM/STM, coprocessor...).
+// reads/writes are register bitmasks, mem is set for loads and stores,
+// setcc when the flags are written.
+int ARMAssembler::decode(uint32_t w, uint32_t* reads, uint32_t* writes,
+        int* mem, int* setcc)
+{
+    uint32_t r = 0;
+    uint32_t wr = 0;
+    int m = 0;
+    int s = 0;
+
+    if (((w & 0x0C000000) == 0x00000000) && ((w & 0x90) != 0x90)) {
+        // data processing
+        const int opcode = (w>>21) & 0xF;
+        s = (w>>20) & 1;
+        if (opcode>=8 && opcode<=11 && !s)
+            return 0;                       // MRS/MSR/BX/SMUL land here
+        if (!(opcode==13 || opcode==15))
+            r |= 1 << ((w>>16) & 0xF);      // Rn, except MOV/MVN
+        if (!(opcode>=8 && opcode<=11))
+            wr |= 1 << ((w>>12) & 0xF);     // Rd, except TST/TEQ/CMP/CMN
+        if (!(w & (1<<25))) {
+            r |= 1 << (w & 0xF);            // Rm
+            if (w & 0x10)
+                r |= 1 << ((w>>8) & 0xF);   // Rs (shift by register)
+        }
+    } else if ((w & 0x0C000000) == 0x04000000) {
+        // single data transfer
+        m = 1;
+        r |= 1 << ((w>>16) & 0xF);          // Rn
+        if (w & (1<<25))
+            r |= 1 << (w & 0xF);            // Rm (register offset)
+        if (!(w & (1<<24)) || (w & (1<<21)))
+            wr |= 1 << ((w>>16) & 0xF);     // write-back
+        if (w & (1<<20))
+            wr |= 1 << ((w>>12) & 0xF);     // LDR Rd
+        else
+            r |= 1 << ((w>>12) & 0xF);      // STR Rd
+    } else if (((w & 0x0E000090) == 0x00000090) && (w & 0x60)) {
+        // halfword / signed byte transfers
+        m = 1;
+        r |= 1 << ((w>>16) & 0xF);
+        if (!(w & (1<<22)))
+            r |= 1 << (w & 0xF);            // register offset
+        if (!(w & (1<<24)) || (w & (1<<21)))
+            wr |= 1 << ((w>>16) & 0xF);
+        if (w & (1<<20))
+            wr |= 1 << ((w>>12) & 0xF);
+        else
+            r |= 1 << ((w>>12) & 0xF);
+    } else if ((w & 0x0FC000F0) == 0x00000090) {
+        // MUL/MLA
+        s = (w>>20) & 1;
+        wr |= 1 << ((w>>16) & 0xF);         // Rd lives in 19:16 here
+        r |= 1 << (w & 0xF);                // Rm
+        r |= 1 << ((w>>8) & 0xF);           // Rs
+        if (w & (1<<21))
+            r |= 1 << ((w>>12) & 0xF);      // MLA Rn
+    } else if ((w & 0x0F8000F0) == 0x00800090) {
+        // long multiplies
+        s = (w>>20) & 1;
+        wr |= 1 << ((w>>16) & 0xF);         // RdHi
+        wr |= 1 << ((w>>12) & 0xF);         // RdLo
+        r |= 1 << (w & 0xF);                // Rm
+        r |= 1 << ((w>>8) & 0xF);           // Rs
+        if (w & (1<<21))
+            r |= wr;                        // accumulating
+    } else {
+        return 0;
+    }
+    *reads = r;
+    *writes = wr;
+    *mem = m;
+    *setcc = s;
+    return 1;
+}
+
+// Separate load-use pairs: ARM9/ARM11 stall when a load's result is
+// used by the very next instruction, which is exactly the pattern
+// load_store.cpp and blending.cpp tend to emit.  When the instruction
+// after the stalled one is a provably independent ALU op, swap the two
+// so it fills the load delay.  Swapping two adjacent words never moves
+// anything else, so branch offsets stay valid; the only extra care is
+// not swapping instructions that are branch targets themselves.
+void ARMAssembler::scheduleLoadUse()
+{
+    for (uint32_t* p = mBase ; p+2 < mPC ; p++) {
+        const uint32_t ld = p[0];
+        const uint32_t i1 = p[1];
+        const uint32_t i2 = p[2];
+        uint32_t ldR, ldW, r1, w1, r2, w2;
+        int ldM, ldS, m1, s1, m2, s2;
+
+        // an unconditional load...
+        if ((ld>>28) != 0xE)
+            continue;
+        if (!decode(ld, &ldR, &ldW, &ldM, &ldS) || !ldM || !(ld & (1<<20)))
+            continue;
+        if (!decode(i1, &r1, &w1, &m1, &s1) ||
+            !decode(i2, &r2, &w2, &m2, &s2))
+            continue;
+        // ...immediately followed by a use of its result
+        if (!(r1 & ldW))
+            continue;
+        // the filler must be an unconditional ALU op (it then neither
+        // reads nor writes the flags, whatever i1 does with them)...
+        if ((i2>>28) != 0xE || m2 || s2)
+            continue;
+        // ...with no register dependency on the load or on i1
+        if ((r2 | w2) & (ldW | w1))
+            continue;
+        if (w2 & r1)
+            continue;
+        if ((r1 | w1 | r2 | w2 | ldR | ldW) & (1<<15))
+            continue;       // anything touching the pc
+        // can't exchange instructions a branch may land on
+        int isTarget = 0;
+        const size_t nbLabels = mLabels.size();
+        for (size_t j=0 ; j<nbLabels ; j++) {
+            uint32_t* t = mLabels.valueAt(j);
+            if (t == p+1 || t == p+2) {
+                isTarget = 1;
+                break;
+            }
+        }
+        if (isTarget)
+            continue;
+
+        p[1] = i2;
+        p[2] = i1;
+        p += 2;
+    }
+}
+
 int ARMAssembler::generate(const char* name)
 {
+    char scheduler[PROPERTY_VALUE_MAX];
+    property_get("debug.pf.noscheduler", scheduler, "0");
+    if (atoi(scheduler) == 0) {
+        // safe on the not-yet-fixed-up stream: branch words don't
+        // decode as anything the pass is willing to touch
+        scheduleLoadUse();
+    }
+
     // fixup all the branches
     size_t count = mBranchTargets.size();
     while (count--) {
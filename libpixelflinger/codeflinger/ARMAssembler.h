@@ -127,6 +127,12 @@ private:
                 ARMAssembler(const ARMAssembler& rhs);
                 ARMAssembler& operator = (const ARMAssembler& rhs);
 
+    // conservative load-use scheduling over the emitted stream,
+    // see ARMAssembler.cpp
+    void        scheduleLoadUse();
+    static int  decode(uint32_t w, uint32_t* reads, uint32_t* writes,
+                    int* mem, int* setcc);
+
     sp<Assembly>    mAssembly;
     uint32_t*       mBase;
     uint32_t*       mPC;
@@ -36,8 +36,86 @@ namespace android {
 
 // ----------------------------------------------------------------------------
 
+// ----------------------------------------------------------------------------
+
+CodeArena::CodeArena(size_t size)
+    : mBase((uint32_t*)malloc(size)), mSize(size)
+{
+    pthread_mutex_init(&mLock, 0);
+    if (mBase) {
+        free_range_t r;
+        r.offset = 0;
+        r.size = size;
+        mFree.add(r);
+    }
+}
+
+CodeArena::~CodeArena()
+{
+    ::free(mBase);
+    pthread_mutex_destroy(&mLock);
+}
+
+uint32_t* CodeArena::alloc(size_t size)
+{
+    if (!mBase)
+        return 0;
+    // keep blocks cache-line aligned
+    size = (size + 31) & ~31;
+    uint32_t* block = 0;
+    pthread_mutex_lock(&mLock);
+    // first fit
+    const size_t count = mFree.size();
+    for (size_t i=0 ; i<count ; i++) {
+        if (mFree[i].size >= size) {
+            free_range_t& r = mFree.editItemAt(i);
+            block = (uint32_t*)(uintptr_t(mBase) + r.offset);
+            r.offset += size;
+            r.size -= size;
+            if (r.size == 0)
+                mFree.removeAt(i);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    return block;
+}
+
+void CodeArena::free(uint32_t* block, size_t size)
+{
+    if (!block)
+        return;
+    size = (size + 31) & ~31;
+    free_range_t r;
+    r.offset = uintptr_t(block) - uintptr_t(mBase);
+    r.size = size;
+    pthread_mutex_lock(&mLock);
+    size_t i = 0;
+    while (i < mFree.size() && mFree[i].offset < r.offset)
+        i++;
+    // coalesce with the range below...
+    if (i > 0 && mFree[i-1].offset + mFree[i-1].size == r.offset) {
+        free_range_t& prev = mFree.editItemAt(i-1);
+        prev.size += r.size;
+        // ...and with the one above
+        if (i < mFree.size() && prev.offset + prev.size == mFree[i].offset) {
+            prev.size += mFree[i].size;
+            mFree.removeAt(i);
+        }
+    } else if (i < mFree.size() && r.offset + r.size == mFree[i].offset) {
+        free_range_t& next = mFree.editItemAt(i);
+        next.offset = r.offset;
+        next.size += r.size;
+    } else {
+        mFree.insertAt(r, i);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+// ----------------------------------------------------------------------------
+
 Assembly::Assembly(size_t size)
-    : mCount(1), mSize(0)
+    : mCount(1), mSize(0), mOwnsBase(true), mArena(0)
 {
     mBase = (uint32_t*)malloc(size);
     if (mBase) {
@@ -45,9 +123,22 @@ Assembly::Assembly(size_t size)
     }
 }
 
+Assembly::Assembly(uint32_t* base, size_t size)
+    : mCount(1), mBase(base), mSize(size), mOwnsBase(false), mArena(0)
+{
+}
+
+Assembly::Assembly(uint32_t* base, size_t size, CodeArena* arena)
+    : mCount(1), mBase(base), mSize(size), mOwnsBase(false), mArena(arena)
+{
+}
+
 Assembly::~Assembly()
 {
-    free(mBase);
+    if (mOwnsBase)
+        free(mBase);
+    else if (mArena)
+        mArena->free(mBase, mSize);
 }
 
 void Assembly::incStrong(const void*) const
@@ -75,6 +166,8 @@ uint32_t* Assembly::base() const
 
 ssize_t Assembly::resize(size_t newSize)
 {
+    if (!mOwnsBase)
+        return NO_MEMORY;
     mBase = (uint32_t*)realloc(mBase, newSize);
     mSize = newSize;
     return size();
@@ -83,34 +176,37 @@ ssize_t Assembly::resize(size_t newSize)
 // ----------------------------------------------------------------------------
 
 CodeCache::CodeCache(size_t size)
-    : mCacheSize(size), mCacheInUse(0)
+    : mWhen(0), mCacheSize(size), mCacheInUse(0)
 {
-    pthread_mutex_init(&mLock, 0);
+    pthread_rwlock_init(&mLock, 0);
 }
 
 CodeCache::~CodeCache()
 {
-    pthread_mutex_destroy(&mLock);
+    pthread_rwlock_destroy(&mLock);
 }
 
 sp<Assembly> CodeCache::lookup(const AssemblyKeyBase& keyBase) const
 {
-    pthread_mutex_lock(&mLock);
+    pthread_rwlock_rdlock(&mLock);
     sp<Assembly> r;
     ssize_t index = mCacheData.indexOfKey(key_t(keyBase));
     if (index >= 0) {
         const cache_entry_t& e = mCacheData.valueAt(index);
-        e.when = mWhen++;
+        // the LRU stamp is updated under the read lock; concurrent
+        // hits on the same entry may clobber each other's stamp,
+        // which only perturbs the eviction order, never the data
+        e.when = android_atomic_inc(&mWhen);
         r = e.entry;
     }
-    pthread_mutex_unlock(&mLock);
+    pthread_rwlock_unlock(&mLock);
     return r;
 }
 
 int CodeCache::cache(  const AssemblyKeyBase& keyBase,
                             const sp<Assembly>& assembly)
 {
-    pthread_mutex_lock(&mLock);
+    pthread_rwlock_wrlock(&mLock);
 
     const ssize_t assemblySize = assembly->size();
     while (mCacheInUse + assemblySize > mCacheSize) {
@@ -128,10 +224,10 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
         mCacheData.removeItemsAt(lru);
     }
 
-    ssize_t err = mCacheData.add(key_t(keyBase), cache_entry_t(assembly, mWhen));
+    ssize_t err = mCacheData.add(key_t(keyBase),
+            cache_entry_t(assembly, android_atomic_inc(&mWhen)));
     if (err >= 0) {
         mCacheInUse += assemblySize;
-        mWhen++;
         // synchronize caches...
 #if defined(__arm__)
         const long base = long(assembly->base());
@@ -142,7 +238,7 @@ int CodeCache::cache(  const AssemblyKeyBase& keyBase,
 #endif
     }
 
-    pthread_mutex_unlock(&mLock);
+    pthread_rwlock_unlock(&mLock);
     return err;
 }
 
@@ -23,6 +23,7 @@
 #include <pthread.h>
 #include <sys/types.h>
 
+#include <utils/Vector.h>
 #include <utils/KeyedVector.h>
 
 #include "tinyutils/smartpointer.h"
@@ -52,10 +53,43 @@ private:
 
 // ----------------------------------------------------------------------------
 
+// packs finished assemblies into one contiguous block of memory, so the
+// dozens of small programs a scene uses don't end up scattered across
+// the heap: fewer icache lines and TLB pages are touched when switching
+// between them. blocks come back when the owning Assembly dies.
+class CodeArena
+{
+public:
+                CodeArena(size_t size);
+                ~CodeArena();
+
+    uint32_t*   alloc(size_t size);
+    void        free(uint32_t* block, size_t size);
+
+private:
+    struct free_range_t {
+        size_t offset;
+        size_t size;
+    };
+    pthread_mutex_t         mLock;
+    uint32_t*               mBase;
+    size_t                  mSize;
+    // sorted by offset, adjacent ranges coalesced
+    Vector<free_range_t>    mFree;
+};
+
+// ----------------------------------------------------------------------------
+
 class Assembly
 {
 public:
                 Assembly(size_t size);
+                // wrap code that lives elsewhere (e.g. a mapped cache
+                // file); the memory is neither freed nor resizable
+                Assembly(uint32_t* base, size_t size);
+                // wrap a block obtained from a CodeArena; the block is
+                // returned to the arena on destruction, not resizable
+                Assembly(uint32_t* base, size_t size, CodeArena* arena);
     virtual     ~Assembly();
 
     ssize_t     size() const;
@@ -71,6 +105,8 @@ private:
     mutable int32_t     mCount;
             uint32_t*   mBase;
             ssize_t     mSize;
+            bool        mOwnsBase;
+            CodeArena*  mArena;
 };
 
 // ----------------------------------------------------------------------------
@@ -91,10 +127,10 @@ private:
     // nothing to see here...
     struct cache_entry_t {
         inline cache_entry_t() { }
-        inline cache_entry_t(const sp<Assembly>& a, int64_t w)
+        inline cache_entry_t(const sp<Assembly>& a, int32_t w)
                 : entry(a), when(w) { }
         sp<Assembly>            entry;
-        mutable int64_t         when;
+        mutable int32_t         when;
     };
 
     class key_t {
@@ -107,8 +143,11 @@ private:
         key_t(const AssemblyKeyBase& k) : mKey(&k)  { }
     };
 
-    mutable pthread_mutex_t             mLock;
-    mutable int64_t                     mWhen;
+    // cache hits only take the read side, so concurrent rasterizer
+    // threads switching programs don't serialize on each other; the
+    // write side is only held to insert or evict
+    mutable pthread_rwlock_t            mLock;
+    mutable volatile int32_t            mWhen;
     size_t                              mCacheSize;
     size_t                              mCacheInUse;
     KeyedVector<key_t, cache_entry_t>   mCacheData;
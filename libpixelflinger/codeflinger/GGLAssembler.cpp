@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "codeflinger/GGLAssembler.h"
 
@@ -33,6 +34,12 @@ namespace android {
 GGLAssembler::GGLAssembler(ARMAssemblerInterface* target)
     : ARMAssemblerProxy(target), RegisterAllocator(), mOptLevel(7)
 {
+    // every core this jit runs on understands pld (they all have the
+    // v5te extensions the pipeline already relies on); keep an escape
+    // hatch so the gain can be measured on the device
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.pf.noprefetch", value, "0");
+    mPrefetch = (value[0] == '0');
 }
 
 GGLAssembler::~GGLAssembler()
@@ -75,11 +82,14 @@ int GGLAssembler::scanline(const needs_t& needs, context_t const* c)
     uint32_t* fragment_end_pc = pcForLabel("epilog");
     const int per_fragment_ops = int(fragment_end_pc - fragment_start_pc);
     
-    // build a name for our pipeline
-    char name[64];    
+    // build a name for our pipeline. the needs key is followed by the
+    // allocator statistics, so "adb logcat" tells us which keys had to
+    // spill or give up optimizations.
+    char name[96];
     sprintf(name,
-            "scanline__%08X:%08X_%08X_%08X [%3d ipp]",
-            needs.p, needs.n, needs.t[0], needs.t[1], per_fragment_ops);
+            "scanline__%08X:%08X_%08X_%08X [%3d ipp, opt=%d, %d spills]",
+            needs.p, needs.n, needs.t[0], needs.t[1], per_fragment_ops,
+            opt_level, int(registerFile().spills()));
 
     if (err) {
         LOGE("Error while generating ""%s""\n", name);
@@ -1030,14 +1040,15 @@ RegisterAllocator::RegisterFile& RegisterAllocator::registerFile()
 // ----------------------------------------------------------------------------
 
 RegisterAllocator::RegisterFile::RegisterFile()
-    : mRegs(0), mTouched(0), mStatus(0)
+    : mRegs(0), mTouched(0), mStatus(0), mSpills(0), mLowWater(16)
 {
     reserve(ARMAssemblerInterface::SP);
     reserve(ARMAssemblerInterface::PC);
 }
 
 RegisterAllocator::RegisterFile::RegisterFile(const RegisterFile& rhs)
-    : mRegs(rhs.mRegs), mTouched(rhs.mTouched)
+    : mRegs(rhs.mRegs), mTouched(rhs.mTouched), mStatus(rhs.mStatus),
+      mSpills(rhs.mSpills), mLowWater(rhs.mLowWater)
 {
 }
 
@@ -1052,7 +1063,8 @@ bool RegisterAllocator::RegisterFile::operator == (const RegisterFile& rhs) cons
 
 void RegisterAllocator::RegisterFile::reset()
 {
-    mRegs = mTouched = mStatus = 0;
+    mRegs = mTouched = mStatus = mSpills = 0;
+    mLowWater = 16;
     reserve(ARMAssemblerInterface::SP);
     reserve(ARMAssemblerInterface::PC);
 }
@@ -1064,6 +1076,9 @@ int RegisterAllocator::RegisterFile::reserve(int reg)
                         reg);
     mRegs |= (1<<reg);
     mTouched |= mRegs;
+    const int f = countFreeRegs();
+    if (f < mLowWater)
+        mLowWater = f;
     return reg;
 }
 
@@ -1071,6 +1086,9 @@ void RegisterAllocator::RegisterFile::reserveSeveral(uint32_t regMask)
 {
     mRegs |= regMask;
     mTouched |= regMask;
+    const int f = countFreeRegs();
+    if (f < mLowWater)
+        mLowWater = f;
 }
 
 int RegisterAllocator::RegisterFile::isUsed(int reg) const
@@ -77,7 +77,15 @@ public:
 
                 uint32_t    touched() const;
         inline  uint32_t    status() const { return mStatus; }
-        
+
+        // statistics over one assembled program: how many values had
+        // to live in memory instead of registers, and how close the
+        // file came to running dry.  this is what tells us which
+        // needs-keys degrade.
+        inline  void        countSpills(int n) { mSpills += n; }
+        inline  uint32_t    spills() const { return mSpills; }
+        inline  int         lowWater() const { return mLowWater; }
+
         enum {
             OUT_OF_REGISTERS = 0x1
         };
@@ -86,6 +94,8 @@ public:
         uint32_t    mRegs;
         uint32_t    mTouched;
         uint32_t    mStatus;
+        uint32_t    mSpills;
+        int         mLowWater;
     };
  
     class Scratch
@@ -136,6 +146,7 @@ public:
                     mGen.STM(mGen.AL, mGen.DB, mGen.SP, 1, mRegList);
                 }
                 mRegFile.recycleSeveral(mRegList);
+                mRegFile.countSpills(count);
                 mCount = count;
             }
         }
@@ -545,6 +556,7 @@ private:
     int             mBlendDstA;
     
     int             mOptLevel;
+    int             mPrefetch;
 };
 
 // ----------------------------------------------------------------------------
@@ -26,9 +26,14 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 void GGLAssembler::store(const pointer_t& addr, const pixel_t& s, uint32_t flags)
-{    
+{
     const int bits = addr.size;
     const int inc = (flags & WRITE_BACK)?1:0;
+    if (inc && mPrefetch) {
+        // a write-back store walks the scanline linearly; start the
+        // next cacheline's fill early so the stores don't stall on it
+        PLD(addr.reg, immed12_pre(32));
+    }
     switch (bits) {
     case 32:
         if (inc)    STR(AL, s.reg, addr.reg, immed12_post(4));
@@ -66,6 +71,12 @@ void GGLAssembler::load(const pointer_t& addr, const pixel_t& s, uint32_t flags)
 
     const int bits = addr.size;
     const int inc = (flags & WRITE_BACK)?1:0;
+    if (inc && mPrefetch) {
+        // write-back loads are the 1:1 texture walk; prefetch a
+        // cacheline ahead.  computed (wrapped or filtered) fetches
+        // don't walk linearly and are left alone.
+        PLD(addr.reg, immed12_pre(32));
+    }
     switch (bits) {
     case 32:
         if (inc)    LDR(AL, s.reg, addr.reg, immed12_post(4));
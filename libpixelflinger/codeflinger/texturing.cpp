@@ -385,6 +385,7 @@ void GGLAssembler::init_textures(
                 CONTEXT_STORE(t.reg, generated_vars.texture[i].spill[1]);
                 recycleReg(s.reg);
                 recycleReg(t.reg);
+                registerFile().countSpills(2);
             }
         }
 
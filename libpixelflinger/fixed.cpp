@@ -23,6 +23,21 @@
 
 // ------------------------------------------------------------------------
 
+// 1/x seeds for the Newton-Raphson iterations below, indexed with the
+// 6 bits under the leading one of the normalized mantissa.  values are
+// round(2^14/x) sampled at the interval midpoints, which gives about
+// 7 bits of accuracy before the first iteration.
+static const uint16_t ggl_recip_seed_tab[64] = {
+    0x7F02, 0x7D12, 0x7B30, 0x795D, 0x7797, 0x75DF, 0x7433, 0x7293,
+    0x70FE, 0x6F75, 0x6DF6, 0x6C81, 0x6B16, 0x69B4, 0x685B, 0x670B,
+    0x65C4, 0x6484, 0x634C, 0x621C, 0x60F2, 0x5FD0, 0x5EB5, 0x5D9F,
+    0x5C91, 0x5B88, 0x5A85, 0x5988, 0x5890, 0x579D, 0x56B0, 0x55C8,
+    0x54E4, 0x5405, 0x532B, 0x5255, 0x5183, 0x50B6, 0x4FEC, 0x4F26,
+    0x4E64, 0x4DA6, 0x4CEC, 0x4C34, 0x4B81, 0x4AD0, 0x4A23, 0x4979,
+    0x48D1, 0x482D, 0x478C, 0x46ED, 0x4651, 0x45B8, 0x4521, 0x448D,
+    0x43FC, 0x436D, 0x42E0, 0x4255, 0x41CD, 0x4146, 0x40C2, 0x4040
+};
+
 int32_t gglRecipQNormalized(int32_t x, int* exponent)
 {
     const int32_t s = x>>31;
@@ -44,7 +59,7 @@ int32_t gglRecipQNormalized(int32_t x, int* exponent)
     // case we don't need to compute anything. We get the reciprocal for
     // (almost) free.
     if (a != 0x80000000) {
-        r = (0x2E800 << (30-16)) - (r>>(2-1)); // 2.30, r = 2.90625 - 2*a
+        r = uint32_t(ggl_recip_seed_tab[(a>>25)&0x3F]) << 16; // 2.30
         // 0.32 + 2.30 = 2.62 -> 2.30
         // 2.30 + 2.30 = 4.60 -> 2.30
         r = (((2LU<<30) - uint32_t((uint64_t(a)*r) >> 32)) * uint64_t(r)) >> 30;
@@ -80,9 +95,12 @@ GGLfixed gglFastDivx(GGLfixed n, GGLfixed d)
 
 // ------------------------------------------------------------------------
 
-static const GGLfixed ggl_sqrt_reciproc_approx_tab[8] = {
-    // 1/sqrt(x) with x = 1-N/16, N=[8...1]
-    0x16A09, 0x15555, 0x143D1, 0x134BF, 0x1279A, 0x11C01, 0x111AC, 0x10865
+static const GGLfixed ggl_sqrt_reciproc_approx_tab[32] = {
+    // 1/sqrt(x) with x at the midpoints of [0.5+N/64, 0.5+(N+1)/64)
+    0x1673E, 0x161D7, 0x15CAD, 0x157BB, 0x152FD, 0x14E70, 0x14A11, 0x145DC,
+    0x141D0, 0x13DE9, 0x13A26, 0x13684, 0x13302, 0x12F9E, 0x12C55, 0x12928,
+    0x12613, 0x12317, 0x12032, 0x11D62, 0x11AA7, 0x117FF, 0x1156B, 0x112E8,
+    0x11076, 0x10E15, 0x10BC4, 0x10981, 0x1074D, 0x10527, 0x1030E, 0x10102
 };
 
 GGLfixed gglSqrtRecipx(GGLfixed x)
@@ -91,15 +109,17 @@ GGLfixed gglSqrtRecipx(GGLfixed x)
     if (x == FIXED_ONE) return x;
     const GGLfixed a = x;
     const int32_t lz = gglClz(x);
-    x = ggl_sqrt_reciproc_approx_tab[(a>>(28-lz))&0x7];
+    // normalize first so the index shift can't go negative
+    x = ggl_sqrt_reciproc_approx_tab[((uint32_t(a)<<lz)>>26)&0x1F];
     const int32_t exp = lz - 16;
     if (exp <= 0)   x >>= -exp>>1;
-    else            x <<= (exp>>1) + (exp & 1);        
+    else            x <<= (exp>>1) + (exp & 1);
     if (exp & 1) {
-        x = gglMulx(x, ggl_sqrt_reciproc_approx_tab[0])>>1;
+        x = gglMulx(x, 0x16A09)>>1;     // scale by sqrt(2)/2
     }
-    // 2 Newton-Raphson iterations: x = x/2*(3-(a*x)*x)
-    x = gglMulx((x>>1),(0x30000 - gglMulx(gglMulx(a,x),x)));
+    // one Newton-Raphson iteration: x = x/2*(3-(a*x)*x)
+    // the seed above is good enough that a second iteration gains
+    // nothing: accuracy is limited by the 16.16 intermediates here
     x = gglMulx((x>>1),(0x30000 - gglMulx(gglMulx(a,x),x)));
     return x;
 }
@@ -172,7 +192,11 @@ GGLfixed gglPowx(GGLfixed x, GGLfixed y)
 
 int32_t gglDivQ(GGLfixed n, GGLfixed d, int32_t i)
 {
-    //int32_t r =int32_t((int64_t(n)<<i)/d);
+#if defined(__i386__) || defined(__amd64__)
+    // with a hardware divider the straight computation beats the
+    // bit-serial loop below; same truncation toward zero
+    return int32_t((int64_t(n)<<i)/d);
+#else
     const int32_t ds = n^d;
     if (n<0) n = -n;
     if (d<0) d = -d;
@@ -236,6 +260,7 @@ int32_t gglDivQ(GGLfixed n, GGLfixed d, int32_t i)
     else        n += d;
     j--;
     goto finish;
+#endif
 }
 
 // ------------------------------------------------------------------------
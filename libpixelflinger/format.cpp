@@ -16,20 +16,33 @@
 */
 
 #include <stdio.h>
+#include <utils/Endian.h>
 #include <pixelflinger/format.h>
 
+#if defined(__SSE2__) && !defined(__arm__)
+#define ANDROID_SSE2_CONVERT    1
+#include <emmintrin.h>
+#endif
+
 namespace android {
 
+static void fromRGBA8888_565(void* dst, const void* src, size_t count);
+static void toRGBA8888_565(void* dst, const void* src, size_t count);
+static void fromRGBA8888_4444(void* dst, const void* src, size_t count);
+static void toRGBA8888_4444(void* dst, const void* src, size_t count);
+
 static GGLFormat const gPixelFormatInfos[] =
 {   //          Alpha    Red     Green   Blue
     {  0,  0, {{ 0, 0,   0, 0,   0, 0,   0, 0 }},        0 },   // PIXEL_FORMAT_NONE
     {  4, 32, {{32,24,   8, 0,  16, 8,  24,16 }}, GGL_RGBA },   // PIXEL_FORMAT_RGBA_8888
     {  4, 24, {{ 0, 0,   8, 0,  16, 8,  24,16 }}, GGL_RGB  },   // PIXEL_FORMAT_RGBX_8888
     {  3, 24, {{ 0, 0,   8, 0,  16, 8,  24,16 }}, GGL_RGB  },   // PIXEL_FORMAT_RGB_888
-    {  2, 16, {{ 0, 0,  16,11,  11, 5,   5, 0 }}, GGL_RGB  },   // PIXEL_FORMAT_RGB_565
+    {  2, 16, {{ 0, 0,  16,11,  11, 5,   5, 0 }}, GGL_RGB,     // PIXEL_FORMAT_RGB_565
+                fromRGBA8888_565, toRGBA8888_565 },
     {  4, 32, {{32,24,  24,16,  16, 8,   8, 0 }}, GGL_RGBA },   // PIXEL_FORMAT_BGRA_8888
     {  2, 16, {{ 1, 0,  16,11,  11, 6,   6, 1 }}, GGL_RGBA },   // PIXEL_FORMAT_RGBA_5551
-    {  2, 16, {{ 4, 0,  16,12,  12, 8,   8, 4 }}, GGL_RGBA },   // PIXEL_FORMAT_RGBA_4444
+    {  2, 16, {{ 4, 0,  16,12,  12, 8,   8, 4 }}, GGL_RGBA,    // PIXEL_FORMAT_RGBA_4444
+                fromRGBA8888_4444, toRGBA8888_4444 },
     {  1,  8, {{ 8, 0,   0, 0,   0, 0,   0, 0 }}, GGL_ALPHA},   // PIXEL_FORMAT_A8
     {  1,  8, {{ 0, 0,   8, 0,   8, 0,   8, 0 }}, GGL_LUMINANCE},//PIXEL_FORMAT_L8
     {  2, 16, {{16, 8,   8, 0,   8, 0,   8, 0 }}, GGL_LUMINANCE_ALPHA},// PIXEL_FORMAT_LA_88
@@ -55,6 +68,112 @@ static GGLFormat const gPixelFormatInfos[] =
     {  4,  8, {{ 32,24,  0, 0,   0, 0,   0, 0 }}, GGL_STENCIL_INDEX  },
 };
 
+// ----------------------------------------------------------------------------
+
+/* batch conversion kernels between RGBA_8888 and the 16-bit formats.
+** the per-channel math matches what a read_pixel/write_pixel round-trip
+** produces (truncation when narrowing, bit replication when widening),
+** but converts whole runs with direct loads/stores instead of going
+** through pixel_t.
+*/
+
+// a 32-bit RGBA word with R in the low byte (same mapping as
+// GGL_RGBA_TO_HOST in the private headers, which we don't pull in here)
+#if BYTE_ORDER == LITTLE_ENDIAN
+static inline uint32_t host_rgba(uint32_t v) {
+    return v;
+}
+#else
+static inline uint32_t host_rgba(uint32_t v) {
+    return (v<<24) | (v>>24) | ((v<<8)&0xff0000) | ((v>>8)&0xff00);
+}
+#endif
+
+void fromRGBA8888_565(void* dst, const void* src, size_t count)
+{
+    uint16_t* d = static_cast<uint16_t*>(dst);
+    const uint32_t* s = static_cast<const uint32_t*>(src);
+#if ANDROID_SSE2_CONVERT
+    while (count >= 8) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(s+0));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(s+4));
+        __m128i p0, p1;
+        p0 = _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v0, 3),
+                        _mm_set1_epi32(0x1F)), 11),
+                _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v0, 10),
+                        _mm_set1_epi32(0x3F)), 5)),
+                _mm_and_si128(_mm_srli_epi32(v0, 19),
+                        _mm_set1_epi32(0x1F)));
+        p1 = _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v1, 3),
+                        _mm_set1_epi32(0x1F)), 11),
+                _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v1, 10),
+                        _mm_set1_epi32(0x3F)), 5)),
+                _mm_and_si128(_mm_srli_epi32(v1, 19),
+                        _mm_set1_epi32(0x1F)));
+        // packs_epi32 saturates as signed; the values fit in 16 bits,
+        // so sign-extend through bit 15 first to keep the raw pattern
+        p0 = _mm_srai_epi32(_mm_slli_epi32(p0, 16), 16);
+        p1 = _mm_srai_epi32(_mm_slli_epi32(p1, 16), 16);
+        _mm_storeu_si128((__m128i*)d, _mm_packs_epi32(p0, p1));
+        s += 8;
+        d += 8;
+        count -= 8;
+    }
+#endif
+    while (count--) {
+        __builtin_prefetch(s + 16);
+        const uint32_t v = host_rgba(*s++);
+        *d++ = ((v>>3)&0x1F)<<11 | ((v>>10)&0x3F)<<5 | ((v>>19)&0x1F);
+    }
+}
+
+void toRGBA8888_565(void* dst, const void* src, size_t count)
+{
+    uint32_t* d = static_cast<uint32_t*>(dst);
+    const uint16_t* s = static_cast<const uint16_t*>(src);
+    while (count--) {
+        __builtin_prefetch(s + 32);
+        const uint32_t v = *s++;
+        const uint32_t r = v>>11;
+        const uint32_t g = (v>>5)&0x3F;
+        const uint32_t b = v&0x1F;
+        *d++ = host_rgba(0xFF000000 |
+                (((b<<3)|(b>>2))<<16) |
+                (((g<<2)|(g>>4))<<8)  |
+                 ((r<<3)|(r>>2)));
+    }
+}
+
+void fromRGBA8888_4444(void* dst, const void* src, size_t count)
+{
+    uint16_t* d = static_cast<uint16_t*>(dst);
+    const uint32_t* s = static_cast<const uint32_t*>(src);
+    while (count--) {
+        __builtin_prefetch(s + 16);
+        const uint32_t v = host_rgba(*s++);
+        *d++ = ((v>>4)&0xF)<<12 | ((v>>12)&0xF)<<8 |
+               ((v>>20)&0xF)<<4 | ((v>>28)&0xF);
+    }
+}
+
+void toRGBA8888_4444(void* dst, const void* src, size_t count)
+{
+    uint32_t* d = static_cast<uint32_t*>(dst);
+    const uint16_t* s = static_cast<const uint16_t*>(src);
+    while (count--) {
+        __builtin_prefetch(s + 32);
+        const uint32_t v = *s++;
+        const uint32_t r = (v>>12)&0xF;
+        const uint32_t g = (v>>8)&0xF;
+        const uint32_t b = (v>>4)&0xF;
+        const uint32_t a = v&0xF;
+        *d++ = host_rgba((((a<<4)|a)<<24) | (((b<<4)|b)<<16) |
+                         (((g<<4)|g)<<8)  |  ((r<<4)|r));
+    }
+}
+
 }; // namespace android
 
 
@@ -17,17 +17,88 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "buffer.h"
 #include "scanline.h"
 #include "picker.h"
 
+// a captured state block: the full state_t (with the surface readers /
+// writers and the needs it was validated against) plus the pipeline
+// procs picked for it.  step_y and the rectangle blitter are re-picked
+// by init_y at every primitive and don't need to be saved.
+struct GGLStateBlockRec {
+    android::state_t    state;
+    android::generated_tex_vars_t
+                        gen_tex[android::GGL_TEXTURE_UNIT_COUNT];
+    void                (*init_y)(android::context_t* c, int32_t y);
+    void                (*scanline)(android::context_t* c);
+    void                (*span)(android::context_t* c);
+    android::Assembly*  scanline_as;    // holds a reference
+};
+
 namespace android {
 
 // ----------------------------------------------------------------------------
 
+static GGLStateBlock ggl_captureState(void* con)
+{
+    GGL_CONTEXT(c, con);
+    GGLStateBlockRec* b = (GGLStateBlockRec*)malloc(sizeof(GGLStateBlockRec));
+    if (ggl_unlikely(b == 0)) {
+        ggl_error(c, GGL_OUT_OF_MEMORY);
+        return 0;
+    }
+    ggl_pick(c);
+    // the span guard interposes on c->scanline; save the real pipeline
+    // and let bindState re-install the guard against the conditions in
+    // effect at bind time
+    ggl_uninstall_span_guard(c);
+    b->state = c->state;
+    memcpy(b->gen_tex, c->generated_vars.texture, sizeof(b->gen_tex));
+    b->init_y = c->init_y;
+    b->scanline = c->scanline;
+    b->span = c->span;
+    b->scanline_as = ggl_scanline_as_acquire(c);
+    ggl_install_span_guard(c);
+    return b;
+}
+
+static void ggl_bindState(void* con, GGLStateBlock b)
+{
+    GGL_CONTEXT(c, con);
+    if (ggl_unlikely(b == 0)) {
+        ggl_error(c, GGL_INVALID_VALUE);
+        return;
+    }
+    c->state = b->state;
+    memcpy(c->generated_vars.texture, b->gen_tex, sizeof(b->gen_tex));
+    c->init_y = b->init_y;
+    c->scanline = b->scanline;
+    c->span = b->span;
+    ggl_scanline_as_install(c, b->scanline_as);
+    ggl_install_span_guard(c);
+    // everything a pick would derive came with the block
+    c->dirty = 0;
+}
+
+static void ggl_releaseState(void* con, GGLStateBlock b)
+{
+    GGL_CONTEXT(c, con);
+    if (b == 0)
+        return;
+    ggl_scanline_as_release(c, b->scanline_as);
+    free(b);
+}
+
+// ----------------------------------------------------------------------------
+
 void ggl_init_picker(context_t* c)
 {
+    GGLContext& procs = *(GGLContext*)c;
+    GGL_INIT_PROC(procs, captureState);
+    GGL_INIT_PROC(procs, bindState);
+    GGL_INIT_PROC(procs, releaseState);
 }
 
 void ggl_pick(context_t* c)
@@ -106,6 +106,25 @@ static void ggl_bindTextureLod(void* con, GGLuint tmu,const GGLSurface* surface)
     ggl_set_surface(c, &c->state.texture[tmu].surface, surface);
 }
 
+static void ggl_bindTextureLevel(void* con, GGLuint tmu, GGLint level,
+        const GGLSurface* surface)
+{
+    GGL_CONTEXT(c, con);
+    if (level <= 0) {
+        ggl_bindTextureLod(con, tmu, surface);
+        return;
+    }
+    if (level > GGL_TEXTURE_MIP_LEVELS) {
+        ggl_error(c, GGL_INVALID_VALUE);
+        return;
+    }
+    texture_t& t = c->state.texture[tmu];
+    // All levels must have the same format as level 0
+    ggl_set_surface(c, &t.lod[level-1], surface);
+    if (t.lod_count < uint8_t(level))
+        t.lod_count = uint8_t(level);
+}
+
 static void ggl_colorBuffer(void* con, const GGLSurface* surface)
 {
     GGL_CONTEXT(c, con);
@@ -119,6 +138,9 @@ static void ggl_colorBuffer(void* con, const GGLSurface* surface)
         c->state.buffers.coverageBufferSize =
                 c->state.buffers.coverage ? surface->width : 0;
     }
+    // a pending lazy clear refers to the outgoing surface
+    ggl_resolve_deferred_clear(c);
+    ggl_tile_resolve_all(c);
     ggl_set_surface(c, &(c->state.buffers.color), surface);
     if (c->state.buffers.read.format == 0) {
         ggl_set_surface(c, &(c->state.buffers.read), surface);
@@ -135,6 +157,7 @@ static void ggl_readBuffer(void* con, const GGLSurface* surface)
 static void ggl_depthBuffer(void* con, const GGLSurface* surface)
 {
     GGL_CONTEXT(c, con);
+    ggl_resolve_deferred_clear(c);
     if (surface->format == GGL_PIXEL_FORMAT_Z_16) {
         ggl_set_surface(c, &(c->state.buffers.depth), surface);
     } else {
@@ -171,6 +194,7 @@ static void enable_disable(context_t* c, GGLenum name, int en)
     case GGL_W_LERP:            ggl_enable_w_lerp(c, en);        break;
     case GGL_FOG:               ggl_enable_fog(c, en);           break;
     case GGL_POINT_SMOOTH_NICE: ggl_enable_point_aa_nice(c, en); break;
+    case GGL_OCCLUSION_CULLING: ggl_enable_occlusion_culling(c, en); break;
     }
 }
 
@@ -749,6 +773,7 @@ void ggl_init_procs(context_t* c)
     GGL_INIT_PROC(procs, activeTexture);
     GGL_INIT_PROC(procs, bindTexture);
     GGL_INIT_PROC(procs, bindTextureLod);
+    GGL_INIT_PROC(procs, bindTextureLevel);
     GGL_INIT_PROC(procs, colorBuffer);
     GGL_INIT_PROC(procs, readBuffer);
     GGL_INIT_PROC(procs, depthBuffer);
@@ -808,6 +833,9 @@ void ggl_init_context(context_t* c)
 void ggl_uninit_context(context_t* c)
 {
     ggl_uninit_scanline(c);
+    free(c->occlusion);
+    free(c->region);
+    free(c->tileStatus);
 }
 
 // ----------------------------------------------------------------------------
@@ -22,11 +22,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <cutils/memory.h>
 #include <cutils/log.h>
 
 #include "buffer.h"
+#include "clear.h"
 #include "scanline.h"
 
 #include "codeflinger/CodeCache.h"
@@ -55,6 +61,17 @@
 #   define ANDROID_ARM_CODEGEN  0
 #endif
 
+/* the simulator build runs on x86, where sse2 lets the hot 32->565
+** scanline kernels below chew 8 pixels per iteration instead of one.
+** arm keeps its hand-written assembly shortcuts.
+*/
+#if defined(__SSE2__) && !defined(__arm__)
+#   define ANDROID_SSE2_SCANLINE 1
+#   include <emmintrin.h>
+#else
+#   define ANDROID_SSE2_SCANLINE 0
+#endif
+
 #define DEBUG__CODEGEN_ONLY     0
 
 
@@ -150,6 +167,7 @@ static  const needs_filter_t fill16noblend = {
 
 #if ANDROID_ARM_CODEGEN
 static CodeCache gCodeCache(12 * 1024);
+static CodeArena gCodeArena(12 * 1024);
 
 class ScanlineAssembly : public Assembly {
     AssemblyKey<needs_t> mKey;
@@ -158,12 +176,313 @@ public:
         : Assembly(size), mKey(needs) { }
     const AssemblyKey<needs_t>& key() const { return mKey; }
 };
+
+// a finished program packed into the shared code arena; the block goes
+// back to the arena once the cache and every context have let go of it
+class PackedScanlineAssembly : public Assembly {
+    AssemblyKey<needs_t> mKey;
+public:
+    PackedScanlineAssembly(needs_t needs, uint32_t* base, size_t size)
+        : Assembly(base, size, &gCodeArena), mKey(needs) { }
+    const AssemblyKey<needs_t>& key() const { return mKey; }
+};
+
+/* optional persistent backing store for gCodeCache, so a restarting
+** process doesn't re-assemble the same pixel pipelines from scratch.
+** enabled by pointing GGL_CODE_CACHE at a file; since we map and
+** execute whatever validates, that file must live in a directory only
+** our own uid can write to.  entries are keyed by the full needs
+** descriptor, checksummed, and silently ignored when they don't
+** validate.  the generated code only references the context passed in
+** r0, so fragments are valid across processes and reboots.
+*/
+
+#define CODE_STORE_MAGIC        0x434C4747    // 'GGLC'
+// bump whenever context_t layout changes: the stored fragments bake
+// in GGL_OFFSETOF() displacements
+#define CODE_STORE_VERSION      3
+#define CODE_STORE_MAX_SIZE     (64*1024)
+
+struct code_store_header_t {
+    uint32_t    magic;
+    uint32_t    version;
+};
+
+struct code_store_entry_t {
+    uint32_t    n, p, t0, t1;   // needs descriptor
+    uint32_t    size;           // code bytes following this header
+    uint32_t    check;          // 32-bit sum of the code words
+};
+
+// wraps code living in the store mapping; the key has to live with the
+// assembly because CodeCache only keeps a pointer to it
+class MappedScanlineAssembly : public Assembly {
+    AssemblyKey<needs_t> mKey;
+public:
+    MappedScanlineAssembly(needs_t needs, uint32_t* base, size_t size)
+        : Assembly(base, size), mKey(needs) { }
+    const AssemblyKey<needs_t>& key() const { return mKey; }
+};
+
+static pthread_once_t gCodeStoreOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t code_store_checksum(const uint32_t* code, size_t bytes)
+{
+    uint32_t sum = 0;
+    for (size_t i=0 ; i<bytes/4 ; i++)
+        sum += code[i];
+    return sum;
+}
+
+static void code_store_load(void)
+{
+    const char* path = getenv("GGL_CODE_CACHE");
+    if (!path)
+        return;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < (off_t)sizeof(code_store_header_t) ||
+        st.st_size > CODE_STORE_MAX_SIZE) {
+        close(fd);
+        return;
+    }
+
+    // PROT_EXEC because the scanline hook points straight into the
+    // mapping; it stays mapped for the life of the process
+    void* map = mmap(0, st.st_size, PROT_READ|PROT_EXEC, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+
+    const uint8_t* const base = (const uint8_t*)map;
+    const uint8_t* const end = base + st.st_size;
+    const code_store_header_t* h = (const code_store_header_t*)base;
+    if (h->magic != CODE_STORE_MAGIC || h->version != CODE_STORE_VERSION) {
+        munmap(map, st.st_size);
+        return;
+    }
+
+    const uint8_t* ptr = base + sizeof(*h);
+    while (ptr + sizeof(code_store_entry_t) <= end) {
+        const code_store_entry_t* e = (const code_store_entry_t*)ptr;
+        ptr += sizeof(*e);
+        if (e->size == 0 || (e->size & 3) ||
+            e->size > ASSEMBLY_SCRATCH_SIZE*4 ||
+            ptr + e->size > end) {
+            // a torn append leaves a truncated tail; stop here and
+            // keep whatever validated so far
+            break;
+        }
+        if (code_store_checksum((const uint32_t*)ptr, e->size) == e->check) {
+            needs_t needs;
+            needs.n = e->n;
+            needs.p = e->p;
+            needs.t[0] = e->t0;
+            needs.t[1] = e->t1;
+            if (gCodeCache.lookup(AssemblyKey<needs_t>(needs)) == 0) {
+                sp<MappedScanlineAssembly> a = new MappedScanlineAssembly(
+                        needs, (uint32_t*)ptr, e->size);
+                gCodeCache.cache(a->key(), a);
+            }
+        }
+        ptr += e->size;
+    }
+}
+
+static void code_store_save(const needs_t& needs,
+        const uint32_t* code, size_t size)
+{
+    const char* path = getenv("GGL_CODE_CACHE");
+    if (!path || !code || !size)
+        return;
+
+    int fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0600);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size +
+            (off_t)(sizeof(code_store_entry_t) + size) > CODE_STORE_MAX_SIZE) {
+        close(fd);
+        return;
+    }
+
+    // build the whole record and append it with one write(), so
+    // concurrent writers can at worst leave a truncated tail the
+    // loader will reject
+    size_t total = (st.st_size == 0 ? sizeof(code_store_header_t) : 0)
+            + sizeof(code_store_entry_t) + size;
+    uint8_t* buf = (uint8_t*)malloc(total);
+    if (!buf) {
+        close(fd);
+        return;
+    }
+    uint8_t* ptr = buf;
+    if (st.st_size == 0) {
+        code_store_header_t h;
+        h.magic = CODE_STORE_MAGIC;
+        h.version = CODE_STORE_VERSION;
+        memcpy(ptr, &h, sizeof(h));
+        ptr += sizeof(h);
+    }
+    code_store_entry_t e;
+    e.n = needs.n;
+    e.p = needs.p;
+    e.t0 = needs.t[0];
+    e.t1 = needs.t[1];
+    e.size = size;
+    e.check = code_store_checksum(code, size);
+    memcpy(ptr, &e, sizeof(e));
+    ptr += sizeof(e);
+    memcpy(ptr, code, size);
+    write(fd, buf, total);
+    free(buf);
+    close(fd);
+}
+
+// ----------------------------------------------------------------------------
+
+// assembles the pipeline for the given needs and caches it.
+// returns 0 if the needs cannot be assembled.
+static sp<Assembly> assemble_scanline(context_t* c, const needs_t& needs)
+{
+    // create a new assembly region
+    sp<ScanlineAssembly> a = new ScanlineAssembly(needs,
+            ASSEMBLY_SCRATCH_SIZE);
+    // initialize our assembler
+    GGLAssembler assembler( new ARMAssembler(a) );
+    //GGLAssembler assembler(
+    //        new ARMAssemblerOptimizer(new ARMAssembler(a)) );
+    // generate the scanline code for the given needs
+    int err = assembler.scanline(needs, c);
+    if (ggl_unlikely(err))
+        return 0;
+    // pack the finished program into the shared arena so live
+    // programs sit next to each other instead of scattered
+    // across the heap. if the arena is full (evicted programs
+    // still referenced by a context), cache it where it was
+    // assembled.
+    sp<Assembly> final(a);
+    uint32_t* block = gCodeArena.alloc(a->size());
+    if (block) {
+        memcpy(block, a->base(), a->size());
+        sp<PackedScanlineAssembly> p = new PackedScanlineAssembly(
+                needs, block, a->size());
+        err = gCodeCache.cache(p->key(), p);
+        if (ggl_likely(!err))
+            final = p;
+    } else {
+        err = gCodeCache.cache(a->key(), a);
+    }
+    if (ggl_unlikely(err))
+        return 0;
+    // and append it to the persistent store, if enabled
+    code_store_save(needs, final->base(), final->size());
+    return final;
+}
+
+// the warmup list is assembled here, off the rendering thread
+struct warmup_t {
+    context_t*  c;
+    GGLuint*    keys;
+    int         count;
+};
+
+static void* warmup_thread(void* vdata)
+{
+    warmup_t* d = (warmup_t*)vdata;
+    pthread_once(&gCodeStoreOnce, code_store_load);
+    for (int i=0 ; i<d->count ; i++) {
+        needs_t needs;
+        needs.p    = d->keys[i*4 + 0];
+        needs.n    = d->keys[i*4 + 1];
+        needs.t[0] = d->keys[i*4 + 2];
+        needs.t[1] = d->keys[i*4 + 3];
+        if (gCodeCache.lookup(AssemblyKey<needs_t>(needs)) == 0)
+            assemble_scanline(d->c, needs);
+    }
+    free(d);
+    return 0;
+}
+
 #endif
 
 // ----------------------------------------------------------------------------
 
+/* every needs key validated in this process is recorded here, so a
+** workload's profile can be dumped with dumpNeeds() and fed back to
+** warmup() at the next startup.
+*/
+
+static pthread_mutex_t gObservedLock = PTHREAD_MUTEX_INITIALIZER;
+static Vector<needs_t> gObservedNeeds;
+
+static void record_needs(const needs_t& needs)
+{
+    pthread_mutex_lock(&gObservedLock);
+    const size_t count = gObservedNeeds.size();
+    size_t i = 0;
+    while (i < count && gObservedNeeds[i] != needs)
+        i++;
+    if (i >= count)
+        gObservedNeeds.add(needs);
+    pthread_mutex_unlock(&gObservedLock);
+}
+
+static void ggl_warmup(void* con, const GGLuint* keys, GGLsizei count)
+{
+#if ANDROID_ARM_CODEGEN
+    GGL_CONTEXT(c, con);
+    if (keys == 0 || count <= 0)
+        return;
+    warmup_t* d = (warmup_t*)malloc(
+            sizeof(warmup_t) + count*4*sizeof(GGLuint));
+    if (d == 0)
+        return;
+    d->c = c;
+    d->keys = (GGLuint*)(d + 1);
+    d->count = count;
+    memcpy(d->keys, keys, count*4*sizeof(GGLuint));
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, warmup_thread, d) != 0)
+        free(d);
+    pthread_attr_destroy(&attr);
+#endif
+}
+
+static GGLsizei ggl_dumpNeeds(void* con, GGLuint* keys, GGLsizei maxCount)
+{
+    pthread_mutex_lock(&gObservedLock);
+    const GGLsizei observed = gObservedNeeds.size();
+    if (keys) {
+        const GGLsizei n = (maxCount < observed) ? maxCount : observed;
+        for (GGLsizei i=0 ; i<n ; i++) {
+            const needs_t& needs = gObservedNeeds[i];
+            keys[i*4 + 0] = needs.p;
+            keys[i*4 + 1] = needs.n;
+            keys[i*4 + 2] = needs.t[0];
+            keys[i*4 + 3] = needs.t[1];
+        }
+    }
+    pthread_mutex_unlock(&gObservedLock);
+    return observed;
+}
+
+// ----------------------------------------------------------------------------
+
 void ggl_init_scanline(context_t* c)
 {
+    GGLContext& procs = *(GGLContext*)c;
+    GGL_INIT_PROC(procs, warmup);
+    GGL_INIT_PROC(procs, dumpNeeds);
     c->init_y = init_y;
     c->step_y = step_y__generic;
     c->scanline = scanline;
@@ -196,6 +515,32 @@ static void pick_scanline(context_t* c)
     //    c->state.needs.n, c->state.needs.p,
     //    c->state.needs.t[0], c->state.needs.t[1]);
 
+    // tiled surfaces are only understood by the generic pipeline; the
+    // shortcut scanlines and the generated code both address memory
+    // linearly
+    if (c->state.buffers.color.flags & GGL_SURFACE_TILED_4X4) {
+        c->init_y = init_y;
+        c->step_y = step_y__generic;
+        c->scanline = scanline;
+        return;
+    }
+    if (c->state.enables & GGL_ENABLE_TMUS) {
+        for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; ++i) {
+            const texture_t& tx = c->state.texture[i];
+            if (!tx.enable)
+                continue;
+            int tiled = tx.surface.flags & GGL_SURFACE_TILED_4X4;
+            for (int j=0 ; j<tx.lod_count && !tiled ; j++)
+                tiled = tx.lod[j].flags & GGL_SURFACE_TILED_4X4;
+            if (tiled) {
+                c->init_y = init_y;
+                c->step_y = step_y__generic;
+                c->scanline = scanline;
+                return;
+            }
+        }
+    }
+
     // first handle the special case that we cannot test with a filter
     const uint32_t cb_format = GGL_READ_NEEDS(CB_FORMAT, c->state.needs.n);
     if (GGL_READ_NEEDS(T_FORMAT, c->state.needs.t[0]) == cb_format) {
@@ -244,31 +589,21 @@ static void pick_scanline(context_t* c)
 
 #if ANDROID_ARM_CODEGEN
     // we're going to have to generate some code...
+    // first chance to prime the cache from the persistent store
+    pthread_once(&gCodeStoreOnce, code_store_load);
+    record_needs(c->state.needs);
     // here, generate code for our pixel pipeline
     const AssemblyKey<needs_t> key(c->state.needs);
     sp<Assembly> assembly = gCodeCache.lookup(key);
     if (assembly == 0) {
-        // create a new assembly region
-        sp<ScanlineAssembly> a = new ScanlineAssembly(c->state.needs, 
-                ASSEMBLY_SCRATCH_SIZE);
-        // initialize our assembler
-        GGLAssembler assembler( new ARMAssembler(a) );
-        //GGLAssembler assembler(
-        //        new ARMAssemblerOptimizer(new ARMAssembler(a)) );
-        // generate the scanline code for the given needs
-        int err = assembler.scanline(c->state.needs, c);
-        if (ggl_likely(!err)) {
-            // finally, cache this assembly
-            err = gCodeCache.cache(a->key(), a);
-        }
-        if (ggl_unlikely(err)) {
+        assembly = assemble_scanline(c, c->state.needs);
+        if (ggl_unlikely(assembly == 0)) {
             LOGE("error generating or caching assembly. Reverting to NOP.");
             c->scanline = scanline_noop;
             c->init_y = init_y_noop;
             c->step_y = step_y__nop;
             return;
         }
-        assembly = a;
     }
 
     // release the previous assembly
@@ -286,6 +621,208 @@ static void pick_scanline(context_t* c)
 #endif
 }
 
+// ----------------------------------------------------------------------------
+// deferred clear & opaque-span occlusion (see clear.cpp for the state)
+// ----------------------------------------------------------------------------
+
+// a span is opaque when every pixel it covers is written entirely from
+// the fragment: no blending or logic-op reading the destination, and
+// no per-fragment test that could reject pixels
+static int span_is_opaque(context_t* c)
+{
+    if (c->state.enables & (GGL_ENABLE_BLENDING|GGL_ENABLE_LOGIC_OP|
+            GGL_ENABLE_ALPHA_TEST|GGL_ENABLE_DEPTH_TEST|
+            GGL_ENABLE_STENCIL_TEST|GGL_ENABLE_AA))
+        return 0;
+    return c->state.mask.color == 0xF;
+}
+
+// clear [l,r) of row y, clipped to the pending clear rectangle
+static inline void guard_clear_segment(context_t* c, int32_t y,
+        int32_t l, int32_t r)
+{
+    if (l < int32_t(c->clearLeft))  l = int32_t(c->clearLeft);
+    if (r > int32_t(c->clearRight)) r = int32_t(c->clearRight);
+    if (l < r)
+        ggl_clear_region(c, GGL_COLOR_BUFFER_BIT, l, y, r-l, 1);
+}
+
+static void guard_touch_row(context_t* c, int32_t y,
+        occlusion_row_t& row, int32_t l, int32_t r, int opaque)
+{
+    const int32_t cl = int32_t(c->clearLeft);
+    const int32_t cr = int32_t(c->clearRight);
+    const int pending = !row.settled &&
+            (c->deferredClear & GGL_COLOR_BUFFER_BIT) &&
+            (y >= int32_t(c->clearTop)) && (y < int32_t(c->clearBottom));
+
+    if (!opaque) {
+        if (pending) {
+            // the span may read the destination: settle this row's
+            // clear now, skipping what opaque spans already wrote
+            if (row.l >= row.r) {
+                guard_clear_segment(c, y, cl, cr);
+            } else {
+                guard_clear_segment(c, y, cl, row.l);
+                guard_clear_segment(c, y, row.r, cr);
+            }
+            row.settled = 1;
+        }
+        return;
+    }
+
+    // opaque: grow the covered interval
+    if (row.l >= row.r) {
+        row.l = l;
+        row.r = r;
+        return;
+    }
+    if (l <= row.r && r >= row.l) {
+        if (l < row.l) row.l = l;
+        if (r > row.r) row.r = r;
+        return;
+    }
+    // disjoint from what's already drawn
+    if (pending) {
+        // settle the gaps now so a single interval keeps describing
+        // everything that's been written on this row
+        const int32_t a0 = (row.l < l) ? row.l : l;
+        const int32_t a1 = (row.r < r) ? row.r : r;
+        const int32_t b0 = (row.l < l) ? l : row.l;
+        const int32_t b1 = (row.r < r) ? r : row.r;
+        guard_clear_segment(c, y, cl, a0);
+        guard_clear_segment(c, y, a1, b0);
+        guard_clear_segment(c, y, b1, cr);
+        row.settled = 1;
+    }
+    // keep the longer opaque run for culling
+    if (r-l > row.r-row.l) {
+        row.l = l;
+        row.r = r;
+    }
+}
+
+static void scanline_span_guard(context_t* c)
+{
+    if (!(c->deferredClear | c->occlusionEnabled | c->tileActive)) {
+        // nothing left to watch, step aside
+        c->scanline = c->scanline_core;
+        c->rect = c->rect_core;
+        c->scanline(c);
+        return;
+    }
+
+    if (c->tileActive) {
+        // the span is about to read or write this row: materialize
+        // the tiles it crosses
+        ggl_tile_resolve(c, c->iterators.xl, c->iterators.y,
+                c->iterators.xr, c->iterators.y + 1);
+    }
+
+    if ((c->deferredClear & GGL_DEPTH_BUFFER_BIT) &&
+        (c->state.enables & GGL_ENABLE_DEPTH_TEST)) {
+        // the depth test is about to read the depth buffer
+        ggl_clear_region(c, GGL_DEPTH_BUFFER_BIT,
+                c->clearLeft, c->clearTop,
+                c->clearRight - c->clearLeft,
+                c->clearBottom - c->clearTop);
+        c->deferredClear &= ~GGL_DEPTH_BUFFER_BIT;
+    }
+
+    const int32_t y = c->iterators.y;
+    if (uint32_t(y) >= c->occlusionRows) {
+        c->scanline_core(c);
+        return;
+    }
+
+    occlusion_row_t& row = c->occlusion[y];
+    const int opaque = span_is_opaque(c);
+    const int32_t xl = c->iterators.xl;
+    const int32_t xr = c->iterators.xr;
+    int32_t l = xl;
+    int32_t r = xr;
+
+    if (c->occlusionEnabled && row.l < row.r && l < r) {
+        // cull against the opaquely drawn interval; an interval
+        // strictly inside the span can't shorten it
+        if (l >= row.l && r <= row.r)
+            return;
+        if (l < row.r && r > row.l) {
+            if (l >= row.l)      l = row.r;
+            else if (r <= row.r) r = row.l;
+        }
+        if (l >= r)
+            return;
+    }
+
+    guard_touch_row(c, y, row, l, r, opaque);
+
+    if (l != xl || r != xr) {
+        c->iterators.xl = l;
+        c->iterators.xr = r;
+        c->scanline_core(c);
+        c->iterators.xl = xl;
+        c->iterators.xr = xr;
+    } else {
+        c->scanline_core(c);
+    }
+}
+
+void ggl_install_span_guard(context_t* c)
+{
+    if (!(c->deferredClear | c->occlusionEnabled | c->tileActive))
+        return;
+    if (c->scanline != scanline_span_guard) {
+        c->scanline_core = c->scanline;
+        c->scanline = scanline_span_guard;
+        // rect_memcpy would bypass c->scanline entirely
+        c->rect_core = c->rect;
+        c->rect = rect_generic;
+    }
+}
+
+void ggl_uninstall_span_guard(context_t* c)
+{
+    if (c->scanline == scanline_span_guard) {
+        c->scanline = c->scanline_core;
+        c->rect = c->rect_core;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+Assembly* ggl_scanline_as_acquire(context_t* c)
+{
+#if ANDROID_ARM_CODEGEN
+    if (c->scanline_as)
+        c->scanline_as->incStrong(c);
+#endif
+    return c->scanline_as;
+}
+
+void ggl_scanline_as_install(context_t* c, Assembly* as)
+{
+#if ANDROID_ARM_CODEGEN
+    if (as == c->scanline_as)
+        return;
+    if (as)
+        as->incStrong(c);
+    if (c->scanline_as)
+        c->scanline_as->decStrong(c);
+    c->scanline_as = as;
+#endif
+}
+
+void ggl_scanline_as_release(context_t* c, Assembly* as)
+{
+#if ANDROID_ARM_CODEGEN
+    if (as)
+        as->decStrong(c);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+
 void ggl_pick_scanline(context_t* c)
 {
     pick_scanline(c);
@@ -299,6 +836,7 @@ void ggl_pick_scanline(context_t* c)
             c->scanline = scanline_perspective_single;
         }
     }
+    ggl_install_span_guard(c);
 }
 
 // ----------------------------------------------------------------------------
@@ -308,14 +846,8 @@ static void blend_factor(context_t* c, pixel_t* r, uint32_t factor,
         const pixel_t* src, const pixel_t* dst);
 static void rescale(uint32_t& u, uint8_t& su, uint32_t& v, uint8_t& sv);
 
-#if ANDROID_ARM_CODEGEN && (ANDROID_CODEGEN == ANDROID_CODEGEN_GENERATED)
-
-// no need to compile the generic-pipeline, it can't be reached
-void scanline(context_t*)
-{
-}
-
-#else
+// note: this used to be stubbed out on codegen builds, but tiled
+// surfaces fall back to the generic pipeline, so it's always needed
 
 void rescale(uint32_t& u, uint8_t& su, uint32_t& v, uint8_t& sv)
 {
@@ -342,11 +874,11 @@ void blending(context_t* c, pixel_t* fragment, pixel_t* fb)
     blend_factor(c, &df, c->state.blend.dst, fragment, fb);
 
     fragment->c[1] =
-            gglMulAddx(fragment->c[1], sf.c[1], gglMulx(fb->c[1], df.c[1]));
+            gglMulMulAddx(fragment->c[1], sf.c[1], fb->c[1], df.c[1]);
     fragment->c[2] =
-            gglMulAddx(fragment->c[2], sf.c[2], gglMulx(fb->c[2], df.c[2]));
+            gglMulMulAddx(fragment->c[2], sf.c[2], fb->c[2], df.c[2]);
     fragment->c[3] =
-            gglMulAddx(fragment->c[3], sf.c[3], gglMulx(fb->c[3], df.c[3]));
+            gglMulMulAddx(fragment->c[3], sf.c[3], fb->c[3], df.c[3]);
 
     if (c->state.blend.alpha_separate) {
         blend_factor(c, &sf, c->state.blend.src_alpha, fragment, fb);
@@ -354,7 +886,7 @@ void blending(context_t* c, pixel_t* fragment, pixel_t* fb)
     }
 
     fragment->c[0] =
-            gglMulAddx(fragment->c[0], sf.c[0], gglMulx(fb->c[0], df.c[0]));
+            gglMulMulAddx(fragment->c[0], sf.c[0], fb->c[0], df.c[0]);
 
     // clamp to 1.0
     if (fragment->c[0] >= (1LU<<fragment->s[0]))
@@ -541,6 +1073,21 @@ void scanline(context_t* c)
 	uint32_t x = xs;
 	uint32_t y = c->iterators.y;
 
+    /* color-buffer span staging: fragments are read and written in
+    ** runs through the span interfaces, instead of paying an indirect
+    ** call (and its branches) per pixel.  pending writes are flushed
+    ** whenever a discarded fragment breaks the run.
+    */
+    enum { SPAN_BATCH = 16 };
+    surface_t* fbs = &(c->state.buffers.color);
+    pixel_t fbSpan[SPAN_BATCH];
+    pixel_t outSpan[SPAN_BATCH];
+    const uint32_t xend = xs + xc;
+    uint32_t fbSpanX = x;           // first pixel cached in fbSpan
+    uint32_t fbSpanCount = 0;       // valid entries in fbSpan
+    uint32_t outSpanX = x;          // first pixel pending in outSpan
+    uint32_t outSpanCount = 0;      // pending entries in outSpan
+
 	while (xc--) {
     
         { // just a scope
@@ -560,11 +1107,12 @@ void scanline(context_t* c)
                 if (!tx.enable)
                     continue;
                 texture_iterators_t& ti = tx.iterators;
+                const surface_t& txs = *tx.sampled;
                 int32_t u, v;
 
                 // s-coordinate
                 if (tx.s_coord != GGL_ONE_TO_ONE) {
-                    const int w = tx.surface.width;
+                    const int w = txs.width;
                     u = wrapping(tc[i].s, w, tx.s_wrap);
                     tc[i].s += ti.dsdx;
                 } else {
@@ -573,7 +1121,7 @@ void scanline(context_t* c)
 
                 // t-coordinate
                 if (tx.t_coord != GGL_ONE_TO_ONE) {
-                    const int h = tx.surface.height;
+                    const int h = txs.height;
                     v = wrapping(tc[i].t, h, tx.t_wrap);
                     tc[i].t += ti.dtdx;
                 } else {
@@ -586,10 +1134,10 @@ void scanline(context_t* c)
                 {
                     u >>= 16;
                     v >>= 16;
-                    tx.surface.read(&tx.surface, c, u, v, &texel);
+                    txs.read(&txs, c, u, v, &texel);
                 } else {
-                    const int w = tx.surface.width;
-                    const int h = tx.surface.height;
+                    const int w = txs.width;
+                    const int h = txs.height;
                     u -= FIXED_HALF;
                     v -= FIXED_HALF;
                     int u0 = u >> 16;
@@ -620,10 +1168,10 @@ void scanline(context_t* c)
                     }
                     pixel_t texels[4];
                     uint32_t mm[4];
-                    tx.surface.read(&tx.surface, c, u0, v0, &texels[0]);
-                    tx.surface.read(&tx.surface, c, u0, v1, &texels[1]);
-                    tx.surface.read(&tx.surface, c, u1, v0, &texels[2]);
-                    tx.surface.read(&tx.surface, c, u1, v1, &texels[3]);
+                    txs.read(&txs, c, u0, v0, &texels[0]);
+                    txs.read(&txs, c, u0, v1, &texels[1]);
+                    txs.read(&txs, c, u1, v0, &texels[2]);
+                    txs.read(&txs, c, u1, v1, &texels[3]);
                     u = (u >> 12) & 0xF; 
                     v = (v >> 12) & 0xF;
                     u += u>>3;
@@ -750,23 +1298,39 @@ void scanline(context_t* c)
                 uint32_t& c = fragment.c[i];
                 uint8_t& s  = fragment.s[i];
                 c = (c * 0x10000) / ((1<<s)-1);
-                c = gglMulAddx(c, f, gglMulx(fc, 0x10000 - f));
+                c = gglMulMulAddx(c, f, fc, 0x10000 - f);
                 s = 16;
             }
         }
 
         // blending
         if (enables & GGL_ENABLE_BLENDING) {
-            fb.c[1] = fb.c[2] = fb.c[3] = fb.c[0] = 0; // placate valgrind
-            fb.s[1] = fb.s[2] = fb.s[3] = fb.s[0] = 0;
-            c->state.buffers.color.read(
-                    &(c->state.buffers.color), c, x, y, &fb);
+            // refill the read-ahead span when we walk past it; x only
+            // moves forward, so discarded pixels just go unused
+            if (x >= fbSpanX + fbSpanCount) {
+                fbSpanX = x;
+                fbSpanCount = xend - x;
+                if (fbSpanCount > SPAN_BATCH)
+                    fbSpanCount = SPAN_BATCH;
+                memset(fbSpan, 0, sizeof(fbSpan)); // placate valgrind
+                fbs->read_span(fbs, c, x, y, fbSpan, fbSpanCount);
+            }
+            fb = fbSpan[x - fbSpanX];
             blending( c, &fragment, &fb );
         }
 
-		// write
-        c->state.buffers.color.write(
-                &(c->state.buffers.color), c, x, y, &fragment);
+		// write (staged, flushed in runs)
+        if (outSpanCount && (outSpanX + outSpanCount != x)) {
+            fbs->write_span(fbs, c, outSpanX, y, outSpan, outSpanCount);
+            outSpanCount = 0;
+        }
+        if (outSpanCount == 0)
+            outSpanX = x;
+        outSpan[outSpanCount++] = fragment;
+        if (outSpanCount == SPAN_BATCH) {
+            fbs->write_span(fbs, c, outSpanX, y, outSpan, outSpanCount);
+            outSpanCount = 0;
+        }
         }
 
 discard:
@@ -781,9 +1345,11 @@ discard:
         z += c->shade.dzdx;
         f += c->shade.dfdx;
 	}
-}
 
-#endif // ANDROID_ARM_CODEGEN && (ANDROID_CODEGEN == ANDROID_CODEGEN_GENERATED)
+    // flush the last pending run
+    if (outSpanCount)
+        fbs->write_span(fbs, c, outSpanX, y, outSpan, outSpanCount);
+}
 
 // ----------------------------------------------------------------------------
 #if 0
@@ -804,6 +1370,20 @@ T interpolate(int y, T v0, U dvdx, U dvdy) {
 #pragma mark -
 #endif
 
+// per-pixel texel step of one texture axis, as an integer.  repeat
+// iterators run in 0.32 normalized space, clamp iterators in 16.16
+// texels (see adjustSWrap/adjustTWrap in init_y).
+static inline
+uint32_t texel_step(int32_t dx, int32_t dy, int wrapped, uint32_t size)
+{
+    const uint32_t ax = (dx < 0) ? uint32_t(-dx) : uint32_t(dx);
+    const uint32_t ay = (dy < 0) ? uint32_t(-dy) : uint32_t(dy);
+    const uint32_t d = (ax > ay) ? ax : ay;
+    if (wrapped)
+        return uint32_t((uint64_t(d) * size) >> 32);
+    return d >> 16;
+}
+
 void init_y(context_t* c, int32_t ys)
 {
     const uint32_t enables = c->state.enables;
@@ -857,6 +1437,7 @@ void init_y(context_t* c, int32_t ys)
             texture_t& t = c->state.texture[i];
             if (!t.enable) continue;
 
+            t.sampled = &t.surface;
             texture_iterators_t& ti = t.iterators;
             if (t.s_coord == GGL_ONE_TO_ONE && t.t_coord == GGL_ONE_TO_ONE) {
                 // we need to set all of these to 0 because in some cases
@@ -900,12 +1481,50 @@ void init_y(context_t* c, int32_t ys)
                     }
                 }
             }
+
+            // automatic level-of-detail selection.  when extra levels
+            // are bound, minified affine spans sample the level whose
+            // texel-to-pixel step is closest to one.  repeat iterators
+            // run in 0.32 normalized space and need no adjustment;
+            // clamp iterators are 16.16 texels of level 0 and must be
+            // shifted into the selected level's space.
+            if (t.lod_count && !(enables & GGL_ENABLE_W) &&
+                !(t.s_coord == GGL_ONE_TO_ONE &&
+                  t.t_coord == GGL_ONE_TO_ONE))
+            {
+                const int sWrapped = (t.s_wrap != GGL_CLAMP);
+                const int tWrapped = (t.t_wrap != GGL_CLAMP);
+                uint32_t rho = texel_step(ti.dsdx, ti.dsdy,
+                        sWrapped, t.surface.width);
+                const uint32_t rhot = texel_step(ti.dtdx, ti.dtdy,
+                        tWrapped, t.surface.height);
+                if (rhot > rho)
+                    rho = rhot;
+                int level = (rho >= 2) ? (31 - gglClz(rho)) : 0;
+                if (level > t.lod_count)
+                    level = t.lod_count;
+                if (level > 0) {
+                    t.sampled = &t.lod[level-1];
+                    if (!sWrapped) {
+                        ti.ydsdy >>= level;
+                        ti.dsdx  >>= level;
+                        ti.dsdy  >>= level;
+                    }
+                    if (!tWrapped) {
+                        ti.ydtdy >>= level;
+                        ti.dtdx  >>= level;
+                        ti.dtdy  >>= level;
+                    }
+                }
+            }
+
             // mirror for generated code...
+            const surface_t& ts = *t.sampled;
             generated_tex_vars_t& gen = c->generated_vars.texture[i];
-            gen.width   = t.surface.width;
-            gen.height  = t.surface.height;
-            gen.stride  = t.surface.stride;
-            gen.data    = int32_t(t.surface.data);
+            gen.width   = ts.width;
+            gen.height  = ts.height;
+            gen.stride  = ts.stride;
+            gen.data    = int32_t(ts.data);
             gen.dsdx = ti.dsdx;
             gen.dtdx = ti.dtdx;
         }
@@ -1253,6 +1872,34 @@ finish:
 
 // ----------------------------------------------------------------------------
 
+#if ANDROID_SSE2_SCANLINE
+
+// convert four 8888 texels held in 32-bit lanes to 565 in the low
+// 16 bits of each lane (x86 is little-endian, so GGL_RGBA_TO_HOST
+// is the identity and the channel offsets match the scalar code)
+static inline __m128i scanline_to565_sse2(__m128i s)
+{
+    __m128i r = _mm_and_si128(_mm_srli_epi32(s, 3),  _mm_set1_epi32(0x1F));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(s, 10), _mm_set1_epi32(0x3F));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(s, 19), _mm_set1_epi32(0x1F));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11),
+                                     _mm_slli_epi32(g, 5)), b);
+}
+
+// narrow the 32-bit lanes of two vectors (values <= 0xFFFF) into one
+// vector of eight 16-bit lanes; sse2 only has a signed saturating
+// pack, hence the bias dance
+static inline __m128i scanline_pack16_sse2(__m128i lo, __m128i hi)
+{
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+    return _mm_add_epi16(_mm_packs_epi32(_mm_sub_epi32(lo, bias32),
+                                         _mm_sub_epi32(hi, bias32)),
+                         bias16);
+}
+
+#endif // ANDROID_SSE2_SCANLINE
+
 void scanline_t32cb16(context_t* c)
 {
     int32_t x = c->iterators.xl;
@@ -1282,7 +1929,22 @@ last_one:
         ct--;
     }
 
+#if ANDROID_SSE2_SCANLINE
+    while (ct >= 8) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 4));
+        _mm_storeu_si128((__m128i*)dst,
+                         scanline_pack16_sse2(scanline_to565_sse2(v0),
+                                              scanline_to565_sse2(v1)));
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+#endif
+
     while (ct > 0) {
+        __builtin_prefetch(src + 16);
+
         s = GGL_RGBA_TO_HOST( *src++ );
         sR = (s >> (   3))&0x1F;
         sG = (s >> ( 8+2))&0x3F;
@@ -1324,7 +1986,59 @@ void scanline_t32cb16blend(context_t* c)
 #if ((ANDROID_CODEGEN >= ANDROID_CODEGEN_ASM) && defined(__arm__))
     scanline_t32cb16blend_arm(dst, src, ct);
 #else
+#if ANDROID_SSE2_SCANLINE
+    // eight pixels per iteration: the source channels are narrowed to
+    // 16-bit lanes (all <= 0xFF so the signed pack is exact) and the
+    // blend runs per-channel exactly like the scalar code below.  a
+    // fully transparent source pixel yields f == 0x100, which keeps
+    // the destination bit-exact, so no zero test is needed.
+    while (ct >= 8) {
+        const __m128i m1f = _mm_set1_epi16(0x1F);
+        const __m128i m3f = _mm_set1_epi16(0x3F);
+        const __m128i m1f32 = _mm_set1_epi32(0x1F);
+        const __m128i m3f32 = _mm_set1_epi32(0x3F);
+
+        __m128i v0 = _mm_loadu_si128((const __m128i*)src);
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(src + 4));
+        __m128i d  = _mm_loadu_si128((const __m128i*)dst);
+
+        __m128i sR = _mm_packs_epi32(
+                _mm_and_si128(_mm_srli_epi32(v0, 3), m1f32),
+                _mm_and_si128(_mm_srli_epi32(v1, 3), m1f32));
+        __m128i sG = _mm_packs_epi32(
+                _mm_and_si128(_mm_srli_epi32(v0, 10), m3f32),
+                _mm_and_si128(_mm_srli_epi32(v1, 10), m3f32));
+        __m128i sB = _mm_packs_epi32(
+                _mm_and_si128(_mm_srli_epi32(v0, 19), m1f32),
+                _mm_and_si128(_mm_srli_epi32(v1, 19), m1f32));
+        __m128i sA = _mm_packs_epi32(_mm_srli_epi32(v0, 24),
+                                     _mm_srli_epi32(v1, 24));
+
+        // f = 0x100 - (sA + (sA>>7))
+        __m128i f = _mm_sub_epi16(_mm_set1_epi16(0x100),
+                                  _mm_add_epi16(sA, _mm_srli_epi16(sA, 7)));
+
+        __m128i dR = _mm_and_si128(_mm_srli_epi16(d, 11), m1f);
+        __m128i dG = _mm_and_si128(_mm_srli_epi16(d, 5),  m3f);
+        __m128i dB = _mm_and_si128(d, m1f);
+
+        sR = _mm_add_epi16(sR, _mm_srli_epi16(_mm_mullo_epi16(f, dR), 8));
+        sG = _mm_add_epi16(sG, _mm_srli_epi16(_mm_mullo_epi16(f, dG), 8));
+        sB = _mm_add_epi16(sB, _mm_srli_epi16(_mm_mullo_epi16(f, dB), 8));
+
+        d = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(sR, 11),
+                                      _mm_slli_epi16(sG, 5)), sB);
+        _mm_storeu_si128((__m128i*)dst, d);
+
+        src += 8;
+        dst += 8;
+        ct -= 8;
+    }
+#endif
     while (ct--) {
+        __builtin_prefetch(src + 16);
+        __builtin_prefetch(dst + 32);
+
         uint32_t s = *src++;
         if (!s) {
             dst++;
@@ -1387,7 +2101,19 @@ void scanline_memset16(context_t* c)
     surface_t* cb = &(c->state.buffers.color);
     uint16_t* dst = reinterpret_cast<uint16_t*>(cb->data) + (x+(cb->stride*y));
     uint32_t packed = c->packed;
+#if ANDROID_SSE2_SCANLINE
+    __m128i v = _mm_set1_epi16((short)packed);
+    while (ct >= 8) {
+        _mm_storeu_si128((__m128i*)dst, v);
+        dst += 8;
+        ct -= 8;
+    }
+    while (ct--) {
+        *dst++ = uint16_t(packed);
+    }
+#else
     android_memset16(dst, packed, ct*2);
+#endif
 }
 
 void scanline_memset32(context_t* c)
@@ -1398,7 +2124,19 @@ void scanline_memset32(context_t* c)
     surface_t* cb = &(c->state.buffers.color);
     uint32_t* dst = reinterpret_cast<uint32_t*>(cb->data) + (x+(cb->stride*y));
     uint32_t packed = GGL_HOST_TO_RGBA(c->packed);
+#if ANDROID_SSE2_SCANLINE
+    __m128i v = _mm_set1_epi32(packed);
+    while (ct >= 4) {
+        _mm_storeu_si128((__m128i*)dst, v);
+        dst += 4;
+        ct -= 4;
+    }
+    while (ct--) {
+        *dst++ = packed;
+    }
+#else
     android_memset32(dst, packed, ct*4);
+#endif
 }
 
 void scanline_clear(context_t* c)
@@ -1439,6 +2177,104 @@ void rect_generic(context_t* c, size_t yc)
     } while (--yc);
 }
 
+// Large rect_memcpy() blits are split between the caller and one lazily
+// started helper thread.  This path is the only one that can safely run
+// on two cores: it never touches the iterators or the generated scanline
+// pipeline, both of which mutate shared context state per row.  The
+// helper copies the top half while the caller copies the bottom half.
+
+struct rect_worker_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cv;
+    pthread_cond_t  done_cv;
+    int             state;      // 0 idle, 1 work posted, -1 unavailable
+    uint8_t*        dst;
+    const uint8_t*  src;
+    size_t          size;
+    size_t          dbpr;
+    size_t          sbpr;
+    size_t          rows;
+};
+
+static rect_worker_t gRectWorker = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    -2,     // not started yet
+    0, 0, 0, 0, 0, 0
+};
+
+// rows below this aren't worth a wakeup/wait round trip
+#define RECT_WORKER_MIN_ROWS    32
+
+static void copy_rows(uint8_t* dst, const uint8_t* src,
+                      size_t size, size_t dbpr, size_t sbpr, size_t rows)
+{
+    do {
+        memcpy(dst, src, size);
+        dst += dbpr;
+        src += sbpr;
+    } while (--rows);
+}
+
+static void* rect_worker_thread(void*)
+{
+    rect_worker_t* w = &gRectWorker;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->state != 1)
+            pthread_cond_wait(&w->work_cv, &w->lock);
+        pthread_mutex_unlock(&w->lock);
+
+        copy_rows(w->dst, w->src, w->size, w->dbpr, w->sbpr, w->rows);
+
+        pthread_mutex_lock(&w->lock);
+        w->state = 0;
+        pthread_cond_signal(&w->done_cv);
+    }
+    return 0;
+}
+
+// post the top `rows` rows to the helper; returns 0 if the caller
+// must copy everything itself
+static int rect_worker_post(uint8_t* dst, const uint8_t* src,
+                            size_t size, size_t dbpr, size_t sbpr, size_t rows)
+{
+    rect_worker_t* w = &gRectWorker;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->state == -2) {
+        pthread_t thread;
+        w->state = (pthread_create(&thread, 0, rect_worker_thread, 0) == 0)
+                 ? 0 : -1;
+    }
+    if (w->state != 0) {
+        pthread_mutex_unlock(&w->lock);
+        return 0;
+    }
+    w->dst  = dst;
+    w->src  = src;
+    w->size = size;
+    w->dbpr = dbpr;
+    w->sbpr = sbpr;
+    w->rows = rows;
+    w->state = 1;
+    pthread_cond_signal(&w->work_cv);
+    pthread_mutex_unlock(&w->lock);
+    return 1;
+}
+
+static void rect_worker_wait(void)
+{
+    rect_worker_t* w = &gRectWorker;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->state == 1)
+        pthread_cond_wait(&w->done_cv, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
 void rect_memcpy(context_t* c, size_t yc)
 {
     int32_t x = c->iterators.xl;
@@ -1455,17 +2291,24 @@ void rect_memcpy(context_t* c, size_t yc)
     uint8_t *src = reinterpret_cast<uint8_t*>(tex->data) +
                             (u + (tex->stride * v)) * fp->size;
 
+    const size_t size = ct * fp->size;
+    const size_t dbpr = cb->stride  * fp->size;
+    const size_t sbpr = tex->stride * fp->size;
+
+    if (yc >= RECT_WORKER_MIN_ROWS) {
+        const size_t half = yc / 2;
+        if (rect_worker_post(dst, src, size, dbpr, sbpr, half)) {
+            copy_rows(dst + half * dbpr, src + half * sbpr,
+                      size, dbpr, sbpr, yc - half);
+            rect_worker_wait();
+            return;
+        }
+    }
+
     if (cb->stride == tex->stride && ct == size_t(cb->stride)) {
         memcpy(dst, src, ct * fp->size * yc);
     } else {
-        const size_t size = ct * fp->size;
-        const size_t dbpr = cb->stride  * fp->size;
-        const size_t sbpr = tex->stride * fp->size;
-        do {
-            memcpy(dst, src, size);
-            dst += dbpr;
-            src += sbpr;        
-        } while (--yc);
+        copy_rows(dst, src, size, dbpr, sbpr, yc);
     }
 }
 // ----------------------------------------------------------------------------
@@ -27,6 +27,18 @@ void ggl_init_scanline(context_t* c);
 void ggl_uninit_scanline(context_t* c);
 void ggl_pick_scanline(context_t* c);
 
+// interpose the deferred-clear / occlusion guard on c->scanline
+void ggl_install_span_guard(context_t* c);
+// put the real pipeline back; used when snapshotting the proc pointers
+void ggl_uninstall_span_guard(context_t* c);
+
+// reference counting on the generated scanline program, for state
+// blocks (picker.cpp): a block must hold its own reference so the
+// program outlives cache eviction.  no-ops on non-codegen builds.
+Assembly* ggl_scanline_as_acquire(context_t* c);
+void ggl_scanline_as_install(context_t* c, Assembly* as);
+void ggl_scanline_as_release(context_t* c, Assembly* as);
+
 }; // namespace android
 
 #endif
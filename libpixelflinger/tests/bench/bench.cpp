@@ -0,0 +1,314 @@
+/* libs/pixelflinger/tests/bench/bench.cpp
+**
+** Copyright 2008, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+// pixelflinger micro-benchmarks.  each scenario drives one of the
+// common scanline paths (shortcut, generated or generic) through the
+// public API and reports pixels per second, so regressions show up
+// before they hit the device.
+//
+//   test-opengl-bench              run and print the rates
+//   test-opengl-bench -w FILE      also record them as a baseline
+//   test-opengl-bench -c FILE      compare against a recorded baseline,
+//                                  exit(1) on a >10% regression
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <pixelflinger/pixelflinger.h>
+
+#define WIDTH   320
+#define HEIGHT  480
+#define TEX_SIZE 256
+
+// same clock the library itself uses for its timings
+static int64_t system_time()
+{
+#if defined(HAVE_POSIX_CLOCKS)
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+#else
+    struct timeval t;
+    t.tv_sec = t.tv_usec = 0;
+    gettimeofday(&t, NULL);
+    return int64_t(t.tv_sec)*1000000000LL + int64_t(t.tv_usec)*1000LL;
+#endif
+}
+
+struct scene_t {
+    const char* name;
+    void (*setup)(GGLContext* gl);
+    void (*draw)(GGLContext* gl);
+    uint32_t pixels;    // per draw() call
+};
+
+static GGLSurface gColorBuffer;
+static GGLSurface gDepthBuffer;
+static GGLSurface gTexture;
+
+static void reset_state(GGLContext* gl)
+{
+    gl->disable(gl, GGL_BLEND);
+    gl->disable(gl, GGL_TEXTURE_2D);
+    gl->disable(gl, GGL_AA);
+    gl->disable(gl, GGL_W_LERP);
+    gl->disable(gl, GGL_DEPTH_TEST);
+    gl->colorBuffer(gl, &gColorBuffer);
+    gl->clearColorx(gl, 0, 0, 0, 0x10000);
+    static GGLclampx white[4] = { 0x10000, 0x10000, 0x10000, 0x10000 };
+    gl->color4xv(gl, white);
+}
+
+// ----------------------------------------------------------------------------
+
+static void setup_nop(GGLContext*)
+{
+}
+
+static void draw_clear(GGLContext* gl)
+{
+    gl->clear(gl, GGL_COLOR_BUFFER_BIT);
+}
+
+static void draw_rect(GGLContext* gl)
+{
+    gl->recti(gl, 0, 0, WIDTH, HEIGHT);
+}
+
+static void setup_blend(GGLContext* gl)
+{
+    static GGLclampx half[4] = { 0x10000, 0x8000, 0x4000, 0x8000 };
+    gl->color4xv(gl, half);
+    gl->blendFunc(gl, GGL_SRC_ALPHA, GGL_ONE_MINUS_SRC_ALPHA);
+    gl->enable(gl, GGL_BLEND);
+}
+
+static void setup_texture(GGLContext* gl)
+{
+    gl->activeTexture(gl, 0);
+    gl->bindTexture(gl, &gTexture);
+    gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+    gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_ONE_TO_ONE);
+    gl->texCoord2i(gl, 0, 0);
+    gl->enable(gl, GGL_TEXTURE_2D);
+}
+
+static void draw_texture(GGLContext* gl)
+{
+    gl->recti(gl, 0, 0, TEX_SIZE, TEX_SIZE);
+}
+
+static void setup_persp(GGLContext* gl)
+{
+    gl->activeTexture(gl, 0);
+    gl->bindTexture(gl, &gTexture);
+    gl->texEnvi(gl, GGL_TEXTURE_ENV, GGL_TEXTURE_ENV_MODE, GGL_REPLACE);
+    gl->texGeni(gl, GGL_S, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+    gl->texGeni(gl, GGL_T, GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
+    gl->enable(gl, GGL_TEXTURE_2D);
+    gl->enable(gl, GGL_W_LERP);
+
+    // s/w, t/w and 1/w vary across the screen; the actual values
+    // don't matter much, they just have to keep the iterators busy
+    const int32_t grad[8] = {
+        0,                          // is0
+        (TEX_SIZE<<16) / WIDTH,     // idsdx
+        0,                          // idsdy
+        0,                          // it0
+        0,                          // idtdx
+        (TEX_SIZE<<16) / HEIGHT,    // idtdy
+        16 - 16,                    // sscale
+        16 - 16,                    // tscale
+    };
+    gl->texCoordGradScale8xv(gl, 0, grad);
+
+    const GGLfixed w[3] = {
+        0x10000,                    // w0
+        0x8000 / WIDTH,             // dwdx
+        0x8000 / HEIGHT,            // dwdy
+    };
+    gl->wGrad3xv(gl, w);
+}
+
+static void draw_triangle(GGLContext* gl)
+{
+    // covers about half of the frame buffer
+    const GGLcoord v[3][2] = {
+        { 0,            0 },
+        { WIDTH << 4,   0 },
+        { 0,            HEIGHT << 4 },
+    };
+    gl->trianglex(gl, v[0], v[1], v[2]);
+}
+
+static void setup_aa_lines(GGLContext* gl)
+{
+    gl->enable(gl, GGL_AA);
+}
+
+static void draw_aa_lines(GGLContext* gl)
+{
+    const GGLcoord v0[2] = { 0, 0 };
+    const GGLcoord v1[2] = { WIDTH << 4, HEIGHT << 4 };
+    gl->linex(gl, v0, v1, 2 << 4);
+}
+
+static const scene_t gScenes[] = {
+    { "clear-565",      setup_nop,      draw_clear,     WIDTH*HEIGHT },
+    { "fill-565",       setup_nop,      draw_rect,      WIDTH*HEIGHT },
+    { "blend-565",      setup_blend,    draw_rect,      WIDTH*HEIGHT },
+    { "texture-32-565", setup_texture,  draw_texture,   TEX_SIZE*TEX_SIZE },
+    { "persp-32-565",   setup_persp,    draw_triangle,  WIDTH*HEIGHT/2 },
+    { "aa-lines-565",   setup_aa_lines, draw_aa_lines,  HEIGHT*2 },
+};
+
+// ----------------------------------------------------------------------------
+
+static int64_t run_scene(GGLContext* gl, const scene_t& s)
+{
+    reset_state(gl);
+    s.setup(gl);
+
+    // warm up (validates state, primes the code cache)
+    s.draw(gl);
+
+    // size the run for roughly a quarter of a second
+    int64_t t0 = system_time();
+    s.draw(gl);
+    int64_t once = system_time() - t0;
+    int iters = 1;
+    if (once > 0) {
+        iters = int(250000000LL / once);
+        if (iters < 1)      iters = 1;
+        if (iters > 100000) iters = 100000;
+    }
+
+    t0 = system_time();
+    for (int i=0 ; i<iters ; i++)
+        s.draw(gl);
+    const int64_t ns = system_time() - t0;
+    if (ns <= 0)
+        return 0;
+
+    return (int64_t(s.pixels) * iters * 1000000000LL) / ns;
+}
+
+static int load_baseline(const char* path,
+        int64_t* rates, size_t count, const scene_t* scenes)
+{
+    FILE* f = fopen(path, "r");
+    if (f == 0) {
+        fprintf(stderr, "can't open baseline %s\n", path);
+        return -1;
+    }
+    for (size_t i=0 ; i<count ; i++)
+        rates[i] = 0;
+    char name[64];
+    long long rate;
+    while (fscanf(f, "%63s %lld", name, &rate) == 2) {
+        for (size_t i=0 ; i<count ; i++) {
+            if (!strcmp(name, scenes[i].name))
+                rates[i] = rate;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* record = 0;
+    const char* compare = 0;
+    for (int i=1 ; i<argc-1 ; i++) {
+        if (!strcmp(argv[i], "-w"))         record = argv[++i];
+        else if (!strcmp(argv[i], "-c"))    compare = argv[++i];
+    }
+
+    const size_t count = sizeof(gScenes)/sizeof(gScenes[0]);
+    int64_t baseline[count];
+    if (compare && load_baseline(compare, baseline, count, gScenes) < 0)
+        return 1;
+
+    gColorBuffer.version = sizeof(GGLSurface);
+    gColorBuffer.width   = WIDTH;
+    gColorBuffer.height  = HEIGHT;
+    gColorBuffer.stride  = WIDTH;
+    gColorBuffer.format  = GGL_PIXEL_FORMAT_RGB_565;
+    gColorBuffer.data    = (GGLubyte*)malloc(WIDTH*HEIGHT*2);
+
+    gDepthBuffer.version = sizeof(GGLSurface);
+    gDepthBuffer.width   = WIDTH;
+    gDepthBuffer.height  = HEIGHT;
+    gDepthBuffer.stride  = WIDTH;
+    gDepthBuffer.format  = GGL_PIXEL_FORMAT_Z_16;
+    gDepthBuffer.data    = (GGLubyte*)malloc(WIDTH*HEIGHT*2);
+
+    gTexture.version = sizeof(GGLSurface);
+    gTexture.width   = TEX_SIZE;
+    gTexture.height  = TEX_SIZE;
+    gTexture.stride  = TEX_SIZE;
+    gTexture.format  = GGL_PIXEL_FORMAT_RGBA_8888;
+    gTexture.data    = (GGLubyte*)malloc(TEX_SIZE*TEX_SIZE*4);
+    for (int i=0 ; i<TEX_SIZE*TEX_SIZE ; i++)
+        ((uint32_t*)gTexture.data)[i] = 0xFF000000 | (i*0x1234567);
+
+    GGLContext* gl;
+    if (gglInit(&gl) < 0) {
+        fprintf(stderr, "gglInit failed\n");
+        return 1;
+    }
+    gl->colorBuffer(gl, &gColorBuffer);
+    gl->depthBuffer(gl, &gDepthBuffer);
+
+    FILE* out = record ? fopen(record, "w") : 0;
+    if (record && out == 0) {
+        fprintf(stderr, "can't write baseline %s\n", record);
+        return 1;
+    }
+
+    int failed = 0;
+    for (size_t i=0 ; i<count ; i++) {
+        const int64_t rate = run_scene(gl, gScenes[i]);
+        printf("%-16s %10lld pixels/s", gScenes[i].name, (long long)rate);
+        if (compare) {
+            if (baseline[i] <= 0) {
+                printf("  (no baseline)");
+            } else {
+                const int64_t pct = (rate*100) / baseline[i];
+                printf("  %3lld%% of baseline", (long long)pct);
+                if (pct < 90) {
+                    printf("  REGRESSION");
+                    failed = 1;
+                }
+            }
+        }
+        printf("\n");
+        if (out)
+            fprintf(out, "%s %lld\n", gScenes[i].name, (long long)rate);
+    }
+    if (out)
+        fclose(out);
+
+    gglUninit(gl);
+    return failed;
+}
@@ -280,16 +280,29 @@ void* VectorImpl::_grow(size_t where, size_t amount)
       
     const size_t new_size = mCount + amount;
     if (capacity() < new_size) {
-        const size_t new_capacity = max(kMinVectorCapacity, ((new_size*3)+1)/2);
+        // grow by at least doubling, so a burst of insertions costs an
+        // amortized-constant number of allocations instead of paying
+        // SharedBuffer::alloc every few items
+        const size_t new_capacity =
+                max(kMinVectorCapacity, max(new_size, capacity()*2));
 //        LOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
         if ((mStorage) &&
-            (mCount==where) &&
             (mFlags & HAS_TRIVIAL_COPY) &&
             (mFlags & HAS_TRIVIAL_DTOR))
         {
             const SharedBuffer* cur_sb = SharedBuffer::sharedBuffer(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             mStorage = sb->data();
+            // trivial items relocate with a flat move, so inserting in
+            // the middle doesn't need a fresh buffer and two copies
+            ssize_t s = mCount - where;
+            if (s > 0) {
+                void* to = reinterpret_cast<uint8_t *>(mStorage)
+                        + (where+amount)*mItemSize;
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage)
+                        + where*mItemSize;
+                _do_move_forward(to, from, s);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "trap.h"
 #include "picker.h"
@@ -42,9 +43,15 @@ static void aa_nice_pointx(void *con, const GGLcoord* c, GGLcoord r);
 static void linex_validate(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord w);
 static void linex(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord w);
 static void aa_linex(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord w);
+static void aa_linex565(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord w);
 
-static void recti_validate(void* c, GGLint l, GGLint t, GGLint r, GGLint b); 
-static void recti(void* c, GGLint l, GGLint t, GGLint r, GGLint b); 
+static void ggl_linesx(void* con,
+        const GGLcoord* verts, GGLsizei count, GGLcoord width);
+
+static void recti_validate(void* c, GGLint l, GGLint t, GGLint r, GGLint b);
+static void recti(void* c, GGLint l, GGLint t, GGLint r, GGLint b);
+
+static void ggl_rectsi(void* con, const GGLint* rects, GGLsizei count);
 
 static void trianglex_validate(void*,
         const GGLcoord*, const GGLcoord*, const GGLcoord*);
@@ -57,6 +64,15 @@ static void aa_trianglex(void*,
 static void trianglex_debug(void* con,
         const GGLcoord*, const GGLcoord*, const GGLcoord*);
 
+static void ggl_dirtyRegion(void* con, const GGLint* rects, GGLsizei count);
+static void ggl_region_procs(context_t* c);
+static void region_pointx(void *con, const GGLcoord* v, GGLcoord rad);
+static void region_linex(void *con,
+        const GGLcoord* v0, const GGLcoord* v1, GGLcoord width);
+static void region_recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b);
+static void region_trianglex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2);
+
 static void aapolyx(void* con,
         const GGLcoord* pts, int count);
 
@@ -113,6 +129,10 @@ triangle_dump_points( const GGLcoord*  v0,
 
 void ggl_init_trap(context_t* c)
 {
+    GGLContext& procs = *(GGLContext*)c;
+    GGL_INIT_PROC(procs, dirtyRegion);
+    GGL_INIT_PROC(procs, linesx);
+    GGL_INIT_PROC(procs, rectsi);
     ggl_state_changed(c, GGL_PIXEL_PIPELINE_STATE|GGL_TMU_STATE|GGL_CB_STATE);
 }
 
@@ -123,6 +143,8 @@ void ggl_state_changed(context_t* c, int flags)
         c->procs.linex      = linex_validate;
         c->procs.recti      = recti_validate;
         c->procs.trianglex  = trianglex_validate;
+        if (c->regionCount)
+            ggl_region_procs(c);
     }
     c->dirty |= uint32_t(flags);
 }
@@ -333,12 +355,40 @@ void aa_pointx(void *con, const GGLcoord* v, GGLcoord size)
 #pragma mark Line
 #endif
 
+// the specialized thin-line routine below writes RGB565 directly, so
+// every per-fragment stage it doesn't implement must be off and the
+// blend must be the standard src-alpha one it hardcodes
+static int aa_line_can_shortcut(const context_t* c)
+{
+    if (c->state.buffers.color.format != GGL_PIXEL_FORMAT_RGB_565)
+        return 0;
+    if (c->state.buffers.color.flags & GGL_SURFACE_TILED_4X4)
+        return 0;
+    if (c->state.enables & (GGL_ENABLE_TMUS|GGL_ENABLE_SMOOTH|
+            GGL_ENABLE_FOG|GGL_ENABLE_DEPTH_TEST|GGL_ENABLE_STENCIL_TEST|
+            GGL_ENABLE_ALPHA_TEST|GGL_ENABLE_LOGIC_OP|GGL_ENABLE_DITHER))
+        return 0;
+    if (c->state.mask.color != 0xF)
+        return 0;
+    if (!(c->state.enables & GGL_ENABLE_BLENDING))
+        return 0;
+    if (c->state.blend.src != GGL_SRC_ALPHA ||
+        c->state.blend.dst != GGL_ONE_MINUS_SRC_ALPHA ||
+        c->state.blend.alpha_separate)
+        return 0;
+    return 1;
+}
+
 void linex_validate(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord w)
 {
     GGL_CONTEXT(c, con);
     ggl_pick(c);
     if (c->state.needs.p & GGL_NEED_MASK(P_AA)) {
-        c->procs.linex = aa_linex;
+        if (aa_line_can_shortcut(c)) {
+            c->procs.linex = aa_linex565;
+        } else {
+            c->procs.linex = aa_linex;
+        }
     } else {
         c->procs.linex = linex;
     }
@@ -398,9 +448,139 @@ static void aa_linex(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord
     v[1][0] += nx;      v[1][1] += ny;
     v[2][0] -= nx;      v[2][1] -= ny;
     v[3][0] -= nx;      v[3][1] -= ny;
-    aapolyx(con, v[0], 4);        
+    aapolyx(con, v[0], 4);
 }
 
+/* Gupta-Sproull-style antialiased thin line, straight to RGB565.
+** we walk the major axis one pixel column at a time and touch the
+** three pixels crossing the minor axis; their coverage comes from a
+** cone-filter LUT indexed by the perpendicular distance to the line
+** center, and is blended into the framebuffer directly instead of
+** going through triangle setup and the generic pipeline.
+*/
+
+// coverage of a 1-pixel-wide line under a radius-1 cone filter, as a
+// function of the perpendicular distance in 1/16 pixel steps (the
+// center intensity of a cone-filtered thin line is below 1.0)
+static const uint8_t gAALineCoverage[32] = {
+    199, 198, 194, 188, 179, 169, 156, 142,
+    128, 112,  98,  84,  70,  58,  47,  37,
+     28,  21,  14,   9,   5,   3,   1,   0,
+      0,   0,   0,   0,   0,   0,   0,   0
+};
+
+static void aa_linex565(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord width)
+{
+    GGL_CONTEXT(c, con);
+
+    if (ggl_unlikely((TRI_ROUND(width) > TRI_ONE) |
+            c->deferredClear | c->tileActive)) {
+        // thick lines keep the generic quad path; the lazy-clear
+        // machinery watches c->scanline, which we bypass here
+        aa_linex(con, v0, v1, width);
+        return;
+    }
+
+    const GGLcoord dx = abs(v0[0] - v1[0]);
+    const GGLcoord dy = abs(v0[1] - v1[1]);
+    if ((dx | dy) == 0)
+        return;
+
+    // set up a (u, v) frame along the major axis, so the same walk
+    // covers both orientations; ustep/vstep convert back to memory
+    const surface_t& cb = c->state.buffers.color;
+    int32_t ustep, vstep;
+    GGLcoord u0, w0, u1, w1;
+    int32_t umin, umax, vmin, vmax;
+    if (dx >= dy) {
+        u0 = v0[0];  w0 = v0[1];  u1 = v1[0];  w1 = v1[1];
+        ustep = 1;
+        vstep = cb.stride;
+        umin = c->state.scissor.left;
+        umax = c->state.scissor.right;
+        vmin = c->state.scissor.top;
+        vmax = c->state.scissor.bottom;
+    } else {
+        u0 = v0[1];  w0 = v0[0];  u1 = v1[1];  w1 = v1[0];
+        ustep = cb.stride;
+        vstep = 1;
+        umin = c->state.scissor.top;
+        umax = c->state.scissor.bottom;
+        vmin = c->state.scissor.left;
+        vmax = c->state.scissor.right;
+    }
+    if (u0 > u1) {
+        swap(u0, u1);
+        swap(w0, w1);
+    }
+
+    // minor-axis slope per major-axis pixel, 16.16
+    const int32_t m = int32_t((int64_t(w1 - w0) << 16) / (u1 - u0));
+
+    // perpendicular distance = minor-axis distance * |du|/length,
+    // i.e. 1/sqrt(1+m^2); 16.16, in (0.7, 1.0]
+    const int32_t msq = int32_t((int64_t(m) * m) >> 16);
+    const int32_t scale = gglSqrtRecipx(0x10000 + msq);
+
+    // pixel columns whose center the line crosses, clipped
+    int32_t us = (u0 - TRI_HALF + TRI_ONE-1) >> TRI_FRACTION_BITS;
+    int32_t ue = (u1 - TRI_HALF) >> TRI_FRACTION_BITS;
+    if (us < umin)  us = umin;
+    if (ue >= umax) ue = umax-1;
+    if (us > ue)
+        return;
+
+    // line center on the minor axis at the first column center, 16.16
+    const GGLcoord ucenter = TRI_FROM_INT(us) + TRI_HALF;
+    int32_t vline = (w0 << (16 - TRI_FRACTION_BITS)) +
+            int32_t((int64_t(m) * (ucenter - u0)) >> TRI_FRACTION_BITS);
+
+    const int32_t sr = (c->shade.r0 >> (GGL_COLOR_BITS-8)) >> 3;
+    const int32_t sg = (c->shade.g0 >> (GGL_COLOR_BITS-8)) >> 2;
+    const int32_t sb = (c->shade.b0 >> (GGL_COLOR_BITS-8)) >> 3;
+    const int32_t sa = (c->shade.a0 >> (GGL_COLOR_BITS-8)) + 1;  // 1..256
+
+    uint16_t* const base = reinterpret_cast<uint16_t*>(cb.data);
+
+    for (int32_t u=us ; u<=ue ; u++, vline += m) {
+        uint16_t* const col = base + u*ustep;
+        int32_t vi = (vline >> 16) - 1;
+        int32_t d = (vi << 16) + 0x8000 - vline;    // center - line
+        for (int k=0 ; k<3 ; k++, vi++, d += 0x10000) {
+            if (uint32_t(vi - vmin) >= uint32_t(vmax - vmin))
+                continue;
+            const int32_t ad = d < 0 ? -d : d;
+            // quantize |d|*scale to 1/16 pixel for the LUT
+            uint32_t idx = uint32_t((ad >> 8) * (scale >> 8)) >> 12;
+            if (idx > 31) idx = 31;
+            const int32_t cov = gAALineCoverage[idx];
+            if (!cov)
+                continue;
+            const int32_t f = (cov * sa) >> 8;      // 0..199
+            uint16_t* const p = col + vi*vstep;
+            const uint32_t pix = *p;
+            int32_t r = pix >> 11;
+            int32_t g = (pix >> 5) & 0x3F;
+            int32_t b = pix & 0x1F;
+            r += ((sr - r) * f) >> 8;
+            g += ((sg - g) * f) >> 8;
+            b += ((sb - b) * f) >> 8;
+            *p = uint16_t((r << 11) | (g << 5) | b);
+        }
+    }
+}
+
+// batched segments: the first call through linex validates the state
+// and installs the picked routine, every following segment goes to it
+// directly, so a whole vertex array pays for one validation
+static void ggl_linesx(void* con,
+        const GGLcoord* verts, GGLsizei count, GGLcoord width)
+{
+    GGL_CONTEXT(c, con);
+    for (GGLsizei i=0 ; i+1 < count ; i+=2, verts+=4) {
+        c->procs.linex(con, verts, verts+2, width);
+    }
+}
 
 // ----------------------------------------------------------------------------
 #if 0
@@ -408,6 +588,18 @@ static void aa_linex(void *con, const GGLcoord* v0, const GGLcoord* v1, GGLcoord
 #pragma mark Rect
 #endif
 
+// batched rects, same deal as linesx: the first one validates the
+// state and installs the picked routine, every following rect goes to
+// it directly.  for the small rects a UI is made of, the per-call
+// validation otherwise costs more than the pixels
+static void ggl_rectsi(void* con, const GGLint* rects, GGLsizei count)
+{
+    GGL_CONTEXT(c, con);
+    for (GGLsizei i=0 ; i<count ; i++, rects+=4) {
+        c->procs.recti(con, rects[0], rects[1], rects[2], rects[3]);
+    }
+}
+
 void recti_validate(void *con, GGLint l, GGLint t, GGLint r, GGLint b)
 {
     GGL_CONTEXT(c, con);
@@ -707,7 +899,10 @@ void edge_setup(
         edge->x_incr = gglDivQ16(dx, dy);
     }
     if (ggl_likely(y1 < ymin)) {
-        int32_t xadjust = (edge->x_incr * (ymin-y1)) >> TRI_FRACTION_BITS;
+        // 64-bit on purpose: for a big triangle whose apex is far
+        // above the scissor top, x_incr * (ymin-y1) overflows 32 bits
+        int32_t xadjust = int32_t((int64_t(edge->x_incr) * (ymin-y1))
+                >> TRI_FRACTION_BITS);
         edge->x += xadjust;
     }
   
@@ -895,8 +1090,8 @@ void aa_edge_setup(
         }
     }
     if (ggl_likely(y1 < ymin)) {
-        int32_t xadjust = (edge->x_incr * (ymin-y1))
-                >> (TRI_FRACTION_BITS + TRI_ITERATORS_BITS - FIXED_BITS);
+        int32_t xadjust = int32_t((int64_t(edge->x_incr) * (ymin-y1))
+                >> (TRI_FRACTION_BITS + TRI_ITERATORS_BITS - FIXED_BITS));
         edge->x += xadjust;
     }
   
@@ -1170,4 +1365,184 @@ void aapolyx(void* con,
         c->scanline(c);
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Dirty region
+#endif
+
+/* dirty-region clipping.  the compositor hands us the rectangles that
+** actually changed; every primitive is then rasterized once per
+** rectangle it touches, with the scissor narrowed accordingly, so the
+** unchanged parts of the surface are never written.  a primitive's
+** bounding box is tested against the union of the region first, then
+** against each rectangle, so most primitives reject in one compare.
+*/
+
+static void ggl_region_procs(context_t* c)
+{
+    c->procs.pointx     = region_pointx;
+    c->procs.linex      = region_linex;
+    c->procs.recti      = region_recti;
+    c->procs.trianglex  = region_trianglex;
+}
+
+// quick reject of the bounding box against the union of the region
+// and the user's scissor
+static int region_reject(context_t* c,
+        GGLint bl, GGLint bt, GGLint br, GGLint bb)
+{
+    if (br <= c->regionBounds[0] || bb <= c->regionBounds[1] ||
+        bl >= c->regionBounds[2] || bt >= c->regionBounds[3])
+        return 1;
+    const scissor_t& user = c->state.scissor;
+    if (br <= GGLint(user.left) || bb <= GGLint(user.top) ||
+        bl >= GGLint(user.right) || bt >= GGLint(user.bottom))
+        return 1;
+    return 0;
+}
+
+// narrows the scissor to rect i of the region; returns 0 when the
+// rect misses the saved scissor or the primitive's bounding box
+static int region_scissor(context_t* c, const scissor_t& user, uint32_t i,
+        GGLint bl, GGLint bt, GGLint br, GGLint bb)
+{
+    const int32_t* rect = c->region + i*4;
+    GGLint l = rect[0] > GGLint(user.left)   ? rect[0] : GGLint(user.left);
+    GGLint t = rect[1] > GGLint(user.top)    ? rect[1] : GGLint(user.top);
+    GGLint r = rect[2] < GGLint(user.right)  ? rect[2] : GGLint(user.right);
+    GGLint b = rect[3] < GGLint(user.bottom) ? rect[3] : GGLint(user.bottom);
+    if (l >= r || t >= b)
+        return 0;
+    if (r <= bl || b <= bt || l >= br || t >= bb)
+        return 0;
+    c->state.scissor.left   = l;
+    c->state.scissor.top    = t;
+    c->state.scissor.right  = r;
+    c->state.scissor.bottom = b;
+    return 1;
+}
+
+void region_pointx(void* con, const GGLcoord* v, GGLcoord rad)
+{
+    GGL_CONTEXT(c, con);
+    // conservative bounding box (covers rounding and anti-aliasing)
+    const GGLint bl = ((v[0] - rad) >> TRI_FRACTION_BITS) - 1;
+    const GGLint bt = ((v[1] - rad) >> TRI_FRACTION_BITS) - 1;
+    const GGLint br = ((v[0] + rad) >> TRI_FRACTION_BITS) + 2;
+    const GGLint bb = ((v[1] + rad) >> TRI_FRACTION_BITS) + 2;
+    if (region_reject(c, bl, bt, br, bb))
+        return;
+    const scissor_t user = c->state.scissor;
+    for (uint32_t i=0 ; i<c->regionCount ; i++) {
+        if (region_scissor(c, user, i, bl, bt, br, bb))
+            pointx_validate(con, v, rad);
+    }
+    c->state.scissor = user;
+    c->procs.pointx = region_pointx;
+}
+
+void region_linex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, GGLcoord width)
+{
+    GGL_CONTEXT(c, con);
+    const GGLcoord xmin = v0[0] < v1[0] ? v0[0] : v1[0];
+    const GGLcoord xmax = v0[0] < v1[0] ? v1[0] : v0[0];
+    const GGLcoord ymin = v0[1] < v1[1] ? v0[1] : v1[1];
+    const GGLcoord ymax = v0[1] < v1[1] ? v1[1] : v0[1];
+    const GGLcoord w = (width >> 1) + TRI_ONE;
+    const GGLint bl = ((xmin - w) >> TRI_FRACTION_BITS) - 1;
+    const GGLint bt = ((ymin - w) >> TRI_FRACTION_BITS) - 1;
+    const GGLint br = ((xmax + w) >> TRI_FRACTION_BITS) + 2;
+    const GGLint bb = ((ymax + w) >> TRI_FRACTION_BITS) + 2;
+    if (region_reject(c, bl, bt, br, bb))
+        return;
+    const scissor_t user = c->state.scissor;
+    for (uint32_t i=0 ; i<c->regionCount ; i++) {
+        if (region_scissor(c, user, i, bl, bt, br, bb))
+            linex_validate(con, v0, v1, width);
+    }
+    c->state.scissor = user;
+    c->procs.linex = region_linex;
+}
+
+void region_recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b)
+{
+    GGL_CONTEXT(c, con);
+    if (region_reject(c, l, t, r, b))
+        return;
+    const scissor_t user = c->state.scissor;
+    for (uint32_t i=0 ; i<c->regionCount ; i++) {
+        if (region_scissor(c, user, i, l, t, r, b))
+            recti_validate(con, l, t, r, b);
+    }
+    c->state.scissor = user;
+    c->procs.recti = region_recti;
+}
+
+void region_trianglex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2)
+{
+    GGL_CONTEXT(c, con);
+    GGLcoord xmin = v0[0] < v1[0] ? v0[0] : v1[0];
+    GGLcoord xmax = v0[0] < v1[0] ? v1[0] : v0[0];
+    GGLcoord ymin = v0[1] < v1[1] ? v0[1] : v1[1];
+    GGLcoord ymax = v0[1] < v1[1] ? v1[1] : v0[1];
+    if (v2[0] < xmin) xmin = v2[0];
+    if (v2[0] > xmax) xmax = v2[0];
+    if (v2[1] < ymin) ymin = v2[1];
+    if (v2[1] > ymax) ymax = v2[1];
+    const GGLint bl = (xmin >> TRI_FRACTION_BITS) - 1;
+    const GGLint bt = (ymin >> TRI_FRACTION_BITS) - 1;
+    const GGLint br = (xmax >> TRI_FRACTION_BITS) + 2;
+    const GGLint bb = (ymax >> TRI_FRACTION_BITS) + 2;
+    if (region_reject(c, bl, bt, br, bb))
+        return;
+    const scissor_t user = c->state.scissor;
+    for (uint32_t i=0 ; i<c->regionCount ; i++) {
+        if (region_scissor(c, user, i, bl, bt, br, bb))
+            trianglex_validate(con, v0, v1, v2);
+    }
+    c->state.scissor = user;
+    c->procs.trianglex = region_trianglex;
+}
+
+void ggl_dirtyRegion(void* con, const GGLint* rects, GGLsizei count)
+{
+    GGL_CONTEXT(c, con);
+    if (c->region) {
+        free(c->region);
+        c->region = 0;
+    }
+    c->regionCount = 0;
+    if (rects == 0 || count <= 0) {
+        // back to full-surface drawing
+        c->procs.pointx     = pointx_validate;
+        c->procs.linex      = linex_validate;
+        c->procs.recti      = recti_validate;
+        c->procs.trianglex  = trianglex_validate;
+        return;
+    }
+    c->region = (int32_t*)malloc(count*4*sizeof(int32_t));
+    if (ggl_unlikely(c->region == 0)) {
+        // out of memory: draw everything rather than nothing
+        return;
+    }
+    memcpy(c->region, rects, count*4*sizeof(int32_t));
+    c->regionCount = count;
+    // union of the rects, for the quick whole-region reject
+    c->regionBounds[0] = rects[0];
+    c->regionBounds[1] = rects[1];
+    c->regionBounds[2] = rects[2];
+    c->regionBounds[3] = rects[3];
+    for (GGLsizei i=1 ; i<count ; i++) {
+        const GGLint* r = rects + i*4;
+        if (r[0] < c->regionBounds[0]) c->regionBounds[0] = r[0];
+        if (r[1] < c->regionBounds[1]) c->regionBounds[1] = r[1];
+        if (r[2] > c->regionBounds[2]) c->regionBounds[2] = r[2];
+        if (r[3] > c->regionBounds[3]) c->regionBounds[3] = r[3];
+    }
+    ggl_region_procs(c);
+}
+
 }; // namespace android
@@ -0,0 +1,13 @@
+# Copyright 2008 The Android Open Source Project
+#
+# Host-side USB scanning shared by adb and fastboot (linux only;
+# the darwin and windows backends talk to their native USB stacks).
+
+LOCAL_PATH:= $(call my-dir)
+
+ifeq ($(HOST_OS),linux)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := usbhost_linux.c
+LOCAL_MODULE := libusbhost
+include $(BUILD_HOST_STATIC_LIBRARY)
+endif
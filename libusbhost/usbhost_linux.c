@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <linux/usbdevice_fs.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
+#include <linux/usb/ch9.h>
+#else
+#include <linux/usb_ch9.h>
+#endif
+#include <asm/byteorder.h>
+
+#include <usbhost/usbhost.h>
+
+static inline int badname(const char *name)
+{
+    while(*name) {
+        if(!isdigit(*name++)) return 1;
+    }
+    return 0;
+}
+
+static int check(void *_desc, int len, unsigned type, int size)
+{
+    unsigned char *desc = _desc;
+
+    if(len < size) return -1;
+    if(desc[0] < size) return -1;
+    if(desc[0] > len) return -1;
+    if(desc[1] != type) return -1;
+
+    return 0;
+}
+
+/* Polling callers rescan the bus once a second, re-reading every
+** descriptor set and asking every device for its serial string each
+** time round.  None of that can change without a re-enumeration, and
+** usbfs gives a re-enumerated device a fresh node, so nodes already
+** rejected are skipped while they are unchanged on disk, and a whole
+** bus directory is skipped while its mtime says nothing was plugged
+** or unplugged.
+*/
+struct scan_cache {
+    struct scan_cache *next;
+    char name[64];
+    time_t mtime;
+    ino_t ino;
+};
+
+static struct scan_cache *rejected_devs = 0;
+static struct scan_cache *quiet_buses = 0;
+
+static struct scan_cache *cache_find(struct scan_cache *list, const char *name)
+{
+    struct scan_cache *c;
+
+    for(c = list; c; c = c->next) {
+        if(!strcmp(c->name, name)) return c;
+    }
+    return 0;
+}
+
+static void cache_add(struct scan_cache **list, const char *name,
+                      time_t mtime, ino_t ino)
+{
+    struct scan_cache *c = cache_find(*list, name);
+
+    if(c == 0) {
+        c = calloc(1, sizeof(*c));
+        if(c == 0) return;
+        strcpy(c->name, name);
+        c->next = *list;
+        *list = c;
+    }
+    c->mtime = mtime;
+    c->ino = ino;
+}
+
+static int cache_hit(struct scan_cache *list, const char *name,
+                     time_t mtime, ino_t ino)
+{
+    struct scan_cache *c = cache_find(list, name);
+
+    return c && (c->mtime == mtime) && (c->ino == ino);
+}
+
+/* drop entries whose node is gone so a hub full of reconnects
+** cannot grow the lists without bound
+*/
+static void cache_prune(struct scan_cache **list)
+{
+    struct scan_cache *c;
+    struct stat st;
+
+    while((c = *list)) {
+        if(stat(c->name, &st)) {
+            *list = c->next;
+            free(c);
+        } else {
+            list = &c->next;
+        }
+    }
+}
+
+/* parse one device's descriptor set and run the callback over each
+** interface.  returns the callback's strongest verdict; a successful
+** claim short-circuits.
+*/
+static int scan_device(int fd, const char *devname, char *ptr, int len,
+                       usb_scan_cb cb, void *cookie)
+{
+    struct usb_device_descriptor *dev;
+    struct usb_config_descriptor *cfg;
+    struct usb_interface_descriptor *ifc;
+    struct usb_endpoint_descriptor *ept;
+    usb_ifc_match info;
+
+    int in, out, maxpkt;
+    unsigned i;
+    unsigned e;
+    int verdict;
+
+    if(check(ptr, len, USB_DT_DEVICE, USB_DT_DEVICE_SIZE))
+        return USB_SCAN_CONTINUE;
+    dev = (void*) ptr;
+    len -= dev->bLength;
+    ptr += dev->bLength;
+
+    if(check(ptr, len, USB_DT_CONFIG, USB_DT_CONFIG_SIZE))
+        return USB_SCAN_CONTINUE;
+    cfg = (void*) ptr;
+    len -= cfg->bLength;
+    ptr += cfg->bLength;
+
+    memset(&info, 0, sizeof(info));
+    info.dev_name = devname;
+    info.dev_vendor = __le16_to_cpu(dev->idVendor);
+    info.dev_product = __le16_to_cpu(dev->idProduct);
+    info.dev_class = dev->bDeviceClass;
+    info.dev_subclass = dev->bDeviceSubClass;
+    info.dev_protocol = dev->bDeviceProtocol;
+
+    // read device serial number (if there is one)
+    if (dev->iSerialNumber) {
+        struct usbdevfs_ctrltransfer  ctrl;
+        __u16 buffer[128];
+        int result;
+
+        memset(buffer, 0, sizeof(buffer));
+
+        ctrl.bRequestType = USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE;
+        ctrl.bRequest = USB_REQ_GET_DESCRIPTOR;
+        ctrl.wValue = (USB_DT_STRING << 8) | dev->iSerialNumber;
+        ctrl.wIndex = 0;
+        ctrl.wLength = sizeof(buffer);
+        ctrl.data = buffer;
+
+        result = ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+        if (result > 0) {
+            int n;
+            // skip first word, and copy the rest to the serial string, changing shorts to bytes.
+            result /= 2;
+            for (n = 1; n < result; n++)
+                info.serial_number[n - 1] = buffer[n];
+            info.serial_number[n - 1] = 0;
+        }
+    }
+
+    for(i = 0; i < cfg->bNumInterfaces; i++) {
+        if(check(ptr, len, USB_DT_INTERFACE, USB_DT_INTERFACE_SIZE))
+            return USB_SCAN_CONTINUE;
+        ifc = (void*) ptr;
+        len -= ifc->bLength;
+        ptr += ifc->bLength;
+
+        in = -1;
+        out = -1;
+        maxpkt = 0;
+        info.ifc_class = ifc->bInterfaceClass;
+        info.ifc_subclass = ifc->bInterfaceSubClass;
+        info.ifc_protocol = ifc->bInterfaceProtocol;
+        info.ifc_number = ifc->bInterfaceNumber;
+
+        for(e = 0; e < ifc->bNumEndpoints; e++) {
+            if(check(ptr, len, USB_DT_ENDPOINT, USB_DT_ENDPOINT_SIZE))
+                return USB_SCAN_CONTINUE;
+            ept = (void*) ptr;
+            len -= ept->bLength;
+            ptr += ept->bLength;
+
+            if((ept->bmAttributes & 0x03) != 0x02)
+                continue;
+
+            if(ept->bEndpointAddress & 0x80) {
+                in = ept->bEndpointAddress;
+                maxpkt = __le16_to_cpu(ept->wMaxPacketSize);
+            } else {
+                out = ept->bEndpointAddress;
+                if(in == -1)
+                    maxpkt = __le16_to_cpu(ept->wMaxPacketSize);
+            }
+        }
+
+        info.has_bulk_in = (in != -1);
+        info.has_bulk_out = (out != -1);
+        info.ep_in = (in != -1) ? in : 0;
+        info.ep_out = (out != -1) ? out : 0;
+        info.ep_max_packet = maxpkt;
+
+        verdict = cb(&info, cookie);
+        if(verdict == USB_SCAN_MATCH)
+            return USB_SCAN_MATCH;
+        if(verdict == USB_SCAN_CLAIM) {
+            int n = ifc->bInterfaceNumber;
+            if(ioctl(fd, USBDEVFS_CLAIMINTERFACE, &n) == 0)
+                return USB_SCAN_CLAIM;
+                /* interesting but busy: retry on a later scan, so
+                 * never enter the reject cache */
+            return USB_SCAN_MATCH;
+        }
+    }
+
+    return USB_SCAN_CONTINUE;
+}
+
+int usb_host_scan(const char *base, usb_skip_cb skip,
+                  usb_scan_cb cb, void *cookie)
+{
+    char busname[64], devname[64];
+    char desc[1024];
+    int n, fd, verdict;
+    int claimed_fd = -1;
+
+    DIR *busdir, *devdir;
+    struct dirent *de;
+    struct stat busst, devst;
+
+    busdir = opendir(base);
+    if(busdir == 0) return -1;
+
+    while((de = readdir(busdir)) && (claimed_fd < 0)) {
+        if(badname(de->d_name)) continue;
+
+        sprintf(busname, "%s/%s", base, de->d_name);
+        if(stat(busname, &busst)) continue;
+
+            /* a bus whose directory has not changed since we last
+             * came up empty on it cannot have gained a device.  with
+             * a skip callback the caller wants to see every node for
+             * its own bookkeeping, so no bus is skipped. */
+        if(skip == 0 &&
+           cache_hit(quiet_buses, busname, busst.st_mtime, busst.st_ino))
+            continue;
+
+        devdir = opendir(busname);
+        if(devdir == 0) continue;
+
+        while((de = readdir(devdir)) && (claimed_fd < 0)) {
+
+            if(badname(de->d_name)) continue;
+            sprintf(devname, "%s/%s", busname, de->d_name);
+
+            if(skip && skip(devname, cookie)) continue;
+
+            if(stat(devname, &devst)) continue;
+            if(cache_hit(rejected_devs, devname, devst.st_mtime, devst.st_ino))
+                continue;
+
+            if((fd = open(devname, O_RDWR)) < 0) {
+                continue;
+            }
+
+            n = read(fd, desc, sizeof(desc));
+
+            verdict = scan_device(fd, devname, desc, n, cb, cookie);
+            if(verdict == USB_SCAN_CLAIM) {
+                claimed_fd = fd;
+            } else {
+                if(verdict == USB_SCAN_CONTINUE)
+                    cache_add(&rejected_devs, devname,
+                              devst.st_mtime, devst.st_ino);
+                close(fd);
+            }
+        }
+        closedir(devdir);
+
+            /* busst predates the walk, so a device arriving while we
+             * scanned leaves a newer mtime and forces a rescan */
+        if(skip == 0 && claimed_fd < 0)
+            cache_add(&quiet_buses, busname, busst.st_mtime, busst.st_ino);
+    }
+    closedir(busdir);
+
+    if(claimed_fd < 0) {
+        cache_prune(&rejected_devs);
+        cache_prune(&quiet_buses);
+    }
+
+    return claimed_fd;
+}
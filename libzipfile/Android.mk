@@ -41,6 +41,8 @@ LOCAL_SRC_FILES:= \
 
 LOCAL_STATIC_LIBRARIES := libzipfile libunz
 
+LOCAL_LDLIBS += -lpthread
+
 LOCAL_MODULE := test_zipfile
 
 LOCAL_C_INCLUDES += external/zlib
@@ -72,8 +72,6 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     unsigned short  compressionMethod;
     unsigned short  lastModFileTime;
     unsigned short  lastModFileDate;
-    unsigned long   crc32;
-    unsigned long   compressedSize;
     unsigned long   uncompressedSize;
     unsigned short  extraFieldLength;
     unsigned short  fileCommentLength;
@@ -105,8 +103,8 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     entry->compressionMethod = read_le_short(&p[0x0a]);
     lastModFileTime = read_le_short(&p[0x0c]);
     lastModFileDate = read_le_short(&p[0x0e]);
-    crc32 = read_le_int(&p[0x10]);
-    compressedSize = read_le_int(&p[0x14]);
+    entry->crc32 = read_le_int(&p[0x10]);
+    entry->compressedSize = read_le_int(&p[0x14]);
     entry->uncompressedSize = read_le_int(&p[0x18]);
     entry->fileNameLength = read_le_short(&p[0x1c]);
     extraFieldLength = read_le_short(&p[0x1e]);
@@ -161,6 +159,81 @@ read_central_directory_entry(Zipfile* file, Zipentry* entry,
     return 0;
 }
 
+static unsigned int
+hash_filename(const unsigned char* name, unsigned int len)
+{
+    unsigned int h = 0;
+    while (len-- > 0) {
+        h = h*31 + *name++;
+    }
+    return h;
+}
+
+// Allocate a Zipentry for the central dir record at cde and put it on
+// the file's list.  This is the only place that dereferences the local
+// file header, so until an entry is asked for we never touch its pages.
+static Zipentry*
+materialize_entry(Zipfile* file, const unsigned char* cde)
+{
+    Zipentry* entry;
+    const unsigned char* p = cde;
+    ssize_t len = (file->buf+file->bufsize)-cde;
+    int err;
+
+    entry = malloc(sizeof(Zipentry));
+    if (entry == NULL) return NULL;
+    memset(entry, 0, sizeof(Zipentry));
+
+    err = read_central_directory_entry(file, entry, &p, &len);
+    if (err != 0) {
+        fprintf(stderr, "read_central_directory_entry failed\n");
+        free(entry);
+        return NULL;
+    }
+
+    entry->next = file->entries;
+    file->entries = entry;
+    return entry;
+}
+
+Zipentry*
+index_lookup(Zipfile* file, const char* entryName)
+{
+    unsigned int len = strlen(entryName);
+    unsigned int hash = hash_filename((const unsigned char*)entryName, len);
+    unsigned int i = hash & (file->indexSize-1);
+
+    while (file->index[i].cde != NULL) {
+        const unsigned char* cde = file->index[i].cde;
+        if (file->index[i].hash == hash
+                && read_le_short(&cde[0x1c]) == len
+                && 0 == memcmp(entryName, cde + ENTRY_LEN, len)) {
+            if (file->index[i].entry == NULL) {
+                file->index[i].entry = materialize_entry(file, cde);
+            }
+            return file->index[i].entry;
+        }
+        i = (i+1) & (file->indexSize-1);
+    }
+    return NULL;
+}
+
+int
+materialize_all(Zipfile* file)
+{
+    unsigned int i;
+
+    for (i=0; i < file->indexSize; i++) {
+        if (file->index[i].cde != NULL && file->index[i].entry == NULL) {
+            file->index[i].entry = materialize_entry(file, file->index[i].cde);
+            if (file->index[i].entry == NULL) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
 /*
  * Find the central directory and read the contents.
  *
@@ -189,7 +262,6 @@ read_central_dir(Zipfile *file)
     const unsigned char* eocd;
     const unsigned char* p;
     const unsigned char* start;
-    ssize_t len;
     int i;
 
     // too small to be a ZIP archive?
@@ -230,27 +302,51 @@ read_central_dir(Zipfile *file)
         goto bail;
     }
 
-    // Loop through and read the central dir entries.
+    // Build the filename-hash index.  This walk only touches the
+    // central directory itself -- no allocation per entry and no
+    // peeking at local file headers, which is what makes opening a
+    // large archive cheap.  Entries are materialized on first lookup.
+    file->indexSize = 1;
+    while (file->indexSize < (unsigned int)file->totalEntryCount * 2) {
+        file->indexSize <<= 1;
+    }
+    file->index = calloc(file->indexSize, sizeof(Zipindex));
+    if (file->index == NULL) {
+        goto bail;
+    }
+
     p = buf + file->centralDirOffest;
-    len = (buf+bufsize)-p;
     for (i=0; i < file->totalEntryCount; i++) {
-        Zipentry* entry = malloc(sizeof(Zipentry));
-        memset(entry, sizeof(Zipentry), 0);
+        unsigned int fileNameLength, extraLen, commentLen;
+        unsigned int hash, j;
 
-        err = read_central_directory_entry(file, entry, &p, &len);
-        if (err != 0) {
-            fprintf(stderr, "read_central_directory_entry failed\n");
-            free(entry);
+        if ((buf+bufsize)-p < ENTRY_LEN) {
+            fprintf(stderr, "cde entry not large enough\n");
             goto bail;
         }
-        
-        // add it to our list
-        entry->next = file->entries;
-        file->entries = entry;
+        if (read_le_int(&p[0x00]) != ENTRY_SIGNATURE) {
+            fprintf(stderr, "Whoops: didn't find expected signature\n");
+            goto bail;
+        }
+        fileNameLength = read_le_short(&p[0x1c]);
+        extraLen = read_le_short(&p[0x1e]);
+        commentLen = read_le_short(&p[0x20]);
+
+        hash = hash_filename(p + ENTRY_LEN, fileNameLength);
+        j = hash & (file->indexSize-1);
+        while (file->index[j].cde != NULL) {
+            j = (j+1) & (file->indexSize-1);
+        }
+        file->index[j].hash = hash;
+        file->index[j].cde = p;
+
+        p += ENTRY_LEN + fileNameLength + extraLen + commentLen;
     }
 
     return 0;
 bail:
+    free(file->index);
+    file->index = NULL;
     return -1;
 }
 
@@ -13,11 +13,21 @@ typedef struct Zipentry {
     unsigned short compressionMethod;
     unsigned int uncompressedSize;
     unsigned int compressedSize;
+    unsigned int crc32;
     const unsigned char* data;
-    
+
     struct Zipentry* next;
 } Zipentry;
 
+// One slot of the filename-hash index.  cde points at the entry's
+// record in the central directory; entry is filled in lazily the
+// first time somebody asks for it.
+typedef struct Zipindex {
+    unsigned int hash;
+    const unsigned char* cde;
+    Zipentry* entry;
+} Zipindex;
+
 typedef struct Zipfile
 {
     const unsigned char *buf;
@@ -33,11 +43,17 @@ typedef struct Zipfile
     unsigned short  commentLen;         //mCommentLen;
     const unsigned char*  comment;            //mComment;
 
-    Zipentry* entries;
+    Zipentry* entries;          // materialized entries only
+
+    Zipindex* index;            // open-addressed, power-of-two sized
+    unsigned int indexSize;
 } Zipfile;
 
 int read_central_dir(Zipfile* file);
 
+Zipentry* index_lookup(Zipfile* file, const char* entryName);
+int materialize_all(Zipfile* file);
+
 unsigned int read_le_int(const unsigned char* buf);
 unsigned int read_le_short(const unsigned char* buf);
 
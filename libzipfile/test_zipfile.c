@@ -15,7 +15,7 @@ main(int argc, char** argv)
     zipfile_t zip;
     zipentry_t entry;
     int err;
-    enum { HUH, LIST, UNZIP } what = HUH;
+    enum { HUH, LIST, UNZIP, STREAM, EXTRACT } what = HUH;
 
     if (strcmp(argv[2], "-l") == 0 && argc == 3) {
         what = LIST;
@@ -23,11 +23,21 @@ main(int argc, char** argv)
     else if (strcmp(argv[2], "-u") == 0 && argc == 5) {
         what = UNZIP;
     }
+    else if (strcmp(argv[2], "-s") == 0 && argc == 5) {
+        what = STREAM;
+    }
+    else if (strcmp(argv[2], "-x") == 0 && argc == 4) {
+        what = EXTRACT;
+    }
     else {
         fprintf(stderr, "usage: test_zipfile ZIPFILE -l\n"
                         "          lists the files in the zipfile\n"
                         "       test_zipfile ZIPFILE -u FILENAME SAVETO\n"
-                        "          saves FILENAME from the zip file into SAVETO\n");
+                        "          saves FILENAME from the zip file into SAVETO\n"
+                        "       test_zipfile ZIPFILE -s FILENAME SAVETO\n"
+                        "          same, but through the streaming api\n"
+                        "       test_zipfile ZIPFILE -x DIR\n"
+                        "          extracts the whole zip file into DIR\n");
         return 1;
     }
     
@@ -83,8 +93,48 @@ main(int argc, char** argv)
             free(scratch);
             fclose(f);
             break;
+        case STREAM:
+        {
+            zipstream_t stream;
+            char window[64*1024];
+            int n;
+
+            entry = lookup_zipentry(zip, argv[3]);
+            if (entry == NULL) {
+                fprintf(stderr, "zip file '%s' does not contain file '%s'\n",
+                                argv[1], argv[3]);
+                return 1;
+            }
+            f = fopen(argv[4], "w");
+            if (f == NULL) {
+                fprintf(stderr, "can't open file for writing '%s'\n", argv[4]);
+                return 1;
+            }
+            stream = zipentry_open_stream(entry);
+            if (stream == NULL) {
+                fprintf(stderr, "can't open stream\n");
+                return 1;
+            }
+            while ((n = zipentry_read_stream(stream, window, sizeof(window))) > 0) {
+                fwrite(window, n, 1, f);
+            }
+            zipentry_close_stream(stream);
+            fclose(f);
+            if (n < 0) {
+                fprintf(stderr, "error streaming file\n");
+                return 1;
+            }
+            break;
+        }
+        case EXTRACT:
+            err = extract_all_zipentries(zip, argv[3], 0);
+            if (err != 0) {
+                fprintf(stderr, "%d entries failed to extract\n", err);
+                return 1;
+            }
+            break;
     }
-    
+
     free(buf);
 
     return 0;
@@ -3,7 +3,14 @@
 #include "private.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <zlib.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #define DEF_MEM_LEVEL 8                // normally in zutil.h?
 
 zipfile_t
@@ -36,6 +43,7 @@ release_zipfile(zipfile_t f)
         free(entry);
         entry = next;
     }
+    free(file->index);
     free(file);
 }
 
@@ -43,14 +51,7 @@ zipentry_t
 lookup_zipentry(zipfile_t f, const char* entryName)
 {
     Zipfile* file = (Zipfile*)f;
-    Zipentry* entry = file->entries;
-    while (entry) {
-        if (0 == memcmp(entryName, entry->fileName, entry->fileNameLength)) {
-            return entry;
-        }
-        entry = entry->next;
-    }
-    return NULL;
+    return index_lookup(file, entryName);
 }
 
 size_t
@@ -128,13 +129,372 @@ decompress_zipentry(zipentry_t e, void* buf, int bufsize)
     }
 }
 
+int
+zipentry_get_window(zipentry_t e, const void** data, size_t* size,
+        int* method)
+{
+    Zipentry* entry = (Zipentry*)e;
+
+    if (entry == NULL) return -1;
+    if (data) *data = entry->data;
+    if (size) *size = entry->compressedSize;
+    if (method) *method = entry->compressionMethod;
+    return 0;
+}
+
+typedef struct Zipstream {
+    Zipentry* entry;
+    size_t offset;        // bytes produced so far
+    int inflating;        // zstream is live (DEFLATED entries only)
+    int done;
+    z_stream zstream;
+} Zipstream;
+
+zipstream_t
+zipentry_open_stream(zipentry_t e)
+{
+    Zipentry* entry = (Zipentry*)e;
+    Zipstream* stream;
+    int zerr;
+
+    if (entry->compressionMethod != STORED
+            && entry->compressionMethod != DEFLATED) {
+        return NULL;
+    }
+
+    stream = malloc(sizeof(Zipstream));
+    if (stream == NULL) return NULL;
+    memset(stream, 0, sizeof(Zipstream));
+    stream->entry = entry;
+
+    if (entry->compressionMethod == DEFLATED) {
+        // the compressed input is already in memory, so it is handed
+        // to zlib whole; only the output is windowed
+        stream->zstream.next_in = (void*)entry->data;
+        stream->zstream.avail_in = entry->compressedSize;
+        stream->zstream.data_type = Z_UNKNOWN;
+
+        // Use the undocumented "negative window bits" feature to tell zlib
+        // that there's no zlib header waiting for it.
+        zerr = inflateInit2(&stream->zstream, -MAX_WBITS);
+        if (zerr != Z_OK) {
+            free(stream);
+            return NULL;
+        }
+        stream->inflating = 1;
+    }
+
+    return stream;
+}
+
+int
+zipentry_read_stream(zipstream_t s, void* buf, int bufsize)
+{
+    Zipstream* stream = (Zipstream*)s;
+    Zipentry* entry = stream->entry;
+    size_t n;
+    int zerr;
+
+    if (stream->done || bufsize <= 0) return 0;
+
+    if (entry->compressionMethod == STORED) {
+        n = entry->uncompressedSize - stream->offset;
+        if (n > (size_t)bufsize) n = bufsize;
+        memcpy(buf, entry->data + stream->offset, n);
+        stream->offset += n;
+        if (stream->offset == entry->uncompressedSize) stream->done = 1;
+        return n;
+    }
+
+    stream->zstream.next_out = (Bytef*)buf;
+    stream->zstream.avail_out = bufsize;
+
+    zerr = inflate(&stream->zstream, Z_NO_FLUSH);
+    if (zerr != Z_OK && zerr != Z_STREAM_END) {
+        fprintf(stderr, "zipentry_read_stream: zerr=%d total_out=%lu\n",
+                    zerr, stream->zstream.total_out);
+        return -1;
+    }
+    if (zerr == Z_STREAM_END) stream->done = 1;
+
+    n = bufsize - stream->zstream.avail_out;
+    stream->offset += n;
+
+    // a truncated stream would otherwise read as a clean end
+    if (n == 0 && !stream->done) return -1;
+    return n;
+}
+
+void
+zipentry_close_stream(zipstream_t s)
+{
+    Zipstream* stream = (Zipstream*)s;
+
+    if (stream->inflating) {
+        inflateEnd(&stream->zstream);
+    }
+    free(stream);
+}
+
+// ---------- bulk extraction ----------
+
+#define EXTRACT_WINDOW (256*1024)
+#define MAX_EXTRACT_THREADS 8
+
+typedef struct Extractor {
+    Zipentry** entries;
+    int count;
+    int next;           // next entry to hand out
+    int failed;
+    const char* dir;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+} Extractor;
+
+// mkdir -p for everything up to the last slash in path
+static int
+make_parent_dirs(char* path)
+{
+    char* p = path;
+
+    while ((p = strchr(p + 1, '/')) != NULL) {
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+// Extract one entry to disk.  The worker's z_stream and output window
+// are reused across entries; the crc runs over each window as it is
+// produced instead of in a second pass over the output file.
+static int
+extract_one(Zipentry* entry, const char* dir, z_stream* zs,
+        unsigned char* window)
+{
+    char path[1024];
+    unsigned long crc = crc32(0, NULL, 0);
+    size_t remaining;
+    const unsigned char* in;
+    int fd, zerr, n;
+
+    if (strlen(dir) + entry->fileNameLength + 2 > sizeof(path)) {
+        fprintf(stderr, "entry name too long\n");
+        return -1;
+    }
+    n = sprintf(path, "%s/", dir);
+    memcpy(path + n, entry->fileName, entry->fileNameLength);
+    path[n + entry->fileNameLength] = '\0';
+
+    // directory entries just get created
+    if (entry->fileNameLength > 0
+            && entry->fileName[entry->fileNameLength-1] == '/') {
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "can't mkdir %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    if (make_parent_dirs(path) != 0) {
+        fprintf(stderr, "can't create parents of %s: %s\n",
+                path, strerror(errno));
+        return -1;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "can't create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    // preallocate so the filesystem isn't growing the file a window
+    // at a time underneath us
+    if (entry->uncompressedSize > 0) {
+        ftruncate(fd, entry->uncompressedSize);
+    }
+
+    if (entry->compressionMethod == STORED) {
+        remaining = entry->uncompressedSize;
+        in = entry->data;
+        while (remaining > 0) {
+            size_t amt = remaining > EXTRACT_WINDOW ? EXTRACT_WINDOW
+                                                    : remaining;
+            if (write(fd, in, amt) != (ssize_t)amt) goto fail;
+            crc = crc32(crc, in, amt);
+            in += amt;
+            remaining -= amt;
+        }
+    } else {
+        zs->next_in = (void*)entry->data;
+        zs->avail_in = entry->compressedSize;
+        do {
+            zs->next_out = window;
+            zs->avail_out = EXTRACT_WINDOW;
+            zerr = inflate(zs, Z_NO_FLUSH);
+            if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                fprintf(stderr, "%s: inflate failed (zerr=%d)\n", path, zerr);
+                inflateReset(zs);
+                goto fail;
+            }
+            n = EXTRACT_WINDOW - zs->avail_out;
+            if (n > 0) {
+                if (write(fd, window, n) != n) goto fail;
+                crc = crc32(crc, window, n);
+            }
+        } while (zerr != Z_STREAM_END);
+        inflateReset(zs);
+    }
+
+    if (crc != entry->crc32) {
+        fprintf(stderr, "%s: crc mismatch (%08lx != %08x)\n",
+                path, crc, entry->crc32);
+        goto fail;
+    }
+
+    close(fd);
+    return 0;
+
+fail:
+    close(fd);
+    unlink(path);
+    return -1;
+}
+
+static void
+extract_worker(Extractor* ex)
+{
+    z_stream zstream;
+    unsigned char* window;
+    int i;
+
+    window = malloc(EXTRACT_WINDOW);
+    if (window == NULL) return;
+
+    memset(&zstream, 0, sizeof(zstream));
+    // see the comment in uninflate about negative window bits
+    if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK) {
+        free(window);
+        return;
+    }
+
+    for (;;) {
+#ifndef _WIN32
+        pthread_mutex_lock(&ex->lock);
+#endif
+        i = ex->next++;
+#ifndef _WIN32
+        pthread_mutex_unlock(&ex->lock);
+#endif
+        if (i >= ex->count) break;
+        if (extract_one(ex->entries[i], ex->dir, &zstream, window) != 0) {
+#ifndef _WIN32
+            pthread_mutex_lock(&ex->lock);
+#endif
+            ex->failed++;
+#ifndef _WIN32
+            pthread_mutex_unlock(&ex->lock);
+#endif
+        }
+    }
+
+    inflateEnd(&zstream);
+    free(window);
+}
+
+#ifndef _WIN32
+static void*
+extract_worker_thread(void* cookie)
+{
+    extract_worker((Extractor*)cookie);
+    return NULL;
+}
+#endif
+
+int
+extract_all_zipentries(zipfile_t f, const char* dir, int nthreads)
+{
+    Zipfile* file = (Zipfile*)f;
+    Extractor ex;
+    Zipentry* entry;
+    int i;
+
+    if (materialize_all(file) != 0) {
+        return -1;
+    }
+
+    memset(&ex, 0, sizeof(ex));
+    ex.dir = dir;
+    ex.entries = malloc(file->totalEntryCount * sizeof(Zipentry*));
+    if (ex.entries == NULL) return -1;
+    for (entry = file->entries; entry != NULL; entry = entry->next) {
+        ex.entries[ex.count++] = entry;
+    }
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "can't mkdir %s: %s\n", dir, strerror(errno));
+        free(ex.entries);
+        return -1;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_init(&ex.lock, NULL);
+    if (nthreads <= 0) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads < 1) nthreads = 1;
+    }
+    if (nthreads > MAX_EXTRACT_THREADS) nthreads = MAX_EXTRACT_THREADS;
+    if (nthreads > ex.count) nthreads = ex.count;
+
+    if (nthreads > 1) {
+        pthread_t threads[MAX_EXTRACT_THREADS];
+        int started = 0;
+        for (i=0; i < nthreads; i++) {
+            if (pthread_create(&threads[i], NULL, extract_worker_thread,
+                        &ex) != 0) {
+                break;
+            }
+            started++;
+        }
+        if (started == 0) {
+            extract_worker(&ex);
+        }
+        for (i=0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    } else {
+        extract_worker(&ex);
+    }
+    pthread_mutex_destroy(&ex.lock);
+#else
+    extract_worker(&ex);
+#endif
+
+    // anything not handed out means the workers all bailed early
+    if (ex.next < ex.count) {
+        ex.failed += ex.count - ex.next;
+    }
+
+    free(ex.entries);
+    return ex.failed;
+}
+
 void
 dump_zipfile(FILE* to, zipfile_t file)
 {
     Zipfile* zip = (Zipfile*)file;
-    Zipentry* entry = zip->entries;
+    Zipentry* entry;
     int i;
 
+    if (materialize_all(zip) != 0) {
+        fprintf(to, "(incomplete archive)\n");
+        return;
+    }
+    entry = zip->entries;
+
     fprintf(to, "entryCount=%d\n", zip->entryCount);
     for (i=0; i<zip->entryCount; i++) {
         fprintf(to, "  file \"");
@@ -150,6 +510,9 @@ iterate_zipfile(zipfile_t file, void** cookie)
     Zipentry* entry = (Zipentry*)*cookie;
     if (entry == NULL) {
         Zipfile* zip = (Zipfile*)file;
+        if (materialize_all(zip) != 0) {
+            return NULL;
+        }
         *cookie = zip->entries;
         return *cookie;
     } else {
@@ -19,7 +19,12 @@
 #include <ctype.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <zlib.h>
 
 #define DEFAULT_LOG_ROTATE_SIZE_KBYTES 16
 #define DEFAULT_MAX_ROTATED_LOGS 4
@@ -43,6 +48,44 @@ static int g_outFD = -1;
 static off_t g_outByteCount = 0;
 static int g_isBinary = 0;
 static int g_printBinary = 0;
+static int g_snapshot = 0;
+static const char * g_formatFile = NULL;
+static int g_flushIntervalMs = 0;       // 0 means "write every line through"
+static int g_compressRotated = 0;
+
+static char g_outBuffer[64 * 1024];
+static size_t g_outBufferUsed = 0;
+
+static pthread_t g_compressThread;
+static int g_compressActive = 0;
+static long long g_lastFlushMs = 0;
+
+static long long nowMs()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * One open ring buffer.  Entries read from a device are queued here in
+ * arrival (and therefore timestamp) order, so interleaving N devices
+ * is a k-way merge on the queue heads.
+ */
+struct queued_entry_t {
+    unsigned char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
+    queued_entry_t* next;
+};
+
+struct log_device_t {
+    char* device;
+    int fd;
+    int binary;             /* events buffer; decode via the tag map */
+    queued_entry_t* queueHead;
+    queued_entry_t* queueTail;
+    log_device_t* next;
+};
 
 static EventTagMap* g_eventTagMap = NULL;
 
@@ -51,6 +94,102 @@ static int openLogFile (const char *pathname)
     return open(g_outputFileName, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
 }
 
+/* empty the userspace output buffer (used with -i) into the fd */
+static void flushOutput()
+{
+    size_t off = 0;
+    int ret;
+
+    while (off < g_outBufferUsed) {
+        ret = write(g_outFD, g_outBuffer + off, g_outBufferUsed - off);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("output error");
+            exit(-1);
+        }
+        off += ret;
+    }
+    g_outBufferUsed = 0;
+    g_lastFlushMs = nowMs();
+}
+
+static void bufferedWrite(const char *data, size_t len)
+{
+    if (len > sizeof(g_outBuffer) - g_outBufferUsed) {
+        flushOutput();
+    }
+    if (len > sizeof(g_outBuffer)) {
+        /* bigger than the whole buffer; write it straight through */
+        size_t off = 0;
+        int ret;
+
+        while (off < len) {
+            ret = write(g_outFD, data + off, len - off);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                perror("output error");
+                exit(-1);
+            }
+            off += ret;
+        }
+        return;
+    }
+    memcpy(g_outBuffer + g_outBufferUsed, data, len);
+    g_outBufferUsed += len;
+}
+
+/*
+ * gzip a rotated log on a background thread, so the logging path only
+ * pays for the rename.  The source file is removed once the archive
+ * is safely written; on failure the half-written archive is removed
+ * and the plain file kept.
+ */
+static void* compressFileThread(void *arg)
+{
+    char *path = (char *) arg;
+    char *gzPath;
+    char buf[16 * 1024];
+    FILE *in;
+    gzFile out;
+    size_t n;
+    int ok = 1;
+
+    asprintf(&gzPath, "%s.gz", path);
+
+    in = fopen(path, "rb");
+    out = gzopen(gzPath, "wb");
+    if (in == NULL || out == NULL) {
+        ok = 0;
+    } else {
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            if (gzwrite(out, buf, n) != (int) n) {
+                ok = 0;
+                break;
+            }
+        }
+        if (ferror(in))
+            ok = 0;
+    }
+
+    if (in != NULL)
+        fclose(in);
+    if (out != NULL && gzclose(out) != Z_OK)
+        ok = 0;
+
+    if (ok) {
+        unlink(path);
+    } else {
+        fprintf(stderr, "couldn't compress %s\n", path);
+        unlink(gzPath);
+    }
+
+    free(gzPath);
+    free(path);
+    return NULL;
+}
+
 static void rotateLogs()
 {
     int err;
@@ -60,15 +199,31 @@ static void rotateLogs()
         return;
     }
 
+    flushOutput();
     close(g_outFD);
 
+    // an archive from the previous rotation may still be in flight;
+    // it has to land before its name can be shifted
+    if (g_compressActive) {
+        pthread_join(g_compressThread, NULL);
+        g_compressActive = 0;
+    }
+
+    // with -z the steady-state chain is file.1.gz .. file.N.gz; the
+    // live file briefly becomes file.1 until the background gzip lands
     for (int i = g_maxRotatedLogs ; i > 0 ; i--) {
         char *file0, *file1;
 
-        asprintf(&file1, "%s.%d", g_outputFileName, i);
+        if (g_compressRotated && i > 1) {
+            asprintf(&file1, "%s.%d.gz", g_outputFileName, i);
+        } else {
+            asprintf(&file1, "%s.%d", g_outputFileName, i);
+        }
 
         if (i - 1 == 0) {
             asprintf(&file0, "%s", g_outputFileName);
+        } else if (g_compressRotated) {
+            asprintf(&file0, "%s.%d.gz", g_outputFileName, i - 1);
         } else {
             asprintf(&file0, "%s.%d", g_outputFileName, i - 1);
         }
@@ -83,6 +238,18 @@ static void rotateLogs()
         free(file0);
     }
 
+    if (g_compressRotated) {
+        char *rotated;
+
+        asprintf(&rotated, "%s.1", g_outputFileName);
+        if (pthread_create(&g_compressThread, NULL,
+                compressFileThread, rotated) == 0) {
+            g_compressActive = 1;
+        } else {
+            free(rotated);
+        }
+    }
+
     g_outFD = openLogFile (g_outputFileName);
 
     if (g_outFD < 0) {
@@ -104,14 +271,14 @@ void printBinary(struct logger_entry *buf)
     } while (ret < 0 && errno == EINTR);
 }
 
-static void processBuffer(struct logger_entry *buf)
+static void processBuffer(struct logger_entry *buf, int binary)
 {
     int bytesWritten;
     int err;
     AndroidLogEntry entry;
     char binaryMsgBuf[1024];
 
-    if (g_isBinary) {
+    if (binary) {
         err = android_log_processBinaryLogBuffer(buf, &entry, g_eventTagMap,
                 binaryMsgBuf, sizeof(binaryMsgBuf));
         //printf(">>> pri=%d len=%d msg='%s'\n",
@@ -122,12 +289,37 @@ static void processBuffer(struct logger_entry *buf)
     if (err < 0)
         goto error;
 
-    bytesWritten = android_log_filterAndPrintLogLine(
-                        g_logformat, g_outFD, &entry);
+    if (g_flushIntervalMs > 0) {
+        /* buffered output: format here and batch the writes */
+        char defaultBuffer[512];
+        char *outBuffer;
+        size_t totalLen;
 
-    if (bytesWritten < 0) {
-        perror("output error");
-        exit(-1);
+        if (0 == android_log_shouldPrintLine(g_logformat, entry.tag,
+                entry.priority)) {
+            return;
+        }
+
+        outBuffer = android_log_formatLogLine(g_logformat, defaultBuffer,
+                sizeof(defaultBuffer), &entry, &totalLen);
+        if (outBuffer == NULL) {
+            perror("output error");
+            exit(-1);
+        }
+
+        bufferedWrite(outBuffer, totalLen);
+        if (outBuffer != defaultBuffer) {
+            free(outBuffer);
+        }
+        bytesWritten = totalLen;
+    } else {
+        bytesWritten = android_log_filterAndPrintLogLine(
+                            g_logformat, g_outFD, &entry);
+
+        if (bytesWritten < 0) {
+            perror("output error");
+            exit(-1);
+        }
     }
 
     g_outByteCount += bytesWritten;
@@ -143,44 +335,226 @@ error:
     return;
 }
 
-static void readLogLines(int logfd)
+/*
+ * Read everything a device has ready, one entry per read (a driver
+ * guarantee), queueing in arrival order.  Returns when the device
+ * would block.
+ */
+static void drainDevice(log_device_t* dev)
 {
-    while (1) {
-        unsigned char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
-        struct logger_entry *entry = (struct logger_entry *) buf;
+    for (;;) {
+        queued_entry_t* entry = new queued_entry_t;
+        struct logger_entry* e = (struct logger_entry*) entry->buf;
         int ret;
 
-        ret = read(logfd, entry, LOGGER_ENTRY_MAX_LEN);
-        if (ret < 0) {
-            if (errno == EINTR)
+        ret = read(dev->fd, e, LOGGER_ENTRY_MAX_LEN);
+        if (ret <= 0) {
+            delete entry;
+            if (ret < 0 && errno == EINTR)
                 continue;
-            if (errno == EAGAIN)
-                break;
-            perror("logcat read");
+            if (ret < 0 && errno == EAGAIN)
+                return;
+            if (ret == 0)
+                fprintf(stderr, "read: Unexpected EOF!\n");
+            else
+                perror("logcat read");
             exit(EXIT_FAILURE);
         }
-        else if (!ret) {
-            fprintf(stderr, "read: Unexpected EOF!\n");
-            exit(EXIT_FAILURE);
+
+        e->msg[e->len] = '\0';
+        entry->next = NULL;
+        if (dev->queueTail == NULL) {
+            dev->queueHead = entry;
+        } else {
+            dev->queueTail->next = entry;
         }
+        dev->queueTail = entry;
+    }
+}
 
-        /* NOTE: driver guarantees we read exactly one full entry */
+/* does a come before b? */
+static int entryBefore(const queued_entry_t* a, const queued_entry_t* b)
+{
+    const struct logger_entry* ea = (const struct logger_entry*) a->buf;
+    const struct logger_entry* eb = (const struct logger_entry*) b->buf;
 
-        entry->msg[entry->len] = '\0';
+    if (ea->sec != eb->sec)
+        return ea->sec < eb->sec;
+    return ea->nsec < eb->nsec;
+}
+
+/*
+ * Emit every queued entry across all devices in timestamp order: a
+ * k-way merge on the per-device queue heads.  Everything queued came
+ * from the same drain pass, so nothing earlier can still arrive.
+ */
+static void printQueued(log_device_t* devices)
+{
+    for (;;) {
+        log_device_t* oldest = NULL;
+        log_device_t* dev;
+        queued_entry_t* entry;
+
+        for (dev = devices; dev != NULL; dev = dev->next) {
+            if (dev->queueHead == NULL)
+                continue;
+            if (oldest == NULL ||
+                    entryBefore(dev->queueHead, oldest->queueHead)) {
+                oldest = dev;
+            }
+        }
+        if (oldest == NULL)
+            break;
+
+        entry = oldest->queueHead;
+        oldest->queueHead = entry->next;
+        if (oldest->queueHead == NULL)
+            oldest->queueTail = NULL;
 
         if (g_printBinary) {
-            printBinary(entry);
+            printBinary((struct logger_entry*) entry->buf);
         } else {
-            (void) processBuffer(entry);
+            processBuffer((struct logger_entry*) entry->buf, oldest->binary);
+        }
+        delete entry;
+    }
+}
+
+static void readLogLines(log_device_t* devices, int dumpAndExit)
+{
+    struct pollfd* fds;
+    log_device_t* dev;
+    int count = 0;
+
+    for (dev = devices; dev != NULL; dev = dev->next)
+        count++;
+    fds = new struct pollfd[count];
+    count = 0;
+    for (dev = devices; dev != NULL; dev = dev->next) {
+        fds[count].fd = dev->fd;
+        fds[count].events = POLLIN;
+        count++;
+    }
+
+    for (;;) {
+        for (dev = devices; dev != NULL; dev = dev->next) {
+            drainDevice(dev);
+        }
+        printQueued(devices);
+
+        if (dumpAndExit) {
+            flushOutput();
+            delete[] fds;
+            return;
+        }
+
+        int ret;
+        int timeout = -1;
+        if (g_outBufferUsed > 0) {
+            /* flush once the interval has passed, even under a
+             * steady stream of entries */
+            long long elapsed = nowMs() - g_lastFlushMs;
+
+            if (elapsed >= g_flushIntervalMs) {
+                flushOutput();
+            } else {
+                timeout = g_flushIntervalMs - (int) elapsed;
+            }
+        }
+        do {
+            ret = poll(fds, count, timeout);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            perror("logcat poll");
+            exit(EXIT_FAILURE);
+        }
+        if (ret == 0) {
+            /* flush interval expired with no new log data */
+            flushOutput();
         }
     }
 }
 
+/*
+ * Offline formatter for a raw entry stream produced by -S or -B:
+ * mmap the file and feed each record through the normal filtering and
+ * formatting path.  Records in the stream aren't aligned, so each one
+ * is copied into the same aligned buffer readLogLines uses.
+ */
+static int formatBinaryFile(const char *path)
+{
+    unsigned char buf[LOGGER_ENTRY_MAX_LEN + 1] __attribute__((aligned(4)));
+    struct logger_entry *entry = (struct logger_entry *) buf;
+    const unsigned char *data;
+    const unsigned char *pos;
+    struct stat sb;
+    size_t remaining;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &sb) < 0) {
+        fprintf(stderr, "Unable to open log dump '%s': %s\n",
+                path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (sb.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    data = (const unsigned char *) mmap(NULL, sb.st_size, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Unable to map log dump '%s': %s\n",
+                path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    pos = data;
+    remaining = sb.st_size;
+    while (remaining >= sizeof(struct logger_entry)) {
+        memcpy(buf, pos, sizeof(struct logger_entry));
+
+        if (entry->len > LOGGER_ENTRY_MAX_PAYLOAD ||
+                sizeof(struct logger_entry) + entry->len > remaining) {
+            fprintf(stderr, "Warning: truncated or corrupt record "
+                    "at offset %d\n", (int)(pos - data));
+            break;
+        }
+
+        memcpy(entry->msg, pos + sizeof(struct logger_entry), entry->len);
+        entry->msg[entry->len] = '\0';
+
+        pos += sizeof(struct logger_entry) + entry->len;
+        remaining -= sizeof(struct logger_entry) + entry->len;
+
+        processBuffer(entry, g_isBinary);
+    }
+
+    munmap((void *) data, sb.st_size);
+    return 0;
+}
+
 static int clearLog(int logfd)
 {
     return ioctl(logfd, LOGGER_FLUSH_LOG);
 }
 
+static log_device_t* makeLogDevice(const char* bufName)
+{
+    log_device_t* dev = new log_device_t;
+
+    asprintf(&dev->device, "%s%s", LOG_FILE_DIR, bufName);
+    dev->fd = -1;
+    dev->binary = (strcmp(bufName, "events") == 0);
+    dev->queueHead = NULL;
+    dev->queueTail = NULL;
+    dev->next = NULL;
+
+    return dev;
+}
+
 /* returns the total size of the log's ring buffer */
 static int getLogSize(int logfd)
 {
@@ -193,6 +567,76 @@ static int getLogReadableSize(int logfd)
     return ioctl(logfd, LOGGER_GET_LOG_LEN);
 }
 
+/*
+ * Drain the whole ring into memory and write it out as one raw
+ * logger_entry stream.  The driver hands back exactly one entry per
+ * read however large the buffer, so the batching happens on the
+ * output side: the snapshot is a single buffered write instead of one
+ * write per entry, and we never pay for formatting.  The result can
+ * be formatted later with -F.
+ */
+static void snapshotLog(int logfd)
+{
+    size_t capacity;
+    size_t used = 0;
+    unsigned char *buf;
+    unsigned char *out;
+    int readable;
+    int ret;
+
+    readable = getLogReadableSize(logfd);
+    if (readable < 0)
+        readable = 0;
+    capacity = readable + LOGGER_ENTRY_MAX_LEN;
+
+    buf = (unsigned char *) malloc(capacity);
+    if (buf == NULL) {
+        fprintf(stderr, "couldn't allocate %d byte snapshot buffer\n",
+                (int) capacity);
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        if (capacity - used < LOGGER_ENTRY_MAX_LEN) {
+            /* more arrived while we were draining */
+            capacity *= 2;
+            buf = (unsigned char *) realloc(buf, capacity);
+            if (buf == NULL) {
+                fprintf(stderr, "couldn't grow snapshot buffer\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        ret = read(logfd, buf + used, LOGGER_ENTRY_MAX_LEN);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            perror("logcat read");
+            exit(EXIT_FAILURE);
+        }
+        if (ret == 0)
+            break;
+
+        used += ret;
+    }
+
+    out = buf;
+    while (used > 0) {
+        ret = write(g_outFD, out, used);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("snapshot write");
+            exit(EXIT_FAILURE);
+        }
+        out += ret;
+        used -= ret;
+    }
+    free(buf);
+}
+
 static void setupOutput()
 {
 
@@ -225,14 +669,22 @@ static void show_help(const char *cmd)
                     "  -f <filename>   Log to file. Default to stdout\n"
                     "  -r [<kbytes>]   Rotate log every kbytes. (16 if unspecified). Requires -f\n"
                     "  -n <count>      Sets max number of rotated logs to <count>, default 4\n"
+                    "  -i <millis>     Buffer file output, flushing every <millis> ms at most;\n"
+                    "                  cuts flash writes for long-running logs. Requires -f\n"
+                    "  -z              gzip rotated logs in the background. Requires -r\n"
                     "  -v <format>     Sets the log print format, where <format> is one of:\n\n"
                     "                  brief process tag thread raw time threadtime long\n\n"
                     "  -c              clear (flush) the entire log and exit\n"
                     "  -d              dump the log and then exit (don't block)\n"
                     "  -g              get the size of the log's ring buffer and exit\n"
                     "  -b <buffer>     request alternate ring buffer\n"
-                    "                  ('main' (default), 'radio', 'events')\n"
-                    "  -B              output the log in binary");
+                    "                  ('main' (default), 'radio', 'events' or 'all');\n"
+                    "                  may be given more than once, output is merged\n"
+                    "                  by entry timestamp\n"
+                    "  -B              output the log in binary\n"
+                    "  -S              snapshot: dump the ring unformatted and exit.\n"
+                    "                  Much faster than -d; format later with -F\n"
+                    "  -F <filename>   format a raw dump taken with -S (or -B) and exit");
 
 
     fprintf(stderr,"\nfilterspecs are a series of \n"
@@ -278,13 +730,14 @@ extern "C" void logprint_run_tests(void);
 
 int main (int argc, char **argv)
 {
-    int logfd;
     int err;
     int hasSetLogFormat = 0;
     int clearLog = 0;
     int getLogSize = 0;
-    int mode = O_RDONLY;
-    char *log_device = strdup("/dev/"LOGGER_LOG_MAIN);
+    int dumpAndExit = 0;
+    int mode = O_RDONLY | O_NONBLOCK;
+    android::log_device_t* devices = NULL;
+    android::log_device_t* dev;
     const char *forceFilters = NULL;
 
     g_logformat = android_log_format_new();
@@ -302,7 +755,7 @@ int main (int argc, char **argv)
     for (;;) {
         int ret;
 
-        ret = getopt(argc, argv, "cdgsQf:r::n:v:b:B");
+        ret = getopt(argc, argv, "cdgsQf:r::n:v:b:BSF:i:z");
 
         if (ret < 0) {
             break;
@@ -320,27 +773,75 @@ int main (int argc, char **argv)
             break;
 
             case 'd':
-                mode |= O_NONBLOCK;
+                dumpAndExit = 1;
             break;
 
             case 'g':
                 getLogSize = 1;
             break;
 
-            case 'b':
-                free(log_device);
-                log_device =
-                    (char*) malloc(strlen(LOG_FILE_DIR) + strlen(optarg) + 1);
-                strcpy(log_device, LOG_FILE_DIR);
-                strcat(log_device, optarg);
+            case 'b': {
+                static const char* all_buffers[] = { "main", "radio", "events" };
+                const char* one[1];
+                const char** names;
+                unsigned int count;
+                unsigned int i;
 
-                android::g_isBinary = (strcmp(optarg, "events") == 0);
+                if (strcmp(optarg, "all") == 0) {
+                    names = all_buffers;
+                    count = sizeof(all_buffers) / sizeof(all_buffers[0]);
+                } else {
+                    one[0] = optarg;
+                    names = one;
+                    count = 1;
+                }
+
+                for (i = 0; i < count; i++) {
+                    android::log_device_t** pp = &devices;
+
+                    /* ignore buffers requested twice */
+                    for (dev = devices; dev != NULL; dev = dev->next) {
+                        if (strcmp(dev->device + strlen(LOG_FILE_DIR),
+                                names[i]) == 0)
+                            break;
+                        pp = &dev->next;
+                    }
+                    if (dev != NULL)
+                        continue;
+
+                    *pp = android::makeLogDevice(names[i]);
+                    if ((*pp)->binary)
+                        android::g_isBinary = 1;
+                }
+            }
             break;
 
             case 'B':
                 android::g_printBinary = 1;
             break;
 
+            case 'S':
+                android::g_snapshot = 1;
+                mode |= O_NONBLOCK;
+            break;
+
+            case 'F':
+                android::g_formatFile = optarg;
+            break;
+
+            case 'i':
+                if (!isdigit(optarg[0])) {
+                    fprintf(stderr,"Invalid parameter to -i\n");
+                    android::show_help(argv[0]);
+                    exit(-1);
+                }
+                android::g_flushIntervalMs = atoi(optarg);
+            break;
+
+            case 'z':
+                android::g_compressRotated = 1;
+            break;
+
             case 'f':
                 // redirect output to a file
 
@@ -461,7 +962,7 @@ int main (int argc, char **argv)
         }
     }
 
-    if (android::g_logRotateSizeKBytes != 0 
+    if (android::g_logRotateSizeKBytes != 0
         && android::g_outputFileName == NULL
     ) {
         fprintf(stderr,"-r requires -f as well\n");
@@ -469,6 +970,18 @@ int main (int argc, char **argv)
         exit(-1);
     }
 
+    if (android::g_flushIntervalMs != 0 && android::g_outputFileName == NULL) {
+        fprintf(stderr,"-i requires -f as well\n");
+        android::show_help(argv[0]);
+        exit(-1);
+    }
+
+    if (android::g_compressRotated && android::g_logRotateSizeKBytes == 0) {
+        fprintf(stderr,"-z requires -r as well\n");
+        android::show_help(argv[0]);
+        exit(-1);
+    }
+
     android::setupOutput();
 
     if (hasSetLogFormat == 0) {
@@ -517,42 +1030,56 @@ int main (int argc, char **argv)
         }
     }
 
-    logfd = open(log_device, mode);
-    if (logfd < 0) {
-        fprintf(stderr, "Unable to open log device '%s': %s\n",
-            log_device, strerror(errno));
-        exit(EXIT_FAILURE);
+    if (android::g_formatFile != NULL) {
+        if (android::g_isBinary)
+            android::g_eventTagMap = android_openEventTagMap(EVENT_TAG_MAP_FILE);
+        return android::formatBinaryFile(android::g_formatFile);
     }
 
-    if (clearLog) {
-        int ret;
-        ret = android::clearLog(logfd);
-        if (ret) {
-            perror("ioctl");
+    if (devices == NULL) {
+        devices = android::makeLogDevice("main");
+    }
+
+    for (dev = devices; dev != NULL; dev = dev->next) {
+        dev->fd = open(dev->device, mode);
+        if (dev->fd < 0) {
+            fprintf(stderr, "Unable to open log device '%s': %s\n",
+                dev->device, strerror(errno));
             exit(EXIT_FAILURE);
         }
+    }
+
+    if (clearLog) {
+        for (dev = devices; dev != NULL; dev = dev->next) {
+            if (android::clearLog(dev->fd)) {
+                perror("ioctl");
+                exit(EXIT_FAILURE);
+            }
+        }
         return 0;
     }
 
     if (getLogSize) {
-        int size, readable;
+        for (dev = devices; dev != NULL; dev = dev->next) {
+            int size, readable;
 
-        size = android::getLogSize(logfd);
-        if (size < 0) {
-            perror("ioctl");
-            exit(EXIT_FAILURE);
-        }
+            size = android::getLogSize(dev->fd);
+            if (size < 0) {
+                perror("ioctl");
+                exit(EXIT_FAILURE);
+            }
 
-        readable = android::getLogReadableSize(logfd);
-        if (readable < 0) {
-            perror("ioctl");
-            exit(EXIT_FAILURE);
-        }
+            readable = android::getLogReadableSize(dev->fd);
+            if (readable < 0) {
+                perror("ioctl");
+                exit(EXIT_FAILURE);
+            }
 
-        printf("ring buffer is %dKb (%dKb consumed), "
-               "max entry is %db, max payload is %db\n",
-               size / 1024, readable / 1024,
-               (int) LOGGER_ENTRY_MAX_LEN, (int) LOGGER_ENTRY_MAX_PAYLOAD);
+            printf("%s: ring buffer is %dKb (%dKb consumed), "
+                   "max entry is %db, max payload is %db\n",
+                   dev->device, size / 1024, readable / 1024,
+                   (int) LOGGER_ENTRY_MAX_LEN, (int) LOGGER_ENTRY_MAX_PAYLOAD);
+        }
         return 0;
     }
 
@@ -560,10 +1087,17 @@ int main (int argc, char **argv)
     //LOG_EVENT_LONG(11, 0x1122334455667788LL);
     //LOG_EVENT_STRING(0, "whassup, doc?");
 
+    if (android::g_snapshot) {
+        for (dev = devices; dev != NULL; dev = dev->next) {
+            android::snapshotLog(dev->fd);
+        }
+        return 0;
+    }
+
     if (android::g_isBinary)
         android::g_eventTagMap = android_openEventTagMap(EVENT_TAG_MAP_FILE);
 
-    android::readLogLines(logfd);
+    android::readLogLines(devices, dumpAndExit);
 
     return 0;
 }
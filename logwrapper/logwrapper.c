@@ -17,6 +17,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -44,9 +45,119 @@ void usage() {
         "    fault address is set to the status of wait()\n");
 }
 
+/*
+ * Child output is staged in a ring buffer and written to the log by a
+ * separate flusher thread, so a stalled log device never blocks the
+ * reader (and therefore never blocks the wrapped tool's stdout).  If
+ * the log stalls long enough for the ring to fill, the oldest lines
+ * are dropped and accounted for in a summary line.
+ */
+
+#define RING_SIZE (32 * 1024)   // bytes of buffered child output
+#define BATCH_MAX 4096          // max bytes of lines per log write
+
+static char ring[RING_SIZE];
+static int ring_tail;           // oldest byte in the ring
+static int ring_used;
+static int ring_dropped;        // lines dropped since the last summary
+static int ring_done;           // no more child output is coming
+static const char *ring_tag;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_ready = PTHREAD_COND_INITIALIZER;
+
+// Drop the oldest line in the ring.  Called with ring_lock held.
+static void ring_drop_line() {
+    char c;
+
+    while (ring_used > 0) {
+        c = ring[ring_tail];
+        ring_tail = (ring_tail + 1) % RING_SIZE;
+        ring_used--;
+        if (c == '\n')
+            break;
+    }
+    ring_dropped++;
+}
+
+// Append one line of child output (newline-terminated in the ring)
+static void ring_put_line(const char *line, int len) {
+    int i;
+
+    // keep the old behavior of terminating the line at the first CR
+    // (which the reader turned into a NUL)
+    for (i = 0; i < len; i++) {
+        if (line[i] == '\0') {
+            len = i;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&ring_lock);
+    while (RING_SIZE - ring_used < len + 1)
+        ring_drop_line();
+    for (i = 0; i < len; i++) {
+        ring[(ring_tail + ring_used) % RING_SIZE] = line[i];
+        ring_used++;
+    }
+    ring[(ring_tail + ring_used) % RING_SIZE] = '\n';
+    ring_used++;
+    pthread_cond_signal(&ring_ready);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static void *flusher(void *unused) {
+    char batch[BATCH_MAX + 1];
+    int at;
+    int len;
+    int i;
+    int dropped;
+
+    for (;;) {
+        pthread_mutex_lock(&ring_lock);
+        while (ring_used == 0 && !ring_done)
+            pthread_cond_wait(&ring_ready, &ring_lock);
+        if (ring_used == 0) {
+            pthread_mutex_unlock(&ring_lock);
+            break;
+        }
+
+        // Take as many whole lines as fit in one batch.  The ring only
+        // ever holds newline-terminated lines.
+        at = 0;
+        while (ring_used > 0) {
+            for (len = 0; ring[(ring_tail + len) % RING_SIZE] != '\n'; len++)
+                ;
+            if (at > 0 && at + len + 1 > BATCH_MAX)
+                break;
+            for (i = 0; i <= len; i++) {
+                batch[at++] = ring[ring_tail];
+                ring_tail = (ring_tail + 1) % RING_SIZE;
+            }
+            ring_used -= len + 1;
+        }
+        dropped = ring_dropped;
+        ring_dropped = 0;
+        pthread_mutex_unlock(&ring_lock);
+
+        if (dropped) {
+            LOG(LOG_INFO, "logwrapper", "%s: dropped %d lines of output",
+                    ring_tag, dropped);
+        }
+        batch[at - 1] = '\0';   // strip the trailing newline
+        LOG(LOG_INFO, ring_tag, "%s", batch);
+    }
+    return NULL;
+}
+
 void parent(const char *tag, int seg_fault_on_exit, int parent_read) {
     int status;
     char buffer[4096];
+    pthread_t flush_thread;
+
+    ring_tag = tag;
+    if (pthread_create(&flush_thread, NULL, flusher, NULL)) {
+        fatal("Cannot create flusher thread\n");
+    }
 
     int a = 0;  // start index of unprocessed data
     int b = 0;  // end index of unprocessed data
@@ -54,21 +165,19 @@ void parent(const char *tag, int seg_fault_on_exit, int parent_read) {
     while ((sz = read(parent_read, &buffer[b], sizeof(buffer) - 1 - b)) > 0) {
 
         sz += b;
-        // Log one line at a time
+        // Queue one line at a time
         for (b = 0; b < sz; b++) {
             if (buffer[b] == '\r') {
                 buffer[b] = '\0';
             } else if (buffer[b] == '\n') {
-                buffer[b] = '\0';
-                LOG(LOG_INFO, tag, &buffer[a]);
+                ring_put_line(&buffer[a], b - a);
                 a = b + 1;
             }
         }
 
         if (a == 0 && b == sizeof(buffer) - 1) {
             // buffer is full, flush
-            buffer[b] = '\0';
-            LOG(LOG_INFO, tag, &buffer[a]);
+            ring_put_line(buffer, b);
             b = 0;
         } else if (a != b) {
             // Keep left-overs
@@ -83,9 +192,14 @@ void parent(const char *tag, int seg_fault_on_exit, int parent_read) {
     }
     // Flush remaining data
     if (a != b) {
-        buffer[b] = '\0';
-        LOG(LOG_INFO, tag, &buffer[a]);
+        ring_put_line(&buffer[a], b - a);
     }
+    pthread_mutex_lock(&ring_lock);
+    ring_done = 1;
+    pthread_cond_signal(&ring_ready);
+    pthread_mutex_unlock(&ring_lock);
+    pthread_join(flush_thread, NULL);
+
     status = 0xAAAA;
     if (wait(&status) != -1) {  // Wait for child
         if (WIFEXITED(status))
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <poll.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 #include <sys/mount.h>
@@ -71,10 +72,19 @@ static const char *MODULES[] = { "dm_mod", "crypto", "crypto_algapi", "crypto_bl
                                  "mbcache", "ext3",
                                  NULL };
 static const char KEY_PATH[] = "/data/system/asec.key";
+static const char STATE_PATH[] = "/data/system/asec.state";
 static const char MODULE_PATH[] = "/system/lib/modules";
 static const char MKE2FS_PATH[] = "/system/bin/mke2fs";
 static const char E2FSCK_PATH[] = "/system/bin/e2fsck";
 
+// How many containers are brought up at once by AsecStartAll()
+#define ASEC_START_THREADS 4
+
+// Containers can start concurrently, but loop/dm numbers and the key
+// and state files are shared between them
+static pthread_mutex_t asec_dev_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t asec_state_lock = PTHREAD_MUTEX_INITIALIZER;
+
 boolean AsecIsStarted(void *Handle)
 {
     struct asec_context *ctx = (struct asec_context *) Handle;
@@ -210,8 +220,10 @@ static int AsecLoadGenerateKey(struct asec_context *ctx)
     int fd;
     int rc = 0;
 
+    pthread_mutex_lock(&asec_state_lock);
     if ((fd = open(KEY_PATH, O_RDWR | O_CREAT, 0600)) < 0) {
         LOG_ERROR("Error opening / creating keyfile (%d)\n", errno);
+        pthread_mutex_unlock(&asec_state_lock);
         return -errno;
     }
 
@@ -230,6 +242,7 @@ static int AsecLoadGenerateKey(struct asec_context *ctx)
     
  out:
     close (fd);
+    pthread_mutex_unlock(&asec_state_lock);
     return rc;
 }
 
@@ -293,6 +306,93 @@ static int AsecCheckFilesystem(struct asec_context *ctx)
     return rc;
 }
 
+/*
+ * A container that was stopped cleanly gets a "name mtime" line in
+ * the state file, stamped with its image's mtime.  If the stamp still
+ * matches when the container next starts, the image is known to be
+ * unchanged since the clean stop and the filesystem check is skipped.
+ * The entry is dropped while the container is started, so only a
+ * clean stop can re-arm the skip.
+ */
+static unsigned long AsecGetCacheMtime(struct asec_context *ctx)
+{
+    char filepath[255];
+    struct stat sbuf;
+
+    sprintf(filepath, "%s/%s", ctx->srcPath, ctx->backingFile);
+    if (stat(filepath, &sbuf) < 0)
+        return 0;
+    return (unsigned long) sbuf.st_mtime;
+}
+
+// Rewrite the state file without our entry, re-adding it stamped
+// 'mtime' if non-zero
+static void AsecUpdateCacheEntry(struct asec_context *ctx, unsigned long mtime)
+{
+    FILE *in, *out;
+    char line[255];
+    char tmppath[255];
+
+    pthread_mutex_lock(&asec_state_lock);
+    sprintf(tmppath, "%s.tmp", STATE_PATH);
+    if (!(out = fopen(tmppath, "w"))) {
+        LOG_ERROR("Unable to write ASEC state file (%d)\n", errno);
+        pthread_mutex_unlock(&asec_state_lock);
+        return;
+    }
+
+    if ((in = fopen(STATE_PATH, "r"))) {
+        while (fgets(line, sizeof(line), in)) {
+            char name[128];
+            unsigned long stamp;
+
+            if (sscanf(line, "%127s %lu", name, &stamp) != 2)
+                continue;
+            if (strcmp(name, ctx->name))
+                fprintf(out, "%s %lu\n", name, stamp);
+        }
+        fclose(in);
+    }
+
+    if (mtime)
+        fprintf(out, "%s %lu\n", ctx->name, mtime);
+    fclose(out);
+    rename(tmppath, STATE_PATH);
+    pthread_mutex_unlock(&asec_state_lock);
+}
+
+static boolean AsecCacheIsClean(struct asec_context *ctx)
+{
+    FILE *f;
+    char line[255];
+    unsigned long mtime = AsecGetCacheMtime(ctx);
+    boolean clean = false;
+
+    if (!mtime)
+        return false;
+
+    pthread_mutex_lock(&asec_state_lock);
+    if (!(f = fopen(STATE_PATH, "r"))) {
+        pthread_mutex_unlock(&asec_state_lock);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        unsigned long stamp;
+
+        if (sscanf(line, "%127s %lu", name, &stamp) != 2)
+            continue;
+        if (!strcmp(name, ctx->name)) {
+            clean = (stamp == mtime);
+            break;
+        }
+    }
+    fclose(f);
+    pthread_mutex_unlock(&asec_state_lock);
+    return clean;
+}
+
 static int AsecOpenCreateCache(struct asec_context *ctx)
 {
     char filepath[255];
@@ -444,10 +544,13 @@ static int AsecCreateDeviceMapping(struct asec_context *ctx)
     int                   dmFd;
     int                   rc = 0;
 
+    // concurrent starts must not pick the same dm number
+    pthread_mutex_lock(&asec_dev_lock);
     ctx->dm_num = FindNextAvailableDm();
 
     if ((dmFd = open("/dev/device-mapper", O_RDWR)) < 0) {
         LOG_ERROR("Error opening device mapper (%d)\n", errno);
+        pthread_mutex_unlock(&asec_dev_lock);
         return -errno;
     }
 
@@ -495,6 +598,7 @@ out_free:
     free (io);
 out_nofree:
     close (dmFd);
+    pthread_mutex_unlock(&asec_dev_lock);
     return rc;
 }
 
@@ -598,9 +702,13 @@ static int AsecCreateLoop(struct asec_context *ctx)
     int device_fd;
     int rc = 0;
 
+    // concurrent starts must not pick the same loop device, and the
+    // device only becomes busy once LOOP_SET_FD lands
+    pthread_mutex_lock(&asec_dev_lock);
     ctx->lo_num = FindNextAvailableLoop();
     if (ctx->lo_num < 0) {
         LOG_ERROR("No loop devices available\n");
+        pthread_mutex_unlock(&asec_dev_lock);
         return -ENXIO;
     }
 
@@ -608,6 +716,7 @@ static int AsecCreateLoop(struct asec_context *ctx)
     device_fd = open(devname, O_RDWR);
     if (device_fd < 0) {
         LOG_ERROR("failed to open loop device (%d)\n", errno);
+        pthread_mutex_unlock(&asec_dev_lock);
         return -errno;
     }
 
@@ -616,6 +725,7 @@ static int AsecCreateLoop(struct asec_context *ctx)
         rc = -errno;
     }
     close(device_fd);
+    pthread_mutex_unlock(&asec_dev_lock);
     return rc;
 }
 
@@ -696,6 +806,9 @@ int AsecStart(void *Handle)
             goto fail_destroydm;
         }
         ctx->needs_format = 0;
+    } else if (AsecCacheIsClean(ctx)) {
+        LOG_ASEC("ASEC volume '%s' unchanged since clean stop - skipping check\n",
+                 ctx->name);
     } else {
         if ((rc = AsecCheckFilesystem(ctx))) {
             LOG_ERROR("AsecStart: Failed to check filesystem (%d)\n", rc);
@@ -704,6 +817,10 @@ int AsecStart(void *Handle)
         }
     }
 
+    // while we're started the image is in flux; only a clean stop
+    // re-arms the check skip
+    AsecUpdateCacheEntry(ctx, 0);
+
     if ((rc = AsecMountCache(ctx)) < 0) {
         LOG_ERROR("AsecStart: Failed to mount cache (%d)\n", rc);
         NotifyAsecState(ASEC_FAILED_INTERR, ctx->dstPath);
@@ -724,6 +841,75 @@ int AsecStart(void *Handle)
     return rc;
 }
 
+struct asec_start_batch {
+    void            **handles;
+    int             count;
+    int             next;
+    pthread_mutex_t lock;
+};
+
+static void *AsecStartThread(void *arg)
+{
+    struct asec_start_batch *batch = (struct asec_start_batch *) arg;
+
+    for (;;) {
+        void *handle = NULL;
+        int rc;
+
+        pthread_mutex_lock(&batch->lock);
+        while (batch->next < batch->count) {
+            handle = batch->handles[batch->next++];
+            if (handle)
+                break;
+        }
+        pthread_mutex_unlock(&batch->lock);
+
+        if (!handle)
+            break;
+
+        if ((rc = AsecStart(handle)) < 0)
+            LOG_ERROR("ASEC start failure (%d)\n", rc);
+    }
+    return NULL;
+}
+
+/*
+ * Start every container in 'Handles' (NULL slots are skipped), up to
+ * ASEC_START_THREADS at a time.  Returns when they have all been
+ * attempted.
+ */
+int AsecStartAll(void **Handles, int Count)
+{
+    struct asec_start_batch batch;
+    pthread_t threads[ASEC_START_THREADS];
+    int nr_threads = 0;
+    int i;
+
+    batch.handles = Handles;
+    batch.count = Count;
+    batch.next = 0;
+    pthread_mutex_init(&batch.lock, NULL);
+
+    for (i = 0; i < Count && nr_threads < ASEC_START_THREADS; i++) {
+        if (!Handles[i])
+            continue;
+        if (pthread_create(&threads[nr_threads], NULL, AsecStartThread, &batch))
+            break;
+        nr_threads++;
+    }
+
+    if (!nr_threads) {
+        // nothing to do, or thread creation failed - run inline
+        AsecStartThread(&batch);
+        return 0;
+    }
+
+    for (i = 0; i < nr_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    return 0;
+}
+
 int AsecStop(void *Handle)
 {
     struct asec_context *ctx = (struct asec_context *) Handle;
@@ -755,7 +941,9 @@ int AsecStop(void *Handle)
     }
 
     AsecCloseCache(ctx);
- 
+
+    AsecUpdateCacheEntry(ctx, AsecGetCacheMtime(ctx));
+
     if ((rc = AsecUnloadModules()) < 0) {
         if (rc == -EAGAIN) {
             LOG_ASEC("AsecStop: Kernel modules still in use\n");
@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <poll.h>
 
+#include <time.h>
+
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <linux/loop.h>
@@ -45,8 +47,12 @@
 // FIXME - only one loop mount is supported at a time
 #define LOOP_DEVICE "/dev/block/loop0"
 
-// timeout value for poll() when retries are pending
-#define POLL_TIMEOUT    1000
+// exponential backoff bounds for mount/unmount retries
+#define RETRY_DELAY_MIN_MS  250
+#define RETRY_DELAY_MAX_MS  8000
+
+// maximum number of coalesced block device events per poll() wakeup
+#define COALESCE_MAX    16
 
 #define MAX_MOUNT_RETRIES   3
 #define MAX_UNMOUNT_RETRIES   5
@@ -93,10 +99,16 @@ typedef struct MountPoint {
     // current state of the mount point
     MountState state;
     
-    // number of mount or unmount retries so far, 
+    // number of mount or unmount retries so far,
     // when attempting to mount or unmount the device
-    int retryCount; 
- 
+    int retryCount;
+
+    // current retry delay in milliseconds, doubled after each failure
+    int retryDelay;
+
+    // uptime in milliseconds of the next retry attempt
+    long long nextRetryTime;
+
     // next in sMountPointList linked list
     struct MountPoint* next;   
 } MountPoint;
@@ -322,16 +334,8 @@ static int DoMountDevice(const char* device, const char* mountPoint)
         MountPoint* mp = sMountPointList;
         while (mp) {
             if (!strcmp(mountPoint, mp->mountPoint)) {
-                int i;
-             
-                for (i = 0; i < ASEC_STORES_MAX; i++) {
-                    if (mp->asecHandles[i] != NULL) {
-                        int a_result;
-                        if ((a_result = AsecStart(mp->asecHandles[i])) < 0) {
-                            LOG_ERROR("ASEC start failure (%d)\n", a_result);
-                        }
-                    }
-                }
+                // bring the containers up in parallel
+                AsecStartAll(mp->asecHandles, ASEC_STORES_MAX);
                 break;
             }
             mp = mp -> next;
@@ -421,11 +425,22 @@ static void SetState(MountPoint* mp, MountState state)
     mp->state = state;
 }
 
+static long long UptimeMillis()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 // Enter a state that requires retries and timeouts.
+// Each mount point keeps its own retry schedule with exponential
+// backoff, so one struggling device does not hold up the others.
 static void SetRetries(MountPoint* mp, MountState state)
 {
     SetState(mp, state);
     mp->retryCount = 0;
+    mp->retryDelay = RETRY_DELAY_MIN_MS;
+    mp->nextRetryTime = UptimeMillis() + mp->retryDelay;
 
     sRetriesPending++;
     // wake up the automounter thread if we are being called 
@@ -638,22 +653,65 @@ static void HandleMediaRemoved(const char* device)
     }
 }
 
-// Handle retrying to mount or unmount devices, 
-// and handle timeout condition if we have tried too many times
+// milliseconds until the next scheduled retry, or -1 if none are pending
+static int NextRetryTimeout()
+{
+    MountPoint* mp = sMountPointList;
+    long long now = UptimeMillis();
+    long long next = -1;
+
+    while (mp)
+    {
+        if (mp->state == kMounting || mp->state == kUnmountingForEject ||
+                mp->state == kUnmountingForUms)
+        {
+            if (next < 0 || mp->nextRetryTime < next)
+                next = mp->nextRetryTime;
+        }
+        mp = mp->next;
+    }
+
+    if (next < 0)
+        return -1;
+    if (next <= now)
+        return 0;
+    return (int)(next - now);
+}
+
+// back off the retry schedule after a failed attempt
+static void RetryFailed(MountPoint* mp, long long now)
+{
+    mp->retryDelay *= 2;
+    if (mp->retryDelay > RETRY_DELAY_MAX_MS)
+        mp->retryDelay = RETRY_DELAY_MAX_MS;
+    mp->nextRetryTime = now + mp->retryDelay;
+}
+
+// Handle retrying to mount or unmount devices,
+// and handle timeout condition if we have tried too many times.
+// Only mount points whose retry is actually due are touched.
 static void HandleRetries()
 {
     MountPoint* mp = sMountPointList;
-    
+    long long now = UptimeMillis();
+
     while (mp)
     {
-       if (mp->state == kMounting) 
+       if (now < mp->nextRetryTime)
+       {
+            // this mount point's retry is not due yet
+            mp = mp->next;
+            continue;
+       }
+
+       if (mp->state == kMounting)
        {
             if (MountPartition(mp->device, mp->mountPoint) == 0)
             {
                 // mount succeeded - clear the retry for this mount point
                 ClearRetries(mp, kMounted);
             } 
-            else 
+            else
             {
                 mp->retryCount++;
                 if (mp->retryCount == MAX_MOUNT_RETRIES)
@@ -663,8 +721,10 @@ static void HandleRetries()
                     // notify that we failed to mount
                     NotifyMediaState(mp->mountPoint, MEDIA_UNMOUNTABLE, false);
                 }
+                else
+                    RetryFailed(mp, now);
             }
-       } 
+       }
        else if (mp->state == kUnmountingForEject || mp->state == kUnmountingForUms)
        {
             if (DoUnmountDevice(mp) == 0)
@@ -704,12 +764,13 @@ static void HandleRetries()
                     }
 
                     // unmounting the device is failing, so start killing processes
-                    KillProcessesWithOpenFiles(mp->mountPoint, sigkill, gExcludedPids, 
+                    KillProcessesWithOpenFiles(mp->mountPoint, sigkill, gExcludedPids,
                                                sizeof(gExcludedPids) / sizeof(pid_t));
 
                 }
+                RetryFailed(mp, now);
             }
-       } 
+       }
         
         mp = mp->next;
     }
@@ -823,40 +884,98 @@ static void* AutoMountThread(void* arg)
         fds[UEVENT_IDX].events = POLLIN;
         fds[UEVENT_IDX].revents = 0;
         
-        // wait for an event or a timeout to occur.
+        // wait for an event or the next scheduled retry.
         // poll() can also return in response to a SIGUSR1 signal
-        timeout = (sRetriesPending ? POLL_TIMEOUT : -1);
+        timeout = (sRetriesPending ? NextRetryTimeout() : -1);
         result = poll(fds, 2, timeout);
 
         // lock the mutex while we are handling events
         pthread_mutex_lock(&sMutex);
 
-        // handle inotify notifications for block device creation and deletion
+        // handle inotify notifications for block device creation and deletion.
+        // Flaky card contacts generate rapid insert/remove bursts, and a
+        // mount attempt for a device that is already gone again blocks the
+        // thread for several retries.  So drain everything that is queued
+        // first, drop create/delete pairs we never acted on, and only then
+        // handle what is left.
         if (fds[INOTIFY_IDX].revents == POLLIN)
         {
-            struct inotify_event    event;
+            struct {
+                char name[32];
+                int mask;
+            } queue[COALESCE_MAX];
+            int queued = 0;
             char    buffer[512];
-            int length = read(inotify_fd, buffer, sizeof(buffer));
-            int offset = 0;
- 
-            while (length >= (int)sizeof(struct inotify_event))
+            int length;
+            int i;
+
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+            {
+                int offset = 0;
+
+                while (length >= (int)sizeof(struct inotify_event))
+                {
+                   struct inotify_event* event = (struct inotify_event *)&buffer[offset];
+
+                   if (event->mask == IN_CREATE || event->mask == IN_DELETE)
+                   {
+                       // find the most recent queued event for this device
+                       for (i = queued - 1; i >= 0; i--)
+                       {
+                           if (strcmp(queue[i].name, event->name) == 0)
+                               break;
+                       }
+
+                       if (i >= 0 && queue[i].mask == event->mask)
+                       {
+                           // duplicate event, nothing new to do
+                       }
+                       else if (i >= 0 && queue[i].mask == IN_CREATE &&
+                               event->mask == IN_DELETE)
+                       {
+                           // the device went away again before we acted on
+                           // its creation; both events are superseded
+                           LOG_MOUNT("/dev/block/%s came and went, skipping\n",
+                                   event->name);
+                           memmove(&queue[i], &queue[i + 1],
+                                   (queued - i - 1) * sizeof(queue[0]));
+                           queued--;
+                       }
+                       else if (queued < COALESCE_MAX)
+                       {
+                           strncpy(queue[queued].name, event->name,
+                                   sizeof(queue[0].name) - 1);
+                           queue[queued].name[sizeof(queue[0].name) - 1] = 0;
+                           queue[queued].mask = event->mask;
+                           queued++;
+                       }
+                       else if (event->mask == IN_CREATE)
+                       {
+                           // queue is full - handle it right away
+                           HandleMediaInserted(event->name);
+                       }
+                       else
+                           HandleMediaRemoved(event->name);
+                   }
+
+                   int size = sizeof(struct inotify_event) + event->len;
+                   length -= size;
+                   offset += size;
+                }
+            }
+
+            for (i = 0; i < queued; i++)
             {
-               struct inotify_event* event = (struct inotify_event *)&buffer[offset];
-               
-               if (event->mask == IN_CREATE)
-               {
-                   LOG_MOUNT("/dev/block/%s created\n", event->name);
-                   HandleMediaInserted(event->name);
-               }
-               else if (event->mask == IN_DELETE)
-               {
-                   LOG_MOUNT("/dev/block/%s deleted\n", event->name);
-                   HandleMediaRemoved(event->name);
-               }
-               
-               int size = sizeof(struct inotify_event) + event->len;
-               length -= size;
-               offset += size;
+                if (queue[i].mask == IN_CREATE)
+                {
+                    LOG_MOUNT("/dev/block/%s created\n", queue[i].name);
+                    HandleMediaInserted(queue[i].name);
+                }
+                else
+                {
+                    LOG_MOUNT("/dev/block/%s deleted\n", queue[i].name);
+                    HandleMediaRemoved(queue[i].name);
+                }
             }
         }
 
@@ -1012,6 +1131,8 @@ void *AddMountPoint(const char* device, const char* mountPoint, const char * dri
     newMountPoint->umsActive = false;
     newMountPoint->state = kUnmounted;
     newMountPoint->retryCount = 0;
+    newMountPoint->retryDelay = 0;
+    newMountPoint->nextRetryTime = 0;
 
     // add to linked list
     newMountPoint->next = sMountPointList;
@@ -79,10 +79,72 @@ static int Write2(const char* message, const char* data)
     return Write(buffer);
 }
 
+// State snapshot shared by all pollers. It is only rewritten (and its
+// sequence number only bumped) on actual transitions, so rapid status
+// polling never touches the driver state and never rebuilds messages.
+static MountdSnapshot sSnapshot = {
+    MOUNTD_SNAPSHOT_VERSION, sizeof(MountdSnapshot), 0,
+    MOUNTD_SNAPSHOT_UNKNOWN, MOUNTD_SNAPSHOT_UNKNOWN,
+    MOUNTD_SNAPSHOT_UNKNOWN, 0, ""
+};
+static pthread_mutex_t sSnapshotMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// updates one snapshot field, returns true if this was a transition
+static boolean UpdateSnapshot(unsigned char* field, unsigned char value)
+{
+    boolean changed;
+
+    pthread_mutex_lock(&sSnapshotMutex);
+    changed = (*field != value);
+    if (changed)
+    {
+        *field = value;
+        sSnapshot.sequence++;
+    }
+    pthread_mutex_unlock(&sSnapshotMutex);
+
+    return changed;
+}
+
+static void SendSnapshot()
+{
+    MountdSnapshot snapshot;
+
+    pthread_mutex_lock(&sSnapshotMutex);
+    snapshot = sSnapshot;
+    pthread_mutex_unlock(&sSnapshotMutex);
+
+    pthread_mutex_lock(&sWriteMutex);
+    LOG_SERVER("SendSnapshot: sequence %u\n", snapshot.sequence);
+    if (sFD >= 0)
+        write(sFD, &snapshot, sizeof(snapshot));
+    pthread_mutex_unlock(&sWriteMutex);
+}
+
 static void SendStatus()
 {
-    Write(IsMassStorageConnected() ? MOUNTD_UMS_CONNECTED : MOUNTD_UMS_DISCONNECTED);
-    Write(IsMassStorageEnabled() ? MOUNTD_UMS_ENABLED : MOUNTD_UMS_DISABLED);
+    unsigned char connected, enabled;
+
+    // answer polls from the cached state; only probe the driver while
+    // the state is still unknown
+    pthread_mutex_lock(&sSnapshotMutex);
+    connected = sSnapshot.umsConnected;
+    enabled = sSnapshot.umsEnabled;
+    pthread_mutex_unlock(&sSnapshotMutex);
+
+    if (connected == MOUNTD_SNAPSHOT_UNKNOWN)
+    {
+        connected = IsMassStorageConnected() ? 1 : 0;
+        UpdateSnapshot(&sSnapshot.umsConnected, connected);
+    }
+    if (enabled == MOUNTD_SNAPSHOT_UNKNOWN)
+    {
+        enabled = IsMassStorageEnabled() ? 1 : 0;
+        UpdateSnapshot(&sSnapshot.umsEnabled, enabled);
+    }
+
+    Write(connected ? MOUNTD_UMS_CONNECTED : MOUNTD_UMS_DISCONNECTED);
+    Write(enabled ? MOUNTD_UMS_ENABLED : MOUNTD_UMS_DISABLED);
 }
 
 static void DoCommand(const char* command)
@@ -92,17 +154,23 @@ static void DoCommand(const char* command)
     if (strcmp(command, MOUNTD_ENABLE_UMS) == 0)
     {
         EnableMassStorage(true);
+        UpdateSnapshot(&sSnapshot.umsEnabled, 1);
         Write(MOUNTD_UMS_ENABLED);
      }
-    else if (strcmp(command, MOUNTD_DISABLE_UMS) == 0) 
+    else if (strcmp(command, MOUNTD_DISABLE_UMS) == 0)
     {
         EnableMassStorage(false);
+        UpdateSnapshot(&sSnapshot.umsEnabled, 0);
         Write(MOUNTD_UMS_DISABLED);
     }
     else if (strcmp(command, MOUNTD_SEND_STATUS) == 0)
     {
         SendStatus();
     }
+    else if (strcmp(command, MOUNTD_SEND_SNAPSHOT) == 0)
+    {
+        SendSnapshot();
+    }
     else if (strncmp(command, MOUNTD_MOUNT_MEDIA, strlen(MOUNTD_MOUNT_MEDIA)) == 0)
     {
         const char* path = command + strlen(MOUNTD_MOUNT_MEDIA);
@@ -157,7 +225,10 @@ int RunServer()
             continue;
             
         if (sDeferredUnmountableMediaPath) {
-            NotifyMediaState(sDeferredUnmountableMediaPath, MEDIA_UNMOUNTABLE, false);
+            // the failed state is already in the snapshot, so write the
+            // event directly rather than going through NotifyMediaState,
+            // which would see no transition
+            Write2(MOUNTD_MEDIA_UNMOUNTABLE, sDeferredUnmountableMediaPath);
             free(sDeferredUnmountableMediaPath);
             sDeferredUnmountableMediaPath = NULL;
         }
@@ -205,7 +276,10 @@ int RunServer()
 
 void SendMassStorageConnected(boolean connected)
 {
-    Write(connected ? MOUNTD_UMS_CONNECTED : MOUNTD_UMS_DISCONNECTED);
+    // only notify on actual transitions; pollers that just want the
+    // current state use MOUNTD_SEND_STATUS or MOUNTD_SEND_SNAPSHOT
+    if (UpdateSnapshot(&sSnapshot.umsConnected, connected ? 1 : 0))
+        Write(connected ? MOUNTD_UMS_CONNECTED : MOUNTD_UMS_DISCONNECTED);
 }
 
 void SendUnmountRequest(const char* path)
@@ -302,7 +376,30 @@ void NotifyMediaState(const char* path, MediaState state, boolean readOnly)
             LOG_ERROR("unknown MediaState %d in NotifyMediaState\n", state);
             return;
     }
-    
+
+    // record the transition in the snapshot; if nothing actually
+    // changed there is nothing to tell the clients
+    boolean changed;
+    pthread_mutex_lock(&sSnapshotMutex);
+    changed = sSnapshot.mediaState != (unsigned char)state
+            || sSnapshot.mediaReadOnly != (readOnly ? 1 : 0)
+            || strcmp(sSnapshot.mediaPath, path) != 0;
+    if (changed)
+    {
+        sSnapshot.mediaState = state;
+        sSnapshot.mediaReadOnly = readOnly ? 1 : 0;
+        strncpy(sSnapshot.mediaPath, path, sizeof(sSnapshot.mediaPath) - 1);
+        sSnapshot.mediaPath[sizeof(sSnapshot.mediaPath) - 1] = 0;
+        sSnapshot.sequence++;
+    }
+    pthread_mutex_unlock(&sSnapshotMutex);
+
+    if (!changed)
+    {
+        LOG_SERVER("NotifyMediaState: %s already in state %d\n", path, state);
+        return;
+    }
+
     property_set(EXTERNAL_STORAGE_STATE, propertyValue);
     int result = Write2(event, path);
     if (result < 0 && state == MEDIA_UNMOUNTABLE) {
@@ -105,6 +105,9 @@ typedef enum MediaState {
 #define MOUNTD_DISABLE_UMS    "disable_ums"
 #define MOUNTD_SEND_STATUS    "send_status"
 
+// requests the current state as a binary MountdSnapshot
+#define MOUNTD_SEND_SNAPSHOT  "send_snapshot"
+
 // these commands should contain a mount point following the colon
 #define MOUNTD_MOUNT_MEDIA  "mount_media:"
 #define MOUNTD_EJECT_MEDIA  "eject_media:"
@@ -129,6 +132,26 @@ typedef enum MediaState {
 // this event sent to request unmount for media mount point
 #define MOUNTD_REQUEST_EJECT            "request_eject:"
 
+// Binary state snapshot sent in response to MOUNTD_SEND_SNAPSHOT.
+// It is serialized once per state transition, no matter how many
+// clients poll, and the sequence number only moves on transitions,
+// so pollers can cheaply detect "nothing changed".
+#define MOUNTD_SNAPSHOT_VERSION         1
+
+// value of the unsigned char fields before the state is known
+#define MOUNTD_SNAPSHOT_UNKNOWN         0xFF
+
+typedef struct MountdSnapshot {
+    unsigned short  version;        // MOUNTD_SNAPSHOT_VERSION
+    unsigned short  size;           // sizeof(MountdSnapshot)
+    unsigned int    sequence;       // incremented on every transition
+    unsigned char   umsConnected;
+    unsigned char   umsEnabled;
+    unsigned char   mediaState;     // MediaState enum value
+    unsigned char   mediaReadOnly;
+    char            mediaPath[64];  // mount point of the media
+} MountdSnapshot;
+
 // system properties
 // these must match the corresponding strings in //device/java/android/android/os/Environment.java
 #define EXTERNAL_STORAGE_STATE          "EXTERNAL_STORAGE_STATE"
@@ -168,6 +191,7 @@ void NotifyExistingMounts();
 void *AsecInit(const char *Name, const char *SrcPath, const char *BackingFile,
                const char *Size, const char *DstPath, const char *Crypt);
 int AsecStart(void *Handle);
+int AsecStartAll(void **Handles, int Count);
 int AsecStop(void *Handle);
 void AsecDeinit(void *Handle);
 boolean AsecIsStarted(void *Handle);
@@ -89,6 +89,10 @@ __RCSID("$NetBSD: eval.c,v 1.81.2.1 2005/06/13 22:03:51 tron Exp $");
 #define EV_TESTED 02		/* exit status is checked; ignore -e flag */
 #define EV_BACKCMD 04		/* command executing within back quotes */
 
+#ifndef F_SETPIPE_SZ
+#define F_SETPIPE_SZ 1031	/* Linux-specific fcntl, 2.6.35 and up */
+#endif
+
 int evalskip;			/* set if we are skipping commands */
 STATIC int skipcount;		/* number of levels to skip */
 MKINIT int loopnest;		/* current loop nesting level */
@@ -152,6 +156,14 @@ sh_pipe(int fds[2])
 			fds[1] = nfd;
 		}
 	}
+
+	/*
+	 * Ask for a bigger kernel buffer; bulk pipelines make fewer
+	 * context switches that way.  Best effort only -- kernels
+	 * without F_SETPIPE_SZ just return EINVAL.
+	 */
+	(void) fcntl(fds[1], F_SETPIPE_SZ, 256 * 1024);
+
 	return 0;
 }
 
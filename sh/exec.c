@@ -49,6 +49,7 @@ __RCSID("$NetBSD: exec.c,v 1.37 2003/08/07 09:05:31 agc Exp $");
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 /*
  * When commands are first encountered, they are entered in a hash table.
@@ -83,6 +84,7 @@ __RCSID("$NetBSD: exec.c,v 1.37 2003/08/07 09:05:31 agc Exp $");
 
 #define CMDTABLESIZE 31		/* should be prime */
 #define ARB 1			/* actual size determined at run time */
+#define MAXPATHDIRS 32		/* max PATH directories we stamp */
 
 
 
@@ -94,9 +96,26 @@ struct tblentry {
 	char cmdname[ARB];	/* name of command */
 };
 
+/*
+ * Failed searches are cached in the table as CMDUNKNOWN entries, so a
+ * name that is not on PATH is not searched for again on every use.
+ * The stamp below records (dev, ino, mtime) of every PATH directory
+ * when the first miss is cached; negative entries are only trusted
+ * while none of those directories have changed.
+ */
+
+struct pdirstat {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+};
+
 
 STATIC struct tblentry *cmdtable[CMDTABLESIZE];
 STATIC int builtinloc = -1;		/* index in path of %builtin, or -1 */
+STATIC struct pdirstat pathstamp[MAXPATHDIRS];
+STATIC int pathstamplen = -1;		/* -1 until a miss is cached */
+STATIC time_t pathstamptime;		/* when the stamp was taken */
 int exerrno = 0;			/* Last exec error */
 
 
@@ -106,6 +125,9 @@ STATIC void printentry(struct tblentry *, int);
 STATIC void clearcmdentry(int);
 STATIC struct tblentry *cmdlookup(const char *, int);
 STATIC void delete_cmd_entry(void);
+STATIC int stamppath(const char *, struct pdirstat *);
+STATIC int negvalid(void);
+STATIC void clearnegentries(void);
 
 
 extern char *const parsekwd[];
@@ -348,7 +370,8 @@ hashcmd(int argc, char **argv)
 	if (*argptr == NULL) {
 		for (pp = cmdtable ; pp < &cmdtable[CMDTABLESIZE] ; pp++) {
 			for (cmdp = *pp ; cmdp ; cmdp = cmdp->next) {
-				if (verbose || cmdp->cmdtype == CMDNORMAL)
+				if (cmdp->cmdtype != CMDUNKNOWN &&
+				    (verbose || cmdp->cmdtype == CMDNORMAL))
 					printentry(cmdp, verbose);
 			}
 		}
@@ -357,6 +380,7 @@ hashcmd(int argc, char **argv)
 	while ((name = *argptr) != NULL) {
 		if ((cmdp = cmdlookup(name, 0)) != NULL
 		 && (cmdp->cmdtype == CMDNORMAL
+		     || cmdp->cmdtype == CMDUNKNOWN
 		     || (cmdp->cmdtype == CMDBUILTIN && builtinloc >= 0)))
 			delete_cmd_entry();
 		find_command(name, &entry, DO_ERR, pathval());
@@ -485,6 +509,26 @@ find_command(char *name, struct cmdentry *entry, int act, const char *path)
 					continue;
 				}
 				break;
+			case CMDUNKNOWN:
+				/* cached negative result */
+				if (act & DO_ALTPATH) {
+					cmdp = NULL;
+					continue;
+				}
+				if (cmdp->rehash == 0 && negvalid()) {
+					if (act & DO_ERR)
+						outfmt(out2, "%s: %s\n", name,
+						    errmsg(cmdp->param.index,
+							E_EXEC));
+					entry->cmdtype = CMDUNKNOWN;
+					return;
+				}
+				/* negvalid may have freed the entry
+				 * already; look it up again */
+				if (cmdlookup(name, 0) != NULL)
+					delete_cmd_entry();
+				cmdp = NULL;
+				continue;
 			}
 			/* if not invalidated by cd, we're done */
 			if (cmdp->rehash == 0)
@@ -584,6 +628,22 @@ loop:
 	/* We failed.  If there was an entry for this command, delete it */
 	if (cmdp)
 		delete_cmd_entry();
+	/* Cache the miss so the next lookup of this name does not walk
+	 * PATH again; cleared when PATH or one of its directories
+	 * changes. */
+	if ((act & DO_ALTPATH) == 0) {
+		INTOFF;
+		cmdp = cmdlookup(name, 1);
+		if (cmdp->cmdtype == CMDUNKNOWN) {
+			cmdp->param.index = e;
+			cmdp->rehash = 0;
+			if (pathstamplen < 0) {
+				pathstamplen = stamppath(pathval(), pathstamp);
+				pathstamptime = time((time_t *)0);
+			}
+		}
+		INTON;
+	}
 	if (act & DO_ERR)
 		outfmt(out2, "%s: %s\n", name, errmsg(e, E_EXEC));
 	entry->cmdtype = CMDUNKNOWN;
@@ -659,6 +719,126 @@ hash_special_builtins(void)
 	}
 }
 
+/*
+ * Preload the regular builtins into the hash table as well, so the
+ * first use of one dispatches from the table instead of scanning the
+ * builtins list.
+ */
+
+void
+hash_builtins(void)
+{
+	const struct builtincmd *bp;
+	struct tblentry *cmdp;
+
+	for (bp = builtincmd ; bp->name ; bp++) {
+		cmdp = cmdlookup(bp->name, 1);
+		if (cmdp->cmdtype == CMDUNKNOWN) {
+			cmdp->cmdtype = CMDBUILTIN;
+			cmdp->param.bltin = bp->builtin;
+		}
+	}
+}
+
+/*
+ * Record (dev, ino, mtime) for each directory in path.  Directories
+ * that cannot be stat'ed (or components too long to handle) stamp as
+ * zeroes, which still compares consistently between calls.
+ */
+
+STATIC int
+stamppath(const char *path, struct pdirstat *stamp)
+{
+	char dir[1024];
+	struct stat statb;
+	const char *p;
+	const char *end;
+	const char *opt;
+	size_t len;
+	int n = 0;
+
+	for (p = path ; p != NULL && n < MAXPATHDIRS ; ) {
+		end = strchr(p, ':');
+		len = end != NULL ? (size_t)(end - p) : strlen(p);
+		memset(&stamp[n], 0, sizeof(stamp[n]));
+		if (len < sizeof(dir)) {
+			opt = memchr(p, '%', len);
+			if (opt != NULL)
+				len = opt - p;
+			if (len == 0) {
+				dir[0] = '.';	/* empty component is cwd */
+				dir[1] = '\0';
+			} else {
+				memcpy(dir, p, len);
+				dir[len] = '\0';
+			}
+			if (stat(dir, &statb) >= 0) {
+				stamp[n].dev = statb.st_dev;
+				stamp[n].ino = statb.st_ino;
+				stamp[n].mtime = statb.st_mtime;
+			}
+		}
+		n++;
+		p = end != NULL ? end + 1 : NULL;
+	}
+	return n;
+}
+
+/*
+ * Check that the PATH directories are unchanged since the stamp was
+ * taken.  If any changed, drop every cached miss and restamp; the
+ * caller then searches again.
+ */
+
+STATIC int
+negvalid(void)
+{
+	struct pdirstat now[MAXPATHDIRS];
+	int n, i;
+
+	if (pathstamplen < 0)
+		return 0;
+	n = stamppath(pathval(), now);
+	if (n == pathstamplen &&
+	    memcmp(now, pathstamp, n * sizeof(now[0])) == 0) {
+		/* mtime has one second granularity: a directory
+		 * modified in the very second we stamped could hide
+		 * a change, so only trust strictly older mtimes */
+		for (i = 0 ; i < n ; i++)
+			if (now[i].mtime >= pathstamptime)
+				break;
+		if (i == n)
+			return 1;
+	}
+	clearnegentries();
+	memcpy(pathstamp, now, n * sizeof(now[0]));
+	pathstamplen = n;
+	pathstamptime = time((time_t *)0);
+	return 0;
+}
+
+STATIC void
+clearnegentries(void)
+{
+	struct tblentry **tblp;
+	struct tblentry **pp;
+	struct tblentry *cmdp;
+
+	INTOFF;
+	for (tblp = cmdtable ; tblp < &cmdtable[CMDTABLESIZE] ; tblp++) {
+		pp = tblp;
+		while ((cmdp = *pp) != NULL) {
+			if (cmdp->cmdtype == CMDUNKNOWN) {
+				*pp = cmdp->next;
+				ckfree(cmdp);
+			} else {
+				pp = &cmdp->next;
+			}
+		}
+	}
+	INTON;
+}
+
 
 
 /*
@@ -675,6 +855,7 @@ hashcd(void)
 	for (pp = cmdtable ; pp < &cmdtable[CMDTABLESIZE] ; pp++) {
 		for (cmdp = *pp ; cmdp ; cmdp = cmdp->next) {
 			if (cmdp->cmdtype == CMDNORMAL
+			 || cmdp->cmdtype == CMDUNKNOWN
 			 || (cmdp->cmdtype == CMDBUILTIN && builtinloc >= 0))
 				cmdp->rehash = 1;
 		}
@@ -748,7 +929,8 @@ clearcmdentry(int firstchange)
 			if ((cmdp->cmdtype == CMDNORMAL &&
 			     cmdp->param.index >= firstchange)
 			 || (cmdp->cmdtype == CMDBUILTIN &&
-			     builtinloc >= firstchange)) {
+			     builtinloc >= firstchange)
+			 || cmdp->cmdtype == CMDUNKNOWN) {
 				*pp = cmdp->next;
 				ckfree(cmdp);
 			} else {
@@ -756,6 +938,7 @@ clearcmdentry(int firstchange)
 			}
 		}
 	}
+	pathstamplen = -1;
 	INTON;
 }
 
@@ -767,9 +950,11 @@ clearcmdentry(int firstchange)
 #ifdef mkinit
 MKINIT void deletefuncs(void);
 MKINIT void hash_special_builtins(void);
+MKINIT void hash_builtins(void);
 
 INIT {
 	hash_special_builtins();
+	hash_builtins();
 }
 
 SHELLPROC {
@@ -994,7 +1179,8 @@ typecmd(int argc, char **argv)
 		}
 
 		/* Then check if it is a tracked alias */
-		if ((cmdp = cmdlookup(arg, 0)) != NULL) {
+		if ((cmdp = cmdlookup(arg, 0)) != NULL &&
+		    cmdp->cmdtype != CMDUNKNOWN) {
 			entry.cmdtype = cmdp->cmdtype;
 			entry.u = cmdp->param;
 		} else {
@@ -77,3 +77,4 @@ void defun(char *, union node *);
 int unsetfunc(char *);
 int typecmd(int, char **);
 void hash_special_builtins(void);
+void hash_builtins(void);
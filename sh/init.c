@@ -264,6 +264,8 @@
 #define NEWARGS 5
 #undef  EOF_NLEFT
 #define EOF_NLEFT -99		/* value of parsenleft when EOF pushed back */
+#undef  IBUFSIZ
+#define IBUFSIZ (16 * 1024)	/* input readahead; BUFSIZ is as small as 1k here */
 #undef  _PATH_DEVNULL
 #define _PATH_DEVNULL "/dev/null"
 #undef  PROFILE
@@ -297,7 +299,7 @@
 #undef  S_RESET
 #define S_RESET 5		/* temporary - to reset a hard ignored sig */
 #undef  OUTBUFSIZ
-#define OUTBUFSIZ BUFSIZ
+#define OUTBUFSIZ (8 * 1024)	/* BUFSIZ is as small as 1k here */
 #undef  BLOCK_OUT
 #define BLOCK_OUT -2		/* output to a fixed block of memory */
 #undef  MEM_OUT
@@ -556,6 +558,8 @@
 #define NEWARGS 5
 #undef  EOF_NLEFT
 #define EOF_NLEFT -99		/* value of parsenleft when EOF pushed back */
+#undef  IBUFSIZ
+#define IBUFSIZ (16 * 1024)	/* input readahead; BUFSIZ is as small as 1k here */
 #undef  _PATH_DEVNULL
 #define _PATH_DEVNULL "/dev/null"
 #undef  PROFILE
@@ -589,7 +593,7 @@
 #undef  S_RESET
 #define S_RESET 5		/* temporary - to reset a hard ignored sig */
 #undef  OUTBUFSIZ
-#define OUTBUFSIZ BUFSIZ
+#define OUTBUFSIZ (8 * 1024)	/* BUFSIZ is as small as 1k here */
 #undef  BLOCK_OUT
 #define BLOCK_OUT -2		/* output to a fixed block of memory */
 #undef  MEM_OUT
@@ -844,6 +848,8 @@
 #define NEWARGS 5
 #undef  EOF_NLEFT
 #define EOF_NLEFT -99		/* value of parsenleft when EOF pushed back */
+#undef  IBUFSIZ
+#define IBUFSIZ (16 * 1024)	/* input readahead; BUFSIZ is as small as 1k here */
 #undef  _PATH_DEVNULL
 #define _PATH_DEVNULL "/dev/null"
 #undef  PROFILE
@@ -873,7 +879,7 @@
 #undef  S_RESET
 #define S_RESET 5		/* temporary - to reset a hard ignored sig */
 #undef  OUTBUFSIZ
-#define OUTBUFSIZ BUFSIZ
+#define OUTBUFSIZ (8 * 1024)	/* BUFSIZ is as small as 1k here */
 #undef  BLOCK_OUT
 #define BLOCK_OUT -2		/* output to a fixed block of memory */
 #undef  MEM_OUT
@@ -899,6 +905,7 @@ extern int loopnest;		/* current loop nesting level */
 
 extern void deletefuncs(void);
 extern void hash_special_builtins(void);
+extern void hash_builtins(void);
 
 struct strpush {
 	struct strpush *prev;	/* preceding string on stack */
@@ -922,7 +929,7 @@ struct parsefile {
 
 extern int parselleft;		/* copy of parsefile->lleft */
 extern struct parsefile basepf;	/* top level input file */
-extern char basebuf[BUFSIZ];	/* buffer for top level input file */
+extern char basebuf[IBUFSIZ];	/* buffer for top level input file */
 
 extern pid_t backgndpid;	/* pid of last background process */
 extern int jobctl;
@@ -953,6 +960,7 @@ init() {
       /* from exec.c: */
       {
 	      hash_special_builtins();
+	      hash_builtins();
       }
 
       /* from input.c: */
@@ -65,6 +65,7 @@ __RCSID("$NetBSD: input.c,v 1.39 2003/08/07 09:05:32 agc Exp $");
 #include "myhistedit.h"
 
 #define EOF_NLEFT -99		/* value of parsenleft when EOF pushed back */
+#define IBUFSIZ (16 * 1024)	/* input readahead; BUFSIZ is as small as 1k here */
 
 MKINIT
 struct strpush {
@@ -99,7 +100,7 @@ int parsenleft;			/* copy of parsefile->nleft */
 MKINIT int parselleft;		/* copy of parsefile->lleft */
 char *parsenextc;		/* copy of parsefile->nextc */
 MKINIT struct parsefile basepf;	/* top level input file */
-MKINIT char basebuf[BUFSIZ];	/* buffer for top level input file */
+MKINIT char basebuf[IBUFSIZ];	/* buffer for top level input file */
 struct parsefile *parsefile = &basepf;	/* current input file */
 int init_editline = 0;		/* editline library initialized? */
 int whichprompt;		/* 1 == PS1, 2 == PS2 */
@@ -191,8 +192,8 @@ retry:
 			nr = 0;
 		else {
 			nr = el_len;
-			if (nr > BUFSIZ - 8)
-				nr = BUFSIZ - 8;
+			if (nr > IBUFSIZ - 8)
+				nr = IBUFSIZ - 8;
 			memcpy(buf, rl_cp, nr);
 			if (nr != el_len) {
 				el_len -= nr;
@@ -203,7 +204,7 @@ retry:
 
 	} else
 #endif
-		nr = read(parsefile->fd, buf, BUFSIZ - 8);
+		nr = read(parsefile->fd, buf, IBUFSIZ - 8);
 
 
 	if (nr <= 0) {
@@ -415,13 +416,13 @@ setinputfd(int fd, int push)
 	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
 	if (push) {
 		pushfile();
-		parsefile->buf = ckmalloc(BUFSIZ);
+		parsefile->buf = ckmalloc(IBUFSIZ);
 	}
 	if (parsefile->fd > 0)
 		close(parsefile->fd);
 	parsefile->fd = fd;
 	if (parsefile->buf == NULL)
-		parsefile->buf = ckmalloc(BUFSIZ);
+		parsefile->buf = ckmalloc(IBUFSIZ);
 	parselleft = parsenleft = 0;
 	plinno = 1;
 }
@@ -106,13 +106,15 @@ savestr(const char *s)
  */
 
 #define MINSIZE 504		/* minimum size of a block */
+#define CACHEMAX 4096		/* biggest block worth keeping for reuse */
 
 struct stack_block {
 	struct stack_block *prev;
+	int size;		/* usable bytes in space */
 	char space[MINSIZE];
 };
 
-struct stack_block stackbase;
+struct stack_block stackbase = { NULL, MINSIZE };
 struct stack_block *stackp = &stackbase;
 struct stackmark *markp;
 char *stacknxt = stackbase.space;
@@ -120,6 +122,15 @@ int stacknleft = MINSIZE;
 int sstrnleft;
 int herefd = -1;
 
+/*
+ * Parse trees are built on the stack and discarded after every command
+ * line, so instead of returning each popped block to malloc we keep the
+ * largest one for the next parse.  This keeps the per-command block
+ * churn out of the heap; a heap that keeps growing makes every later
+ * fork more expensive.
+ */
+STATIC struct stack_block *stackcache;
+
 pointer
 stalloc(int nbytes)
 {
@@ -134,7 +145,15 @@ stalloc(int nbytes)
 		if (blocksize < MINSIZE)
 			blocksize = MINSIZE;
 		INTOFF;
-		sp = ckmalloc(sizeof(struct stack_block) - MINSIZE + blocksize);
+		if (stackcache != NULL && stackcache->size >= blocksize) {
+			sp = stackcache;
+			stackcache = NULL;
+			blocksize = sp->size;
+		} else {
+			sp = ckmalloc(sizeof(struct stack_block) - MINSIZE +
+			    blocksize);
+			sp->size = blocksize;
+		}
 		sp->prev = stackp;
 		stacknxt = sp->space;
 		stacknleft = blocksize;
@@ -182,7 +201,13 @@ popstackmark(struct stackmark *mark)
 	while (stackp != mark->stackp) {
 		sp = stackp;
 		stackp = sp->prev;
-		ckfree(sp);
+		if (sp->size <= CACHEMAX &&
+		    (stackcache == NULL || sp->size > stackcache->size)) {
+			if (stackcache != NULL)
+				ckfree(stackcache);
+			stackcache = sp;
+		} else
+			ckfree(sp);
 	}
 	stacknxt = mark->stacknxt;
 	stacknleft = mark->stacknleft;
@@ -217,6 +242,7 @@ growstackblock(void)
 		sp = ckrealloc((pointer)sp,
 		    sizeof(struct stack_block) - MINSIZE + newlen);
 		sp->prev = stackp;
+		sp->size = newlen;
 		stackp = sp;
 		stacknxt = sp->space;
 		stacknleft = newlen;
@@ -55,6 +55,7 @@ __RCSID("$NetBSD: output.c,v 1.28 2003/08/07 09:05:36 agc Exp $");
 #include <sys/types.h>		/* quad_t */
 #include <sys/param.h>		/* BSD4_4 */
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <stdio.h>	/* defines BUFSIZ */
 #include <string.h>
@@ -69,7 +70,7 @@ __RCSID("$NetBSD: output.c,v 1.28 2003/08/07 09:05:36 agc Exp $");
 #include "error.h"
 
 
-#define OUTBUFSIZ BUFSIZ
+#define OUTBUFSIZ (8 * 1024)	/* BUFSIZ is as small as 1k here */
 #define BLOCK_OUT -2		/* output to a fixed block of memory */
 #define MEM_OUT -3		/* output to dynamically allocated memory */
 #define OUTPUT_ERR 01		/* error occurred on output */
@@ -81,6 +82,8 @@ struct output memout = {NULL, 0, NULL, 0, MEM_OUT, 0};
 struct output *out1 = &output;
 struct output *out2 = &errout;
 
+STATIC int xwritev(int, struct iovec *, int);
+
 
 
 #ifdef mkinit
@@ -133,8 +136,47 @@ out2str(const char *p)
 void
 outstr(const char *p, struct output *file)
 {
-	while (*p)
-		outc(*p++, file);
+	int len = strlen(p);
+	int n;
+
+	if (file == out2 && file->fd >= 0 && len > 0) {
+		/*
+		 * Error output is flushed after every string anyway, so
+		 * send whatever is already buffered and the new string
+		 * with a single writev() instead of copying the string
+		 * through the (small) errout buffer.
+		 */
+		struct iovec iov[2];
+		int niov = 0;
+
+		if (file->buf != NULL && file->nextc > file->buf) {
+			iov[niov].iov_base = file->buf;
+			iov[niov].iov_len = file->nextc - file->buf;
+			niov++;
+			file->nextc = file->buf;
+			file->nleft = file->bufsize;
+		}
+		iov[niov].iov_base = (char *)p;	/* writev won't modify it */
+		iov[niov].iov_len = len;
+		niov++;
+		if (xwritev(file->fd, iov, niov) < 0)
+			file->flags |= OUTPUT_ERR;
+		return;
+	}
+	while (len > 0) {
+		if (file->nleft <= 0) {
+			/* flushes or grows the buffer as appropriate */
+			outc(*p++, file);
+			len--;
+			continue;
+		}
+		n = file->nleft < len ? file->nleft : len;
+		memcpy(file->nextc, p, n);
+		file->nextc += n;
+		file->nleft -= n;
+		p += n;
+		len -= n;
+	}
 	if (file == out2)
 		flushout(file);
 }
@@ -501,6 +543,40 @@ xwrite(int fd, char *buf, int nbytes)
 }
 
 
+/*
+ * Scatter/gather version of the above.
+ */
+
+STATIC int
+xwritev(int fd, struct iovec *iov, int iovcnt)
+{
+	int ntry;
+	int i;
+
+	ntry = 0;
+	for (;;) {
+		i = writev(fd, iov, iovcnt);
+		if (i > 0) {
+			while (iovcnt > 0 && i >= (int)iov->iov_len) {
+				i -= iov->iov_len;
+				iov++;
+				iovcnt--;
+			}
+			if (iovcnt == 0)
+				return 0;
+			iov->iov_base = (char *)iov->iov_base + i;
+			iov->iov_len -= i;
+			ntry = 0;
+		} else if (i == 0) {
+			if (++ntry > 10)
+				return -1;
+		} else if (errno != EINTR) {
+			return -1;
+		}
+	}
+}
+
+
 /*
  * Version of ioctl that retries after a signal is caught.
  * XXX unused function
@@ -72,6 +72,9 @@ __RCSID("$NetBSD: redir.c,v 1.29 2004/07/08 03:57:33 christos Exp $");
 #else
 # define PIPESIZE PIPE_BUF
 #endif
+#ifndef F_SETPIPE_SZ
+# define F_SETPIPE_SZ 1031	/* Linux-specific fcntl, 2.6.35 and up */
+#endif
 
 #define signal bsd_signal
 
@@ -264,7 +267,14 @@ openhere(union node *redir)
 		error("Pipe call failed");
 	if (redir->type == NHERE) {
 		len = strlen(redir->nhere.doc->narg.text);
-		if (len <= PIPESIZE) {
+		/*
+		 * If the document doesn't fit in a default pipe, try to
+		 * grow the pipe to hold it; that still beats forking off
+		 * a writer.  fcntl() returns the new size on success and
+		 * EINVAL on kernels that don't have F_SETPIPE_SZ.
+		 */
+		if (len <= PIPESIZE ||
+		    fcntl(pip[1], F_SETPIPE_SZ, len) >= len) {
 			xwrite(pip[1], redir->nhere.doc->narg.text, len);
 			goto out;
 		}
@@ -57,7 +57,7 @@
 #endif
 
 #ifndef DO_SHAREDVFORK
-#if __NetBSD_Version__ >= 104000000
+#if __NetBSD_Version__ >= 104000000 || defined(__linux__)
 #define DO_SHAREDVFORK
 #endif
 #endif
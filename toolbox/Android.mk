@@ -55,7 +55,9 @@ LOCAL_SRC_FILES:= \
 	toolbox.c \
 	$(patsubst %,%.c,$(TOOLS))
 
-LOCAL_SHARED_LIBRARIES := libcutils libc
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../libnetutils
+
+LOCAL_SHARED_LIBRARIES := libcutils libnetutils libc
 
 LOCAL_MODULE:= toolbox
 
@@ -43,7 +43,12 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
 #define CAT_BUFSIZ (4096)
+#define CAT_BIGBUF (64 * 1024)
+#define CAT_FASTCHUNK (1024 * 1024)
 
 static int bflag, eflag, fflag, lflag, nflag, sflag, tflag, vflag;
 static int rval;
@@ -147,6 +152,49 @@ cook_args(char **argv)
 	} while (*argv);
 }
 
+#ifdef __NR_splice
+/*
+ * Move a regular file into a pipe without copying through user space.
+ * Returns 0 once the whole file has been sent, or 1 if splice cannot
+ * be used and the caller should fall back to read/write.
+ */
+static int
+splice_cat(int rfd, int wfd)
+{
+	ssize_t nr;
+	int any = 0;
+
+	while ((nr = syscall(__NR_splice, rfd, NULL, wfd, NULL,
+	    (size_t)CAT_FASTCHUNK, 0)) > 0)
+		any = 1;
+	if (nr == 0)
+		return 0;
+	if (!any && (errno == EINVAL || errno == ENOSYS))
+		return 1;
+	perror("splice");
+	exit(EXIT_FAILURE);
+}
+#endif
+
+/*
+ * Same idea for sockets, where sendfile does the in-kernel copy.
+ */
+static int
+sendfile_cat(int rfd, int wfd)
+{
+	ssize_t nr;
+	int any = 0;
+
+	while ((nr = sendfile(wfd, rfd, NULL, (size_t)CAT_FASTCHUNK)) > 0)
+		any = 1;
+	if (nr == 0)
+		return 0;
+	if (!any && (errno == EINVAL || errno == ENOSYS))
+		return 1;
+	perror("sendfile");
+	exit(EXIT_FAILURE);
+}
+
 static void
 raw_cat(int rfd)
 {
@@ -154,15 +202,24 @@ raw_cat(int rfd)
 	static char fb_buf[CAT_BUFSIZ];
 	static size_t bsize;
 
-	struct stat sbuf;
+	struct stat sbuf, rsbuf;
 	ssize_t nr, nw, off;
 	int wfd;
 
 	wfd = fileno(stdout);
+	if (fstat(rfd, &rsbuf) == 0 && S_ISREG(rsbuf.st_mode) &&
+	    fstat(wfd, &sbuf) == 0) {
+#ifdef __NR_splice
+		if (S_ISFIFO(sbuf.st_mode) && splice_cat(rfd, wfd) == 0)
+			return;
+#endif
+		if (S_ISSOCK(sbuf.st_mode) && sendfile_cat(rfd, wfd) == 0)
+			return;
+	}
 	if (buf == NULL) {
 		if (fstat(wfd, &sbuf) == 0) {
-			bsize = sbuf.st_blksize > CAT_BUFSIZ ?
-			    sbuf.st_blksize : CAT_BUFSIZ;
+			bsize = sbuf.st_blksize > CAT_BIGBUF ?
+			    sbuf.st_blksize : CAT_BIGBUF;
 			buf = malloc(bsize);
 		}
 		if (buf == NULL) {
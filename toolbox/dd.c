@@ -56,10 +56,13 @@ __RCSID("$NetBSD: dd.c,v 1.37 2004/01/17 21:00:16 dbj Exp $");
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "dd.h"
@@ -102,8 +105,12 @@ extern u_char		casetab[];
 static void dd_close(void);
 static void dd_in(void);
 static void getfdtype(IO *);
+static void preallocate(off_t);
 static int redup_clean_fd(int);
 static void setup(void);
+static ssize_t dwrite(int, const void *, size_t);
+static ssize_t awrite(const void *, size_t);
+static void adrain(void);
 
 
 IO		in, out;		/* input/output state */
@@ -115,6 +122,8 @@ u_int		ddflags;		/* conversion options */
 uint64_t	cbsz;			/* conversion block size */
 u_int		files_cnt = 1;		/* # of files to copy */
 int		progress = 0;		/* display sign of life */
+static int	direct = 0;		/* direct=1: open files O_DIRECT */
+static int	async = 0;		/* async=1: double buffered writes */
 const u_char	*ctab;			/* conversion table */
 sigset_t	infoset;		/* a set blocking SIGINFO */
 
@@ -155,12 +164,24 @@ dd_main(int argc, char *argv[])
 static void
 setup(void)
 {
+	int dflag;
+
+	/* O_DIRECT transfers must be 512 aligned, buffers included. */
+	if (direct && ((in.dbsz | out.dbsz) & 511)) {
+		fprintf(stderr,
+			"direct needs block sizes that are a multiple of 512; "
+			"ignoring\n");
+		direct = 0;
+	}
+	dflag = direct ? O_DIRECT : 0;
 
 	if (in.name == NULL) {
 		in.name = "stdin";
 		in.fd = STDIN_FILENO;
 	} else {
-		in.fd = open(in.name, O_RDONLY, 0);
+		in.fd = open(in.name, O_RDONLY | dflag, 0);
+		if (in.fd < 0 && dflag && errno == EINVAL)
+			in.fd = open(in.name, O_RDONLY, 0);
 		if (in.fd < 0) {
 			fprintf(stderr, "%s: cannot open for read: %s\n",
 				in.name, strerror(errno));
@@ -188,7 +209,9 @@ setup(void)
 	} else {
 #define	OFLAGS \
     (O_CREAT | (ddflags & (C_SEEK | C_NOTRUNC) ? 0 : O_TRUNC))
-		out.fd = open(out.name, O_RDWR | OFLAGS /*, DEFFILEMODE */);
+		out.fd = open(out.name, O_RDWR | OFLAGS | dflag /*, DEFFILEMODE */);
+		if (out.fd < 0 && dflag && errno == EINVAL)
+			out.fd = open(out.name, O_RDWR | OFLAGS /*, DEFFILEMODE */);
 		/*
 		 * May not have read access, so try again with write only.
 		 * Without read we may have a problem if output also does
@@ -211,12 +234,23 @@ setup(void)
 
 	getfdtype(&out);
 
+	/*
+	 * The double buffered engine only helps plain copies onto things
+	 * that take big sequential writes, and it would race against the
+	 * output seeks conv=sparse does from this thread.
+	 */
+	if (async &&
+	    ((out.flags & (ISCHR|ISPIPE|ISTAPE)) || (ddflags & C_SPARSE)))
+		async = 0;
+
 	/*
 	 * Allocate space for the input and output buffers.  If not doing
 	 * record oriented I/O, only need a single buffer.
 	 */
 	if (!(ddflags & (C_BLOCK|C_UNBLOCK))) {
-		if ((in.db = malloc(out.dbsz + in.dbsz - 1)) == NULL) {
+		in.db = direct ? memalign(4096, out.dbsz + in.dbsz - 1)
+			       : malloc(out.dbsz + in.dbsz - 1);
+		if (in.db == NULL) {
 			exit(1);
 			/* NOTREACHED */
 		}
@@ -243,6 +277,16 @@ setup(void)
 	if ((ddflags & (C_OF | C_SEEK | C_NOTRUNC)) == (C_OF | C_SEEK))
 		(void)ftruncate(out.fd, (off_t)out.offset * out.dbsz);
 
+	/*
+	 * When the transfer size is known, hand the filesystem the final
+	 * extent up front so it isn't allocated piecemeal as we write.
+	 * Pointless for sparse output, and notrunc must not resize.
+	 */
+	if ((ddflags & C_COUNT) && !(ddflags & (C_NOTRUNC | C_SPARSE)) &&
+	    (out.flags & ISREG))
+		preallocate((off_t)out.offset * out.dbsz +
+		    (off_t)cpy_cnt * in.dbsz);
+
 	/*
 	 * If converting case at the same time as another conversion, build a
 	 * table that does both at once.  If just converting case, use the
@@ -282,6 +326,27 @@ setup(void)
 	(void)gettimeofday(&st.start, NULL);	/* Statistics timestamp. */
 }
 
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE	0x01
+#endif
+
+/*
+ * Preallocate the output file.  fallocate(2) needs kernel 2.6.23 and
+ * filesystem support; without it the blocks are simply allocated as
+ * we write.  KEEP_SIZE matters: the copy may legitimately end short
+ * of count*ibs (input EOF, short reads without conv=sync), and the
+ * file size must reflect the bytes actually written, not the
+ * reservation.
+ */
+static void
+preallocate(off_t len)
+{
+#ifdef __NR_fallocate
+	(void)syscall(__NR_fallocate, out.fd, FALLOC_FL_KEEP_SIZE,
+	    (off_t)0, len);
+#endif
+}
+
 static void
 getfdtype(IO *io)
 {
@@ -294,6 +359,8 @@ getfdtype(IO *io)
 		exit(1);
 		/* NOTREACHED */
 	}
+	if (S_ISREG(sb.st_mode))
+		io->flags |= ISREG;
 	if (S_ISCHR(sb.st_mode))
 		io->flags |= /*ioctl(io->fd, MTIOCGET, &mt) ? ISCHR : ISTAPE; */ ISCHR;
 	else if (lseek(io->fd, (off_t)0, SEEK_CUR) == -1 && errno == ESPIPE)
@@ -364,6 +431,20 @@ dd_in(void)
 
 		/* Read error. */
 		if (n < 0) {
+			static int dretried;
+
+			/*
+			 * An O_DIRECT read the kernel won't do (alignment,
+			 * filesystem) shouldn't kill the copy: drop the flag
+			 * from the descriptor and retry once.
+			 */
+			if (errno == EINVAL && direct && !dretried &&
+			    !(in.flags & (ISPIPE|ISTAPE))) {
+				dretried = 1;
+				(void)fcntl(in.fd, F_SETFL,
+				    fcntl(in.fd, F_GETFL, 0) & ~O_DIRECT);
+				continue;
+			}
 
 			/*
 			 * If noerror not specified, die.  POSIX requires that
@@ -466,6 +547,9 @@ dd_close(void)
 	if (out.dbcnt)
 		dd_out(1);
 
+	/* Wait for the double buffered writer before syncing/closing. */
+	adrain();
+
 	/*
 	 * Reporting nfs write error may be defered until next
 	 * write(2) or close(2) system call.  So, we need to do an
@@ -513,13 +597,19 @@ dd_out(int force)
 		for (cnt = n;; cnt -= nw) {
 
 			if (!force && ddflags & C_SPARSE) {
-				int sparse, i;
+				/* a chunked memcmp against a zero block is
+				 * much cheaper than a byte loop */
+				static const u_char zeroes[4096];
+				int64_t i, n2;
+				int sparse;
+
 				sparse = 1;	/* Is buffer sparse? */
-				for (i = 0; i < cnt; i++)
-					if (outp[i] != 0) {
+				for (i = 0; sparse && i < cnt; i += n2) {
+					n2 = MIN(cnt - i,
+					    (int64_t)sizeof(zeroes));
+					if (memcmp(outp + i, zeroes, n2))
 						sparse = 0;
-						break;
-					}
+				}
 				if (sparse) {
 					pending += cnt;
 					outp += cnt;
@@ -608,13 +698,152 @@ bwrite(int fd, const void *buf, size_t len)
 	int oerrno;
 
 	(void)sigprocmask(SIG_BLOCK, &infoset, &oset);
-	rv = write(fd, buf, len);
+	if (async && fd == out.fd)
+		rv = awrite(buf, len);
+	else
+		rv = dwrite(fd, buf, len);
 	oerrno = errno;
 	(void)sigprocmask(SIG_SETMASK, &oset, NULL);
 	errno = oerrno;
 	return (rv);
 }
 
+/*
+ * Plain write, except that if the kernel rejects an O_DIRECT transfer
+ * (unaligned tail block, filesystem without support) the flag is
+ * dropped from the descriptor and the write retried.
+ */
+static ssize_t
+dwrite(int fd, const void *buf, size_t len)
+{
+	ssize_t nw;
+
+	nw = write(fd, buf, len);
+	if (nw < 0 && errno == EINVAL && direct) {
+		(void)fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_DIRECT);
+		nw = write(fd, buf, len);
+	}
+	return (nw);
+}
+
+/*
+ * Double buffered output (async=1): bwrite hands finished blocks to a
+ * helper thread, so reading the next input block overlaps writing the
+ * current one.  Errors are picked up on the next hand-off or at the
+ * final drain -- the summary may then credit a block or two that never
+ * reached the medium, but dd exits non-zero either way.
+ */
+#define ASYNC_SLOTS 2
+static u_char	*aslot[ASYNC_SLOTS];
+static size_t	alen[ASYNC_SLOTS];
+static int	ahead, atail, afull;
+static int	aerr, adone, astarted;
+static pthread_t athread;
+static pthread_mutex_t alock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t acond = PTHREAD_COND_INITIALIZER;
+
+static void *
+awriter(void *unused)
+{
+	ssize_t nw;
+	size_t off;
+	int slot;
+
+	(void)pthread_mutex_lock(&alock);
+	for (;;) {
+		while (afull == 0 && !adone)
+			pthread_cond_wait(&acond, &alock);
+		if (afull == 0)
+			break;
+		slot = atail;
+		(void)pthread_mutex_unlock(&alock);
+
+		for (off = 0; off < alen[slot]; off += nw) {
+			nw = dwrite(out.fd, aslot[slot] + off,
+			    alen[slot] - off);
+			if (nw == 0) {
+				nw = -1;
+				errno = ENOSPC;
+			}
+			if (nw < 0) {
+				if (errno == EINTR) {
+					nw = 0;
+					continue;
+				}
+				break;
+			}
+		}
+
+		(void)pthread_mutex_lock(&alock);
+		if (off < alen[slot] && aerr == 0)
+			aerr = errno;
+		atail = (atail + 1) % ASYNC_SLOTS;
+		afull--;
+		pthread_cond_signal(&acond);
+	}
+	(void)pthread_mutex_unlock(&alock);
+	return NULL;
+}
+
+static ssize_t
+awrite(const void *buf, size_t len)
+{
+	int slot;
+
+	if (!astarted) {
+		for (slot = 0; slot < ASYNC_SLOTS; slot++) {
+			aslot[slot] = direct ?
+			    memalign(4096, MAX(in.dbsz, out.dbsz)) :
+			    malloc(MAX(in.dbsz, out.dbsz));
+			if (aslot[slot] == NULL)
+				break;
+		}
+		if (slot < ASYNC_SLOTS ||
+		    pthread_create(&athread, NULL, awriter, NULL)) {
+			/* can't double buffer; keep going synchronously */
+			async = 0;
+			return dwrite(out.fd, buf, len);
+		}
+		astarted = 1;
+	}
+
+	(void)pthread_mutex_lock(&alock);
+	while (afull == ASYNC_SLOTS && aerr == 0)
+		pthread_cond_wait(&acond, &alock);
+	if (aerr) {
+		errno = aerr;
+		(void)pthread_mutex_unlock(&alock);
+		return -1;
+	}
+	slot = ahead;
+	memcpy(aslot[slot], buf, len);
+	alen[slot] = len;
+	ahead = (ahead + 1) % ASYNC_SLOTS;
+	afull++;
+	pthread_cond_signal(&acond);
+	(void)pthread_mutex_unlock(&alock);
+	return (ssize_t)len;
+}
+
+/* Let the helper thread finish its queue; called before fsync/close. */
+static void
+adrain(void)
+{
+	if (!astarted)
+		return;
+	(void)pthread_mutex_lock(&alock);
+	adone = 1;
+	pthread_cond_signal(&acond);
+	(void)pthread_mutex_unlock(&alock);
+	(void)pthread_join(athread, NULL);
+	if (aerr) {
+		fprintf(stderr, "%s: write error: %s\n",
+			out.name, strerror(aerr));
+		exit(1);
+		/* NOTREACHED */
+	}
+}
+
 /*
  * Position input/output data streams before starting the copy.  Device type
  * dependent.  Seekable devices use lseek, and the rest position by reading.
@@ -1049,8 +1278,10 @@ static int	c_arg(const void *, const void *);
 #ifndef	NO_CONV
 static int	c_conv(const void *, const void *);
 #endif
+static void	f_async(char *);
 static void	f_bs(char *);
 static void	f_cbs(char *);
+static void	f_direct(char *);
 static void	f_conv(char *);
 static void	f_count(char *);
 static void	f_files(char *);
@@ -1069,10 +1300,12 @@ static const struct arg {
 } args[] = {
      /* the array needs to be sorted by the first column so
 	bsearch() can be used to find commands quickly */
+	{ "async",	f_async,	0,	 0 },
 	{ "bs",		f_bs,		C_BS,	 C_BS|C_IBS|C_OBS|C_OSYNC },
 	{ "cbs",	f_cbs,		C_CBS,	 C_CBS },
 	{ "conv",	f_conv,		0,	 0 },
 	{ "count",	f_count,	C_COUNT, C_COUNT },
+	{ "direct",	f_direct,	0,	 0 },
 	{ "files",	f_files,	C_FILES, C_FILES },
 	{ "ibs",	f_ibs,		C_IBS,	 C_BS|C_IBS },
 	{ "if",		f_if,		C_IF,	 C_IF },
@@ -1284,15 +1517,49 @@ f_progress(char *arg)
 		progress = 1;
 }
 
+static void
+f_async(char *arg)
+{
+
+	if (*arg != '0')
+		async = 1;
+}
+
+static void
+f_direct(char *arg)
+{
+
+	if (*arg != '0')
+		direct = 1;
+}
+
 #ifdef	NO_CONV
-/* Build a small version (i.e. for a ramdisk root) */
+/* Build a small version (i.e. for a ramdisk root): no conversion
+ * tables, but the flag-only conversions still work.
+ */
 static void
 f_conv(char *arg)
 {
+	const char *name;
 
-	fprintf(stderr, "conv option disabled\n");
-	exit(1);
-	/* NOTREACHED */
+	while (arg != NULL) {
+		name = strsep(&arg, ",");
+		if (strcmp(name, "noerror") == 0)
+			ddflags |= C_NOERROR;
+		else if (strcmp(name, "notrunc") == 0)
+			ddflags |= C_NOTRUNC;
+		else if (strcmp(name, "osync") == 0)
+			ddflags |= C_OSYNC;
+		else if (strcmp(name, "sparse") == 0)
+			ddflags |= C_SPARSE;
+		else if (strcmp(name, "sync") == 0)
+			ddflags |= C_SYNC;
+		else {
+			fprintf(stderr, "unsupported conversion: %s\n", name);
+			exit(1);
+			/* NOTREACHED */
+		}
+	}
 }
 #else	/* NO_CONV */
 
@@ -47,6 +47,7 @@ typedef struct {
 #define	ISPIPE		0x02		/* pipe (not truncatable) */
 #define	ISTAPE		0x04		/* tape (not seekable) */
 #define	NOREAD		0x08		/* not readable */
+#define	ISREG		0x10		/* regular file (preallocatable) */
 	u_int		flags;
 
 	const char  	*name;		/* name */
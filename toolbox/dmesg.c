@@ -3,41 +3,109 @@
 #include <stdio.h>
 #include <errno.h>
 #include <sys/klog.h>
+#include <sys/time.h>
 #include <string.h>
 
 #define KLOG_BUF_SHIFT	17	/* CONFIG_LOG_BUF_SHIFT from our kernel */
 #define KLOG_BUF_LEN	(1 << KLOG_BUF_SHIFT)
 
-int dmesg_main(int argc, char **argv)
+#ifndef KLOG_SIZE_BUFFER
+#define KLOG_SIZE_BUFFER 10
+#endif
+
+/* header in front of every chunk written in binary mode, so the
+ * stream can be merged with other timestamped logs */
+struct klog_entry {
+    unsigned sec;
+    unsigned usec;
+    unsigned len;
+};
+
+static int dump_chunk(char *buf, int n, int binary)
 {
-    char buffer[KLOG_BUF_LEN + 1];
-    char *p = buffer;
+    struct klog_entry hdr;
+    struct timeval tv;
     ssize_t ret;
-    int n, op;
+    char *p = buf;
 
-    if((argc == 2) && (!strcmp(argv[1],"-c"))) {
-        op = KLOG_READ_CLEAR;
-    } else {
-        op = KLOG_READ_ALL;
-    }
-
-    n = klogctl(op, buffer, KLOG_BUF_LEN);
-    if (n < 0) {
-        perror("klogctl");
-        return EXIT_FAILURE;
+    if(binary) {
+        gettimeofday(&tv, NULL);
+        hdr.sec = tv.tv_sec;
+        hdr.usec = tv.tv_usec;
+        hdr.len = n;
+        if(write(STDOUT_FILENO, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+            perror("write");
+            return -1;
+        }
     }
-    buffer[n] = '\0';
-
-    while((ret = write(STDOUT_FILENO, p, n))) {
+    while(n > 0) {
+        ret = write(STDOUT_FILENO, p, n);
         if (ret == -1) {
 	    if (errno == EINTR)
                 continue;
 	    perror("write");
-	    return EXIT_FAILURE;
+	    return -1;
 	}
 	p += ret;
 	n -= ret;
     }
+    return 0;
+}
+
+int dmesg_main(int argc, char **argv)
+{
+    char *buffer;
+    int follow = 0;
+    int binary = 0;
+    int len, n, op, i;
+
+    op = KLOG_READ_ALL;
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-c")) {
+            op = KLOG_READ_CLEAR;
+        } else if(!strcmp(argv[i], "-f")) {
+            follow = 1;
+        } else if(!strcmp(argv[i], "-b")) {
+            binary = 1;
+        } else {
+            fprintf(stderr, "usage: dmesg [-c] [-f] [-b]\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* ask the kernel how big the ring really is; fall back to the
+     * configured default if it is too old to say */
+    len = klogctl(KLOG_SIZE_BUFFER, 0, 0);
+    if(len <= 0)
+        len = KLOG_BUF_LEN;
+    buffer = malloc(len + 1);
+    if(buffer == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    n = klogctl(op, buffer, len);
+    if (n < 0) {
+        perror("klogctl");
+        return EXIT_FAILURE;
+    }
+    if(dump_chunk(buffer, n, binary))
+        return EXIT_FAILURE;
+
+    /* KLOG_READ blocks until the ring grows, then hands back only
+     * the new bytes, so following costs nothing while the log is
+     * idle and never rereads what was already printed */
+    while(follow) {
+        n = klogctl(KLOG_READ, buffer, len);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("klogctl");
+            return EXIT_FAILURE;
+        }
+        if(dump_chunk(buffer, n, binary))
+            return EXIT_FAILURE;
+    }
 
     return 0;
 }
@@ -264,20 +264,26 @@ static int scan_dir(const char *dirname, int print_flags)
 
 static void usage(int argc, char *argv[])
 {
-    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-q] [-c count] [-r] [device]\n", argv[0]);
+    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-q] [-c count] [-r] [-o file] [device]\n", argv[0]);
+    fprintf(stderr, "    -o file   log raw events (kernel timestamps included) to file;\n");
+    fprintf(stderr, "              requires a device, replay with sendevent -f file device\n");
 }
 
 int getevent_main(int argc, char *argv[])
 {
     int c;
     int i;
+    int j;
     int res;
     int pollres;
     int get_time = 0;
     int print_device = 0;
     char *newline = "\n";
     uint16_t get_switch = 0;
-    struct input_event event;
+    struct input_event events[64];
+    struct input_event *event;
+    int record_fd = -1;
+    const char *record_file = NULL;
     int version;
     int print_flags = PRINT_DEVICE_ERRORS | PRINT_DEVICE | PRINT_DEVICE_NAME;
     int print_flags_set = 0;
@@ -290,7 +296,7 @@ int getevent_main(int argc, char *argv[])
 
     opterr = 0;
     do {
-        c = getopt(argc, argv, "tns:Sv::qc:rh");
+        c = getopt(argc, argv, "tns:Sv::qc:ro:h");
         if (c == EOF)
             break;
         switch (c) {
@@ -328,6 +334,9 @@ int getevent_main(int argc, char *argv[])
         case 'r':
             sync_rate = 1;
             break;
+        case 'o':
+            record_file = optarg;
+            break;
         case '?':
             fprintf(stderr, "%s: invalid option -%c\n",
                 argv[0], optopt);
@@ -347,6 +356,18 @@ int getevent_main(int argc, char *argv[])
         usage(argc, argv);
         exit(1);
     }
+    if (record_file) {
+        /* a recording mixing several devices could not be replayed */
+        if (device == NULL) {
+            fprintf(stderr, "%s: -o requires a device\n", argv[0]);
+            exit(1);
+        }
+        record_fd = open(record_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (record_fd < 0) {
+            fprintf(stderr, "could not create %s, %s\n", record_file, strerror(errno));
+            exit(1);
+        }
+    }
     nfds = 1;
     ufds = calloc(1, sizeof(ufds[0]));
     ufds[0].fd = inotify_init();
@@ -398,26 +419,40 @@ int getevent_main(int argc, char *argv[])
         for(i = 1; i < nfds; i++) {
             if(ufds[i].revents) {
                 if(ufds[i].revents & POLLIN) {
-                    res = read(ufds[i].fd, &event, sizeof(event));
-                    if(res < (int)sizeof(event)) {
+                    /* drain a batch per read so high rate streams don't
+                     * overflow the evdev client queue while we format */
+                    res = read(ufds[i].fd, events, sizeof(events));
+                    if(res < (int)sizeof(events[0])) {
                         fprintf(stderr, "could not get event\n");
                         return 1;
                     }
-                    if(get_time) {
-                        printf("%ld-%ld: ", event.time.tv_sec, event.time.tv_usec);
+                    if(record_fd >= 0) {
+                        /* log the batch as read, kernel timestamps and all */
+                        if(write(record_fd, events, res) != res) {
+                            fprintf(stderr, "could not log event, %s\n", strerror(errno));
+                            return 1;
+                        }
                     }
-                    if(print_device)
-                        printf("%s: ", device_names[i]);
-                    printf("%04x %04x %08x", event.type, event.code, event.value);
-                    if(sync_rate && event.type == 0 && event.code == 0) {
-                        int64_t now = event.time.tv_sec * 1000000LL + event.time.tv_usec;
-                        if(last_sync_time)
-                            printf(" rate %lld", 1000000LL / (now - last_sync_time));
-                        last_sync_time = now;
+                    for(j = 0; j < res / (int)sizeof(events[0]); j++) {
+                        event = &events[j];
+                        if(record_fd < 0) {
+                            if(get_time) {
+                                printf("%ld-%ld: ", event->time.tv_sec, event->time.tv_usec);
+                            }
+                            if(print_device)
+                                printf("%s: ", device_names[i]);
+                            printf("%04x %04x %08x", event->type, event->code, event->value);
+                            if(sync_rate && event->type == 0 && event->code == 0) {
+                                int64_t now = event->time.tv_sec * 1000000LL + event->time.tv_usec;
+                                if(last_sync_time)
+                                    printf(" rate %lld", 1000000LL / (now - last_sync_time));
+                                last_sync_time = now;
+                            }
+                            printf("%s", newline);
+                        }
+                        if(event_count && --event_count == 0)
+                            return 0;
                     }
-                    printf("%s", newline);
-                    if(event_count && --event_count == 0)
-                        return 0;
                 }
             }
         }
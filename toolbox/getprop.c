@@ -1,15 +1,50 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <cutils/properties.h>
 
 #include <sys/system_properties.h>
 
-static void proplist(const char *key, const char *name, 
+static void proplist(const char *key, const char *name,
                      void *user __attribute__((unused)))
 {
     printf("[%s]: [%s]\n", key, name);
 }
 
+/* accumulates matching properties into one buffer so the whole
+ * listing goes out in a single write
+ */
+struct bulk_list {
+    const char *prefix;
+    int prefix_len;
+    char *buf;
+    int used;
+    int size;
+};
+
+static void proplist_prefix(const char *key, const char *value, void *user)
+{
+    struct bulk_list *b = user;
+    int n;
+
+    if(strncmp(key, b->prefix, b->prefix_len)) return;
+
+    for(;;) {
+        n = snprintf(b->buf + b->used, b->size - b->used,
+                     "[%s]: [%s]\n", key, value);
+        if(n < b->size - b->used) break;
+        b->size *= 2;
+        b->buf = realloc(b->buf, b->size);
+        if(b->buf == 0) {
+            fprintf(stderr,"out of memory\n");
+            exit(1);
+        }
+    }
+    b->used += n;
+}
+
 int __system_property_wait(prop_info *pi);
 
 int getprop_main(int argc, char *argv[])
@@ -18,6 +53,21 @@ int getprop_main(int argc, char *argv[])
 
     if (argc == 1) {
         (void)property_list(proplist, NULL);
+    } else if (!strcmp(argv[1], "-p")) {
+        struct bulk_list b;
+
+        b.prefix = (argc > 2) ? argv[2] : "";
+        b.prefix_len = strlen(b.prefix);
+        b.size = 4096;
+        b.used = 0;
+        b.buf = malloc(b.size);
+        if(b.buf == 0) {
+            fprintf(stderr,"out of memory\n");
+            return 1;
+        }
+        (void)property_list(proplist_prefix, &b);
+        write(1, b.buf, b.used);
+        free(b.buf);
     } else {
         char value[PROPERTY_VALUE_MAX];
         char *default_value;
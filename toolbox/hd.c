@@ -4,17 +4,61 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 
+static char obuf[65536];
+static int olen;
+
+static void oflush(void)
+{
+	if(olen) {
+		fwrite(obuf, 1, olen, stdout);
+		olen = 0;
+	}
+}
+
+/* format one chunk of data into obuf, flushing in bulk as it fills */
+static void hd_format(const unsigned char *buf, int res, int filepos,
+                      int *sump, int *lsump)
+{
+	static const char hexdig[] = "0123456789abcdef";
+	int sum = *sump;
+	int lsum = *lsump;
+	int i;
+
+	for(i = 0; i < res; i++) {
+		if((i & 15) == 0) {
+			olen += sprintf(obuf + olen, "%08x: ", filepos + i);
+		}
+		lsum += buf[i];
+		sum += buf[i];
+		obuf[olen++] = hexdig[buf[i] >> 4];
+		obuf[olen++] = hexdig[buf[i] & 15];
+		obuf[olen++] = ' ';
+		if(((i & 15) == 15) || (i == res - 1)) {
+			olen += sprintf(obuf + olen, "s %x\n", lsum);
+			lsum = 0;
+		}
+		if(olen >= (int)sizeof(obuf) - 80)
+			oflush();
+	}
+	*sump = sum;
+	*lsump = lsum;
+}
+
 int hd_main(int argc, char *argv[])
 {
     int c;
     int fd;
 	unsigned char buf[4096];
+	const unsigned char *p;
+	struct stat st;
+	void *map;
     int res;
 	int read_len;
 	int rv = 0;
-	int i;
 	int filepos = 0;
 	int sum;
 	int lsum;
@@ -55,6 +99,12 @@ int hd_main(int argc, char *argv[])
         return 1;
     }
 
+	/* map regular files and format straight out of the page cache;
+	 * the read path stays for devices and anything mmap rejects */
+	map = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
 	do {
 		if(base >= 0) {
 			lseek(fd, base, SEEK_SET);
@@ -66,20 +116,18 @@ int hd_main(int argc, char *argv[])
 			read_len = sizeof(buf);
 			if(count > 0 && base + count - filepos < read_len)
 				read_len = base + count - filepos;
-	        res = read(fd, &buf, read_len);
-			for(i = 0; i < res; i++) {
-				if((i & 15) == 0) {
-					printf("%08x: ", filepos + i);
-				}
-				lsum += buf[i];
-				sum += buf[i];
-				printf("%02x ", buf[i]);
-				if(((i & 15) == 15) || (i == res - 1)) {
-					printf("s %x\n", lsum);
-					lsum = 0;
-				}
+			if(map != MAP_FAILED) {
+				res = st.st_size - filepos;
+				if(res > read_len)
+					res = read_len;
+				p = (const unsigned char *)map + filepos;
+			} else {
+				res = read(fd, &buf, read_len);
+				p = buf;
 			}
+			hd_format(p, res, filepos, &sum, &lsum);
 			if(res <= 0) {
+				oflush();
 				printf("Read error on %s, offset %d len %d, %s\n", argv[optind], filepos, read_len, strerror(errno));
 				return 1;
 			}
@@ -87,6 +135,7 @@ int hd_main(int argc, char *argv[])
 			if(filepos == base + count)
 				break;
 	    }
+		oflush();
 		printf("sum %x\n", sum);
 		if(repeat)
 			sleep(repeat);
@@ -18,10 +18,57 @@
 #define LIST_LONG       (1 << 0)
 #define LIST_ALL        (1 << 1)
 #define LIST_RECURSIVE  (1 << 2)
+#define LIST_UNSORTED   (1 << 3)
 
 // fwd
 static int listpath(const char *name, int flags);
 
+/* A directory worth of entries, packed into one growable arena so a
+ * 20k-file directory costs a handful of allocations instead of one per
+ * name.  Each record is a d_type byte followed by the nul terminated
+ * name; offsets[] points at the records.
+ */
+typedef struct {
+    char *arena;
+    int used;
+    int size;
+    int *offsets;
+    int count;
+    int max;
+} entrylist;
+
+static int entrylist_add(entrylist *el, const char *name, int type)
+{
+    int len = strlen(name) + 2;   /* type byte + name + nul */
+
+    if (el->used + len > el->size) {
+        el->size = el->size ? el->size * 2 : 4096;
+        if (el->size < el->used + len) el->size = el->used + len;
+        el->arena = realloc(el->arena, el->size);
+        if (el->arena == 0) return -1;
+    }
+    if (el->count == el->max) {
+        el->max = el->max ? el->max * 2 : 256;
+        el->offsets = realloc(el->offsets, el->max * sizeof(int));
+        if (el->offsets == 0) return -1;
+    }
+    el->offsets[el->count++] = el->used;
+    el->arena[el->used] = type;
+    strcpy(el->arena + el->used + 1, name);
+    el->used += len;
+    return 0;
+}
+
+/* base of the arena being sorted; sorting finishes before any
+ * recursion, so a plain static is safe */
+static const char *cmp_base;
+
+static int entrycmp(const void *a, const void *b)
+{
+    return strcmp(cmp_base + *(const int *)a + 1,
+                  cmp_base + *(const int *)b + 1);
+}
+
 static char mode2kind(unsigned mode)
 {
     switch(mode & S_IFMT){
@@ -160,62 +207,89 @@ static int listdir(const char *name, int flags)
     char tmp[4096];
     DIR *d;
     struct dirent *de;
-    
+    entrylist el;
+    int i;
+
     d = opendir(name);
     if(d == 0) {
         fprintf(stderr, "opendir failed, %s\n", strerror(errno));
         return -1;
     }
 
+    memset(&el, 0, sizeof(el));
+
     while((de = readdir(d)) != 0){
         if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
         if(de->d_name[0] == '.' && (flags & LIST_ALL) == 0) continue;
-        if ((flags & LIST_LONG) != 0) {
-            sprintf(tmp, "%s/%s", name, de->d_name);
-            listfile(tmp, flags);
-        } else {
-            printf("%s\n", de->d_name);
+
+        if (flags & LIST_UNSORTED) {
+            /* stream entries out as they arrive; only plausible
+             * directories need to be remembered, for the recursive pass */
+            if ((flags & LIST_LONG) != 0) {
+                sprintf(tmp, "%s/%s", name, de->d_name);
+                listfile(tmp, flags);
+            } else {
+                printf("%s\n", de->d_name);
+            }
+            if ((flags & LIST_RECURSIVE) == 0) continue;
+            if (de->d_type != DT_DIR && de->d_type != DT_UNKNOWN) continue;
+        }
+        if (entrylist_add(&el, de->d_name, de->d_type) < 0) {
+            closedir(d);
+            return -1;
         }
     }
+    closedir(d);
 
-    if (flags & LIST_RECURSIVE) {
-        rewinddir(d);
+    if ((flags & LIST_UNSORTED) == 0) {
+        cmp_base = el.arena;
+        qsort(el.offsets, el.count, sizeof(int), entrycmp);
+
+        for (i = 0; i < el.count; i++) {
+            const char *dname = el.arena + el.offsets[i] + 1;
+
+            if ((flags & LIST_LONG) != 0) {
+                sprintf(tmp, "%s/%s", name, dname);
+                listfile(tmp, flags);
+            } else {
+                printf("%s\n", dname);
+            }
+        }
+    }
 
-        while ((de = readdir(d)) != 0) {
+    if (flags & LIST_RECURSIVE) {
+        for (i = 0; i < el.count; i++) {
+            const char *dname = el.arena + el.offsets[i] + 1;
+            int type = el.arena[el.offsets[i]];
             struct stat s;
-            int err;
 
-            if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
-                continue;
-            if (de->d_name[0] == '.' && (flags & LIST_ALL) == 0)
+            /* d_type spares the lstat, except on filesystems that
+             * don't fill it in.  Symlinks are not followed, as before. */
+            if (type == DT_UNKNOWN) {
+                if (!strcmp(name, "/")) sprintf(tmp, "/%s", dname);
+                else sprintf(tmp, "%s/%s", name, dname);
+
+                if (lstat(tmp, &s) < 0) {
+                    perror(tmp);
+                    free(el.arena);
+                    free(el.offsets);
+                    return -1;
+                }
+                if (!S_ISDIR(s.st_mode)) continue;
+            } else if (type != DT_DIR) {
                 continue;
-
-            if (!strcmp(name, "/")) sprintf(tmp, "/%s", de->d_name);
-            else sprintf(tmp, "%s/%s", name, de->d_name);
-
-            /*
-             * If the name ends in a '/', use stat() so we treat it like a
-             * directory even if it's a symlink.
-             */
-            if (tmp[strlen(tmp)-1] == '/')
-                err = stat(tmp, &s);
-            else
-                err = lstat(tmp, &s);
-
-            if (err < 0) {
-                perror(tmp);
-                closedir(d);
-                return -1;
+            } else {
+                if (!strcmp(name, "/")) sprintf(tmp, "/%s", dname);
+                else sprintf(tmp, "%s/%s", name, dname);
             }
 
-            if (S_ISDIR(s.st_mode)) {
-                printf("\n%s:\n", tmp);
-                listdir(tmp, flags);
-            }
+            printf("\n%s:\n", tmp);
+            listdir(tmp, flags);
         }
     }
 
-    closedir(d);
+    free(el.arena);
+    free(el.offsets);
     return 0;
 }
 
@@ -255,9 +329,13 @@ static int listpath(const char *name, int flags)
 
 int ls_main(int argc, char **argv)
 {
+    static char iobuf[65536];
     int flags = 0;
     int listed = 0;
-    
+
+    /* a few big writes to the far end instead of one per entry */
+    setvbuf(stdout, iobuf, _IOFBF, sizeof(iobuf));
+
     if(argc > 1) {
         int i;
         int err = 0;
@@ -269,6 +347,8 @@ int ls_main(int argc, char **argv)
                 flags |= LIST_ALL;
             } else if (!strcmp(argv[i], "-R")) {
                 flags |= LIST_RECURSIVE;
+            } else if (!strcmp(argv[i], "-U")) {
+                flags |= LIST_UNSORTED;
             } else {
                 listed++;
                 if(listpath(argv[i], flags) != 0) {
@@ -62,6 +62,7 @@
 
 #define DOSMAGIC  0xaa55	/* DOS magic number */
 #define MINBPS	  128		/* minimum bytes per sector */
+#define WRITE_BATCH 512		/* sectors buffered per write */
 #define MAXSPC	  128		/* maximum sectors per cluster */
 #define MAXNFT	  16		/* maximum number of FATs */
 #define DEFBLK	  4096		/* default block size */
@@ -75,6 +76,10 @@
 #define MAXCLS16  0xfff5	/* maximum FAT16 clusters */
 #define MAXCLS32  0xffffff5	/* maximum FAT32 clusters */
 
+#ifndef BLKDISCARD
+#define BLKDISCARD _IO(0x12,119)	/* discard sectors: u64 range[2] */
+#endif
+
 #define mincls(fat)  ((fat) == 12 ? MINCLS12 :	\
 		      (fat) == 16 ? MINCLS16 :	\
 				    MINCLS32)
@@ -239,8 +244,45 @@ static u_int argtou(const char *, u_int, u_int, const char *);
 static int oklabel(const char *);
 static void mklabel(u_int8_t *, const char *);
 static void setstr(u_int8_t *, const char *, size_t);
+static u_int get_erase_size(const char *);
 static void usage(char* progname);
 
+/*
+ * Look up the card's preferred erase block size in sysfs, the same
+ * per-card data vold reads when it bootstraps a card.  Returns 0 if
+ * the kernel doesn't export it.
+ */
+static u_int
+get_erase_size(const char *fname)
+{
+    char path[MAXPATHLEN], blk[64];
+    const char *base;
+    size_t blen;
+    int fd, n;
+
+    base = strrchr(fname, '/');
+    base = base ? base + 1 : fname;
+    blen = strlen(base);
+    if (blen == 0 || blen >= sizeof(blk))
+	return 0;
+    strcpy(blk, base);
+    /* strip a partition suffix: mmcblk0p1 -> mmcblk0 */
+    while (blen > 1 && isdigit((unsigned char)blk[blen - 1]))
+	blen--;
+    if (blen > 1 && blk[blen - 1] == 'p' && isdigit((unsigned char)blk[blen]))
+	blk[blen - 1] = '\0';
+    snprintf(path, sizeof(path), "/sys/block/%s/device/preferred_erase_size",
+	blk);
+    if ((fd = open(path, O_RDONLY)) == -1)
+	return 0;
+    n = read(fd, path, sizeof(path) - 1);
+    close(fd);
+    if (n <= 0)
+	return 0;
+    path[n] = '\0';
+    return atoi(path);
+}
+
 /*
  * Construct a FAT12, FAT16, or FAT32 file system.
  */
@@ -264,11 +306,12 @@ mkdosfs_main(int argc, char *argv[])
     struct bsxbpb *bsxbpb;
     struct bsx *bsx;
     struct de *de;
-    u_int8_t *img;
+    u_int8_t *img, *io_buf;
     const char *fname, *dtype, *bname;
     ssize_t n;
+    size_t len;
     time_t now;
-    u_int fat, bss, rds, cls, dir, lsn, x, x1, x2;
+    u_int fat, bss, rds, cls, dir, lsn, nsec, ebs, x, x1, x2;
     int ch, fd, fd1;
     char* progname = argv[0];
 
@@ -545,6 +588,15 @@ mkdosfs_main(int argc, char *argv[])
 	bpb.bspf = x2;
 	x1 += (bpb.bspf - 1) * bpb.nft;
     }
+    /* Push the cluster area out to the card's erase block boundary, so
+     * clusters never straddle erase blocks. */
+    ebs = get_erase_size(fname) / bpb.bps;
+    if (ebs > 1 && x1 % ebs) {
+	bpb.res += ebs - x1 % ebs;
+	x1 += ebs - x1 % ebs;
+	printf("aligning data area to %u sector erase blocks (res=%u)\n",
+	    ebs, bpb.res);
+    }
     cls = (bpb.bsec - x1) / bpb.spc;
     x = (u_int64_t)bpb.bspf * bpb.bps * NPB / (fat / BPN) - RESFTE;
     if (cls > x)
@@ -605,11 +657,27 @@ mkdosfs_main(int argc, char *argv[])
 	gettimeofday(&tv, NULL);
 	now = tv.tv_sec;
 	tm = localtime(&now);
-	if (!(img = malloc(bpb.bps)))
+	if (!(io_buf = malloc(WRITE_BATCH * bpb.bps)))
 	    fprintf(stderr, NULL);
 	dir = bpb.res + (bpb.spf ? bpb.spf : bpb.bspf) * bpb.nft;
 
-	for (lsn = 0; lsn < dir + (fat == 32 ? bpb.spc : rds); lsn++) {
+	/* Ask the device to erase itself wholesale first; on managed
+	 * flash this is near free and leaves the FTL with a clean slate
+	 * instead of stale data from the previous filesystem. */
+	if (!fstat(fd, &sb) && S_ISBLK(sb.st_mode)) {
+	    u_int64_t range[2];
+
+	    range[0] = 0;
+	    range[1] = (u_int64_t)bpb.bps *
+		(bpb.bsec ? bpb.bsec : bpb.sec);
+	    if (ioctl(fd, BLKDISCARD, range) == 0)
+		printf("discarded %llu bytes\n",
+		    (unsigned long long)range[1]);
+	}
+
+	nsec = dir + (fat == 32 ? bpb.spc : rds);
+	for (lsn = 0; lsn < nsec; lsn++) {
+	    img = io_buf + (size_t)(lsn % WRITE_BATCH) * bpb.bps;
 	    x = lsn;
 	    if (opt_B &&
 		fat == 32 && bpb.bkbs != MAXU16 &&
@@ -707,10 +775,14 @@ mkdosfs_main(int argc, char *argv[])
 		    (u_int)tm->tm_mday;
 		mk2(de->date, x);
 	    }
-	    if ((n = write(fd, img, bpb.bps)) == -1)
-		fprintf(stderr, "%s\n", fname);
-	    if (n != bpb.bps)
-		fprintf(stderr, "%s: can't write sector %u\n", fname, lsn);
+	    /* flush full batches and the final partial one */
+	    if ((lsn + 1) % WRITE_BATCH == 0 || lsn + 1 == nsec) {
+		len = ((lsn % WRITE_BATCH) + 1) * bpb.bps;
+		if ((n = write(fd, io_buf, len)) == -1)
+		    fprintf(stderr, "%s\n", fname);
+		if (n != (ssize_t)len)
+		    fprintf(stderr, "%s: can't write sector %u\n", fname, lsn);
+	    }
 	}
     }
     return 0;
@@ -32,6 +32,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "netstats.h"
+
+#define MAX_SOCKETS 256
+
 typedef union iaddr iaddr;
 
 union iaddr {
@@ -70,50 +74,37 @@ void addr2str(iaddr addr, unsigned port, char *buf)
 
 int netstat_main(int argc, char *argv[])
 {
-    char buf[512];
+    static struct netstats_socket sockets[MAX_SOCKETS];
     char lip[64];
     char rip[64];
     iaddr laddr, raddr;
-    unsigned lport, rport, state, txq, rxq, num;
-    int n;
-    FILE *fp;
+    int n, i;
 
     printf("Proto Recv-Q Send-Q Local Address          Foreign Address        State\n");
 
-    fp = fopen("/proc/net/tcp", "r");
-    if(fp != 0) {
-        fgets(buf, 512, fp);
-        while(fgets(buf, 512, fp)){
-            n = sscanf(buf, " %d: %x:%x %x:%x %x %x:%x",
-                       &num, &laddr.u, &lport, &raddr.u, &rport,
-                       &state, &txq, &rxq);
-            if(n == 8) {
-                addr2str(laddr, lport, lip);
-                addr2str(raddr, rport, rip);
-                
-                printf("tcp   %6d %6d %-22s %-22s %s\n", 
-                       txq, rxq, lip, rip,
-                       state2str(state));
-            }
-        }
-        fclose(fp);
+    n = netstats_get_tcp(sockets, MAX_SOCKETS);
+    for(i = 0; i < n; i++) {
+        laddr.u = sockets[i].local_addr;
+        raddr.u = sockets[i].remote_addr;
+        addr2str(laddr, sockets[i].local_port, lip);
+        addr2str(raddr, sockets[i].remote_port, rip);
+
+        /* inet_diag reports a listener's backlog limit as its write
+         * queue; /proc/net/tcp showed 0 there, so keep that display. */
+        printf("tcp   %6d %6d %-22s %-22s %s\n",
+               sockets[i].state == 0xA ? 0 : sockets[i].txq,
+               sockets[i].rxq, lip, rip,
+               state2str(sockets[i].state));
     }
-    fp = fopen("/proc/net/udp", "r");
-    if(fp != 0) {
-        fgets(buf, 512, fp);
-        while(fgets(buf, 512, fp)){
-            n = sscanf(buf, " %d: %x:%x %x:%x %x %x:%x",
-                       &num, &laddr.u, &lport, &raddr.u, &rport,
-                       &state, &txq, &rxq);
-            if(n == 8) {
-                addr2str(laddr, lport, lip);
-                addr2str(raddr, rport, rip);
-                
-                printf("udp   %6d %6d %-22s %-22s\n", 
-                       txq, rxq, lip, rip);
-            }
-        }
-        fclose(fp);
+    n = netstats_get_udp(sockets, MAX_SOCKETS);
+    for(i = 0; i < n; i++) {
+        laddr.u = sockets[i].local_addr;
+        raddr.u = sockets[i].remote_addr;
+        addr2str(laddr, sockets[i].local_port, lip);
+        addr2str(raddr, sockets[i].remote_port, rip);
+
+        printf("udp   %6d %6d %-22s %-22s\n",
+               sockets[i].txq, sockets[i].rxq, lip, rip);
     }
 
     return 0;
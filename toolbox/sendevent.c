@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 //#include <linux/input.h> // this does not compile
 #include <errno.h>
 
@@ -45,6 +48,74 @@ struct input_event {
 
 
 
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* Replay a raw event stream captured with getevent -o, pacing writes by
+ * the kernel timestamps in the recording.  Events sharing a timestamp
+ * (one hardware report) go to the device in a single write.
+ */
+static int replay_events(const char *path, const char *device)
+{
+    struct input_event *events;
+    struct stat st;
+    int64_t t0, target, now;
+    int fd, rfd;
+    int count, i, j, ret;
+
+    rfd = open(path, O_RDONLY);
+    if(rfd < 0) {
+        fprintf(stderr, "could not open %s, %s\n", path, strerror(errno));
+        return 1;
+    }
+    if(fstat(rfd, &st) < 0 || st.st_size == 0 ||
+       st.st_size % sizeof(struct input_event)) {
+        fprintf(stderr, "%s is not an event recording\n", path);
+        return 1;
+    }
+    events = malloc(st.st_size);
+    if(events == NULL || read(rfd, events, st.st_size) != st.st_size) {
+        fprintf(stderr, "could not read %s, %s\n", path, strerror(errno));
+        return 1;
+    }
+    close(rfd);
+    count = st.st_size / sizeof(struct input_event);
+
+    fd = open(device, O_RDWR);
+    if(fd < 0) {
+        fprintf(stderr, "could not open %s, %s\n", device, strerror(errno));
+        return 1;
+    }
+
+    t0 = events[0].time.tv_sec * 1000000LL + events[0].time.tv_usec;
+    target = now_us();
+    for(i = 0; i < count; i = j) {
+        target += events[i].time.tv_sec * 1000000LL + events[i].time.tv_usec - t0;
+        t0 = events[i].time.tv_sec * 1000000LL + events[i].time.tv_usec;
+        while((now = now_us()) < target) {
+            struct timespec ts;
+            ts.tv_sec = (target - now) / 1000000;
+            ts.tv_nsec = ((target - now) % 1000000) * 1000;
+            nanosleep(&ts, NULL);
+        }
+        for(j = i + 1; j < count; j++)
+            if(events[j].time.tv_sec != events[i].time.tv_sec ||
+               events[j].time.tv_usec != events[i].time.tv_usec)
+                break;
+        ret = write(fd, events + i, (j - i) * sizeof(struct input_event));
+        if(ret < (int)((j - i) * sizeof(struct input_event))) {
+            fprintf(stderr, "write event failed, %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    free(events);
+    return 0;
+}
+
 int sendevent_main(int argc, char *argv[])
 {
     int i;
@@ -53,8 +124,12 @@ int sendevent_main(int argc, char *argv[])
     int version;
     struct input_event event;
 
+    if(argc == 4 && strcmp(argv[1], "-f") == 0) {
+        return replay_events(argv[2], argv[3]);
+    }
     if(argc != 5) {
         fprintf(stderr, "use: %s device type code value\n", argv[0]);
+        fprintf(stderr, "     %s -f recording device\n", argv[0]);
         return 1;
     }
 
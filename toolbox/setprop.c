@@ -1,16 +1,53 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <cutils/properties.h>
 
+static int usage(void)
+{
+    fprintf(stderr,"usage: setprop <key> <value>\n"
+                   "       setprop <key>=<value> [<key>=<value> ...]\n");
+    return 1;
+}
+
 int setprop_main(int argc, char *argv[])
 {
-    if(argc != 3) {
-        fprintf(stderr,"usage: setprop <key> <value>\n");
+    const char **keys;
+    const char **values;
+    char *x;
+    int n;
+
+    if(argc == 3 && strchr(argv[1], '=') == 0) {
+        if(property_set(argv[1], argv[2])){
+            fprintf(stderr,"could not set property\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    if(argc < 2) return usage();
+
+    /* multiple key=value assignments ride one connection to the
+     * property service instead of paying a round trip apiece
+     */
+    keys = malloc((argc - 1) * sizeof(char*));
+    values = malloc((argc - 1) * sizeof(char*));
+    if(keys == 0 || values == 0) {
+        fprintf(stderr,"out of memory\n");
         return 1;
     }
 
-    if(property_set(argv[1], argv[2])){
-        fprintf(stderr,"could not set property\n");
+    for(n = 1; n < argc; n++) {
+        x = strchr(argv[n], '=');
+        if(x == 0 || x == argv[n]) return usage();
+        *x = 0;
+        keys[n - 1] = argv[n];
+        values[n - 1] = x + 1;
+    }
+
+    if(property_set_bulk(keys, values, argc - 1)){
+        fprintf(stderr,"could not set properties\n");
         return 1;
     }
 
@@ -31,6 +31,7 @@
 
 #include <ctype.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <pwd.h>
 #include <stdio.h>
@@ -53,6 +54,7 @@ struct proc_info {
     char state;
     long unsigned utime;
     long unsigned stime;
+    long unsigned starttime;
     long unsigned delta_utime;
     long unsigned delta_stime;
     long unsigned delta_time;
@@ -89,6 +91,7 @@ static int read_status(char *filename, struct proc_info *proc);
 static void print_procs(void);
 static struct proc_info *find_old_proc(pid_t pid, pid_t tid);
 static void free_old_procs(void);
+static int proc_id_cmp(const void *a, const void *b);
 static int (*proc_cmp)(const void *a, const void *b);
 static int proc_cpu_cmp(const void *a, const void *b);
 static int proc_vss_cmp(const void *a, const void *b);
@@ -173,6 +176,8 @@ int top_main(int argc, char *argv[]) {
         old_procs = new_procs;
         num_old_procs = num_new_procs;
         memcpy(&old_cpu, &new_cpu, sizeof(old_cpu));
+        /* keep the retained procs sorted so find_old_proc can bisect */
+        qsort(old_procs, num_old_procs, sizeof(struct proc_info *), proc_id_cmp);
         sleep(delay);
         read_procs();
         print_procs();
@@ -215,7 +220,7 @@ static void read_procs(void) {
     char filename[64];
     FILE *file;
     int proc_num;
-    struct proc_info *proc;
+    struct proc_info *proc, *old;
     pid_t pid, tid;
 
     int i;
@@ -246,11 +251,21 @@ static void read_procs(void) {
             sprintf(filename, "/proc/%d/stat", pid);
             read_stat(filename, proc);
 
-            sprintf(filename, "/proc/%d/cmdline", pid);
-            read_cmdline(filename, proc);
+            /* Same incarnation as last cycle? Then the command line and
+             * credentials cannot have changed; skip re-reading them.
+             */
+            old = find_old_proc(pid, pid);
+            if (old && old->starttime == proc->starttime) {
+                strcpy(proc->name, old->name);
+                proc->uid = old->uid;
+                proc->gid = old->gid;
+            } else {
+                sprintf(filename, "/proc/%d/cmdline", pid);
+                read_cmdline(filename, proc);
 
-            sprintf(filename, "/proc/%d/status", pid);
-            read_status(filename, proc);
+                sprintf(filename, "/proc/%d/status", pid);
+                read_status(filename, proc);
+            }
 
             proc->num_threads = 0;
         } else {
@@ -275,11 +290,18 @@ static void read_procs(void) {
                 sprintf(filename, "/proc/%d/task/%d/stat", pid, tid);
                 read_stat(filename, proc);
 
-                sprintf(filename, "/proc/%d/task/%d/cmdline", pid, tid);
-                read_cmdline(filename, proc);
+                old = find_old_proc(pid, tid);
+                if (old && old->starttime == proc->starttime) {
+                    strcpy(proc->name, old->name);
+                    proc->uid = old->uid;
+                    proc->gid = old->gid;
+                } else {
+                    sprintf(filename, "/proc/%d/task/%d/cmdline", pid, tid);
+                    read_cmdline(filename, proc);
 
-                sprintf(filename, "/proc/%d/task/%d/status", pid, tid);
-                read_status(filename, proc);
+                    sprintf(filename, "/proc/%d/task/%d/status", pid, tid);
+                    read_status(filename, proc);
+                }
 
                 add_proc(proc_num++, proc);
             } else {
@@ -300,14 +322,15 @@ static void read_procs(void) {
 }
 
 static int read_stat(char *filename, struct proc_info *proc) {
-    FILE *file;
-    char buf[MAX_LINE], *open_paren, *close_paren;
-    int res, idx;
+    char buf[MAX_LINE], *open_paren, *close_paren, *p;
+    int fd, r, field;
 
-    file = fopen(filename, "r");
-    if (!file) return 1;
-    fgets(buf, MAX_LINE, file);
-    fclose(file);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return 1;
+    r = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (r < 0) return 1;
+    buf[r] = 0;
 
     /* Split at first '(' and last ')' to get process name. */
     open_paren = strchr(buf, '(');
@@ -317,10 +340,31 @@ static int read_stat(char *filename, struct proc_info *proc) {
     *open_paren = *close_paren = '\0';
     strcpy(proc->name, open_paren + 1);
 
-    /* Scan rest of string. */
-    sscanf(close_paren + 1, " %c %*d %*d %*d %*d %*d %*d %*d %*d %*d %*d "
-                 "%lu %lu %*d %*d %*d %*d %*d %*d %*d %lu %ld",
-                 &proc->state, &proc->utime, &proc->stime, &proc->vss, &proc->rss);
+    /* Walk the remaining fields in a single pass (numbered as in
+     * proc(5); the state we just consumed is field 3) instead of
+     * running a 23-conversion sscanf per process per cycle.
+     */
+    proc->utime = proc->stime = proc->starttime = 0;
+    proc->vss = proc->rss = 0;
+    p = close_paren + 1;
+    while (*p == ' ') p++;
+    proc->state = *p++;
+    field = 3;
+    while (*p) {
+        while (*p == ' ') p++;
+        if (!*p) break;
+        field++;
+        switch (field) {
+        case 14: proc->utime = strtoul(p, &p, 10); break;
+        case 15: proc->stime = strtoul(p, &p, 10); break;
+        case 22: proc->starttime = strtoul(p, &p, 10); break;
+        case 23: proc->vss = strtol(p, &p, 10); break;
+        case 24: proc->rss = strtol(p, &p, 10); return 0;
+        default:
+            while (*p && *p != ' ') p++;
+            break;
+        }
+    }
 
     return 0;
 }
@@ -355,13 +399,15 @@ static int read_cmdline(char *filename, struct proc_info *proc) {
 static int read_status(char *filename, struct proc_info *proc) {
     FILE *file;
     char line[MAX_LINE];
-    unsigned int uid, gid;
+    unsigned int uid = 0, gid = 0;
 
     file = fopen(filename, "r");
     if (!file) return 1;
     while (fgets(line, MAX_LINE, file)) {
         sscanf(line, "Uid: %u", &uid);
-        sscanf(line, "Gid: %u", &gid);
+        /* Gid follows Uid; nothing further down is needed */
+        if (sscanf(line, "Gid: %u", &gid) == 1)
+            break;
     }
     fclose(file);
     proc->uid = uid; proc->gid = gid;
@@ -430,12 +476,23 @@ static void print_procs(void) {
     }
 }
 
+/* Binary search the pid/tid sorted retained procs; the old linear scan
+ * per process made the refresh quadratic in the process count.
+ */
 static struct proc_info *find_old_proc(pid_t pid, pid_t tid) {
-    int i;
+    int lo = 0, hi = num_old_procs - 1;
 
-    for (i = 0; i < num_old_procs; i++)
-        if (old_procs[i] && (old_procs[i]->pid == pid) && (old_procs[i]->tid == tid))
-            return old_procs[i];
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        struct proc_info *p = old_procs[mid];
+
+        if (!p || p->pid > pid || (p->pid == pid && p->tid > tid))
+            hi = mid - 1;
+        else if (p->pid == pid && p->tid == tid)
+            return p;
+        else
+            lo = mid + 1;
+    }
 
     return NULL;
 }
@@ -498,6 +555,19 @@ static int proc_thr_cmp(const void *a, const void *b) {
     return -numcmp(pa->num_threads, pb->num_threads);
 }
 
+static int proc_id_cmp(const void *a, const void *b) {
+    struct proc_info *pa, *pb;
+
+    pa = *((struct proc_info **)a); pb = *((struct proc_info **)b);
+
+    if (!pa && !pb) return 0;
+    if (!pa) return 1;
+    if (!pb) return -1;
+
+    if (pa->pid != pb->pid) return numcmp(pa->pid, pb->pid);
+    return numcmp(pa->tid, pb->tid);
+}
+
 static int numcmp(long long a, long long b) {
     if (a < b) return -1;
     if (a > b) return 1;
@@ -30,9 +30,15 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/param.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 struct state {
@@ -57,6 +63,27 @@ struct state {
     long cpu_si;
 };
 
+/* Binary recording (-o file): a small header followed by fixed-size
+ * samples, written through a preallocated mmap so the sampling loop
+ * itself makes no write syscalls.  -f file formats a recording back
+ * to text offline.
+ */
+#define RECORD_MAGIC 0x74736d76     /* "vmst" */
+#define RECORD_CHUNK 4096           /* samples preallocated at a time */
+
+struct record_header {
+    uint32_t magic;
+    uint32_t sample_size;
+    uint32_t delay_ms;
+    uint32_t count;
+};
+
+struct sample {
+    uint32_t sec;                   /* realtime of the sample */
+    uint32_t msec;
+    struct state s;
+};
+
 #define MAX_LINE 256
 
 char line[MAX_LINE];
@@ -65,19 +92,25 @@ static void read_state(struct state *s);
 static int read_meminfo(struct state *s);
 static int read_stat(struct state *s);
 static int read_vmstat(struct state *s);
-static void print_header(void);
+static int record_samples(const char *path, int delay_ms, int iterations);
+static int format_recording(const char *path, int header_interval);
+static void print_header(int indent);
 static void print_line(struct state *old, struct state *new);
 static void usage(char *cmd);
 
 int vmstat_main(int argc, char *argv[]) {
     struct state s[2];
-    int iterations, delay, header_interval;
-    int toggle, count;
+    int iterations, delay, delay_ms, header_interval;
+    int toggle, count, forever;
     int i;
+    char *record_file, *format_file;
 
     iterations = 0;
     delay = 1;
+    delay_ms = 0;
     header_interval = 20;
+    record_file = NULL;
+    format_file = NULL;
 
     for (i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-n")) { 
@@ -104,6 +137,30 @@ int vmstat_main(int argc, char *argv[]) {
             header_interval = atoi(argv[++i]);
             continue;
         }
+        if (!strcmp(argv[i], "-m")) {
+            if (i >= argc - 1) {
+                fprintf(stderr, "Option -m requires an argument.\n");
+                exit(EXIT_FAILURE);
+            }
+            delay_ms = atoi(argv[++i]);
+            continue;
+        }
+        if (!strcmp(argv[i], "-o")) {
+            if (i >= argc - 1) {
+                fprintf(stderr, "Option -o requires an argument.\n");
+                exit(EXIT_FAILURE);
+            }
+            record_file = argv[++i];
+            continue;
+        }
+        if (!strcmp(argv[i], "-f")) {
+            if (i >= argc - 1) {
+                fprintf(stderr, "Option -f requires an argument.\n");
+                exit(EXIT_FAILURE);
+            }
+            format_file = argv[++i];
+            continue;
+        }
         if (!strcmp(argv[i], "-h")) {
             usage(argv[0]);
             exit(EXIT_SUCCESS);
@@ -113,18 +170,30 @@ int vmstat_main(int argc, char *argv[]) {
 	exit(EXIT_FAILURE);
     }
 
+    if (format_file)
+        return format_recording(format_file, header_interval);
+    if (record_file)
+        return record_samples(record_file,
+            delay_ms ? delay_ms : delay * 1000, iterations);
+
     toggle = 0;
     count = 0;
 
     if (!header_interval)
-        print_header();
+        print_header(0);
     read_state(&s[1 - toggle]);
-    while ((iterations == 0) || (iterations-- > 0)) {
-        sleep(delay);
+    /* note the forever case up front: -n used to run its count of rows
+     * and then keep going once the counter decremented to zero */
+    forever = (iterations == 0);
+    while (forever || iterations-- > 0) {
+        if (delay_ms)
+            usleep(delay_ms * 1000);
+        else
+            sleep(delay);
         read_state(&s[toggle]);
         if (header_interval) {
             if (count == 0)
-                print_header();
+                print_header(0);
             count = (count + 1) % header_interval;
         }
         print_line(&s[1 - toggle], &s[toggle]);
@@ -134,6 +203,112 @@ int vmstat_main(int argc, char *argv[]) {
     return 0;
 }
 
+static volatile int record_stop;
+
+static void record_sig(int signum) {
+    record_stop = 1;
+}
+
+static int record_samples(const char *path, int delay_ms, int iterations) {
+    struct record_header *hdr = NULL;
+    struct sample *samp;
+    struct timeval tv;
+    unsigned char *map = NULL;
+    size_t mapped = 0, filesz;
+    uint32_t n = 0, room = 0;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "vmstat: could not create %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, record_sig);
+    signal(SIGTERM, record_sig);
+
+    while (!record_stop && ((iterations == 0) || (n < (uint32_t) iterations))) {
+        if (n == room) {
+            /* grow the file a chunk of samples at a time, so steady
+             * state recording touches no file size metadata */
+            if (map)
+                munmap(map, mapped);
+            room += RECORD_CHUNK;
+            filesz = sizeof(*hdr) + (size_t) room * sizeof(*samp);
+            if (ftruncate(fd, filesz) < 0 ||
+                (map = mmap(0, filesz, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0)) == MAP_FAILED) {
+                fprintf(stderr, "vmstat: could not grow %s: %s\n", path, strerror(errno));
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            mapped = filesz;
+            hdr = (struct record_header *) map;
+            hdr->magic = RECORD_MAGIC;
+            hdr->sample_size = sizeof(struct sample);
+            hdr->delay_ms = delay_ms;
+        }
+        samp = (struct sample *) (map + sizeof(*hdr)) + n;
+        gettimeofday(&tv, NULL);
+        samp->sec = tv.tv_sec;
+        samp->msec = tv.tv_usec / 1000;
+        read_state(&samp->s);
+        hdr->count = ++n;
+        usleep(delay_ms * 1000);
+    }
+
+    munmap(map, mapped);
+    (void) ftruncate(fd, sizeof(*hdr) + (size_t) n * sizeof(*samp));
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+static int format_recording(const char *path, int header_interval) {
+    struct record_header hdr;
+    struct sample s[2];
+    uint32_t i, t0;
+    int toggle, count;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "vmstat: could not open %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != RECORD_MAGIC ||
+        hdr.sample_size != sizeof(struct sample)) {
+        fprintf(stderr, "vmstat: %s is not a vmstat recording\n", path);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    toggle = 0;
+    count = 0;
+
+    if (!header_interval)
+        print_header(10);
+    if (fread(&s[1 - toggle], sizeof(s[0]), 1, f) != 1) {
+        fclose(f);
+        return EXIT_SUCCESS;
+    }
+    t0 = s[1 - toggle].sec;
+    for (i = 1; i < hdr.count; i++) {
+        if (fread(&s[toggle], sizeof(s[0]), 1, f) != 1)
+            break;
+        if (header_interval) {
+            if (count == 0)
+                print_header(10);
+            count = (count + 1) % header_interval;
+        }
+        printf("%6u.%03u ", s[toggle].sec - t0, s[toggle].msec);
+        print_line(&s[1 - toggle].s, &s[toggle].s);
+        toggle = 1 - toggle;
+    }
+
+    fclose(f);
+    return EXIT_SUCCESS;
+}
+
 static void read_state(struct state *s) {
     int error;
 
@@ -156,11 +331,17 @@ static void read_state(struct state *s) {
     }
 }
 
+/* The /proc files are opened once and rewound per sample, so the
+ * sampling loop does not pay for path lookup and stream setup. */
 static int read_meminfo(struct state *s) {
-    FILE *f;
+    static FILE *f;
 
-    f = fopen("/proc/meminfo", "r");
-    if (!f) return errno;
+    if (!f) {
+        f = fopen("/proc/meminfo", "r");
+        if (!f) return errno;
+    } else {
+        rewind(f);
+    }
 
     while (fgets(line, MAX_LINE, f)) {
         sscanf(line, "MemFree: %ld kB", &s->mem_free);
@@ -169,16 +350,18 @@ static int read_meminfo(struct state *s) {
         sscanf(line, "Slab: %ld kB", &s->mem_slab);
     }
 
-    fclose(f);
-
     return 0;
 }
 
 static int read_stat(struct state *s) {
-    FILE *f;
+    static FILE *f;
 
-    f = fopen("/proc/stat", "r");
-    if (!f) return errno;
+    if (!f) {
+        f = fopen("/proc/stat", "r");
+        if (!f) return errno;
+    } else {
+        rewind(f);
+    }
 
     while (fgets(line, MAX_LINE, f)) {
         if (!strncmp(line, "cpu ", 4)) {
@@ -192,29 +375,29 @@ static int read_stat(struct state *s) {
         sscanf(line, "procs_blocked %ld", &s->procs_b);
     }
 
-    fclose(f);
-
     return 0;
 }
 
 static int read_vmstat(struct state *s) {
-    FILE *f;
+    static FILE *f;
 
-    f = fopen("/proc/vmstat", "r");
-    if (!f) return errno;
+    if (!f) {
+        f = fopen("/proc/vmstat", "r");
+        if (!f) return errno;
+    } else {
+        rewind(f);
+    }
 
     while (fgets(line, MAX_LINE, f)) {
         sscanf(line, "pgmajfault %ld", &s->sys_flt);
     }
 
-    fclose(f);
-
     return 0;
 }
 
-static void print_header(void) {
-    printf("%-5s  %-27s  %-14s  %-17s\n", "procs", "memory", "system", "cpu");
-    printf("%2s %2s  %6s %6s %6s %6s  %4s %4s %4s  %2s %2s %2s %2s %2s %2s\n", "r", "b", "free", "mapped", "anon", "slab", "in", "cs", "flt", "us", "ni", "sy", "id", "wa", "ir");
+static void print_header(int indent) {
+    printf("%*s%-5s  %-27s  %-14s  %-17s\n", indent, "", "procs", "memory", "system", "cpu");
+    printf("%*s%2s %2s  %6s %6s %6s %6s  %4s %4s %4s  %2s %2s %2s %2s %2s %2s\n", indent, "", "r", "b", "free", "mapped", "anon", "slab", "in", "cs", "flt", "us", "ni", "sy", "id", "wa", "ir");
 }
 
 /* Jiffies to percent conversion */
@@ -238,10 +421,15 @@ static void print_line(struct state *old, struct state *new) {
 
 static void usage(char *cmd) {
     fprintf(stderr, "Usage: %s [ -h ] [ -n iterations ] [ -d delay ] [ -r header_repeat ]\n"
+                    "          [ -m msec ] [ -o record_file ] [ -f record_file ]\n"
                     "    -n iterations     How many rows of data to print.\n"
                     "    -d delay          How long to sleep between rows.\n"
                     "    -r header_repeat  How many rows to print before repeating\n"
                     "                      the header.  Zero means never repeat.\n"
+                    "    -m msec           Sample period in milliseconds (overrides -d).\n"
+                    "    -o record_file    Record binary samples to record_file instead\n"
+                    "                      of printing text.\n"
+                    "    -f record_file    Format a recording as text and exit.\n"
                     "    -h                Displays this help screen.\n",
         cmd);
 }
@@ -4,8 +4,6 @@
 
 #include <cutils/properties.h>
 
-#include <sys/atomics.h>
-
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
@@ -40,10 +38,10 @@ static void announce(const prop_info *pi)
 int watchprops_main(int argc, char *argv[])
 {
     prop_area *pa = __system_property_area__;
-    unsigned serial = pa->serial;
+    unsigned token = property_serial();
     unsigned count = pa->count;
     unsigned n;
-    
+
     if(count >= 1024) exit(1);
 
     for(n = 0; n < count; n++) {
@@ -52,13 +50,11 @@ int watchprops_main(int argc, char *argv[])
     }
 
     for(;;) {
-        do {
-            __futex_wait(&pa->serial, serial, 0);
-        } while(pa->serial == serial);
+        token = property_wait(0, token);
 
         while(count < pa->count){
             watchlist[count].pi = __system_property_find_nth(count);
-            watchlist[count].serial = watchlist[n].pi->serial;
+            watchlist[count].serial = watchlist[count].pi->serial;
             announce(watchlist[count].pi);
             count++;
             if(count == 1024) exit(1);
@@ -16,6 +16,7 @@ LOCAL_SRC_FILES:=                \
                   blkdev.c       \
                   ums.c          \
                   geom_mbr_enc.c \
+                  snapshot.c     \
                   volmgr.c       \
                   media.c        \
                   volmgr_vfat.c  \
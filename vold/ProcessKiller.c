@@ -29,22 +29,29 @@
 #include <pwd.h>
 #include <stdlib.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
+// PIDs found holding references on the previous pass.  An unmount
+// retry loop hits the same few offenders over and over, so they are
+// rechecked first and the full /proc walk is skipped while the set
+// is unchanged.  Queried from the main loop, filled from worker
+// threads, hence the lock.
+#define PID_CACHE_MAX 16
+
+static pthread_mutex_t pid_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int  cached_pids[PID_CACHE_MAX];
+static int  nr_cached_pids = 0;
+static char cached_mountpoint[PATH_MAX];
 
 static boolean ReadSymLink(const char* path, char* link)
 {
-    struct stat s;
     int length;
 
-    if (lstat(path, &s) < 0)
-        return false;
-    if ((s.st_mode & S_IFMT) != S_IFLNK)
-        return false;
-   
-    // we have a symlink    
+    // a plain readlink is all we need - it fails with EINVAL on
+    // anything that isn't a symlink, saving an lstat per entry
     length = readlink(path, link, PATH_MAX - 1);
-    if (length <= 0) 
+    if (length <= 0)
         return false;
     link[length] = 0;
     return true;
@@ -176,47 +183,107 @@ static int get_pid(const char* s)
     return result;
 }
 
+static boolean PidHoldsReference(int pid, const char* mountPoint)
+{
+    return CheckFileDescriptorSymLinks(pid, mountPoint)     // check for open files
+            || CheckFileMaps(pid, mountPoint)               // check for mmap()
+            || CheckSymLink(pid, mountPoint, "cwd", "working directory")  // check working directory
+            || CheckSymLink(pid, mountPoint, "root", "chroot")            // check for chroot()
+            || CheckSymLink(pid, mountPoint, "exe", "executable path");   // check executable path
+}
+
+// record the pid as a blocker (cache lock held) and kill it unless excluded
+static void KillPid(int pid, boolean sigkill, int *excluded, int num_excluded)
+{
+    int i;
+
+    if (nr_cached_pids < PID_CACHE_MAX)
+        cached_pids[nr_cached_pids++] = pid;
+
+    for (i = 0; i < num_excluded; i++) {
+        if (pid == excluded[i]) {
+            LOG_ERROR("I just need a little more TIME captain!\n");
+            return;
+        }
+    }
+
+    LOG_ERROR("Killing process %d\n", pid);
+    kill(pid, (sigkill ? SIGKILL : SIGTERM));
+}
+
 // hunt down and kill processes that have files open on the given mount point
 void KillProcessesWithOpenFiles(const char* mountPoint, boolean sigkill, int *excluded, int num_excluded)
 {
     DIR*    dir;
     struct dirent* de;
+    int     prev_pids[PID_CACHE_MAX];
+    int     nr_prev = 0;
+    int     i;
 
     LOG_ERROR("KillProcessesWithOpenFiles %s\n", mountPoint);
+
+    pthread_mutex_lock(&pid_cache_lock);
+
+    if (nr_cached_pids && !strcmp(cached_mountpoint, mountPoint)) {
+        nr_prev = nr_cached_pids;
+        memcpy(prev_pids, cached_pids, sizeof(prev_pids));
+    }
+    nr_cached_pids = 0;
+    strcpy(cached_mountpoint, mountPoint);
+
+    if (nr_prev) {
+        boolean all_still_held = true;
+
+        for (i = 0; i < nr_prev; i++) {
+            if (PidHoldsReference(prev_pids[i], mountPoint))
+                KillPid(prev_pids[i], sigkill, excluded, num_excluded);
+            else
+                all_still_held = false;
+        }
+
+        // if every previous offender is still hanging on, they are
+        // what is blocking the unmount - no need to rescan the world.
+        // if any went away, someone new may have taken a reference,
+        // so fall through to the full scan
+        if (all_still_held && nr_cached_pids) {
+            pthread_mutex_unlock(&pid_cache_lock);
+            return;
+        }
+        nr_cached_pids = 0;
+    }
+
     dir = opendir("/proc");
-    if (!dir) return;
+    if (!dir) {
+        pthread_mutex_unlock(&pid_cache_lock);
+        return;
+    }
 
     while ((de = readdir(dir)) != 0)
     {
-        boolean killed = false;
         // does the name look like a process ID?
         int pid = get_pid(de->d_name);
         if (pid == -1) continue;
 
-        if (CheckFileDescriptorSymLinks(pid, mountPoint)    // check for open files
-                || CheckFileMaps(pid, mountPoint)           // check for mmap()
-                || CheckSymLink(pid, mountPoint, "cwd", "working directory")    // check working directory
-                || CheckSymLink(pid, mountPoint, "root", "chroot")              // check for chroot()
-                || CheckSymLink(pid, mountPoint, "exe", "executable path")      // check executable path
-            ) 
-        {
-            int i;
-            boolean hit = false;
-
-            for (i = 0; i < num_excluded; i++) {
-                if (pid == excluded[i]) {
-                    LOG_ERROR("I just need a little more TIME captain!\n");
-                    hit = true;
-                    break;
-                }
-            }
-
-            if (!hit) {
-                LOG_ERROR("Killing process %d\n", pid);
-                kill(pid, (sigkill ? SIGKILL : SIGTERM));
-            }
-        }
+        if (PidHoldsReference(pid, mountPoint))
+            KillPid(pid, sigkill, excluded, num_excluded);
     }
 
     closedir(dir);
-}        
+    pthread_mutex_unlock(&pid_cache_lock);
+}
+
+// copy out the pids that blocked the last unmount attempt
+int GetBlockingPids(int *pids, int max)
+{
+    int i, nr;
+
+    pthread_mutex_lock(&pid_cache_lock);
+    nr = nr_cached_pids;
+    if (nr > max)
+        nr = max;
+    for (i = 0; i < nr; i++)
+        pids[i] = cached_pids[i];
+    pthread_mutex_unlock(&pid_cache_lock);
+
+    return nr;
+}
@@ -20,11 +20,12 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/mman.h>
 
 #include <linux/fs.h>
 
@@ -34,11 +35,19 @@
 
 #define DEBUG_BLKDEV 0
 
+// How much of the start of the media one probe read pulls in.  64k
+// covers the MBR and the superblocks of any sanely aligned first
+// partition, and slow media handles a single large request far better
+// than a series of single-sector reads
+#define PROBE_SIZE  (64 * 1024)
+#define PROBE_ALIGN 4096
+
 static blkdev_list_t *list_root = NULL;
 
 static blkdev_t *_blkdev_create(blkdev_t *disk, char *devpath, int major,
                                 int minor, char *type, struct media *media, char *dev_fspath);
 static void blkdev_dev_fspath_set(blkdev_t *blk, char *dev_fspath);
+static int blkdev_probe_disk(blkdev_t *disk);
 
 int blkdev_handle_devicefile_removed(blkdev_t *blk, char *dev_fspath)
 {
@@ -46,6 +55,13 @@ int blkdev_handle_devicefile_removed(blkdev_t *blk, char *dev_fspath)
     LOG_VOL("blkdev_handle_devicefile_removed(%s):\n", dev_fspath);
 #endif
     blkdev_dev_fspath_set(blk, NULL);
+
+    // the cached probe describes media which is no longer there
+    if (blk->type == blkdev_disk && blk->probe) {
+        free(blk->probe);
+        blk->probe = NULL;
+        blk->probe_len = 0;
+    }
     return 0;
 }
 
@@ -97,7 +113,10 @@ int blkdev_handle_devicefile_created(blkdev_t *blk, char *dev_fspath)
 
     /*
      * If we're a disk, then read the partition table. Otherwise we're
-     * a partition so get the partition type
+     * a partition so get the partition type.  Either way the data
+     * comes out of the disk's probe cache - the partition table was
+     * read once when the disk showed up, so partition device files
+     * cost no media I/O at all.
      */
     disk = blk->disk;
 
@@ -110,23 +129,23 @@ int blkdev_handle_devicefile_created(blkdev_t *blk, char *dev_fspath)
 
     if (ioctl(fd, BLKGETSIZE, &blk->nr_sec)) {
         LOGE("Unable to get device size (%m)\n");
+        close(fd);
         return -errno;
     }
+    close(fd);
 
 #if DEBUG_BLKDEV
     LOG_VOL("New device '%s' size = %u sectors\n", dev_fspath, blk->nr_sec);
 #endif
 
-    void *raw_pt;
-    unsigned char *chr_pt;
-    int i;
-
-    raw_pt = chr_pt = mmap(NULL, 512, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (raw_pt == MAP_FAILED) {
-        LOGE("Unable to mmap device paritition table (%m)\n");
-        goto out_nommap;
+    if (!disk->probe && (rc = blkdev_probe_disk(disk))) {
+        LOGE("Unable to probe device '%s' (%s)\n", disk->dev_fspath, strerror(-rc));
+        return rc;
     }
 
+    unsigned char *chr_pt = disk->probe;
+    int i;
+
     if (blk->type == blkdev_disk) {
         blk->nr_parts = 0;
 
@@ -138,7 +157,7 @@ int blkdev_handle_devicefile_created(blkdev_t *blk, char *dev_fspath)
         for (i = 0; i < 4; i++) {
             struct dos_partition part;
 
-            dos_partition_dec(raw_pt + DOSPARTOFF + i * sizeof(struct dos_partition), &part);
+            dos_partition_dec(chr_pt + DOSPARTOFF + i * sizeof(struct dos_partition), &part);
             if (part.dp_size != 0 && part.dp_typ != 0)
                 blk->nr_parts++;
         }
@@ -148,28 +167,95 @@ int blkdev_handle_devicefile_created(blkdev_t *blk, char *dev_fspath)
         struct dos_partition part;
         int part_no = blk->minor -1;
 
-        dos_partition_dec(raw_pt + DOSPARTOFF + part_no * sizeof(struct dos_partition), &part);
+        dos_partition_dec(chr_pt + DOSPARTOFF + part_no * sizeof(struct dos_partition), &part);
 
         if (!part.dp_typ)
             LOG_VOL("Warning - Partition device '%s' (blkdev %s) has no partition type set\n",
                     dev_fspath, blk->devpath);
         blk->part_type = part.dp_typ;
+        blk->part_start = part.dp_start;
 
         LOG_VOL("Partition device '%s' (blkdev %s) partition type 0x%x\n",
                  dev_fspath, blk->devpath, blk->part_type);
     } else {
         LOGE("Bad blkdev type '%d'\n", blk->type);
         rc = -EINVAL;
-        goto out;
     }
 
  out:
-    munmap(raw_pt, 512);
- out_nommap:
-    close(fd);
     return rc;
 }
 
+/*
+ * Read the start of a disk into its probe cache with a single bulk
+ * request.  O_DIRECT keeps the one-off read out of the page cache;
+ * not every device accepts it, so fall back to a buffered read.
+ */
+static int blkdev_probe_disk(blkdev_t *disk)
+{
+    unsigned char *buf;
+    int fd;
+    ssize_t n;
+
+    if (!(buf = memalign(PROBE_ALIGN, PROBE_SIZE)))
+        return -ENOMEM;
+
+    if ((fd = open(disk->dev_fspath, O_RDONLY | O_DIRECT)) < 0)
+        fd = open(disk->dev_fspath, O_RDONLY);
+    if (fd < 0) {
+        free(buf);
+        return -errno;
+    }
+
+    n = read(fd, buf, PROBE_SIZE);
+    close(fd);
+
+    if (n < 512) {
+        free(buf);
+        return (n < 0) ? -errno : -EIO;
+    }
+
+    disk->probe = buf;
+    disk->probe_len = n;
+    return 0;
+}
+
+/*
+ * Read 'len' bytes at byte offset 'offset' of a block device,
+ * servicing the request from the probe cache when the region is
+ * already there.  Filesystem identification should come through here
+ * rather than reading the media directly.
+ */
+int blkdev_read_probe(blkdev_t *blk, size_t offset, void *buf, size_t len)
+{
+    blkdev_t *disk = blk->disk;
+    size_t abs_off = offset;
+    int fd;
+    ssize_t n;
+
+    if (blk->type == blkdev_partition)
+        abs_off += (size_t) blk->part_start * 512;
+
+    if (disk->probe && (abs_off + len) <= disk->probe_len) {
+        memcpy(buf, disk->probe + abs_off, len);
+        return 0;
+    }
+
+    if (!blk->dev_fspath)
+        return -ENODEV;
+
+    if ((fd = open(blk->dev_fspath, O_RDONLY)) < 0)
+        return -errno;
+
+    if (lseek(fd, offset, SEEK_SET) < 0 || (n = read(fd, buf, len)) < 0) {
+        close(fd);
+        return -errno;
+    }
+    close(fd);
+
+    return ((size_t) n == len) ? 0 : -EIO;
+}
+
 blkdev_t *blkdev_create_pending_partition(blkdev_t *disk, char *dev_fspath, int major,
                                 int minor, struct media *media)
 {
@@ -260,6 +346,8 @@ void blkdev_destroy(blkdev_t *blkdev)
         free(blkdev->devpath);
     if (blkdev->dev_fspath)
         free(blkdev->dev_fspath);
+    if (blkdev->probe)
+        free(blkdev->probe);
     free(blkdev);
 }
 
@@ -34,9 +34,17 @@ struct blkdev {
 
     // If type == blkdev_partition then part_type = partition type
     uint8_t       part_type;
+    // If type == blkdev_partition then part_start = first sector (LBA)
+    uint32_t      part_start;
     // If type == blkdev_partition
     struct blkdev *disk;
 
+    // If type == blkdev_disk, one bulk read of the start of the media
+    // (MBR + early superblock region) taken when the device file shows
+    // up, so probing doesn't go back to the media sector by sector
+    unsigned char *probe;
+    size_t        probe_len;
+
     unsigned int  nr_sec;
 
     int           major;
@@ -61,6 +69,7 @@ void blkdev_destroy(blkdev_t *blk);
 
 int blkdev_handle_devicefile_created(blkdev_t *blk, char *dev_fspath);
 int blkdev_handle_devicefile_removed(blkdev_t *blk, char *dev_fspath);
+int blkdev_read_probe(blkdev_t *blk, size_t offset, void *buf, size_t len);
 int blkdev_get_num_pending_partitions(blkdev_t *blk);
 void blkdev_devpath_set(blkdev_t *blk, char *dev_fspath);
 #endif
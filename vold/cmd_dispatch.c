@@ -17,8 +17,13 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 #include "vold.h"
+
+// after vold.h: the stdbool.h that hashmap.h pulls in must not see
+// vold.h's boolean enum
+#include <cutils/hashmap.h>
 #include "cmd_dispatch.h"
 #include "ums.h"
 #include "volmgr.h"
@@ -28,11 +33,33 @@ struct cmd_dispatch {
     int (* dispatch) (char *);
 };
 
+// a binary handler fills 'out' (VOLD_BINCMD_MAX_PAYLOAD bytes) and
+// returns 0 or -errno, which becomes the response status
+struct bin_dispatch {
+    int op;
+    int (* dispatch) (char *payload, int len, char *out, int *outlen);
+};
+
 static void dispatch_cmd(char *cmd);
 static int do_send_ums_status(char *cmd);
 static int do_set_ums_enable(char *cmd);
 static int do_mount_volume(char *cmd);
 static int do_eject_media(char *cmd);
+static int do_send_blocked_pids(char *cmd);
+static int do_prepare_ums(char *cmd);
+static int do_format_volume(char *cmd);
+
+static int process_binary_commands(void);
+static void dispatch_bincmd(struct vold_bincmd *hdr, char *payload);
+static int do_bin_enable_ums(char *payload, int len, char *out, int *outlen);
+static int do_bin_disable_ums(char *payload, int len, char *out, int *outlen);
+static int do_bin_ums_status(char *payload, int len, char *out, int *outlen);
+static int do_bin_mount_volume(char *payload, int len, char *out, int *outlen);
+static int do_bin_eject_media(char *payload, int len, char *out, int *outlen);
+static int do_bin_blocked_pids(char *payload, int len, char *out, int *outlen);
+static int do_bin_volume_states(char *payload, int len, char *out, int *outlen);
+static int do_bin_prepare_ums(char *payload, int len, char *out, int *outlen);
+static int do_bin_format_volume(char *payload, int len, char *out, int *outlen);
 
 static struct cmd_dispatch dispatch_table[] = {
     { VOLD_CMD_ENABLE_UMS,      do_set_ums_enable },
@@ -40,19 +67,70 @@ static struct cmd_dispatch dispatch_table[] = {
     { VOLD_CMD_SEND_UMS_STATUS, do_send_ums_status },
     { VOLD_CMD_MOUNT_VOLUME,     do_mount_volume },
     { VOLD_CMD_EJECT_MEDIA,     do_eject_media },
+    { VOLD_CMD_SEND_BLOCKED_PIDS, do_send_blocked_pids },
+    { VOLD_CMD_PREPARE_UMS,     do_prepare_ums },
+    { VOLD_CMD_FORMAT_VOLUME,   do_format_volume },
     { NULL, NULL }
 };
 
+static struct bin_dispatch bin_dispatch_table[] = {
+    { VOLD_BINOP_ENABLE_UMS,    do_bin_enable_ums },
+    { VOLD_BINOP_DISABLE_UMS,   do_bin_disable_ums },
+    { VOLD_BINOP_UMS_STATUS,    do_bin_ums_status },
+    { VOLD_BINOP_MOUNT_VOLUME,  do_bin_mount_volume },
+    { VOLD_BINOP_EJECT_MEDIA,   do_bin_eject_media },
+    { VOLD_BINOP_BLOCKED_PIDS,  do_bin_blocked_pids },
+    { VOLD_BINOP_VOLUME_STATES, do_bin_volume_states },
+    { VOLD_BINOP_PREPARE_UMS,   do_bin_prepare_ums },
+    { VOLD_BINOP_FORMAT_VOLUME, do_bin_format_volume },
+    { 0, NULL }
+};
+
+// pipelined binary frames can split across reads, so undispatched
+// bytes stay here between calls.  bin_table maps opcode -> handler
+static int bin_mode = 0;
+static char bin_buf[4096];
+static int bin_len = 0;
+static Hashmap *bin_table = NULL;
+
+// called when a new framework connection is accepted
+void cmd_dispatch_reset(void)
+{
+    bin_mode = 0;
+    bin_len = 0;
+}
+
 int process_framework_command(int socket)
 {
     int rc;
     char buffer[101];
 
+    if (bin_mode) {
+        if ((rc = read(socket, bin_buf + bin_len,
+                       sizeof(bin_buf) - bin_len)) < 0) {
+            LOGE("Unable to read framework command (%s)\n", strerror(errno));
+            return -errno;
+        }
+        if (!rc)
+            return -ECONNRESET;
+        bin_len += rc;
+        return process_binary_commands();
+    }
+
     if ((rc = read(socket, buffer, sizeof(buffer) -1)) < 0) {
         LOGE("Unable to read framework command (%s)\n", strerror(errno));
         return -errno;
     }
 
+    // a connection opening with the binary magic speaks the binary
+    // protocol from here on
+    if (rc > 0 && (unsigned char) buffer[0] == VOLD_BINCMD_MAGIC) {
+        bin_mode = 1;
+        memcpy(bin_buf, buffer, rc);
+        bin_len = rc;
+        return process_binary_commands();
+    }
+
     int start = 0;
     int i;
 
@@ -67,6 +145,80 @@ int process_framework_command(int socket)
     return 0;
 }
 
+static int send_bin_response(struct vold_bincmd *req, int status,
+                             void *data, int len)
+{
+    char buf[sizeof(struct vold_bincmd) + sizeof(int) + VOLD_BINCMD_MAX_PAYLOAD];
+    struct vold_bincmd *hdr = (struct vold_bincmd *) buf;
+
+    hdr->magic = VOLD_BINCMD_MAGIC;
+    hdr->op = req->op;
+    hdr->seq = req->seq;
+    hdr->len = sizeof(int) + len;
+    memcpy(buf + sizeof(*hdr), &status, sizeof(int));
+    if (len)
+        memcpy(buf + sizeof(*hdr) + sizeof(int), data, len);
+
+    // one write per frame, so responses never interleave with
+    // asynchronous event messages
+    return send_raw(buf, sizeof(*hdr) + hdr->len);
+}
+
+static int process_binary_commands(void)
+{
+    while (bin_len >= (int) sizeof(struct vold_bincmd)) {
+        struct vold_bincmd *hdr = (struct vold_bincmd *) bin_buf;
+        int frame;
+
+        if (hdr->magic != VOLD_BINCMD_MAGIC ||
+            hdr->len > VOLD_BINCMD_MAX_PAYLOAD) {
+            // the stream cannot be resynchronized; drop the connection
+            LOGE("Malformed binary command (magic 0x%02x len %d)\n",
+                 hdr->magic, hdr->len);
+            return -ECONNRESET;
+        }
+
+        frame = sizeof(struct vold_bincmd) + hdr->len;
+        if (bin_len < frame)
+            break;      // rest of the frame hasn't arrived yet
+
+        dispatch_bincmd(hdr, bin_buf + sizeof(struct vold_bincmd));
+
+        memmove(bin_buf, bin_buf + frame, bin_len - frame);
+        bin_len -= frame;
+    }
+    return 0;
+}
+
+static void dispatch_bincmd(struct vold_bincmd *hdr, char *payload)
+{
+    char out[VOLD_BINCMD_MAX_PAYLOAD];
+    struct bin_dispatch *c;
+    int op = hdr->op;
+    int outlen = 0;
+    int rc;
+
+    if (bin_table == NULL) {
+        bin_table = hashmapCreateFlat(16, hashmapIntHash, hashmapIntEquals);
+        if (bin_table == NULL) {
+            LOGE("Unable to allocate binary dispatch table\n");
+            send_bin_response(hdr, -ENOMEM, NULL, 0);
+            return;
+        }
+        for (c = bin_dispatch_table; c->dispatch != NULL; c++)
+            hashmapPut(bin_table, &c->op, c);
+    }
+
+    if (!(c = hashmapGet(bin_table, &op))) {
+        LOGE("No cmd handler defined for binary opcode %d\n", op);
+        send_bin_response(hdr, -ENOSYS, NULL, 0);
+        return;
+    }
+
+    rc = c->dispatch(payload, hdr->len, out, &outlen);
+    send_bin_response(hdr, rc, out, outlen);
+}
+
 static void dispatch_cmd(char *cmd)
 {
     struct cmd_dispatch *c;
@@ -105,3 +257,96 @@ static int do_eject_media(char *cmd)
 {
     return volmgr_stop_volume_by_mountpoint(&cmd[strlen("eject_media:")]);
 }
+
+// report which pids blocked the last unmount attempt, so clients can
+// deal with the offenders instead of asking for rescan after rescan
+static int do_send_blocked_pids(char *cmd)
+{
+    int pids[16];
+    char buffer[255];
+    char *p = buffer;
+    int nr, i;
+
+    nr = GetBlockingPids(pids, 16);
+
+    buffer[0] = '\0';
+    for (i = 0; i < nr; i++)
+        p += sprintf(p, (i ? " %d" : "%d"), pids[i]);
+
+    return send_msg_with_data(VOLD_EVT_BLOCKED_PIDS, buffer);
+}
+
+static int do_prepare_ums(char *cmd)
+{
+    return volmgr_prepare_ums();
+}
+
+static int do_format_volume(char *cmd)
+{
+    return volmgr_format_volume(&cmd[strlen("format_volume:")]);
+}
+
+/*
+ * Binary protocol handlers
+ */
+
+static int do_bin_enable_ums(char *payload, int len, char *out, int *outlen)
+{
+    return volmgr_enable_ums(true);
+}
+
+static int do_bin_disable_ums(char *payload, int len, char *out, int *outlen)
+{
+    return volmgr_enable_ums(false);
+}
+
+static int do_bin_ums_status(char *payload, int len, char *out, int *outlen)
+{
+    out[0] = ums_enabled_get() ? 1 : 0;
+    out[1] = ums_hostconnected_get() ? 1 : 0;
+    *outlen = 2;
+    return 0;
+}
+
+static int do_bin_mount_volume(char *payload, int len, char *out, int *outlen)
+{
+    if (len < 2 || payload[len - 1] != 0)
+        return -EINVAL;
+    return volmgr_start_volume_by_mountpoint(payload);
+}
+
+static int do_bin_eject_media(char *payload, int len, char *out, int *outlen)
+{
+    if (len < 2 || payload[len - 1] != 0)
+        return -EINVAL;
+    return volmgr_stop_volume_by_mountpoint(payload);
+}
+
+static int do_bin_blocked_pids(char *payload, int len, char *out, int *outlen)
+{
+    int pids[16];
+    int nr;
+
+    nr = GetBlockingPids(pids, 16);
+    memcpy(out, pids, nr * sizeof(int));
+    *outlen = nr * sizeof(int);
+    return 0;
+}
+
+static int do_bin_volume_states(char *payload, int len, char *out, int *outlen)
+{
+    *outlen = volmgr_format_states(out, VOLD_BINCMD_MAX_PAYLOAD);
+    return 0;
+}
+
+static int do_bin_prepare_ums(char *payload, int len, char *out, int *outlen)
+{
+    return volmgr_prepare_ums();
+}
+
+static int do_bin_format_volume(char *payload, int len, char *out, int *outlen)
+{
+    if (len < 2 || payload[len - 1] != 0)
+        return -EINVAL;
+    return volmgr_format_volume(payload);
+}
@@ -22,9 +22,53 @@
 #define VOLD_CMD_ENABLE_UMS         "enable_ums"
 #define VOLD_CMD_DISABLE_UMS        "disable_ums"
 #define VOLD_CMD_SEND_UMS_STATUS    "send_ums_status"
+#define VOLD_CMD_PREPARE_UMS        "prepare_ums"
+#define VOLD_CMD_SEND_BLOCKED_PIDS  "send_blocked_pids"
 
 // these commands should contain a volume mount point after the colon
 #define VOLD_CMD_MOUNT_VOLUME       "mount_volume:"
 #define VOLD_CMD_EJECT_MEDIA        "eject_media:"
+#define VOLD_CMD_FORMAT_VOLUME      "format_volume:"
+
+/*
+ * Binary protocol.
+ *
+ * A connection whose very first byte is VOLD_BINCMD_MAGIC speaks the
+ * binary protocol for its lifetime; anything else is treated as the
+ * text protocol above.  A request is a vold_bincmd header followed by
+ * 'len' payload bytes.  Requests may be pipelined - the daemon answers
+ * them in arrival order and echoes 'seq' so the client can match
+ * responses to outstanding requests.
+ *
+ * A response reuses the header ('op' and 'seq' echoed, 'len' covering
+ * the payload) and its payload always starts with a 32-bit status
+ * (0 or -errno), followed by op-specific data.  The socket is local,
+ * so all fields are host byte order.
+ */
+
+#define VOLD_BINCMD_MAGIC   0xda    // never the first byte of a text command
+
+struct vold_bincmd {
+    unsigned char  magic;
+    unsigned char  op;
+    unsigned short seq;
+    unsigned short len;     // payload bytes following the header
+} __attribute__((packed));
+
+#define VOLD_BINCMD_MAX_PAYLOAD  1024
+
+#define VOLD_BINOP_ENABLE_UMS       1
+#define VOLD_BINOP_DISABLE_UMS      2
+#define VOLD_BINOP_UMS_STATUS       3   // response data: u8 enabled, u8 connected
+#define VOLD_BINOP_MOUNT_VOLUME     4   // payload: mount point, nul terminated
+#define VOLD_BINOP_EJECT_MEDIA      5   // payload: mount point, nul terminated
+#define VOLD_BINOP_BLOCKED_PIDS     6   // response data: array of 32-bit pids
+#define VOLD_BINOP_VOLUME_STATES    7   // response data: <mount point>\0<state>\0
+                                        // for every configured volume
+#define VOLD_BINOP_PREPARE_UMS      8   // start background writeback; progress
+                                        // arrives as VOLD_EVT_UMS_PREPARE events
+#define VOLD_BINOP_FORMAT_VOLUME    9   // payload: mount point, nul terminated;
+                                        // progress arrives as
+                                        // VOLD_EVT_FORMAT_PROGRESS events
 
 #endif
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/inotify.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 
 #include "vold.h"
@@ -32,32 +33,136 @@
 
 #define DEBUG_INOTIFY 0
 
+// A burst of events is drained from the kernel in a few large reads
+// instead of one wakeup per 512 bytes.  Within the batch, events for
+// the same name are coalesced down to the latest one (a node created
+// and deleted in the same burst only needs the delete handled), and
+// disks are handed to volmgr once per batch rather than per event.
+#define INOTIFY_BUFFER_SZ 4096
+#define COALESCE_MAX      64
+
+struct coalesced_event {
+    uint32_t mask;
+    char     name[64];
+};
+
 static int handle_inotify_event(struct inotify_event *evt);
+static void inotify_queue_disk(blkdev_t *disk);
+static void inotify_flush_disk_queue(void);
 
-int process_inotify_event(int fd)
+static void dispatch_coalesced(struct coalesced_event *events, int nr)
 {
-    char buffer[512];
-    int len;
-    int offset = 0;
-  
-    if ((len = read(fd, buffer, sizeof(buffer))) < 0) {
-        LOGE("Unable to read inotify event (%m)\n");
-        return -errno;
-    }
+    char raw[sizeof(struct inotify_event) + sizeof(events[0].name)];
+    struct inotify_event *evt = (struct inotify_event *) raw;
+    int i;
+
+    for (i = 0; i < nr; i++) {
+        memset(raw, 0, sizeof(raw));
+        evt->mask = events[i].mask;
+        strcpy(evt->name, events[i].name);
 
-    while (len >= (int) sizeof(struct inotify_event)) {
-        struct inotify_event *evt = (struct inotify_event *) &buffer[offset];
-   
         if (handle_inotify_event(evt) < 0)
             LOGE("Error handling inotify event (%m)\n");
-      
-        len -= sizeof(struct inotify_event) + evt->len;
-        offset += sizeof(struct inotify_event) + evt->len;
-         
     }
+}
+
+static void coalesce_event(struct coalesced_event *events, int *nr,
+                           struct inotify_event *evt)
+{
+    int i;
+
+    if (evt->len == 0 || strlen(evt->name) >= sizeof(events[0].name))
+        return;
+
+    for (i = 0; i < *nr; i++) {
+        if (!strcmp(events[i].name, evt->name)) {
+            events[i].mask = evt->mask;
+            return;
+        }
+    }
+
+    if (*nr == COALESCE_MAX) {
+        // table full - flush what we have and start over
+        dispatch_coalesced(events, *nr);
+        *nr = 0;
+    }
+
+    events[*nr].mask = evt->mask;
+    strcpy(events[*nr].name, evt->name);
+    (*nr)++;
+}
+
+int process_inotify_event(int fd)
+{
+    char buffer[INOTIFY_BUFFER_SZ];
+    struct coalesced_event events[COALESCE_MAX];
+    int nr_events = 0;
+    int len;
+    int pending;
+
+    do {
+        int offset = 0;
+
+        if ((len = read(fd, buffer, sizeof(buffer))) < 0) {
+            LOGE("Unable to read inotify event (%m)\n");
+            return -errno;
+        }
+
+        while (len >= (int) sizeof(struct inotify_event)) {
+            struct inotify_event *evt = (struct inotify_event *) &buffer[offset];
+
+            coalesce_event(events, &nr_events, evt);
+
+            len -= sizeof(struct inotify_event) + evt->len;
+            offset += sizeof(struct inotify_event) + evt->len;
+        }
+
+        // keep draining while the kernel still has events queued, so
+        // a flood costs a few large reads rather than many wakeups
+        if (ioctl(fd, FIONREAD, &pending) < 0)
+            pending = 0;
+    } while (pending >= (int) sizeof(struct inotify_event));
+
+    dispatch_coalesced(events, nr_events);
+    inotify_flush_disk_queue();
     return 0;
 }
 
+/*
+ * Disks whose last pending partition showed up during the current
+ * batch; each is dispatched to volmgr once, at the end of the batch.
+ */
+#define DISK_QUEUE_MAX 8
+
+static blkdev_t *disk_queue[DISK_QUEUE_MAX];
+static int       nr_queued_disks = 0;
+
+static void inotify_queue_disk(blkdev_t *disk)
+{
+    int i;
+
+    for (i = 0; i < nr_queued_disks; i++) {
+        if (disk_queue[i] == disk)
+            return;
+    }
+
+    if (nr_queued_disks == DISK_QUEUE_MAX)
+        inotify_flush_disk_queue();
+
+    disk_queue[nr_queued_disks++] = disk;
+}
+
+static void inotify_flush_disk_queue(void)
+{
+    int i, rc;
+
+    for (i = 0; i < nr_queued_disks; i++) {
+        if ((rc = volmgr_consider_disk(disk_queue[i])) < 0)
+            LOGE("Error from volmgr - %d\n", rc);
+    }
+    nr_queued_disks = 0;
+}
+
 struct blk_dev_entry {
     int minor;
     char *name;
@@ -194,6 +299,7 @@ int inotify_bootstrap(void)
 
     } // for
 
+    inotify_flush_disk_queue();
 
     return 0;
 }
@@ -244,12 +350,8 @@ static int handle_inotify_event(struct inotify_event *evt)
 #if DEBUG_INOTIFY
         LOG_VOL("NUM_PENDING_PARTITIONS = %d\n", blkdev_get_num_pending_partitions(blkdev));
 #endif
-        if (blkdev_get_num_pending_partitions(blkdev->disk) == 0) {
-            if ((rc = volmgr_consider_disk(blkdev->disk)) < 0) {
-                LOGE("Error from volmgr - %d\n", rc);
-                return rc;
-            }
-        }
+        if (blkdev_get_num_pending_partitions(blkdev->disk) == 0)
+            inotify_queue_disk(blkdev->disk);
     } else {
         blkdev_t *blkdev;
 
@@ -19,15 +19,41 @@
 #include <string.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 
 #include "vold.h"
 #include "mmc.h"
 #include "media.h"
+#include "snapshot.h"
 
 #define DEBUG_BOOTSTRAP 0
 
+// one probe thread per mmc host at bootstrap
+#define MMC_MAX_HOSTS 8
+
+/*
+ * Card identities survive across soft restarts of the probe (a
+ * rescan of the same slot), keyed by slot + serial, so a card we
+ * have already identified costs one sysfs read instead of three.
+ */
+struct mmc_card_ident {
+    struct mmc_card_ident *next;
+    char slot[64];
+    char serial[64];
+    char type[64];
+    char name[64];
+};
+
+static struct mmc_card_ident *card_ident_cache = NULL;
+static pthread_mutex_t card_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the uevent simulation path and the media lists behind it are not
+// thread safe, so the per-host probe threads serialize here
+static pthread_mutex_t uevent_sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *mmc_bootstrap_controller_thread(void *arg);
 static int mmc_bootstrap_controller(char *sysfs_path);
 static int mmc_bootstrap_card(char *sysfs_path);
 static int mmc_bootstrap_block(char *devpath);
@@ -41,12 +67,22 @@ int mmc_bootstrap()
 {
     DIR *d;
     struct dirent *de;
+    pthread_t threads[MMC_MAX_HOSTS];
+    char paths[MMC_MAX_HOSTS][255];
+    int nr_threads = 0;
+    int i;
 
     if (!(d = opendir(SYSFS_CLASS_MMC_PATH))) {
         LOG_ERROR("Unable to open '%s' (%m)\n", SYSFS_CLASS_MMC_PATH);
         return -errno;
     }
 
+    /*
+     * Each host gets its own probe thread: a slot with a slow or
+     * absent card no longer delays volume availability on the
+     * others.  The uevent delivery itself stays serialized on
+     * uevent_sim_lock.
+     */
     while ((de = readdir(d))) {
         char tmp[255];
 
@@ -54,15 +90,70 @@ int mmc_bootstrap()
             continue;
 
         sprintf(tmp, "%s/%s", SYSFS_CLASS_MMC_PATH, de->d_name);
+
+        if (nr_threads < MMC_MAX_HOSTS) {
+            strcpy(paths[nr_threads], tmp);
+            if (!pthread_create(&threads[nr_threads], NULL,
+                                mmc_bootstrap_controller_thread,
+                                paths[nr_threads])) {
+                nr_threads++;
+                continue;
+            }
+        }
+
+        // no thread for this one - probe it inline
         if (mmc_bootstrap_controller(tmp))
             LOG_ERROR("Error bootstrapping controller '%s' (%m)\n", tmp);
     }
 
     closedir(d);
 
+    for (i = 0; i < nr_threads; i++)
+        pthread_join(threads[i], NULL);
+
     return 0;
 }
 
+static void *mmc_bootstrap_controller_thread(void *arg)
+{
+    char *sysfs_path = (char *) arg;
+
+    if (mmc_bootstrap_controller(sysfs_path))
+        LOG_ERROR("Error bootstrapping controller '%s' (%m)\n", sysfs_path);
+    return NULL;
+}
+
+/*
+ * Reads a batch of sysfs attributes under /sys<devpath>.  Each value
+ * gets its trailing newline stripped and is empty when the attribute
+ * is missing.  Returns the number of attributes actually read.
+ */
+static int mmc_read_attrs(char *devpath, const char **names,
+                          char vals[][64], int count)
+{
+    char filename[255];
+    char *p;
+    ssize_t sz;
+    int i;
+    int got = 0;
+
+    for (i = 0; i < count; i++) {
+        vals[i][0] = '\0';
+        sprintf(filename, "/sys%s/%s", devpath, names[i]);
+        if (!(p = read_file(filename, &sz)))
+            continue;
+        if (sz > 63)
+            sz = 63;
+        while (sz > 0 && p[sz - 1] == '\n')
+            sz--;
+        memcpy(vals[i], p, sz);
+        vals[i][sz] = '\0';
+        free(p);
+        got++;
+    }
+    return got;
+}
+
 static int mmc_bootstrap_controller(char *sysfs_path)
 {
     DIR *d;
@@ -101,70 +192,87 @@ static int mmc_bootstrap_controller(char *sysfs_path)
 
 static int mmc_bootstrap_card(char *sysfs_path)
 {
-    char saved_cwd[255];
-    char new_cwd[255];
+    char real_path[255];
     char *devpath;
+    char *slot;
     char *uevent_params[4];
-    char *p;
     char filename[255];
     char tmp[255];
-    ssize_t sz;
+    static const char *card_attrs[] = { "serial", "type", "name" };
+    char vals[3][64];
+    struct mmc_card_ident *id;
+    int rc;
 
 #if DEBUG_BOOTSTRAP
     LOG_VOL("bootstrap_card(%s):\n", sysfs_path);
 #endif
 
     /*
-     * sysfs_path is based on /sys/class, but we want the actual device class
+     * sysfs_path is based on /sys/class, but we want the actual
+     * device path.  realpath() rather than a chdir()/getcwd() round
+     * trip - the probe threads share one working directory.
      */
-    if (!getcwd(saved_cwd, sizeof(saved_cwd))) {
-        LOGE("Buffer too small for working dir path\n");
-        return -errno;
-    }
-    
-    if (chdir(sysfs_path) < 0) {
-        LOGE("Unable to chdir to %s (%m)\n", sysfs_path);
+    if (!realpath(sysfs_path, real_path)) {
+        LOGE("Unable to resolve path to %s (%m)\n", sysfs_path);
         return -errno;
     }
 
-    if (!getcwd(new_cwd, sizeof(new_cwd))) {
-        LOGE("Buffer too small for device path\n");
-        return -errno;
-    }
+    devpath = &real_path[4]; // Skip over '/sys'
 
-    if (chdir(saved_cwd) < 0) {
-        LOGE("Unable to restore working dir\n");
-        return -errno;
-    }
-
-    devpath = &new_cwd[4]; // Skip over '/sys'
+    for (slot = &sysfs_path[strlen(sysfs_path)]; *slot != '/'; slot--);
+    slot++;
 
     /*
-     * Collect parameters so we can simulate a UEVENT
+     * Collect parameters so we can simulate a UEVENT.  A card we
+     * identified on an earlier pass answers from the cache
      */
+    mmc_read_attrs(devpath, card_attrs, vals, 1);
+
+    pthread_mutex_lock(&card_cache_lock);
+    for (id = card_ident_cache; id; id = id->next) {
+        if (!strcmp(id->slot, slot) && !strcmp(id->serial, vals[0]))
+            break;
+    }
+    if (id) {
+        strcpy(vals[1], id->type);
+        strcpy(vals[2], id->name);
+    }
+    pthread_mutex_unlock(&card_cache_lock);
+
+    if (!id) {
+        mmc_read_attrs(devpath, &card_attrs[1], &vals[1], 2);
+
+        if ((id = malloc(sizeof(struct mmc_card_ident)))) {
+            strcpy(id->slot, slot);
+            strcpy(id->serial, vals[0]);
+            strcpy(id->type, vals[1]);
+            strcpy(id->name, vals[2]);
+            pthread_mutex_lock(&card_cache_lock);
+            id->next = card_ident_cache;
+            card_ident_cache = id;
+            pthread_mutex_unlock(&card_cache_lock);
+        }
+    }
+
     sprintf(tmp, "DEVPATH=%s", devpath);
     uevent_params[0] = (char *) strdup(tmp);
 
-    sprintf(filename, "/sys%s/type", devpath);
-    p = read_file(filename, &sz);
-    p[strlen(p) - 1] = '\0';
-    sprintf(tmp, "MMC_TYPE=%s", p);
-    free(p);
+    sprintf(tmp, "MMC_TYPE=%s", vals[1]);
     uevent_params[1] = (char *) strdup(tmp);
 
-    sprintf(filename, "/sys%s/name", devpath);
-    p = read_file(filename, &sz);
-    p[strlen(p) - 1] = '\0';
-    sprintf(tmp, "MMC_NAME=%s", p);
-    free(p);
+    sprintf(tmp, "MMC_NAME=%s", vals[2]);
     uevent_params[2] = (char *) strdup(tmp);
 
     uevent_params[3] = (char *) NULL;
 
-    if (simulate_uevent("mmc", devpath, "add", uevent_params) < 0) {
+    pthread_mutex_lock(&uevent_sim_lock);
+    rc = simulate_uevent("mmc", devpath, "add", uevent_params);
+    pthread_mutex_unlock(&uevent_sim_lock);
+    if (rc < 0) {
         LOGE("Error simulating uevent (%m)\n");
         return -errno;
     }
+    snapshot_record("mmc", "add", devpath, uevent_params);
 
     /*
      *  Check for block drivers
@@ -254,6 +362,7 @@ static int mmc_bootstrap_mmcblk_partition(char *devpath)
     char tmp[255];
     FILE *fp;
     char line[255];
+    int rc;
 
 #if DEBUG_BOOTSTRAP
     LOG_VOL("mmc_bootstrap_mmcblk_partition(%s):\n", devpath);
@@ -284,10 +393,14 @@ static int mmc_bootstrap_mmcblk_partition(char *devpath)
         return -1;
     }
     uevent_params[4] = '\0';
-    
-    if (simulate_uevent("block", devpath, "add", uevent_params) < 0) {
+
+    pthread_mutex_lock(&uevent_sim_lock);
+    rc = simulate_uevent("block", devpath, "add", uevent_params);
+    pthread_mutex_unlock(&uevent_sim_lock);
+    if (rc < 0) {
         LOGE("Error simulating uevent (%m)\n");
         return -errno;
     }
+    snapshot_record("block", "add", devpath, uevent_params);
     return 0;
 }
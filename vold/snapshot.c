@@ -0,0 +1,313 @@
+
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Coldplug snapshot.  The bootstrap walk of /sys costs seconds of
+ * sysfs reads on a loaded system; the uevents it ends up simulating
+ * are recorded here and persisted, so the next vold start can replay
+ * them from one file instead of re-walking sysfs.  The snapshot is
+ * only trusted when the kernel boot id matches and the cards it
+ * describes are still present; any live mmc/block uevent invalidates
+ * it, since hardware changed behind its back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "vold.h"
+#include "mmc.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_PATH     "/data/misc/vold.snapshot"
+#define SNAPSHOT_TMP_PATH SNAPSHOT_PATH ".tmp"
+#define SNAPSHOT_VERSION  1
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+#define SNAPSHOT_MAX_EVENTS 64
+#define SNAPSHOT_MAX_PARAMS 8
+
+struct snap_event {
+    char *subsystem;
+    char *action;
+    char *devpath;
+    char *param[SNAPSHOT_MAX_PARAMS + 1];
+};
+
+static struct snap_event record_log[SNAPSHOT_MAX_EVENTS];
+static int record_count = 0;
+static int record_overflow = 0;
+static int snap_loaded = 0;
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int read_boot_id(char *buf, int len)
+{
+    FILE *fp;
+
+    if (!(fp = fopen(BOOT_ID_PATH, "r")))
+        return -errno;
+    if (!fgets(buf, len, fp)) {
+        fclose(fp);
+        return -EIO;
+    }
+    fclose(fp);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+/*
+ * Records one simulated uevent from the bootstrap walk.  Called from
+ * the per-host probe threads.
+ */
+void snapshot_record(char *subsystem, char *action, char *devpath,
+                     char **params)
+{
+    struct snap_event *e;
+    int i;
+
+    pthread_mutex_lock(&snap_lock);
+
+    if (record_count >= SNAPSHOT_MAX_EVENTS) {
+        record_overflow = 1;
+        pthread_mutex_unlock(&snap_lock);
+        return;
+    }
+
+    e = &record_log[record_count++];
+    e->subsystem = strdup(subsystem);
+    e->action = strdup(action);
+    e->devpath = strdup(devpath);
+    for (i = 0; i < SNAPSHOT_MAX_PARAMS && params[i]; i++)
+        e->param[i] = strdup(params[i]);
+    e->param[i] = NULL;
+
+    pthread_mutex_unlock(&snap_lock);
+}
+
+void snapshot_invalidate(void)
+{
+    unlink(SNAPSHOT_PATH);
+}
+
+/*
+ * Writes the recorded events out, atomically via rename.  A snapshot
+ * restored by snapshot_try_load() is already on disk and is left
+ * alone.
+ */
+int snapshot_commit(void)
+{
+    FILE *fp;
+    char boot_id[64];
+    int i, j;
+
+    if (snap_loaded)
+        return 0;
+
+    if (record_overflow || read_boot_id(boot_id, sizeof(boot_id)) < 0) {
+        snapshot_invalidate();
+        return 0;
+    }
+
+    if (!(fp = fopen(SNAPSHOT_TMP_PATH, "w"))) {
+        LOGE("Unable to write snapshot (%s)\n", strerror(errno));
+        return -errno;
+    }
+
+    fprintf(fp, "vold-snapshot %d\n", SNAPSHOT_VERSION);
+    fprintf(fp, "bootid %s\n", boot_id);
+
+    pthread_mutex_lock(&snap_lock);
+    for (i = 0; i < record_count; i++) {
+        struct snap_event *e = &record_log[i];
+
+        fprintf(fp, "E %s %s %s\n", e->subsystem, e->action, e->devpath);
+        for (j = 0; e->param[j]; j++)
+            fprintf(fp, "P %s\n", e->param[j]);
+    }
+    pthread_mutex_unlock(&snap_lock);
+
+    if (fclose(fp) || rename(SNAPSHOT_TMP_PATH, SNAPSHOT_PATH) < 0) {
+        LOGE("Unable to commit snapshot (%s)\n", strerror(errno));
+        unlink(SNAPSHOT_TMP_PATH);
+        return -errno;
+    }
+
+    LOG_VOL("Committed coldplug snapshot (%d events)\n", record_count);
+    return 0;
+}
+
+// cards currently present under /sys/class/mmc_host
+static int count_mmc_cards(void)
+{
+    DIR *hosts, *cards;
+    struct dirent *de, *ce;
+    char tmp[255];
+    int count = 0;
+
+    if (!(hosts = opendir(SYSFS_CLASS_MMC_PATH)))
+        return 0;
+
+    while ((de = readdir(hosts))) {
+        if (de->d_name[0] == '.')
+            continue;
+        sprintf(tmp, "%s/%s", SYSFS_CLASS_MMC_PATH, de->d_name);
+        if (!(cards = opendir(tmp)))
+            continue;
+        while ((ce = readdir(cards))) {
+            if (ce->d_name[0] == '.')
+                continue;
+            if ((!strcmp(ce->d_name, "uevent")) ||
+                (!strcmp(ce->d_name, "subsystem")) ||
+                (!strcmp(ce->d_name, "device")) ||
+                (!strcmp(ce->d_name, "power")))
+                continue;
+            count++;
+        }
+        closedir(cards);
+    }
+    closedir(hosts);
+    return count;
+}
+
+static void free_events(struct snap_event *events, int count)
+{
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        free(events[i].subsystem);
+        free(events[i].action);
+        free(events[i].devpath);
+        for (j = 0; events[i].param[j]; j++)
+            free(events[i].param[j]);
+    }
+}
+
+/*
+ * Restores device state from the snapshot when it is still valid.
+ * Returns 0 when the replay covered coldplug; any negative return
+ * means the caller must do the full sysfs walk.
+ */
+int snapshot_try_load(void)
+{
+    FILE *fp;
+    char line[512];
+    char boot_id[64];
+    struct snap_event events[SNAPSHOT_MAX_EVENTS];
+    int count = 0;
+    int mmc_cards = 0;
+    int version;
+    int i;
+
+    if (!(fp = fopen(SNAPSHOT_PATH, "r")))
+        return -errno;
+
+    memset(events, 0, sizeof(events));
+
+    if (!fgets(line, sizeof(line), fp) ||
+        sscanf(line, "vold-snapshot %d", &version) != 1 ||
+        version != SNAPSHOT_VERSION)
+        goto bad;
+
+    if (read_boot_id(boot_id, sizeof(boot_id)) < 0)
+        goto bad;
+    if (!fgets(line, sizeof(line), fp))
+        goto bad;
+    line[strcspn(line, "\n")] = '\0';
+    if (strncmp(line, "bootid ", 7) || strcmp(line + 7, boot_id)) {
+        LOG_VOL("Snapshot is from an earlier boot - discarding\n");
+        goto bad;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (line[0] == 'E') {
+            char subsystem[64], action[16], devpath[255];
+
+            if (count >= SNAPSHOT_MAX_EVENTS ||
+                sscanf(line, "E %63s %15s %254s",
+                       subsystem, action, devpath) != 3)
+                goto bad;
+            events[count].subsystem = strdup(subsystem);
+            events[count].action = strdup(action);
+            events[count].devpath = strdup(devpath);
+            count++;
+        } else if (line[0] == 'P' && line[1] == ' ') {
+            struct snap_event *e;
+
+            if (!count)
+                goto bad;
+            e = &events[count - 1];
+            for (i = 0; e->param[i]; i++);
+            if (i >= SNAPSHOT_MAX_PARAMS)
+                goto bad;
+            e->param[i] = strdup(line + 2);
+            e->param[i + 1] = NULL;
+        } else
+            goto bad;
+    }
+    fclose(fp);
+    fp = NULL;
+
+    /*
+     * Validate against what sysfs holds right now: every recorded
+     * device must still exist, and no card may have appeared that
+     * the snapshot doesn't know about.
+     */
+    for (i = 0; i < count; i++) {
+        char syspath[300];
+
+        sprintf(syspath, "/sys%s", events[i].devpath);
+        if (access(syspath, F_OK) < 0) {
+            LOG_VOL("Snapshot device '%s' is gone - discarding\n",
+                    events[i].devpath);
+            goto bad;
+        }
+        if (!strcmp(events[i].subsystem, "mmc"))
+            mmc_cards++;
+    }
+
+    if (mmc_cards != count_mmc_cards()) {
+        LOG_VOL("Snapshot card population changed - discarding\n");
+        goto bad;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (simulate_uevent(events[i].subsystem, events[i].devpath,
+                            events[i].action, events[i].param) < 0) {
+            LOGE("Snapshot replay failed at '%s'\n", events[i].devpath);
+            goto bad;
+        }
+    }
+
+    LOG_VOL("Restored coldplug state from snapshot (%d events)\n", count);
+    free_events(events, count);
+    snap_loaded = 1;
+    return 0;
+
+ bad:
+    if (fp)
+        fclose(fp);
+    free_events(events, count);
+    snapshot_invalidate();
+    return -EINVAL;
+}
@@ -28,6 +28,7 @@
 #include "blkdev.h"
 #include "volmgr.h"
 #include "media.h"
+#include "snapshot.h"
 
 #define DEBUG_UEVENT 0
 
@@ -123,6 +124,12 @@ int process_uevent_message(int socket)
         s+= (strlen(s) + 1);
     }
 
+    // storage hardware changed behind the coldplug snapshot's back
+    if (event->subsystem &&
+        (!strcmp(event->subsystem, "mmc") ||
+         !strcmp(event->subsystem, "block")))
+        snapshot_invalidate();
+
     rc = dispatch_uevent(event);
     
     free_uevent(event);
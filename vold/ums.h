@@ -26,6 +26,7 @@
 
 
 int ums_send_status(void);
+boolean ums_enabled_get(void);
 int ums_enable(char *device_file, char *lun_syspath);
 int ums_disable(char *lun_syspath);
 #endif
@@ -41,6 +41,7 @@
 
 #include "vold.h"
 #include "volmgr.h"
+#include "snapshot.h"
 
 
 #define VOLD_SOCKET "vold"
@@ -121,8 +122,10 @@ int main(int argc, char **argv)
      * Bootstrap 
      */
 
-    // SD Card system
-    mmc_bootstrap();
+    // SD Card system - replay the coldplug snapshot when it still
+    // matches sysfs, otherwise do the full walk
+    if (snapshot_try_load() < 0)
+        mmc_bootstrap();
 
     // USB Mass Storage
     ums_bootstrap();
@@ -133,6 +136,8 @@ int main(int argc, char **argv)
     // Block device system
     inotify_bootstrap();
 
+    snapshot_commit();
+
     /*
      * Main loop
      */
@@ -183,6 +188,7 @@ int main(int argc, char **argv)
                      strerror(errno));
             }
             LOG_VOL("Accepted connection from framework\n");
+            cmd_dispatch_reset();
             if ((rc = volmgr_send_states()) < 0) {
                 LOGE("Unable to send volmgr status to framework (%d)\n", rc);
             }
@@ -234,6 +240,20 @@ int send_msg(char* message)
     return result;
 }
 
+int send_raw(const void *data, int len)
+{
+    int result = -1;
+
+    pthread_mutex_lock(&write_mutex);
+
+    if (fw_sock >= 0)
+        result = write(fw_sock, data, len);
+
+    pthread_mutex_unlock(&write_mutex);
+
+    return result;
+}
+
 int send_msg_with_data(char *message, char *data)
 {
     int result = -1;
@@ -74,6 +74,7 @@ enum {
  */
 
 int process_framework_command(int socket);
+void cmd_dispatch_reset(void);
 
 int process_inotify_event(int fd);
 int inotify_bootstrap(void);
@@ -95,4 +96,5 @@ boolean ums_hostconnected_get(void);
 
 int send_msg(char *msg);
 int send_msg_with_data(char *msg, char *data);
+int send_raw(const void *data, int len);
 #endif
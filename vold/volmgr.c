@@ -15,10 +15,12 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sched.h>
 
@@ -37,12 +39,21 @@
 
 #define DEBUG_VOLMGR 0
 
+// At most this many filesystem checks run at once.  Independent
+// volumes get checked in parallel, but unbounded parallelism just
+// makes every check slower
+#define MAX_RUNNING_FSCK 2
+
 static volume_t        *vol_root = NULL;
 
+static pthread_mutex_t fsck_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  fsck_slot_free = PTHREAD_COND_INITIALIZER;
+static int             fsck_running = 0;
+
 static struct volmgr_fstable_entry fs_table[] = {
-    { "ext3", ext3_identify, ext3_check, ext3_mount },
-    { "vfat", vfat_identify, vfat_check, vfat_mount },
-    { NULL, NULL, NULL, NULL }
+    { "ext3", ext3_identify, ext3_check, ext3_mount, NULL },
+    { "vfat", vfat_identify, vfat_check, vfat_mount, vfat_format },
+    { NULL, NULL, NULL, NULL, NULL }
 };
 
 struct _volume_state_event_map {
@@ -70,8 +81,9 @@ static int volmgr_readconfig(char *cfg_path);
 static int volmgr_config_volume(cnode *node);
 static volume_t *volmgr_lookup_volume_by_mediapath(char *media_path, boolean fuzzy);
 static volume_t *volmgr_lookup_volume_by_dev(blkdev_t *dev);
-static int _volmgr_start(volume_t *vol, blkdev_t *dev);
-static int volmgr_start_fs(struct volmgr_fstable_entry *fs, volume_t *vol, blkdev_t *dev);
+static int volmgr_start_worker(volume_t *vol, blkdev_t *dev);
+static struct volmgr_fstable_entry *volmgr_identify_fs(blkdev_t *dev);
+static void volmgr_run_pending(volume_t *vol);
 static void *volmgr_start_fs_thread(void *arg);
 static void volmgr_start_fs_thread_sighandler(int signo);
 static void volume_setstate(volume_t *vol, volume_state_t state);
@@ -87,6 +99,8 @@ static void _cb_volume_stopped_for_shutdown(volume_t *v, void *arg);
 static int _volmgr_consider_disk_and_vol(volume_t *vol, blkdev_t *dev);
 static void volmgr_uncage_reaper(volume_t *vol);
 static void volmgr_reaper_thread_sighandler(int signo);
+static void volmgr_set_clean_marker(volume_t *vol);
+static void volmgr_drop_clean_marker(volume_t *vol);
 
 /*
  * Public functions
@@ -120,6 +134,37 @@ int volmgr_send_states(void)
     return 0;
 }
 
+/*
+ * Packs "<mount point>\0<state>\0" for every configured volume into
+ * buf, so a client gets all volume states in a single query instead
+ * of one round trip per volume.  Returns the number of bytes used.
+ */
+int volmgr_format_states(char *buf, int maxlen)
+{
+    volume_t *v = vol_root;
+    int used = 0;
+
+    while (v) {
+        pthread_mutex_lock(&v->lock);
+        char *state = conv_volstate_to_propstr(v->state);
+        int mp_len = strlen(v->mount_point) + 1;
+        int st_len = strlen(state) + 1;
+
+        if (used + mp_len + st_len > maxlen) {
+            pthread_mutex_unlock(&v->lock);
+            break;
+        }
+        memcpy(buf + used, v->mount_point, mp_len);
+        used += mp_len;
+        memcpy(buf + used, state, st_len);
+        used += st_len;
+        pthread_mutex_unlock(&v->lock);
+        v = v->next;
+    }
+
+    return used;
+}
+
 /*
  * Called when a block device is ready to be
  * evaluated by the volume manager.
@@ -182,6 +227,94 @@ int volmgr_stop_volume_by_mountpoint(char *mount_point)
     return -ENOENT;
 }
 
+static void *volmgr_format_thread(void *arg)
+{
+    volume_t *v = (volume_t *) arg;
+    struct volmgr_fstable_entry *fs;
+    int rc;
+
+    pthread_mutex_lock(&v->lock);
+
+    if (v->state != volstate_unmounted && v->state != volstate_nofs &&
+        v->state != volstate_damaged) {
+        LOGE("Volume '%s' changed state before format could start\n",
+             v->mount_point);
+        goto out;
+    }
+
+    // external media is FAT by convention; today vfat is the only
+    // filesystem with a format engine
+    for (fs = fs_table; fs->name && !fs->format_fn; fs++);
+    if (!fs->name) {
+        LOGE("No filesystem format engine available\n");
+        goto out;
+    }
+
+    LOG_VOL("Formatting volume '%s' (%s)\n", v->mount_point, fs->name);
+
+    if ((rc = fs->format_fn(v->dev, v)) < 0) {
+        LOGE("Format of '%s' failed (%d)\n", v->mount_point, rc);
+        volume_setstate(v, volstate_damaged);
+        goto out;
+    }
+
+    // pick the fresh filesystem up through the normal start path
+    if ((rc = _volmgr_consider_disk_and_vol(v, v->dev->disk)) < 0)
+        LOGE("volmgr failed to restart volume '%s' after format (%d)\n",
+             v->mount_point, rc);
+
+ out:
+    pthread_mutex_unlock(&v->lock);
+    pthread_exit(NULL);
+    return NULL;
+}
+
+/*
+ * Reformats an unmounted volume.  The actual work runs on its own
+ * thread - a format takes seconds and must not stall the main loop -
+ * with progress reported as VOLD_EVT_FORMAT_PROGRESS events.
+ */
+int volmgr_format_volume(char *mount_point)
+{
+    volume_t *v = vol_root;
+    pthread_attr_t attr;
+    pthread_t t;
+
+    while (v) {
+        if (!strcmp(v->mount_point, mount_point))
+            break;
+        v = v->next;
+    }
+    if (!v)
+        return -ENOENT;
+
+    pthread_mutex_lock(&v->lock);
+
+    if (!v->dev) {
+        pthread_mutex_unlock(&v->lock);
+        return -ENODEV;
+    }
+    if (v->worker_running ||
+        (v->state != volstate_unmounted && v->state != volstate_nofs &&
+         v->state != volstate_damaged)) {
+        LOGE("Cannot format '%s' while in state %d\n", mount_point, v->state);
+        pthread_mutex_unlock(&v->lock);
+        return -EBUSY;
+    }
+
+    pthread_mutex_unlock(&v->lock);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    if (pthread_create(&t, &attr, volmgr_format_thread, v)) {
+        LOGE("Unable to create format thread (%s)\n", strerror(errno));
+        return -errno;
+    }
+
+    return 0;
+}
+
 int volmgr_notify_eject(blkdev_t *dev, void (* cb) (blkdev_t *))
 {
 #if DEBUG_VOLMGR
@@ -199,7 +332,15 @@ int volmgr_notify_eject(blkdev_t *dev, void (* cb) (blkdev_t *))
     }
     
     pthread_mutex_lock(&v->lock);
-    if (v->state == volstate_mounted) 
+
+    // the media is going away, so any queued start is now pointless,
+    // and a clean marker no longer proves anything about the card
+    // that comes back
+    if (v->pending && !v->pending_reap)
+        v->pending = false;
+    volmgr_drop_clean_marker(v);
+
+    if (v->state == volstate_mounted)
         volume_setstate(v, volstate_badremoval);
 
     int rc = volmgr_stop_volume(v, _cb_volume_stopped_for_eject, cb, false);
@@ -221,6 +362,108 @@ static void _cb_volume_stopped_for_eject(volume_t *v, void *arg)
  * Instructs the volume manager to enable or disable USB mass storage
  * on any volumes configured to use it.
  */
+/*
+ * UMS pre-flush.  Enabling UMS unmounts the volume, and that unmount
+ * writes back every dirty page while the user waits - measured at up
+ * to 8 seconds after heavy writes.  The framework calls this as soon
+ * as it puts up its share confirmation UI, so writeback runs in the
+ * background and the eventual unmount finds an already-clean
+ * filesystem.
+ */
+
+static pthread_mutex_t prepare_lock = PTHREAD_MUTEX_INITIALIZER;
+static boolean prepare_running = false;
+
+// system-wide dirty + in-flight writeback, in kB, or -1
+static int volmgr_dirty_kb(void)
+{
+    FILE *fp;
+    char line[128];
+    int total = 0;
+    int kb;
+
+    if (!(fp = fopen("/proc/meminfo", "r")))
+        return -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "Dirty: %d kB", &kb) == 1 ||
+            sscanf(line, "Writeback: %d kB", &kb) == 1)
+            total += kb;
+    }
+    fclose(fp);
+    return total;
+}
+
+static void volmgr_send_prepare_progress(char *phase)
+{
+    volume_t *v;
+    char buffer[255];
+
+    for (v = vol_root; v; v = v->next) {
+        if (!v->ums_path)
+            continue;
+        pthread_mutex_lock(&v->lock);
+        if (v->state == volstate_mounted || v->state == volstate_mounted_ro) {
+            snprintf(buffer, sizeof(buffer), "%s %s", v->mount_point, phase);
+            send_msg_with_data(VOLD_EVT_UMS_PREPARE, buffer);
+        }
+        pthread_mutex_unlock(&v->lock);
+    }
+}
+
+static void *volmgr_ums_prepare_thread(void *arg)
+{
+    char phase[64];
+    int dirty = volmgr_dirty_kb();
+
+    if (dirty >= 0)
+        snprintf(phase, sizeof(phase), "started %dkB", dirty);
+    else
+        strcpy(phase, "started");
+    volmgr_send_prepare_progress(phase);
+
+    // there is no per-volume writeback control short of walking every
+    // file on it, so flush everything: on these devices the shared
+    // volume holds nearly all of the dirty data anyway
+    sync();
+
+    volmgr_send_prepare_progress("done");
+
+    pthread_mutex_lock(&prepare_lock);
+    prepare_running = false;
+    pthread_mutex_unlock(&prepare_lock);
+    pthread_exit(NULL);
+    return NULL;
+}
+
+int volmgr_prepare_ums(void)
+{
+    pthread_attr_t attr;
+    pthread_t t;
+
+    pthread_mutex_lock(&prepare_lock);
+    if (prepare_running) {
+        // a flush is already on its way; it covers this request too
+        pthread_mutex_unlock(&prepare_lock);
+        return 0;
+    }
+    prepare_running = true;
+    pthread_mutex_unlock(&prepare_lock);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    if (pthread_create(&t, &attr, volmgr_ums_prepare_thread, NULL)) {
+        LOGE("Unable to create ums prepare thread (%s)\n", strerror(errno));
+        pthread_mutex_lock(&prepare_lock);
+        prepare_running = false;
+        pthread_mutex_unlock(&prepare_lock);
+        return -errno;
+    }
+
+    return 0;
+}
+
 int volmgr_enable_ums(boolean enable)
 {
     volume_t *v = vol_root;
@@ -281,45 +524,13 @@ static int _volmgr_consider_disk_and_vol(volume_t *vol, blkdev_t *dev)
 
     LOG_VOL("Evaluating dev '%s' for mountable filesystems for '%s'\n", dev->devpath, vol->mount_point);
 
-    if (dev->nr_parts == 0) {
-        rc = _volmgr_start(vol, dev);
-#if DEBUG_VOLMGR
-        LOG_VOL("_volmgr_start(%s, %s) rc = %d\n", vol->mount_point, dev->dev_fspath ,rc);
-#endif
-    } else {
-        /*
-         * Device has multiple partitions
-         * This is where interesting partition policies could be implemented.
-         * For now just try them in sequence until one succeeds
-         */
-   
-        rc = -ENODEV;
-        int i;
-        for (i = 0; i < dev->nr_parts; i++) {
-            blkdev_t *part = blkdev_lookup_by_devno(dev->major, (i+1));
-            if (!part) {
-                LOGE("Error - unable to lookup partition for blkdev %d:%d\n", dev->major, (i+1));
-                continue;
-            }
-            rc = _volmgr_start(vol, part);
-#if DEBUG_VOLMGR
-            LOG_VOL("_volmgr_start(%s, %s) rc = %d\n", vol->mount_point, part->dev_fspath, rc);
-#endif
-            if (!rc) 
-                break;
-        }
-
-        if (rc == -ENODEV) {
-            // Assert to make sure each partition had a backing blkdev
-            LOGE("Internal consistency error\n");
-            return 0;
-        }
-    }
-
-    if (rc == -ENODATA) {
-        LOGE("Device %s contains no usable filesystems\n", dev->dev_fspath);
-        rc = 0;
-    }
+    /*
+     * Filesystem identification reads from the media, so it runs on
+     * the per-volume worker thread along with the check and mount.
+     * All we do here is hand the disk over; the main loop stays
+     * responsive while a slow card is being brought up.
+     */
+    rc = volmgr_start_worker(vol, dev);
 
     return rc;
 }
@@ -329,6 +540,22 @@ static void volmgr_reaper_thread_sighandler(int signo)
     LOGE("volmgr reaper thread got signal %d\n", signo);
 }
 
+/*
+ * Spawn whatever work was queued while the worker was busy.
+ * vol->lock must be held, so the main loop cannot race the handoff.
+ */
+static void volmgr_run_pending(volume_t *vol)
+{
+    if (!vol->pending)
+        return;
+
+    vol->pending = false;
+    if (vol->pending_reap)
+        volmgr_uncage_reaper(vol);
+    else
+        volmgr_start_worker(vol, vol->pending_dev);
+}
+
 static void __reaper_cleanup(void *arg)
 {
     volume_t *vol = (volume_t *) arg;
@@ -337,6 +564,8 @@ static void __reaper_cleanup(void *arg)
 
     vol->worker_running = false;
 
+    volmgr_run_pending(vol);
+
     // Wake up anyone that was waiting on this thread
     pthread_mutex_unlock(&vol->worker_sem);
 
@@ -399,12 +628,14 @@ static void *volmgr_reaper_thread(void *arg)
 static void volmgr_uncage_reaper(volume_t *vol)
 {
     if (vol->worker_running) {
-        LOGE("Worker thread is currently running.. waiting..\n");
-        pthread_mutex_lock(&vol->worker_sem);
-        LOG_VOL("Worker thread now available\n");
+        // queue the reap for when the worker finishes rather than
+        // stalling the caller (usually the main loop)
+        LOG_VOL("Worker busy for '%s' - queueing reap\n", vol->mount_point);
+        vol->pending = true;
+        vol->pending_reap = true;
+        return;
     }
 
-    vol->worker_args.fs = NULL;
     vol->worker_args.dev = NULL;
 
     pthread_attr_t attr;
@@ -436,6 +667,10 @@ static int volmgr_stop_volume(volume_t *v, void (*cb) (volume_t *, void *), void
         if (!rc) {
             LOG_VOL("volmgr_stop_volume(%s): Volume unmounted sucessfully\n",
                     v->mount_point);
+            // only a graceful unmount counts as clean - the eject
+            // path comes through here too, in badremoval state
+            if (v->state == volstate_mounted && emit_statechange)
+                volmgr_set_clean_marker(v);
             if (emit_statechange)
                 volume_setstate(v, volstate_unmounted);
             goto out_cb_immed;
@@ -495,6 +730,8 @@ static void _cb_volstopped_for_ums_enable(volume_t *v, void *arg)
         LOGE("Error enabling ums (%d)\n", rc);
         return;
     }
+    // the USB host can dirty the filesystem behind our back
+    volmgr_drop_clean_marker(v);
     volume_setstate(v, volstate_ums);
     pthread_mutex_unlock(&v->lock);
 }
@@ -527,6 +764,7 @@ static int volmgr_config_volume(cnode *node)
     memset(new, 0, sizeof(volume_t));
 
     new->state = volstate_nomedia;
+    new->read_ahead_kb = -1;
     pthread_mutex_init(&new->lock, NULL);
     pthread_mutex_init(&new->worker_sem, NULL);
 
@@ -547,6 +785,10 @@ static int volmgr_config_volume(cnode *node)
             new->mount_point = strdup(child->value);
         else if (!strcmp(child->name, "ums_path"))
             new->ums_path = strdup(child->value);
+        else if (!strcmp(child->name, "read_ahead_kb"))
+            new->read_ahead_kb = atoi(child->value);
+        else if (!strcmp(child->name, "scheduler"))
+            new->scheduler = strdup(child->value);
         else
             LOGE("Ignoring unknown config entry '%s'\n", child->name);
         child = child->next;
@@ -576,6 +818,8 @@ static int volmgr_config_volume(cnode *node)
         free(new->mount_point);
     if (new->ums_path)
         free(new->ums_path);
+    if (new->scheduler)
+        free(new->scheduler);
     return rc;
 }
 
@@ -583,8 +827,15 @@ static volume_t *volmgr_lookup_volume_by_dev(blkdev_t *dev)
 {
     volume_t *scan = vol_root;
     while(scan) {
-        if (scan->dev == dev)
-            return scan;
+        if (scan->dev) {
+            if (scan->dev == dev)
+                return scan;
+            // the volume may be bound to another partition of the
+            // same disk (or to the disk while the worker is still
+            // picking a partition)
+            if (scan->dev->disk == dev->disk)
+                return scan;
+        }
         scan = scan->next;
     }
     return NULL;
@@ -613,51 +864,145 @@ static volume_t *volmgr_lookup_volume_by_mediapath(char *media_path, boolean fuz
     return res;
 }
 
+static void volmgr_fsck_progress(volume_t *vol, char *phase)
+{
+    char data[255];
+
+    sprintf(data, "%s %s", vol->mount_point, phase);
+    send_msg_with_data(VOLD_EVT_FSCK_PROGRESS, data);
+}
+
+static void volmgr_fsck_slot_acquire(volume_t *vol)
+{
+    pthread_mutex_lock(&fsck_mutex);
+    if (fsck_running >= MAX_RUNNING_FSCK) {
+        LOG_VOL("Too many filesystem checks running - queueing %s\n",
+                vol->mount_point);
+        volmgr_fsck_progress(vol, "queued");
+        while (fsck_running >= MAX_RUNNING_FSCK)
+            pthread_cond_wait(&fsck_slot_free, &fsck_mutex);
+    }
+    fsck_running++;
+    pthread_mutex_unlock(&fsck_mutex);
+}
+
+static void volmgr_fsck_slot_release(void)
+{
+    pthread_mutex_lock(&fsck_mutex);
+    fsck_running--;
+    pthread_cond_signal(&fsck_slot_free);
+    pthread_mutex_unlock(&fsck_mutex);
+}
+
 /*
- * Attempt to bring a volume online
- * Returns: 0 on success, errno on failure, with the following exceptions:
- *     - ENODATA - Unsupported filesystem type / blank
- * vol->lock MUST be held!
+ * A volume that was unmounted cleanly leaves a marker behind, and a
+ * still-present marker lets the next start skip the filesystem check
+ * (i.e. across a reboot with the card left in).  The marker is
+ * consumed on use, and dropped whenever the media leaves our sight -
+ * ejected, or handed to a USB host - since someone else may have
+ * dirtied the filesystem in the meantime.
  */
-static int _volmgr_start(volume_t *vol, blkdev_t *dev)
+static void volmgr_clean_marker_path(volume_t *vol, char *buf)
 {
-    struct volmgr_fstable_entry *fs;
-    int rc = ENODATA;
+    char *p;
 
-#if DEBUG_VOLMGR
-    LOG_VOL("_volmgr_start(%s, %s):\n", vol->mount_point, dev->dev_fspath);
-#endif
+    sprintf(buf, "/data/misc/vold-clean-%s", vol->mount_point + 1);
+    for (p = buf + strlen("/data/misc/"); *p; p++)
+        if (*p == '/')
+            *p = '_';
+}
 
-    for (fs = fs_table; fs->name; fs++) {
-        if (!fs->identify_fn(dev))
-            break;
+static void volmgr_set_clean_marker(volume_t *vol)
+{
+    char path[255];
+    int fd;
+
+    volmgr_clean_marker_path(vol, path);
+    if ((fd = open(path, O_CREAT | O_WRONLY, 0600)) < 0) {
+        LOGE("Unable to write clean marker '%s' (%s)\n", path, strerror(errno));
+        return;
     }
+    close(fd);
+}
 
-    if (!fs) {
-        LOGE("No supported filesystems on %s\n", dev->dev_fspath);
-        volume_setstate(vol, volstate_nofs);
-        return -ENODATA;
+static void volmgr_drop_clean_marker(volume_t *vol)
+{
+    char path[255];
+
+    volmgr_clean_marker_path(vol, path);
+    unlink(path);
+}
+
+static boolean volmgr_consume_clean_marker(volume_t *vol)
+{
+    char path[255];
+
+    volmgr_clean_marker_path(vol, path);
+    return !unlink(path);
+}
+
+static void volmgr_write_queue_var(blkdev_t *disk, char *var, char *val)
+{
+    char filename[255];
+    int fd;
+
+    sprintf(filename, "/sys%s/queue/%s", disk->devpath, var);
+    if ((fd = open(filename, O_WRONLY)) < 0) {
+        LOGE("Unable to open '%s' (%s)\n", filename, strerror(errno));
+        return;
     }
+    if (write(fd, val, strlen(val)) < 0)
+        LOGE("Unable to write '%s' to '%s' (%s)\n", val, filename, strerror(errno));
+    close(fd);
+}
+
+/*
+ * Apply any block-layer tuning configured for the volume to its
+ * underlying disk.  Failures are logged but not fatal - the volume
+ * works either way, just slower.
+ */
+static void volmgr_apply_io_tuning(volume_t *vol, blkdev_t *dev)
+{
+    char val[16];
 
-    return volmgr_start_fs(fs, vol, dev);
+    if (vol->read_ahead_kb >= 0) {
+        sprintf(val, "%d", vol->read_ahead_kb);
+        volmgr_write_queue_var(dev->disk, "read_ahead_kb", val);
+    }
+    if (vol->scheduler)
+        volmgr_write_queue_var(dev->disk, "scheduler", vol->scheduler);
 }
 
-// vol->lock MUST be held!
-static int volmgr_start_fs(struct volmgr_fstable_entry *fs, volume_t *vol, blkdev_t *dev)
+static struct volmgr_fstable_entry *volmgr_identify_fs(blkdev_t *dev)
 {
-    /*
-     * Spawn a thread to do the actual checking / mounting in
-     */
+    struct volmgr_fstable_entry *fs;
 
+    for (fs = fs_table; fs->name; fs++) {
+        if (!fs->identify_fn(dev))
+            return fs;
+    }
+    return NULL;
+}
+
+/*
+ * Hand a disk to the per-volume worker thread, which identifies,
+ * checks and mounts it.  If the worker is busy the job is queued and
+ * spawned when it finishes, so the caller never blocks.
+ * vol->lock MUST be held!
+ */
+static int volmgr_start_worker(volume_t *vol, blkdev_t *dev)
+{
     if (vol->worker_running) {
-        LOGE("Worker thread is currently running.. waiting..\n");
-        pthread_mutex_lock(&vol->worker_sem);
-        LOG_VOL("Worker thread now available\n");
+        // only the latest request matters
+        LOG_VOL("Worker busy for '%s' - queueing start\n", vol->mount_point);
+        vol->pending = true;
+        vol->pending_reap = false;
+        vol->pending_dev = dev;
+        return 0;
     }
 
-    vol->dev = dev; 
+    vol->dev = dev;
 
-    vol->worker_args.fs = fs;
     vol->worker_args.dev = dev;
 
     pthread_attr_t attr;
@@ -677,6 +1022,8 @@ static void __start_fs_thread_lock_cleanup(void *arg)
 
     vol->worker_running = false;
 
+    volmgr_run_pending(vol);
+
     // Wake up anyone that was waiting on this thread
     pthread_mutex_unlock(&vol->worker_sem);
 
@@ -702,30 +1049,87 @@ static void *volmgr_start_fs_thread(void *arg)
     actions.sa_handler = volmgr_start_fs_thread_sighandler;
     sigaction(SIGUSR1, &actions, NULL);
 
-    struct volmgr_fstable_entry *fs = vol->worker_args.fs;
-    blkdev_t                    *dev = vol->worker_args.dev;
+    struct volmgr_fstable_entry *fs = NULL;
+    blkdev_t                    *disk = vol->worker_args.dev;
+    blkdev_t                    *dev = NULL;
     int                          rc;
-  
-    LOG_VOL("Worker thread pid %d starting %s fs %s on %s\n", getpid(), fs->name, dev->dev_fspath, vol->mount_point);
 
-    if (fs->check_fn) {
-        LOG_VOL("Starting %s filesystem check on %s\n", fs->name, dev->dev_fspath);
-        volume_setstate(vol, volstate_checking);
-        pthread_mutex_unlock(&vol->lock);
-        rc = fs->check_fn(dev);
-        pthread_mutex_lock(&vol->lock);
-        if (vol->state != volstate_checking) {
-            LOG_VOL("filesystem check aborted\n");
-            goto out;
+    LOG_VOL("Worker thread pid %d evaluating %s for %s\n", getpid(), disk->dev_fspath, vol->mount_point);
+
+    /*
+     * Identification reads from the media, so drop the lock while it
+     * runs; the checking state covers it, and a stop/eject aborts us
+     * the same way it aborts the filesystem check.
+     */
+    volume_setstate(vol, volstate_checking);
+    pthread_mutex_unlock(&vol->lock);
+
+    if (disk->nr_parts == 0) {
+        if ((fs = volmgr_identify_fs(disk)))
+            dev = disk;
+    } else {
+        /*
+         * Device has multiple partitions
+         * This is where interesting partition policies could be implemented.
+         * For now just try them in sequence until one succeeds
+         */
+        int i;
+        for (i = 0; i < disk->nr_parts; i++) {
+            blkdev_t *part = blkdev_lookup_by_devno(disk->major, (i+1));
+            if (!part) {
+                LOGE("Error - unable to lookup partition for blkdev %d:%d\n", disk->major, (i+1));
+                continue;
+            }
+            if ((fs = volmgr_identify_fs(part))) {
+                dev = part;
+                break;
+            }
         }
-        
-        if (rc < 0) {
-            LOG_VOL("%s filesystem check failed on %s\n", fs->name, dev->dev_fspath);
-            goto out_unmountable;
+    }
+
+    pthread_mutex_lock(&vol->lock);
+    if (vol->state != volstate_checking) {
+        LOG_VOL("volume start aborted\n");
+        goto out;
+    }
+
+    if (!fs) {
+        LOGE("Device %s contains no usable filesystems\n", disk->dev_fspath);
+        volume_setstate(vol, volstate_nofs);
+        goto out;
+    }
+
+    vol->dev = dev;
+
+    if (fs->check_fn) {
+        if (volmgr_consume_clean_marker(vol)) {
+            LOG_VOL("Skipping %s filesystem check on %s (clean unmount marker)\n",
+                    fs->name, dev->dev_fspath);
+            volmgr_fsck_progress(vol, "skipped");
+        } else {
+            LOG_VOL("Starting %s filesystem check on %s\n", fs->name, dev->dev_fspath);
+            pthread_mutex_unlock(&vol->lock);
+            volmgr_fsck_slot_acquire(vol);
+            volmgr_fsck_progress(vol, "started");
+            rc = fs->check_fn(dev);
+            volmgr_fsck_slot_release();
+            volmgr_fsck_progress(vol, (rc < 0) ? "failed" : "done");
+            pthread_mutex_lock(&vol->lock);
+            if (vol->state != volstate_checking) {
+                LOG_VOL("filesystem check aborted\n");
+                goto out;
+            }
+
+            if (rc < 0) {
+                LOG_VOL("%s filesystem check failed on %s\n", fs->name, dev->dev_fspath);
+                goto out_unmountable;
+            }
+            LOG_VOL("%s filesystem check of %s OK\n", fs->name, dev->dev_fspath);
         }
-        LOG_VOL("%s filesystem check of %s OK\n", fs->name, dev->dev_fspath);
     }
 
+    volmgr_apply_io_tuning(vol, dev);
+
     rc = fs->mount_fn(dev, vol);
     if (!rc) {
         LOG_VOL("Sucessfully mounted %s filesystem %s on %s\n", fs->name, dev->devpath, vol->mount_point);
@@ -26,6 +26,24 @@
 
 #define PROP_EXTERNAL_STORAGE_STATE "EXTERNAL_STORAGE_STATE"
 
+// filesystem check progress, sent to framework clients.  The volume
+// mount point and the phase (queued/started/done/failed/skipped)
+// follow the colon
+#define VOLD_EVT_FSCK_PROGRESS "volume_fsck_progress:"
+
+// pids that blocked the last unmount attempt, space separated after
+// the colon
+#define VOLD_EVT_BLOCKED_PIDS "volume_blocked_pids:"
+
+// format progress: the volume mount point and percent complete
+// follow the colon
+#define VOLD_EVT_FORMAT_PROGRESS "volume_format_progress:"
+
+// UMS pre-flush progress.  The volume mount point and the phase
+// (started/done) follow the colon; 'started' also carries the amount
+// of dirty data queued for writeback
+#define VOLD_EVT_UMS_PREPARE "volume_ums_prepare:"
+
 // these must match the corresponding states in the MediaState enum.
 // A path to the volume mount point follows the colon
 typedef enum volume_state {
@@ -79,10 +97,10 @@ struct volmgr_fstable_entry {
     int (*identify_fn) (blkdev_t *dev);
     int (*check_fn) (blkdev_t *dev);
     int (*mount_fn) (blkdev_t *dev, struct volume *vol);
+    int (*format_fn) (blkdev_t *dev, struct volume *vol);
 };
 
 struct volmgr_start_args {
-    struct volmgr_fstable_entry *fs;
     blkdev_t                    *dev;
 };
 
@@ -92,6 +110,11 @@ typedef struct volume {
     char            *mount_point;
     char            *ums_path;
 
+    // optional block-layer tuning from vold.conf, applied to the
+    // underlying disk when the volume is mounted
+    int             read_ahead_kb;
+    char            *scheduler;
+
     pthread_mutex_t          lock;
     volume_state_t           state;
     blkdev_t                 *dev;
@@ -101,6 +124,12 @@ typedef struct volume {
     boolean                  worker_running;
     pthread_mutex_t          worker_sem;
 
+    // next job for the worker, queued while it is busy so the main
+    // loop never has to wait for it
+    boolean                  pending;
+    boolean                  pending_reap;
+    blkdev_t                 *pending_dev;
+
     struct volume            *next;
 } volume_t;
 
@@ -108,8 +137,12 @@ int volmgr_consider_disk(blkdev_t *dev);
 int volmgr_notify_eject(blkdev_t *dev, void (* cb) (blkdev_t *));
 int volmgr_send_states(void);
 int volmgr_enable_ums(boolean enable);
+int volmgr_prepare_ums(void);
 int volmgr_stop_volume_by_mountpoint(char *mount_point);
 int volmgr_start_volume_by_mountpoint(char *mount_point);
+int volmgr_format_states(char *buf, int maxlen);
+int volmgr_format_volume(char *mount_point);
 
 void KillProcessesWithOpenFiles(const char* mountPoint, boolean sigkill, int *excluded, int num_excluded);
+int GetBlockingPids(int *pids, int max);
 #endif
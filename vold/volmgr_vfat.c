@@ -16,8 +16,17 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <sys/mount.h>
+#include <sys/ioctl.h>
+
+#include <linux/fs.h>
 
 #include "vold.h"
 #include "volmgr.h"
@@ -26,6 +35,17 @@
 
 #define VFAT_DEBUG 0
 
+#ifndef BLKDISCARD
+#define BLKDISCARD _IO(0x12,119)
+#endif
+
+// size of the aligned buffer each format write goes out in.  Flash
+// media performs best with writes of a few erase blocks at a time
+#define FORMAT_CHUNK (2 * 1024 * 1024)
+
+#define FAT_RESERVED_SECTORS 32
+#define FAT_NUM_FATS         2
+
 static char FSCK_MSDOS_PATH[] = "/system/bin/dosfsck";
 
 int vfat_identify(blkdev_t *dev)
@@ -115,3 +135,215 @@ int vfat_mount(blkdev_t *dev, volume_t *vol)
 #endif
     return rc;
 }
+
+static void put_le16(unsigned char *p, unsigned short v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+// cluster size in sectors by media size, per the usual FAT32
+// formatter conventions
+static unsigned int vfat_cluster_sectors(unsigned int nr_sec)
+{
+    if (nr_sec <= 532480)          // <= 260 MB
+        return 1;
+    else if (nr_sec <= 16777216)   // <= 8 GB
+        return 8;
+    else if (nr_sec <= 33554432)   // <= 16 GB
+        return 16;
+    else if (nr_sec <= 67108864)   // <= 32 GB
+        return 32;
+    return 64;
+}
+
+static void vfat_build_bootsector(unsigned char *s, unsigned int nr_sec,
+                                  unsigned int spc, unsigned int fat_sz,
+                                  unsigned int part_start)
+{
+    s[0] = 0xeb;                   // x86 jump, per spec
+    s[1] = 0x58;
+    s[2] = 0x90;
+    memcpy(&s[3], "ANDROID ", 8);  // OEM name
+    put_le16(&s[11], 512);         // bytes per sector
+    s[13] = spc;
+    put_le16(&s[14], FAT_RESERVED_SECTORS);
+    s[16] = FAT_NUM_FATS;
+    s[21] = 0xf8;                  // media descriptor (fixed disk)
+    put_le16(&s[24], 63);          // sectors per track
+    put_le16(&s[26], 255);         // heads
+    put_le32(&s[28], part_start);  // hidden sectors
+    put_le32(&s[32], nr_sec);      // total sectors (32 bit)
+    put_le32(&s[36], fat_sz);      // sectors per fat (32 bit)
+    put_le32(&s[44], 2);           // root directory cluster
+    put_le16(&s[48], 1);           // fsinfo sector
+    put_le16(&s[50], 6);           // backup boot sector
+    s[64] = 0x80;                  // BIOS drive number
+    s[66] = 0x29;                  // extended boot signature
+    put_le32(&s[67], (unsigned int) time(NULL)); // volume id
+    memcpy(&s[71], "NO NAME    ", 11);
+    memcpy(&s[82], "FAT32   ", 8);
+    s[510] = 0x55;
+    s[511] = 0xaa;
+}
+
+static void vfat_build_fsinfo(unsigned char *s, unsigned int free_clusters)
+{
+    put_le32(&s[0], 0x41615252);   // "RRaA"
+    put_le32(&s[484], 0x61417272); // "rrAa"
+    put_le32(&s[488], free_clusters);
+    put_le32(&s[492], 3);          // next free cluster hint
+    s[510] = 0x55;
+    s[511] = 0xaa;
+}
+
+static void vfat_build_fathead(unsigned char *s)
+{
+    put_le32(&s[0], 0x0ffffff8);   // entry 0: media descriptor
+    put_le32(&s[4], 0xffffffff);   // entry 1: reserved
+    put_le32(&s[8], 0x0fffffff);   // root directory EOC
+}
+
+/*
+ * Writes a fresh FAT32 filesystem onto the device.  All metadata -
+ * boot sectors, FATs and the empty root directory - lies in one run
+ * at the front of the device, so the whole format is a single
+ * sequential pass of large aligned writes: each chunk is zeroed,
+ * any metadata sectors falling inside it are built in place, and the
+ * chunk goes out in one write.  The media is asked to discard its old
+ * contents first so the controller can drop stale mappings instead of
+ * preserving them through the overwrite.
+ */
+int vfat_format(blkdev_t *dev, volume_t *vol)
+{
+    unsigned char *buf;
+    unsigned int nr_sec = dev->nr_sec;
+    unsigned int spc, fat_sz, clusters, total, done;
+    unsigned long long range[2];
+    int fd, last_pct = -1;
+    int rc = 0;
+
+    LOG_VOL("vfat_format(%s):\n", dev->dev_fspath);
+
+    if ((fd = open(dev->dev_fspath, O_RDWR | O_DIRECT)) < 0 &&
+        errno == EINVAL)
+        fd = open(dev->dev_fspath, O_RDWR);
+    if (fd < 0) {
+        LOGE("vfat_format: Unable to open '%s' (%s)\n", dev->dev_fspath,
+             strerror(errno));
+        return -errno;
+    }
+
+    if (!nr_sec || nr_sec == 0xffffffff) {
+        unsigned long sz;
+
+        if (ioctl(fd, BLKGETSIZE, &sz) < 0) {
+            LOGE("vfat_format: Unable to get device size (%s)\n",
+                 strerror(errno));
+            rc = -errno;
+            goto out;
+        }
+        nr_sec = sz;
+    }
+
+    if (nr_sec < 66560) {  // 32.5 MB, about the smallest sane FAT32
+        LOGE("vfat_format: Device too small (%u sectors)\n", nr_sec);
+        rc = -EINVAL;
+        goto out;
+    }
+
+    // let the media invalidate its old contents - best effort, older
+    // kernels and most controllers don't support it
+    range[0] = 0;
+    range[1] = (unsigned long long) nr_sec * 512;
+    if (!ioctl(fd, BLKDISCARD, range))
+        LOG_VOL("vfat_format: Discarded %llu bytes\n", range[1]);
+
+    spc = vfat_cluster_sectors(nr_sec);
+
+    // fat size per the FAT spec's estimation formula - may run an
+    // entry or two long, which every formatter tolerates
+    {
+        unsigned int tmp1 = nr_sec - FAT_RESERVED_SECTORS;
+        unsigned int tmp2 = (256 * spc + FAT_NUM_FATS) / 2;
+
+        fat_sz = (tmp1 + tmp2 - 1) / tmp2;
+    }
+    clusters = (nr_sec - FAT_RESERVED_SECTORS -
+                FAT_NUM_FATS * fat_sz) / spc;
+
+    if (!(buf = memalign(4096, FORMAT_CHUNK))) {
+        LOGE("vfat_format: Out of memory\n");
+        rc = -ENOMEM;
+        goto out;
+    }
+
+    // everything that needs writing: reserved area, both fats, and
+    // the root directory cluster
+    total = FAT_RESERVED_SECTORS + FAT_NUM_FATS * fat_sz + spc;
+    done = 0;
+
+    while (done < total) {
+        unsigned int n = FORMAT_CHUNK / 512;
+        unsigned int i;
+        int pct;
+
+        if (total - done < n)
+            n = total - done;
+        memset(buf, 0, n * 512);
+
+        for (i = 0; i < n; i++) {
+            unsigned int sec = done + i;
+
+            if (sec == 0 || sec == 6)
+                vfat_build_bootsector(&buf[i * 512], nr_sec, spc, fat_sz,
+                                      dev->part_start);
+            else if (sec == 1 || sec == 7)
+                vfat_build_fsinfo(&buf[i * 512], clusters - 1);
+            else if (sec == FAT_RESERVED_SECTORS ||
+                     sec == FAT_RESERVED_SECTORS + fat_sz)
+                vfat_build_fathead(&buf[i * 512]);
+        }
+
+        if (write(fd, buf, n * 512) != (int) (n * 512)) {
+            LOGE("vfat_format: Write failed at sector %u (%s)\n", done,
+                 strerror(errno));
+            rc = -errno;
+            free(buf);
+            goto out;
+        }
+        done += n;
+
+        pct = done * 100 / total;
+        if (pct != last_pct) {
+            char msg[288];
+
+            sprintf(msg, "%s %d", vol->mount_point, pct);
+            send_msg_with_data(VOLD_EVT_FORMAT_PROGRESS, msg);
+            last_pct = pct;
+        }
+    }
+
+    free(buf);
+
+    if (fsync(fd) < 0) {
+        LOGE("vfat_format: fsync failed (%s)\n", strerror(errno));
+        rc = -errno;
+        goto out;
+    }
+
+    LOG_VOL("vfat_format(%s): %u clusters of %u sectors\n", dev->dev_fspath,
+            clusters, spc);
+
+ out:
+    close(fd);
+    return rc;
+}